@@ -6,7 +6,8 @@
  *
  *  SYNOPSIS
  *	dbdec [-sift sift_expr] [-c calper] [-wfdir wfdir] [-f  for-
- *	mat] dbin dbout chan_maps dec_stage1 [dec_stage2 ...]
+ *	mat] [-j nthreads] [-chunk seconds] dbin dbout chan_maps
+ *	dec_stage1 [dec_stage2 ...]
  *
  *  DESCRIPTION
  *	dbdec will decimate waveform data.  This program  will  only
@@ -63,6 +64,18 @@
  *	               optional  and if it is ommited, then the out-
  *	               put format is the same as the input format.
  *	
+ *	-j nthreads    Number of channels to decimate  concurrently.
+ *	               Waveform segments written to the same  output
+ *	               file are always handled by one thread.   When
+ *	               nthreads  is  greater  than 1 the output wfdisc
+ *	               rows are written in the order channels finish,
+ *	               not input order.  The default is 1.
+ *	
+ *	-chunk seconds Waveform segments are read  and  decimated  in
+ *	               pieces  of  this  length  so memory use does
+ *	               not grow with the length of a segment.   The
+ *	               default is 3600 seconds.
+ *	
  *	dbin           The name of the input database. This argument
  *	               is required.
  *	
@@ -99,7 +112,9 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -111,10 +126,63 @@
 #include "response.h"
 #include "stock.h"
 #include "tr.h"
+#include <pthread.h>
+#include "firdec.h"
 
-Trace *read_trace();
 Trace *convert_trace();
 
+/* Work shared by the decimation threads.  Input wfdisc rows are sorted
+   by output file name and each group of rows writing to the same file
+   is handled by one thread. */
+typedef struct Decjob {
+	Dbptr dbwfi, dbo;
+	char *format;
+	char *wfdir1, *wfdir2, *dbbase;
+	Tbl *chan_in, *chan_out;
+	Tbl *ncoefs, *coefs, *dec_fac;
+	double tref;
+	double chunk;
+	int *records;
+	int *groups;
+	int ngroups;
+	int next_group;
+	int error;
+} Decjob;
+
+/* Output file state for one input wfdisc row */
+typedef struct Decout {
+	char fname[1024];
+	char dir[128];
+	char dfile[128];
+	char format[8];
+	double tstart;
+	double dt;
+	long nsamps;
+	long foff;
+	int have_carry;
+	double tcarry;
+	float carry;
+} Decout;
+
+typedef struct Outrow {
+	int record;
+	char fname[1024];
+} Outrow;
+
+/* Datascope, trgetwf and the scv2 trace routines are not thread safe.
+   All calls to them are made holding this lock. */
+static pthread_mutex_t db_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *dec_worker (void *arg);
+static FIRdec *make_decimator (Tbl *ncoefs, Tbl *coefs, Tbl *dec_fac);
+static Trace *new_float_trace (double tstart, double dt, long nsamps, char *format);
+int decimate_row (Decjob *job, int record, FIRdec *fd);
+int flush_output (FIRdec *fd, double **buf, long *nbuf, Trace **otrace, double *tout_next, double dtout, char *format);
+int append_output (Trace **otrace, double *buf, long n, double tstart, double dt, char *format);
+int write_output (Decjob *job, Decout *out, Trace *otrace);
+int add_wfdisc (Dbptr dbi, Dbptr dbo, Decout *out, Tbl *chan_in, Tbl *chan_out);
+int read_trace (Dbptr db, double tstart, double tend, Trace **trace);
+
 int main(int argc, char **argv)
 {
 	char *sift_expr, *wfdir, *format, *dbin, *dbout, *chan_maps;
@@ -140,11 +208,18 @@ int main(int argc, char **argv)
 	char wfdir1[512];
 	char wfdir2[512];
 	double time, tref;
+	int nthreads;
+	double chunk;
+	Decjob job;
+	Outrow *outrows;
+	pthread_t *threads;
+	int compare_outrow();
 
 	/* Get command line args */
 
-	if (!getargs(argc, argv, &sift_expr, &calper, &wfdir, &format, &dbin,
-				&dbout, &chan_maps, &ndec_stages, &dec_stages)) {
+	if (!getargs(argc, argv, &sift_expr, &calper, &wfdir, &format,
+				&nthreads, &chunk, &dbin, &dbout, &chan_maps,
+				&ndec_stages, &dec_stages)) {
 		usage();
 		exit (1);
 	}
@@ -265,44 +340,70 @@ int main(int argc, char **argv)
 	}
 	tref = (double)((int)tref);
 
-	/* Loop through and do the decimation */
+	/* Group the input rows by output file */
 
+	outrows = (Outrow *) malloc (n*sizeof(Outrow));
+	job.records = (int *) malloc (n*sizeof(int));
+	job.groups = (int *) malloc ((n+1)*sizeof(int));
+	if (outrows == NULL || job.records == NULL || job.groups == NULL) {
+		fprintf (stderr, "dbdec: Malloc error.\n");
+		exit (1);
+	}
 	for (dbwfi.record=0; dbwfi.record<n; dbwfi.record++) {
-		Trace *trace=NULL;
-
-		/* Read in trace and convert to float */
-
-		SCV_free_trace (trace);
-		trace = NULL;
-		trace = read_trace (dbwfi);
-		if (trace == NULL) {
-			fprintf (stderr, "dbdec: read_trace() error.\n");
-			continue;
-		}
-
-		/* Decimate float trace */
-
-		if (!decimate_trace (trace, ncoefs, coefs, dec_fac, tref)) {
-			fprintf (stderr, "dbdec: decimate_trace() error.\n");
+		outrows[dbwfi.record].record = dbwfi.record;
+		if (!makeoutfname (dbwfi, wfdir1, wfdir2, dbbase, dir, dfile,
+					outrows[dbwfi.record].fname)) {
+			fprintf (stderr, "dbdec: makeoutfname() error.\n");
 			exit (1);
 		}
+	}
+	qsort (outrows, n, sizeof(Outrow), compare_outrow);
+	for (i=0,job.ngroups=0; i<n; i++) {
+		job.records[i] = outrows[i].record;
+		if (i == 0 || strcmp(outrows[i].fname, outrows[i-1].fname))
+			job.groups[job.ngroups++] = i;
+	}
+	job.groups[job.ngroups] = n;
+	free (outrows);
 
-		/* Convert trace to output units and put back in data gaps */
+	/* Loop through and do the decimation */
 
-		trace = convert_trace (trace, format);
-		if (trace == NULL) {
-			fprintf (stderr, "dbdec: convert_trace() error.\n");
+	job.dbwfi = dbwfi;
+	job.dbo = dbo;
+	job.format = format;
+	job.wfdir1 = wfdir1;
+	job.wfdir2 = wfdir2;
+	job.dbbase = dbbase;
+	job.chan_in = chan_in_tbl;
+	job.chan_out = chan_out_tbl;
+	job.ncoefs = ncoefs;
+	job.coefs = coefs;
+	job.dec_fac = dec_fac;
+	job.tref = tref;
+	job.chunk = chunk;
+	job.next_group = 0;
+	job.error = 0;
+	if (nthreads > job.ngroups) nthreads = job.ngroups;
+	if (nthreads <= 1) {
+		dec_worker (&job);
+	} else {
+		threads = (pthread_t *) malloc (nthreads*sizeof(pthread_t));
+		if (threads == NULL) {
+			fprintf (stderr, "dbdec: Malloc error.\n");
 			exit (1);
 		}
-
-		/* Write out decimated trace and wfdisc */
-
-		makeoutfname (dbwfi, wfdir1, wfdir2, dbbase, dir, dfile, fnameo);
-		if (!write_trace (dbwfi, dbo, dir, dfile, fnameo, 
-					chan_in_tbl, chan_out_tbl, trace, overwrite)) {
-			fprintf (stderr, "dbdec: write_trace() error.\n");
-			exit (1);
+		for (i=0; i<nthreads; i++) {
+			if (pthread_create (&threads[i], NULL, dec_worker, &job)) {
+				fprintf (stderr, "dbdec: pthread_create() error.\n");
+				exit (1);
+			}
 		}
+		for (i=0; i<nthreads; i++) pthread_join (threads[i], NULL);
+		free (threads);
+	}
+	if (job.error) {
+		fprintf (stderr, "dbdec: decimation failed.\n");
+		exit (1);
 	}
 
 	/* Fix up the output sensor, sitechan, etc. tables */
@@ -687,28 +788,368 @@ int comp_responses (Dbptr db, Response *resp, Response **respo)
 }
 
 int
-write_trace (dbi, dbo, dir, dfile, fname, chan_in, chan_out, trace, overwrite)
-
-Dbptr        dbi;
-Dbptr             dbo;
-char *                 dir;
-char *                      dfile;
-char *                             fname;
-Tbl *                                     chan_in;
-Tbl *                                              chan_out;
-Trace *                                                      trace;
-int                                                                 overwrite;
+compare_outrow (Outrow *a, Outrow *b)
 
 {
+	int ret;
+
+	ret = strcmp (a->fname, b->fname);
+	if (ret) return (ret);
+	return (a->record - b->record);
+}
+
+static void *
+dec_worker (void *arg)
+
+{
+	Decjob *job=(Decjob *)arg;
+	FIRdec *fd;
+	int ig, i, ok;
+
+	fd = make_decimator (job->ncoefs, job->coefs, job->dec_fac);
+	if (fd == NULL) {
+		fprintf (stderr, "dec_worker: make_decimator() error.\n");
+		pthread_mutex_lock (&db_mutex);
+		job->error = 1;
+		pthread_mutex_unlock (&db_mutex);
+		return (NULL);
+	}
+	while (1) {
+		pthread_mutex_lock (&db_mutex);
+		if (job->error) ig = job->ngroups; else ig = job->next_group++;
+		pthread_mutex_unlock (&db_mutex);
+		if (ig >= job->ngroups) break;
+		for (i=job->groups[ig]; i<job->groups[ig+1]; i++) {
+			ok = decimate_row (job, job->records[i], fd);
+			if (!ok) {
+				pthread_mutex_lock (&db_mutex);
+				job->error = 1;
+				pthread_mutex_unlock (&db_mutex);
+				break;
+			}
+		}
+	}
+	firdec_free (fd);
+	return (NULL);
+}
+
+/* All decimation stages are applied in one pass by the streaming
+   decimator in libperf.  Data beyond the ends of a segment take the
+   value of the end sample. */
+static FIRdec *
+make_decimator (Tbl *ncoefs, Tbl *coefs, Tbl *dec_fac)
+
+{
+	FIRdec *fd;
+	int i, nstages;
+
+	fd = firdec_new (FIRDEC_EDGE_CONSTANT);
+	if (fd == NULL) return (NULL);
+	nstages = maxtbl(ncoefs);
+	for (i=0; i<nstages; i++) {
+		if (firdec_add_half_stage (fd, *((int *) gettbl (dec_fac, i)),
+				*((int *) gettbl (ncoefs, i)),
+				(float *) gettbl (coefs, i)) < 0) {
+			firdec_free (fd);
+			return (NULL);
+		}
+	}
+	return (fd);
+}
+
+/* Decimate one input wfdisc row.  The row is read chunk seconds at a time
+   and the decimator state is carried from one chunk to the next, so the
+   result does not depend on the chunk length.   The decimator is flushed
+   and restarted at data gaps.  Decimated samples are appended to the
+   output file as each chunk is done and the output wfdisc row is added
+   at the end.  Returns 0 on a fatal error. */
+int
+decimate_row (Decjob *job, int record, FIRdec *fd)
+
+{
+	Dbptr db;
+	Decout out;
+	Trace *trace, *tr, *otrace;
+	double time, endtime, samprate, dt, dtout;
+	double t0, t1, tin_next=0.0, tout_next=0.0;
+	double *buf=NULL;
+	long nbuf=0, n, nout, skip;
+	int active=0, last=0;
+
+	db = job->dbwfi;
+	db.record = record;
+	memset (&out, 0, sizeof(Decout));
+	pthread_mutex_lock (&db_mutex);
+	dbgetv (db, 0, "time", &time, "endtime", &endtime,
+				"samprate", &samprate, 0);
+	n = makeoutfname (db, job->wfdir1, job->wfdir2, job->dbbase,
+				out.dir, out.dfile, out.fname);
+	pthread_mutex_unlock (&db_mutex);
+	if (!n) {
+		fprintf (stderr, "decimate_row: makeoutfname() error.\n");
+		return (0);
+	}
+	dt = 1.0/samprate;
+	dtout = dt*firdec_decfac(fd);
+	for (t0=time; !last; t0+=job->chunk) {
+
+		/* Read in the next piece of the trace and convert to float */
+
+		t1 = t0 + job->chunk;
+		if (t1 >= endtime) {
+			/* The +dt assures that the data read are always long enough */
+			t1 = endtime + dt;
+			last = 1;
+		}
+		pthread_mutex_lock (&db_mutex);
+		n = read_trace (db, t0, t1, &trace);
+		pthread_mutex_unlock (&db_mutex);
+		if (!n) {
+			fprintf (stderr, "decimate_row: read_trace() error.\n");
+			last = 1;
+		}
+
+		/* Decimate float trace */
+
+		otrace = NULL;
+		for (tr=trace; tr!=NULL; tr=tr->next) {
+			if (out.format[0] == '\0') strcpy (out.format, tr->rawdata_format);
+			skip = 0;
+			if (active) {
+				/* Drop samples already seen and flush at gaps */
+				n = floor((tr->tstart-tin_next)/dt + 0.5);
+				if (n < 0) {
+					skip = -n;
+				} else if (n > 0) {
+					if (!flush_output (fd, &buf, &nbuf, &otrace, &tout_next,
+								dtout, out.format)) goto fail;
+					active = 0;
+				}
+			}
+			if (skip >= tr->nsamps) continue;
+			if (!active) {
+				tout_next = firdec_align (fd, tr->tstart+skip*dt, dt, job->tref);
+				active = 1;
+			}
+			n = firdec_maxout (fd, tr->nsamps-skip);
+			if (n > nbuf) {
+				if (buf) free (buf);
+				nbuf = n;
+				buf = (double *) malloc (nbuf*sizeof(double));
+				if (buf == NULL) {
+					fprintf (stderr, "decimate_row: Malloc error.\n");
+					goto fail;
+				}
+			}
+			nout = firdec_process_float (fd, tr->data+skip, tr->nsamps-skip, buf);
+			if (nout < 0) {
+				fprintf (stderr, "decimate_row: firdec_process_float() error.\n");
+				goto fail;
+			}
+			if (!append_output (&otrace, buf, nout, tout_next, dtout, out.format))
+				goto fail;
+			tout_next += nout*dtout;
+			tin_next = tr->tstart + tr->nsamps*dt;
+		}
+		if (last && active) {
+			if (!flush_output (fd, &buf, &nbuf, &otrace, &tout_next,
+						dtout, out.format)) goto fail;
+			active = 0;
+		}
+		pthread_mutex_lock (&db_mutex);
+		SCV_free_trace (trace);
+		pthread_mutex_unlock (&db_mutex);
+
+		/* Convert to output units, put back in data gaps and write */
+
+		if (otrace && !write_output (job, &out, otrace)) goto fail;
+	}
+	if (buf) free (buf);
+
+	/* Add the output wfdisc row */
+
+	if (out.nsamps > 0) {
+		pthread_mutex_lock (&db_mutex);
+		n = add_wfdisc (db, job->dbo, &out, job->chan_in, job->chan_out);
+		pthread_mutex_unlock (&db_mutex);
+		if (!n) {
+			fprintf (stderr, "decimate_row: add_wfdisc() error.\n");
+			return (0);
+		}
+	}
+	return (1);
+
+fail:	if (buf) free (buf);
+	firdec_reset (fd, 0);
+	return (0);
+}
+
+/* Drain the decimator at the end of a segment */
+int
+flush_output (FIRdec *fd, double **buf, long *nbuf, Trace **otrace, double *tout_next, double dtout, char *format)
+
+{
+	long n;
+
+	n = firdec_maxout (fd, 0);
+	if (n > *nbuf) {
+		if (*buf) free (*buf);
+		*nbuf = n;
+		*buf = (double *) malloc (n*sizeof(double));
+		if (*buf == NULL) {
+			fprintf (stderr, "flush_output: Malloc error.\n");
+			return (0);
+		}
+	}
+	n = firdec_flush (fd, *buf);
+	if (n < 0) {
+		fprintf (stderr, "flush_output: firdec_flush() error.\n");
+		return (0);
+	}
+	if (!append_output (otrace, *buf, n, *tout_next, dtout, format)) return (0);
+	*tout_next += n*dtout;
+	return (1);
+}
+
+/* Add a float trace holding n decimated samples to the end of a list */
+int
+append_output (Trace **otrace, double *buf, long n, double tstart, double dt, char *format)
+
+{
+	Trace *tr, *trn;
+	long i;
+
+	if (n <= 0) return (1);
+	trn = new_float_trace (tstart, dt, n, format);
+	if (trn == NULL) {
+		fprintf (stderr, "append_output: Malloc error.\n");
+		return (0);
+	}
+	for (i=0; i<n; i++) trn->data[i] = buf[i];
+	if (*otrace == NULL) {
+		*otrace = trn;
+		return (1);
+	}
+	for (tr=(*otrace); tr->next!=NULL; tr=tr->next);
+	tr->next = trn;
+	trn->prev = tr;
+	return (1);
+}
+
+static Trace *
+new_float_trace (double tstart, double dt, long nsamps, char *format)
+
+{
+	Trace *trace;
+	float *data;
+
+	trace = (Trace *) calloc (1, sizeof(Trace));
+	if (trace == NULL) return (NULL);
+	data = (float *) malloc (nsamps*sizeof(float));
+	if (data == NULL) {
+		free (trace);
+		return (NULL);
+	}
+	trace->tstart = tstart;
+	trace->dt = dt;
+	trace->nsamps = nsamps;
+	strcpy (trace->rawdata_format, format);
+	trace->data = data;
+	trace->data_free = data;
+	trace->data_malloc = nsamps*sizeof(float);
+	trace->raw_data = NULL;
+	trace->rawdata_free = NULL;
+	trace->rawdata_malloc = 0;
+	trace->prev = NULL;
+	trace->next = NULL;
+	return (trace);
+}
+
+/* Convert a list of decimated traces to the output format and append
+   it to the output file.   The last sample written for the previous
+   chunk is put in front of the list so gaps that span a chunk boundary
+   are filled by SCV_trace_fillgaps.  It is not written again. */
+int
+write_output (Decjob *job, Decout *out, Trace *otrace)
+
+{
+	Trace *tr, *trc;
 	FILE *fp;
 	char outdir[1024];
 	char outbase[1024];
+	int skip, size;
+	long ret;
+
+	skip = 0;
+	if (out->have_carry) {
+		trc = new_float_trace (out->tcarry, otrace->dt, 1, out->format);
+		if (trc == NULL) {
+			fprintf (stderr, "write_output: Malloc error.\n");
+			return (0);
+		}
+		trc->data[0] = out->carry;
+		trc->next = otrace;
+		otrace->prev = trc;
+		otrace = trc;
+		skip = 1;
+	}
+	for (tr=otrace; tr->next!=NULL; tr=tr->next);
+	out->carry = tr->data[tr->nsamps-1];
+	out->tcarry = tr->tstart + (tr->nsamps-1)*tr->dt;
+	out->have_carry = 1;
+
+	pthread_mutex_lock (&db_mutex);
+	otrace = convert_trace (otrace, job->format);
+	if (otrace == NULL) {
+		pthread_mutex_unlock (&db_mutex);
+		fprintf (stderr, "write_output: convert_trace() error.\n");
+		return (0);
+	}
+	pthread_mutex_unlock (&db_mutex);
+	if (out->nsamps == 0) {
+		dirbase (out->fname, outdir, outbase);
+		if (makedir(outdir) == -1) {
+			fprintf (stderr, "write_output: Unable to create %s\n", outdir);
+			return (0);
+		}
+		out->tstart = otrace->tstart;
+		out->dt = otrace->dt;
+		strcpy (out->format, otrace->rawdata_format);
+	}
+	/* Shortcoming here.  Converted from older code here to allow the
+	program to append to files.  Have not bothered to allow the program
+	to support writing output in miniseed (sd format) */
+	fp = fopen(out->fname, "a");
+	if(fp==NULL)
+	{
+		fprintf (stderr, "write_output: Open error on '%s'.\n", out->fname);
+		return (0);
+	}
+	fseek(fp,0L,SEEK_END);
+	if (out->nsamps == 0) out->foff = ftell(fp);
+	size = atoi(&otrace->rawdata_format[strlen(otrace->rawdata_format)-1]);
+	ret = fwrite((char *)otrace->raw_data+skip*size,size,otrace->nsamps-skip,fp);
+	fclose (fp);
+	if(ret != (otrace->nsamps-skip)) {
+		fprintf (stderr, "write_output: Write error on '%s'.\n", out->fname);
+		return (0);
+	}
+	out->nsamps += ret;
+	pthread_mutex_lock (&db_mutex);
+	SCV_free_trace (otrace);
+	pthread_mutex_unlock (&db_mutex);
+	return (1);
+}
+
+int
+add_wfdisc (Dbptr dbi, Dbptr dbo, Decout *out, Tbl *chan_in, Tbl *chan_out)
+
+{
 	char sta[32], chani[32], chano[32], instype[32], segtype[8];
 	char clip[8];
 	int chanid;
 	double calib, calper;
-	int i, n, size, ret;
-	long int foff;
+	int i, n;
 
         dbgetv (dbi, 0, "sta", sta, "chan", chani, "chanid", &chanid,
         		"calib", &calib, "calper", &calper,
@@ -720,30 +1161,7 @@ int                                                                 overwrite;
 		if (!strcmp(chani, gettbl(chan_in, i))) break;
 	}
 	if (i == n) {
-		fprintf (stderr, "write_trace: Unable to map input channel '%s'.\n", chani);
-		return (0);
-	}
-	dirbase (fname, outdir, outbase);
-	if (makedir(outdir) == -1) {
-                fprintf (stderr, "write_trace: Unable to create %s\n", outdir);
-                return (0);
-        }
-	/* Shortcoming here.  Converted from older code here to allow the 
-	program to append to files.  Have not bothered to allow the program
-	to support writing output in miniseed (sd format) */
-	fp = fopen(fname, "a");
-	if(fp==NULL)
-	{
-		fprintf (stderr, "write_trace: Open error on '%s'.\n", fname);
-		return (0);
-	}
-	fseek(fp,0L,SEEK_END);
-	foff = ftell(fp);
-	size = atoi(&trace->rawdata_format[strlen(trace->rawdata_format)-1]);
-	ret = fwrite(trace->raw_data,size,trace->nsamps,fp);
-	fclose (fp);
-	if(ret != (trace->nsamps)) {
-		fprintf (stderr, "write_trace: Write error on '%s'.\n", fname);
+		fprintf (stderr, "add_wfdisc: Unable to map input channel '%s'.\n", chani);
 		return (0);
 	}
         dbo.record = dbNULL;
@@ -752,22 +1170,22 @@ int                                                                 overwrite;
         dbo.record = dbSCRATCH;
 	dbputv (dbo, 0,	"sta", sta,
 			"chan", chano,
-			"time", trace->tstart,
+			"time", out->tstart,
 			"wfid", dbnextid(dbo, "wfid"),
 			"chanid", chanid,
-			"jdate", yearday(trace->tstart),
-			"endtime", trace->tstart+trace->dt*(trace->nsamps-1),
-			"nsamp", trace->nsamps,
-			"samprate", 1.0/trace->dt,
+			"jdate", yearday(out->tstart),
+			"endtime", out->tstart+out->dt*(out->nsamps-1),
+			"nsamp", out->nsamps,
+			"samprate", 1.0/out->dt,
 			"calib", calib,
 			"calper", calper,
 			"instype", instype,
 			"segtype", segtype,
-			"datatype", trace->rawdata_format,
+			"datatype", out->format,
 			"clip", clip,
-			"dir", dir,
-			"dfile", dfile,
-			"foff",foff,
+			"dir", out->dir,
+			"dfile", out->dfile,
+			"foff", out->foff,
 			0);
 	dbadd (dbo, 0);
 	return (1);
@@ -787,149 +1205,64 @@ Trace *convert_trace(Trace *trace, char *format)
 	return (trace);
 }
 
+/* Read the samples of wfdisc row db between tstart and tend.  *trace is
+   returned NULL when there are no samples in the window. */
 int
-decimate_trace (trace, ncoefs, coefs, dec_fac, tref)
-
-Trace *trace;
-Tbl *ncoefs;
-Tbl *coefs;
-Tbl *dec_fac;
-double tref;
-
-{
-	Trace *tr;
-	int i, j, nstages;
-	float *cfs;
-	int ncfs, decfac;
-	int ns, nsout, ioff;
-	float *buf=NULL;
-
-	nstages = maxtbl(ncoefs);
-	for (tr=trace; tr!=NULL; tr=tr->next) {
-		ns = tr->nsamps;
-		buf = (float *) malloc (ns*sizeof(float));
-		if (buf == NULL) {
-			fprintf (stderr, "decimate_trace: Malloc error.\n");
-			return (0);
-		}
-		for (i=0; i<nstages; i++) {
-			cfs = (float *) gettbl (coefs, i);
-			ncfs = *((int *) gettbl (ncoefs, i));
-			decfac = *((int *) gettbl (dec_fac, i));
-			ns = tr->nsamps;
-			ioff = (tr->tstart-tref)/tr->dt + 0.5;
-			ioff = decfac - (ioff%decfac);
-			if (ioff == decfac) ioff = 0;
-			convsym (tr->data, ns, cfs, ncfs, decfac, ioff, &nsout, buf);
-			tr->tstart += ioff*tr->dt;
-			tr->dt *= decfac;
-			tr->nsamps = nsout;
-			for (j=0; j<nsout; j++) tr->data[j] = buf[j];
-		}
-		free (buf);
-	}
-	return (1);
-}
-
-int
-convsym (datain, nsin, coefs, ncoefs, decfac, ioff, nsout, dataout)
-
-float *datain;
-int nsin;
-float *coefs;
-int ncoefs;
-int decfac;
-int ioff;
-int *nsout;
-float *dataout;
-
-{
-	int i, j;
-	float hold;
-	int i1, i2, n1, n2;
-
-	n1 = ncoefs-1;
-	n2 = nsin-ncoefs;
-	for (i=ioff,(*nsout)=0; i<nsin; i+=decfac,(*nsout)++) {
-		if (i >= n1 && i <= n2) {
-			hold = datain[i]*coefs[0];
-			for (j=1; j<ncoefs; j++) hold += coefs[j]*(datain[i+j]+datain[i-j]);
-		} else {
-			i1 = i - n1;
-			i2 = i + n1;
-			hold = 0.0;
-			for (j=i1; j<0; j++) hold += datain[0]*coefs[i-j];
-			for (j=nsin; j<=i2; j++) hold += datain[nsin-1]*coefs[j-i];
-			if (i1 < 0) i1 = 0;
-			if (i2 > nsin-1) i2 = nsin-1;
-			for (j=i1; j<i; j++) hold += datain[j]*coefs[i-j];
-			for (j=i; j<=i2; j++) hold += datain[j]*coefs[j-i];
-		}
-		dataout[(*nsout)] = hold;
-	}
-}
-
-Trace *
-read_trace (db)
-
-Dbptr db;
+read_trace (Dbptr db, double tstart, double tend, Trace **trace)
 
 {
 	char dtype[8];
-	int foff, nsamp,npts;
+	int nsamp,npts;
 	float *data;
-	Trace *trace;
-	double time, endtime, dt, samprate;
+	double samprate;
 	double t0,t1;
 
-	if( dbgetv (db, 0, "time", &time, "endtime", &endtime, "samprate", &samprate,
-		"nsamp", &nsamp, "datatype", dtype, "foff", &foff, 0) == dbINVALID)
+	*trace = NULL;
+	if( dbgetv (db, 0, "samprate", &samprate, "datatype", dtype, 0) == dbINVALID)
 	{
 		fprintf(stderr,"read_trace:  dbgetv error reading row %d\n",db.record);
-		return(NULL);
+		return(0);
 	}
+	nsamp = (tend-tstart)*samprate + 2;
 	allot(float *,data,nsamp);
-	/* The +dt assurs that the data read are always long enough*/
-        dt=1.0/samprate;
-	if(trgetwf(db,0,&data,&nsamp,time,endtime+dt,&t0,&t1,&npts,0,0))
+	if(trgetwf(db,0,&data,&nsamp,tstart,tend,&t0,&t1,&npts,0,0))
 	{
 		fprintf(stderr,"trgetwf error for row %d of input db\n",db.record);
-		return(NULL);
+		free (data);
+		return(0);
 	}
-	if(nsamp>npts)
-        {
-		char sta[10],chan[10];
-                dbgetv(db,0,"sta",sta,"chan",chan,0);
-		fprintf(stderr,"Warning:  %s:%s at start time %s\nExpected to read %d samples, got only %d\n",
-			sta,chan,strtime(time),nsamp,npts);
+	if(npts < 1)
+	{
+		free (data);
+		return(1);
 	}
-	trace = (Trace *) malloc (sizeof(Trace));
-	if (trace == NULL) {
+	*trace = (Trace *) malloc (sizeof(Trace));
+	if (*trace == NULL) {
 		fprintf (stderr, "read_trace: Malloc error on Trace structure.\n");
 		free (data);
-		return (NULL);
+		return (0);
 	}
-	trace->tstart = time;
-	trace->dt = 1.0/samprate;
-	trace->nsamps = nsamp;
+	(*trace)->tstart = t0;
+	(*trace)->dt = 1.0/samprate;
+	(*trace)->nsamps = npts;
 	/* Added to support miniseed format.  This may not work around gaps
 	correctly depending on how the trgetwf routine handles this. */
 	if(!strcmp(dtype,"sd"))
-		strcpy (trace->rawdata_format,"t4");
+		strcpy ((*trace)->rawdata_format,"t4");
 	else
-		strcpy (trace->rawdata_format, dtype);
-		
-	trace->data = NULL;
-	trace->data_free = NULL;
-	trace->data_malloc = 0;
-	trace->raw_data = data;
-	trace->rawdata_free = data;
-	trace->rawdata_malloc = 1;
-	trace->prev = NULL;
-	trace->next = NULL;
-	trace = (Trace *) SCV_trace_fixgaps(trace, "segment");
-        trace = (Trace *) SCV_trace_tofloat(trace, 1);
-	return (trace);
+		strcpy ((*trace)->rawdata_format, dtype);
+
+	(*trace)->data = NULL;
+	(*trace)->data_free = NULL;
+	(*trace)->data_malloc = 0;
+	(*trace)->raw_data = data;
+	(*trace)->rawdata_free = data;
+	(*trace)->rawdata_malloc = 1;
+	(*trace)->prev = NULL;
+	(*trace)->next = NULL;
+	*trace = (Trace *) SCV_trace_fixgaps(*trace, "segment");
+        *trace = (Trace *) SCV_trace_tofloat(*trace, 1);
+	return (1);
 }
 
 int zaccess(char *path, int mode)
@@ -1206,8 +1539,8 @@ Tbl **chan_out_tbl;
 }
 
 int
-getargs (argc, argv, sift_expr, calper, wfdir, format, dbin,
-	 dbout, chan_maps, ndec_stages, dec_stages)
+getargs (argc, argv, sift_expr, calper, wfdir, format, nthreads, chunk,
+	 dbin, dbout, chan_maps, ndec_stages, dec_stages)
 
 int argc;
 char **argv;
@@ -1215,6 +1548,8 @@ char **sift_expr;
 double *calper;
 char **wfdir;
 char **format;
+int *nthreads;
+double *chunk;
 char **dbin;
 char **dbout;
 char **chan_maps;
@@ -1228,6 +1563,8 @@ char ***dec_stages;
 	*calper = -1.0;
 	*wfdir = NULL;
 	*format = NULL;
+	*nthreads = 1;
+	*chunk = 3600.0;
 	for (argc--,argv++; argc>0; argc--,argv++) {
 		if (!strcmp(*argv, "-sift")) {
 			argc--; argv++;
@@ -1257,6 +1594,28 @@ char ***dec_stages;
 				return (0);
 			}
 			*format = *argv;
+		} else if (!strcmp(*argv, "-j")) {
+			argc--; argv++;
+			if (argc < 1) {
+				fprintf (stderr, "dbdec: No -j argument.\n");
+				return (0);
+			}
+			*nthreads = atoi(*argv);
+			if (*nthreads < 1) {
+				fprintf (stderr, "dbdec: Illegal -j argument.\n");
+				return (0);
+			}
+		} else if (!strcmp(*argv, "-chunk")) {
+			argc--; argv++;
+			if (argc < 1) {
+				fprintf (stderr, "dbdec: No -chunk argument.\n");
+				return (0);
+			}
+			*chunk = atof(*argv);
+			if (*chunk <= 0.0) {
+				fprintf (stderr, "dbdec: Illegal -chunk argument.\n");
+				return (0);
+			}
 		} else {
 			break;
 		}
@@ -1292,8 +1651,8 @@ usage()
 {
         cbanner("$Revision$", 
 		"dbdec [-sift sift_expr] [-c calper] [-wfdir wfdir]\n"
-		"             [-f format] dbin dbout chan_maps dec_stage1\n"
-		"             [dec_stage2 ...]\n",
+		"             [-f format] [-j nthreads] [-chunk seconds]\n"
+		"             dbin dbout chan_maps dec_stage1 [dec_stage2 ...]\n",
 		"Gary Pavlis", 
 		"Indiana University", 
 		"pavlis@geology.indiana.edu" ) ; 
@@ -123,69 +123,59 @@ decimate_trace (Trace *trace, Tbl *ncoefs, Tbl *coefs, Tbl *dec_fac, double tref
 {
 	Trace *tr;
 	int i, j, nstages;
-	float *cfs;
-	int ncfs, decfac;
-	int ns, nsout, ioff;
-	float *buf=NULL;
-
+	FIRdec *fd;
+	long nsout, nf;
+	double *buf=NULL;
+	long bufsize=0;
+
+	/* All stages are applied in one pass by the streaming decimator
+	   in libperf.  Data off the ends of a segment take the end values. */
+	fd = firdec_new (FIRDEC_EDGE_CONSTANT);
+	if (fd == NULL) {
+		fprintf (stderr, "decimate_trace: Malloc error.\n");
+		return (0);
+	}
 	nstages = maxtbl(ncoefs);
+	for (i=0; i<nstages; i++) {
+		if (firdec_add_half_stage (fd, *((int *) gettbl (dec_fac, i)),
+				*((int *) gettbl (ncoefs, i)),
+				(float *) gettbl (coefs, i)) < 0) {
+			fprintf (stderr, "decimate_trace: Bad filter stage %d.\n", i);
+			firdec_free (fd);
+			return (0);
+		}
+	}
 	for (tr=trace; tr!=NULL; tr=tr->next) {
-		ns = tr->nsamps;
-		buf = (float *) malloc (ns*sizeof(float));
-		if (buf == NULL) {
+		nsout = firdec_maxout (fd, tr->nsamps) + firdec_maxout (fd, 0);
+		if (nsout > bufsize) {
+			if (buf) free (buf);
+			bufsize = nsout;
+			buf = (double *) malloc (bufsize*sizeof(double));
+			if (buf == NULL) {
+				fprintf (stderr, "decimate_trace: Malloc error.\n");
+				firdec_free (fd);
+				return (0);
+			}
+		}
+		tr->tstart = firdec_align (fd, tr->tstart, tr->dt, tref);
+		nsout = firdec_process_float (fd, tr->data, tr->nsamps, buf);
+		nf = (nsout < 0) ? -1 : firdec_flush (fd, buf+nsout);
+		if (nf < 0) {
 			fprintf (stderr, "decimate_trace: Malloc error.\n");
+			free (buf);
+			firdec_free (fd);
 			return (0);
 		}
-		for (i=0; i<nstages; i++) {
-			cfs = (float *) gettbl (coefs, i);
-			ncfs = *((int *) gettbl (ncoefs, i));
-			decfac = *((int *) gettbl (dec_fac, i));
-			ns = tr->nsamps;
-			ioff = (tr->tstart-tref)/tr->dt + 0.5;
-			ioff = decfac - (ioff%decfac);
-			if (ioff == decfac) ioff = 0;
-			convsym (tr->data, ns, cfs, ncfs, decfac, ioff, &nsout, buf);
-			tr->tstart += ioff*tr->dt;
-			tr->dt *= decfac;
-			tr->nsamps = nsout;
-			for (j=0; j<nsout; j++) tr->data[j] = buf[j];
-		}
-		free (buf);
+		nsout += nf;
+		tr->dt *= firdec_decfac (fd);
+		tr->nsamps = nsout;
+		for (j=0; j<nsout; j++) tr->data[j] = buf[j];
 	}
+	if (buf) free (buf);
+	firdec_free (fd);
 	return (1);
 }
 
-int
-convsym (float *datain, int nsin, float *coefs, int ncoefs, int decfac, int ioff, int *nsout, float *dataout)
-
-{
-	int i, j;
-	float hold;
-	int i1, i2, n1, n2;
-
-	n1 = ncoefs-1;
-	n2 = nsin-ncoefs;
-	for (i=ioff,(*nsout)=0; i<nsin; i+=decfac,(*nsout)++) {
-		if (i >= n1 && i <= n2) {
-			hold = datain[i]*coefs[0];
-			for (j=1; j<ncoefs; j++) hold += coefs[j]*(datain[i+j]+datain[i-j]);
-		} else {
-			i1 = i - n1;
-			i2 = i + n1;
-			hold = 0.0;
-			for (j=i1; j<0; j++) hold += datain[0]*coefs[i-j];
-			for (j=nsin; j<=i2; j++) hold += datain[nsin-1]*coefs[j-i];
-			if (i1 < 0) i1 = 0;
-			if (i2 > nsin-1) i2 = nsin-1;
-			for (j=i1; j<i; j++) hold += datain[j]*coefs[i-j];
-			for (j=i; j<=i2; j++) hold += datain[j]*coefs[j-i];
-		}
-		dataout[(*nsout)] = hold;
-	}
-
-	return (0);
-}
-
 int
 add_trace (Dbptr db, double tstart, double tend, Trace *trace, Trace **traceo)
 
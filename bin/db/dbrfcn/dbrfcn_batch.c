@@ -0,0 +1,448 @@
+/* dbrfcn_batch.c   receiver functions for a whole event x station set
+	call with:  dbrfcn_batch db dbout [-pf pffile] [-n nthreads] [-v]
+	see manpages for details
+
+	Does the same calculation as dbrfcn for every origin-site pair
+	that passes the subset and distance tests.   The deconvolutions run
+	in parallel in a pool of threads using the engine in rf_engine.c.
+	Datascope and the trace library are not thread safe so all database
+	access (waveform loading in the workers, saving in the main thread)
+	is serialized with db_mutex.   Pairs are processed in batches and
+	the receiver functions of each batch are saved with one trsave_wf
+	call to an output database that is opened once.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "db.h"
+#include "tr.h"
+#include "pf.h"
+#include "tttaup.h"
+#include "coords.h"
+#include "stock.h"
+#include "rf_engine.h"
+
+/* One origin-site pair */
+typedef struct Rfpair {
+	int orid;
+	int isite;
+	double tpred;		/* predicted P time */
+	double delta;		/* degrees */
+	double baz;		/* degrees */
+	int status;		/* 0 ok, -1 no data or failed */
+	Rfoutput out;
+} Rfpair;
+
+/* Work shared by the receiver function threads */
+typedef struct Rfjob {
+	Dbptr *sitewf;		/* wfdisc/sitechan view of each site */
+	char **sitenames;
+	Rfparams *params;
+	double tst, ten;
+	Rfpair *pairs;
+	int npairs;
+	int next_pair;
+	int verbose;
+} Rfjob;
+
+/* Datascope and the trace library are not thread safe.
+   All calls to them are made holding this lock. */
+static pthread_mutex_t db_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *rf_worker (void *arg);
+int load_pair (Rfjob *job, Rfpair *pair, Rfinput *in);
+int save_batch (Rfjob *job, Dbptr dbout, Rfpair *pairs, int npairs);
+void free_input (Rfinput *in);
+
+static void
+usage ()
+{
+	fprintf (stderr, "usage: dbrfcn_batch db dbout [-pf pffile] [-n nthreads] [-v]\n");
+}
+
+int
+main (int argc, char **argv)
+{
+	char *dbname, *output_database, *pfname="dbrfcn_batch";
+	char *origin_subset, *site_subset, *chan_subset, *method;
+	char expr[512];
+	Pf *pf;
+	Dbptr db, dbo, dbs, dbwf, dbsc, dbout;
+	Rfparams params;
+	Rfjob job;
+	Rfpair *pairs;
+	pthread_t *threads;
+	int nthreads=-1, verbose=0, batch_size;
+	int norigins, nsites, npairs, nalloc, nsaved=0, nfailed=0;
+	int i, j, k, n, ib, nb;
+	double evlat, evlon, dep, evtime, slat, slon, del, az;
+	double delmin, delmax;
+	int orid;
+
+	elog_init (argc, argv);
+	if (argc < 3) {
+		usage();
+		exit (1);
+	}
+	dbname = argv[1];
+	output_database = argv[2];
+	for (i=3; i<argc; i++) {
+		if (!strcmp(argv[i], "-pf")) {
+			if (++i >= argc) { usage(); exit (1); }
+			pfname = argv[i];
+		} else if (!strcmp(argv[i], "-n")) {
+			if (++i >= argc) { usage(); exit (1); }
+			nthreads = atoi(argv[i]);
+		} else if (!strcmp(argv[i], "-v")) {
+			verbose = 1;
+		} else {
+			usage();
+			exit (1);
+		}
+	}
+	if (pfread (pfname, &pf) != 0)
+		elog_die (0, "dbrfcn_batch: pfread error for %s\n", pfname);
+	job.tst = pfget_double (pf, "tstart");
+	job.ten = pfget_double (pf, "tend");
+	params.gfreq = pfget_double (pf, "gaussfreq");
+	params.hpfreq = pfget_double (pf, "hpfreq");
+	params.phshift = pfget_double (pf, "phaseshift");
+	params.wlev = pfget_double (pf, "waterlevel");
+	params.idecim = pfget_int (pf, "decimate");
+	params.itmax = pfget_int (pf, "maximum_iterations");
+	params.minderr = pfget_double (pf, "minimum_fit_improvement");
+	method = pfget_string (pf, "deconvolution_method");
+	if (!strcmp(method, "waterlevel"))
+		params.method = RF_WATERLEVEL;
+	else if (!strcmp(method, "iterative"))
+		params.method = RF_ITERATIVE;
+	else
+		elog_die (0, "dbrfcn_batch: unknown deconvolution_method %s\n", method);
+	delmin = pfget_double (pf, "minimum_distance");
+	delmax = pfget_double (pf, "maximum_distance");
+	origin_subset = pfget_string (pf, "origin_subset");
+	site_subset = pfget_string (pf, "site_subset");
+	chan_subset = pfget_string (pf, "channel_subset");
+	batch_size = pfget_int (pf, "batch_size");
+	if (batch_size < 1) batch_size = 1;
+	if (nthreads < 0) nthreads = pfget_int (pf, "number_threads");
+	if (nthreads < 1) nthreads = 1;
+
+	if (dbopen (dbname, "r+", &db) == dbINVALID)
+		elog_die (0, "dbrfcn_batch: Unable to open database %s\n", dbname);
+	if (dbopen (output_database, "r+", &dbout) == dbINVALID)
+		elog_die (0, "dbrfcn_batch: Unable to open database %s\n", output_database);
+	dbout = dblookup (dbout, 0, "wfdisc", 0, 0);
+
+	dbo = dblookup (db, 0, "origin", 0, 0);
+	if (origin_subset != NULL && strlen(origin_subset) > 0)
+		dbo = dbsubset (dbo, origin_subset, 0);
+	dbquery (dbo, dbRECORD_COUNT, &norigins);
+	dbs = dblookup (db, 0, "site", 0, 0);
+	if (site_subset != NULL && strlen(site_subset) > 0)
+		dbs = dbsubset (dbs, site_subset, 0);
+	dbquery (dbs, dbRECORD_COUNT, &nsites);
+	if (norigins < 1 || nsites < 1)
+		elog_die (0, "dbrfcn_batch: %d origins and %d sites selected; nothing to do\n",
+				norigins, nsites);
+
+	/* Build the wfdisc/sitechan view of each site once.  Each pair then
+	   only needs a time subset of its station's view. */
+	job.sitewf = (Dbptr *) malloc (nsites*sizeof(Dbptr));
+	job.sitenames = (char **) malloc (nsites*sizeof(char *));
+	if (job.sitewf == NULL || job.sitenames == NULL)
+		elog_die (1, "dbrfcn_batch: malloc error\n");
+	dbwf = dblookup (db, 0, "wfdisc", 0, 0);
+	dbsc = dblookup (db, 0, "sitechan", 0, 0);
+	for (dbs.record=0; dbs.record<nsites; dbs.record++) {
+		char sta[32];
+		dbgetv (dbs, 0, "sta", sta, 0);
+		job.sitenames[dbs.record] = strdup (sta);
+		if (chan_subset != NULL && strlen(chan_subset) > 0)
+			sprintf (expr, "(sta == \"%s\" && %s)", sta, chan_subset);
+		else
+			sprintf (expr, "(sta == \"%s\")", sta);
+		job.sitewf[dbs.record] = dbjoin (dbsubset (dbwf, expr, 0), dbsc, 0, 0, 0, 0, 0);
+	}
+
+	/* Build the list of pairs */
+	nalloc = 1024;
+	npairs = 0;
+	pairs = (Rfpair *) malloc (nalloc*sizeof(Rfpair));
+	if (pairs == NULL) elog_die (1, "dbrfcn_batch: malloc error\n");
+	for (dbo.record=0; dbo.record<norigins; dbo.record++) {
+		dbgetv (dbo, 0, "orid", &orid, "lat", &evlat, "lon", &evlon,
+				"depth", &dep, "time", &evtime, 0);
+		evlat *= M_PI/180.0;
+		evlon *= M_PI/180.0;
+		for (dbs.record=0; dbs.record<nsites; dbs.record++) {
+			dbquery (job.sitewf[dbs.record], dbRECORD_COUNT, &n);
+			if (n < 3) continue;
+			dbgetv (dbs, 0, "lat", &slat, "lon", &slon, 0);
+			slat *= M_PI/180.0;
+			slon *= M_PI/180.0;
+			dist (slat, slon, evlat, evlon, &del, &az);
+			del *= 180.0/M_PI;
+			if (del < delmin || del > delmax) continue;
+			if (npairs >= nalloc) {
+				nalloc *= 2;
+				pairs = (Rfpair *) realloc (pairs, nalloc*sizeof(Rfpair));
+				if (pairs == NULL) elog_die (1, "dbrfcn_batch: malloc error\n");
+			}
+			memset (&pairs[npairs], 0, sizeof(Rfpair));
+			pairs[npairs].orid = orid;
+			pairs[npairs].isite = dbs.record;
+			pairs[npairs].delta = del;
+			pairs[npairs].baz = az*180.0/M_PI;
+			pairs[npairs].tpred = evtime + ptime(del, dep);
+			npairs++;
+		}
+	}
+	if (verbose) elog_notify (0, "dbrfcn_batch: %d origins %d sites %d pairs\n",
+			norigins, nsites, npairs);
+
+	job.params = &params;
+	job.verbose = verbose;
+	threads = (pthread_t *) malloc (nthreads*sizeof(pthread_t));
+	if (threads == NULL) elog_die (1, "dbrfcn_batch: malloc error\n");
+	for (ib=0; ib<npairs; ib+=batch_size) {
+		nb = npairs - ib;
+		if (nb > batch_size) nb = batch_size;
+		job.pairs = pairs + ib;
+		job.npairs = nb;
+		job.next_pair = 0;
+		k = (nthreads > nb) ? nb : nthreads;
+		if (k <= 1) {
+			rf_worker (&job);
+		} else {
+			for (j=0; j<k; j++) {
+				if (pthread_create (&threads[j], NULL, rf_worker, &job)) {
+					elog_die (1, "dbrfcn_batch: pthread_create() error.\n");
+				}
+			}
+			for (j=0; j<k; j++) pthread_join (threads[j], NULL);
+		}
+		n = save_batch (&job, dbout, job.pairs, nb);
+		nsaved += n;
+		nfailed += nb - n;
+		if (verbose) elog_notify (0, "dbrfcn_batch: %d of %d pairs done, %d saved\n",
+				ib+nb, npairs, nsaved);
+	}
+	elog_notify (0, "dbrfcn_batch: %d receiver function pairs saved, %d pairs skipped\n",
+			nsaved, nfailed);
+	free (threads);
+	free (pairs);
+	dbclose (dbout);
+	dbclose (db);
+	return 0;
+}
+
+static void *
+rf_worker (void *arg)
+
+{
+	Rfjob *job=(Rfjob *)arg;
+	Rfwork *w;
+	Rfinput in;
+	Rfpair *pair;
+	int ip;
+
+	w = rfwork_new ();
+	while (1) {
+		pthread_mutex_lock (&db_mutex);
+		ip = job->next_pair++;
+		pthread_mutex_unlock (&db_mutex);
+		if (ip >= job->npairs) break;
+		pair = &(job->pairs[ip]);
+		pair->status = -1;
+		if (load_pair (job, pair, &in) != 0) continue;
+		if (rf_compute (w, job->params, &in, &(pair->out)) == 0)
+			pair->status = 0;
+		free_input (&in);
+	}
+	rfwork_free (w);
+	return (NULL);
+}
+
+/* Load the three components for a pair.  Returns 0 on success. */
+int
+load_pair (Rfjob *job, Rfpair *pair, Rfinput *in)
+{
+	Dbptr dbwf, dbsort_view, tr;
+	char expr[256], chan[16], time_str[32], endtime_str[32];
+	char *sta;
+	double t0, t1, t0dat, t1dat, samprate, calib, hang, vang;
+	int ic, nwf, nsamp, ret=-1;
+	float *data;
+	Tbl *sortkeys;
+
+	memset (in, 0, sizeof(Rfinput));
+	sta = job->sitenames[pair->isite];
+	t0 = pair->tpred + job->tst;
+	t1 = pair->tpred + job->ten;
+	pthread_mutex_lock (&db_mutex);
+	sprintf (expr, "(time < %f && endtime > %f)", t1, t0);
+	dbwf = dbsubset (job->sitewf[pair->isite], expr, 0);
+	dbquery (dbwf, dbRECORD_COUNT, &nwf);
+	if (nwf != 3) {
+		if (job->verbose)
+			elog_complain (0, "orid %d sta %s:  %d channels, need 3; skipped\n",
+					pair->orid, sta, nwf);
+		dbfree (dbwf);
+		pthread_mutex_unlock (&db_mutex);
+		return (-1);
+	}
+	for (dbwf.record=0; dbwf.record<nwf; dbwf.record++) {
+		dbgetv (dbwf, 0, "time", &t0dat, "nsamp", &nsamp, "samprate", &samprate, 0);
+		t1dat = t0dat + (double)(nsamp-1)/samprate;
+		if (t0 < t0dat) t0 = t0dat;
+		if (t1 > t1dat) t1 = t1dat;
+	}
+	sortkeys = strtbl ("sta", "chan", "time", 0);
+	dbsort_view = dbsort (dbwf, sortkeys, 0, 0);
+	freetbl (sortkeys, 0);
+	tr = dbinvalid ();
+	sprintf (time_str, "%f", t0);
+	sprintf (endtime_str, "%f", t1);
+	if (t1 <= t0 || trload_css (dbsort_view, time_str, endtime_str, &tr, 0, 0) < 0) {
+		elog_complain (0, "orid %d sta %s:  problems loading traces; skipped\n",
+				pair->orid, sta);
+		if (tr.database >= 0) {
+			tr.table = dbALL;
+			trfree (tr);
+		}
+		dbfree (dbsort_view);
+		dbfree (dbwf);
+		pthread_mutex_unlock (&db_mutex);
+		return (-1);
+	}
+	trsplit (tr, 0, 0);
+	tr = dblookup (tr, 0, "trace", 0, 0);
+	dbquery (tr, dbRECORD_COUNT, &nwf);
+	if (nwf != 3) {
+		if (job->verbose)
+			elog_complain (0, "orid %d sta %s:  gaps, %d traces; skipped\n",
+					pair->orid, sta, nwf);
+	} else {
+		ret = 0;
+		for (tr.record=0; tr.record<nwf; tr.record++) {
+			dbgetv (tr, 0, "chan", chan, "data", &data, "nsamp", &nsamp,
+					"samprate", &samprate, "calib", &calib,
+					"hang", &hang, "vang", &vang, 0);
+			switch (chan[2]) {
+			case 'E':
+				ic = RF_EAST;
+				break;
+			case 'N':
+				ic = RF_NORTH;
+				break;
+			case 'Z':
+				ic = RF_VERTICAL;
+				break;
+			default:
+				ic = -1;
+			}
+			if (ic < 0 || in->data[ic] != NULL || nsamp < 2) {
+				ret = -1;
+				break;
+			}
+			in->data[ic] = (float *) malloc (nsamp*sizeof(float));
+			if (in->data[ic] == NULL) elog_die (1, "load_pair: malloc error\n");
+			memcpy (in->data[ic], data, nsamp*sizeof(float));
+			in->nsamp[ic] = nsamp;
+			in->calib[ic] = calib;
+			in->hang[ic] = hang;
+			in->vang[ic] = vang;
+			in->samprate = samprate;
+		}
+		if (ret != 0) {
+			elog_complain (0, "orid %d sta %s:  channels are not Z, N, E; skipped\n",
+					pair->orid, sta);
+			free_input (in);
+		}
+	}
+	in->baz = pair->baz;
+	tr.table = dbALL;
+	trfree (tr);
+	dbfree (dbsort_view);
+	dbfree (dbwf);
+	pthread_mutex_unlock (&db_mutex);
+	return (ret);
+}
+
+void
+free_input (Rfinput *in)
+{
+	int i;
+
+	for (i=0; i<3; i++) {
+		if (in->data[i] != NULL) free (in->data[i]);
+		in->data[i] = NULL;
+	}
+}
+
+/* Save the radial and tangential receiver functions of a batch of pairs
+   with a single trsave_wf.  As in dbrfcn the time is set so the
+   predicted P time is at zero lag and calib holds the rescaling factor.
+   Returns the number of pairs with both traces saved. */
+int
+save_batch (Rfjob *job, Dbptr dbout, Rfpair *pairs, int npairs)
+{
+	char *outpath = "wfrf/%Y/%j/%{sta}.%{chan}.%Y:%j:%H:%M:%S";
+	Dbptr tr;
+	Rfpair *pair;
+	double tt, endtime;
+	int i, j, nadded, nrows=0, nsaved=0, nwfo, nwf, wfid;
+	float *data;
+
+	pthread_mutex_lock (&db_mutex);
+	tr = trnew (0, 0);
+	tr = dblookup (tr, 0, "trace", 0, 0);
+	for (i=0; i<npairs; i++) {
+		pair = &(pairs[i]);
+		if (pair->status != 0) continue;
+		tt = pair->tpred - job->params->phshift;
+		endtime = tt + (double)(pair->out.nsamp-1)/pair->out.samprate;
+		nadded = 0;
+		for (j=0; j<2; j++) {
+			data = (j == 0) ? pair->out.rfr : pair->out.rft;
+			tr.record = dbaddv (tr, 0,
+				"sta", job->sitenames[pair->isite],
+				"chan", (j == 0) ? "rfcn" : "rf_T",
+				"time", tt,
+				"endtime", endtime,
+				"nsamp", pair->out.nsamp,
+				"samprate", pair->out.samprate,
+				"calib", pair->out.zamp,
+				"datatype", "t4",
+				0);
+			if (tr.record < 0) {
+				elog_complain (0, "save_batch: dbaddv error for orid %d sta %s\n",
+						pair->orid, job->sitenames[pair->isite]);
+				free (data);
+				continue;
+			}
+			/* the trace table owns the data from here and trfree releases it */
+			dbputv (tr, 0, "data", data, 0);
+			nadded++;
+		}
+		pair->out.rfr = pair->out.rft = NULL;
+		nrows += nadded;
+		if (nadded == 2) nsaved++;
+	}
+	dbquery (dbout, dbRECORD_COUNT, &nwfo);
+	if (nrows > 0 && trsave_wf (tr, dbout, "t4", outpath, 0))
+		elog_die (0, "save_batch: Couldn't save waveforms\n");
+	dbquery (dbout, dbRECORD_COUNT, &nwf);
+	for (dbout.record=nwfo; dbout.record<nwf; dbout.record++) {
+		wfid = dbnextid (dbout, "wfid");
+		dbputv (dbout, 0, "wfid", wfid, 0);
+	}
+	tr.table = dbALL;
+	trfree (tr);
+	pthread_mutex_unlock (&db_mutex);
+	return (nsaved);
+}
@@ -0,0 +1,467 @@
+/* rf_engine.c   receiver function compute engine for dbrfcn_batch
+
+	Numerically this follows dbrfcn:  the same FFT decimation, rotation,
+	detrend, water level spectral division, gaussian and high pass
+	filters, phase shift, sign convention, and rescaling by the peak of
+	the Z/Z receiver function.  The differences are in how the work is
+	organized:
+
+	1.  Buffers live in an Rfwork structure and are reused.
+	2.  The filter response (gaussian * high pass * phase shift) is
+	    cached per FFT length instead of recomputed with cos/sin/exp/pow
+	    for every bin of every deconvolution.
+	3.  Calibration, orientation correction, rotation and detrending
+	    of all three components are done in one pass over the samples.
+	4.  Z is transformed once and its water leveled inverse is shared
+	    by the R, T and Z deconvolutions (dbrfcn does six forward FFTs
+	    per pair; this does three).
+	5.  Traces are padded to the first length of at least twice the
+	    data with only the factors 2, 3, 5 and 7 instead of twice the
+	    next power of 2, and the transforms use a cached libfft plan.
+
+	An iterative time domain deconvolution (Ligorria and Ammon, 1999)
+	is also available.  It fits the radial (or tangential) component
+	with a sum of spikes convolved with the filtered vertical.  The
+	cross correlation of the residual with Z is updated from the Z
+	autocorrelation after each spike so each iteration costs one pass
+	over the allowed lags instead of a pair of FFTs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stock.h"
+#include "rf_engine.h"
+
+extern void cfftr(), cfftri();
+
+static int
+next_pow2 (int n)
+{
+	int i;
+
+	for (i=2; i<n; i*=2);
+	return (i);
+}
+
+static float *
+grow (float *x, int n)
+{
+	if (x != NULL) free (x);
+	x = (float *) malloc (n*sizeof(float));
+	if (x == NULL) elog_die (1, "rf_engine: malloc error for %d floats\n", n);
+	return (x);
+}
+
+Rfwork *
+rfwork_new ()
+
+{
+	Rfwork *w;
+
+	w = (Rfwork *) calloc (1, sizeof(Rfwork));
+	if (w == NULL) elog_die (1, "rfwork_new: malloc error\n");
+	return (w);
+}
+
+void
+rfwork_free (Rfwork *w)
+
+{
+	if (w == NULL) return;
+	if (w->r) free (w->r);
+	if (w->t) free (w->t);
+	if (w->z) free (w->z);
+	if (w->w) free (w->w);
+	if (w->c) free (w->c);
+	if (w->s) free (w->s);
+	if (w->filter) free (w->filter);
+	if (w->fwork) free (w->fwork);
+	if (w->ownplan) fftplan_free (w->plan);
+	free (w);
+}
+
+/* Make sure all buffers hold at least n floats */
+static void
+rfwork_size (Rfwork *w, int n)
+{
+	if (n <= w->nalloc) return;
+	w->r = grow (w->r, n);
+	w->t = grow (w->t, n);
+	w->z = grow (w->z, n);
+	w->w = grow (w->w, n);
+	w->c = grow (w->c, n);
+	w->s = grow (w->s, n);
+	w->nalloc = n;
+}
+
+/* Get a libfft plan for real transforms of length nfft and
+   FFT scratch space for this thread */
+static void
+rfwork_plan (Rfwork *w, int nfft)
+{
+	int nwork;
+
+	if (w->plan != NULL && w->plan->n == nfft) return;
+	if (w->ownplan) fftplan_free (w->plan);
+	w->ownplan = 0;
+	/* The shared cache is bounded.  When it is full keep a private plan. */
+	w->plan = fftplan_get (nfft, 1);
+	if (w->plan == NULL) {
+		w->plan = fftplan_new (nfft, 1);
+		w->ownplan = 1;
+	}
+	if (w->plan == NULL) elog_die (0, "rfwork_plan: cannot plan FFT length %d\n", nfft);
+	nwork = fftplan_worksize (w->plan);
+	if (nwork > w->nfwork) {
+		w->fwork = grow (w->fwork, nwork);
+		w->nfwork = nwork;
+	}
+}
+
+/* Build (or reuse) the complex filter for length nfft.  The filter
+   includes the inverse FFT scaling and the dbrfcn sign convention. */
+static void
+rfwork_filter (Rfwork *w, Rfparams *p, int nfft, double delta)
+{
+	int k, nbins;
+	double f, df, famp, phs, scale;
+
+	if (w->filter != NULL && w->nfft == nfft && w->delta == delta
+			&& w->gfreq == p->gfreq && w->hpfreq == p->hpfreq
+			&& w->phshift == p->phshift) return;
+	if (w->filter) free (w->filter);
+	w->filter = (float *) malloc ((nfft+2)*sizeof(float));
+	if (w->filter == NULL) elog_die (1, "rfwork_filter: malloc error\n");
+	nbins = nfft/2;
+	df = 1.0/(delta*(double)nfft);
+	scale = -1.0/(double)nfft;
+	for (k=0; k<=nbins; k++) {
+		f = k*df;
+		famp = scale;
+		if (p->gfreq > 0.0) famp *= exp(-0.5*f*f/p->gfreq/p->gfreq);
+		if (p->hpfreq > 0.0) famp *= pow(f*f/(f*f+p->hpfreq*p->hpfreq), 3.);
+		phs = (p->phshift > 0.0) ? -2.0*M_PI*f*p->phshift : 0.0;
+		w->filter[2*k] = famp*cos(phs);
+		w->filter[2*k+1] = famp*sin(phs);
+	}
+	/* zero out nyquist frequency, just to be safe */
+	w->filter[nfft] = 0.0;
+	w->filter[nfft+1] = 0.0;
+	w->nfft = nfft;
+	w->delta = delta;
+	w->gfreq = p->gfreq;
+	w->hpfreq = p->hpfreq;
+	w->phshift = p->phshift;
+
+	/* Impulse response peak = amplitude of the Z/Z receiver function
+	   of the iterative method */
+	memcpy (w->c, w->filter, (nfft+2)*sizeof(float));
+	fftplan_inverse (w->plan, w->c, w->fwork);
+	w->fpeak = 0.0;
+	for (k=0; k<nfft; k++)
+		if (fabs((double)w->c[k]) > w->fpeak) w->fpeak = fabs((double)w->c[k]);
+}
+
+/* Decimate x (n samples) in place as trdecimate does:  FFT, 6 pole zero
+   phase Butterworth at half the new nyquist, and truncated inverse.
+   Returns the new number of samples or -1. */
+static int
+rf_decimate (Rfwork *w, float *x, int n, int idecim)
+{
+	int i, length2, nout, lengthout;
+	double freq, fcorner, famp;
+	float *result;
+
+	length2 = 2*next_pow2(n);
+	nout = n / idecim;
+	if (nout < 2) return (-1);
+	lengthout = 2*next_pow2(nout);
+	rfwork_size (w, length2+2);
+	result = w->c;
+	for (i=0; i<n; i++) result[i] = x[i];
+	for (i=n; i<length2; i++) result[i] = x[0];
+	cfftr (result, length2);
+	fcorner = (double)lengthout/2.0;
+	for (i=0, freq=0.; i<lengthout; i+= 2, freq+= 2.0) {
+		famp = freq*freq/(fcorner*fcorner);
+		famp = 1./( (famp+1)*((famp+1)*(famp+1) - 3.*famp) );
+		result[i] *= famp;
+		result[i+1] *= famp;
+	}
+	result[lengthout] = 0.;
+	result[lengthout+1] = 0.;
+	cfftri (result, lengthout);
+	for (i=0; i<nout; i++) x[i] = result[i]*(2.0/lengthout);
+	return (nout);
+}
+
+/* Remove least squares line from x given the sums over n samples */
+static void
+remove_trend (float *x, int n, double sy, double sxy)
+{
+	double sx, sx2, slope, intercept;
+	int i;
+
+	sx = 0.5*(double)n*(double)(n-1);
+	sx2 = (double)(n-1)*(double)n*(double)(2*n-1)/6.0;
+	slope = (sxy - sx*sy/n)/(sx2 - sx*sx/n);
+	intercept = sy/n - slope*sx/n;
+	for (i=0; i<n; i++) x[i] -= intercept + slope*i;
+}
+
+/* Calibrate, correct orientation, rotate to R and T, and detrend in one
+   pass.  Results are left zero padded to nfft in w->r, w->t, w->z. */
+static void
+rf_rotate_detrend (Rfwork *w, Rfinput *in, int n, int nfft)
+{
+	double rpd = 0.017453293;
+	double cal[3], cosz, sine, cose, sinn, cosn, cosphi, sinphi;
+	double e, nn, z, dn, de, rr, tt;
+	double sr, sxr, st, sxt, sz, sxz;
+	float *edata, *ndata, *zdata;
+	int i;
+
+	for (i=0; i<3; i++) cal[i] = (in->calib[i] != 0.0) ? in->calib[i] : 1.0;
+	cosz = (in->vang[RF_VERTICAL] < -360.) ? 1.0 : cos(in->vang[RF_VERTICAL]*rpd);
+	if (in->hang[RF_EAST] < -360.) {
+		sine = 1.;
+		cose = 0.;
+	} else {
+		sine = sin(in->hang[RF_EAST]*rpd);
+		cose = cos(in->hang[RF_EAST]*rpd);
+	}
+	if (in->hang[RF_NORTH] < -360.) {
+		sinn = 0.;
+		cosn = 1.;
+	} else {
+		sinn = sin(in->hang[RF_NORTH]*rpd);
+		cosn = cos(in->hang[RF_NORTH]*rpd);
+	}
+	cosphi = cos(in->baz*rpd);
+	sinphi = sin(in->baz*rpd);
+	edata = in->data[RF_EAST];
+	ndata = in->data[RF_NORTH];
+	zdata = in->data[RF_VERTICAL];
+	sr = sxr = st = sxt = sz = sxz = 0.0;
+	for (i=0; i<n; i++) {
+		e = edata[i]*cal[RF_EAST];
+		nn = ndata[i]*cal[RF_NORTH];
+		z = zdata[i]*cal[RF_VERTICAL]*cosz;
+		dn = cosn*nn + cose*e;
+		de = sinn*nn + sine*e;
+		rr = dn*cosphi + de*sinphi;
+		tt = -(de*cosphi - dn*sinphi);
+		w->r[i] = rr;
+		w->t[i] = tt;
+		w->z[i] = z;
+		sr += rr;
+		sxr += i*rr;
+		st += tt;
+		sxt += i*tt;
+		sz += z;
+		sxz += i*z;
+	}
+	remove_trend (w->r, n, sr, sxr);
+	remove_trend (w->t, n, st, sxt);
+	remove_trend (w->z, n, sz, sxz);
+	for (i=n; i<nfft+2; i++) w->r[i] = w->t[i] = w->z[i] = 0.0;
+}
+
+/* x = x*y for complex spectra of nfft/2+1 bins */
+static void
+cmult (float *x, float *y, int nfft)
+{
+	int i;
+	float re;
+
+	for (i=0; i<=nfft; i+=2) {
+		re = x[i]*y[i] - x[i+1]*y[i+1];
+		x[i+1] = x[i]*y[i+1] + x[i+1]*y[i];
+		x[i] = re;
+	}
+}
+
+/* Water level deconvolution.  On entry r, t, z hold spectra. */
+static void
+rf_waterlevel (Rfwork *w, Rfparams *p, int nfft)
+{
+	int i;
+	double amp, ampmax, wlev1, br, bi, temp;
+
+	/* w->w = 1/B with B the water leveled Z spectrum */
+	ampmax = 0.;
+	if (p->wlev > 0.) {
+		for (i=0; i<=nfft; i+=2) {
+			amp = sqrt(w->z[i]*w->z[i]+w->z[i+1]*w->z[i+1]);
+			if (amp > ampmax) ampmax = amp;
+		}
+	}
+	wlev1 = p->wlev*ampmax;
+	for (i=0; i<=nfft; i+=2) {
+		br = w->z[i];
+		bi = w->z[i+1];
+		if (p->wlev > 0.) {
+			amp = sqrt(br*br+bi*bi);
+			if (amp < wlev1 && amp > 0.) {
+				br *= wlev1/amp;
+				bi *= wlev1/amp;
+			}
+		}
+		temp = br*br+bi*bi;
+		if (temp == 0.0) {
+			w->w[i] = w->w[i+1] = 0.0;
+		} else {
+			w->w[i] = br/temp;
+			w->w[i+1] = -bi/temp;
+		}
+	}
+	cmult (w->w, w->filter, nfft);
+	cmult (w->r, w->w, nfft);
+	cmult (w->t, w->w, nfft);
+	cmult (w->z, w->w, nfft);
+	fftplan_inverse (w->plan, w->r, w->fwork);
+	fftplan_inverse (w->plan, w->t, w->fwork);
+	fftplan_inverse (w->plan, w->z, w->fwork);
+}
+
+/* Fit x by spikes convolved with z.   On entry x holds the filtered
+   spectrum of the numerator and w->w the autocorrelation of the filtered
+   Z (time domain, nfft samples).  Ez is w->w[0].  On exit x holds the
+   filtered spike train in the time domain.  Returns spikes used. */
+static int
+rf_iterate (Rfwork *w, Rfparams *p, float *x, float *fz, int nfft)
+{
+	int i, k, lag, maxlag, nit;
+	double ez, er0, er, erlast, amp, cmax;
+	float *c = w->c, *a = w->w, *s = w->s;
+
+	/* cross correlation of numerator with Z:  X * conj(FZ) */
+	for (i=0; i<=nfft; i+=2) {
+		c[i] = x[i]*fz[i] + x[i+1]*fz[i+1];
+		c[i+1] = x[i+1]*fz[i] - x[i]*fz[i+1];
+	}
+	/* energy of filtered numerator by Parseval */
+	er0 = x[0]*x[0] + x[nfft]*x[nfft];
+	for (i=2; i<nfft; i+=2) er0 += 2.0*(x[i]*x[i]+x[i+1]*x[i+1]);
+	er0 /= (double)nfft;
+	fftplan_inverse (w->plan, c, w->fwork);
+	for (i=0; i<nfft; i++) c[i] *= 1.0/nfft;
+	ez = a[0];
+	for (i=0; i<nfft+2; i++) s[i] = 0.0;
+	maxlag = nfft/2;
+	er = erlast = er0;
+	for (nit=0; nit<p->itmax && ez > 0.0 && er0 > 0.0; nit++) {
+		lag = 0;
+		cmax = 0.0;
+		for (i=0; i<maxlag; i++) {
+			if (fabs((double)c[i]) > cmax) {
+				cmax = fabs((double)c[i]);
+				lag = i;
+			}
+		}
+		if (cmax == 0.0) break;
+		amp = c[lag]/ez;
+		s[lag] += amp;
+		er -= amp*c[lag];
+		for (i=0; i<maxlag; i++) {
+			k = i - lag;
+			if (k < 0) k += nfft;
+			c[i] -= amp*a[k];
+		}
+		if (100.0*(erlast-er)/er0 < p->minderr) {
+			nit++;
+			break;
+		}
+		erlast = er;
+	}
+	memcpy (x, s, (nfft+2)*sizeof(float));
+	fftplan_forward (w->plan, x, w->fwork);
+	cmult (x, w->filter, nfft);
+	fftplan_inverse (w->plan, x, w->fwork);
+	return (nit);
+}
+
+/* Iterative time domain deconvolution.  On entry r, t, z hold spectra. */
+static int
+rf_iterative (Rfwork *w, Rfparams *p, int nfft)
+{
+	int i, nr, nt;
+	float re, fr, fi;
+
+	/* Filter all three with the amplitude part of the filter.   Any
+	   phase shift cancels in the correlations. */
+	for (i=0; i<=nfft; i+=2) {
+		fr = w->filter[i];
+		fi = w->filter[i+1];
+		re = sqrt(fr*fr + fi*fi);
+		w->r[i] *= re; w->r[i+1] *= re;
+		w->t[i] *= re; w->t[i+1] *= re;
+		w->z[i] *= re; w->z[i+1] *= re;
+	}
+	/* autocorrelation of filtered Z */
+	for (i=0; i<=nfft; i+=2) {
+		w->w[i] = w->z[i]*w->z[i] + w->z[i+1]*w->z[i+1];
+		w->w[i+1] = 0.0;
+	}
+	fftplan_inverse (w->plan, w->w, w->fwork);
+	for (i=0; i<nfft; i++) w->w[i] *= 1.0/nfft;
+	nr = rf_iterate (w, p, w->r, w->z, nfft);
+	nt = rf_iterate (w, p, w->t, w->z, nfft);
+	return (nr > nt ? nr : nt);
+}
+
+/* Compute radial and tangential receiver functions for one pair.
+   Returns 0 on success, -1 if there is too little data. */
+int
+rf_compute (Rfwork *w, Rfparams *p, Rfinput *in, Rfoutput *out)
+{
+	int i, n, nfft;
+	double delta, samprate, zamp;
+
+	memset (out, 0, sizeof(Rfoutput));
+	samprate = in->samprate;
+	n = in->nsamp[0];
+	for (i=1; i<3; i++) if (in->nsamp[i] < n) n = in->nsamp[i];
+	if (n < 4 || samprate <= 0.0) return (-1);
+	if (p->idecim > 0) {
+		for (i=0; i<3; i++) {
+			in->nsamp[i] = rf_decimate (w, in->data[i], in->nsamp[i], p->idecim);
+			if (in->nsamp[i] < 2) return (-1);
+		}
+		samprate /= (double)p->idecim;
+		n = in->nsamp[0];
+		for (i=1; i<3; i++) if (in->nsamp[i] < n) n = in->nsamp[i];
+	}
+	delta = 1.0/samprate;
+	nfft = fftplan_goodsize (2*n);
+	rfwork_size (w, nfft+2);
+	rfwork_plan (w, nfft);
+	rfwork_filter (w, p, nfft, delta);
+	rf_rotate_detrend (w, in, n, nfft);
+	fftplan_forward (w->plan, w->r, w->fwork);
+	fftplan_forward (w->plan, w->t, w->fwork);
+	fftplan_forward (w->plan, w->z, w->fwork);
+	if (p->method == RF_ITERATIVE) {
+		out->niter = rf_iterative (w, p, nfft);
+		zamp = w->fpeak;
+	} else {
+		rf_waterlevel (w, p, nfft);
+		zamp = 0.0;
+		for (i=0; i<n; i++)
+			if (fabs((double)w->z[i]) > zamp) zamp = fabs((double)w->z[i]);
+	}
+	out->rfr = (float *) malloc (n*sizeof(float));
+	out->rft = (float *) malloc (n*sizeof(float));
+	if (out->rfr == NULL || out->rft == NULL)
+		elog_die (1, "rf_compute: malloc error\n");
+	if (zamp <= 0.0) zamp = 1.0;
+	for (i=0; i<n; i++) {
+		out->rfr[i] = w->r[i]/zamp;
+		out->rft[i] = w->t[i]/zamp;
+	}
+	out->nsamp = n;
+	out->samprate = samprate;
+	out->zamp = zamp;
+	return (0);
+}
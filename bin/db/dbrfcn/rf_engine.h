@@ -0,0 +1,79 @@
+/* rf_engine.h   receiver function compute engine for dbrfcn_batch
+
+	The engine does the work of trdecimate, trdemean, rot, mytr_detrend
+	and rfcn_calc for one station-event pair without touching the
+	database, so many pairs can be processed in parallel.  All scratch
+	space and the frequency domain filters are held in an Rfwork
+	structure that is reused from one pair to the next.  One Rfwork
+	is needed per thread.
+ */
+#ifndef _RF_ENGINE_H_
+#define _RF_ENGINE_H_
+
+#include "fftplan.h"
+
+#define RF_WATERLEVEL	0
+#define RF_ITERATIVE	1
+
+/* Component order used in Rfinput */
+#define RF_EAST		0
+#define RF_NORTH	1
+#define RF_VERTICAL	2
+
+typedef struct Rfparams {
+	double phshift;		/* time shift of output (s) */
+	double wlev;		/* water level (fraction of peak) */
+	double gfreq;		/* gaussian low pass corner (Hz) */
+	double hpfreq;		/* high pass corner (Hz) */
+	int idecim;		/* decimation factor (0 for none) */
+	int method;		/* RF_WATERLEVEL or RF_ITERATIVE */
+	int itmax;		/* iterative:  maximum number of spikes */
+	double minderr;		/* iterative:  stop when fit improves less (%) */
+} Rfparams;
+
+/* Three components of one pair as loaded from the database */
+typedef struct Rfinput {
+	float *data[3];
+	int nsamp[3];
+	double calib[3];
+	double hang[3];
+	double vang[3];
+	double samprate;
+	double baz;		/* rotation angle in degrees */
+} Rfinput;
+
+/* Results for one pair.  rfr and rft are malloced. */
+typedef struct Rfoutput {
+	float *rfr;		/* radial receiver function (chan rfcn) */
+	float *rft;		/* tangential receiver function (chan rf_T) */
+	int nsamp;
+	double samprate;
+	double zamp;		/* amplitude rescaling (saved in calib) */
+	int niter;		/* spikes used by iterative method */
+} Rfoutput;
+
+typedef struct Rfwork {
+	int nalloc;		/* size of each buffer below (floats) */
+	float *r, *t, *z;	/* components, then their spectra */
+	float *w;		/* water level or autocorrelation */
+	float *c;		/* scratch and cross correlation */
+	float *s;		/* spike train */
+	/* Filter cache.  The gaussian, high pass, and phase shift
+	   responses depend only on nfft, sample interval, and the
+	   parameters so they are computed once and reused. */
+	int nfft;
+	double delta;
+	double gfreq, hpfreq, phshift;
+	float *filter;		/* complex response, nfft+2 floats */
+	double fpeak;		/* peak of the filter impulse response */
+	FFTplan *plan;		/* libfft plan for nfft */
+	int ownplan;		/* plan came from fftplan_new, not the cache */
+	float *fwork;		/* FFT scratch space */
+	int nfwork;
+} Rfwork;
+
+Rfwork *rfwork_new (void);
+void rfwork_free (Rfwork *w);
+int rf_compute (Rfwork *w, Rfparams *p, Rfinput *in, Rfoutput *out);
+
+#endif
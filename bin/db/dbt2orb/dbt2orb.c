@@ -15,6 +15,7 @@
 #include "db.h"
 #include "stock.h"
 #include "orb.h"
+#include "tablewatch.h"
 
 int loop;
 
@@ -23,21 +24,64 @@ void done(int signal)
    printf("\nCaught SIGINT, no more iterations. \n",signal);
  }
 
+/* Send records first through last-1 of the input table that pass the
+   (optional) subset expression.  This replaces building a subset view
+   of the whole table on every iteration:  only the new rows are
+   evaluated.  Returns the number of records sent. */
+
+int send_records(Dbptr dbinput, Dbptr dbscratch, Expression *ex,
+                 long first, long last, int orb, char *orbname,
+                 char *rowtemp, int verbose)
+ { Dbptr db;
+   long  keep;
+   int   nsent = 0;
+
+   db = dbinput;
+   for (db.record=first; db.record<last; db.record++)
+     { if (ex != NULL)
+         { if ( dbex_eval( db, ex, 0, &keep) < 0 )
+              { elog_complain(0,"subset expression failed for record %ld.\n",
+                              db.record);
+                continue;
+              }
+           if (!keep) continue;
+         }
+       if (verbose) printf("writing record %ld to orb...\n",db.record); 
+
+       /* copy the row into the scratch record of the input database,
+          so the packet never refers to a view */
+       if ( dbget( db,        rowtemp) == dbINVALID ) elog_die(1,"dbget error.\n");
+       if ( dbput( dbscratch, rowtemp) == dbINVALID ) elog_die(1,"dbput error.\n");
+
+       if ( db2orbpkt( dbscratch, orb ) < 0 )
+          { elog_complain( 0, "Couldn't write record #%ld to %s.\n",
+            	   db.record, orbname); } 
+       nsent++;
+     }
+   return nsent;
+ }
+
 int main(int argc, char **argv)
- { Pf 		*pf;
-   char		*orbname,
+ { char		*orbname,
 		*dbname,
 		*expr,
 		*table,
 		*rowtemp,
+		*filename,
                 verbose;
    int  	orb,
-		totalrecords,
-		records,
- 		record;
-   Dbptr  	db,
-		dbinput,
+		naptime,
+		watchmode,
+		watchid,
+		totalrecords;
+   long		records,
+		first,
+		last;
+   double	poll_interval;
+   Dbptr  	dbinput,
 		dbscratch;
+   Expression	*ex;
+   Tablewatch	*tw;
 
   elog_init(argc,argv);		
 
@@ -45,8 +89,11 @@ int main(int argc, char **argv)
 
   verbose = 0;
   expr = NULL;
+  ex = NULL;
   loop = 0;
-  record = 0;
+  naptime = -1;
+  watchmode = TABLEWATCH_AUTO;
+  poll_interval = 1.0;
   totalrecords = 0;
 
   rowtemp = malloc(ROW_MAX_LENGTH);
@@ -58,10 +105,17 @@ int main(int argc, char **argv)
   { int c;
     unsigned char errflg = 0;
 
-    while (( c = getopt( argc, argv, "vl:s:")) != -1)
+    while (( c = getopt( argc, argv, "vl:s:P:")) != -1)
         switch (c) {
-          case 'l': loop = atoi(optarg);
-                    sigset(SIGINT,done);
+          case 'l': naptime = atoi(optarg);
+                    /* -l 0 is a single pass as it always has been */
+                    if (naptime > 0)
+                     { loop = 1;
+                       sigset(SIGINT,done);
+                     }
+                    break;
+          case 'P': poll_interval = atof(optarg);
+                    watchmode = TABLEWATCH_POLL;
                     break;
           case 's': expr = optarg;
                     break;
@@ -73,7 +127,7 @@ int main(int argc, char **argv)
     if ( (argc - optind) != 3 ) errflg++;
 
     if (errflg) 
-       { elog_die(0,"usage: %s [-v] [-s subset] [-l delay] db table orb\n",argv[0]); 
+       { elog_die(0,"usage: %s [-v] [-s subset] [-l delay [-P poll_interval]] db table orb\n",argv[0]); 
        }
     
     dbname = argv[optind++];
@@ -96,53 +150,74 @@ int main(int argc, char **argv)
    { elog_die(1,"Couldn't lookup the scratch record in the database \"%s\".\n",
 		dbname); }
   
-  if ( dbquery( dbinput, dbRECORD_COUNT, &records) < 0 )
-   { elog_die(1,"dbquery dbRECORD_COUNT failed.\n"); }
+  if ( expr != NULL && dbex_compile( dbinput, expr, &ex, dbBOOLEAN) < 0 )
+   { elog_die(1,"Couldn't compile subset expression \"%s\".\n",expr); }
 
   orb      = orbopen( orbname, "w&" );
 
   if ( orb == -1 )
    { elog_die(1,"Couldn't open the orb, \"%s\".\n",orbname); }
 
-  if (loop == 0) loop = -1;
+  /* Register the table file before the first pass, so rows added
+     while the first pass runs are picked up by the watch. */
+  tw = NULL;
+  watchid = -1;
+  if (loop && dbquery( dbinput, dbTABLE_FILENAME, &filename) < 0)
+   { elog_complain(1,"dbquery dbTABLE_FILENAME failed for %s; "
+                     "making a single pass.\n", table);
+     loop = 0;
+   }
+  if (loop)
+   { tw = tablewatch_new( watchmode, poll_interval );
+     watchid = tablewatch_add( tw, filename, 0 );
+     if (verbose)
+        printf("following %s %s\n", filename,
+               tablewatch_is_event_driven(tw) ? "with inotify" : "by polling");
+   }
 
-  while (loop)
-   { db = dbinput;
-     
-     if ( expr != NULL) db = dbsubset( db, expr, 0 );
-     
-     db.record = record;
-
-     if ( dbquery( db, dbRECORD_COUNT, &records) < 0 )
-   	 elog_die(1,"dbquery dbRECORD_COUNT failed.\n");  
-     
-     for (;db.record<records;db.record++)
-       { if (verbose) printf("writing record %d to orb...\n",db.record); 
-
-         /* copy the row from what could be a view into the scratch record of the
-            input database, so as to avoid putting a view on the ORB */
-         if ( dbget( db,        rowtemp) == dbINVALID ) elog_die(1,"dbget error.\n");
-         if ( dbput( dbscratch, rowtemp) == dbINVALID ) elog_die(1,"dbput error.\n");
-
-         if ( db2orbpkt( dbscratch, orb ) < 0 )
-            { elog_complain( 0, "Couldn't write record #%d to %s.\n",
-              	   db.record, orbname); } 
-         totalrecords++;
-       }
+  if ( dbquery( dbinput, dbRECORD_COUNT, &records) < 0 )
+   { elog_die(1,"dbquery dbRECORD_COUNT failed.\n"); }
 
-     record = db.record; 
+  totalrecords += send_records( dbinput, dbscratch, ex, 0L, records, orb,
+                                orbname, rowtemp, verbose );
+  if (tw != NULL) tablewatch_commit( tw, watchid, records );
 
-     /* if a subset expression was supplied, then we're working with
-        a view, which should be freed. */
+  /* With -l, wait for the table file to change instead of sleeping and
+     rescanning.  Only records appended since the last pass are read.
+     naptime is now only the longest time between checks. */
 
-     if ( expr != NULL) dbfree(db);
-     if ( loop == -1 ) loop = 0;
-     sleep(loop);
+  while (loop)
+   { tablewatch_wait( tw, (double) naptime, 0.0 );
+     if (!loop) break;
+
+     switch ( tablewatch_check( tw, watchid, &first, &last ) )
+      { case TABLEWATCH_APPENDED:
+          /* make Datascope notice the new records */
+          if ( dbquery( dbinput, dbRECORD_COUNT, &records) < 0 )
+             elog_die(1,"dbquery dbRECORD_COUNT failed.\n");  
+          if (last > records) last = records;
+          totalrecords += send_records( dbinput, dbscratch, ex, first, last,
+                                        orb, orbname, rowtemp, verbose );
+          tablewatch_commit( tw, watchid, last );
+          break;
+        case TABLEWATCH_SHRUNK:
+          elog_complain(0,"table %s shrank to %ld records; "
+                          "continuing after the last record.\n", table, last);
+          tablewatch_commit( tw, watchid, last );
+          break;
+        case TABLEWATCH_MODIFIED:
+          if (verbose) printf("existing rows of %s changed; not resent.\n",
+                              table);
+          break;
+        default:
+          break;
+      }
    } 
 
   printf("posted %d records from database %s to orb %s.\n",totalrecords,dbname,orbname);
+  if (tw != NULL) tablewatch_free(tw);
+  if (ex != NULL) dbex_free(ex);
   dbclose(dbinput);
   orbclose(orb); 
   free(rowtemp);
  }
-
@@ -408,6 +408,8 @@ void handle_next_event( long orid, string phase_to_analyze, Widget w, SessionMan
 	{
 		const string base_error("handle_next_event:  ");
 		mdfinder.put("orid",orid);
+		/* Background prefetch threads may be using the database */
+		std::unique_lock<std::mutex> dblock(psm->xpe->database_lock());
 		list<long> recs=psm->dbh.find(mdfinder);
 		if(recs.size()<=0)
 		{
@@ -430,6 +432,7 @@ void handle_next_event( long orid, string phase_to_analyze, Widget w, SessionMan
 			throw SeisppError(base_error
 				+string("error reading origin data from input db"));
 		}
+		dblock.unlock();
 
 		psm->set_evid(evid);
 		psm->set_orid(orid);
@@ -701,6 +704,49 @@ void handle_next_ensemble(string phase_to_analyze,Widget w,SessionManager *psm)
 	}
 }
 
+/* Reads ahead in the control stream and asks the processing engine to
+load upcoming events in the background while the analyst works on
+the current one.  Events requesting a phase other than the current one 
+are not prefetched because the analysis setting will change before 
+they are loaded. */
+void prefetch_upcoming_events(SessionManager *psm)
+{
+        const string method("tttaup");
+        const string model("iasp91");
+	int maxdepth=psm->xpe->prefetch_depth();
+	if(maxdepth<=0) return;
+	while((psm->lookahead.size()<maxdepth) && psm->instream.good())
+	{
+		long orid;
+		string phase;
+		psm->instream >> orid;
+		psm->instream >> phase;
+		if(psm->instream.fail()) break;
+		psm->lookahead.push_back(pair<long,string>(orid,phase));
+	}
+	list<pair<long,string> >::iterator lptr;
+	for(lptr=psm->lookahead.begin();lptr!=psm->lookahead.end();++lptr)
+	{
+		if(lptr->second!=psm->get_phase()) continue;
+		Metadata mdfinder;
+		mdfinder.put("orid",lptr->first);
+		double lat,lon,depth,otime;
+		{
+			std::lock_guard<std::mutex> dblock(psm->xpe->database_lock());
+			list<long> recs=psm->dbh.find(mdfinder);
+			if(recs.size()!=1) continue;
+			Dbptr db=psm->dbh.db;
+			db.record=*(recs.begin());
+			if(dbgetv(db,0,"lat",&lat,
+				"lon",&lon,
+				"depth",&depth,
+				"time",&otime,NULL)==dbINVALID) continue;
+		}
+		Hypocenter h(rad(lat),rad(lon),depth,otime,method,model);
+		if(!psm->xpe->prefetch(h)) break;
+	}
+}
+
 void get_next_event(Widget w, void * client_data, void * userdata)
 {
 	int orid;
@@ -712,11 +758,20 @@ void get_next_event(Widget w, void * client_data, void * userdata)
 	XcorEngineMode mode=psm->get_processing_mode();
 	if(mode==ContinuousDB)
 	{
-	    if(psm->instream.good())
+	    if(psm->lookahead.size()>0)
+	    {
+		orid=psm->lookahead.front().first;
+		phase_to_analyze=psm->lookahead.front().second;
+		psm->lookahead.pop_front();
+		handle_next_event( orid, phase_to_analyze, w, psm );
+		prefetch_upcoming_events(psm);
+	    }
+	    else if(psm->instream.good())
 	    {
 		psm->instream >> orid;
 		psm->instream >> phase_to_analyze;
 		handle_next_event( orid, phase_to_analyze, w, psm );
+		prefetch_upcoming_events(psm);
 	    }
 	}
 	else
@@ -10,6 +10,7 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <list>
 #include <map>
 /* Seismic library base include needed here before Xm includes.
 * Something is wrong in Xm include files that makes this necessary.
@@ -81,6 +82,9 @@ public:
     Widget tweeker_widget;  // Auxiliary seisw window for repair work
     ofstream log_stream;  //log file stream
     ifstream instream;
+    /* orid:phase pairs read ahead from instream so the engine can
+    load them in the background (see XcorProcessingEngine::prefetch) */
+    list<pair<long,string> > lookahead;
 
     XcorProcessingEngine * xpe;
     MultichannelCorrelator *mcc;
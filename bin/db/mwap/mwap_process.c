@@ -381,6 +381,7 @@ void mwap_process(Dbptr dbv,char *phase,  Pf *pf)
 	pmarray = NULL;
 	errarray = NULL;
 	si = pfget_double(pf,"sample_interval");
+	set_mwtransform_threads(pfget_int(pf,"mwtransform_threads"));
 	/* First we need to load the multiwavelet functions and the 
 	associated decimators for the transform.  Each of these
 	routines will die if serious problems occur and have no
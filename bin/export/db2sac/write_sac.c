@@ -9,6 +9,7 @@
 #include "csstime.h"
 #include "dbl2.h"
 #include "ahsac.h"
+#include "wfswap.h"
 
 #define BINARY (TRUE)
 #define CSS_28        (1)
@@ -17,29 +18,18 @@
 
 extern Trace   *SCV_get_rawtrace (SCV * scv, double tstart, double tend);
 
+/* SAC files are written in the byte order requested by intel */
+static int
+sac_swap_needed (int intel)
+{
+    return wf_swap_needed (intel ? WF_LITTLE_ENDIAN : WF_BIG_ENDIAN);
+}
+
 static void
 swap_sac (int intel, sac_t * sachdr)
 {
-    int             swap;
-    char           *s;
-
-#ifdef WORDS_BIGENDIAN
-    if (intel) {
-	swap = 1;
-    } else {
-	swap = 0;
-    }
-#else
-    if (intel) {
-	swap = 0;
-    } else {
-	swap = 1;
-    }
-#endif
-
-    if (swap) {
-	s = (char *) sachdr;
-	swap4 (s, s, 110);
+    if (sac_swap_needed (intel)) {
+	wf_swap4 (sachdr, 110);
     }
 }
 
@@ -81,7 +71,6 @@ char           *wfdir;
     Trace          *trace,
                    *original;
     double          calib;
-    float          *fp;
 
     /* Dummy variables for retrieving data.  */
     double          dummy_double;
@@ -457,12 +446,7 @@ char           *wfdir;
 	    fprintf (stderr, "\tExecution continuing.\n");
 	}
 	/* write the SAC data */
-	fp = seg_data;
-	if (intel) {
-	    hf2vf (seg_data, &fp, num_samps);
-	} else {
-	    hf2mf (seg_data, &fp, num_samps);
-	}
+	wf_float_to_f4 (seg_data, seg_data, num_samps, sac_swap_needed (intel));
 	if (fwrite ((char *) seg_data, sizeof (float), num_samps, outfile)
 		!= num_samps) {
 	    fprintf (stderr, "WARNING (output_data):  ");
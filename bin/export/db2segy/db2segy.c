@@ -30,6 +30,10 @@ Updated: 2014 with SEGY Rev1 compatibility
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <assert.h>
 #include "stock.h"
 #include "coords.h"
@@ -38,6 +42,7 @@ Updated: 2014 with SEGY Rev1 compatibility
 #include "pf.h"
 #include "elog.h"
 #include "segy.h"
+#include "wfswap.h"
 #include "deviants.h"
 #define min(a,b) ((a) <= (b) ? (a) : (b))
 /* Newer compilers will complain if these prototypes are not defined.
@@ -628,8 +633,120 @@ void repair_gaps(Dbptr trdb)
 }
 
 
+/* Output is assembled one shot at a time in a single contiguous block
+holding, for each channel in output order, the 240 byte trace header
+followed by the samples.  That is exactly the layout of the file, so a
+shot is written with one system call.  Two blocks are used.  While one
+is being written by a separate thread the next shot is read from the
+database into the other, so reading and writing overlap. */
+typedef struct ShotBlock {
+	char *buf;		/* page aligned */
+	size_t nbytes;
+	int first_trace;	/* sequence number of first trace for errors */
+} ShotBlock;
+
+typedef struct SegyWriter {
+	int fd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	ShotBlock *pending;	/* block being written, NULL when idle */
+	int done;
+} SegyWriter;
 
+static void
+write_block(int fd, ShotBlock *blk)
+{
+	char *p = blk->buf;
+	size_t nleft = blk->nbytes;
+	ssize_t n;
+
+	while(nleft > 0)
+	{
+		n = write(fd,p,nleft);
+		if(n < 0)
+		{
+			if(errno == EINTR) continue;
+			elog_die(1,"Write error for shot block starting at trace %d\n",
+				blk->first_trace);
+		}
+		p += n;
+		nleft -= (size_t)n;
+	}
+}
+
+static void *
+segy_writer_thread(void *arg)
+{
+	SegyWriter *w = (SegyWriter *)arg;
+	ShotBlock *blk;
 
+	for(;;)
+	{
+		pthread_mutex_lock(&(w->lock));
+		while((w->pending == NULL) && !(w->done))
+			pthread_cond_wait(&(w->cond),&(w->lock));
+		blk = w->pending;
+		pthread_mutex_unlock(&(w->lock));
+		if(blk == NULL) break;
+		write_block(w->fd,blk);
+		pthread_mutex_lock(&(w->lock));
+		w->pending = NULL;
+		pthread_cond_broadcast(&(w->cond));
+		pthread_mutex_unlock(&(w->lock));
+	}
+	return(NULL);
+}
+
+static void
+segy_writer_start(SegyWriter *w, int fd)
+{
+	w->fd = fd;
+	w->pending = NULL;
+	w->done = 0;
+	pthread_mutex_init(&(w->lock),NULL);
+	pthread_cond_init(&(w->cond),NULL);
+	if(pthread_create(&(w->thread),NULL,segy_writer_thread,(void *)w))
+		elog_die(1,"Cannot create output thread\n");
+}
+
+/* Wait until the previous block has been written, then hand blk to the
+writer.  On return the other block is free to be refilled. */
+static void
+segy_writer_submit(SegyWriter *w, ShotBlock *blk)
+{
+	pthread_mutex_lock(&(w->lock));
+	while(w->pending != NULL)
+		pthread_cond_wait(&(w->cond),&(w->lock));
+	w->pending = blk;
+	pthread_cond_broadcast(&(w->cond));
+	pthread_mutex_unlock(&(w->lock));
+}
+
+static void
+segy_writer_finish(SegyWriter *w)
+{
+	pthread_mutex_lock(&(w->lock));
+	while(w->pending != NULL)
+		pthread_cond_wait(&(w->cond),&(w->lock));
+	w->done = 1;
+	pthread_cond_broadcast(&(w->cond));
+	pthread_mutex_unlock(&(w->lock));
+	pthread_join(w->thread,NULL);
+	pthread_mutex_destroy(&(w->lock));
+	pthread_cond_destroy(&(w->cond));
+}
+
+static void
+alloc_shot_block(ShotBlock *blk, size_t nbytes)
+{
+	void *p;
+	if(posix_memalign(&p,(size_t)4096,nbytes))
+		elog_die(1,"Cannot alloc %ld byte shot buffer\n",(long)nbytes);
+	blk->buf = (char *)p;
+	blk->nbytes = nbytes;
+	blk->first_trace = 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -644,7 +761,12 @@ int main(int argc, char **argv)
 	int nchan;
 	char *stest;
 
-	float **traces;
+	ShotBlock blocks[2];
+	int iblock=0;
+	size_t trace_bytes;
+	SegyWriter writer;
+	/* segy samples are always big endian */
+	int swap_samples=wf_swap_needed(WF_BIG_ENDIAN);
 	char text_file_header[SEGY_TEXT_HEADER_SIZE];
 	Dbptr db, trdb, dbj;
 	Dbptr trdbss;
@@ -652,7 +774,7 @@ int main(int argc, char **argv)
 	double time0, endtime0, samprate0;
 	long int nsamp;
 	double samprate;
-	int i,j;
+	int i;
 	char stime[30],etime[30];
 	char s[128];
 	double tlength;
@@ -931,18 +1053,12 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* memory allocation for trace data.  This is a large matrix
-	that is cleared for each event.  This model works because of
-	segy's fixed length format.*/
-	traces = calloc(nchan, sizeof(float*));
-	if(traces == NULL)
-		elog_die(1,"out of memory");
-	for (int r = 0; r < nchan; r++)
-	{
-		traces[r] = calloc(nsamp0, sizeof(float));
-		if(traces[r] == NULL)
-			elog_die(1,"out of memory");
-	}
+	/* memory allocation for trace data.  Each shot block is a large
+	matrix of headers and samples that is cleared for each event.  This
+	model works because of segy's fixed length format.*/
+	trace_bytes = sizeof(SEGYTraceHeader) + sizeof(float)*(size_t)nsamp0;
+	alloc_shot_block(&(blocks[0]),trace_bytes*(size_t)nchan);
+	alloc_shot_block(&(blocks[1]),trace_bytes*(size_t)nchan);
 	header = (SEGYTraceHeader *)calloc((size_t)nchan,sizeof(SEGYTraceHeader));
 	if(header == NULL)
 			elog_die(0,"Cannot alloc memory for %d segy header workspace\n",nchan);
@@ -976,6 +1092,10 @@ int main(int argc, char **argv)
 			elog_die(1,"Write error for binary reel header");
 		}
 	}
+	/* Everything after this goes through the writer thread */
+	if(fflush(fp))
+		elog_die(1,"Write error on file headers");
+	segy_writer_start(&writer,fileno(fp));
 
 	/* Now we enter a loop over stdin reading start times.
 	Program will blindly ask for data from each start time to
@@ -988,6 +1108,8 @@ int main(int argc, char **argv)
 		double slat,slon,selev;  /* Used when reading source location*/
 		if(Verbose)
 			elog_notify(0,"Processing:  %s\n",s);
+		/* zero bits are 0.0 in either byte order */
+		memset(blocks[iblock].buf,0,blocks[iblock].nbytes);
 		for(i=0;i<nchan;++i)
 		{
 			initialize_trace_header(&(header[i]), segy_format);
@@ -1005,7 +1127,6 @@ int main(int argc, char **argv)
 			}
 			header[i].event_number   = htonl(shotid);
 			header[i].energySourcePt = htonl(shotid);
-			for(j=0;j<nsamp0;++j)  traces[i][j] = htonf((Trsample)0.0);
 		}
 		if(input_source_coordinates)
 		{
@@ -1121,9 +1242,10 @@ int main(int argc, char **argv)
 					ntohl(header[ichan].reelSeq),
 					shotid, evid);
 				header[ichan].traceID = get_trace_id_code_from_segtype(segtype);
-				for(j=0;j<nsamp;++j) {
-				   traces[ichan][j] = htonf((float)trdata[j]);
-				}
+				wf_float_to_f4(blocks[iblock].buf
+					+ trace_bytes*(size_t)ichan
+					+ sizeof(SEGYTraceHeader),
+					trdata,nsamp,swap_samples);
 				/* header fields coming from trace table */
 				header[ichan].samp_rate = htonl(
 						(int32_t) (1000000.0/samprate0));
@@ -1263,19 +1385,19 @@ int main(int argc, char **argv)
 			}
 
 		}
-		/* Now we write the data */
+		/* Now we hand the data to the writer and switch blocks */
 		for(i=0;i<nchan;++i)
-		{
-			if(fwrite((void *)(&(header[i])),sizeof(SEGYTraceHeader),1,fp) != 1)
-				elog_die(0,"Write error on header for trace %d\n",total_traces+i);
-			if(fwrite((void *)traces[i],sizeof(float),
-					(size_t)nsamp0,fp) != nsamp0)
-				elog_die(0,"Write error while writing data for trace %d\n",
-					total_traces+i);
-		}
+			memcpy(blocks[iblock].buf + trace_bytes*(size_t)i,
+				&(header[i]),sizeof(SEGYTraceHeader));
+		blocks[iblock].first_trace = total_traces;
+		segy_writer_submit(&writer,&(blocks[iblock]));
+		iblock = 1 - iblock;
 		total_traces += nchan;
 		trdestroy(&trdb);
 		if(!input_source_coordinates) ++shotid;
 	}
+	segy_writer_finish(&writer);
+	if(fclose(fp))
+		elog_die(1,"Error closing output file %s\n",outfile);
 	return 0 ;
 }
@@ -4,6 +4,7 @@
 #include "stock.h"
 #include "db.h"
 #include "sac.h"
+#include "wfswap.h"
 
 #define SAC_NULL_FLOAT -12345.0
 #define SAC_NULL_INT   -12345
@@ -36,9 +37,7 @@ swap_sac (sac_t * sachdr)
 #endif
     } else {
 	/* swap */
-	char           *s;
-	s = (char *) sachdr;
-	swap4 (s, s, 110);
+	wf_swap4 (sachdr, 110);
 
 #ifdef WORDS_BIGENDIAN
 	intel = 1;
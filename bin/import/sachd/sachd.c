@@ -6,6 +6,7 @@
 #include "stock.h"
 #include "db.h"
 #include "libsac.h"
+#include "wfswap.h"
 
 #define SAC_NULL_FLOAT -12345.0
 
@@ -38,9 +39,7 @@ swap_sac (SAC * sachdr)
 #endif
     } else {
 	/* swap */
-	char           *s;
-	s = (char *) sachdr;
-	swap4 (s, s, 110);
+	wf_swap4 (sachdr, 110);
 
 #ifdef WORDS_BIGENDIAN
 	intel = 1;
@@ -238,10 +238,14 @@ record for orid %ld prefor of event %ld\n",
         		elog_complain(0, "parameter ellipse_type %s incorrect (must be F_dist or chi_square)--default to chi_square", modtype );
         		model = CHI_SQUARE;
      		}
+		/* predicted_errors and project_covariance use libperf,
+		which may be running pmel for other clusters at the same time */
+		pmel_perf_lock();
 		predicted_errors(h[i],ta[i],utbl,o,C,emodel);
     		rc = project_covariance( C, model, &conf,
                              h[i].rms_weighted, h[i].degrees_of_freedom,
                              &smajax, &sminax, &strike, &sdepth, &stime );
+		pmel_perf_unlock();
 
     		if( rc != 0 )
     		{
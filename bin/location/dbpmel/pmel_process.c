@@ -76,6 +76,90 @@ enum FREEZE_METHOD get_freeze_method(Pf *pf)
 	}
 	return(result);
 }
+/* Returns the number of threads used to run clusters, set by the
+pmel_threads parameter.  0 means one per processor.  Default is 1,
+which processes clusters one at a time as dbpmel always did. */
+static int get_pmel_threads(Pf *pf)
+{
+	char *s;
+	int nthreads;
+	s=pfget_string(pf,"pmel_threads");
+	if(s==NULL) return(1);
+	nthreads=atoi(s);
+	if(nthreads<0)
+	{
+		elog_notify(0,"Illegal value %d for pmel_threads parameter\nDefault to 1",
+			nthreads);
+		nthreads=1;
+	}
+	return(nthreads);
+}
+/* Writes the results for one cluster returned by the pool to the 
+database and releases it.  This is the part of the original
+processing loop that followed the call to pmel. */
+static void dbpmel_save_cluster(Pmel_cluster *c, Dbptr db, Dbptr dbcs,
+	char *gridname, char *runname, Pf *pf)
+{
+	int k,pmelfail;
+
+	/* smatrix is not created when no path anomaly corrections could
+	be computed.  That was already reported by pmel_cluster. */
+	if(c->smatrix==NULL)
+	{
+		free_Pmel_cluster(c);
+		return;
+	}
+	if(c->status)
+	{
+		elog_notify(0,
+		  "No solution from pmel for cluster id = %ld\n",
+			c->gridid);
+		free_Pmel_cluster(c);
+		return;
+	}
+	fprintf(stdout,"Cluster id=%ld pmel convergence reason\n",
+		c->gridid);
+	for(k=0,pmelfail=0;k<maxtbl(c->converge);++k)
+	{
+		char *swork;
+		swork = (char *)gettbl(c->converge,k);
+		fprintf(stdout,"%s\n",swork);
+
+		/* The string ABORT in the convergence list
+		is used to flag a failure. */
+		if(strstr(swork,"ABORT")!=NULL) pmelfail=1;
+	}
+	if(!pmelfail)
+	{
+		dbpmel_save_sc(c->gridid,db,c->smatrix,pf);
+
+
+		if(dbpmel_save_results(db,c->nevents,c->evid,c->h0,
+			c->ta,c->o,pf))
+
+		{
+			elog_complain(0,"Problems saving results\
+for cluster id %ld\n",
+				c->gridid);
+		}
+
+
+		/* Missing function here should update
+		hypocentroid row */
+
+		if(dbaddv(dbcs,0,"gridid",c->gridid,
+			"gridname", gridname,
+			"pmelrun",runname,
+			"sswrodgf",c->smatrix->sswrodgf,
+			"ndgf",c->smatrix->ndgf,
+			"sdobs",c->smatrix->rmsraw,NULL ) == dbINVALID)
+		{
+			elog_complain(0,"dbaddv error for gridid %ld adding to gridstat table\n",
+			c->gridid);
+		}
+	}
+	free_Pmel_cluster(c);
+}
 
 
 /* this is the main processing routine for dbpmel.  It takes an input
@@ -121,6 +205,11 @@ alter the view.  The view is next sorted by the key
 gridid:evid:sta:phase with a dbUNIQUE to prevent redundant picks on
 multiple channels. 
 
+Clusters are independent, so with pmel_threads other than 1 several
+are run at once by a pool of threads (see pmel(3)).  All
+database reads and writes are still done here, and results are saved
+in gridlist order.
+
 Author:  Gary Pavlis
 Written:  Fall 2000
 */
@@ -137,7 +226,7 @@ int dbpmel_process(Dbptr db, Tbl *gridlist,Pf *pf)
 	/* Hold station table.   We make the array table empty always. */
 	Arr *stations;
 	int nbcs;
-	int i,j,k;
+	int i,j;
 	Tbl *grptbl;
 	Tbl *grdidtbl;
 	Dbptr dbevid_grp;  /* dbgroup pointers */
@@ -151,25 +240,21 @@ int dbpmel_process(Dbptr db, Tbl *gridlist,Pf *pf)
 			allow a simple loop through an event group.*/
 	Hypocenter *h0;  
 	long *evid;  /* parallel array to h0 of event ids for each h0[i]*/
-	Hypocenter hypocentroid;
 	/* The associative array here is loaded from the pf and contains
 	information on which events are to be treated as calibration events.
 	The fixlist array of character strings is passed to pmel as a 
 	parallel of vectors defining events with fixed coordinates */
 	Arr *events_to_fix;
-	/* This is the structure that encapsulates all the station
-	correction elements.  WARNING: it is built up in pieces below,
-	and later modifications most handle this carefully.*/
-	SCMatrix *smatrix;
-	Tbl *converge=NULL,*pmelhistory=NULL;
 	Arr *arr_phase_3D;
 	/* needed for output db tables */
 	char *runname, *gridname;
-	int pmelfail;
 	Tbl *phaselist;
+	/* Clusters are run by this pool of threads */
+	Pmel_pool *pool;
+	Pmel_cluster *c;
+	int nthreads,maxpending;
 
 
-	initialize_hypocenter(&hypocentroid);
 	runname = pfget_string(pf,"pmel_run_name");
 	gridname = pfget_string(pf,"gridname");
 
@@ -214,11 +299,9 @@ option which is know to cause problems\nrecenter set off\n");
 	edit_phase_handle(arr_phase,phaselist);
 	edit_phase_handle(arr_phase_3D,phaselist);
 
-	/* load the station table and use it to create the station
-	indexes for the smatrix structure and setup the result
-	vectors stored there.*/
+	/* load the station table.  Each cluster builds its own 
+	smatrix structure from it.*/
 	stations = pmel_dbload_stations(db,pf);
-	smatrix = create_SCMatrix(stations,arr_phase);
 
 	/* These routines set up definitions of stations to use 
 	S-P type phases with due to "bad clocks".   We use this
@@ -259,14 +342,23 @@ option which is know to cause problems\nrecenter set off\n");
 	dbgs.record = dbSCRATCH;
 
 	dbcs = dblookup(db,0,"gridstat",0,0);
+
+	/* Clusters are independent, so they are run on a pool of
+	threads.  This thread does all the database work:  it loads
+	clusters ahead of the workers and saves results in gridlist
+	order as they come back.  maxpending limits how many clusters
+	are held in memory at once. */
+	nthreads = get_pmel_threads(pf);
+	pool = pmel_pool_create(nthreads,stations,arr_phase,arr_phase_3D,
+			&o,pf);
+	if(nthreads<=0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	maxpending = nthreads>1 ? 2*nthreads : 1;
 	
 	for(i=0;i<maxtbl(gridlist);++i)
 	{
 		long gridid;
 		int nevents;
 		long is,ie;
-		int ndata;
-		int ierr;
 
 		gridid = (long)gettbl(gridlist,i);
 
@@ -282,13 +374,19 @@ option which is know to cause problems\nrecenter set off\n");
 			freetbl(reclist,0);
 			continue;
 		}
-		allot(Tbl **,ta,nevents);
-		allot(Hypocenter *,h0,nevents);
-		allot(long *,evid,nevents);
+		c = create_Pmel_cluster();
+		c->gridid = gridid;
+		c->nevents = nevents;
+		allot(Tbl **,c->ta,nevents);
+		allot(Hypocenter *,c->h0,nevents);
+		allot(long *,c->evid,nevents);
+		ta = c->ta;
+		h0 = c->h0;
+		evid = c->evid;
 		
 		/* reclist now contains a collection of record numbers
 		for gridid:evid grouped parts of the working view. */
-		for(j=0,ndata=0;j<nevents;++j)
+		for(j=0,c->ndata=0;j<nevents;++j)
 		{
 			dbevid_grp.record = (long)gettbl(reclist,j);
 			dbgetv(dbevid_grp,0,"evid",evid+j,
@@ -305,149 +403,42 @@ option which is know to cause problems\nrecenter set off\n");
 					elog_complain(0,"Warning (dbpmel_process):  problems in editing arrival table for minus phases in minus_phases_arrival function\n");
 				}
 			}
-			ndata += maxtbl(ta[j]);
+			c->ndata += maxtbl(ta[j]);
 			h0[j] = db_load_initial(dbbundle,is);
 			
 		}
+		freetbl(reclist,0);
 		/* We assume the hypocentroid has been joined to this
 		view and we can just grab the first row of the view pointer
 		to get the hypocentroid location for this group. */
-		if(load_hypocentroid(dbbundle,is,&hypocentroid))
+		if(load_hypocentroid(dbbundle,is,&(c->hypocentroid)))
 		{
 			elog_complain(0,"Error loading hypocentroid from working view for gridid=%ld;  Skipping to next gridid in processing list\n",
 				gridid);
-			for(k=0;k<nevents;++k) freetbl(ta[i],free);
-			continue;
-		}
-
-		/* This function alters the phase handles by setting the
-		station corrections to those computed from the difference
-		in travel time between the model defined in the arr_phase_3D
-		definition and that in arr_phase.  */
-		ierr = initialize_station_corrections(arr_phase,arr_phase_3D,
-			stations,&hypocentroid);
-		if(ierr>0)
-		{
-			elog_complain(0,"%d problems setting path anomaly corrections for gridid=%ld\n",
-				ierr,gridid);
-		}
-		else if(ierr<0)
-		{
-			elog_complain(0,"Cannot compute any path anomaly corrections for gridid=%ld\nSkipping to next grid point\n",
-				gridid);
-			for(k=0;k<nevents;++k) freetbl(ta[k],free);
-			free(evid);
-			free(ta);
+			free_Pmel_cluster(c);
 			continue;
 		}
-		/* We make the S work space of size ndata times smatrix->ncol
-		to avoid having to handle fixed coordinates.  We could work in
-		a space as small as ndata-4*nevents if all events had free 
-		coordinates,but this would be too small if any coordinates are
-		fixed.  Hence, we may waste some memory, but this should not
-		be a large factor.  Note the use of reallot which causes this
-		workspace to be dynamic from group to group */
-		reallot(double *,smatrix->S,ndata*(smatrix->ncol));
-		smatrix->nrow = ndata;
-		for(k=0;k<(ndata*(smatrix->ncol));++k) smatrix->S[k]=0.0;
-
-		/* This computes the set of reference station corrections
-		for this group of events */
-		ierr = compute_scref(smatrix, &hypocentroid,stations,
-			arr_phase,arr_phase_3D);
-		if(ierr)
-		{
-			elog_complain(0,"%d errors in compute_scref\n",ierr);
-		}
-		/* It is necessary to initialize the sc vector in smatrix
-		to the contents of the reference station corrections to make
-		the results internally consistent.  pmel internally uses the
-		station corrections in the phase handles in computing travel 
-		times and sc is used to as the work vector to store the
-		current estimates.  The reference corrections are always the
-		starting solution and this copy is required to keep the
-		solution consistent with this fact */
-		dcopy(smatrix->ncol,smatrix->scref,1,smatrix->sc,1);
-		Arr *fixarrtmp;
 		if(freeze)
 		{
 			if(in_fixdepthlist(events_to_fix,evid,nevents))
-				fixarrtmp=duparr(events_to_fix,(void *)strdup);
+				c->fixarr=duparr(events_to_fix,(void *)strdup);
 			else
-				fixarrtmp=get_freezearr(fm,h0,evid,ta,nevents);
+				c->fixarr=get_freezearr(fm,h0,evid,ta,nevents);
 		}
 		else
-			fixarrtmp=duparr(events_to_fix,(void *)strdup);
-		
+			c->fixarr=duparr(events_to_fix,(void *)strdup);
 
-		/* This is the main processing routine.  It was 
+		/* pmel_cluster is the main processing routine.  It was 
 		intentionally built without any db hooks to make it
 		more portable */
-		if(pmel(nevents,evid,ta,h0,
-			fixarrtmp,&hypocentroid,smatrix,
-			arr_phase,&o,pf,&converge,&pmelhistory))
-		{
-			elog_notify(0,
-			  "No solution from pmel for cluster id = %ld\n",
-				gridid);
-			freearr(fixarrtmp,free);
-			continue;
-		}
-		freearr(fixarrtmp,free);
-		fprintf(stdout,"Cluster id=%ld pmel convergence reason\n",
-			gridid);
-		for(k=0,pmelfail=0;k<maxtbl(converge);++k)
-		{
-			char *swork;
-			swork = (char *)gettbl(converge,k);
-			fprintf(stdout,"%s\n",swork);
-
-			/* The string ABORT in the convergence list
-			is used to flag a failure. */
-			if(strstr(swork,"ABORT")!=NULL) pmelfail=1;
-		}
-		if(!pmelfail)
-		{
-			dbpmel_save_sc(gridid,db,smatrix,pf);
-
-
-			if(dbpmel_save_results(db,nevents,evid,h0,
-				ta,o,pf))
-
-			{
-				elog_complain(0,"Problems saving results\
-for cluster id %ld\n",
-					gridid);
-			}
-
-
-			/* Missing function here should update
-			hypocentroid row */
-
-			if(dbaddv(dbcs,0,"gridid",gridid,
-				"gridname", gridname,
-				"pmelrun",runname,
-				"sswrodgf",smatrix->sswrodgf,
-				"ndgf",smatrix->ndgf,
-				"sdobs",smatrix->rmsraw,NULL ) == dbINVALID)
-			{
-				elog_complain(0,"dbaddv error for gridid %ld adding to gridstat table\n",
-				gridid);
-			}
-		}
-		for(k=0;k<nevents;++k) freetbl(ta[k],free);
-		free(ta);
-		free(evid);
-		free(h0);
-		freetbl(converge,0);
-		freetbl(pmelhistory,free);
-
-		converge=NULL;
-		pmelhistory=NULL;
-		freetbl(reclist,0);
-
+		pmel_pool_submit(pool,c);
+		while(pmel_pool_pending(pool)>=maxpending)
+			dbpmel_save_cluster(pmel_pool_next(pool),db,dbcs,
+				gridname,runname,pf);
 	}
+	while((c=pmel_pool_next(pool))!=NULL)
+		dbpmel_save_cluster(c,db,dbcs,gridname,runname,pf);
+	pmel_pool_destroy(pool);
 	freearr(events_to_fix,0);
-	destroy_SCMatrix(smatrix);
 	return(0);
 }
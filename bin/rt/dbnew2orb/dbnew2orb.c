@@ -10,6 +10,7 @@
 #include "Pkt.h"
 #include "brttutil.h"
 #include "bury.h"
+#include "tablewatch.h"
 #define NEW_TABLE 0
 #define TABLE_SEEN 1
 #define MAX_TABLES_IN_DB	200
@@ -48,22 +49,54 @@ static void
 usage()
 {
 	cbanner("$Date$",
-		"[-sleep seconds] [-pf pfname] [-state statefile]\n                   [-lastid] [-wfdisc] [-prefix prefix] [-modified_after time] [-v] db orb",
+		"[-sleep seconds] [-pf pfname] [-state statefile] [-poll]\n                   [-lastid] [-wfdisc] [-prefix prefix] [-modified_after time] [-v] db orb",
 		"Nikolaus Horn",
 		"ZAMG / Vienna",
 		"nikolaus.horn@zamg.ac.at");
 	exit(1);
 }
+/*
+ * packet buffer shared by all sends. stuffPkt grows it as needed, so
+ * a burst of rows is sent without a malloc/free per row
+ */
+static char    *packet = 0;
+static int      packetsize = 0;
+
+static int
+row2orb(Packet * pkt, Dbptr db, int orb, char *srcname)
+{
+	double          time;
+	int             nbytes;
+
+	pkt->db = db;
+	if (stuffPkt(pkt, srcname, &time, &packet, &nbytes, &packetsize) < 0) {
+		elog_complain(0, "stuffPkt fails for pf packet");
+		return (-1);
+	}
+	if (orbput(orb, srcname, time, packet, nbytes) < 0) {
+		elog_complain(0, "Couldn't send packet to orb\n");
+		return (-1);
+	}
+	return (0);
+}
+static Packet  *
+new_dbpkt(char *prefix)
+{
+	Packet         *pkt;
+
+	pkt = newPkt();
+	if (prefix)
+		strncpy(pkt->parts.src_net, prefix, PKT_TYPESIZE);
+	pkt->pkttype = suffix2pkttype("db");
+	return (pkt);
+}
 static int
 dbrows2orb(Dbptr db, int orb, char *prefix)
 {
-	Packet         *pkt= NULL;
+	Packet         *pkt;
 	char            srcname[ORBSRCNAME_SIZE];
-	double          time;
-	static char           *packet=0;
-	int             nbytes, packetsize = 0;
 	Dbptr           tmpdb;
-	long            t, nrecords, r, ntables;
+	long            t, nrecords = 0, r, ntables;
 	Arr            *records = NULL;
 	Tbl            *tables = NULL;
 	char           *thistablename;
@@ -73,30 +106,20 @@ dbrows2orb(Dbptr db, int orb, char *prefix)
 	dbuntangle(db, &records);
 	tables = keysarr(records);
 	ntables = maxtbl(tables);
-	if (ntables > 0)
-		pkt = newPkt();
-	if (prefix)
-		strncpy(pkt->parts.src_net, prefix, PKT_TYPESIZE);
-	pkt->pkttype = suffix2pkttype("db");
+	pkt = new_dbpkt(prefix);
+	srcname[0] = '\0';
 	for (t = 0; t < ntables; t++) {
 		thistablename = gettbl(tables, t);
 		tmpdb = dblookup(db, 0, thistablename, 0, 0);
 		stbl = (Stbl *) getarr(records, thistablename);
 		nrecords = maxstbl(stbl);
-		if (nrecords > 0) {
-			for (r = 0; r < nrecords; r++) {
-				tmpdb.record = (long) getstbl(stbl, r);
-				pkt->db = tmpdb;
-				packetsize=0;
-				if (stuffPkt(pkt, srcname, &time, &packet, &nbytes, &packetsize) < 0) {
-					elog_complain(0, "stuffPkt fails for pf packet");
-					return (-1);
-				}
-				if (orbput(orb, srcname, time, packet, nbytes) < 0) {
-					elog_complain(0, "Couldn't send packet to orb\n");
-					return (-1);
-				}
-				free(packet);
+		for (r = 0; r < nrecords; r++) {
+			tmpdb.record = (long) getstbl(stbl, r);
+			if (row2orb(pkt, tmpdb, orb, srcname) < 0) {
+				freetbl(tables, 0);
+				dbfree_untangle(records);
+				freePkt(pkt);
+				return (-1);
 			}
 		}
 	}
@@ -108,10 +131,37 @@ dbrows2orb(Dbptr db, int orb, char *prefix)
 		free(s);
 	}
 	return (0);
+}
+/*
+ * send records first .. last-1 of table dbt, i.e. rows appended since
+ * the last pass. No subset is needed, the rows are addressed directly.
+ * maxlddate is raised to the largest lddate sent.
+ */
+static int
+dbrange2orb(Dbptr dbt, long first, long last, int orb, char *prefix, double *maxlddate)
+{
+	Packet         *pkt;
+	char            srcname[ORBSRCNAME_SIZE];
+	double          lddate;
+	char           *s;
 
-
-
-
+	pkt = new_dbpkt(prefix);
+	srcname[0] = '\0';
+	for (dbt.record = first; dbt.record < last; dbt.record++) {
+		if (row2orb(pkt, dbt, orb, srcname) < 0) {
+			freePkt(pkt);
+			return (-1);
+		}
+		if (dbgetv(dbt, 0, "lddate", &lddate, NULL) >= 0 && lddate > *maxlddate) {
+			*maxlddate = lddate;
+		}
+	}
+	freePkt(pkt);
+	if (verbose) {
+		elog_notify(0, "%s: %ld appended packet(s) sent with sourcename: %s\n", s = strtime(std_now()), last - first, srcname);
+		free(s);
+	}
+	return (0);
 }
 int
 main(int argc, char **argv)
@@ -130,16 +180,22 @@ main(int argc, char **argv)
 	long            table_present, recc, is_view;
 	char           *tablename, *schemaname;
 	char           *filename;
-	int             counter = 0, force_check = 0, send_lastid = 0, send_wfdisc = 0;
+	int             force_check = 0, send_lastid = 0, send_wfdisc = 0;
 	char            expr[512];
 	char           *statefilename = NULL, *pfname = "dbnew2orb";
 	Pf             *pf = NULL;
-	double          lastburytime;
+	double          lastburytime, lastforcetime, nowtime;
 	Relic           relic;
 	char           *s;
 	Expression     *expr_lddate;
 	double         *mtimes;
 	double         *lddates;
+	Tablewatch     *tw;
+	int            *watchids;
+	int             watchmode = TABLEWATCH_AUTO;
+	double          poll_interval = 1.0, coalesce = 0.05;
+	long            first, last, nrecords;
+	int             status;
 
 	elog_init(argc, argv);
 
@@ -202,6 +258,8 @@ main(int argc, char **argv)
 				exit(1);
 			}
 			check_lddate_interval = atoi(*argv);
+		} else if (!strcmp(*argv, "-poll")) {
+			watchmode = TABLEWATCH_POLL;
 		} else if (!strcmp(*argv, "-v")) {
 			verbose++;
 		} else if (!strcmp(*argv, "-lastid")) {
@@ -245,6 +303,13 @@ main(int argc, char **argv)
 			prefix = NULL;
 		}
 	}
+	if (watchmode == TABLEWATCH_AUTO) {
+		if (parse_param(pf, "watch", P_BOOL, 0, &i) == 0 && !i) {
+			watchmode = TABLEWATCH_POLL;
+		}
+	}
+	parse_param(pf, "poll_interval", P_DBL, 0, &poll_interval);
+	parse_param(pf, "coalesce", P_DBL, 0, &coalesce);
 	parse_param(pf, "check_tables", P_TBL, 0, &check_tables);
 	if (check_tables) {
 		if (maxtbl(check_tables) < 1) {
@@ -347,20 +412,45 @@ main(int argc, char **argv)
 			elog_complain(0, "could not read old statefile\n");
 		}
 	}
+	/*
+	 * follow the table files. Rows already in a table are left to the
+	 * lddate checks below, the watch only reports rows added later
+	 */
+	tw = tablewatch_new(watchmode, poll_interval);
+	watchids = malloc(ntables * sizeof(int));
+	if (watchids == NULL) {
+		elog_die(1, "malloc error\n");
+	}
 	for (i = 0; i < ntables; i++) {
 		/*
 		 * mtimes[i] = modified_after; lddates[i] = modified_after;
 		 */
 		static_flags[i] = NEW_TABLE;
+		dbt = dblookup(db, 0, gettbl(tablenames, i), 0, 0);
+		dbquery(dbt, dbTABLE_FILENAME, &filename);
+		watchids[i] = tablewatch_add(tw, filename, -1);
+	}
+	if (verbose) {
+		elog_notify(0, "following %ld tables %s\n", ntables,
+			    tablewatch_is_event_driven(tw) ? "with inotify" : "by polling");
 	}
+	lastburytime = lastforcetime = std_now();
 	for (;;) {
 		for (i = 0; i < ntables; i++) {
             /* ignore nameless table... */
 			tablename = gettbl(tablenames, i);
-			printf("tavblename: %s\n",tablename);
 			if (!tablename) {
 				continue;
 			}
+			/*
+			 * a stat of the table file tells if anything happened,
+			 * no need to query the database for untouched tables
+			 */
+			status = tablewatch_check(tw, watchids[i], &first, &last);
+			if (status == TABLEWATCH_UNCHANGED && !force_check
+			    && static_flags[i] == TABLE_SEEN) {
+				continue;
+			}
             /* ignore empty tables, would not make sense... */
 			dbt = dblookup(db, 0, tablename, 0, 0);
 			dbquery(dbt, dbTABLE_PRESENT, &table_present);
@@ -376,6 +466,7 @@ main(int argc, char **argv)
 			if (recc < 1) {
 				continue;
 			}
+			nrecords = recc;
 			if (statefilename) {
 			if (static_flags[i] == NEW_TABLE) {
 				relic.dp = &bury_times[i];
@@ -413,6 +504,24 @@ main(int argc, char **argv)
 			last_lddate = lddates[i];
 
 			mtime = filestat.st_mtime;
+			/*
+			 * rows were only appended: send exactly those rows
+			 */
+			if (status == TABLEWATCH_APPENDED && !force_check) {
+				if (last > nrecords) {
+					last = nrecords;
+				}
+				if (dbrange2orb(dbt, first, last, orb, prefix, &lddates[i]) == 0) {
+					mtimes[i] = mtime;
+					bury_times[i] = lddates[i];
+					tablewatch_commit(tw, watchids[i], last);
+				}
+				if (Stop) {
+					bury();
+					return (0);
+				}
+				continue;
+			}
 			/*
 			 * the whole mtime stuff is not soo good: mtime is
 			 * typically > lddate, so setting modified_after to
@@ -421,7 +530,8 @@ main(int argc, char **argv)
 			 * to detect file modifications and lddates to get
 			 * the actual entries...
 			 */
-			if (force_check || mtime > last_mtime) {
+			if (force_check || mtime > last_mtime
+			    || status == TABLEWATCH_MODIFIED || status == TABLEWATCH_SHRUNK) {
 				sprintf(expr, "lddate > %f", last_lddate);
 				dbs = dbsubset(dbt, expr, 0);
 				dbquery(dbs, dbRECORD_COUNT, &recc);
@@ -439,6 +549,11 @@ main(int argc, char **argv)
 				}
 				dbfree(dbs);
 			}
+			/*
+			 * anything appended up to now has been covered by the
+			 * lddate check
+			 */
+			tablewatch_commit(tw, watchids[i], nrecords);
 			/*
 			 * a call to dbfree(dbt) would remove it from the
 			 * list of tablenames, all later calls to tablename
@@ -449,18 +564,21 @@ main(int argc, char **argv)
 				return (0);
 			}
 		}
-		sleep(naptime);
-		if ((counter + 1) >= check_lddate_interval) {
-			counter = 0;
+		/*
+		 * wait for a table to be written, at most naptime seconds.
+		 * The full lddate check now runs on a clock, every
+		 * check_lddate_interval naps, since passes happen whenever
+		 * a table changes
+		 */
+		tablewatch_wait(tw, (double) naptime, coalesce);
+		nowtime = std_now();
+		if (nowtime - lastforcetime >= (double) naptime * check_lddate_interval) {
+			lastforcetime = nowtime;
 			force_check = 1;
 		} else {
 			force_check = 0;
-			counter++;
 		}
 		if (statefilename) {
-			double          nowtime;
-
-			nowtime = std_now();
 			if (nowtime - lastburytime > 600.0) {
 				lastburytime = nowtime;
 				bury();
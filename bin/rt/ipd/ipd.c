@@ -25,7 +25,7 @@ int Psize = 4096;
 void usage ()
 {
     fprintf (stderr, 
-             "Usage: %s [-v][-c check_rate] [-i] [-p pfile] [-s pkt_size] [-t timeout] [-u] iport orb\n", 
+             "Usage: %s [-v][-c check_rate] [-i] [-p pfile] [-s pkt_size] [-t timeout] [-u] iport [iport ...] orb\n", 
              Program_Name);
     banner (Program_Name, "$Revision$ $Date$");
     exit (1);
@@ -38,7 +38,7 @@ char *argv[];
   extern char    *optarg;
   extern int     optind;
   struct Prts    Ports;
-  int     	 i, timeout=30;
+  int     	 i, timeout=30, nports, mux;
   int	         pktsize, htype=0;
   char           *iport = 0;
   char           *hdrtype = 0;
@@ -81,13 +81,14 @@ char *argv[];
         default: 
             usage();
         }
-       if ( argc - optind != 2 )
+       if ( argc - optind < 2 )
           usage ();
        
 /* Open input port and ORB  */
   
-       iport = argv[optind++];
-       orbname = argv[optind++] ; 
+       nports = argc - optind - 1;
+       iport = argv[optind];
+       orbname = argv[argc-1] ; 
 
        signal(SIGUSR1, sig_hdlr );
        initpf( pffile );
@@ -96,6 +97,19 @@ char *argv[];
          if( (htype = ( int ) decode( hdrtype )) < 0 ) 
 	    elog_die( 0, "Can't recognize hdrtype - %s\n", hdrtype );
 
+/* Several sockets and serial lines are all read by one loop; 
+   a single port and other port types are read one per process 
+   as before  */
+
+       for( i = 0, mux = ( nports > 1 ); i < nports; i++ )
+          if( !ipd_port_kind( argv[optind+i] ) ) mux = 0;
+       if( mux )  {
+          mux_ports( &argv[optind], nports, orbname, htype, timeout );
+          exit( 0 );
+       }
+       if( nports > 1 )
+          elog_die( 0, "Only sockets and serial ports can be read together.\n" );
+
        strcpy( Ports.ip_name, iport );
        Ports.ip_name[strlen(iport)] = '\0';
        strcpy(Ports.orbname, orbname );
@@ -98,6 +98,8 @@ extern int read_chr PL_(( struct Prts *inport, unsigned char **buffer ));
 extern int read_disc PL_(( struct Prts *inport, unsigned char **buffer ));
 extern int read_socket PL_(( struct Prts *inport, int hdrtype , int timeout));
 extern int send2orb PL_ ((int *orb, char *orbname, char *packet, char *srcname, double epoch, int size, int err));
+extern int ipd_port_kind PL_(( char *name ));
+extern int mux_ports PL_(( char **iports, int nports, char *orbname, int hdrtype, int timeout ));
 extern int valid_pkt PL_(( unsigned char **data, char *srcname, double *epoch, int *psize, int length, int err , int hdrtype));
  
 #undef PL_
@@ -0,0 +1,197 @@
+/*********************************************************************
+ *
+ *  ipd_mux.c
+ *
+ *  Read several socket and serial input ports from one process.
+ *  Packets are framed here, handed to the ingest library's orb
+ *  writer thread, and given their header by valid_pkt there.
+ *
+ ********************************************************************/
+#include <ctype.h>
+#include <signal.h>
+#include <math.h>
+#include "ipd.h"
+#include "ingest.h"
+
+extern int NoSP;
+extern int Psize;
+
+#define PSCL_HDR_SIZE	46	/* sync, type, 44 byte header */
+
+static Ingest *Mux = 0;
+static int Hdrtype = 0;
+
+/* What kind of input port is name?  Only sockets and character
+   devices other than raw disks and High Speed Serial cards can be
+   multiplexed.  /dev/hih needs the ioctl setup done by open_chr. */
+int
+ipd_port_kind( name )
+char *name;
+{
+	struct stat buf;
+
+	if( stat( name, &buf ) != 0 )  {
+	    if( isdigit( name[0] ) || !strncmp( name, "local", strlen("local") ) )
+		return IN_SOCKET;
+	    return 0;
+	}
+	if( S_ISCHR( buf.st_mode ) && strncmp( name, "/dev/rsd", strlen("/dev/rsd") )
+	    && strncmp( name, "/dev/hih", strlen("/dev/hih") ) )
+	    return IN_CHR;
+	return 0;
+}
+
+/* PASSCAL/RefTek DAS stream: sync 0xab or 0xbb, a packet type
+   character, then a 44 byte header holding the packet length.  The
+   length counts the whole packet including the two sync characters;
+   the checksum is over big endian 16 bit words. */
+static int
+pscl_frame( arg, buf, nbuf )
+void *arg;
+unsigned char *buf;
+int nbuf;
+{
+	unsigned short pchecksum, checksum;
+	int plength, j, sp = 0;
+
+	if( buf[0] != 0xab && buf[0] != 0xbb )  {
+	    if( Log )
+		elog_complain(0, "state = 0 : discarding character '%c' = %x\n", buf[0], buf[0]);
+	    return -1;
+	}
+	if( nbuf < 2 ) return 0;
+	switch( buf[1] )  {
+	    case 0xcd:
+	    case 0xde:
+	    case 0xbc:
+		break;
+	    case 0xef:
+	    case 0xdc:
+		sp = 1;
+		break;
+	    default:
+		if( Log )
+		    elog_complain(0, "state = 1 : discarding character '%c' = %x\n", buf[1], buf[1]);
+		return -1;
+	}
+	if( nbuf < PSCL_HDR_SIZE ) return 0;
+
+	plength = (buf[2+OFF_PLENB] * 256) + buf[2+OFF_PLENB+1];
+	if( plength < PSCL_HDR_SIZE || plength > Psize )  {
+	    elog_complain(0, "bad plength = %d for packet type 0x%x%x : discarding packet\n",
+	                   plength, buf[0], buf[1]);
+	    return -1;
+	}
+	if( nbuf < plength ) return 0;
+
+	pchecksum = (buf[2] << 8) | buf[3];
+	checksum = 0;
+	for( j = 4; j + 1 < plength; j += 2 )
+	    checksum ^= (buf[j] << 8) | buf[j+1];
+	checksum ^= 0xABCD;
+	if( pchecksum != checksum )  {
+	    elog_complain(0, "discarding packet with bad checksum  PCHK:%04X!=CHK:%04X %04d\n",
+	                   pchecksum, checksum, plength );
+	    if( Log ) hexdump( stderr, buf, plength );
+	    return -plength;
+	}
+	if( sp && NoSP ) return -plength;
+
+	return plength;
+}
+
+/* Runs in the orb writer thread; valid_pkt and its parameter file
+   globals are only ever used from there. */
+static int
+pscl_convert( arg, pkt )
+void *arg;
+IngestPacket *pkt;
+{
+	static int err = 0;
+	static double prev_time = 0.0;
+	unsigned char *data = pkt->data;
+	ulong ysec;
+	ushort_t hdrsiz;
+	double epoch;
+	int psize;
+	char *s;
+
+	if( ( err = valid_pkt( &data, pkt->srcname, &epoch, &psize,
+	                       pkt->nbytes, err, Hdrtype )) > 0 )  {
+	    elog_complain(0, "%s: Not valid packet. Wrong HEADER?\n",
+	                  ingest_port_name( Mux, pkt->port ) );
+	    return 1;
+	}
+	if( fabs( epoch - prev_time) > 86400.0 )  {
+	    prev_time = std_now();
+	    if( fabs( epoch - prev_time) > 86400.0 )  {
+		memcpy( (char *) &hdrsiz, data, 2 );
+		memcpy( (char *) &ysec, data+hdrsiz+10, 4 );
+		elog_complain(0,
+		    "%s packet has bad time - %s (epoch:%lf - ysec:%ld). Will discard packet.\n",
+		    pkt->srcname, s=strtime(epoch), epoch, ysec );
+		free(s);
+		if( Log ) hexdump( stderr, data+hdrsiz, 48 );
+		return 1;
+	    }
+	}
+	prev_time = epoch;
+
+	pkt->time = epoch;
+	pkt->out = (char *) data;
+	pkt->outsize = psize;
+	return 0;
+}
+
+static void
+mux_stop( sig )
+int sig;
+{
+	ingest_stop( Mux );
+}
+
+/* Read all the input ports into orbname until killed.  Each port
+   is reopened on its own when it fails or is silent for timeout
+   seconds. */
+int
+mux_ports( iports, nports, orbname, hdrtype, timeout )
+char **iports;
+int nports;
+char *orbname;
+int hdrtype;
+int timeout;
+{
+	char name[132];
+	int i;
+
+	Hdrtype = hdrtype;
+
+	/* Leave room in every buffer for the header valid_pkt prepends */
+	Mux = ingest_new( orbname, 64 + 32 * nports, Psize + IBUF_SIZE,
+	                  (double) timeout, 10.0 );
+	for( i = 0; i < nports; i++ )  {
+	    switch( ipd_port_kind( iports[i] ) )  {
+		case IN_SOCKET:
+		    if( !strncmp( iports[i], "local", strlen("local") ) )  {
+			sprintf( name, "localhost%s", iports[i] + strlen("local") );
+			ingest_add_tcp( Mux, name, RTDAS_PORT, pscl_frame, pscl_convert, 0 );
+		    } else
+			ingest_add_tcp( Mux, iports[i], RTDAS_PORT, pscl_frame, pscl_convert, 0 );
+		    break;
+		case IN_CHR:
+		    ingest_add_device( Mux, iports[i], pscl_frame, pscl_convert, 0 );
+		    break;
+		default:
+		    elog_die( 0, "%s can't be read together with other input ports\n", iports[i] );
+	    }
+	}
+	signal( SIGINT, mux_stop );
+	signal( SIGTERM, mux_stop );
+
+	if( ingest_run( Mux ) < 0 )
+	    elog_die( 0, "can't read input ports\n" );
+	if( Log )
+	    ingest_report( Mux );
+	ingest_free( Mux );
+	return 0;
+}
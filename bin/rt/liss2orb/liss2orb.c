@@ -1,5 +1,7 @@
 
+#include <signal.h>
 #include "liss2orb.h"
+#include "ingest.h"
 
 Arr *NewCh;
 int PSize;
@@ -11,7 +13,7 @@ static void
 usage ()
 {
     fprintf (stderr,
-    "Usage: %s [-d database] [-m match] [-r] [-s size] [-t timeout] [-v] liss orb\n",
+    "Usage: %s [-d database] [-m match] [-n npkts] [-r] [-s size] [-t timeout] [-v] liss [liss ...] orb\n",
 	     Program_Name);
     exit (1);
 }
@@ -44,66 +46,115 @@ the packet size.  See the message below:
 
 */
 
+/* Find the next SEED record in the byte stream from a liss server.  
+   With an explicit size every record is that long; otherwise the size 
+   is taken from blockette 1000, and a record without one means the 
+   stream is out of step, so the connection is dropped and reopened. */
 static int 
-getpkt (Bns *bns, char **seedp, int fixedsize, int *pktsize, int *seedsize) 
+liss_frame (void *arg, unsigned char *seed, int nbuf) 
 {
-    int retcode ;
+    int fixedsize = *((int *) arg) ;
+    unsigned short type=0 ; 
+    int log2_record_length, size ;
+
     if ( fixedsize != 0 ) {
-	SIZE_BUFFER (char *, *seedp, *seedsize, fixedsize ) ; 
-	retcode = bnsget(bns, *seedp, BYTES, fixedsize ) ;
-	*pktsize = fixedsize ;
-    } else if ( (retcode = bnsget ( bns, *seedp, BYTES, 64 )) == 0 ) {
-	unsigned short type=0 ; 
-	int log2_record_length = 0 ; 
-	memcpy(&type, *seedp+48, 2) ;
-	if ( type == 0x3e8 || type == 0xe803 ) { 
-	    int size ;
-	    log2_record_length = *((unsigned char *) *seedp+54) ;
-	    *pktsize = size = 1 << log2_record_length ;
-	    RESIZE_BUFFER (char *, *seedp, *seedsize, size ) ;
-	    if ( *pktsize > 0 && *pktsize < 1<<14 ) {
-		retcode = bnsget(bns, *seedp+64, BYTES, size-64 ) ;
-	    } else { 
-		elog_complain( 0, "read record length=%d => packet size=%d", 
-			log2_record_length, *pktsize ) ; 
-		hexdump ( stderr, *seedp, 64 ) ; 
-		retcode = -1; 
+	return nbuf >= fixedsize ? fixedsize : 0 ; 
+    } else if ( nbuf < 64 ) { 
+	return 0 ;
+    }
+    memcpy(&type, seed+48, 2) ;
+    if ( type == 0x3e8 || type == 0xe803 ) { 
+	log2_record_length = seed[54] ;
+	size = 1 << log2_record_length ;
+	if ( size >= 64 && size < 1<<14 ) {
+	    return nbuf >= size ? size : 0 ; 
+	}
+	elog_complain( 0, "read record length=%d => packet size=%d", 
+		log2_record_length, size ) ; 
+    } else { 
+	elog_complain( 0, "no blockette 1000!" ) ; 
+    }
+    hexdump ( stderr, seed, 64 ) ; 
+    return INGEST_RECONNECT ;
+}
+
+static Ingest *Liss ;
+static char	  *Database = 0 ;
+static char	  *Match = 0 ;
+static int	   Remap = 0 ;
+static int	   Verbose = 0 ;
+static int	   Npkts = 0 ;
+
+/* Runs in the orb writer thread only, so the static buffers here and
+   in liss2orbpkt are safe. */
+static int 
+liss_convert (void *arg, IngestPacket *pkt) 
+{
+    static char *packet=0 ;
+    static int bufsize = 0 ;
+    static Hook *hook=0 ;
+    static long cnt = 0 ;
+    long start, nchars ;
+    char *seed = (char *) pkt->data ;
+    int pktsize = pkt->nbytes ;
+    int nbytes = 0 ;
+
+    if ( Debug != 0 ) { 
+	static int debug = -1 ; 
+	static long ndebug = 0 ;
+	if ( debug < 0 ) { 
+	    debug = reopen (Debug, O_RDWR | O_CREAT, 0664);
+	    if ( debug < 0 ) { 
+		elog_die( 1, "Can't open %s to write out packets!", Debug ) ; 
 	    }
-	} else { 
-	    elog_complain( 0, "no blockette 1000!" ) ; 
-	    hexdump ( stderr, *seedp, 64 ) ; 
-	    retcode = -1 ; 
+	    printf ( "\n" ) ;
 	}
+	fprintf ( stderr, "\rPacket #%ld", ndebug++ ) ; 
+	if ( write ( debug, seed, pktsize ) != pktsize ) { 
+	    elog_die( 1, "Failed to write %d bytes to %s", pktsize, Debug ) ; 
+	}
+    }
+    if ( liss2orbpkt ( seed, pktsize, Database, Remap,
+	    pkt->srcname, &pkt->time, &packet, &nbytes, &bufsize ) != 0 ) { 
+	return -1 ;
+    }
+    if ( Match != 0 && ! strcontains ( pkt->srcname, Match, &hook, &start, &nchars) ) { 
+	return -1 ;
+    }
+    if ( Npkts > 0 && cnt >= Npkts ) { 
+	return -1 ;
+    }
+    pkt->out = packet ;
+    pkt->outsize = nbytes ;
+    if ( Verbose ) { 
+	char *s ;
+	fprintf ( stderr, "%-20s %s %4d => %4d  %s\n", pkt->srcname, 
+		s=strydtime(pkt->time), pktsize, nbytes, 
+		ingest_port_name ( Liss, pkt->port ) ) ;
+	free(s) ;
     }
-    return retcode ;
+    cnt++ ; 
+    if ( Npkts > 0 && cnt >= Npkts ) { 
+	ingest_stop ( Liss ) ;
+    }
+    return 0 ;
+}
+
+static void
+stop_liss (int sig)
+{
+    ingest_stop ( Liss ) ;
 }
 
 int
 main (int argc, char **argv)
 {
-    int		   c ;
-    char           *match = 0;
-    char           *liss_server ;
+    int		   c, i ;
     int            timeout = 300;
     char           *orbname ;
-    int		   verbose = 0 ;
-    int 	   orb ;
-    int		   fixedsize=0, pktsize=0 ;
+    int		   fixedsize=0 ;
     int		   defaultport = 4000 ;
-    char	  *database = 0 ;
-    char	  *seed ;
-    int		   seedsize = 4096, bufsize = 0 ; 
-    int 	   fd = -1 ;
-    int 	   failures = 0 ;
-    char 	   srcname[ORBSRCNAME_SIZE] ;
-    double 	   time ; 
-    char 	  *packet ; 
-    int 	   nbytes = 0 ;
-    int 	   cnt =0, npkts = 0 ;
-    int		   remap = 0 ;
-    Bns 	   *bns=0 ;
-    Hook	   *hook=0 ;
-    long	   start, nchars ;
+    int		   nservers ;
 
     elog_init (argc, argv);
     announce(0,0) ;
@@ -115,19 +166,19 @@ main (int argc, char **argv)
 	    break ;
 
 	  case 'd':
-	    database = optarg ; 
+	    Database = optarg ; 
 	    break ;
 
 	  case 'm':
-	    match = optarg;
+	    Match = optarg;
 	    break;
 
 	  case 'n':
-	    npkts = atoi(optarg) ; 
+	    Npkts = atoi(optarg) ; 
 	    break ;
 
 	  case 'r':
-	    remap = 1 ; 
+	    Remap = 1 ; 
 	    break ;
 
 	  case 's':
@@ -139,7 +190,7 @@ main (int argc, char **argv)
 	    break ;
 
 	  case 'v':
-	    verbose++ ;
+	    Verbose++ ;
 	    break;
 
 	  case 'V':
@@ -152,87 +203,40 @@ main (int argc, char **argv)
 	    usage ();
 	}
     }
-    if (argc - optind != 2)
+    if (argc - optind < 2)
 	usage ();
 
-    liss_server = argv[optind++];
-    orbname = argv[optind++];
-
-    orb = orbopen(orbname, "w&" ) ; 
-    if ( orb < 0 ) { 
-	elog_die(0, "Can't open output orb %s", orbname ) ; 
-    }
+    nservers = argc - optind - 1 ;
+    orbname = argv[argc-1];
 
-    if (database) {
+    if (Database) {
 	Dbptr db;
 
-	if (dbopen(database, "r+", &db) == dbINVALID) {
-		elog_die(0, "dbopen(%s) error.\n", database);
+	if (dbopen(Database, "r+", &db) == dbINVALID) {
+		elog_die(0, "dbopen(%s) error.\n", Database);
 	}
 	finit_db (db);
     }
 
-    allot(char *, seed, seedsize) ; 
-    for(;;) { 
-	while ( fd < 0 ) { 
-	    fd = open_socket ( liss_server, defaultport ) ; 
-	    if ( fd < 0 ) { 
-		if ( failures==0) {
-		    elog_complain( 1, "Can't open liss server %s", liss_server ) ;
-		}
-		snooze ( 60. ) ;
-		failures++ ;
-	    } else { 
-		if ( failures ) { 
-		    elog_notify ( 0, "connected to %s after %d failures", 
-		    	liss_server, failures ) ;
-		    failures = 0  ;
-		}
-		bns = bnsnew(fd, 8192) ;
-		bnsuse_sockio(bns) ;
-		bnstimeout ( bns, timeout*1000 ) ;
-		bnsclr(bns) ;
-		bns->fd = fd ; 
-	    }
-	}
+    /* All servers are read by one loop; records go through a fixed pool
+       of buffers to a separate orb writer thread. */
+    Liss = ingest_new ( orbname, 64 + 32*nservers, 
+	fixedsize != 0 ? fixedsize : 1<<14, (double) timeout, 60. ) ;
+    for ( i=0 ; i<nservers ; i++ ) { 
+	ingest_add_tcp ( Liss, argv[optind+i], defaultport, 
+		liss_frame, liss_convert, &fixedsize ) ;
+    }
+    signal ( SIGINT, stop_liss ) ;
+    signal ( SIGTERM, stop_liss ) ;
+    ignoreSIGPIPE() ;
 
-	if (getpkt(bns, &seed, fixedsize, &pktsize, &seedsize) == 0) { 
-	    if ( Debug != 0 ) { 
-		static int debug = -1 ; 
-		static long cnt = 0 ;
-		if ( debug < 0 ) { 
-		    debug = reopen (Debug, O_RDWR | O_CREAT, 0664);
-		    if ( debug < 0 ) { 
-			elog_die( 1, "Can't open %s to write out packets!", Debug ) ; 
-		    }
-		    printf ( "\n" ) ;
-		}
-		fprintf ( stderr, "\rPacket #%ld", cnt++ ) ; 
-		if ( write ( debug, seed, pktsize ) != pktsize ) { 
-		    elog_die( 1, "Failed to write %d bytes to %s", pktsize, Debug ) ; 
-		}
-	    }
-	    if ( liss2orbpkt ( seed, pktsize, database, remap,
-		    srcname, &time, &packet, &nbytes, &bufsize ) == 0 ) { 
-		if ( match == 0 || strcontains ( srcname, match, &hook, &start, &nchars) ) { 
-		    orbput ( orb, srcname, time, packet, nbytes ) ; 
-		    if ( verbose ) { 
-			char *s ;
-			fprintf ( stderr, "%-20s %s %4d => %4d\n", srcname, s=strydtime(time), pktsize, nbytes ) ;
-			free(s) ;
-		    }
-		    cnt++ ; 
-		    if ( npkts > 0 && cnt >= npkts ) { 
-			break ; 
-		    }
-		}
-	    }
-	} else { 
-	    elog_complain( 1, "Closing connection to liss server %s", liss_server ) ;
-	    bnsclose ( bns ) ;
-	    fd = -1 ; 
-	}
+    if ( ingest_run ( Liss ) < 0 ) { 
+	elog_die( 0, "Can't read liss servers" ) ; 
+    }
+    if ( Verbose ) { 
+	ingest_report ( Liss ) ;
     }
+    ingest_free ( Liss ) ;
 
     return 0 ;
 }
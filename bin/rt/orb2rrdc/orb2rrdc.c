@@ -7,7 +7,22 @@
 
 #define MAX_REGEX_LEN 200
 
+/* Values waiting to be written to one rrd file */
+typedef struct Rrd_batch {
+    char    *rrd;
+    char    *values;        /* " time:val time:val ..." */
+    int     nvalues;
+    int     nbytes;
+    int     size;
+    int     last_time;
+} Rrd_batch;
+
 Arr *Rrd_files = 0;
+Arr *Rrd_batches = 0;
+Tbl *Rrd_batch_list = 0;
+double  Flush_interval_sec = 0;
+int     Max_batch_values = 1;
+double  Last_flush = 0;
 double  Status_stepsize_sec = 0;
 char    *Rrdfile_pattern = 0;
 char    *CacheDaemon = 0;
@@ -17,6 +32,8 @@ int     VeryVerbose = 0;
 FILE    *Rrdfp;
 
 static void pfmorph( Pf *pf );
+static void queue_update( char *rrd, double time, double val );
+static void flush_rrd_batches( void );
 
 static void
 usage( void )
@@ -117,6 +134,105 @@ pfmorph( Pf *pf ) {
     return;
 }
 
+static void
+issue_update( Rrd_batch *rb )
+{
+    if( rb->nvalues <= 0 ) {
+        return;
+    }
+
+    if( VeryVerbose ) {
+        elog_notify( 0, "Issuing rrdtool command: 'update %s%s%s%s' (%d values)\n",
+            CacheDaemon == NULL ? "" : "--daemon=",
+            CacheDaemon == NULL ? "" : CacheDaemon,
+            CacheDaemon == NULL ? "" : " ",
+            rb->rrd, rb->nvalues );
+    }
+
+    if( CacheDaemon == NULL ) {
+        fprintf( Rrdfp, "update %s%s\n", rb->rrd, rb->values );
+    } else {
+        fprintf( Rrdfp, "update --daemon=%s %s%s\n", CacheDaemon, rb->rrd, rb->values );
+    }
+
+    rb->nvalues = 0;
+    rb->nbytes = 0;
+    rb->values[0] = '\0';
+}
+
+/* Buffer one value for an rrd file. The buffer is written as a single
+   multi-value rrdtool update when it holds max_batch_values values or
+   at the next timed flush. When batching, rrdtool rejects a whole update 
+   from the first value that is not later than the previous one, so such 
+   values are dropped here rather than sent. Without batching every value
+   is passed to rrdtool as before. */
+static void
+queue_update( char *rrd, double time, double val )
+{
+    Rrd_batch *rb;
+    char    entry[STRSZ];
+    int     itime;
+    int     n;
+
+    rb = (Rrd_batch *) getarr( Rrd_batches, rrd );
+
+    if( rb == (Rrd_batch *) NULL ) {
+        allot( Rrd_batch *, rb, 1 );
+        rb->rrd = strdup( rrd );
+        rb->size = STRSZ;
+        allot( char *, rb->values, rb->size );
+        rb->values[0] = '\0';
+        rb->nvalues = 0;
+        rb->nbytes = 0;
+        rb->last_time = 0;
+
+        setarr( Rrd_batches, rrd, rb );
+        pushtbl( Rrd_batch_list, rb );
+    }
+
+    itime = (int) floor( time );
+
+    if( Flush_interval_sec > 0 && itime <= rb->last_time ) {
+        if( VeryVerbose ) {
+            elog_notify( 0, "Skipping value at '%d' for '%s': not later than "
+                "previous value at '%d'\n", itime, rrd, rb->last_time );
+        }
+
+        return;
+    }
+
+    sprintf( entry, " %d:%f", itime, val );
+    n = strlen( entry );
+
+    if( rb->nbytes + n + 1 > rb->size ) {
+        rb->size = 2 * rb->size + n;
+        reallot( char *, rb->values, rb->size );
+    }
+
+    strcpy( rb->values + rb->nbytes, entry );
+    rb->nbytes += n;
+    rb->nvalues++;
+    rb->last_time = itime;
+
+    if( rb->nvalues >= Max_batch_values ) {
+        issue_update( rb );
+    }
+}
+
+static void
+flush_rrd_batches( void )
+{
+    int i;
+
+    for( i = 0; i < maxtbl( Rrd_batch_list ); i++ ) {
+        issue_update( (Rrd_batch *) gettbl( Rrd_batch_list, i ) );
+    }
+
+    fflush( Rrdfp );
+
+    Last_flush = now();
+}
+
 static void
 archive_dlsvar( Dbptr db, char *net, char *sta, char *dls_var, char *dsparams, Tbl *rras, double time, double val )
 {
@@ -126,7 +242,6 @@ archive_dlsvar( Dbptr db, char *net, char *sta, char *dls_var, char *dsparams, T
     Dbptr   dbt;
     char    datasource[STRSZ];
     char    command[STRSZ];
-    char    cacheopt[FILENAME_MAX];
 /* Disable response printing for now (see below)
     char    response[STRSZ];
     char    *resp_ptr;
@@ -200,37 +315,7 @@ archive_dlsvar( Dbptr db, char *net, char *sta, char *dls_var, char *dsparams, T
             time, val, net, sta, dls_var, rrd );
     }
 
-    if( CacheDaemon == NULL ) {
-        sprintf( cacheopt, "%s", "" );
-    } else {
-        sprintf( cacheopt, "--daemon=%s", CacheDaemon );
-    }
-
-    sprintf( command, "update %s %s %d:%f", cacheopt, rrd, (int) floor( time ), val );
-
-    if( VeryVerbose ) {
-        elog_notify( 0, "Issuing rrdtool command: '%s'\n", command );
-    }
-
-    fprintf( Rrdfp, "%s\n", command );
-
-    /* Disable response printing for now since popen() bi-directional pipes 
-       are not supported across all platforms: 
-
-    if( VeryVerbose ) { 
-
-        resp_ptr = getaline( Rrdfp, response, STRSZ );
-
-        if( resp_ptr == (char *) NULL ) {
-
-            elog_notify( 0, "%s\n", "(null)" );
-
-        } else {
-
-            elog_notify( 0, "%s\n", resp_ptr );
-        }
-    }
-    */
+    queue_update( rrd, time, val );
 }
 
 int
@@ -458,6 +543,21 @@ main( int argc, char **argv )
     Status_stepsize_sec = pfget_double( pf, "status_stepsize_sec" );
     Default_network = pfget_string( pf, "default_network" );
     dlslines = pfget_tbl( pf, "dls_vars" );
+    Flush_interval_sec = pfget_double( pf, "flush_interval_sec" );
+
+    if( Flush_interval_sec > 0 ) {
+        Max_batch_values = pfget_int( pf, "max_batch_values" );
+
+        if( Max_batch_values < 1 ) {
+            Max_batch_values = 1;
+        }
+    } else {
+        Max_batch_values = 1;
+    }
+
+    Rrd_batches = newarr( 0 );
+    Rrd_batch_list = newtbl( 0 );
+    Last_flush = now();
 
     Dls_vars_dsparams = newarr( 0 );
     Dls_vars_rras = newarr( 0 );
@@ -475,12 +575,42 @@ main( int argc, char **argv )
         setarr( Dls_vars_rras, dls_var, rras );
     }
 
-    ort = orbreapthr_new( orb, -1., 0 );
+    /* When batching, the reaper times out so buffered values are 
+       written on schedule even if no packets arrive */
 
-    while ( 1 ) {
-        orbreapthr_get( ort, &pktid, srcname, &time, &packet, &nbytes, &bufsize );
+    if( Flush_interval_sec > 0 ) {
+        ort = orbreapthr_new( orb, Flush_interval_sec, 0 );
+    } else {
+        ort = orbreapthr_new( orb, -1., 0 );
+    }
+
+    while ( ! stop ) {
+        rc = orbreapthr_get( ort, &pktid, srcname, &time, &packet, &nbytes, &bufsize );
+
+        if( Flush_interval_sec > 0 && now() - Last_flush >= Flush_interval_sec ) {
+            flush_rrd_batches();
+
+            /* Buffered values are lost if the program dies, so the 
+               state is only saved once they have been written */
+
+            if( statefile ) {
+                rc = bury();
+
+                if( rc < 0 ) {
+                    elog_complain( 0, "Unexpected failure of bury command! " 
+                        "(are there two orb2rrdc's running with the same state" 
+                        "file?)\n" );
+
+                    elog_clear_register( 1 );
+                }
+            }
+        }
 
-        if( statefile ) {
+        if( rc != ORBREAPTHR_OK ) {
+            continue;
+        }
+
+        if( statefile && Flush_interval_sec <= 0 ) {
             rc = bury();
 
             if( rc < 0 ) {
@@ -597,5 +727,20 @@ main( int argc, char **argv )
             }
         }
     }
+
+    flush_rrd_batches();
+
+    if( statefile ) {
+        bury();
+    }
+
+    pclose( Rrdfp );
+
+    if( Verbose ) {
+        elog_notify( 0, "Exiting at %s\n", 
+                zepoch2str( str2epoch( "now" ), "%D %T %Z", "" ) );
+    }
+
+    return 0;
 }
 /* vim: set ts=4 sw=4 expandtab: */
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "stock.h"
+#include "coords.h"
+#include "db.h"
+#include "orb.h"
+#include "Pkt.h"
+#include "seispp.h"
+#include "StaLtaDetector.h"
+using namespace std;
+using namespace SEISPP;
+void usage()
+{
+	cerr << "orbstalta orb db [-pf pffile -v]"<<endl;
+	exit(-1);
+}
+/* Converts each channel of a waveform packet to a TimeSeries appended to d.
+Returns number of channels added. */
+int packet_to_timeseries(Packet *pkt, vector<TimeSeries>& d)
+{
+	int i,j;
+	int nadded(0);
+	for(i=0;i<pkt->nchannels;++i)
+	{
+		PktChannel *pktchan=(PktChannel *)gettbl(pkt->channels,i);
+		if((pktchan->nsamp<=0) || (pktchan->samprate<=0.0)) continue;
+		TimeSeries ts;
+		ts.live=true;
+		ts.tref=absolute;
+		ts.t0=pktchan->time;
+		ts.dt=1.0/pktchan->samprate;
+		ts.ns=pktchan->nsamp;
+		ts.s.resize(ts.ns);
+		/* Detection is insensitive to gain so calib is not applied */
+		for(j=0;j<ts.ns;++j) ts.s[j]=(double)(pktchan->data[j]);
+		ts.put("net",pktchan->net);
+		ts.put("sta",pktchan->sta);
+		ts.put("chan",pktchan->chan);
+		if(strlen(pktchan->loc)>0) ts.put("loc",pktchan->loc);
+		d.push_back(ts);
+		++nadded;
+	}
+	return(nadded);
+}
+/* Saves detections as arrival rows.  Returns number saved. */
+int save_detections(vector<Metadata>& det, Dbptr db, string phase,
+	string auth)
+{
+	int nsaved(0);
+	vector<Metadata>::iterator dptr;
+	for(dptr=det.begin();dptr!=det.end();++dptr)
+	{
+		string sta=dptr->get_string("sta");
+		string chan=dptr->get_string("chan");
+		double time=dptr->get_double("time");
+		double snr=dptr->get_double("snr");
+		long arid=dbnextid(db,"arid");
+		char *s=strtime(time);
+		if(dbaddv(db,0,"sta",sta.c_str(),
+			"time",time,
+			"arid",arid,
+			"jdate",yearday(time),
+			"chan",chan.c_str(),
+			"iphase",phase.c_str(),
+			"snr",snr,
+			"auth",auth.c_str(),
+			NULL) < 0)
+		{
+			elog_complain(0,"dbaddv failed for arrival of %s:%s at %s\n",
+				sta.c_str(),chan.c_str(),s);
+		}
+		else
+			++nsaved;
+		if(SEISPP_verbose)
+			cout << sta << " "<<chan<<" "<<s<<" "
+				<<dptr->get_string("filter")<<" stalta="<<snr<<endl;
+		free(s);
+	}
+	return nsaved;
+}
+
+bool SEISPP::SEISPP_verbose(false);
+int main(int argc, char **argv)
+{
+	int i;
+	if(argc<3) usage();
+	string orbname(argv[1]);
+	string dbname(argv[2]);
+	string pfname("orbstalta");
+	for(i=3;i<argc;++i)
+	{
+		string argtest(argv[i]);
+		if(argtest=="-pf")
+		{
+			++i;
+			if(i>=argc) usage();
+			pfname=string(argv[i]);
+		}
+		else if(argtest=="-v")
+			SEISPP_verbose=true;
+		else
+			usage();
+	}
+	elog_init(argc,argv);
+	Pf *pf;
+	if(pfread(const_cast<char *>(pfname.c_str()),&pf))
+	{
+		cerr << "Error reading pf file = "<<pfname<<endl;
+		exit(-1);
+	}
+	Dbptr db;
+	if(dbopen(const_cast<char *>(dbname.c_str()),"r+",&db)==dbINVALID)
+		elog_die(0,"dbopen failed for database %s\n",dbname.c_str());
+	db=dblookup(db,0,"arrival",0,0);
+	int orb=orbopen(const_cast<char *>(orbname.c_str()),"r&");
+	if(orb<0) elog_die(0,"orbopen failed for orb %s\n",orbname.c_str());
+	try {
+		Metadata control(pf);
+		string select=control.get_string("select");
+		string reject("");
+		if(control.is_attribute_set("reject"))
+			reject=control.get_string("reject");
+		if(select.length()>0)
+		{
+			if(orbselect(orb,const_cast<char *>(select.c_str()))<0)
+				elog_die(0,"orbselect failed for %s\n",select.c_str());
+		}
+		if(reject.length()>0)
+		{
+			if(orbreject(orb,const_cast<char *>(reject.c_str()))<0)
+				elog_die(0,"orbreject failed for %s\n",reject.c_str());
+		}
+		double batch_interval=control.get_double("batch_interval");
+		int nthreads=control.get_int("number_threads");
+		string phase=control.get_string("phase_name");
+		string auth=control.get_string("author");
+		MultichannelStaLta detector(control,nthreads);
+		/* The reaper times out so batches are processed on schedule
+		even when data are sparse */
+		OrbreapThr *ort=orbreapthr_new(orb,batch_interval,0);
+		int pktid,nbytes,bufsize(0),rc;
+		char srcname[ORBSRCNAME_SIZE];
+		double pkttime;
+		char *packet=NULL;
+		Packet *pkt=NULL;
+		vector<TimeSeries> batch;
+		double last_flush=now();
+		long npackets(0),nempty(0),ndetections(0);
+		while(1)
+		{
+			rc=orbreapthr_get(ort,&pktid,srcname,&pkttime,&packet,
+				&nbytes,&bufsize);
+			if(rc==ORBREAPTHR_STOPPED) break;
+			if(rc==ORBREAPTHR_OK)
+			{
+				if(unstuffPkt(srcname,pkttime,packet,nbytes,&pkt)==Pkt_wf)
+				{
+					/* Packets with no usable channels (no samples
+					or no sample rate) are counted but otherwise
+					ignored */
+					if(packet_to_timeseries(pkt,batch)>0)
+						++npackets;
+					else
+						++nempty;
+				}
+			}
+			if((now()-last_flush)<batch_interval) continue;
+			last_flush=now();
+			if(batch.empty()) continue;
+			try {
+				vector<Metadata> det=detector.process(batch);
+				ndetections+=save_detections(det,db,phase,auth);
+			} catch (SeisppError& serr)
+			{
+				/* A bad packet should not stop a real time system */
+				serr.log_error();
+			}
+			batch.clear();
+			if(SEISPP_verbose)
+				elog_notify(0,"%ld packets (%ld with no usable channels) %ld detections %d channels\n",
+					npackets,nempty,ndetections,detector.number_channels());
+		}
+		orbreapthr_destroy(ort);
+		if(pkt!=NULL) freePkt(pkt);
+		if(packet!=NULL) free(packet);
+	} catch (SeisppError& serr)
+	{
+		serr.log_error();
+		exit(-1);
+	}
+	orbclose(orb);
+	dbclose(db);
+}
@@ -6,6 +6,7 @@
 #include "seispp.h"
 #include "TimeSeries.h"
 #include "ThreeComponentSeismogram.h"
+#include "ensemble.h"
 #include "StreamObjectReader.h"
 #include "StreamObjectWriter.h"
 using namespace std;   
@@ -151,6 +152,120 @@ template <class DataType> int add_arrivals(Metadata control,bool binary_data)
     }catch(...){throw;};
 }
 
+/* Alternative to add_arrivals used when use_travel_time_table is true.
+ * Objects are read in blocks of block_size and arrival times for a 
+ * whole block are interpolated from a travel time table in parallel.  
+ * Delta, baz, and slowness are then posted serially as they are cheap.
+ * Output order is the same as the input order. */
+template <class DataType> int add_arrivals_batch(Metadata control,bool binary_data)
+{
+    try{
+        string phase=control.get_string("phase");
+        string phase_key=control.get_string("phase_time_key");
+        vector<string> geometry_keys;
+        geometry_keys.push_back(control.get_string("source_latitude_key"));
+        geometry_keys.push_back(control.get_string("source_longitude_key"));
+        geometry_keys.push_back(control.get_string("source_depth_key"));
+        geometry_keys.push_back(control.get_string("source_origin_time_key"));
+        geometry_keys.push_back(control.get_string("receiver_latitude_key"));
+        geometry_keys.push_back(control.get_string("receiver_longitude_key"));
+        geometry_keys.push_back(control.get_string("receiver_elevation_key"));
+        bool save_delta=control.get_bool("save_delta");
+        bool save_baz=control.get_bool("save_baz");
+        bool save_slowness=control.get_bool("save_slowness");
+        string delta_key=control.get_string("delta_key");
+        string baz_key=control.get_string("baz_key");
+        string TTmethod=control.get_string("TTmethod");
+        string TTmodel=control.get_string("TTmodel");
+        string slowness_ux_key=control.get_string("slowness_ux_key");
+        string slowness_uy_key=control.get_string("slowness_uy_key");
+        int block_size=control.get_int("block_size");
+        int nthreads=control.get_int("nthreads");
+        if(block_size<1) block_size=1;
+        TravelTimeTable table(TTmethod,TTmodel,phase);
+        vector<TravelTimeTable *> tables;
+        tables.push_back(&table);
+        vector<string> keys;
+        keys.push_back(phase_key);
+        char form('t');
+        if(binary_data) form='b';
+        StreamObjectReader<DataType> inp(form);
+        StreamObjectWriter<DataType>  outp(form);
+        int count(0);
+        int i,j;
+        double g[7];
+        SlownessVector slow;
+        vector<DataType> block;
+        block.reserve(block_size);
+        while(inp.good())
+        {
+            block.clear();
+            while(inp.good() && (block.size()<block_size))
+                block.push_back(inp.read());
+            LoadPredictedArrivalTimes(block,tables,keys,nthreads,
+                    SEISPP_verbose,geometry_keys);
+            for(i=0;i<block.size();++i)
+            {
+                Metadata *md=dynamic_cast<Metadata*>(&block[i]);
+                try{
+                    for(j=0;j<7;++j) g[j]=md->get<double>(geometry_keys[j]);
+                }catch(MetadataGetError& mde)
+                {
+                    cerr << "add_arrivals: Error fetching required attribute.  "
+                      << "Message posted:"<<endl;
+                    mde.log_error();
+                    cerr<<"Actual content of this seismogram header:"<<endl;
+                    cerr << *md<<endl;
+                    cerr<<"Copying data without required arrival time attribute"
+                      <<endl;  
+                    md->remove(phase_key);
+                    outp.write(block[i]);
+                    ++count;
+                    continue;
+                }
+                /* The batch procedure posts 0 when the time could not
+                 * be computed.  Treat that like a missing attribute. */
+                if(md->get<double>(phase_key)==0.0)
+                {
+                    cerr << "add_arrivals:  travel time calculation failed "
+                        << "for phase "<<phase<<endl
+                        << "Copying data without required arrival time attribute"
+                        <<endl;
+                    md->remove(phase_key);
+                    outp.write(block[i]);
+                    ++count;
+                    continue;
+                }
+                Hypocenter h(rad(g[0]),rad(g[1]),g[2],g[3],TTmethod,TTmodel);
+                double lat=rad(g[4]);
+                double lon=rad(g[5]);
+                if(save_delta)
+                    md->put(delta_key,deg(h.distance(lat,lon)));
+                if(save_baz)
+                    md->put(baz_key,deg(h.seaz(lat,lon)));
+                if(save_slowness)
+                {
+                    try{
+                        slow=table.phaseslow(h,lat,lon,g[6]);
+                        md->put(slowness_ux_key,slow.ux);
+                        md->put(slowness_uy_key,slow.uy);
+                    }catch(SeisppError& serr)
+                    {
+                        cerr << "add_arrivals:  slowness vector calculation failed."
+                            <<"  Error message posted:"<<endl;
+                        serr.log_error();
+                        cerr << "Slowness data not saved, but program continues"
+                            <<endl;
+                    }
+                }
+                outp.write(block[i]);
+                ++count;
+            }
+        }
+        return count;
+    }catch(...){throw;};
+}
+
 bool SEISPP::SEISPP_verbose(false);
 int main(int argc, char **argv)
 {
@@ -213,17 +328,40 @@ int main(int argc, char **argv)
     try{
         Metadata control(pf);
         AllowedObjects dtype=get_object_type(otype);
+        /* Optional so older parameter files still work */
+        bool use_table(false);
+        try{
+            use_table=control.get_bool("use_travel_time_table");
+        }catch(MetadataGetError& mde){use_table=false;};
+        if(use_table)
+        {
+            try{
+                control.get_int("block_size");
+            }catch(MetadataGetError& mde){control.put("block_size",1000);};
+            try{
+                control.get_int("nthreads");
+            }catch(MetadataGetError& mde){control.put("nthreads",0);};
+        }
         int count;
         switch (dtype)
         {
             case TCS:
-                count=add_arrivals<ThreeComponentSeismogram>(control,binary_data);
+                if(use_table)
+                    count=add_arrivals_batch<ThreeComponentSeismogram>(control,binary_data);
+                else
+                    count=add_arrivals<ThreeComponentSeismogram>(control,binary_data);
                 break;
             case TS:
-                count=add_arrivals<TimeSeries>(control,binary_data);
+                if(use_table)
+                    count=add_arrivals_batch<TimeSeries>(control,binary_data);
+                else
+                    count=add_arrivals<TimeSeries>(control,binary_data);
                 break;
             case PMTS:
-                count=add_arrivals<PMTimeSeries>(control,binary_data);
+                if(use_table)
+                    count=add_arrivals_batch<PMTimeSeries>(control,binary_data);
+                else
+                    count=add_arrivals<PMTimeSeries>(control,binary_data);
                 break;
             default:
                 cerr << "Coding problem - dtype variable does not match enum"
@@ -12,11 +12,14 @@ using namespace std;
 using namespace SEISPP;
 void usage()
 {
-    cerr << "build_index dfile [-o indexfile -t object_type -v --help -pf pffile]"
+    cerr << "build_index dfile [dfile2 ... -o indexfile -t object_type -binary -j n -v --help -pf pffile]"
         <<endl
         << "Builds an index from dfile and writes an indexfile"<<endl
         << "Index is defined by parameters in pffile"<<endl
-        << " Use -o to change default index file name (basename.inx)"<<endl
+        << " Use -o to change default index file name (basename.idx) - allowed only with one dfile"<<endl
+        << " When more than one dfile is given the indexes are built in parallel"<<endl
+        << " Use -j to set number of threads used for multiple files (default is number of cpus)"<<endl
+        << " Use -binary to write the index in binary form (faster to load, not portable)"<<endl
         << " Use -t to select object type expected for input. "<<endl
         << " (Allowed options=ThreeComponentEnsemble (default),ThreeComponentSeismogram, TimeSeries, PMTimeSeries, and TimeSeriesEnsemble)"<<endl
         << " -v - be more verbose"<<endl
@@ -53,16 +56,32 @@ AllowedObjects get_object_type(string otype)
  * Fairly simple changes to work for files - change the arguments
  * and calls to constructors.  Example returns a count of the
  * number of objects copied. */
-template <typename DataType> int build_index(string dfile,
-  string indexfile, MetadataList mdl)
+template <typename DataType> int build_index(list<string> dfiles,
+  string indexfile, MetadataList mdl, bool binary, int nthreads)
 {
     try{
       int count;
-      StreamObjectFileIndex<DataType> indexer(dfile,mdl);
+      if(dfiles.size()>1)
+      {
+        list<string> idxlist;
+        idxlist=build_indexes<DataType>(dfiles,mdl,nthreads,binary);
+        return idxlist.size();
+      }
+      StreamObjectFileIndex<DataType> indexer(dfiles.front(),mdl);
       if(indexfile=="DEFAULT")
-        count=indexer.writeindex();
+      {
+        if(binary)
+          count=indexer.writeindex_binary();
+        else
+          count=indexer.writeindex();
+      }
       else
-        count=indexer.writeindex(indexfile);
+      {
+        if(binary)
+          count=indexer.writeindex_binary(indexfile);
+        else
+          count=indexer.writeindex(indexfile);
+      }
       return count;
     }catch(...){throw;};
 }
@@ -75,9 +94,12 @@ int main(int argc, char **argv)
       if(string(argv[1])=="--help") usage();
     if(argc<2) usage();
     string otype("ThreeComponentSeismogram");
-    string dfile(argv[1]);
+    list<string> dfiles;
+    dfiles.push_back(string(argv[1]));
     string indexfile("DEFAULT");
     string pffile("build_index");
+    bool binary(false);
+    int nthreads(0);
     for(i=2;i<argc;++i)
     {
         string sarg(argv[i]);
@@ -105,8 +127,23 @@ int main(int argc, char **argv)
             if(i>=argc)usage();
             pffile=string(argv[i]);
         }
-        else
+        else if(sarg=="-j")
+        {
+            ++i;
+            if(i>=argc)usage();
+            nthreads=atoi(argv[i]);
+        }
+        else if(sarg=="-binary")
+            binary=true;
+        else if(sarg[0]=='-')
             usage();
+        else
+            dfiles.push_back(sarg);
+    }
+    if( (dfiles.size()>1) && (indexfile!="DEFAULT") )
+    {
+        cerr << "build_index:  -o cannot be used when indexing multiple files"<<endl;
+        usage();
     }
     try{
       PfStyleMetadata control(pffile);
@@ -117,19 +154,19 @@ int main(int argc, char **argv)
         switch (dtype)
         {
             case TCS:
-                count=build_index<ThreeComponentSeismogram>(dfile,indexfile,mdl);
+                count=build_index<ThreeComponentSeismogram>(dfiles,indexfile,mdl,binary,nthreads);
                 break;
             case TCE:
-                count=build_index<ThreeComponentEnsemble>(dfile,indexfile,mdl);
+                count=build_index<ThreeComponentEnsemble>(dfiles,indexfile,mdl,binary,nthreads);
                 break;
             case TS:
-                count=build_index<TimeSeries>(dfile,indexfile,mdl);
+                count=build_index<TimeSeries>(dfiles,indexfile,mdl,binary,nthreads);
                 break;
             case TSE:
-                count=build_index<TimeSeriesEnsemble>(dfile,indexfile,mdl);
+                count=build_index<TimeSeriesEnsemble>(dfiles,indexfile,mdl,binary,nthreads);
                 break;
             case PMTS:
-                count=build_index<PMTimeSeries>(dfile,indexfile,mdl);
+                count=build_index<PMTimeSeries>(dfiles,indexfile,mdl,binary,nthreads);
                 break;
             default:
                 cerr << "Coding problem - dtype variable does not match enum"
@@ -138,8 +175,13 @@ int main(int argc, char **argv)
                 exit(-1);
         };
         if(SEISPP_verbose)
-          cerr << "build_index:  constructed index for "<<count<<" objects for file "
-          << dfile<<endl;
+        {
+          if(dfiles.size()>1)
+            cerr << "build_index:  constructed indexes for "<<count<<" files"<<endl;
+          else
+            cerr << "build_index:  constructed index for "<<count<<" objects for file "
+              << dfiles.front()<<endl;
+        }
     }catch(SeisppError& serr)
     {
         serr.log_error();
@@ -36,6 +36,30 @@ AttributeCrossReference pfload_ACR(Pf *pf,string tag)
     return (AttributeCrossReference(acrstr));
   }catch(...){throw;};
 }
+/* Parses the optional predicted_arrivals Tbl.  Each line is a phase name
+followed by the key used to store the predicted arrival time of that phase.
+Returns false if the Tbl is absent or empty. */
+bool load_phase_list(Pf *pf,vector<string>& phases,vector<string>& keys)
+{
+    Tbl *t;
+    t=pfget_tbl(pf,const_cast<char *>("predicted_arrivals"));
+    if(t==NULL) return false;
+    for(int i=0;i<maxtbl(t);++i)
+    {
+        char *line=(char *)gettbl(t,i);
+        istringstream ss(line);
+        string phase,key;
+        ss >> phase >> key;
+        if(phase.length()==0) continue;
+        if(key.length()==0)
+            throw SeisppError(string("db2seispp:  predicted_arrivals line=")
+                    + line + " does not define a key for the time");
+        phases.push_back(phase);
+        keys.push_back(key);
+    }
+    freetbl(t,0);
+    return(phases.size()>0);
+}
 bool SEISPP::SEISPP_verbose(false);
 int main(int argc, char **argv)
 {
@@ -112,6 +136,34 @@ int main(int argc, char **argv)
         out=shared_ptr<StreamObjectWriter<ThreeComponentSeismogram>>
              (new StreamObjectWriter<ThreeComponentSeismogram>);
       }
+      /* Optionally post predicted arrival times.  When enabled seismograms
+      are buffered in blocks and times for a whole block are interpolated 
+      from travel time tables in parallel before the block is written. */
+      vector<string> phases,predarr_keys;
+      vector<TravelTimeTable *> tables;
+      bool predict=load_phase_list(pf,phases,predarr_keys);
+      int block_size(1),nthreads(0);
+      vector<string> geometry_keys;
+      if(predict)
+      {
+        string TTmethod(pfget_string(pf,const_cast<char *>("TTmethod")));
+        string TTmodel(pfget_string(pf,const_cast<char *>("TTmodel")));
+        block_size=pfget_int(pf,const_cast<char *>("block_size"));
+        nthreads=pfget_int(pf,const_cast<char *>("nthreads"));
+        if(block_size<1) block_size=1;
+        for(i=0;i<phases.size();++i)
+          tables.push_back(new TravelTimeTable(TTmethod,TTmodel,phases[i]));
+        geometry_keys.push_back("origin.lat");
+        geometry_keys.push_back("origin.lon");
+        geometry_keys.push_back("origin.depth");
+        geometry_keys.push_back("origin.time");
+        geometry_keys.push_back("site.lat");
+        geometry_keys.push_back("site.lon");
+        geometry_keys.push_back("site.elev");
+      }
+      vector<ThreeComponentSeismogram> block;
+      block.reserve(block_size);
+      int nfailures(0);
       /* Now we work through the entire view. All the hard work here is done
       in the 3c seismogram constructor.*/
       long irec,nrec,nseis(0);
@@ -124,8 +176,13 @@ int main(int argc, char **argv)
           /* Seems necessary to hard code setting this dt attribute.
            * The above constructor does not appear to do that. */
           d.put("dt",d.dt);
-          out->write(d);
-          ++nseis;
+          if(predict)
+            block.push_back(d);
+          else
+          {
+            out->write(d);
+            ++nseis;
+          }
         }catch(SeisppError& serr)
         {
           cerr << "Error in processing database row="<<irec<<endl;
@@ -133,6 +190,25 @@ int main(int argc, char **argv)
           cerr << "Data for that seismogram may not have been written to output - blundering on"
             << endl;
         }
+        if( predict && ((block.size()>=block_size) || (irec==(nrec-1))) )
+        {
+          nfailures+=LoadPredictedArrivalTimes(block,tables,predarr_keys,
+                  nthreads,SEISPP_verbose,geometry_keys);
+          for(i=0;i<block.size();++i)
+          {
+            out->write(block[i]);
+            ++nseis;
+          }
+          block.clear();
+        }
+      }
+      for(i=0;i<tables.size();++i) delete tables[i];
+      if(SEISPP_verbose)
+      {
+        cerr << "db2seispp:  wrote "<<nseis<<" seismograms"<<endl;
+        if(predict)
+          cerr << "db2seispp:  number of predicted times that could not be computed (set to 0)="
+            << nfailures<<endl;
       }
     }
     catch(SeisppError& serr)
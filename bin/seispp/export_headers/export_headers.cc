@@ -0,0 +1,226 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <list>
+#include <iostream>
+#include <fstream>
+#include "seispp.h"
+#include "ensemble.h"
+#include "PfStyleMetadata.h"
+#include "HeaderColumnTable.h"
+using namespace std;   // most compilers do not require this
+using namespace SEISPP;  //This is essential to use SEISPP library
+void usage()
+{
+    cerr << "export_headers columnfile [-o outfile -csv -header -t objecttype "
+        << "-members -dataset pffile -noindex -showfile -showcount "
+        << "-n nthreads -text] [file1 file2 ...]"
+        <<endl
+        << "Bulk extraction of Metadata from files of serialized objects"
+        <<endl
+        << "columnfile defines the output columns with the same format as listhdr -csv"
+        <<endl
+        << "   (one line per column:  key type undefined_value)"<<endl
+        << "Reads the list of data or index (.idx) files or stdin if no files are given"
+        <<endl
+        << " -o - write a binary column table to outfile (default is csv to stdout)"
+        <<endl
+        << " -csv - write csv to outfile instead of a binary table"<<endl
+        << " -header - put a line of column names at the top of csv output"<<endl
+        << " -t - specify the type of object expected"<<endl
+        << "      (Currently accept:  ThreeComponentSeismogram (default), ThreeComponentEnsemble"<<endl
+        << "      TimeSeries, and TimeSeriesEnsemble)"<<endl
+        << " -members - write one row per ensemble member (ensemble values fill undefined keys)"
+        <<endl
+        << " -dataset - read the IndexFileList of a DataSetReader parameter file"
+        <<endl
+        << " -noindex - always scan data files (default uses an index holding all keys)"
+        <<endl
+        << " -showfile - add a first column with the data file name"<<endl
+        << " -showcount - add a column with the object number in each file"<<endl
+        << " -n - number of files scanned in parallel (default number of cores)"
+        <<endl
+        << " -text - input from stdin is text format (default is binary)"<<endl;
+    exit(-1);
+}
+enum AllowedObjects {TCS, TCE, TS, TSE};
+AllowedObjects get_object_type(string otype)
+{
+    if(otype=="ThreeComponentSeismogram")
+        return TCS;
+    else if(otype=="ThreeComponentEnsemble")
+        return TCE;
+    else if(otype=="TimeSeries")
+        return TS;
+    else if(otype=="TimeSeriesEnsemble")
+        return TSE;
+    else
+    {
+        cerr << "Do not know how to handle object type="<<otype
+            <<endl<< "Cannot continue"<<endl;
+        exit(-1);
+    }
+}
+template <class Tdata> long export_headers(vector<HeaderColumn>& cols,
+        list<string>& files, HeaderTableWriter& out, bool members,
+        bool use_index, bool binary_data, int nthreads)
+{
+    try{
+        HeaderExporter<Tdata> exporter(cols,members,use_index);
+        long nobj;
+        if(files.empty())
+            nobj=exporter.export_stream(cin,binary_data ? 'b' : 't',out);
+        else
+            nobj=exporter.export_files(files,out,nthreads);
+        out.close();
+        return nobj;
+    }catch(...){throw;};
+}
+bool SEISPP::SEISPP_verbose(true);
+int main(int argc, char **argv)
+{
+    int i;
+    if(argc<2) usage();
+    string colfile(argv[1]);
+    if(colfile[0]=='-') usage();
+    string otype("ThreeComponentSeismogram");
+    string outfile("");
+    string dataset_pf("");
+    bool csv_output(true);
+    bool force_csv(false);
+    bool header_line(false);
+    bool members(false);
+    bool use_index(true);
+    bool showfile(false);
+    bool showcount(false);
+    bool binary_data(true);
+    int nthreads(0);
+    list<string> files;
+    for(i=2;i<argc;++i)
+    {
+        string sarg(argv[i]);
+        if(sarg=="-o")
+        {
+            ++i;
+            if(i>=argc)usage();
+            outfile=string(argv[i]);
+            csv_output=false;
+        }
+        else if(sarg=="-csv")
+            force_csv=true;
+        else if(sarg=="-header")
+            header_line=true;
+        else if(sarg=="-t")
+        {
+            ++i;
+            if(i>=argc)usage();
+            otype=string(argv[i]);
+        }
+        else if(sarg=="-members")
+            members=true;
+        else if(sarg=="-dataset")
+        {
+            ++i;
+            if(i>=argc)usage();
+            dataset_pf=string(argv[i]);
+        }
+        else if(sarg=="-noindex")
+            use_index=false;
+        else if(sarg=="-showfile")
+            showfile=true;
+        else if(sarg=="-showcount")
+            showcount=true;
+        else if(sarg=="-n")
+        {
+            ++i;
+            if(i>=argc)usage();
+            nthreads=atoi(argv[i]);
+        }
+        else if(sarg=="-text")
+            binary_data=false;
+        else if(sarg[0]=='-')
+            usage();
+        else
+            files.push_back(sarg);
+    }
+    if(force_csv) csv_output=true;
+    try{
+        AllowedObjects dtype=get_object_type(otype);
+        if(dataset_pf.length()>0)
+        {
+            PfStyleMetadata pf=pfread(dataset_pf);
+            list<string> idxfiles=pf.get_tbl("IndexFileList");
+            files.splice(files.end(),idxfiles);
+        }
+        if(files.empty() && showfile)
+        {
+            cerr << "Illegal argument combination"<<endl
+                << "-showfile options not allowed with input from stdin"
+                <<endl;
+            usage();
+        }
+        vector<HeaderColumn> cols;
+        if(showfile)
+            cols.push_back(HeaderColumn("file",MDstring,"",HCfile));
+        if(showcount)
+            cols.push_back(HeaderColumn("object",MDint,"",HCobject));
+        vector<HeaderColumn> mdcols=read_header_columns(colfile);
+        cols.insert(cols.end(),mdcols.begin(),mdcols.end());
+        ofstream ofs;
+        HeaderTableWriter *out;
+        if(csv_output)
+        {
+            if(outfile.length()>0)
+            {
+                ofs.open(outfile.c_str(),ios::out | ios::trunc);
+                if(ofs.fail())
+                {
+                    cerr << "Open failed on output file "<<outfile<<endl;
+                    exit(-1);
+                }
+                out=new CSVHeaderTableWriter(ofs,header_line);
+            }
+            else
+                out=new CSVHeaderTableWriter(cout,header_line);
+        }
+        else
+            out=new BinaryHeaderTableWriter(outfile,cols);
+        long nobj;
+        switch (dtype)
+        {
+            case TCS:
+                nobj=export_headers<ThreeComponentSeismogram>(cols,files,*out,
+                        members,use_index,binary_data,nthreads);
+                break;
+            case TCE:
+                nobj=export_headers<ThreeComponentEnsemble>(cols,files,*out,
+                        members,use_index,binary_data,nthreads);
+                break;
+            case TS:
+                nobj=export_headers<TimeSeries>(cols,files,*out,
+                        members,use_index,binary_data,nthreads);
+                break;
+            case TSE:
+                nobj=export_headers<TimeSeriesEnsemble>(cols,files,*out,
+                        members,use_index,binary_data,nthreads);
+                break;
+            default:
+                cerr << "Coding problem - dtype variable does not match enum"
+                    <<endl
+                    << "Fatal error - bug fix required. "<<endl;
+                exit(-1);
+        };
+        delete out;
+        if(SEISPP_verbose && (outfile.length()>0))
+            cerr << "export_headers:  "<<nobj<<" objects scanned"<<endl;
+    }catch(SeisppError& serr)
+    {
+        serr.log_error();
+        exit(-1);
+    }
+    catch(std::exception& stexc)
+    {
+        cerr << stexc.what()<<endl;
+        exit(-1);
+    }
+}
@@ -0,0 +1,105 @@
+#include <math.h>
+#include <sstream>
+#include "perf.h"
+#include "SeisppError.h"
+#include "DPSSTapers.h"
+using namespace std;
+using namespace SEISPP;
+/* Computes the concentration ratio of a unit energy taper.  A dpss is
+an eigenvector of the sinc kernel A(m)=sin(2 pi W m)/(pi m) as well as
+of the tridiagonal matrix used to compute it, so the ratio is
+(A h)_j / h_j for any j.  We use the row where h is largest.  This is
+O(n) and done entirely in double precision, which matters because
+1-lambda is as small as 1e-10 for the best tapers and enters the
+adaptive weights directly. */
+static double concentration(const double *h, int n, double W)
+{
+  int i,j;
+  j=0;
+  for(i=1;i<n;++i) if(fabs(h[i])>fabs(h[j])) j=i;
+  double result=2.0*W*h[j];
+  for(i=0;i<n;++i)
+  {
+    if(i==j) continue;
+    double m=(double)(j-i);
+    result += h[i]*sin(2.0*M_PI*W*m)/(M_PI*m);
+  }
+  return(result/h[j]);
+}
+DPSSTapers::DPSSTapers(int n, double nw, int k)
+{
+  const string base_error("DPSSTapers constructor:  ");
+  if(k<=0) k=(int)(2.0*nw)-1;
+  if(k<1)k=1;
+  if((n<2) || (nw<=0.0) || (k>n))
+  {
+    stringstream ss;
+    ss << base_error << "illegal parameters N="<<n<<", NW="<<nw
+      << ", number of tapers="<<k<<endl;
+    throw SeisppError(ss.str());
+  }
+  N=n;
+  NW=nw;
+  ntapers=k;
+  double W=nw/((double)n);
+  int i;
+  /* Tridiagonal matrix of Slepian (1978) whose eigenvectors are the
+   dpss.  Largest eigenvalues correspond to the best concentrated
+   tapers */
+  vector<double> d(n),e(n);
+  double c=cos(2.0*M_PI*W);
+  for(i=0;i<n;++i)
+  {
+    double x=((double)(n-1-2*i))/2.0;
+    d[i]=x*x*c;
+    if(i>0) e[i-1]=((double)(i*(n-i)))/2.0;
+  }
+  integer nn(n),il(n-k+1),iu(n),m,nsplit,info;
+  double vl(0.0),vu(0.0),abstol(0.0);
+  char range('I'),order('B');
+  vector<double> w(n),work(5*n);
+  vector<integer> iblock(n),isplit(n),iwork(3*n),ifail(k);
+  dstebz_(&range,&order,&nn,&vl,&vu,&il,&iu,&abstol,&(d[0]),&(e[0]),
+      &m,&nsplit,&(w[0]),&(iblock[0]),&(isplit[0]),&(work[0]),
+      &(iwork[0]),&info);
+  if((info!=0) || (m!=k))
+  {
+    stringstream ss;
+    ss << base_error << "dstebz failed with info="<<info
+      << " computing "<<k<<" eigenvalues for N="<<n<<endl;
+    throw SeisppError(ss.str());
+  }
+  vector<double> z(n*k);
+  dstein_(&nn,&(d[0]),&(e[0]),&m,&(w[0]),&(iblock[0]),&(isplit[0]),
+      &(z[0]),&nn,&(work[0]),&(iwork[0]),&(ifail[0]),&info);
+  if(info!=0)
+  {
+    stringstream ss;
+    ss << base_error << "dstein failed with info="<<info<<endl;
+    throw SeisppError(ss.str());
+  }
+  /* dstebz returns eigenvalues in ascending order so the best 
+   concentrated taper is the last column */
+  h.resize(n*k);
+  lambda.resize(k);
+  int j;
+  for(j=0;j<k;++j)
+  {
+    double *zk=&(z[(k-1-j)*n]);
+    double *hk=&(h[j*n]);
+    double sumsq(0.0),test(0.0);
+    for(i=0;i<n;++i) sumsq+=zk[i]*zk[i];
+    double scale=1.0/sqrt(sumsq);
+    if(j%2)
+    {
+      for(i=0;i<n;++i) test += ((double)(n-1-2*i))*zk[i];
+    }
+    else
+    {
+      for(i=0;i<n;++i) test += zk[i];
+    }
+    if(test<0.0) scale=-scale;
+    for(i=0;i<n;++i) hk[i]=scale*zk[i];
+    lambda[j]=concentration(hk,n,W);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef _DPSSTAPERS_H_
+#define _DPSSTAPERS_H_
+#include <vector>
+/*! \brief Discrete prolate spheroidal sequences (Slepian tapers).
+
+This object holds the set of tapers used for a multitaper spectral
+estimate of a series of length N with time-bandwidth product NW.  Following
+matlab's pmtm, which this code replaces, the default number of tapers is
+2*NW-1.   The tapers are computed as the eigenvectors of the tridiagonal
+matrix that commutes with the concentration problem (Percival and Walden,
+1993, section 8.3) using the LAPACK routines dstebz and dstein.
+Each taper is normalized to unit energy.  Symmetric tapers are signed
+to have a positive sum and antisymmetric tapers to have a positive
+first lobe, which is the same convention as matlab.
+*/
+class DPSSTapers
+{
+public:
+  /*! Length of each taper. */
+  int N;
+  /*! Time-bandwidth product used to compute the tapers. */
+  double NW;
+  /*! Number of tapers stored. */
+  int ntapers;
+  /*! Taper k sample i is stored at h[k*N+i]. */
+  std::vector<double> h;
+  /*! Concentration ratio (fraction of energy inside +-W) of each taper.
+   These are the weights needed for adaptive weighting. */
+  std::vector<double> lambda;
+  /*! Compute tapers for length n and time-bandwidth product nw.
+
+  \param n number of samples.
+  \param nw time-bandwidth product.
+  \param k number of tapers to compute.  If k<=0 (default) 2*nw-1 tapers
+    are computed.
+  \exception SeisppError is thrown if the LAPACK solvers fail or the
+    parameters are nonsensical.
+    */
+  DPSSTapers(int n, double nw, int k=0);
+  /*! Return a pointer to the first sample of taper k. */
+  const double *taper(int k) const {return &(h[k*N]);};
+};
+#endif
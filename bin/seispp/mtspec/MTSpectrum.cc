@@ -1,84 +1,155 @@
+#include <math.h>
 #include <sstream>
 #include <vector>
 #include "TimeSeries.h"
 #include "ThreeComponentSeismogram.h"
 #include "MTSpectrum.h"
+#include "parallel_for.h"
+#include "fftplan.h"
 using namespace std;
 using namespace SEISPP;
 /* This is presently in a local file but might b moved to a library
  * some day. */
 int getfftlength(int N);
+shared_ptr<const DPSSTapers> MTSpectrumCache::tapers(int n, double nw)
+{
+  std::lock_guard<std::mutex> lock(cache_lock);
+  pair<int,double> key(n,nw);
+  map<pair<int,double>,shared_ptr<const DPSSTapers> >::iterator tptr;
+  tptr=taper_cache.find(key);
+  if(tptr!=taper_cache.end()) return tptr->second;
+  shared_ptr<const DPSSTapers> result(new DPSSTapers(n,nw));
+  taper_cache[key]=result;
+  return result;
+}
 MTSpectrum::MTSpectrum()
 {
   tbp=4.0;
-  try{
-    matlab = shared_ptr<MatlabProcessor>(new MatlabProcessor);
-  }catch(...){throw;};
+  nthreads=0;
+  cache = shared_ptr<MTSpectrumCache>(new MTSpectrumCache);
 }
 MTSpectrum::MTSpectrum(double time_bandwidth_product)
 {
   tbp=time_bandwidth_product;
-  try{
-    matlab = shared_ptr<MatlabProcessor>(new MatlabProcessor);
-  }catch(...){throw;};
+  nthreads=0;
+  cache = shared_ptr<MTSpectrumCache>(new MTSpectrumCache);
 }
 MTSpectrum::MTSpectrum(const MTSpectrum& parent)
 {
   tbp=parent.tbp;
-  matlab=parent.matlab;
+  nthreads=parent.nthreads;
+  cache=parent.cache;
 }
 MTSpectrum& MTSpectrum::operator=(const MTSpectrum& parent)
 {
   if(this!=(&parent))
   {
     tbp=parent.tbp;
-    matlab=parent.matlab;
+    nthreads=parent.nthreads;
+    cache=parent.cache;
   }
+  return *this;
 }
-const string vname("y");
-const string mname("u");
-const string specname("Y");
-const string freqname("f");
-/* This small helper creates a string of commands to send to
-matlab to compute multitaper spectrum.  Args are
-
-dname - matlab symbol name for data vector or matrix
-tbp - time bandwidth product.
-N - length of array sent to matlab
-fs - sampling frequncy in Hz
-*/
-string build_process_commands(string dname, double tbp, int N, double fs)
+/* Iteration limit for adaptive weighting.   The iteration normally
+converges in a few passes;  this only guards against pathological data.*/
+const int MaxAdaptiveIterations(100);
+double MTSpectrum::psd(const double *x, int stride, int n, double fs,
+        vector<double>& result)
 {
-  stringstream ss;
-  int nfft;
-  nfft=getfftlength(N);
-  ss << "["<<specname <<",f]"
-    << "=pmtm("<<dname<<","<<tbp<<","<<nfft<<","<<fs<<")"<<endl;
-  return(ss.str());
+  shared_ptr<const DPSSTapers> dpss=cache->tapers(n,this->tbp);
+  int nfft=getfftlength(n);
+  FFTplan *plan=fftplan_get(nfft,1);
+  bool ownplan(false);
+  /* libfft returns NULL when its shared plan cache is full */
+  if(plan==NULL)
+  {
+    plan=fftplan_new(nfft,1);
+    ownplan=true;
+  }
+  int K=dpss->ntapers;
+  int nf=nfft/2+1;
+  int i,j,k;
+  vector<double> Sk(K*nf);
+  vector<float> z(nfft+2),work(fftplan_worksize(plan));
+  /* Each tapered series is a real transform.  libfft returns the nf
+   nonnegative frequency values with real and imaginary parts 
+   alternating. */
+  for(k=0;k<K;++k)
+  {
+    const double *h=dpss->taper(k);
+    for(i=0;i<n;++i) z[i]=h[i]*x[i*stride];
+    for(i=n;i<nfft+2;++i) z[i]=0.0;
+    fftplan_forward(plan,&(z[0]),&(work[0]));
+    double *Sa=&(Sk[k*nf]);
+    for(j=0;j<nf;++j)
+    {
+      double re=z[2*j];
+      double im=z[2*j+1];
+      Sa[j]=re*re+im*im;
+    }
+  }
+  if(ownplan) fftplan_free(plan);
+  vector<double> S(nf);
+  if(K==1)
+  {
+    for(j=0;j<nf;++j) S[j]=Sk[j];
+  }
+  else
+  {
+    /* Adaptive weighting following the algorithm used in pmtm */
+    double sig2(0.0);
+    for(i=0;i<n;++i) sig2 += x[i*stride]*x[i*stride];
+    sig2 /= ((double)n);
+    double tol=0.0005*sig2/((double)nfft);
+    vector<double> a(K),S1(nf,0.0),b(K);
+    for(k=0;k<K;++k) a[k]=sig2*(1.0-dpss->lambda[k]);
+    for(j=0;j<nf;++j) S[j]=(Sk[j]+Sk[nf+j])/2.0;
+    int iteration;
+    for(iteration=0;iteration<MaxAdaptiveIterations;++iteration)
+    {
+      double change(0.0);
+      for(j=0;j<nf;++j)
+      {
+        double sumw(0.0),sumws(0.0);
+        for(k=0;k<K;++k)
+        {
+          double bk=S[j]/(S[j]*dpss->lambda[k]+a[k]);
+          double wk=bk*bk*dpss->lambda[k];
+          sumw += wk;
+          sumws += wk*Sk[k*nf+j];
+        }
+        S1[j]=sumws/sumw;
+        change += fabs(S1[j]-S[j]);
+      }
+      S.swap(S1);
+      if((change/((double)nf))<=tol) break;
+    }
+  }
+  /* One sided density scaling used by pmtm */
+  result.resize(nf);
+  for(j=0;j<nf;++j)
+  {
+    result[j]=S[j]/fs;
+    if((j>0) && (j<(nf-1))) result[j]*=2.0;
+  }
+  return(fs/((double)nfft));
 }
 TimeSeries MTSpectrum::spectrum(Metadata& md, double *d, int nd)
 {
   try{
-    string commands;
-    double fs;
+    double fs(1.0);
     /* Attempt to extract sampling frequency from Metadata.  If
      * if tails default to 1.0 */
     try{
         fs=md.get<double>("samprate");
-        fs=1.0/fs;
     }catch(MetadataGetError& mde)
     {
         cerr << "Warning(MTSpectrum::spectrum(Metadata& md, double *d, int nd) method"<<endl
             << "samprate attribute not defined - defaulting to 1.0. "<<endl
             << "Computed frequencies will likely be wrong"<<endl;
     }
-    commands=build_process_commands(vname,this->tbp,nd,fs);
-    matlab->load(d,nd,vname);
-    matlab->process(commands);
-    vector<double> s,f;
-    s=matlab->retrieve_vector(specname);
-    f=matlab->retrieve_vector(freqname);
-    double df=f[1]-f[0];
+    vector<double> s;
+    double df=this->psd(d,1,nd,fs,s);
     TimeSeries dts(md,false);
     dts.s=s;
     dts.ns=s.size();
@@ -98,18 +169,10 @@ TimeSeries MTSpectrum::spectrum(Metadata& md, vector<double>& d)
 TimeSeries MTSpectrum::spectrum(TimeSeries d)
 {
   try{
-    string commands;
     double fs;
     fs=1.0/(d.dt);  
-    commands=build_process_commands(vname,this->tbp,d.s.size(),fs);
-    /* There is an overloaded method to directoy load a TimeSeries data
-    vector as vname */
-    matlab->load(d,vname);
-    matlab->process(commands);
-    vector<double> s,f;
-    s=matlab->retrieve_vector(specname);
-    f=matlab->retrieve_vector(freqname);
-    double df=f[1]-f[0];
+    vector<double> s;
+    double df=this->psd(&(d.s[0]),1,d.s.size(),fs,s);
     /* We modify the copy of d to hold the power spectrum estimate*/
     d.s=s;
     d.ns=s.size();
@@ -123,23 +186,21 @@ TimeSeries MTSpectrum::spectrum(TimeSeries d)
 ThreeComponentSeismogram MTSpectrum::spectrum(ThreeComponentSeismogram d)
 {
   try{
-    string commands;
     double fs;
     fs=1.0/(d.dt);  
-    commands=build_process_commands(mname,this->tbp,d.ns,fs);
-    /* Matlab requires the component data to be in the columns, but the
-    3c object stores sample data in the columns. */
-    dmatrix ut=tr(d.u);
-    matlab->load(ut,mname);
-    matlab->process(commands);
-    shared_ptr<dmatrix> u;
-    vector<double> f;
-    u=matlab->retrieve_matrix(specname);
-    f=matlab->retrieve_vector(freqname);
-    double df=f[1]-f[0];
+    /* The 3c object stores sample data in the columns of u so each 
+    component is a row accessed with a stride of 3 */
+    vector<double> s[3];
+    double df(0.0);
+    int k,j;
+    for(k=0;k<3;++k)
+      df=this->psd(d.u.get_address(k,0),3,d.ns,fs,s[k]);
+    int nf=s[0].size();
+    dmatrix spec(3,nf);
+    for(j=0;j<nf;++j)
+      for(k=0;k<3;++k) spec(k,j)=s[k][j];
     /* We modify the copy of d to hold the power spectrum estimate*/
-    ut=tr(*u);
-    d.u=ut;
+    d.u=spec;
     d.ns=d.u.columns();
     d.dt=df;
     d.t0=0.0;
@@ -148,30 +209,41 @@ ThreeComponentSeismogram MTSpectrum::spectrum(ThreeComponentSeismogram d)
     return d;
   }catch(...){throw;};
 }
-
-TimeSeriesEnsemble MTSpectrum::spectrum(TimeSeriesEnsemble d)
+/* Ensemble members are handed out to threads by parallel_for.  Tapers 
+and FFT plans are shared through the cache so after the first member 
+all threads are doing nothing but FFTs. */
+template <typename Tdata> void MTSpectrum::process_members(vector<Tdata>& member)
 {
-  try{
-    int i;
-    for(i=0;i<d.member.size();++i)
+  int nm=member.size();
+  if(nm<=0) return;
+  /* Compute the tapers before threads are launched.  Not essential 
+   as the cache is locked, but this avoids all threads blocking on 
+   the first member. */
+  int i;
+  for(i=0;i<nm;++i)
+  {
+    if(member[i].live)
     {
-      TimeSeries spec;
-      spec=this->spectrum(d.member[i]);
-      d.member[i]=spec;
+      cache->tapers(member[i].ns,tbp);
+      break;
     }
+  }
+  parallel_for(nm,nthreads,[this,&member](long im)
+  {
+    if(member[im].live) member[im]=this->spectrum(member[im]);
+  });
+}
+TimeSeriesEnsemble MTSpectrum::spectrum(TimeSeriesEnsemble d)
+{
+  try{
+    this->process_members<TimeSeries>(d.member);
     return d;
   }catch(...){throw;};
 }
 ThreeComponentEnsemble MTSpectrum::spectrum(ThreeComponentEnsemble d)
 {
   try{
-    int i;
-    for(i=0;i<d.member.size();++i)
-    {
-      ThreeComponentSeismogram spec;
-      spec=this->spectrum(d.member[i]);
-      d.member[i]=spec;
-    }
+    this->process_members<ThreeComponentSeismogram>(d.member);
     return d;
   }catch(...){throw;};
 }
@@ -1,8 +1,29 @@
+#include <map>
 #include <vector>
+#include <memory>
+#include <mutex>
 #include "TimeSeries.h"
 #include "ThreeComponentSeismogram.h"
-#include "MatlabProcessor.h"
+#include "ensemble.h"
+#include "DPSSTapers.h"
 using namespace SEISPP;
+/*! \brief Cache of dpss tapers.
+
+Computing dpss tapers requires a tridiagonal eigenvalue problem and
+is by far the most expensive part of a multitaper estimate of a short
+series.   Data processed by mtspec are almost always the same length so
+this object holds tapers keyed by (N,NW) and builds them only the first 
+time they are needed.  FFT plans come from the shared plan cache in
+libfft.  Access is locked with a mutex so one cache can be shared by all 
+the threads of an ensemble calculation. */
+class MTSpectrumCache
+{
+public:
+  shared_ptr<const DPSSTapers> tapers(int n, double nw);
+private:
+  std::mutex cache_lock;
+  map<pair<int,double>,shared_ptr<const DPSSTapers> > taper_cache;
+};
 class MTSpectrum
 {
 public:
@@ -17,21 +38,41 @@ public:
   TimeSeries spectrum(TimeSeries d);
   /*! Process a 3C seismogram object.
 
-  The dmatrix returned in this case contains the spectra in the columnes
-  of thematrix.  Note that is the transpose of the data matrix */
+  Each component of the output is the spectrum of the same component of
+  the input. */
   ThreeComponentSeismogram spectrum(ThreeComponentSeismogram d);
+  /*! Process an ensemble.
+
+  Ensemble members are independent so the work is divided among 
+  threads (one per processor by default).  Dead members are passed through 
+  unaltered. */
   TimeSeriesEnsemble spectrum(TimeSeriesEnsemble d);
   ThreeComponentEnsemble spectrum(ThreeComponentEnsemble d);
-  /* This method is actually called by the above.  The distinction is that
-  in a 3c seismogram the matrix has to be transposed to match matlab.
-  When this is used the dmatrix is passed directly */
-  //`TimeSeriesEnsemble spectrum(TimeSeriesEnsemble d);
-  //ThreeComponentEnsemble spectrum(ThreeComponentEnsemble d);
+  /*! Low level method used by all of the above.
+
+  Computes the one sided power spectral density of a real series with
+  the adaptive weighting method of Thomson (1982).   Output scaling and
+  length (nfft/2+1) are the same as matlab's pmtm.
+
+  \param x pointer to first sample of the data.
+  \param stride increment between samples of x (allows direct use of
+    3C data matrix rows).
+  \param n number of samples in x.
+  \param fs sampling frequency in Hz.
+  \param psd output vector.  Resized to nfft/2+1.
+  \return frequency bin interval of psd.
+  */
+  double psd(const double *x, int stride, int n, double fs,
+          vector<double>& psd);
   double time_bandwidth_product(){return tbp;};
+  /*! Set the number of threads used for ensemble processing.
+   A value <=0 reverts to the default of one thread per processor. */
+  void set_number_threads(int n){nthreads=n;};
   MTSpectrum& operator=(const MTSpectrum& parent);
 private:
   double tbp;
-  /* We make this a shared ptr to allow copying although  it complicates
-  the constructors */
-  shared_ptr<MatlabProcessor> matlab;
+  int nthreads;
+  /* We make this a shared ptr so copies share tapers already computed */
+  shared_ptr<MTSpectrumCache> cache;
+  template <typename Tdata> void process_members(vector<Tdata>& member);
 };
@@ -23,7 +23,7 @@ void usage()
         << "object type as the input.   The dt attribute is replaced with the frequency"<<endl
         << "bin interval, ns may be adjusted, and t0 is set to 0"<<endl
         << "For 3C data each component in the output is the spectrum of that component of the input."<<endl
-        << "Note the implementation uses matlab so expect the program to display matlab's splash screen"<<endl
+        << "Spectra are estimated with dpss tapers and adaptive weighting (same output as matlab pmtm)"<<endl
         << " Use -tbp to change the time bandwidth produce (default is 4)"<<endl
         << " Use -t to select object type expected for input. "<<endl
         << " (Allowed options=ThreeComponentEnsemble (default),ThreeComponentSeismogram, TimeSeries, and TimeSeriesEnsemble)"<<endl
@@ -58,14 +58,14 @@ AllowedObjects get_object_type(string otype)
  * Fairly simple changes to work for files - change the arguments
  * and calls to constructors.  Example returns a count of the
  * number of objects copied. */
-template <typename DataType> int mtspec(int tbp, bool binary_data)
+template <typename DataType> int mtspec(double tbp, bool binary_data)
 {
     try{
         char form('t');
         if(binary_data) form='b';
         StreamObjectReader<DataType> inp(form);
         StreamObjectWriter<DataType>  outp(form);
-        MTSpectrum processor;
+        MTSpectrum processor(tbp);
         int count(0);
         DataType d;
         while(inp.good())
@@ -94,7 +94,7 @@ int main(int argc, char **argv)
     if(argc>1)
       if(string(argv[1])=="--help") usage();
     bool binary_data(true);
-    int time_bandwidth_product(4);
+    double time_bandwidth_product(4.0);
     string otype("ThreeComponentSeismogram");
 
     for(i=1;i<argc;++i)
@@ -108,7 +108,7 @@ int main(int argc, char **argv)
         {
             ++i;
             if(i>=argc)usage();
-            time_bandwidth_product=atoi(argv[i]);
+            time_bandwidth_product=atof(argv[i]);
         }
         else if(sarg=="-text")
         {
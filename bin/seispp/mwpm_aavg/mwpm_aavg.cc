@@ -7,7 +7,7 @@
 #include <memory>
 #include <math.h>
 #include "minicsv.h"
-#include "Vector3DBootstrapError.h"
+#include "VectorBootstrap.h"
 using namespace std;   
 //using namespace SEISPP;
 void usage()
@@ -115,7 +115,7 @@ int process(Vec& majornrm,Vec& dmajornrm,Vec& majoraz,Vec& dmajoraz,
      confidence values. Number of trials is a bit arbitrary but 
      has an implicit assumption nx is of the order of 10.  This 
      calculation is so simple overkill is preferable to undersampling */
-  Vector3DBootstrapError majerr(x3c,0.95,nx*1000);
+  SEISPP::Vector3DBootstrap majerr(x3c,0.95,nx*1000);
   Vec mv=majerr.mean_vector();
   for(i=0;i<3;++i) ofs<<mv[i]<<",";
   ofs<<majerr.angle_error()<<",";
@@ -127,9 +127,8 @@ int process(Vec& majornrm,Vec& dmajornrm,Vec& majoraz,Vec& dmajoraz,
     x3c(1,i)=minor3c[ii+1];
     x3c(2,i)=minor3c[ii+2];
   }
-  /* Vector3DBootstrapError currently lacks operator= so will
-     create a new copy for minor */
-  Vector3DBootstrapError minorerr(x3c,0.95,nx*1000);
+  /* Create a separate bootstrap object for minor */
+  SEISPP::Vector3DBootstrap minorerr(x3c,0.95,nx*1000);
   mv=minorerr.mean_vector();
   for(i=0;i<3;++i) ofs<<mv[i]<<",";
   ofs<<minorerr.angle_error()<<",";
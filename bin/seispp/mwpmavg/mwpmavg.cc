@@ -12,7 +12,7 @@
 #include "StreamObjectReader.h"
 #include "StreamObjectWriter.h"
 #include "VectorStatistics.h"
-#include "Vector3DBootstrapError.h"
+#include "VectorBootstrap.h"
 using namespace std;
 using namespace SEISPP;
 void usage()
@@ -195,8 +195,8 @@ PMAverageData::PMAverageData(PMTimeSeries d, string key, TimeWindow win)
     }
     else
     {
-        Vector3DBootstrapError majerr(majsamples,conf,numtrials);
-        Vector3DBootstrapError minerr(minsamples,conf,numtrials);
+        Vector3DBootstrap majerr(majsamples,conf,numtrials);
+        Vector3DBootstrap minerr(minsamples,conf,numtrials);
         vtmp=majerr.mean_vector();
         for(k=0;k<3;++k) this->major[k]=vtmp[k];
         vtmp=minerr.mean_vector();
@@ -284,7 +284,7 @@ PMAverageData::PMAverageData(PMTimeSeries d, string key, TimeWindow win,
     {
       live=true;
     }
-    /* Now we use the bootstrap error estimator in libmwpm.
+    /* Now we use the bootstrap error estimator in libseispp.
      * The confidence value and multiplier on the number of trials
      * is fixed here.   May want to add that as a parameter to the
      * pf for htis program */
@@ -325,8 +325,8 @@ PMAverageData::PMAverageData(PMTimeSeries d, string key, TimeWindow win,
             majsamples=truncate_cols(majsamples,this->count);
             minsamples=truncate_cols(minsamples,this->count);
         }
-        Vector3DBootstrapError majerr(majsamples,conf,numtrials);
-        Vector3DBootstrapError minerr(minsamples,conf,numtrials);
+        Vector3DBootstrap majerr(majsamples,conf,numtrials);
+        Vector3DBootstrap minerr(minsamples,conf,numtrials);
         dtheta_major_axes=majerr.angle_error();
         dtheta_minor_axes=minerr.angle_error();
 
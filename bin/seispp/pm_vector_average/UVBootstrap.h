@@ -1,13 +1,17 @@
 #ifndef _UVBOOTSTRAP_H_
 #define _UVBOOTSTRAP_H_
 #include <vector>
+#include <stdint.h>
 #include "UnitVector.h"
+#include "VectorBootstrap.h"
 using namespace std;
 /* This is a specialized implementation of the bootstrap to compute confidence intervals
    for angle deviations computed by dot products of a collection of unit vectors.
    It was derived from a similar implementation in the ParticleMotionTools
    libmwtpp library called Vector3Vector3DBootstrapError.
 
+   The resampling is done by the UnitVectorBootstrap engine in libseispp,
+   which runs trials in parallel with reproducible random number streams.
    */
 class UVBootstrap
 {
@@ -39,11 +43,16 @@ class UVBootstrap
     \param - confidence is the confidence level computed. This must be a
        number greater than 0 and less than 1 or an error is thrown.
     \number_trials - number of resampling trials for the bootstrap.
+    \param nthreads - number of threads to use (0 means one per processor).
+      Results do not depend on this value.
+    \param seed - seed for the bootstrap random number streams.
     */
     UVBootstrap(const vector<UnitVector>& x, const vector<double>& xerr,
         const SupportedPenaltyFunctions pen, const double scale,
         const double probability, const double mrwtr,
-        const double confidence, const int number_trials);
+        const double confidence, const int number_trials,
+        const int nthreads=0,
+        const uint64_t seed=SEISPP::BootstrapDefaultSeed);
     UnitVector mean_vector()
     {
       return mean;
@@ -64,8 +73,4 @@ class UVBootstrap
     /* input confidence level */
     double cl;
 };
-/*! This is a routine in libmwtpp - used hre to avoid needing to
-have an include statement for Vector3DBootstrapError from which this
-was derived */
-int random_array_index(int range);
 #endif
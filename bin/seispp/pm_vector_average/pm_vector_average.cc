@@ -93,6 +93,11 @@ int main(int argc, char **argv)
       int boot_min=control.get<int>("smallest_size_for_bootstrap");
       int mintrials=control.get<int>("minimum_number_bootstrap_trials");
       int maxtrials=control.get<int>("maximum_number_bootstrap_trials");
+      /* Older parameter files do not have this key.  Default is one 
+         thread per processor. */
+      int nthreads(0);
+      if(control.is_attribute_set("bootstrap_threads"))
+        nthreads=control.get<int>("bootstrap_threads");
       vector<double> errors;
       vector<UnitVector> x;
       vector<double> extra;
@@ -185,7 +190,7 @@ int main(int argc, char **argv)
         else if(number_of_trials>maxtrials)
           number_of_trials=maxtrials;
         UVBootstrap uboot(x,errors,pfunc,
-          error_scale,probability,mrwtr,cl,number_of_trials);
+          error_scale,probability,mrwtr,cl,number_of_trials,nthreads);
 
         cout << "Robust mean and theta error estimate from all data"<<endl
             << "x1 x2 x3 theta_error average_ssq average_chisq robust_rms robust_chisq N"<<endl;
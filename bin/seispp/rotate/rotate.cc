@@ -16,7 +16,7 @@
 #include "StreamObjectReader.h"
 #include "StreamObjectWriter.h"
 #include "ensemble.h"
-#include "Hypocenter.h"
+#include "RotateControl.h"
 using namespace std;   // most compilers do not require this
 using namespace SEISPP;  //This is essential to use SEISPP library
 void usage()
@@ -39,111 +39,6 @@ void usage()
         <<endl;
     exit(-1);
 }
-enum RotateMode {Fixed,ZRT,LQT,FST};
-class RotateControl
-{
-  public:
-    RotateControl(string pffile);
-    /* When true use the same angle for all data */
-    bool constant_transformation;
-    /* When true get event metadata from ensemble metadata not 
-     * trace data. This is a valid approximation only form small
-     * arrays */
-    bool saamode;
-    double phi,theta;
-    string stalatkey,stalonkey;
-    string evlatkey,evlonkey,evdepthkey;
-    string ttmethod,ttmodel;
-    RotateMode mode;
-    /* Surface P and S needed for or LQT */
-    double vp0,vs0;
-    /* When true LQT and FST modes will use S slowness.  Default is P*/
-    bool use_S_slowness;
-};
-RotateControl::RotateControl(string pffile)
-{
-  const string base_error("RotateControl constructor:  ");
-  Pf *pf;
-  if(pfread(const_cast<char *>(pffile.c_str()),&pf))
-    throw SeisppError(base_error+"pfread failed for "+pffile);
-  try{
-    Metadata md(pf);
-    string modedef=md.get_string("rotation_type");
-    constant_transformation=false;
-    if(modedef=="constant")
-    {
-      constant_transformation=true;
-      phi=md.get_double("phi");
-      theta=md.get_double("theta");
-      /* convert both to radians */
-      phi=rad(phi);
-      theta=rad(theta);
-    }
-    else if(modedef=="ZRT")
-      mode=ZRT;
-    else if(modedef=="LQT")
-      mode=LQT;
-    else if(modedef=="FST")
-      mode=FST;
-    else
-      throw SeisppError(base_error 
-          + "Illegal entry in parameter file for rotation_type="+modedef);
-    saamode=md.get_bool("small_aperture_array_mode");
-    if(saamode && constant_transformation)
-    {
-      cerr << "rotate (WARNING):  pf file specifies constant transformation "
-        << "and small aperture array mode"<<endl
-        << "Turning off small aperture array mode"<<endl;
-      saamode=false;
-    }
-    string nullstring("");
-    if(constant_transformation)
-    {
-      phi=md.get_double("phi");
-      theta=md.get_double("theta");
-      /* convert both to radians */
-      phi=rad(phi);
-      theta=rad(theta);
-      stalatkey=nullstring;
-      stalonkey=nullstring;
-      evlatkey=nullstring;
-      evlatkey=nullstring;
-      evdepthkey=nullstring;
-      ttmethod=nullstring;
-      ttmodel=nullstring;
-    }
-    else
-    {
-      phi=0.0;
-      theta=0.0;
-      stalatkey=md.get_string("station_latitude_key");
-      stalonkey=md.get_string("station_longitude_key");
-      evlatkey=md.get_string("event_latitude_key");
-      evlonkey=md.get_string("event_longitude_key");
-      evdepthkey=md.get_string("event_depth_key");
-      ttmethod=md.get_string("ttmethod");
-      ttmodel=md.get_string("ttmodel");
-      vp0=md.get_double("vp0");
-      vs0=md.get_double("vs0");
-    }
-    use_S_slowness=md.get_bool("use_S_slowness");
-  }catch(...){throw;};
-}
-SlownessVector ComputeSlownessVector(double stalat,double stalon,
-    double evlat,double evlon,double evdepth, RotateControl& rc)
-{
-  /* Use this for origin time - times are not important to us 
-     so it can be bogus */
-  double otime(0.0);
-  /* Assume in this procedure lat and lons are in degrees */
-  Hypocenter h(rad(evlat),rad(evlon),evdepth,otime,rc.ttmethod,rc.ttmodel);
-  SlownessVector u;
-  if(rc.use_S_slowness)
-    u=h.phaseslow(rad(stalat),rad(stalon),0.0,string("S"));
-  else
-    u=h.pslow(rad(stalat),rad(stalon),0.0);
-  return u;
-}
 bool SEISPP::SEISPP_verbose(false);
 int main(int argc, char **argv)
 {
@@ -173,10 +68,6 @@ int main(int argc, char **argv)
   }
   try{
       RotateControl rc(pffile);
-      SphericalCoordinate ctsc;
-      ctsc.radius=1.0;
-      ctsc.phi=rc.phi;
-      ctsc.theta=rc.theta;
       shared_ptr<StreamObjectReader<ThreeComponentEnsemble>> ia;
       if(binary_data)
       {
@@ -204,105 +95,7 @@ int main(int argc, char **argv)
       while(!ia->eof())
       {
         d=ia->read();
-        vector<ThreeComponentSeismogram>::iterator dptr;
-        double slat,slon,evlat,evlon,evdep;
-        int k;
-        if(rc.saamode)
-        {
-           evlat=d.get_double(rc.evlatkey);
-           evlon=d.get_double(rc.evlonkey);
-           evdep=d.get_double(rc.evdepthkey);
-        }
-        for(dptr=d.member.begin(),k=0;dptr!=d.member.end();++dptr,++k)
-        {
-          if(!accum_mode)
-          {
-            if(!dptr->components_are_cardinal)
-              dptr->rotate_to_standard();
-          }
-          double az,delta;
-          if(rc.constant_transformation)
-          {
-            dptr->rotate(ctsc);
-          }
-          else
-          {
-            slat=dptr->get_double(rc.stalatkey);
-            slon=dptr->get_double(rc.stalonkey);
-            if(!rc.saamode)
-            {
-              evlat=dptr->get_double(rc.evlatkey);
-              evlon=dptr->get_double(rc.evlonkey);
-              evdep=dptr->get_double(rc.evdepthkey);
-            }
-            dist(rad(slat),rad(slon),rad(evlat),rad(evlon),&delta,&az);
-            /* Azimuth, az, is backazimuth but all the rotation methods
-               in libseispp use propagation azimuth so convert to that
-               form */
-            az += M_PI;
-            if(az>(2.0*M_PI)) az -= (2.0*M_PI);
-            SlownessVector u;
-            double umag,ema,vtimesu;
-            SphericalCoordinate sc;
-            switch(rc.mode)
-            {
-              case ZRT:
-                dptr->rotate(az);
-                break;
-              case LQT:
-                u=ComputeSlownessVector(slat,slon,evlat,evlon,evdep,rc);
-                umag=u.mag();
-                if(rc.use_S_slowness)
-                {
-                  vtimesu=rc.vs0*umag;
-                  if(vtimesu>1.0)
-                  {
-                    cerr << "Warning:  LQT vs0*slowness > 1 - assuming horizontal propagation"<<endl;
-                    ema=M_PI_2;
-                  }
-                  else
-                  {
-                    ema=asin(vtimesu);
-                  }
-                }
-                else
-                {
-                  vtimesu=rc.vp0*umag;
-                  if(vtimesu>1.0)
-                  {
-                    cerr << "Warning:  LQT vp0*slowness > 1 - assuming vertical incidence"<<endl;
-                    ema=0.0;
-                  }
-                  ema=asin(rc.vp0*umag);
-                }
-                sc.radius=1.0;
-                /* Spherical coordinates are angles from x1 axis but 
-                   the slowness vector returns azimuth from north -convert*/
-                sc.phi=M_PI_2-u.azimuth();
-                sc.theta=ema;
-                dptr->rotate(sc);
-                break;
-              case FST:
-                u=ComputeSlownessVector(slat,slon,evlat,evlon,evdep,rc);
-                dptr->free_surface_transformation(u,rc.vp0,rc.vs0);
-                break;
-              default:
-                cerr << "rotate:  coding error - this should never be executed"
-                  <<endl;
-                exit(-1);
-            };
-            /* az is backazimuth but rotate needs amount y should rotate
-             * to be R = azimuth so add pi */
-            dptr->rotate(az+M_PI);
-            if(SEISPP_verbose)
-            {
-                cerr << "Ensemble index="<<nensembles<<" Member index="<<k<<endl
-                    <<"Station coordinates(degrees):  "<<slat<<" "<<slon<<endl
-                    <<"Event coordinates (degrees):  "<<evlat<<" "<<evlon<<endl
-                    <<"Rotation angle (degrees)="<<deg(az+M_PI)<<endl;
-            }
-          }
-        }
+        rc.apply(d,accum_mode,nensembles);
         oa->write(d);
         ++nensembles;
       }
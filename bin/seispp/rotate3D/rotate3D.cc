@@ -19,8 +19,8 @@ void usage()
         << "(computed from metadaa rx,ry,relev, sx,sy,and selev - local coordinates)"<<endl
         << "To set the angles that define the LRT transformation use the -phi and -theta parameters"<<endl
         << "(phi and theta are spherical coordinate angles in degrees)"<<endl
-        << "-accumulate transforms data without checking current orientation"
-        <<endl <<"(Default forces data to cardinal directions before applying transformation)"
+        << "-accumulate is accepted for compatibility and ignored"<<endl
+        << "(data are always rotated from their current orientation in one pass)"<<endl
         << " -text - switch to text input and output (default is binary)"<<endl
         << "--help will print this usage message"<<endl
         << "infile and outfile are a ThreeComponentEnsemble boost serialization files"
@@ -33,7 +33,6 @@ int main(int argc, char **argv)
     bool compute_from_coordinates(true);
     double phi(-99999.9),theta(-99999.9);
     bool binary_data(true);
-    bool accum_mode(false);
     int i;
     for(i=1;i<argc;++i)
     {
@@ -52,8 +51,9 @@ int main(int argc, char **argv)
             theta=atof(argv[i]);
             compute_from_coordinates=false;
         }
+        /* No longer has any effect.  Kept so old scripts still run */
         else if(sarg=="-accumulate")
-            accum_mode=true;
+            continue;
         else if(sarg=="-text")
             binary_data=false;
         else
@@ -95,17 +95,20 @@ int main(int argc, char **argv)
       while(!ia->eof())
       {
         d=ia->read();
+        /* Compute the direction for each member here and then rotate
+           all members in parallel.   rotate replaces any previous
+           transformation in one pass through the data so there is no
+           need to restore data to cardinal directions first.  */
+        vector<SphericalCoordinate> sc(d.member.size());
         vector<ThreeComponentSeismogram>::iterator dptr;
-        int k;
-        for(dptr=d.member.begin();dptr!=d.member.end();++dptr)
+        int k,m;
+        for(dptr=d.member.begin(),m=0;dptr!=d.member.end();++dptr,++m)
         {
-          //Drop data marked dead 
+          sc[m].radius=1.0;
+          sc[m].phi=phi;
+          sc[m].theta=theta;
+          //Dead data are skipped by rotate
           if(!dptr->live) continue;
-          if(!accum_mode)
-          {
-            if(!dptr->components_are_cardinal) 
-              dptr->rotate_to_standard();
-          }
           if(compute_from_coordinates)
           {
             double r[3],s[3],nu[3];
@@ -124,17 +127,10 @@ int main(int argc, char **argv)
             }
             offset=sqrt(offset);
             for(k=0;k<3;++k) nu[k]=nu[k]/offset;
-            dptr->rotate(nu);
-          }
-          else
-          {
-              SphericalCoordinate sc;
-              sc.radius=1.0;
-              sc.phi=phi;
-              sc.theta=theta;
-              dptr->rotate(sc);
+            sc[m]=UnitVectorToSpherical(nu);
           }
         }
+        RotateMembers(d,sc);
         oa->write(d);
       }
     }catch(boost::archive::archive_exception const& e)
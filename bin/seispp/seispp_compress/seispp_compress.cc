@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <iostream>
+#include <memory>
+#include "PMTimeSeries.h"
+#include "seispp.h"
+#include "ThreeComponentSeismogram.h"
+#include "ensemble.h"
+#include "PfStyleMetadata.h"
+#include "StreamObjectReader.h"
+#include "StreamObjectWriter.h"
+#include "BlockObjectReader.h"
+#include "BlockObjectWriter.h"
+using namespace std;
+using namespace SEISPP;
+void usage()
+{
+    cerr << "seispp_compress file [-d -t object_type -v --help -pf pffile] "
+        <<endl
+        << "Default converts a binary stream file read from stdin to a block compressed file with an embedded index"<<endl
+        << " Use -d to do the reverse - block file is read and a binary stream file is written to stdout"<<endl
+        << " Use -t to select object type expected for input. "<<endl
+        << " (Allowed options=ThreeComponentEnsemble (default),ThreeComponentSeismogram, TimeSeries, PMTimeSeries, and TimeSeriesEnsemble)"<<endl
+        << " -v - be more verbose"<<endl
+        << " --help - prints this message"<<endl
+        << " -pf use alternative pf file instead of default seispp_compress.pf"
+        <<endl;
+    exit(-1);
+}
+enum AllowedObjects {TCS, TCE,  TS, TSE, PMTS};
+AllowedObjects get_object_type(string otype)
+{
+    if(otype=="ThreeComponentSeismogram")
+        return TCS;
+    else if(otype=="ThreeComponentEnsemble")
+        return TCE;
+    else if(otype=="TimeSeries")
+        return TS;
+    else if(otype=="TimeSeriesEnsemble")
+        return TSE;
+    else if(otype=="PMTimeSeries")
+        return PMTS;
+    else
+    {
+        cerr << "Do not know how to handle object type="<<otype
+            <<endl<< "Cannot continue"<<endl;
+        exit(-1);
+    }
+}
+template <typename DataType> int compress(string outfile,
+        MetadataList& mdl,long blocksize,bool precondition)
+{
+    try{
+        StreamObjectReader<DataType> inp('b');
+        BlockObjectWriter<DataType> out(outfile,mdl,blocksize,precondition);
+        DataType d;
+        int count(0);
+        while(inp.good())
+        {
+            d=inp.read();
+            out.write(d);
+            ++count;
+        }
+        out.close();
+        return count;
+    }catch(...){throw;};
+}
+template <typename DataType> int expand(string infile)
+{
+    try{
+        BlockObjectReader<DataType> inp(infile);
+        StreamObjectWriter<DataType> out('b');
+        DataType d;
+        int count(0);
+        while(inp.good())
+        {
+            d=inp.read();
+            out.write(d);
+            ++count;
+        }
+        return count;
+    }catch(...){throw;};
+}
+template <typename DataType> int run(string fname,bool decompress,
+        MetadataList& mdl,long blocksize,bool precondition)
+{
+    if(decompress)
+        return expand<DataType>(fname);
+    else
+        return compress<DataType>(fname,mdl,blocksize,precondition);
+}
+
+bool SEISPP::SEISPP_verbose(false);
+int main(int argc, char **argv)
+{
+    int i;
+    if(argc>1)
+      if(string(argv[1])=="--help") usage();
+    if(argc<2) usage();
+    string otype("ThreeComponentEnsemble");
+    string fname(argv[1]);
+    string pffile("seispp_compress");
+    bool decompress(false);
+    for(i=2;i<argc;++i)
+    {
+        string sarg(argv[i]);
+        if(sarg=="--help")
+        {
+            usage();
+        }
+        else if(sarg=="-v")
+          SEISPP_verbose=true;
+        else if(sarg=="-d")
+          decompress=true;
+        else if(sarg=="-t")
+        {
+            ++i;
+            if(i>=argc)usage();
+            otype=string(argv[i]);
+        }
+        else if(sarg=="-pf")
+        {
+            ++i;
+            if(i>=argc)usage();
+            pffile=string(argv[i]);
+        }
+        else
+            usage();
+    }
+    try{
+        PfStyleMetadata control(pffile);
+        MetadataList mdl=get_mdlist(control,"IndexMetadata");
+        long blocksize=control.get_long("block_size");
+        bool precondition=control.get_bool("precondition");
+        AllowedObjects dtype=get_object_type(otype);
+        int count;
+        switch (dtype)
+        {
+            case TCS:
+                count=run<ThreeComponentSeismogram>(fname,decompress,mdl,
+                        blocksize,precondition);
+                break;
+            case TCE:
+                count=run<ThreeComponentEnsemble>(fname,decompress,mdl,
+                        blocksize,precondition);
+                break;
+            case TS:
+                count=run<TimeSeries>(fname,decompress,mdl,
+                        blocksize,precondition);
+                break;
+            case TSE:
+                count=run<TimeSeriesEnsemble>(fname,decompress,mdl,
+                        blocksize,precondition);
+                break;
+            case PMTS:
+                count=run<PMTimeSeries>(fname,decompress,mdl,
+                        blocksize,precondition);
+                break;
+            default:
+                cerr << "Coding problem - dtype variable does not match enum"
+                    <<endl
+                    << "Fatal error - bug fix required. "<<endl;
+                exit(-1);
+        };
+        if(SEISPP_verbose)
+          cerr << "seispp_compress:  copied "<<count<<" objects"<<endl;
+    }catch(SeisppError& serr)
+    {
+        serr.log_error();
+    }
+    catch(std::exception& stexc)
+    {
+        cerr << stexc.what()<<endl;
+    }
+}
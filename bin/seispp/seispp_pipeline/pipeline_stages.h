@@ -0,0 +1,446 @@
+#ifndef _PIPELINE_STAGES_H_
+#define _PIPELINE_STAGES_H_
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include "seispp.h"
+#include "ensemble.h"
+#include "filter++.h"
+#include "mute.h"
+#include "RotateControl.h"
+#include "StreamObjectWriter.h"
+#include "FusedPipeline.h"
+using namespace std;
+using namespace SEISPP;
+/* This file defines the PipelineStage objects that implement
+ * the seispp unix filters supported by seispp_pipeline.   Each stage
+ * is constructed from the same command line the standalone program
+ * would be run with and produces the same output.   All the stages are
+ * templates on the object type passed down the pipeline.  Stages that
+ * only make sense for a particular type are built from overloaded
+ * helper functions that throw an error for other types. */
+
+/* Split a command line into white space separated words.   argv[0]
+ * is reduced to the base name so full path names are allowed. */
+inline vector<string> split_command_line(const string line)
+{
+  istringstream iss(line);
+  vector<string> argv;
+  string word;
+  while(iss>>word) argv.push_back(word);
+  if(argv.size()>0)
+  {
+    size_t slash=argv[0].rfind('/');
+    if(slash!=string::npos) argv[0]=argv[0].substr(slash+1);
+  }
+  return argv;
+}
+/* Used for any argument a program does not understand.  -text is
+ * accepted and ignored because stages never see serialized data. */
+inline void stage_usage_error(const vector<string>& argv, const string arg)
+{
+  throw SeisppError(string("seispp_pipeline:  illegal argument=")
+      + arg + " in command line for program "+argv[0]);
+}
+
+/* Type dependent helpers.   The template versions are called for
+ * unsupported types and always throw */
+template <class T> void agc_ensemble(T& d, double twin,
+    TimeSeriesEnsemble& gains)
+{
+  throw SeisppError(string("seispp_pipeline agc:  ")
+      + "only ThreeComponentEnsemble data are supported");
+}
+inline void agc_ensemble(ThreeComponentEnsemble& d, double twin,
+    TimeSeriesEnsemble& gains)
+{
+  int i;
+  for(i=0;i<d.member.size();++i)
+    gains.member.push_back(ApplyAGC(d.member[i],twin));
+}
+template <class T> void filter_data(T& d, TimeInvariantFilter& filt)
+{
+  throw SeisppError(string("seispp_pipeline filter3c:  ")
+      + "only ThreeComponentEnsemble or TimeSeriesEnsemble data are supported");
+}
+inline void filter_data(ThreeComponentEnsemble& d, TimeInvariantFilter& filt)
+{
+  FilterEnsemble(d,filt);
+}
+inline void filter_data(TimeSeriesEnsemble& d, TimeInvariantFilter& filt)
+{
+  FilterEnsemble(d,filt);
+}
+template <class T> void rotate_data(T& d, RotateControl& rc,
+    bool accum_mode, int count)
+{
+  throw SeisppError(string("seispp_pipeline rotate:  ")
+      + "only ThreeComponentEnsemble data are supported");
+}
+inline void rotate_data(ThreeComponentEnsemble& d, RotateControl& rc,
+    bool accum_mode, int count)
+{
+  rc.apply(d,accum_mode,count);
+}
+template <class T> void tailmute_data(T& d, TailMute& mute, int count)
+{
+  throw SeisppError(string("seispp_pipeline tailmute:  ")
+      + "only ThreeComponentEnsemble data are supported");
+}
+inline void tailmute_data(ThreeComponentEnsemble& d, TailMute& mute, int count)
+{
+  int i,nchanged;
+  for(i=0;i<d.member.size();++i)
+  {
+    nchanged=mute.apply(d.member[i]);
+    if(SEISPP_verbose) cerr << "TailMute:  ensemble "<<count
+      <<" member="<<i
+      <<" mute altered "<<nchanged<<" vector samples"<<endl;
+  }
+}
+/* Same algorithm as window_streamfile */
+template <class T> void window_object(T& d, TimeWindow& cutwin, int count)
+{
+  if(d.live)
+  {
+    if(d.tref==relative)
+      d=SEISPP::WindowData(d,cutwin);
+    else
+      cerr << "Warning:  file object number "<<count
+        << " is using absolute time - copied without change"<<endl;
+  }
+}
+template <class T> void window_members(T& d, TimeWindow& cutwin, int count)
+{
+  int i;
+  for(i=0;i<d.member.size();++i)
+  {
+    if(d.member[i].live)
+    {
+      if(d.member[i].tref==relative)
+        d.member[i]=WindowData(d.member[i],cutwin);
+      else
+        cerr << "Warning:  member number "<<i<<" of file of ensembles with object number "<<count
+          << " is using absolute time - copied without change"<<endl;
+    }
+  }
+}
+inline void window_data(TimeSeries& d, TimeWindow& cutwin, int count)
+{
+  window_object(d,cutwin,count);
+}
+inline void window_data(ThreeComponentSeismogram& d, TimeWindow& cutwin, int count)
+{
+  window_object(d,cutwin,count);
+}
+inline void window_data(TimeSeriesEnsemble& d, TimeWindow& cutwin, int count)
+{
+  window_members(d,cutwin,count);
+}
+inline void window_data(ThreeComponentEnsemble& d, TimeWindow& cutwin, int count)
+{
+  window_members(d,cutwin,count);
+}
+
+/* agc windlength [-g gainfile] */
+template <class T> class AGCStage : public PipelineStage<T>
+{
+  public:
+    AGCStage(vector<string>& argv)
+    {
+      if(argv.size()<2) stage_usage_error(argv,"(missing window length)");
+      twin=atof(argv[1].c_str());
+      save_gain_function=false;
+      int i;
+      for(i=2;i<argv.size();++i)
+      {
+        if(argv[i]=="-g")
+        {
+          ++i;
+          if(i>=argv.size()) stage_usage_error(argv,"-g");
+          gainfile=argv[i];
+          save_gain_function=true;
+        }
+        else if(argv[i]!="-text")
+          stage_usage_error(argv,argv[i]);
+      }
+    };
+    string name(){return string("agc");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      TimeSeriesEnsemble gains(dynamic_cast<Metadata&>(d),0);
+      agc_ensemble(d,twin,gains);
+      if(save_gain_function) allgains.push_back(gains);
+      out.push(d);
+    };
+    void finish(FusedPipelineQueue<T>& out)
+    {
+      if(save_gain_function)
+      {
+        try{
+          /* These are always written as a text file as in agc */
+          StreamObjectWriter<TimeSeriesEnsemble> ofs(gainfile);
+          int i;
+          for(i=0;i<allgains.size();++i) ofs.write(allgains[i]);
+        }catch(SeisppError& serr)
+        {
+          cerr << "Writer for gain function to file="<<gainfile
+            << " failed."<<endl<<"SeisppError message posted follow:"
+            <<endl;
+          serr.log_error();
+        }
+      }
+    };
+  private:
+    double twin;
+    bool save_gain_function;
+    string gainfile;
+    vector<TimeSeriesEnsemble> allgains;
+};
+/* filter3c filter_specification */
+template <class T> class FilterStage : public PipelineStage<T>
+{
+  public:
+    FilterStage(vector<string>& argv)
+    {
+      /* Filter specifications normally contain spaces so all words
+         up to the first option are part of the specification */
+      if(argv.size()<2) stage_usage_error(argv,"(missing filter specification)");
+      int i;
+      for(i=1;i<argv.size();++i)
+      {
+        if(argv[i]=="-text") continue;
+        if(argv[i]=="-v")
+        {
+          SEISPP_verbose=true;
+          continue;
+        }
+        if(filter_spec.length()>0) filter_spec+=" ";
+        filter_spec+=argv[i];
+      }
+      filt=TimeInvariantFilter(filter_spec);
+      if(SEISPP_verbose) cerr<<"filter program: filtering data with "
+        << filter_spec<<endl;
+    };
+    string name(){return string("filter3c");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      filter_data(d,filt);
+      out.push(d);
+    };
+  private:
+    string filter_spec;
+    TimeInvariantFilter filt;
+};
+/* rotate [-accumulate -pf pffile] */
+template <class T> class RotateStage : public PipelineStage<T>
+{
+  public:
+    RotateStage(vector<string>& argv)
+    {
+      string pffile("rotate");
+      accum_mode=false;
+      int i;
+      for(i=1;i<argv.size();++i)
+      {
+        if(argv[i]=="-pf")
+        {
+          ++i;
+          if(i>=argv.size()) stage_usage_error(argv,"-pf");
+          pffile=argv[i];
+        }
+        else if(argv[i]=="-accumulate")
+          accum_mode=true;
+        else if(argv[i]=="-v")
+          SEISPP_verbose=true;
+        else if(argv[i]!="-text")
+          stage_usage_error(argv,argv[i]);
+      }
+      rc=shared_ptr<RotateControl>(new RotateControl(pffile));
+      count=0;
+    };
+    string name(){return string("rotate");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      rotate_data(d,*rc,accum_mode,count);
+      ++count;
+      out.push(d);
+    };
+  private:
+    shared_ptr<RotateControl> rc;
+    bool accum_mode;
+    int count;
+};
+/* tailmute [-pf pffile] */
+template <class T> class TailMuteStage : public PipelineStage<T>
+{
+  public:
+    TailMuteStage(vector<string>& argv)
+    {
+      string pffile("tailmute.pf");
+      int i;
+      for(i=1;i<argv.size();++i)
+      {
+        if(argv[i]=="-pf")
+        {
+          ++i;
+          if(i>=argv.size()) stage_usage_error(argv,"-pf");
+          pffile=argv[i];
+        }
+        else if(argv[i]=="-v")
+          SEISPP_verbose=true;
+        else if(argv[i]!="-text")
+          stage_usage_error(argv,argv[i]);
+      }
+      PfStyleMetadata control(pffile);
+      mute=shared_ptr<TailMute>(new TailMute(control));
+      count=0;
+    };
+    string name(){return string("tailmute");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      tailmute_data(d,*mute,count);
+      ++count;
+      out.push(d);
+    };
+  private:
+    shared_ptr<TailMute> mute;
+    int count;
+};
+/* window_streamfile tmin tmax [-t objt].   The object type is set
+ * for the whole pipeline so -t is only checked for consistency. */
+template <class T> class WindowStage : public PipelineStage<T>
+{
+  public:
+    WindowStage(vector<string>& argv, const string otype)
+    {
+      if(argv.size()<3) stage_usage_error(argv,"(missing time window)");
+      cutwin=TimeWindow(atof(argv[1].c_str()),atof(argv[2].c_str()));
+      int i;
+      for(i=3;i<argv.size();++i)
+      {
+        if(argv[i]=="-t")
+        {
+          ++i;
+          if(i>=argv.size()) stage_usage_error(argv,"-t");
+          if(argv[i]!=otype)
+            throw SeisppError(string("seispp_pipeline window_streamfile:  ")
+                + "object type "+argv[i]
+                + " does not match pipeline object type "+otype);
+        }
+        else if(argv[i]=="-v")
+          SEISPP_verbose=true;
+        else if(argv[i]!="-text")
+          stage_usage_error(argv,argv[i]);
+      }
+      count=0;
+    };
+    string name(){return string("window_streamfile");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      window_data(d,cutwin,count);
+      ++count;
+      out.push(d);
+    };
+  private:
+    TimeWindow cutwin;
+    int count;
+};
+/* sort1 key [-i||-r].  Like sort1 this is a pure memory sort.
+ * Objects with equal keys retain their input order. */
+enum SortKeyTypes{SortReal,SortInt,SortString};
+template <class T> class SortStage : public PipelineStage<T>
+{
+  public:
+    SortStage(vector<string>& argv)
+    {
+      if(argv.size()<2) stage_usage_error(argv,"(missing sort key)");
+      key=argv[1];
+      ktype=SortString;
+      int i;
+      for(i=2;i<argv.size();++i)
+      {
+        if(argv[i]=="-i")
+          ktype=SortInt;
+        else if(argv[i]=="-r")
+          ktype=SortReal;
+        else if(argv[i]!="-text")
+          stage_usage_error(argv,argv[i]);
+      }
+    };
+    string name(){return string("sort1");};
+    void process(T& d, FusedPipelineQueue<T>& out)
+    {
+      data.push_back(std::move(d));
+    };
+    void finish(FusedPipelineQueue<T>& out)
+    {
+      switch(ktype)
+      {
+        case SortInt:
+          sorted_push<int>(out);
+          break;
+        case SortReal:
+          sorted_push<double>(out);
+          break;
+        case SortString:
+        default:
+          sorted_push<string>(out);
+      };
+      data.clear();
+    };
+  private:
+    string key;
+    SortKeyTypes ktype;
+    vector<T> data;
+    template <class K> void sorted_push(FusedPipelineQueue<T>& out)
+    {
+      multimap<K,int> xref;
+      int i;
+      for(i=0;i<data.size();++i)
+      {
+        try{
+          K val=data[i].template get<K>(key);
+          xref.insert(pair<K,int>(val,i));
+        }catch(SeisppError& serr)
+        {
+          stringstream ss;
+          ss << "seispp_pipeline sort1:  Missing required key for sorting with tag="
+            <<key<<endl
+            << "Error encountered on the "<<i<<"th object of input"<<endl
+            << "Message posted:  "<<serr.what()<<endl;
+          throw SeisppError(ss.str());
+        }
+      }
+      typename multimap<K,int>::iterator mptr;
+      for(mptr=xref.begin();mptr!=xref.end();++mptr)
+        if(!out.push(data[mptr->second])) break;
+    };
+};
+/* Stage factory.   Returns a newly allocated stage built from one
+ * line of the pipeline_commands Tbl.   Throws a SeisppError if
+ * the program is not one seispp_pipeline knows how to run. */
+template <class T> PipelineStage<T> *build_stage(const string line,
+    const string otype)
+{
+  vector<string> argv=split_command_line(line);
+  if(argv.size()==0)
+    throw SeisppError("seispp_pipeline:  empty line in pipeline_commands");
+  if(argv[0]=="agc")
+    return new AGCStage<T>(argv);
+  else if(argv[0]=="filter3c")
+    return new FilterStage<T>(argv);
+  else if(argv[0]=="rotate")
+    return new RotateStage<T>(argv);
+  else if(argv[0]=="tailmute")
+    return new TailMuteStage<T>(argv);
+  else if(argv[0]=="window_streamfile")
+    return new WindowStage<T>(argv,otype);
+  else if(argv[0]=="sort1")
+    return new SortStage<T>(argv);
+  else
+    throw SeisppError(string("seispp_pipeline:  program ")+argv[0]
+        + " cannot be run in a fused pipeline");
+}
+#endif
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <iostream>
+#include <memory>
+#include "seispp.h"
+#include "ensemble.h"
+#include "PfStyleMetadata.h"
+#include "StreamObjectReader.h"
+#include "StreamObjectWriter.h"
+#include "FusedPipeline.h"
+#include "pipeline_stages.h"
+using namespace std;
+using namespace SEISPP;
+void usage()
+{
+    cerr << "seispp_pipeline [-pf pffile -t objt -v --help -text] < in > out"
+        <<endl
+        << "Runs a chain of seispp filters in one process"<<endl
+        << "The chain is defined by the pipeline_commands Tbl in pffile."<<endl
+        << "Each line is the command line that would be used to run that"<<endl
+        << "program in a unix pipeline.  Supported programs are:"<<endl
+        << "  agc, filter3c, rotate, tailmute, window_streamfile, and sort1"<<endl
+        << " -pf - use pffile instead of default seispp_pipeline.pf"<<endl
+        << " Use -t to select object type expected for input. "<<endl
+        << " (Allowed options=ThreeComponentEnsemble (default),ThreeComponentSeismogram, TimeSeries, and TimeSeriesEnsemble)"<<endl
+        << " -v - be more verbose (prints a timing summary for each stage)"<<endl
+        << " --help - prints this message"<<endl
+        << " -text - switch to text input and output (default is binary)"<<endl;
+    exit(-1);
+}
+enum AllowedObjects {TCS, TCE,  TS, TSE};
+AllowedObjects get_object_type(string otype)
+{
+    if(otype=="ThreeComponentSeismogram")
+        return TCS;
+    else if(otype=="ThreeComponentEnsemble")
+        return TCE;
+    else if(otype=="TimeSeries")
+        return TS;
+    else if(otype=="TimeSeriesEnsemble")
+        return TSE;
+    else
+    {
+        cerr << "Do not know how to handle object type="<<otype
+            <<endl<< "Cannot continue"<<endl;
+        exit(-1);
+    }
+}
+template <class T> long run_pipeline(PfStyleMetadata& control,
+        const string otype, bool binary_data)
+{
+    list<string> commands=control.get_tbl("pipeline_commands");
+    int queue_size=control.get<int>("queue_size");
+    FusedPipeline<T> pipeline(queue_size);
+    list<string>::iterator cptr;
+    for(cptr=commands.begin();cptr!=commands.end();++cptr)
+    {
+        pipeline.add(build_stage<T>(*cptr,otype));
+        if(SEISPP_verbose) cerr << "seispp_pipeline:  stage "
+            << pipeline.number_stages()<<" = "<<*cptr<<endl;
+    }
+    char form('t');
+    if(binary_data) form='b';
+    StreamObjectReader<T> inp(form);
+    StreamObjectWriter<T> outp(form);
+    long count=pipeline.run(inp,outp);
+    if(SEISPP_verbose) pipeline.report(cerr);
+    return count;
+}
+bool SEISPP::SEISPP_verbose(false);
+int main(int argc, char **argv)
+{
+    int i;
+    string pffile("seispp_pipeline");
+    string otype("ThreeComponentEnsemble");
+    bool binary_data(true);
+    for(i=1;i<argc;++i)
+    {
+        string sarg(argv[i]);
+        if(sarg=="--help")
+        {
+            usage();
+        }
+        else if(sarg=="-pf")
+        {
+          ++i;
+          if(i>=argc) usage();
+          pffile=string(argv[i]);
+        }
+        else if(sarg=="-t")
+        {
+          ++i;
+          if(i>=argc) usage();
+          otype=string(argv[i]);
+        }
+        else if(sarg=="-text")
+        {
+            binary_data=false;
+        }
+        else if(sarg=="-v")
+          SEISPP_verbose=true;
+        else
+            usage();
+    }
+    try{
+        PfStyleMetadata control(pffile);
+        AllowedObjects dtype=get_object_type(otype);
+        long count;
+        switch (dtype)
+        {
+            case TCS:
+                count=run_pipeline<ThreeComponentSeismogram>(control,otype,
+                        binary_data);
+                break;
+            case TCE:
+                count=run_pipeline<ThreeComponentEnsemble>(control,otype,
+                        binary_data);
+                break;
+            case TS:
+                count=run_pipeline<TimeSeries>(control,otype,binary_data);
+                break;
+            case TSE:
+                count=run_pipeline<TimeSeriesEnsemble>(control,otype,
+                        binary_data);
+                break;
+            default:
+                cerr << "Coding problem - dtype variable does not match enum"
+                    <<endl
+                    << "Fatal error - bug fix required. "<<endl;
+                exit(-1);
+        };
+        if(SEISPP_verbose) cerr << "seispp_pipeline:  wrote "<<count
+            <<" objects to stdout"<<endl;
+    }catch(SeisppError& serr)
+    {
+        serr.log_error();
+        exit(-1);
+    }
+    catch(std::exception& stexc)
+    {
+        cerr << stexc.what()<<endl;
+        exit(-1);
+    }
+}
@@ -9,84 +9,16 @@
 #include "ensemble.h"
 #include "StreamObjectReader.h"
 #include "StreamObjectWriter.h"
+#include "MetadataPredicate.h"
+#include "SelectiveObjectReader.h"
 using namespace std;
 using namespace SEISPP;
 enum ObjectsSupported {TCS, TCE, TS, TSE, PMTS};
-/* This is a generic range tester that will work on any type for
-which <= and >= are defined.  */
-template <typename T> class range_tester
-{
-public:
-  /* Set minonly true to do only greater than test.  Set maxonly
-  true for only less than test */
-  range_tester(T minv, T maxv, bool minonly, bool maxonly);
-  bool inside(T testval);
-private:
-  T minval;
-  T maxval;
-  bool use_min;
-  bool use_max;
-};
-template <typename T>
-   range_tester<T>::range_tester(T minv, T maxv, bool minonly, bool maxonly)
-{
-  minval=minv;
-  maxval=maxv;
-  use_min=true;
-  use_max=true;
-  if(minonly&&minonly)
-  {
-    throw SeisppError(string("range_tester constructor:  ")
-         + "Coding error - cannot turn both start and end of range to test off");
-  }
-  else
-  {
-    if(minonly)
-    {
-      use_max=false;
-    }
-    if(maxonly)
-    {
-      use_max=true;
-    }
-  }
-}
-template <typename T> bool range_tester<T>::inside(T testval)
-{
-  if(use_min)
-  {
-    if(testval<minval)return false;
-  }
-  if(use_max)
-  {
-    if(testval>maxval) return false;
-  }
-  return true;
-}
-/* Generic test for equal condition to a common value set by the
-constructor.   Simplifies tests for equality with variable types */
-template <typename T>
-class equal_tester
-{
-public:
-  equal_tester(T val_to_set)
-  {
-    val_to_test=val_to_set;
-  };
-  bool is_equal(T testval)
-  {
-    if(testval==val_to_test)
-      return true;
-    else
-      return false;
-  };
-private:
-  T val_to_test;
-};
 void usage()
 {
-    cerr << "subset_streamfile key:type ( -eq val | -ne val | -range minval maxval | -min minval -max maxval ) [-t object_type --help -text]"<<endl
-        <<endl
+    cerr << "subset_streamfile key:type test [(-and|-or) key:type test ...] [-if infile -noindex -t object_type --help -text]"<<endl
+        << " where test is one of:  -eq val | -ne val | -range minval maxval | -min minval [-max maxval] | -max maxval"
+        <<endl<<endl
         << " seispp unix filter to subset a data set read from stdin and write result to out"
         <<endl
         << "key is the Metadata key used to defined subset condition.  "
@@ -105,6 +37,12 @@ void usage()
         << " Use -range to select data with key value between (inclusive) minval and maxval"<<endl
         << " Use -min or -max to specify one sided range tests"
         <<endl
+        << " -and and -or add another key test combined with the result of"<<endl
+        << "   all tests to its left (e.g. a -or b -and c is (a or b) and c)"<<endl
+        << " -if - read infile instead of stdin.  If infile has an index"<<endl
+        << "   (see build_index) containing all keys tested only"<<endl
+        << "   matching objects are read"<<endl
+        << " -noindex - with -if do not use an index even if one exists"<<endl
         << " --help - prints this message"<<endl
         << " -text - switch to text input and output (default is binary)"<<endl;
     exit(-1);
@@ -139,179 +77,131 @@ std::pair<string,MDtype> split_arg1(const char *arg)
   return result;
 }
 
-/* This does all the work of this procedure.  It is a double parameter
-template to support multiple object types and generic types for key.
-This procedure is used for a range test.   Nearly identical procedure below
-for equal test.  There might be a fancieer way to do this with predicates, but
-I still find that C++ construct produces very confusing code. Return
-number written to output.*/
-template <typename Tdata, typename Tkey>
-   int filter_by_range(string key,range_tester<Tkey> rt,bool binary_data)
+/* Parses one key test starting at argv[i], which must be the key:type
+argument.  i is left at the last argument used.  */
+shared_ptr<MetadataPredicate> parse_test(int& i, int argc, char **argv)
 {
-  StreamObjectReader<Tdata> *inp=NULL;
-  StreamObjectWriter<Tdata> *outp=NULL;
-  try{
-    int nout(0);
-    /* These are construtors for input from stdin and output to stdout */
-    if(binary_data)
+  std::pair<string,MDtype> arg1=split_arg1(argv[i]);
+  string key=arg1.first;
+  MDtype keytype=arg1.second;
+  string minval,maxval;
+  bool use_min(false),use_max(false);
+  shared_ptr<MetadataPredicate> result;
+  ++i;
+  if(i>=argc) usage();
+  string sarg(argv[i]);
+  if( (sarg=="-eq") || (sarg=="-ne") )
+  {
+    ++i;
+    if(i>=argc) usage();
+    if(sarg=="-eq")
+      result=shared_ptr<MetadataPredicate>(new MetadataKeyTest(key,
+            keytype,MDTeq,string(argv[i])));
+    else
+      result=shared_ptr<MetadataPredicate>(new MetadataKeyTest(key,
+            keytype,MDTne,string(argv[i])));
+    return result;
+  }
+  else if(sarg=="-range")
+  {
+    i+=2;
+    if(i>=argc) usage();
+    minval=string(argv[i-1]);
+    maxval=string(argv[i]);
+    use_min=true;
+    use_max=true;
+  }
+  else if(sarg=="-min")
+  {
+    ++i;
+    if(i>=argc) usage();
+    minval=string(argv[i]);
+    use_min=true;
+    /* -min val -max val is the same as -range */
+    if( ((i+1)<argc) && (string(argv[i+1])=="-max") )
     {
-      inp=new StreamObjectReader<Tdata>('b');
-      outp=new StreamObjectWriter<Tdata>('b');
+      i+=2;
+      if(i>=argc) usage();
+      maxval=string(argv[i]);
+      use_max=true;
     }
-    else
+  }
+  else if(sarg=="-max")
+  {
+    ++i;
+    if(i>=argc) usage();
+    maxval=string(argv[i]);
+    use_max=true;
+  }
+  else
+  {
+    cerr << "subset_streamfile:  no subset test defined for key "<<key<<endl;
+    usage();
+  }
+  if(use_min && use_max)
+  {
+    bool bad_interval;
+    switch(keytype)
     {
-      inp=new StreamObjectReader<Tdata>('t');
-      outp=new StreamObjectWriter<Tdata>('t');
+      case MDint:
+        bad_interval=(atol(minval.c_str())>=atol(maxval.c_str()));
+        break;
+      case MDreal:
+        bad_interval=(atof(minval.c_str())>=atof(maxval.c_str()));
+        break;
+      case MDstring:
+      default:
+        bad_interval=(minval>=maxval);
     }
-    while(inp->good())
+    if(bad_interval)
     {
-      Tdata d=inp->read();
-      Tkey mdtest;
-      Metadata *md=dynamic_cast<Metadata *>(&d);
-      mdtest=md->get<Tkey>(key);
-      if(rt.inside(mdtest))
-      {
-        outp->write(d);
-        ++nout;
-      }
+      cerr << "Interval mismatch for key "<<key<<":  min="<<minval
+        << " max="<<maxval<<endl;
+      usage();
     }
-    delete inp;
-    delete outp;
-    return nout;
-  }catch(...)
-  {
-    if(inp!=NULL) delete inp;
-    if(outp!=NULL) delete outp;
-    throw;
+    result=shared_ptr<MetadataPredicate>(new MetadataKeyTest(key,
+          keytype,MDTrange,minval,maxval));
   }
+  else if(use_min)
+    result=shared_ptr<MetadataPredicate>(new MetadataKeyTest(key,
+          keytype,MDTmin,minval));
+  else
+    result=shared_ptr<MetadataPredicate>(new MetadataKeyTest(key,
+          keytype,MDTmax,maxval));
+  return result;
 }
-template <typename Tdata, typename Tkey>
-   int filter_by_match(string key,equal_tester<Tkey> eqt,
-       bool negate,bool binary_data)
+/* Copies objects passing test to stdout.   Objects are read with
+SelectiveObjectReader so the test is made on each object's header before
+its samples are loaded.  Returns number written to output.*/
+template <typename Tdata> int subset_processor(
+    shared_ptr<MetadataPredicate> test, string infile, bool use_index,
+    bool binary_data)
 {
-  StreamObjectReader<Tdata> *inp=NULL;
-  StreamObjectWriter<Tdata> *outp=NULL;
   try{
     int nout(0);
-    /* This procedure only supports input from stdin and output to stdout*/
-    if(binary_data)
-    {
-      inp=new StreamObjectReader<Tdata>('b');
-      outp=new StreamObjectWriter<Tdata>('b');
-    }
+    char form('t');
+    if(binary_data) form='b';
+    shared_ptr<SelectiveObjectReader<Tdata> > inp;
+    if(infile.length()>0)
+      inp=shared_ptr<SelectiveObjectReader<Tdata> >(
+          new SelectiveObjectReader<Tdata>(infile,test,form,use_index));
     else
+      inp=shared_ptr<SelectiveObjectReader<Tdata> >(
+          new SelectiveObjectReader<Tdata>(test,form));
+    StreamObjectWriter<Tdata> outp(form);
+    Tdata d;
+    while(inp->next(d))
     {
-      inp=new StreamObjectReader<Tdata>('t');
-      outp=new StreamObjectWriter<Tdata>('t');
+      outp.write(d);
+      ++nout;
     }
-    while(inp->good())
+    if(SEISPP_verbose)
     {
-      Tdata d=inp->read();
-      Tkey mdtest;
-      Metadata *md=dynamic_cast<Metadata*>(&d);
-      mdtest=md->get<Tkey>(key);
-      bool testval=eqt.is_equal(mdtest);
-      bool writeme(false);
-      /* There is no doubt a single line way to do this, but hopefull
-         this is clearer for minimal loss in efficiency*/
-      if(negate)
-      {
-        if(!testval)writeme=true;
-      }
-      else if(testval)
-        writeme=true;
-      if(writeme)
-      {
-        outp->write(d);
-        ++nout;
-      }
+      cerr << "subset_streamfile:  tested "<<inp->number_scanned()
+        << " objects";
+      if(inp->using_index()) cerr << " using index for "<<infile;
+      cerr <<endl;
     }
-    if(inp!=NULL) delete inp;
-    if(outp!=NULL) delete outp;
-    return nout;
-  }catch(...)
-  {
-    if(inp!=NULL) delete inp;
-    if(outp!=NULL) delete outp;
-    throw;
-  }
-}
-/* A bit of an ugly generic function that is a top level template to do the full task of this
-   program.   It was created because the original implementation had this block in a chain of
-   switch-case blocks and was even uglier.   The procedure is a front end with variable
-   object data types (Tdata parameter) for the templates filter_by_range and filter_by_match.
-
-   The ugliest part of this procedure is the (evil by purest views) of opaque pointers to pass
-   the range and qual test variables.  This was done to reduce the absurdly long arg list
-   that would have been required otherwise.
-
-Arguments:
-   keytype - main switch for Metadata key type
-   valeq - pointer to equal test value (ignore if equal_tester is false).
-   valmin to valmax  - specify range values for ge and le tests (respectively) passed
-     to range_tester generic function (ignored if equal_test is true).
-     */
-template <typename Tdata> int subset_processor(string key, MDtype keytype,
-      void *valeq, void *valmin, void *valmax, bool equal_test, bool negate,
-      bool minonly, bool maxonly, bool binary_data)
-{
-  int nout;
-  try{
-    switch(keytype)
-    {
-      case MDint:
-        if(equal_test)
-        {
-          int *ieq=static_cast<int*>(valeq);
-          equal_tester<int> eqt(*ieq);
-          nout=filter_by_match<Tdata,int>(key,eqt,negate,binary_data);
-        }
-        else
-        {
-          int *imin,*imax;
-          imin=static_cast<int*>(valmin);
-          imax=static_cast<int*>(valmax);
-          range_tester<int> rt(*imin,*imax,minonly,maxonly);
-          nout=filter_by_range<Tdata,int>(key,rt,binary_data);
-        }
-        break;
-      case MDreal:
-        if(equal_test)
-        {
-          double *req=static_cast<double*>(valeq);
-          equal_tester<double> eqt(*req);
-          nout=filter_by_match<Tdata,double>(key,eqt,negate,binary_data);
-        }
-        else
-        {
-          double *rmin,*rmax;
-          rmin=static_cast<double*>(valmin);
-          rmax=static_cast<double*>(valmax);
-          range_tester<double> rt(*rmin,*rmax,minonly,maxonly);
-          nout=filter_by_range<Tdata,double>(key,rt,binary_data);
-        }
-        break;
-      case MDstring:
-        if(equal_test)
-        {
-          string *seq=static_cast<string*>(valeq);
-          equal_tester<string> eqt(*seq);
-          nout=filter_by_match<Tdata,string>(key,eqt,negate,binary_data);
-        }
-        else
-        {
-          string *smin,*smax;
-          smin=static_cast<string*>(valmin);
-          smax=static_cast<string*>(valmax);
-          range_tester<string> rt(*smin,*smax,minonly,maxonly);
-          nout=filter_by_range<Tdata,string>(key,rt,binary_data);
-        }
-        break;
-      default:
-        cerr<<"subset_streamfile:   coding problem.  Main processing routine passed invalid MDtype"
-          <<endl;
-        exit(-1);
-    };
     return nout;
   }catch(...){throw;};
 }
@@ -320,128 +210,24 @@ bool SEISPP::SEISPP_verbose(true);
 int main(int argc, char **argv)
 {
     int i;
-    const int narg_required(1);
     if(argc<2) usage();
     if(string(argv[1])=="--help") usage();
     bool binary_data(true);
-    bool equal_test(false);
-    bool negate(false);
-    bool minonly(false);
-    bool maxonly(false);
-    bool test_range(false);
-    std::pair<string,MDtype> arg1=split_arg1(argv[1]);
-    string key=arg1.first;
-    MDtype keytype=arg1.second;
-    double req,rmin,rmax;
-    int ieq,imin,imax;
-    string seq,smin,smax;
-    // Ugly opaque pointers used to reduce arg list complexity
-    void *veq,*vmin,*vmax;
+    bool use_index(true);
+    string infile("");
     ObjectsSupported object_type(TCS);
-
-    for(i=narg_required+1;i<argc;++i)
+    i=1;
+    shared_ptr<MetadataPredicate> test=parse_test(i,argc,argv);
+    for(++i;i<argc;++i)
     {
         string sarg(argv[i]);
-        if( (sarg=="-eq") || (sarg=="-ne") )
-        {
-          /* handle the equal and not equal match
-             with the same variables, but use the booleans to
-             distinguish which to use */
-          ++i;
-          if(i>=argc) usage();
-          switch(keytype)
-          {
-            case MDint:
-              ieq=atoi(argv[i]);
-              veq=static_cast<void *>(&ieq);
-              break;
-            case MDreal:
-              req=atof(argv[i]);
-              veq=static_cast<void *>(&req);
-              break;
-            case MDstring:
-            default:
-              seq=string(argv[i]);
-              veq=static_cast<void *>(&seq);
-          }
-          equal_test=true;
-          if(sarg=="-ne")
-            negate=true;
-        }
-        else if(sarg=="-min")
+        if( (sarg=="-and") || (sarg=="-or") )
         {
           ++i;
           if(i>=argc) usage();
-          switch(keytype)
-          {
-            case MDint:
-              imin=atoi(argv[i]);
-              vmin=static_cast<void *>(&imin);
-              break;
-            case MDreal:
-              rmin=atof(argv[i]);
-              vmin=static_cast<void *>(&rmin);
-              break;
-            case MDstring:
-            default:
-              smin=string(argv[i]);
-              vmin=static_cast<void *>(&smin);
-          }
-          minonly=true;
-          maxonly=false;
-          test_range=false;
-        }
-        else if(sarg=="-max")
-        {
-          ++i;
-          if(i>=argc) usage();
-          switch(keytype)
-          {
-            case MDint:
-              imax=atoi(argv[i]);
-              vmax=static_cast<void *>(&imax);
-              break;
-            case MDreal:
-              rmax=atof(argv[i]);
-              vmax=static_cast<void *>(&rmax);
-              break;
-            case MDstring:
-            default:
-              smax=string(argv[i]);
-              vmax=static_cast<void *>(&rmax);
-          }
-          maxonly=true;
-          minonly=false;
-          test_range=false;
-        }
-        else if(sarg=="-range")
-        {
-          i+=2;
-          if(i>=argc) usage();
-          switch(keytype)
-          {
-            case MDint:
-              imin=atoi(argv[i-1]);
-              imax=atoi(argv[i]);
-              vmin=static_cast<void *>(&imin);
-              vmax=static_cast<void *>(&imax);
-              break;
-            case MDreal:
-              rmin=atof(argv[i-1]);
-              rmax=atof(argv[i]);
-              vmin=static_cast<void *>(&rmin);
-              vmax=static_cast<void *>(&rmax);
-              break;
-            case MDstring:
-            default:
-              smin=string(argv[i-1]);
-              smax=string(argv[i]);
-              vmin=static_cast<void *>(&smin);
-              vmax=static_cast<void *>(&smax);
-          };
-          minonly=false;
-          maxonly=false;
-          test_range=true;
+          shared_ptr<MetadataPredicate> rhs=parse_test(i,argc,argv);
+          test=shared_ptr<MetadataPredicate>(new MetadataCompoundTest(test,
+                rhs,sarg=="-and"));
         }
         /* For now allows -objt or -t as I (glp) have a bunch of 
          * shell scripts use -objt as this flag */
@@ -466,6 +252,16 @@ int main(int argc, char **argv)
             usage();
           }
         }
+        else if(sarg=="-if")
+        {
+          ++i;
+          if(i>=argc)usage();
+          infile=string(argv[i]);
+        }
+        else if(sarg=="-noindex")
+        {
+            use_index=false;
+        }
         else if(sarg=="--help")
         {
             usage();
@@ -477,50 +273,6 @@ int main(int argc, char **argv)
         else
             usage();
     }
-    /* Some sanity checks */
-    if(!(test_range || minonly || maxonly || equal_test))
-    {
-      cerr << "no subset test defined"<<endl;
-      usage();
-    }
-    if((equal_test && minonly) || (equal_test && maxonly) || (equal_test && test_range) )
-    {
-      cerr << "Inconsistent arguments:   Cannot specify interval subset and match subset"<<endl;
-      usage();
-    }
-    if(test_range)
-    {
-      switch (keytype) {
-        case MDint:
-          if(imin>=imax)
-          {
-            cerr << "Interval mismatch for integer:  min="<<imin
-              << " max="<<imax<<endl;
-            usage();
-          }
-          break;
-        case MDreal:
-            if(rmin>=rmax)
-            {
-              cerr << "Interval mismatch for real key:  min="<<rmin
-                << " max="<<rmax<<endl;
-              usage();
-            }
-            break;
-        case MDstring:
-            if(smin>=smax)
-            {
-              cerr << "Interval mismatch for string key:  min="<<smin
-                  << " max="<<smax<<endl;
-              usage();
-            }
-            break;
-        default:
-            /* This block should actually never be executed */
-            cerr << "unknown key time"<<endl;
-            usage();
-      }
-    }
     try{
       int nout;
       /* Wonder if there is a cleaner way to do this, but we need to tell
@@ -528,24 +280,24 @@ int main(int argc, char **argv)
       switch(object_type)
       {
         case TCE:
-          nout=subset_processor<ThreeComponentEnsemble>(key,keytype,
-                    veq,vmin,vmax,equal_test,negate,minonly,maxonly,binary_data);
+          nout=subset_processor<ThreeComponentEnsemble>(test,infile,
+                  use_index,binary_data);
           break;
         case TCS:
-          nout=subset_processor<ThreeComponentSeismogram>(key,keytype,
-                    veq,vmin,vmax,equal_test,negate,minonly,maxonly,binary_data);
+          nout=subset_processor<ThreeComponentSeismogram>(test,infile,
+                  use_index,binary_data);
           break;
         case TS:
-          nout=subset_processor<TimeSeries>(key,keytype,
-                    veq,vmin,vmax,equal_test,negate,minonly,maxonly,binary_data);
+          nout=subset_processor<TimeSeries>(test,infile,use_index,
+                  binary_data);
           break;
         case TSE:
-          nout=subset_processor<TimeSeriesEnsemble>(key,keytype,
-                    veq,vmin,vmax,equal_test,negate,minonly,maxonly,binary_data);
+          nout=subset_processor<TimeSeriesEnsemble>(test,infile,
+                  use_index,binary_data);
           break;
         case PMTS:
-          nout=subset_processor<PMTimeSeries>(key,keytype,
-                    veq,vmin,vmax,equal_test,negate,minonly,maxonly,binary_data);
+          nout=subset_processor<PMTimeSeries>(test,infile,use_index,
+                  binary_data);
           break;
       }
       cerr << "subset_streamfile:  Total number of objects copied to output="<<nout<<endl;
@@ -5,6 +5,7 @@
 #include <memory>
 #include "seispp.h"
 #include "ensemble.h"
+#include "mute.h"
 #include "StreamObjectReader.h"
 #include "StreamObjectWriter.h"
 using namespace std;   
@@ -22,74 +23,6 @@ void usage()
         << " -text - switch to text input and output (default is binary)"<<endl;
     exit(-1);
 }
-/* This object's apply method does the work of this program.  It
-   currently supports only a linear ramp from 1 to 0 defined by
-   two end points t1 and t0 respectively. */
-class TailMute
-{
-  public:
-    double t1; // Start of mute (where value is 1)
-    double t0;  // time when mute is zero
-    TailMute(PfStyleMetadata& pf);
-    /* Apply the mute to a seismogram.   Returns number of samples changes*/
-    int apply(ThreeComponentSeismogram& d);
-  private:
-    double dwdt;  //change in weight with time used to compute ramp mute
-};
-TailMute::TailMute(PfStyleMetadata& pf)
-{
-  try{
-    t0=pf.get<double>("t0");
-    t1=pf.get<double>("t1");
-    if(t1>=t0)
-    {
-      stringstream serr;
-      serr<<"TailMute constructor:  illegal parameters for mute definition"
-        <<endl<<"Time of start (t1) ="<<t1<<endl
-        <<"Time of mute end (t0) where data after that time are zeroed="<<t0
-        <<endl
-        << "t0 must be greater than t1"<<endl;
-      throw SeisppError(serr.str());
-    }
-    dwdt = 1.0/(t0-t1);
-  }catch(...){throw;};
-}
-int TailMute::apply(ThreeComponentSeismogram& d)
-{
-  int i,k;
-  int n(0);
-  double t;
-  double te=d.endtime();
-  //DEBUG
-  /*
-  cerr << "first sample number="<<d.sample_number(t1+d.dt)+1<<endl
-      << "last sample number="<<d.sample_number(te)<<endl
-      << "This trace length="<<d.ns<<endl;
-      */
-  for(t=t1+d.dt,i=d.sample_number(t1+d.dt)+1;t<te&&i<d.ns;t+=d.dt,++i)
-  {
-    double w;
-    if(i<0) continue;
-    if(t>=t0)
-        w=0.0;
-    else
-        w=1.0-(t-t1)*dwdt;
-    for(k=0;k<3;++k) d.u(k,i)*=w;
-    ++n;
-  }
-  for(;i<d.ns;++i)
-  {
-    for(k=0;k<3;++k) d.u(k,i)=0.0;
-    ++n;
-  }
-  if(n>=d.ns)
-  {
-      d.live=false;
-      cerr << "TailMute::apply:   zeroed all data.  Marking output dead"
-          <<endl;
-  }
-  return n;
-}
 bool SEISPP::SEISPP_verbose(false);
 int main(int argc, char **argv)
 {
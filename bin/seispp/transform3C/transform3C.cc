@@ -128,8 +128,9 @@ int main(int argc, char **argv)
         while(inp->good())
         {
             d=inp->read();
-            d.rotate_to_standard();
-            d.apply_transformation_matrix(A);
+            /* Same as rotate_to_standard followed by 
+               apply_transformation_matrix in one pass */
+            d.set_transformation_matrix(A);
             if(force_cardinal) reset_tmatrix(d);
             out->write(d);
             ++n;
@@ -10,6 +10,8 @@ criteria on the rows of the database view linked to the queue.
 usage:  rewind_queue qfile
 */
 #include <stdio.h>
+#include <string>
+#include <vector>
 #include "ProcessingQueue.h"
 using namespace std;
 using namespace SEISPP;
@@ -30,12 +32,14 @@ int main(int argc, char **argv)
 			argv[1]);
 		usage();
 	}
-	int position;
+	/* The header is 3 longs written by the ProcessingQueue objects:
+	record count, table number, and the high water mark. */
+	long position;
 	position=0;
-	fseek(fp,2*sizeof(int),SEEK_SET);
-	fwrite((void *)(&position),sizeof(int),1,fp);
+	fseek(fp,2*sizeof(long),SEEK_SET);
+	fwrite((void *)(&position),sizeof(long),1,fp);
 	rewind(fp);
-	fseek(fp,3*sizeof(int),SEEK_SET);
+	fseek(fp,3*sizeof(long),SEEK_SET);
 	ProcessingStatus status_this_record;
 	int number_cleared(0);
 	/* Above read the 3 word header at the start. Now we can
@@ -68,9 +72,23 @@ int main(int argc, char **argv)
 			<< "set as BUSY."<<endl;
 		cout << "Size of this queue="<<newqueue.size()<<" records."<<endl;
 		rewind(fp);
-		fseek(fp,3*sizeof(int),SEEK_SET);
+		fseek(fp,3*sizeof(long),SEEK_SET);
 		fwrite((void *)(&(newqueue[0])),sizeof(ProcessingStatus),
 			newqueue.size(),fp);
 	}
+	fclose(fp);
+	/* MappedProcessingQueue keeps a heartbeat for each claim in a 
+	companion file.  Clear it so reset records are immediately 
+	available.  Heartbeat file has a 2 long header. */
+	string hbname=string(argv[1])+".hb";
+	FILE *hbfp=fopen(hbname.c_str(),"r+");
+	if(hbfp!=NULL)
+	{
+		vector<long> hb(newqueue.size(),0);
+		fseek(hbfp,2*sizeof(long),SEEK_SET);
+		fwrite((void *)(&(hb[0])),sizeof(long),hb.size(),hbfp);
+		fclose(hbfp);
+		cout << "Cleared heartbeat file="<<hbname<<endl;
+	}
 }
 
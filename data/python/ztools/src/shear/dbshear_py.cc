@@ -8,6 +8,7 @@
 #include <Eigen/Dense>
 #include <Eigen/Eigenvalues>
 #include "picker.h"
+#include "parallel_for.h"
 #include "Python.h"
 #include "numpy/arrayobject.h"
 
@@ -27,10 +28,10 @@ void PyArrayToVector (PyArrayObject* arr, vector<double>& out, int n) {
 }
 
 static PyObject* dbshear (PyObject *dummy, PyObject *args) {
-    int i, p_pick;
-    double s1_pick, s2_pick, snr_s1, snr_s2, dt, cov_len, k_len;
-    double sta(1.0), lta(5.0);
+    int i;
+    double dt, cov_len, k_len;
     vector<double> N, E, Z;
+    ShearResult res;
 
     // Python wrapper declarations
     PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL;
@@ -59,41 +60,9 @@ static PyObject* dbshear (PyObject *dummy, PyObject *args) {
 
     // Check that all three traces are the same length
     if ((*nz != *ne) || (*nz != *nn) || (*ne != *nn)) return NULL;
-    vector<double> pol_fltr,  cftK1(*nz), cftK2(*nz);
-    vector<double> cftS1(*nz), cftS2(*nz), snr;
-
-    // Begin picking algorithm & calculate polarization filter
-    Polarizer polar_fltr(cov_len, dt);
-    pol_fltr = polar_fltr.filter(Z, N, E);
-
-    // Calculate STA/LTA and try to find correct trigger window
-    int start, stop;
-    double peak_snr;
-    snr = lstalta(Z, int(sta/dt), int(lta/dt));
-    trigger(snr, 5.0, 2.5, 2.0, dt, start, stop, peak_snr);
-    if (start == -1 || stop == -1) {
-        p_pick = -1;
-    }
-    else {
-        p_pick = start;
-    }
-    vector<double> kurt;
-    kurt = kurtosis(Z, int(k_len/dt));
-    // Window around trial P-pick to refine through k-rate
-    start = p_pick - int(1.0/dt);
-    stop = p_pick + int(1.0/dt);
-    if (stop > kurt.size()) stop = kurt.size()-1;
-    vector<double>::iterator it = kurt.begin();
-    p_pick = std::distance(it, std::max_element(it+start, it+stop));
-
-    // Attempt to pick S-waves on both horizontals
-    ShearPicker SPicker(dt, k_len, sta, lta, 5.0, 2.5, 2, p_pick, pol_fltr);
-    SPicker.pick(N, s1_pick, snr_s1);
-    cftS1 = SPicker.get_cftS();
-    cftK1 = SPicker.get_cftK();
-    SPicker.pick(E, s2_pick, snr_s2);
-    cftS2 = SPicker.get_cftS();
-    cftK2 = SPicker.get_cftK();
+
+    // Polarization filter, P pick, and S picks on both horizontals
+    shear_pick_3c(Z, N, E, cov_len, dt, k_len, res);
 
     filter = (PyArrayObject*) PyArray_SimpleNew(1, nz, NPY_DOUBLE);
     K1 = (PyArrayObject*) PyArray_SimpleNew(1, nz, NPY_DOUBLE);
@@ -108,15 +77,15 @@ static PyObject* dbshear (PyObject *dummy, PyObject *args) {
     double *ptr;
     for (i = 0; i < *nz; i++) {
         ptr = (double*)PyArray_GETPTR1(filter, i);
-        *ptr = pol_fltr[i];
+        *ptr = res.filter[i];
         ptr = (double*)PyArray_GETPTR1(K1, i);
-        *ptr = cftK1[i];
+        *ptr = res.K1[i];
         ptr = (double*)PyArray_GETPTR1(K2, i);
-        *ptr = cftK2[i];
+        *ptr = res.K2[i];
         ptr = (double*)PyArray_GETPTR1(S1, i);
-        *ptr = cftS1[i];
+        *ptr = res.S1[i];
         ptr = (double*)PyArray_GETPTR1(S2, i);
-        *ptr = cftS2[i];
+        *ptr = res.S2[i];
     }
     Py_INCREF(filter);
     Py_INCREF(K1);
@@ -126,13 +95,147 @@ static PyObject* dbshear (PyObject *dummy, PyObject *args) {
     Py_DECREF(PZ);
     Py_DECREF(PN);
     Py_DECREF(PE);
-    return Py_BuildValue("ffffOOOOO", s1_pick, s2_pick, snr_s1, snr_s2,
-                         filter, S1, S2, K1, K2);
+    return Py_BuildValue("ffffOOOOO", res.s1_pick, res.s2_pick,
+                         res.snr_s1, res.snr_s2, filter, S1, S2, K1, K2);
+}
+
+// Work shared by the dbshear_batch threads.  Row i of Z, N and E holds
+// trace i; only the picks are kept.
+struct ShearBatch {
+    const double *Z;
+    const double *N;
+    const double *E;
+    const long *nsamp;
+    npy_intp ntraces;
+    npy_intp rowlen;
+    double cov_len;
+    double dt;
+    double k_len;
+    double *s1_pick;
+    double *s2_pick;
+    double *snr_s1;
+    double *snr_s2;
+};
+
+// Picks trace i of the batch.  Called from the parallel_for threads.
+static void shear_batch_trace (ShearBatch *b, npy_intp i) {
+    npy_intp n;
+    vector<double> Z, N, E;
+    ShearResult res;
+    n = (b->nsamp != NULL) ? b->nsamp[i] : b->rowlen;
+    b->s1_pick[i] = b->s2_pick[i] = -1;
+    b->snr_s1[i] = b->snr_s2[i] = -1;
+    if (n < 2 || n > b->rowlen) return;
+    Z.assign(b->Z + i*b->rowlen, b->Z + i*b->rowlen + n);
+    N.assign(b->N + i*b->rowlen, b->N + i*b->rowlen + n);
+    E.assign(b->E + i*b->rowlen, b->E + i*b->rowlen + n);
+    try {
+        shear_pick_3c(Z, N, E, b->cov_len, b->dt, b->k_len, res);
+    } catch (...) {
+        return;
+    }
+    b->s1_pick[i] = res.s1_pick;
+    b->s2_pick[i] = res.s2_pick;
+    b->snr_s1[i] = res.snr_s1;
+    b->snr_s2[i] = res.snr_s2;
+}
+
+static PyObject* dbshear_batch (PyObject *dummy, PyObject *args) {
+    int nthreads(0);
+    bool failed(false);
+    double dt, cov_len, k_len;
+    PyObject *arg1=NULL, *arg2=NULL, *arg3=NULL, *arg4=NULL;
+    PyArrayObject *PZ=NULL, *PN=NULL, *PE=NULL, *PL=NULL;
+    PyArrayObject *S1pick, *S2pick, *SNR1, *SNR2;
+    ShearBatch batch;
+
+    if (!PyArg_ParseTuple(args, "OOOddd|iO", &arg1, &arg2, &arg3,
+                          &cov_len, &dt, &k_len, &nthreads, &arg4)) {
+        return NULL;
+    }
+    PZ = (PyArrayObject*)PyArray_FROM_OTF(arg1, NPY_DOUBLE, NPY_IN_ARRAY);
+    PN = (PyArrayObject*)PyArray_FROM_OTF(arg2, NPY_DOUBLE, NPY_IN_ARRAY);
+    PE = (PyArrayObject*)PyArray_FROM_OTF(arg3, NPY_DOUBLE, NPY_IN_ARRAY);
+    if (arg4 != NULL && arg4 != Py_None) {
+        PL = (PyArrayObject*)PyArray_FROM_OTF(arg4, NPY_LONG, NPY_IN_ARRAY);
+    }
+    if (PZ == NULL || PN == NULL || PE == NULL
+            || (arg4 != NULL && arg4 != Py_None && PL == NULL)) {
+        Py_XDECREF(PZ);
+        Py_XDECREF(PN);
+        Py_XDECREF(PE);
+        Py_XDECREF(PL);
+        return NULL;
+    }
+    npy_intp *dz = PyArray_DIMS(PZ);
+    if (PyArray_NDIM(PZ) != 2 || PyArray_NDIM(PN) != 2
+            || PyArray_NDIM(PE) != 2
+            || PyArray_DIMS(PN)[0] != dz[0] || PyArray_DIMS(PN)[1] != dz[1]
+            || PyArray_DIMS(PE)[0] != dz[0] || PyArray_DIMS(PE)[1] != dz[1]
+            || (PL != NULL && (PyArray_NDIM(PL) != 1
+                               || PyArray_DIMS(PL)[0] != dz[0]))) {
+        PyErr_SetString(PyExc_ValueError,
+            "dbshear_batch: Z, N and E must be 2-D arrays of the same shape"
+            " (one trace per row) and nsamp must have one entry per row");
+        Py_DECREF(PZ);
+        Py_DECREF(PN);
+        Py_DECREF(PE);
+        Py_XDECREF(PL);
+        return NULL;
+    }
+    S1pick = (PyArrayObject*) PyArray_SimpleNew(1, dz, NPY_DOUBLE);
+    S2pick = (PyArrayObject*) PyArray_SimpleNew(1, dz, NPY_DOUBLE);
+    SNR1 = (PyArrayObject*) PyArray_SimpleNew(1, dz, NPY_DOUBLE);
+    SNR2 = (PyArrayObject*) PyArray_SimpleNew(1, dz, NPY_DOUBLE);
+
+    batch.Z = (const double*) PyArray_DATA(PZ);
+    batch.N = (const double*) PyArray_DATA(PN);
+    batch.E = (const double*) PyArray_DATA(PE);
+    batch.nsamp = (PL != NULL) ? (const long*) PyArray_DATA(PL) : NULL;
+    batch.ntraces = dz[0];
+    batch.rowlen = dz[1];
+    batch.cov_len = cov_len;
+    batch.dt = dt;
+    batch.k_len = k_len;
+    batch.s1_pick = (double*) PyArray_DATA(S1pick);
+    batch.s2_pick = (double*) PyArray_DATA(S2pick);
+    batch.snr_s1 = (double*) PyArray_DATA(SNR1);
+    batch.snr_s2 = (double*) PyArray_DATA(SNR2);
+
+    // The picking touches no Python objects so other Python threads
+    // can run while the batch is processed.  nthreads < 1 means one
+    // thread per processor.
+    Py_BEGIN_ALLOW_THREADS
+    try {
+        SEISPP::parallel_for(batch.ntraces, nthreads, [&batch](long i) {
+            shear_batch_trace(&batch, i);
+        });
+    } catch (...) {
+        failed = true;
+    }
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(PZ);
+    Py_DECREF(PN);
+    Py_DECREF(PE);
+    Py_XDECREF(PL);
+    if (failed) {
+        Py_DECREF(S1pick);
+        Py_DECREF(S2pick);
+        Py_DECREF(SNR1);
+        Py_DECREF(SNR2);
+        PyErr_SetString(PyExc_RuntimeError,
+            "dbshear_batch: picking failed (out of memory?)");
+        return NULL;
+    }
+    return Py_BuildValue("NNNN", S1pick, S2pick, SNR1, SNR2);
 }
 
 static struct PyMethodDef methods[] =
 {
     {"dbshear", dbshear, METH_VARARGS, "Polarization filters recursively"},
+    {"dbshear_batch", dbshear_batch, METH_VARARGS,
+     "S picks for many 3C traces (rows of 2-D arrays) on a thread pool"},
     {NULL, NULL, 0, NULL}
 };
 
@@ -147,5 +250,6 @@ static struct PyModuleDef dbshear_moddef = {
 
 PyMODINIT_FUNC PyInit_dbshear (void)
 {
+    import_array();
     return PyModule_Create(&dbshear_moddef);
 }
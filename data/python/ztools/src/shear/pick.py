@@ -31,3 +31,22 @@ def shear_pick(Z, N, E, dt):
         snr = None
         chan = None
     return s_pick, snr, chan
+
+def shear_pick_batch(Z, N, E, dt, nthreads=0, nsamp=None):
+    """Pick many traces in one call.  Z, N and E are 2-D arrays with one
+    trace per row; nsamp optionally gives the valid length of each row.
+    Returns a list of (s_pick, snr, chan) as shear_pick does."""
+    from __main__ import pfile
+    cov_len = pfile['cov_len']
+    k_len = pfile['k_len']
+    out = algorithm.dbshear_batch(Z, N, E, cov_len, dt, k_len, nthreads,
+                                  nsamp)
+    picks = []
+    for s1_pick, s2_pick, snr_s1, snr_s2 in zip(*out):
+        if s1_pick > 0 and (s2_pick <= 0 or snr_s1 > snr_s2):
+            picks.append((s1_pick, snr_s1, 0))
+        elif s2_pick > 0:
+            picks.append((s2_pick, snr_s2, 1))
+        else:
+            picks.append((None, None, None))
+    return picks
@@ -1,5 +1,5 @@
 #include "picker.h"
-void trigger(vector<double> cft,
+void trigger(vector<double> const &cft,
              double t_on,
              double t_off,
              double min_dur,
@@ -34,8 +34,8 @@ void trigger(vector<double> cft,
     if (ons.size() != offs.size()) {
         std::cout << "Error: trigger ons not same length as trigger offs\n";
     }
-    vector<double>::iterator idx = cft.begin();
-    vector<double>::iterator tmp_peak;
+    vector<double>::const_iterator idx = cft.begin();
+    vector<double>::const_iterator tmp_peak;
     for (i = 0; i < ons.size(); i++) {
         if ((offs[i] - ons[i]) < min_npts) continue;
         tmp_peak = max_element(idx+ons[i], idx+offs[i]);
@@ -87,44 +87,74 @@ vector<double> stalta(vector<double> const &tr,
     return cft;
 }
 
+void moving_sum(vector<double> const &x, size_t w, vector<double> &out) {
+    // out[i] = x[i-w+1] + ... + x[i], or x[0] + ... + x[i] for i < w-1.
+    // Every window is the tail of one block of w samples plus the head of
+    // the next, so it is built from a suffix sum and a prefix sum taken
+    // within blocks.  Nothing is ever subtracted, so unlike a running sum
+    // there is no loss of precision when large values leave the window.
+    size_t n(x.size()), b, i, end;
+    vector<double> tail(n);
+    out.resize(n);
+    if (w < 1) w = 1;
+    for (b = 0; b < n; b += w) {
+        end = std::min(b+w, n);
+        tail[end-1] = x[end-1];
+        for (i = end-1; i > b; i--) {
+            tail[i-1] = tail[i] + x[i-1];
+        }
+        out[b] = x[b];
+        for (i = b+1; i < end; i++) {
+            out[i] = out[i-1] + x[i];
+        }
+    }
+    for (i = w; i < n; i++) {
+        if ((i+1) % w) out[i] += tail[i-w+1];
+    }
+    return;
+}
+
 vector<double> lstalta(vector<double> const &tr,
                        unsigned int n_sta,
                        unsigned int n_lta) {
     // Locking STA/LTA (not-recursive)
     vector<double> cft(tr.size(), 0);
-    double sta(0), lta(0);
-    size_t i, j;
+    vector<double> amp(tr.size()), sta;
+    double lta(0);
+    size_t i;
+    if (n_sta < 1 || n_lta < n_sta || tr.size() < n_lta) return cft;
+    for (i = 0; i < tr.size(); i++) {
+        amp[i] = fabs(tr[i]);
+    }
     for (i = 0; i < n_lta; i++) {
-        lta += fabs(tr[i]);
+        lta += amp[i];
     }
     lta /= n_lta;
+    moving_sum(amp, n_sta, sta);
     for (i = n_lta; i < tr.size(); i++) {
-        sta = 0;
-        for (j = i-n_sta; j < i; j++) {
-            sta += fabs(tr[j]);
-        }
-        sta /= n_sta;
-        cft[i-n_sta] = sta/lta;
+        cft[i-n_sta] = (sta[i-1]/n_sta)/lta;
     }
     return cft;
 }
 
 vector<double> kurtosis(vector<double> const &tr, int n_kurt) {
     vector<double> cft(tr.size(), 0);
-    size_t i, j;
-    double square, temp, quad, numer, denom, inv(1./n_kurt);
+    vector<double> sq(tr.size()), quad(tr.size()), sq_sum, quad_sum;
+    size_t i;
+    double numer, denom, inv(1./n_kurt);
+    if (n_kurt < 1 || tr.size() < size_t(n_kurt)) return cft;
+    for (i = 0; i < tr.size(); i++) {
+        sq[i] = tr[i]*tr[i];
+        quad[i] = sq[i]*sq[i];
+    }
+    moving_sum(sq, n_kurt, sq_sum);
+    moving_sum(quad, n_kurt, quad_sum);
     for (i = n_kurt-1; i < tr.size(); i++) {
-        square = 0;
-        quad = 0;
-        for (j = i-n_kurt+1; j < i+1; j++) {
-            temp = tr[j]*tr[j];
-            square += temp;
-            quad += temp*temp;
-        }
-        numer = inv*quad;
-        denom = pow(inv*square, 2.0);
+        numer = inv*quad_sum[i];
+        denom = inv*sq_sum[i];
+        denom *= denom;
         cft[i] = numer/denom - 3.0;
-        if (isnan(cft[i])) {
+        if (std::isnan(cft[i])) {
             cft[i] = 0;
         }
     }
@@ -319,12 +349,14 @@ void ShearPicker::pick(const vector<double> &tr, double &s_pick, double &snr) {
     // Window around trial S-pick to refine through k-rate
     start = idx - int(0.5*t_sp/dt);
     stop = idx + int(0.5*t_sp/dt);
+    if (start < 0) start = 0;
     if (stop > cftK.size()) stop = cftK.size()-1;
     it = cftK.begin();
     idx = distance(it, max_element(it+start, it+stop));
 
     // Final pick refinement to kurtosis minima
     start = idx - int(0.1/dt);
+    if (start < 0) start = 0;
     it = kurt.begin() + start;
     it = min_element(it, it+int(0.1/dt));
     idx = distance(kurt.begin(), it);
@@ -339,12 +371,53 @@ void ShearPicker::pick(const vector<double> &tr, double &s_pick, double &snr) {
 
     cftK = kurt;
 
-    kurt = kurtosis(tr, int(0.5/dt));
-    start = idx - int(0.25/dt);
-    it = kurt.begin() + start;
-    it = max_element(it, it+int(0.5/dt));
-    std::cout << *it << std::endl;
-
     return;
 
 }
+
+void shear_pick_3c(const vector<double> &Z,
+                   const vector<double> &N,
+                   const vector<double> &E,
+                   double cov_len,
+                   double dt,
+                   double k_len,
+                   ShearResult &res) {
+    // P pick on Z followed by S picks on both horizontals.  Shared by the
+    // single trace and batch entry points of dbshear.
+    int p_pick, start, stop;
+    double sta(1.0), lta(5.0), peak_snr;
+    vector<double> snr, kurt;
+    vector<double>::iterator it;
+
+    // Calculate polarization filter
+    Polarizer polar_fltr(cov_len, dt);
+    res.filter = polar_fltr.filter(Z, N, E);
+
+    // Calculate STA/LTA and try to find correct trigger window
+    snr = lstalta(Z, int(sta/dt), int(lta/dt));
+    trigger(snr, 5.0, 2.5, 2.0, dt, start, stop, peak_snr);
+    if (start == -1 || stop == -1) {
+        p_pick = -1;
+    }
+    else {
+        p_pick = start;
+    }
+    kurt = kurtosis(Z, int(k_len/dt));
+    // Window around trial P-pick to refine through k-rate
+    start = p_pick - int(1.0/dt);
+    stop = p_pick + int(1.0/dt);
+    if (start < 0) start = 0;
+    if (stop > kurt.size()) stop = kurt.size()-1;
+    it = kurt.begin();
+    p_pick = std::distance(it, std::max_element(it+start, it+stop));
+
+    // Attempt to pick S-waves on both horizontals
+    ShearPicker SPicker(dt, k_len, sta, lta, 5.0, 2.5, 2, p_pick, res.filter);
+    SPicker.pick(N, res.s1_pick, res.snr_s1);
+    res.S1 = SPicker.get_cftS();
+    res.K1 = SPicker.get_cftK();
+    SPicker.pick(E, res.s2_pick, res.snr_s2);
+    res.S2 = SPicker.get_cftS();
+    res.K2 = SPicker.get_cftK();
+    return;
+}
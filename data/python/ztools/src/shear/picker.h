@@ -16,7 +16,7 @@ using std::distance;
 using std::max_element;
 using std::min_element;
 
-void trigger(vector<double> cft,
+void trigger(vector<double> const &cft,
              double t_on,
              double t_off,
              double min_dur,
@@ -31,6 +31,8 @@ vector<double> stalta(vector<double> const &tr,
                       double t_on,
                       double t_off);
 
+void moving_sum(vector<double> const &x, size_t w, vector<double> &out);
+
 vector<double> lstalta(vector<double> const &tr,
                        unsigned int n_sta,
                        unsigned int n_lta);
@@ -77,4 +79,25 @@ class ShearPicker {
         vector<double> polarize(const vector<double>&);
 };
 
+// Results of the complete P and S picking sequence on one 3C trace
+struct ShearResult {
+    double s1_pick;
+    double s2_pick;
+    double snr_s1;
+    double snr_s2;
+    vector<double> filter;
+    vector<double> S1;
+    vector<double> S2;
+    vector<double> K1;
+    vector<double> K2;
+};
+
+void shear_pick_3c(const vector<double> &Z,
+                   const vector<double> &N,
+                   const vector<double> &E,
+                   double cov_len,
+                   double dt,
+                   double k_len,
+                   ShearResult &res);
+
 #endif
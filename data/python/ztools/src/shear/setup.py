@@ -9,9 +9,12 @@ if __name__ == "__main__":
     ext_modules = [Extension('dbshear',
                             sources = ['dbshear_py.cc',
                                         'picker.cc'],
-                            extra_compile_args=['-O3']) ]
+                            extra_compile_args=['-O3', '-std=c++11', '-pthread'],
+                            extra_link_args=['-pthread']) ]
     eigen_path = os.getcwd()
     setup(name='dbshear',
         version='1.0',
-        include_dirs=[np.get_include(), eigen_path], #Add Include path of numpy
+        # parallel_for.h is installed by libseispp
+        include_dirs=[np.get_include(), eigen_path,
+                      '%s/contrib/include' % os.environ['ANTELOPE']],
         ext_modules=ext_modules)
@@ -0,0 +1,652 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "stock.h"
+#include "fftplan.h"
+
+/*
+	Mixed radix (2, 3, 4, 5, 7) Stockham autosort FFT with precomputed
+	twiddle factors.
+
+	Each stage of radix p takes a sequence of length l = p*m, held with
+	stride s, and does p point butterflies on the elements j, j+m, ...
+	j+(p-1)*m followed by the twiddle multiply.  Results go to the other
+	buffer with stride s*p so the output comes out in natural order with
+	no bit reversal pass.  The inner loop runs over unit stride data
+	and has no data dependent branches, which lets the compiler
+	vectorize it.
+
+	Real transforms of length n are done as a complex transform of
+	length n/2 on the even/odd samples followed by the usual split
+	step, so they cost about half a complex transform of length n.
+*/
+
+/* The shared cache is an open addressed hash table keyed on the length.
+   Slots are filled once under the mutex and never changed, so lookups
+   are lock free atomic loads. */
+static FFTplan *plan_cache[FFTPLAN_CACHESIZE];
+static pthread_mutex_t plan_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Each thread also has a small direct mapped cache of private plans used
+   by the cfftr family, which may evict and free them. */
+typedef struct FFTplanLocal {
+	FFTplan *plan[FFTPLAN_LOCALSIZE];
+} FFTplanLocal;
+
+static pthread_key_t plan_local_key;
+static pthread_once_t plan_local_once = PTHREAD_ONCE_INIT;
+
+static unsigned int
+fftplan_hash ( int n, int real )
+{
+	return ( ( unsigned int ) n * 2654435761u ) ^ ( unsigned int ) real;
+}
+
+/* Factor n into the radices used by the transform.  Returns the number
+   of stages, or -1 if n has a prime factor larger than 7. */
+static int
+fftplan_factor ( int n, int *radix )
+{
+	int nstages = 0;
+	int p;
+	static int primes[4] = { 2, 3, 5, 7 };
+	int i;
+
+	if ( n < 1 )
+		return -1;
+	while ( n % 4 == 0 && nstages < FFTPLAN_MAXSTAGES ) {
+		radix[nstages++] = 4;
+		n /= 4;
+	}
+	for ( i = 0; i < 4; i++ ) {
+		p = primes[i];
+		while ( n % p == 0 && nstages < FFTPLAN_MAXSTAGES ) {
+			radix[nstages++] = p;
+			n /= p;
+		}
+	}
+	if ( n != 1 )
+		return -1;
+	return nstages;
+}
+
+int
+fftplan_factorable ( int n )
+{
+	int radix[FFTPLAN_MAXSTAGES];
+
+	return ( fftplan_factor ( n, radix ) >= 0 );
+}
+
+/* Smallest even length >= n that has no prime factor larger than 7 */
+int
+fftplan_goodsize ( int n )
+{
+	int m;
+
+	if ( n < 2 )
+		return 2;
+	m = n + ( n & 1 );
+	while ( !fftplan_factorable ( m ) )
+		m += 2;
+	return m;
+}
+
+FFTplan *
+fftplan_new ( int n, int real )
+{
+	FFTplan *plan;
+	int i, j, k, p, l, m, nc, ntw;
+	float *tw;
+	double arg;
+
+	if ( n < 1 || ( real && ( n < 2 || n % 2 ) ) )
+		return NULL;
+	plan = ( FFTplan * ) calloc ( 1, sizeof ( FFTplan ) );
+	if ( plan == NULL )
+		elog_die ( 1, "fftplan_new:  malloc error\n" );
+	plan->n = n;
+	plan->real = real;
+	nc = real ? n / 2 : n;
+	plan->nc = nc;
+	plan->nstages = fftplan_factor ( nc, plan->radix );
+	if ( plan->nstages < 0 ) {
+		free ( plan );
+		return NULL;
+	}
+	/* One table holds the twiddles of every stage, each (p-1)*m complex,
+	   and for real plans the nc/2+1 split step twiddles */
+	ntw = 0;
+	l = nc;
+	for ( i = 0; i < plan->nstages; i++ ) {
+		p = plan->radix[i];
+		m = l / p;
+		ntw += 2 * ( p - 1 ) * m;
+		l = m;
+	}
+	if ( real )
+		ntw += 2 * ( nc / 2 + 1 );
+	plan->space = ( float * ) malloc ( ( ntw + 2 ) * sizeof ( float ) );
+	if ( plan->space == NULL )
+		elog_die ( 1, "fftplan_new:  malloc error\n" );
+	tw = plan->space;
+	l = nc;
+	for ( i = 0; i < plan->nstages; i++ ) {
+		p = plan->radix[i];
+		m = l / p;
+		plan->twiddle[i] = tw;
+		for ( j = 0; j < m; j++ ) {
+			for ( k = 1; k < p; k++ ) {
+				arg = 2.0 * M_PI * ( double ) ( j * k ) / ( double ) l;
+				*tw++ = ( float ) cos ( arg );
+				*tw++ = ( float ) ( -sin ( arg ) );
+			}
+		}
+		l = m;
+	}
+	if ( real ) {
+		plan->rtwiddle = tw;
+		for ( k = 0; k <= nc / 2; k++ ) {
+			arg = M_PI * ( double ) k / ( double ) nc;
+			*tw++ = ( float ) cos ( arg );
+			*tw++ = ( float ) ( -sin ( arg ) );
+		}
+	}
+	return plan;
+}
+
+void
+fftplan_free ( FFTplan *plan )
+{
+	if ( plan == NULL )
+		return;
+	free ( plan->space );
+	free ( plan );
+}
+
+/* Return a shared plan for length n from the cache, building it on
+   first use.  Returns NULL if n cannot be planned or the cache already
+   holds FFTPLAN_CACHESIZE plans; callers then use fftplan_new. */
+FFTplan *
+fftplan_get ( int n, int real )
+{
+	FFTplan *plan;
+	unsigned int h, slot;
+	int i;
+
+	h = fftplan_hash ( n, real );
+	for ( i = 0; i < FFTPLAN_CACHESIZE; i++ ) {
+		slot = ( h + i ) % FFTPLAN_CACHESIZE;
+		plan = __atomic_load_n ( &plan_cache[slot], __ATOMIC_ACQUIRE );
+		if ( plan == NULL )
+			break;
+		if ( plan->n == n && plan->real == real )
+			return plan;
+	}
+	if ( !fftplan_factorable ( real ? n / 2 : n ) )
+		return NULL;
+	pthread_mutex_lock ( &plan_cache_mutex );
+	plan = NULL;
+	for ( i = 0; i < FFTPLAN_CACHESIZE; i++ ) {
+		slot = ( h + i ) % FFTPLAN_CACHESIZE;
+		if ( plan_cache[slot] == NULL ) {
+			plan = fftplan_new ( n, real );
+			if ( plan != NULL )
+				__atomic_store_n ( &plan_cache[slot], plan, __ATOMIC_RELEASE );
+			break;
+		}
+		if ( plan_cache[slot]->n == n && plan_cache[slot]->real == real ) {
+			plan = plan_cache[slot];
+			break;
+		}
+	}
+	pthread_mutex_unlock ( &plan_cache_mutex );
+	return plan;
+}
+
+static void
+fftplan_local_free ( void *arg )
+{
+	FFTplanLocal *local = ( FFTplanLocal * ) arg;
+	int i;
+
+	for ( i = 0; i < FFTPLAN_LOCALSIZE; i++ )
+		fftplan_free ( local->plan[i] );
+	free ( local );
+}
+
+static void
+fftplan_local_init ( void )
+{
+	pthread_key_create ( &plan_local_key, fftplan_local_free );
+}
+
+/* Return a plan for length n private to the calling thread.  The
+   plan stays valid until the next fftplan_local call from the same
+   thread, which may replace it.  No locks are taken. */
+FFTplan *
+fftplan_local ( int n, int real )
+{
+	FFTplanLocal *local;
+	FFTplan *plan;
+	int slot;
+
+	pthread_once ( &plan_local_once, fftplan_local_init );
+	local = ( FFTplanLocal * ) pthread_getspecific ( plan_local_key );
+	if ( local == NULL ) {
+		local = ( FFTplanLocal * ) calloc ( 1, sizeof ( FFTplanLocal ) );
+		if ( local == NULL )
+			elog_die ( 1, "fftplan_local:  malloc error\n" );
+		pthread_setspecific ( plan_local_key, local );
+	}
+	slot = fftplan_hash ( n, real ) % FFTPLAN_LOCALSIZE;
+	plan = local->plan[slot];
+	if ( plan != NULL && plan->n == n && plan->real == real )
+		return plan;
+	if ( !fftplan_factorable ( real ? n / 2 : n ) )
+		return NULL;
+	plan = fftplan_new ( n, real );
+	if ( plan != NULL ) {
+		fftplan_free ( local->plan[slot] );
+		local->plan[slot] = plan;
+	}
+	return plan;
+}
+
+int
+fftplan_worksize ( FFTplan *plan )
+{
+	return 2 * plan->nc;
+}
+
+/* One radix 2 stage.  x and y hold complex values as float pairs.
+   sg is +1 for a forward (negative exponent) transform and -1 for an
+   inverse one; it conjugates the stored forward twiddles. */
+static void
+stage2 ( int m, int s, float *tw, float *x, float *y, float sg )
+{
+	int j, q;
+	float *a0, *a1, *b0, *b1;
+	float wr, wi, tr, ti;
+
+	for ( j = 0; j < m; j++ ) {
+		wr = tw[2 * j];
+		wi = sg * tw[2 * j + 1];
+		a0 = x + 2 * s * j;
+		a1 = x + 2 * s * ( j + m );
+		b0 = y + 2 * s * ( 2 * j );
+		b1 = y + 2 * s * ( 2 * j + 1 );
+		for ( q = 0; q < 2 * s; q += 2 ) {
+			b0[q] = a0[q] + a1[q];
+			b0[q + 1] = a0[q + 1] + a1[q + 1];
+			tr = a0[q] - a1[q];
+			ti = a0[q + 1] - a1[q + 1];
+			b1[q] = tr * wr - ti * wi;
+			b1[q + 1] = tr * wi + ti * wr;
+		}
+	}
+}
+
+static void
+stage4 ( int m, int s, float *tw, float *x, float *y, float sg )
+{
+	int j, q;
+	float *a0, *a1, *a2, *a3, *b0, *b1, *b2, *b3;
+	float w1r, w1i, w2r, w2i, w3r, w3i;
+	float t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+	float cr, ci;
+
+	for ( j = 0; j < m; j++ ) {
+		w1r = tw[6 * j];
+		w1i = sg * tw[6 * j + 1];
+		w2r = tw[6 * j + 2];
+		w2i = sg * tw[6 * j + 3];
+		w3r = tw[6 * j + 4];
+		w3i = sg * tw[6 * j + 5];
+		a0 = x + 2 * s * j;
+		a1 = x + 2 * s * ( j + m );
+		a2 = x + 2 * s * ( j + 2 * m );
+		a3 = x + 2 * s * ( j + 3 * m );
+		b0 = y + 2 * s * ( 4 * j );
+		b1 = y + 2 * s * ( 4 * j + 1 );
+		b2 = y + 2 * s * ( 4 * j + 2 );
+		b3 = y + 2 * s * ( 4 * j + 3 );
+		for ( q = 0; q < 2 * s; q += 2 ) {
+			t0r = a0[q] + a2[q];
+			t0i = a0[q + 1] + a2[q + 1];
+			t1r = a0[q] - a2[q];
+			t1i = a0[q + 1] - a2[q + 1];
+			t2r = a1[q] + a3[q];
+			t2i = a1[q + 1] + a3[q + 1];
+			/* (a1-a3) times -i for forward, +i for inverse */
+			t3r = sg * ( a1[q + 1] - a3[q + 1] );
+			t3i = -sg * ( a1[q] - a3[q] );
+			b0[q] = t0r + t2r;
+			b0[q + 1] = t0i + t2i;
+			cr = t1r + t3r;
+			ci = t1i + t3i;
+			b1[q] = cr * w1r - ci * w1i;
+			b1[q + 1] = cr * w1i + ci * w1r;
+			cr = t0r - t2r;
+			ci = t0i - t2i;
+			b2[q] = cr * w2r - ci * w2i;
+			b2[q + 1] = cr * w2i + ci * w2r;
+			cr = t1r - t3r;
+			ci = t1i - t3i;
+			b3[q] = cr * w3r - ci * w3i;
+			b3[q + 1] = cr * w3i + ci * w3r;
+		}
+	}
+}
+
+static void
+stage3 ( int m, int s, float *tw, float *x, float *y, float sg )
+{
+	int j, q;
+	float *a0, *a1, *a2, *b0, *b1, *b2;
+	float w1r, w1i, w2r, w2i;
+	float t1r, t1i, t2r, t2i, m1r, m1i, m2r, m2i, cr, ci;
+	float s3 = ( float ) ( -sg * 0.86602540378443864676 );
+
+	for ( j = 0; j < m; j++ ) {
+		w1r = tw[4 * j];
+		w1i = sg * tw[4 * j + 1];
+		w2r = tw[4 * j + 2];
+		w2i = sg * tw[4 * j + 3];
+		a0 = x + 2 * s * j;
+		a1 = x + 2 * s * ( j + m );
+		a2 = x + 2 * s * ( j + 2 * m );
+		b0 = y + 2 * s * ( 3 * j );
+		b1 = y + 2 * s * ( 3 * j + 1 );
+		b2 = y + 2 * s * ( 3 * j + 2 );
+		for ( q = 0; q < 2 * s; q += 2 ) {
+			t1r = a1[q] + a2[q];
+			t1i = a1[q + 1] + a2[q + 1];
+			t2r = a1[q] - a2[q];
+			t2i = a1[q + 1] - a2[q + 1];
+			b0[q] = a0[q] + t1r;
+			b0[q + 1] = a0[q + 1] + t1i;
+			m1r = a0[q] - 0.5f * t1r;
+			m1i = a0[q + 1] - 0.5f * t1i;
+			/* i * s3 * t2 */
+			m2r = -s3 * t2i;
+			m2i = s3 * t2r;
+			cr = m1r + m2r;
+			ci = m1i + m2i;
+			b1[q] = cr * w1r - ci * w1i;
+			b1[q + 1] = cr * w1i + ci * w1r;
+			cr = m1r - m2r;
+			ci = m1i - m2i;
+			b2[q] = cr * w2r - ci * w2i;
+			b2[q + 1] = cr * w2i + ci * w2r;
+		}
+	}
+}
+
+/* Radix 5 and 7.  Pairs of outputs k and p-k share the cosine sums
+   and differ only in the sign of the sine sums. */
+static void
+stageodd ( int p, int m, int s, float *tw, float *x, float *y, float sg )
+{
+	int j, q, r, k, h;
+	float *a[7], *b[7];
+	float c[7], sn[7], wr[7], wi[7];
+	float sr[4], si[4], dr[4], di[4];
+	float ar, ai, br, bi, cr, ci;
+
+	h = ( p - 1 ) / 2;
+	for ( k = 0; k < p; k++ ) {
+		c[k] = ( float ) cos ( 2.0 * M_PI * ( double ) k / ( double ) p );
+		sn[k] = ( float ) ( -sg * sin ( 2.0 * M_PI * ( double ) k / ( double ) p ) );
+	}
+	for ( j = 0; j < m; j++ ) {
+		wr[0] = 1.0;
+		wi[0] = 0.0;
+		for ( k = 1; k < p; k++ ) {
+			wr[k] = tw[2 * ( ( p - 1 ) * j + k - 1 )];
+			wi[k] = sg * tw[2 * ( ( p - 1 ) * j + k - 1 ) + 1];
+		}
+		for ( r = 0; r < p; r++ ) {
+			a[r] = x + 2 * s * ( j + r * m );
+			b[r] = y + 2 * s * ( p * j + r );
+		}
+		for ( q = 0; q < 2 * s; q += 2 ) {
+			ar = a[0][q];
+			ai = a[0][q + 1];
+			for ( r = 1; r <= h; r++ ) {
+				sr[r] = a[r][q] + a[p - r][q];
+				si[r] = a[r][q + 1] + a[p - r][q + 1];
+				dr[r] = a[r][q] - a[p - r][q];
+				di[r] = a[r][q + 1] - a[p - r][q + 1];
+				ar += sr[r];
+				ai += si[r];
+			}
+			b[0][q] = ar;
+			b[0][q + 1] = ai;
+			for ( k = 1; k <= h; k++ ) {
+				ar = a[0][q];
+				ai = a[0][q + 1];
+				br = 0.0;
+				bi = 0.0;
+				for ( r = 1; r <= h; r++ ) {
+					ar += c[( r * k ) % p] * sr[r];
+					ai += c[( r * k ) % p] * si[r];
+					br += sn[( r * k ) % p] * dr[r];
+					bi += sn[( r * k ) % p] * di[r];
+				}
+				/* output k is A + i*B, output p-k is A - i*B */
+				cr = ar - bi;
+				ci = ai + br;
+				b[k][q] = cr * wr[k] - ci * wi[k];
+				b[k][q + 1] = cr * wi[k] + ci * wr[k];
+				cr = ar + bi;
+				ci = ai - br;
+				b[p - k][q] = cr * wr[p - k] - ci * wi[p - k];
+				b[p - k][q + 1] = cr * wi[p - k] + ci * wr[p - k];
+			}
+		}
+	}
+}
+
+/* Complex transform of plan->nc values in x.  The result is left in x. */
+static void
+fftplan_exec ( FFTplan *plan, float *x, int isign, float *work )
+{
+	int i, p, l, m, s;
+	float *in, *out, *tmp;
+	float sg;
+
+	sg = ( isign < 0 ) ? 1.0 : -1.0;
+	in = x;
+	out = work;
+	l = plan->nc;
+	s = 1;
+	for ( i = 0; i < plan->nstages; i++ ) {
+		p = plan->radix[i];
+		m = l / p;
+		switch ( p ) {
+		case 2:
+			stage2 ( m, s, plan->twiddle[i], in, out, sg );
+			break;
+		case 3:
+			stage3 ( m, s, plan->twiddle[i], in, out, sg );
+			break;
+		case 4:
+			stage4 ( m, s, plan->twiddle[i], in, out, sg );
+			break;
+		default:
+			stageodd ( p, m, s, plan->twiddle[i], in, out, sg );
+			break;
+		}
+		tmp = in;
+		in = out;
+		out = tmp;
+		l = m;
+		s *= p;
+	}
+	if ( in != x )
+		memcpy ( x, in, 2 * plan->nc * sizeof ( float ) );
+}
+
+/* Complex transform of plan->n values.  The exponent has the sign of
+   isign and there is no scaling, as with cfour. */
+void
+fftplan_complex ( FFTplan *plan, float *x, int isign, float *work )
+{
+	float *w = work;
+
+	if ( w == NULL ) {
+		w = ( float * ) malloc ( fftplan_worksize ( plan ) * sizeof ( float ) );
+		if ( w == NULL )
+			elog_die ( 1, "fftplan_complex:  malloc error\n" );
+	}
+	fftplan_exec ( plan, x, isign, w );
+	if ( work == NULL )
+		free ( w );
+}
+
+/* Split the transform of the packed even/odd samples into the
+   spectrum of the real sequence */
+static void
+fftplan_rsplit ( FFTplan *plan, float *x )
+{
+	int k, nc = plan->nc;
+	float *z1, *z2, *w;
+	float er, ei, odr, odi, tr, ti, z0r, z0i;
+
+	z0r = x[0];
+	z0i = x[1];
+	x[0] = z0r + z0i;
+	x[1] = 0.0;
+	x[2 * nc] = z0r - z0i;
+	x[2 * nc + 1] = 0.0;
+	for ( k = 1; 2 * k <= nc; k++ ) {
+		z1 = x + 2 * k;
+		z2 = x + 2 * ( nc - k );
+		w = plan->rtwiddle + 2 * k;
+		/* Fe = (Z(k) + conj(Z(nc-k)))/2, Fo = (Z(k) - conj(Z(nc-k)))/2i */
+		er = 0.5 * ( z1[0] + z2[0] );
+		ei = 0.5 * ( z1[1] - z2[1] );
+		odr = 0.5 * ( z1[1] + z2[1] );
+		odi = -0.5 * ( z1[0] - z2[0] );
+		tr = w[0] * odr - w[1] * odi;
+		ti = w[0] * odi + w[1] * odr;
+		z1[0] = er + tr;
+		z1[1] = ei + ti;
+		if ( z2 != z1 ) {
+			z2[0] = er - tr;
+			z2[1] = -( ei - ti );
+		}
+	}
+}
+
+/* Inverse of fftplan_rsplit, times 2 */
+static void
+fftplan_rmerge ( FFTplan *plan, float *x )
+{
+	int k, nc = plan->nc;
+	float *z1, *z2, *w;
+	float er, ei, odr, odi, tr, ti, x0, xn;
+
+	x0 = x[0];
+	xn = x[2 * nc];
+	x[0] = x0 + xn;
+	x[1] = x0 - xn;
+	for ( k = 1; 2 * k <= nc; k++ ) {
+		z1 = x + 2 * k;
+		z2 = x + 2 * ( nc - k );
+		w = plan->rtwiddle + 2 * k;
+		/* Fe = X(k) + conj(X(nc-k)), Fo = (X(k) - conj(X(nc-k)))*conj(W^k) */
+		er = z1[0] + z2[0];
+		ei = z1[1] - z2[1];
+		tr = z1[0] - z2[0];
+		ti = z1[1] + z2[1];
+		odr = tr * w[0] + ti * w[1];
+		odi = ti * w[0] - tr * w[1];
+		/* Z(k) = Fe + i*Fo, Z(nc-k) = conj(Fe) + i*conj(Fo) */
+		z1[0] = er - odi;
+		z1[1] = ei + odr;
+		if ( z2 != z1 ) {
+			z2[0] = er + odi;
+			z2[1] = -ei + odr;
+		}
+	}
+}
+
+void
+fftplan_forward ( FFTplan *plan, float *x, float *work )
+{
+	float *w = work;
+
+	if ( !plan->real ) {
+		fftplan_complex ( plan, x, -1, work );
+		return;
+	}
+	if ( w == NULL ) {
+		w = ( float * ) malloc ( fftplan_worksize ( plan ) * sizeof ( float ) );
+		if ( w == NULL )
+			elog_die ( 1, "fftplan_forward:  malloc error\n" );
+	}
+	fftplan_exec ( plan, x, -1, w );
+	fftplan_rsplit ( plan, x );
+	if ( work == NULL )
+		free ( w );
+}
+
+void
+fftplan_inverse ( FFTplan *plan, float *x, float *work )
+{
+	float *w = work;
+
+	if ( !plan->real ) {
+		fftplan_complex ( plan, x, 1, work );
+		return;
+	}
+	if ( w == NULL ) {
+		w = ( float * ) malloc ( fftplan_worksize ( plan ) * sizeof ( float ) );
+		if ( w == NULL )
+			elog_die ( 1, "fftplan_inverse:  malloc error\n" );
+	}
+	fftplan_rmerge ( plan, x );
+	fftplan_exec ( plan, x, 1, w );
+	if ( work == NULL )
+		free ( w );
+}
+
+/* Transform ntraces equal length traces that start stride floats apart.
+   One work buffer and the plan's tables are shared by all of them. */
+void
+fftplan_forward_many ( FFTplan *plan, float *x, int ntraces, int stride, float *work )
+{
+	float *w = work;
+	int i;
+
+	if ( w == NULL ) {
+		w = ( float * ) malloc ( fftplan_worksize ( plan ) * sizeof ( float ) );
+		if ( w == NULL )
+			elog_die ( 1, "fftplan_forward_many:  malloc error\n" );
+	}
+	for ( i = 0; i < ntraces; i++ )
+		fftplan_forward ( plan, x + ( size_t ) i * stride, w );
+	if ( work == NULL )
+		free ( w );
+}
+
+void
+fftplan_inverse_many ( FFTplan *plan, float *x, int ntraces, int stride, float *work )
+{
+	float *w = work;
+	int i;
+
+	if ( w == NULL ) {
+		w = ( float * ) malloc ( fftplan_worksize ( plan ) * sizeof ( float ) );
+		if ( w == NULL )
+			elog_die ( 1, "fftplan_inverse_many:  malloc error\n" );
+	}
+	for ( i = 0; i < ntraces; i++ )
+		fftplan_inverse ( plan, x + ( size_t ) i * stride, w );
+	if ( work == NULL )
+		free ( w );
+}
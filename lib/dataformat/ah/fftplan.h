@@ -0,0 +1,71 @@
+#ifndef _FFTPLAN_H_
+#define _FFTPLAN_H_
+/*
+	Planned mixed radix FFTs for libfft.
+
+	A plan holds the factorization of the transform length and all the
+	twiddle factors so no trig is done when a transform is executed.
+	Lengths may have any combination of the factors 2, 3, 5 and 7, so
+	data can be padded to fftplan_goodsize(n) instead of the next power
+	of 2.  Plans are never modified after they are built and can be
+	shared by any number of threads.  fftplan_get returns a plan from a
+	process wide cache of at most FFTPLAN_CACHESIZE lengths; plans from
+	the cache must not be freed, and when the cache is full fftplan_get
+	returns NULL and fftplan_new/fftplan_free must be used instead.
+	fftplan_local returns a plan from a small per thread cache that
+	is only valid until the next fftplan_local call in that thread;
+	it is meant for one shot transforms like cfftr.
+
+	Real transforms use the same storage as cfftr and cfftri:  n real
+	samples in, n/2+1 complex values out with real and imaginary parts
+	alternating, so x must hold n+2 floats.  The forward transform is
+
+	              n-1
+	        X(k)=sum  x(j) exp( -2*pi*i*k*j/n )
+	              j=0
+
+	and the inverse transform returns n*x(j) in the first n floats (no
+	scaling, unlike cfftri which returns n/2*x(j)).  Complex transforms
+	work on n complex values with real and imaginary parts alternating,
+	as cfour, with isign the sign of the exponent.
+
+	The work argument of every transform is scratch space of at least
+	fftplan_worksize(plan) floats.  If it is NULL space is allocated and
+	freed on each call.  Threads must not share a work buffer.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFTPLAN_MAXSTAGES 32
+#define FFTPLAN_CACHESIZE 256
+#define FFTPLAN_LOCALSIZE 8
+
+typedef struct FFTplan {
+	int n;			/* transform length (real samples or complex values) */
+	int real;		/* 1 for a real transform plan */
+	int nc;			/* complex length actually transformed */
+	int nstages;
+	int radix[FFTPLAN_MAXSTAGES];
+	float *twiddle[FFTPLAN_MAXSTAGES];	/* per stage, (radix-1)*m complex */
+	float *rtwiddle;	/* real plans:  exp(-i*pi*k/nc), k=0..nc/2 */
+	float *space;		/* holds all twiddle tables */
+} FFTplan;
+
+extern int fftplan_goodsize ( int n );
+extern int fftplan_factorable ( int n );
+extern FFTplan *fftplan_new ( int n, int real );
+extern void fftplan_free ( FFTplan *plan );
+extern FFTplan *fftplan_get ( int n, int real );
+extern FFTplan *fftplan_local ( int n, int real );
+extern int fftplan_worksize ( FFTplan *plan );
+extern void fftplan_complex ( FFTplan *plan, float *x, int isign, float *work );
+extern void fftplan_forward ( FFTplan *plan, float *x, float *work );
+extern void fftplan_inverse ( FFTplan *plan, float *x, float *work );
+extern void fftplan_forward_many ( FFTplan *plan, float *x, int ntraces, int stride, float *work );
+extern void fftplan_inverse_many ( FFTplan *plan, float *x, int ntraces, int stride, float *work );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
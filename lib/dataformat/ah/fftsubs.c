@@ -1,8 +1,20 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include "ahhead.h"		       /* to get definition of complex arrays */
 #include "stock.h"
 #include "ahfft.h"
+#include "fftplan.h"
+
+/*
+	cfour, cfftr, cfftri and discrete_fft pass any length with only
+	the factors 2, 3, 5 and 7 to the per thread plans of fftplan.c, so
+	they no longer recompute twiddle factors on every call and are no
+	longer limited to powers of 2.  The original power of 2 code is
+	kept for other lengths.  Scratch space for short transforms comes
+	from the stack.
+*/
+#define FFT_STACKWORK 4096
 
 /*
 	two sets of C routines are used for real data;
@@ -81,8 +93,8 @@ ifour_ (int *data, int *n, int *isign)
     return;
 }
 
-void
-cfour (float *data, int n, int isign)
+static void
+cfour_radix2 (float *data, int n, int isign)
 {
     int             ip0,
                     ip1,
@@ -227,6 +239,20 @@ cifour (int *data, int n, int isign)
     return;
 }
 
+void
+cfour (float *data, int n, int isign)
+{
+    FFTplan        *plan;
+    float           work[FFT_STACKWORK];
+
+    if ((plan = fftplan_local (n, 0)) == NULL) {
+	cfour_radix2 (data, n, isign);
+	return;
+    }
+    fftplan_complex (plan, data, isign,
+		     fftplan_worksize (plan) <= FFT_STACKWORK ? work : NULL);
+}
+
 /*
 fftr and ifftr
 these subroutines take a real time series and compute its
@@ -248,8 +274,8 @@ fftr_ (float *x, int *n)
     return;
 }
 
-void
-cfftr (float *x, int n)
+static void
+cfftr_radix2 (float *x, int n)
 {
     int             nn,
                     is,
@@ -315,6 +341,20 @@ cfftr (float *x, int n)
     return;
 }
 
+void
+cfftr (float *x, int n)
+{
+    FFTplan        *plan;
+    float           work[FFT_STACKWORK];
+
+    if ((plan = fftplan_local (n, 1)) == NULL) {
+	cfftr_radix2 (x, n);
+	return;
+    }
+    fftplan_forward (plan, x,
+		     fftplan_worksize (plan) <= FFT_STACKWORK ? work : NULL);
+}
+
 void
 ifftr_ (int *x, int *n)
 {
@@ -412,8 +452,8 @@ fftri_ (float *x, int *n)
     return;
 }
 
-void
-cfftri (float *x, int n)
+static void
+cfftri_radix2 (float *x, int n)
 {
     int             nn,
                     is,
@@ -477,6 +517,24 @@ cfftri (float *x, int n)
     return;
 }
 
+void
+cfftri (float *x, int n)
+{
+    FFTplan        *plan;
+    float           work[FFT_STACKWORK];
+    int             i;
+
+    if ((plan = fftplan_local (n, 1)) == NULL) {
+	cfftri_radix2 (x, n);
+	return;
+    }
+    fftplan_inverse (plan, x,
+		     fftplan_worksize (plan) <= FFT_STACKWORK ? work : NULL);
+    /* cfftri has always returned n/2 times the time series */
+    for (i = 0; i < n; i++)
+	x[i] *= 0.5;
+}
+
 void
 ifftri_ (int *x, int *n)
 {
@@ -582,7 +640,13 @@ discrete_fft (complex * z1, int n, int isign)
                     inz,
                     i;
     static int      prime[12] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+    FFTplan        *plan;
 
+    /* isign=1 is the forward (negative exponent) transform here */
+    if ((plan = fftplan_local (n, 0)) != NULL) {
+	fftplan_complex (plan, (float *) z1, -isign, NULL);
+	return;
+    }
     after = 1;
     before = n;
     next = 0;
@@ -0,0 +1,427 @@
+#ifndef _WFSWAP_H_
+#define _WFSWAP_H_
+/*
+	Byte order conversion kernels for waveform and grid i/o.
+
+	These replace the per-element swap loops used by readers and
+	writers of external formats (SAC, SEG-Y, the seispp and gclgrid
+	binary files).  Every kernel works on a whole vector.  The fused
+	forms swap and change type in one pass so external 16 or 32 bit
+	integers and floats can be loaded straight into the float or
+	double arrays a program works with, and host floats and doubles
+	can be written straight to big or little endian output.
+
+	All functions are static inline so using them needs only this
+	include file.  On x86 with gcc or clang AVX2 versions are compiled
+	for every kernel and selected at run time when the processor
+	supports them.  Elsewhere the portable loops are written so the
+	compiler can vectorize them.  Define WF_NO_SIMD to force the
+	portable loops.
+
+	The swap argument of the conversion kernels is nonzero when the
+	external data are in the opposite byte order to this machine.
+	Use wf_swap_needed to compute it from the byte order of the data.
+
+	The in place swaps and the copies between types of the same size
+	(e.g. wf_f4_to_float) allow dest==src.  Widening and narrowing
+	conversions require that dest and src do not overlap.
+*/
+#include <string.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define WF_BSWAP16(x)	__builtin_bswap16(x)
+#define WF_BSWAP32(x)	__builtin_bswap32(x)
+#define WF_BSWAP64(x)	__builtin_bswap64(x)
+#else
+#define WF_BSWAP16(x)	((uint16_t)((((x)&0xffu)<<8)|(((x)>>8)&0xffu)))
+#define WF_BSWAP32(x)	((((x)&0xffu)<<24)|(((x)&0xff00u)<<8) \
+			|(((x)>>8)&0xff00u)|(((x)>>24)&0xffu))
+#define WF_BSWAP64(x)	(((uint64_t)WF_BSWAP32((uint32_t)(x))<<32) \
+			|(uint64_t)WF_BSWAP32((uint32_t)((x)>>32)))
+#endif
+
+#if !defined(WF_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) \
+	&& (defined(__clang__) || (defined(__GNUC__) \
+	&& (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define WF_AVX2_KERNELS
+#include <immintrin.h>
+#define WF_AVX2 __attribute__((target("avx2")))
+#endif
+
+/* Byte order codes for wf_swap_needed */
+#define WF_BIG_ENDIAN		0
+#define WF_LITTLE_ENDIAN	1
+
+/* Returns 1 if this machine is little endian, 0 if big endian. */
+static inline int
+wf_little_endian( void )
+{
+	const uint32_t i = 1;
+	unsigned char c;
+	memcpy( &c, &i, 1 );
+	return( c == 1 );
+}
+
+/* Returns nonzero if data in the given byte order (WF_BIG_ENDIAN or
+WF_LITTLE_ENDIAN) must be swapped on this machine. */
+static inline int
+wf_swap_needed( int order )
+{
+	return( (order == WF_LITTLE_ENDIAN) != wf_little_endian() );
+}
+
+#ifdef WF_AVX2_KERNELS
+/* Decided once per compilation unit; the answer never changes */
+static inline int
+wf_use_avx2( void )
+{
+	static int have = -1;
+	if( have < 0 ) {
+		__builtin_cpu_init();
+		have = __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+	}
+	return( have );
+}
+
+/* Shuffle masks reversing the bytes of every 2, 4, or 8 byte word
+of a 16 byte lane.  size 1 is the identity. */
+WF_AVX2 static inline __m128i
+wf_mask128( int size )
+{
+	switch( size ) {
+	case 2:
+		return _mm_setr_epi8( 1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14 );
+	case 4:
+		return _mm_setr_epi8( 3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12 );
+	case 8:
+		return _mm_setr_epi8( 7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8 );
+	default:
+		return _mm_setr_epi8( 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15 );
+	}
+}
+
+/* Reverse the bytes of each size byte word; returns bytes done */
+WF_AVX2 static inline long
+wf_avx2_swap( unsigned char *d, const unsigned char *s, long nbytes, int size )
+{
+	__m256i mask = _mm256_broadcastsi128_si256( wf_mask128( size ) );
+	long i;
+	for( i = 0; i + 32 <= nbytes; i += 32 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i *)(s + i) );
+		_mm256_storeu_si256( (__m256i *)(d + i), _mm256_shuffle_epi8( v, mask ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_i2_to_float( float *d, const unsigned char *s, long n, int swap )
+{
+	__m128i mask = wf_mask128( swap ? 2 : 1 );
+	long i;
+	for( i = 0; i + 8 <= n; i += 8 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)(s + 2*i) );
+		v = _mm_shuffle_epi8( v, mask );
+		_mm256_storeu_ps( d + i,
+			_mm256_cvtepi32_ps( _mm256_cvtepi16_epi32( v ) ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_i4_to_float( float *d, const unsigned char *s, long n, int swap )
+{
+	__m256i mask = _mm256_broadcastsi128_si256( wf_mask128( swap ? 4 : 1 ) );
+	long i;
+	for( i = 0; i + 8 <= n; i += 8 ) {
+		__m256i v = _mm256_loadu_si256( (const __m256i *)(s + 4*i) );
+		v = _mm256_shuffle_epi8( v, mask );
+		_mm256_storeu_ps( d + i, _mm256_cvtepi32_ps( v ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_i2_to_double( double *d, const unsigned char *s, long n, int swap )
+{
+	__m128i mask = wf_mask128( swap ? 2 : 1 );
+	long i;
+	for( i = 0; i + 4 <= n; i += 4 ) {
+		__m128i v = _mm_loadl_epi64( (const __m128i *)(s + 2*i) );
+		v = _mm_shuffle_epi8( v, mask );
+		_mm256_storeu_pd( d + i,
+			_mm256_cvtepi32_pd( _mm_cvtepi16_epi32( v ) ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_i4_to_double( double *d, const unsigned char *s, long n, int swap )
+{
+	__m128i mask = wf_mask128( swap ? 4 : 1 );
+	long i;
+	for( i = 0; i + 4 <= n; i += 4 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)(s + 4*i) );
+		v = _mm_shuffle_epi8( v, mask );
+		_mm256_storeu_pd( d + i, _mm256_cvtepi32_pd( v ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_f4_to_double( double *d, const unsigned char *s, long n, int swap )
+{
+	__m128i mask = wf_mask128( swap ? 4 : 1 );
+	long i;
+	for( i = 0; i + 4 <= n; i += 4 ) {
+		__m128i v = _mm_loadu_si128( (const __m128i *)(s + 4*i) );
+		v = _mm_shuffle_epi8( v, mask );
+		_mm256_storeu_pd( d + i, _mm256_cvtps_pd( _mm_castsi128_ps( v ) ) );
+	}
+	return( i );
+}
+
+WF_AVX2 static inline long
+wf_avx2_double_to_f4( unsigned char *d, const double *s, long n, int swap )
+{
+	__m128i mask = wf_mask128( swap ? 4 : 1 );
+	long i;
+	for( i = 0; i + 4 <= n; i += 4 ) {
+		__m128 f = _mm256_cvtpd_ps( _mm256_loadu_pd( s + i ) );
+		_mm_storeu_si128( (__m128i *)(d + 4*i),
+			_mm_shuffle_epi8( _mm_castps_si128( f ), mask ) );
+	}
+	return( i );
+}
+#endif
+
+/* Reverse the byte order of n 2, 4, or 8 byte words from src into
+dest.  dest may equal src. */
+static inline void
+wf_swap2_copy( void *dest, const void *src, long n )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	unsigned char *d = (unsigned char *) dest;
+	uint16_t u;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_swap( d, s, 2*n, 2 ) / 2;
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 2*i, 2 );
+		u = WF_BSWAP16( u );
+		memcpy( d + 2*i, &u, 2 );
+	}
+}
+
+static inline void
+wf_swap4_copy( void *dest, const void *src, long n )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	unsigned char *d = (unsigned char *) dest;
+	uint32_t u;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_swap( d, s, 4*n, 4 ) / 4;
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 4*i, 4 );
+		u = WF_BSWAP32( u );
+		memcpy( d + 4*i, &u, 4 );
+	}
+}
+
+static inline void
+wf_swap8_copy( void *dest, const void *src, long n )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	unsigned char *d = (unsigned char *) dest;
+	uint64_t u;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_swap( d, s, 8*n, 8 ) / 8;
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 8*i, 8 );
+		u = WF_BSWAP64( u );
+		memcpy( d + 8*i, &u, 8 );
+	}
+}
+
+/* In place versions */
+static inline void
+wf_swap2( void *x, long n )
+{
+	wf_swap2_copy( x, x, n );
+}
+
+static inline void
+wf_swap4( void *x, long n )
+{
+	wf_swap4_copy( x, x, n );
+}
+
+static inline void
+wf_swap8( void *x, long n )
+{
+	wf_swap8_copy( x, x, n );
+}
+
+/* External 16 bit integers, 32 bit integers, or 32 bit floats to host
+floats */
+static inline void
+wf_i2_to_float( float *dest, const void *src, long n, int swap )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	uint16_t u;
+	int16_t v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_i2_to_float( dest, s, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 2*i, 2 );
+		if( swap ) u = WF_BSWAP16( u );
+		memcpy( &v, &u, 2 );
+		dest[i] = (float) v;
+	}
+}
+
+static inline void
+wf_i4_to_float( float *dest, const void *src, long n, int swap )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	uint32_t u;
+	int32_t v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_i4_to_float( dest, s, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 4*i, 4 );
+		if( swap ) u = WF_BSWAP32( u );
+		memcpy( &v, &u, 4 );
+		dest[i] = (float) v;
+	}
+}
+
+static inline void
+wf_f4_to_float( float *dest, const void *src, long n, int swap )
+{
+	if( swap )
+		wf_swap4_copy( dest, src, n );
+	else if( (const void *) dest != src )
+		memmove( dest, src, 4*(size_t)n );
+}
+
+/* External 16 bit integers, 32 bit integers, 32 bit floats, or 64 bit
+floats to host doubles */
+static inline void
+wf_i2_to_double( double *dest, const void *src, long n, int swap )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	uint16_t u;
+	int16_t v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_i2_to_double( dest, s, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 2*i, 2 );
+		if( swap ) u = WF_BSWAP16( u );
+		memcpy( &v, &u, 2 );
+		dest[i] = (double) v;
+	}
+}
+
+static inline void
+wf_i4_to_double( double *dest, const void *src, long n, int swap )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	uint32_t u;
+	int32_t v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_i4_to_double( dest, s, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 4*i, 4 );
+		if( swap ) u = WF_BSWAP32( u );
+		memcpy( &v, &u, 4 );
+		dest[i] = (double) v;
+	}
+}
+
+static inline void
+wf_f4_to_double( double *dest, const void *src, long n, int swap )
+{
+	const unsigned char *s = (const unsigned char *) src;
+	uint32_t u;
+	float v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_f4_to_double( dest, s, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		memcpy( &u, s + 4*i, 4 );
+		if( swap ) u = WF_BSWAP32( u );
+		memcpy( &v, &u, 4 );
+		dest[i] = (double) v;
+	}
+}
+
+static inline void
+wf_f8_to_double( double *dest, const void *src, long n, int swap )
+{
+	if( swap )
+		wf_swap8_copy( dest, src, n );
+	else if( (const void *) dest != src )
+		memmove( dest, src, 8*(size_t)n );
+}
+
+/* Host floats or doubles to external 32 bit floats, and host doubles
+to external 64 bit floats */
+static inline void
+wf_float_to_f4( void *dest, const float *src, long n, int swap )
+{
+	if( swap )
+		wf_swap4_copy( dest, src, n );
+	else if( dest != (const void *) src )
+		memmove( dest, src, 4*(size_t)n );
+}
+
+static inline void
+wf_double_to_f4( void *dest, const double *src, long n, int swap )
+{
+	unsigned char *d = (unsigned char *) dest;
+	uint32_t u;
+	float v;
+	long i = 0;
+#ifdef WF_AVX2_KERNELS
+	if( wf_use_avx2() ) i = wf_avx2_double_to_f4( d, src, n, swap );
+#endif
+	for( ; i < n; ++i ) {
+		v = (float) src[i];
+		memcpy( &u, &v, 4 );
+		if( swap ) u = WF_BSWAP32( u );
+		memcpy( d + 4*i, &u, 4 );
+	}
+}
+
+static inline void
+wf_double_to_f8( void *dest, const double *src, long n, int swap )
+{
+	if( swap )
+		wf_swap8_copy( dest, src, n );
+	else if( dest != (const void *) src )
+		memmove( dest, src, 8*(size_t)n );
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
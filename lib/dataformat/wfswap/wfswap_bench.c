@@ -0,0 +1,291 @@
+/* Benchmark and check for the wfswap kernels.
+
+Each kernel is run on the same random data as a reference loop that
+reverses one element at a time through a byte array, the way the
+older swap code did.  The results must agree exactly.  Throughput is
+reported in Mbytes per second of input for both.
+
+Usage:  wfswap_bench [-n nsamp -r repeats]
+
+Exits with a nonzero status if any kernel disagrees with the
+reference.
+*/
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "wfswap.h"
+
+static double
+now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec );
+}
+
+/* Reference:  reverse size bytes of one element */
+static void
+ref_reverse( unsigned char *d, const unsigned char *s, int size )
+{
+	int k;
+	for( k = 0; k < size; k++ ) d[k] = s[size-1-k];
+}
+
+static void
+ref_swap( void *dest, const void *src, long n, int size )
+{
+	long i;
+	unsigned char tmp[8];
+	for( i = 0; i < n; i++ ) {
+		ref_reverse( tmp, (const unsigned char *) src + size*i, size );
+		memcpy( (unsigned char *) dest + size*i, tmp, size );
+	}
+}
+
+static void
+ref_i2_to_float( float *d, const void *s, long n, int swap )
+{
+	long i; short v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 2*i, 2 );
+		else memcpy( &v, (const unsigned char *) s + 2*i, 2 );
+		d[i] = (float) v;
+	}
+}
+
+static void
+ref_i4_to_float( float *d, const void *s, long n, int swap )
+{
+	long i; int32_t v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 4*i, 4 );
+		else memcpy( &v, (const unsigned char *) s + 4*i, 4 );
+		d[i] = (float) v;
+	}
+}
+
+static void
+ref_f4_to_float( float *d, const void *s, long n, int swap )
+{
+	long i; float v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 4*i, 4 );
+		else memcpy( &v, (const unsigned char *) s + 4*i, 4 );
+		d[i] = v;
+	}
+}
+
+static void
+ref_i2_to_double( double *d, const void *s, long n, int swap )
+{
+	long i; short v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 2*i, 2 );
+		else memcpy( &v, (const unsigned char *) s + 2*i, 2 );
+		d[i] = (double) v;
+	}
+}
+
+static void
+ref_i4_to_double( double *d, const void *s, long n, int swap )
+{
+	long i; int32_t v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 4*i, 4 );
+		else memcpy( &v, (const unsigned char *) s + 4*i, 4 );
+		d[i] = (double) v;
+	}
+}
+
+static void
+ref_f4_to_double( double *d, const void *s, long n, int swap )
+{
+	long i; float v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 4*i, 4 );
+		else memcpy( &v, (const unsigned char *) s + 4*i, 4 );
+		d[i] = (double) v;
+	}
+}
+
+static void
+ref_f8_to_double( double *d, const void *s, long n, int swap )
+{
+	long i; double v;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) &v, (const unsigned char *) s + 8*i, 8 );
+		else memcpy( &v, (const unsigned char *) s + 8*i, 8 );
+		d[i] = v;
+	}
+}
+
+static void
+ref_float_to_f4( void *d, const float *s, long n, int swap )
+{
+	long i;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) d + 4*i, (const unsigned char *) (s + i), 4 );
+		else memcpy( (unsigned char *) d + 4*i, s + i, 4 );
+	}
+}
+
+static void
+ref_double_to_f4( void *d, const double *s, long n, int swap )
+{
+	long i; float v;
+	for( i = 0; i < n; i++ ) {
+		v = (float) s[i];
+		if( swap ) ref_reverse( (unsigned char *) d + 4*i, (const unsigned char *) &v, 4 );
+		else memcpy( (unsigned char *) d + 4*i, &v, 4 );
+	}
+}
+
+static void
+ref_double_to_f8( void *d, const double *s, long n, int swap )
+{
+	long i;
+	for( i = 0; i < n; i++ ) {
+		if( swap ) ref_reverse( (unsigned char *) d + 8*i, (const unsigned char *) (s + i), 8 );
+		else memcpy( (unsigned char *) d + 8*i, s + i, 8 );
+	}
+}
+
+/* Adapters giving every kernel the same signature */
+typedef void (*Kernel) ( void *dest, const void *src, long n, int swap );
+
+static void k_swap2( void *d, const void *s, long n, int swap ) { wf_swap2_copy( d, s, n ); }
+static void k_swap4( void *d, const void *s, long n, int swap ) { wf_swap4_copy( d, s, n ); }
+static void k_swap8( void *d, const void *s, long n, int swap ) { wf_swap8_copy( d, s, n ); }
+static void r_swap2( void *d, const void *s, long n, int swap ) { ref_swap( d, s, n, 2 ); }
+static void r_swap4( void *d, const void *s, long n, int swap ) { ref_swap( d, s, n, 4 ); }
+static void r_swap8( void *d, const void *s, long n, int swap ) { ref_swap( d, s, n, 8 ); }
+static void k_i2f( void *d, const void *s, long n, int swap ) { wf_i2_to_float( d, s, n, swap ); }
+static void r_i2f( void *d, const void *s, long n, int swap ) { ref_i2_to_float( d, s, n, swap ); }
+static void k_i4f( void *d, const void *s, long n, int swap ) { wf_i4_to_float( d, s, n, swap ); }
+static void r_i4f( void *d, const void *s, long n, int swap ) { ref_i4_to_float( d, s, n, swap ); }
+static void k_f4f( void *d, const void *s, long n, int swap ) { wf_f4_to_float( d, s, n, swap ); }
+static void r_f4f( void *d, const void *s, long n, int swap ) { ref_f4_to_float( d, s, n, swap ); }
+static void k_i2d( void *d, const void *s, long n, int swap ) { wf_i2_to_double( d, s, n, swap ); }
+static void r_i2d( void *d, const void *s, long n, int swap ) { ref_i2_to_double( d, s, n, swap ); }
+static void k_i4d( void *d, const void *s, long n, int swap ) { wf_i4_to_double( d, s, n, swap ); }
+static void r_i4d( void *d, const void *s, long n, int swap ) { ref_i4_to_double( d, s, n, swap ); }
+static void k_f4d( void *d, const void *s, long n, int swap ) { wf_f4_to_double( d, s, n, swap ); }
+static void r_f4d( void *d, const void *s, long n, int swap ) { ref_f4_to_double( d, s, n, swap ); }
+static void k_f8d( void *d, const void *s, long n, int swap ) { wf_f8_to_double( d, s, n, swap ); }
+static void r_f8d( void *d, const void *s, long n, int swap ) { ref_f8_to_double( d, s, n, swap ); }
+static void k_ff4( void *d, const void *s, long n, int swap ) { wf_float_to_f4( d, s, n, swap ); }
+static void r_ff4( void *d, const void *s, long n, int swap ) { ref_float_to_f4( d, s, n, swap ); }
+static void k_df4( void *d, const void *s, long n, int swap ) { wf_double_to_f4( d, s, n, swap ); }
+static void r_df4( void *d, const void *s, long n, int swap ) { ref_double_to_f4( d, s, n, swap ); }
+static void k_df8( void *d, const void *s, long n, int swap ) { wf_double_to_f8( d, s, n, swap ); }
+static void r_df8( void *d, const void *s, long n, int swap ) { ref_double_to_f8( d, s, n, swap ); }
+
+typedef struct Case {
+	char	*name;
+	Kernel	kernel, reference;
+	int	insize, outsize;	/* bytes per element */
+	int	host_input;		/* input must be valid host floats or doubles */
+} Case;
+
+static Case Cases[] = {
+	{ "swap2",		k_swap2, r_swap2, 2, 2, 0 },
+	{ "swap4",		k_swap4, r_swap4, 4, 4, 0 },
+	{ "swap8",		k_swap8, r_swap8, 8, 8, 0 },
+	{ "i2_to_float",	k_i2f,	r_i2f,	2, 4, 0 },
+	{ "i4_to_float",	k_i4f,	r_i4f,	4, 4, 0 },
+	{ "f4_to_float",	k_f4f,	r_f4f,	4, 4, 0 },
+	{ "i2_to_double",	k_i2d,	r_i2d,	2, 8, 0 },
+	{ "i4_to_double",	k_i4d,	r_i4d,	4, 8, 0 },
+	{ "f4_to_double",	k_f4d,	r_f4d,	4, 8, 0 },
+	{ "f8_to_double",	k_f8d,	r_f8d,	8, 8, 0 },
+	{ "float_to_f4",	k_ff4,	r_ff4,	4, 4, 1 },
+	{ "double_to_f4",	k_df4,	r_df4,	8, 4, 1 },
+	{ "double_to_f8",	k_df8,	r_df8,	8, 8, 1 },
+};
+
+static void
+usage( void )
+{
+	fprintf( stderr, "Usage:  wfswap_bench [-n nsamp -r repeats]\n" );
+	exit( 1 );
+}
+
+int
+main( int argc, char **argv )
+{
+	long nsamp = 1000003;	/* odd so the scalar tails are exercised */
+	int repeats = 20;
+	int i, j, r, swap, nbad = 0;
+	unsigned char *in, *out, *refout;
+	double t0, tk, tr;
+
+	for( i = 1; i < argc; i++ ) {
+		if( !strcmp( argv[i], "-n" ) && i+1 < argc ) nsamp = atol( argv[++i] );
+		else if( !strcmp( argv[i], "-r" ) && i+1 < argc ) repeats = atoi( argv[++i] );
+		else usage();
+	}
+	if( nsamp < 1 || repeats < 1 ) usage();
+
+	in = (unsigned char *) malloc( 8*(size_t)nsamp );
+	out = (unsigned char *) malloc( 8*(size_t)nsamp );
+	refout = (unsigned char *) malloc( 8*(size_t)nsamp );
+	if( in == NULL || out == NULL || refout == NULL ) {
+		fprintf( stderr, "wfswap_bench:  cannot alloc buffers for %ld samples\n", nsamp );
+		exit( 1 );
+	}
+	srand( 1 );
+
+#ifdef WF_AVX2_KERNELS
+	printf( "wfswap kernels:  %s\n", wf_use_avx2() ? "avx2" : "portable" );
+#else
+	printf( "wfswap kernels:  portable\n" );
+#endif
+	printf( "%ld samples, %d repeats, host is %s endian\n", nsamp, repeats,
+		wf_little_endian() ? "little" : "big" );
+	printf( "%-14s %5s %12s %12s %8s\n", "kernel", "swap", "MB/s", "ref MB/s", "check" );
+
+	for( i = 0; i < (int)(sizeof(Cases)/sizeof(Case)); i++ ) {
+		Case *c = &Cases[i];
+		/* Random values, kept finite for the cases reading host floats */
+		for( j = 0; j < 8*nsamp; j++ ) in[j] = (unsigned char) (rand() & 0xff);
+		if( c->host_input ) {
+			if( c->insize == 4 ) {
+				float *f = (float *) in;
+				for( j = 0; j < nsamp; j++ ) f[j] = (float) (rand() - RAND_MAX/2) / 1000.0f;
+			} else {
+				double *d = (double *) in;
+				for( j = 0; j < nsamp; j++ ) d[j] = (double) (rand() - RAND_MAX/2) / 1000.0;
+			}
+		}
+		for( swap = 0; swap <= 1; swap++ ) {
+			int ok;
+			c->reference( refout, in, nsamp, swap );
+			c->kernel( out, in, nsamp, swap );
+			ok = !memcmp( out, refout, c->outsize*(size_t)nsamp );
+			if( !ok ) nbad++;
+
+			t0 = now();
+			for( r = 0; r < repeats; r++ ) c->kernel( out, in, nsamp, swap );
+			tk = now() - t0;
+			t0 = now();
+			for( r = 0; r < repeats; r++ ) c->reference( refout, in, nsamp, swap );
+			tr = now() - t0;
+			printf( "%-14s %5d %12.1f %12.1f %8s\n", c->name, swap,
+				1e-6 * c->insize * (double) nsamp * repeats / tk,
+				1e-6 * c->insize * (double) nsamp * repeats / tr,
+				ok ? "ok" : "FAILED" );
+			/* the plain swaps ignore the swap argument */
+			if( c->kernel == k_swap2 || c->kernel == k_swap4
+				|| c->kernel == k_swap8 ) break;
+		}
+	}
+	free( in );
+	free( out );
+	free( refout );
+	if( nbad ) {
+		fprintf( stderr, "wfswap_bench:  %d kernels disagree with the reference\n", nbad );
+		return( 1 );
+	}
+	return( 0 );
+}
@@ -15,6 +15,7 @@ type of the "hook" defined by different calculators.  This hopefully
 fixes this.  
 */
 #include <strings.h>
+#include <pthread.h>
 #include "stock.h"
 #include "arrays.h"
 #include "tt.h"
@@ -35,6 +36,9 @@ Pf object defining these relationships, and phase is the phase name
 we use to key these Arr. 
 */
 static Arr *TTmethod,*TTmodel,*TThooks;
+/* The tt(3) hooks hold calculator state and are created on first use,
+so the exec routines below are serialized when called from threads */
+static pthread_mutex_t ttcalc_lock=PTHREAD_MUTEX_INITIALIZER;
 int ttcalc_interface_init(char *phase, Pf *pf)
 {
 	char *model;
@@ -67,7 +71,7 @@ int ttcalc_interface_init(char *phase, Pf *pf)
 
 	return(0);
 }
-Travel_Time_Function_Output  ttcalc_interface_exec(Ray_Endpoints x, char *phase, int mode)
+static Travel_Time_Function_Output ttcalc_interface_time(Ray_Endpoints x, char *phase, int mode)
 {
 	TTGeometry geometry;
 	Tbl *t=NULL;
@@ -208,7 +212,7 @@ Travel_Time_Function_Output  ttcalc_interface_exec(Ray_Endpoints x, char *phase,
 	if(t != NULL) freetbl(t,0);
 	return(o);
 }
-Slowness_Function_Output ttcalc_interface_slow_exec(Ray_Endpoints x, char *phase, int mode)
+static Slowness_Function_Output ttcalc_interface_slow(Ray_Endpoints x, char *phase, int mode)
 {
 	TTGeometry geometry;
 	Tbl *u=NULL;
@@ -281,6 +285,24 @@ Slowness_Function_Output ttcalc_interface_slow_exec(Ray_Endpoints x, char *phase
 	if(u != NULL) freetbl(u,0);
 	return(o);
 }
+Travel_Time_Function_Output  ttcalc_interface_exec(Ray_Endpoints x, char *phase, int mode)
+{
+	Travel_Time_Function_Output o;
+
+	pthread_mutex_lock(&ttcalc_lock);
+	o = ttcalc_interface_time(x,phase,mode);
+	pthread_mutex_unlock(&ttcalc_lock);
+	return(o);
+}
+Slowness_Function_Output ttcalc_interface_slow_exec(Ray_Endpoints x, char *phase, int mode)
+{
+	Slowness_Function_Output o;
+
+	pthread_mutex_lock(&ttcalc_lock);
+	o = ttcalc_interface_slow(x,phase,mode);
+	pthread_mutex_unlock(&ttcalc_lock);
+	return(o);
+}
 	
 
 
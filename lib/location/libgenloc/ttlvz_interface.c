@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "stock.h"
 #include "arrays.h"
 #include "coords.h"
@@ -55,6 +56,10 @@ typedef struct Vmodel{
 } Vmodel;
 static Arr *ttlvz_models=NULL;  /* contains pointers to Vmodel structures for
 			each phase */
+/* ttlvz_ is f2c output that keeps its locals in static storage and the
+exec routines below temporarily alter the model to handle elevations,
+so calls from different threads (e.g. dbpmel) are serialized with this */
+static pthread_mutex_t ttlvz_lock=PTHREAD_MUTEX_INITIALIZER;
 
 /* This function is called in ttlvz_init to parse the contents of the Pf
 object containing the velocity model.  Both models are specified the same
@@ -153,7 +158,7 @@ mode - how much to calculate flag.  If "ALL" (defined in location.h), we
 calculate partial derivatives as well as the travel time.  Otherwise, only
 the travel time is calculated */
 
-Travel_Time_Function_Output ttlvz_time_exec(Ray_Endpoints x, 
+static Travel_Time_Function_Output ttlvz_time(Ray_Endpoints x, 
 		char *phase, int mode)
 {
 	double delta, d_km;  /* epicentral distance in radians and km resp.*/
@@ -295,7 +300,7 @@ when computing derivatives of u wrt z.  Always produced a infinitity.
 /* constant for dz numerical derivative*/
 #define DZ_STEP_SIZE 1.0  /* depth step in km */
 
-Slowness_Function_Output ttlvz_slow_exec (Ray_Endpoints x, 
+static Slowness_Function_Output ttlvz_slow (Ray_Endpoints x, 
 		char *phase, int mode)
 {
 	double delta, d_km;  /* epicentral distance in radians and km resp.*/
@@ -590,6 +595,26 @@ Slowness_Function_Output ttlvz_slow_exec (Ray_Endpoints x,
 	free(work2);
 	return(o);
 }
+Travel_Time_Function_Output ttlvz_time_exec(Ray_Endpoints x, 
+		char *phase, int mode)
+{
+	Travel_Time_Function_Output o;
+
+	pthread_mutex_lock(&ttlvz_lock);
+	o = ttlvz_time(x,phase,mode);
+	pthread_mutex_unlock(&ttlvz_lock);
+	return(o);
+}
+Slowness_Function_Output ttlvz_slow_exec (Ray_Endpoints x, 
+		char *phase, int mode)
+{
+	Slowness_Function_Output o;
+
+	pthread_mutex_lock(&ttlvz_lock);
+	o = ttlvz_slow(x,phase,mode);
+	pthread_mutex_unlock(&ttlvz_lock);
+	return(o);
+}
 /* This is the cleanup procedure that needs to be called if the
 model or travel time calculation method is changed */
 void free_Vmodel(void *p)
@@ -75,3 +75,59 @@ Check phases_to_keep parameter setting\n");
 	freetbl(akeys,0);
 }
 
+static void *dup_double(void *p)
+{
+	double *d;
+	allot(double *,d,1);
+	*d = *((double *)p);
+	return(d);
+}
+/* Makes a copy of an array of phase handles that can be handed to
+pmel for one cluster while other clusters are processed at the same
+time.  The station correction arrays, which pmel alters, are copied.
+The weight functions and travel time calculators are shared with the
+original so the copy must be freed with free_phase_handle_copy and
+the original must outlive it.
+*/
+Arr *dup_phase_handles(Arr *a)
+{
+	Arr *aout;
+	Tbl *keys;
+	char *phase;
+	Phase_handle *p,*pcopy;
+	int i;
+
+	aout = newarr(0);
+	keys = keysarr(a);
+	for(i=0;i<maxtbl(keys);++i)
+	{
+		phase = gettbl(keys,i);
+		p = (Phase_handle *)getarr(a,phase);
+		allot(Phase_handle *,pcopy,1);
+		*pcopy = *p;
+		pcopy->name = strdup(p->name);
+		if(p->time_station_corrections!=NULL)
+			pcopy->time_station_corrections 
+			  = duparr(p->time_station_corrections,dup_double);
+		if(p->ux_sc!=NULL) 
+			pcopy->ux_sc = duparr(p->ux_sc,dup_double);
+		if(p->uy_sc!=NULL) 
+			pcopy->uy_sc = duparr(p->uy_sc,dup_double);
+		setarr(aout,phase,pcopy);
+	}
+	freetbl(keys,0);
+	return(aout);
+}
+/* Free routine for handles created by dup_phase_handles.  Use as
+freearr(a,free_phase_handle_copy) */
+void free_phase_handle_copy(void *value)
+{
+	Phase_handle *p;
+	p = (Phase_handle *)value;
+	if(p->time_station_corrections!=NULL)
+		freearr(p->time_station_corrections,free);
+	if(p->ux_sc!=NULL) freearr(p->ux_sc,free);
+	if(p->uy_sc!=NULL) freearr(p->uy_sc,free);
+	free(p->name);
+	free(p);
+}
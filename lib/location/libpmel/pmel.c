@@ -1,5 +1,7 @@
+#include <stdio.h>
 #include <math.h>
 #include <strings.h>
+#include <pthread.h>
 #include "stock.h"
 #include "arrays.h"
 #include "elog.h"
@@ -8,65 +10,157 @@
 #include "perf.h"
 #include "pmel.h"
 #define SSWR_TEST_LEVEL 0.30
-/* This routine takes advantage of the sparse form of the S matrix 
-that forms what is used to form the matrix SN (see PMEL paper).  That
-is, S is a scrambled diagonal matrix.  Because of this fact it is much
-smarter to form the product SN = UTn*S using the form below that
-uses a simple dscal and dcopy algorithm.  
+/* The BLAS and LAPACK routines in libperf are f2c output that keep
+their local variables in static storage.  When clusters are processed
+by several threads (see pmel_cluster.c) every call into libperf has to
+be made while holding this lock.  pmel takes it once per iteration
+for all of its linear algebra and around each ggnloc call (ggnloc
+uses svdcmp).  Callers running beside pmel that use libperf (e.g.
+predicted_errors and project_covariance) must take it too. */
+static pthread_mutex_t pmel_perf_mutex=PTHREAD_MUTEX_INITIALIZER;
+void pmel_perf_lock()
+{
+	pthread_mutex_lock(&pmel_perf_mutex);
+}
+void pmel_perf_unlock()
+{
+	pthread_mutex_unlock(&pmel_perf_mutex);
+}
+/* pmel writes a table of its convergence history.  By default this
+goes to stdout, but a thread can redirect it with pmel_set_output
+so the tables of clusters processed in parallel are not interleaved.*/
+static pthread_once_t pmel_output_once=PTHREAD_ONCE_INIT;
+static pthread_key_t pmel_output_key;
+static void pmel_output_key_create()
+{
+	pthread_key_create(&pmel_output_key,NULL);
+}
+void pmel_set_output(FILE *fp)
+{
+	pthread_once(&pmel_output_once,pmel_output_key_create);
+	pthread_setspecific(pmel_output_key,fp);
+}
+static FILE *pmel_output()
+{
+	FILE *fp;
+	pthread_once(&pmel_output_once,pmel_output_key_create);
+	fp = (FILE *)pthread_getspecific(pmel_output_key);
+	if(fp==NULL) fp=stdout;
+	return(fp);
+}
+/* This routine forms the rows of the matrix SN = UTn*S (see PMEL
+paper) and the annulled data UTn*r for one event.  Un can be any
+orthonormal basis for the complement of the range of the equations
+of condition A.  Rather than forming the full m by m matrix of left
+singular vectors of A (an svd costing order m**3) we compute the
+Householder QR factorization of A and apply its (at most 4) reflectors
+to the block [W | r], where W is the diagonal matrix of weights.
+Rows ncol to m-1 of the result are UTn*W and UTn*r.  A different basis
+only rotates the rows of SN for this event, which leaves the singular
+values and right singular vectors of S, and hence the solution,
+unchanged.  S is a scrambled diagonal matrix, so column i of UTn*W is
+added to the column of sn for the station:phase of row i.
 
 Arguments:
-	m - data space dimension (rows and columns in U)
-	Un - null space collection of m vectors computed from original
-		equations of condition for current location.  Assume
-		these are stored in the columns of Un in fortran order.
-	n1u - leading dimension of U (fortran thing)
-	nnull - number of null vectors = number of columns in Un
-	sn - matrix to hold the product U_N^T * S (FORTRAN storage).  These
-		will be written to m-ncn rows below this index point.  This
-		may be the first element of a matrix, but it doesn't have
-		to be.  In this program it is dynamic and moves to 
-		progressively higher row numbers as data is accumulated.
+	m - data space dimension (rows of A)
+	ncol - number of free hypocenter coordinates (columns of A).
+		0 means all coordinates are fixed and UTn is the identity.
+	A - equations of condition stored in fortran order with
+		leading dimension m.  Destroyed.
+	r - m vector of residuals
+	w - m vector of weights for each row of original equations.  
+	column_index - This is a vector of integers of length m that 
+		gives the S column for each row.  
+	active - maps S columns to columns of sn (see pmel_columns)
+	C - work space of at least m*(m+1) doubles
+	sn - matrix to hold UTn*S (FORTRAN storage).  The m-ncol rows
+		are added at this point, so the caller must clear it.
 	n1sn - leading dimension of sn (Fortran form)
-	column_index - This is a vector of integers of length m that gives
-		the column index position for each input row of U.  The
-		algorithm works by using this index to copy and scale rows
-		of U (columns of U^T) into the correct column of sn.
-	w - m vector of weights for each row of original equations.  These
-		are the diagonal components of S that scale the vectors
-		copied to sn.
+	rhs - receives the m-ncol annulled data
 
 Return codes:
 	0 - normal return, no problems flagged
-	-1 - failure in svd routine makes station correction estimation
-		impossible, ignore results.    
+	nonzero - info from LAPACK.  sn and rhs are not altered.
 
-Author:  GAry Pavlis
-Written:  October 2000
+Must be called with the libperf lock held.
 */
-void accumulate_sn_matrix(int m, double *U, int n1u, int nnull,
-		double *sn, int n1sn, int *column_index, double *w)
+static int project_event(int m, int ncol, double *A, double *r,
+	double *w, int *column_index, int *active, double *C,
+	double *sn, int n1sn, double *rhs)
 {
-	int i, ic;
-	double *snvector;
+	integer mm,nn,kk,lwork,info=0;
+	double tau[4];
+	double *work;
+	int i,ic,nnull;
 
+	nnull = m - ncol;
+	for(i=0;i<m*(m+1);++i) C[i]=0.0;
 	for(i=0;i<m;++i)
 	{
 	    /* 0 weights and a negative column index are both
-	    methods used by earlier routines to flag problem data.
-	    Note this assumes sn was cleared to 0s before running this
-	    or there may be garbage left in skipped data columns */
-	    if( (w[i]>0.0) && (column_index[i]>=0) )
-	    {
-		ic = column_index[i];
-		snvector = sn + ic*n1sn;
-		dcopy(nnull,U+i,n1u,snvector,1);
-		dscal(nnull,w[i],snvector,1);
-	    }
+	    methods used by earlier routines to flag problem data.*/
+		if( (w[i]>0.0) && (column_index[i]>=0) )
+			C[i+m*i] = w[i];
+		C[i+m*m] = r[i];
+	}
+	if(ncol>0)
+	{
+		mm = m;
+		nn = ncol;
+		lwork = 64*(m+1);
+		allot(double *,work,lwork);
+		dgeqrf_(&mm,&nn,A,&mm,tau,work,&lwork,&info);
+		if(info==0)
+		{
+			nn = m+1;
+			kk = ncol;
+			dormqr_("L","T",&mm,&nn,&kk,A,&mm,tau,C,&mm,
+				work,&lwork,&info);
+		}
+		free(work);
+		if(info) return(info);
+	}
+	for(i=0;i<m;++i)
+	{
+		if( (w[i]>0.0) && (column_index[i]>=0) )
+		{
+			ic = active[column_index[i]];
+			daxpy(nnull,1.0,C+ncol+m*i,1,sn+ic*n1sn,1);
+		}
+	}
+	dcopy(nnull,C+ncol+m*m,1,rhs,1);
+	return(0);
+}
+/* Only the S columns for station:phase pairs that appear in the data
+of a cluster can be nonzero.  With a network sized column space most
+of S is zero for any one cluster, so pmel solves in the space of the
+active columns only.  This builds the map both ways.  active[i] is
+the compacted index of S column i or -1 if no datum uses it.  columns
+is the inverse map.  Returns the number of active columns.
+*/
+static int pmel_columns(int nevents, int *m, int **cindex, int ncol,
+	int *active, int *columns)
+{
+	int i,j,nactive;
+
+	for(i=0;i<ncol;++i) active[i]=-1;
+	for(i=0;i<nevents;++i)
+		for(j=0;j<m[i];++j)
+			if(cindex[i][j]>=0) active[cindex[i][j]]=0;
+	for(i=0,nactive=0;i<ncol;++i)
+	{
+		if(active[i]>=0)
+		{
+			active[i] = nactive;
+			columns[nactive] = i;
+			++nactive;
+		}
 	}
+	return(nactive);
 }
 			
 /* This small function actually forms the column index vector used
-in the algorithm immediately above.  
+by project_event above.  
 
 Arguments:
 	smatrix - SCMatrix structure pointer holding sc matrix work
@@ -85,10 +179,8 @@ void form_column_indices(SCMatrix *sc, Tbl *ta, int *cindex)
 	Arrival *a;
 	int i;
 	int *iphase,*ista;
-	/* This assumes cindex has been alloced to be of this size.
-	We have to clear it to 0 initially */
-	for(i=0;i<(sc->ncol);++i) cindex[i]=0;
-
+	/* This assumes cindex has been alloced with at least
+	maxtbl(ta) elements.  Every one of them is set below. */
 	for(i=0;i<maxtbl(ta);++i)
 	{
 		a = (Arrival *)gettbl(ta,i);
@@ -169,6 +261,234 @@ int hypo_is_bad(Hypocenter *h)
 	
 
 
+/* Work space for one call to pmel.  The equations of condition for
+each event are saved here as events are relocated and all of them
+are projected into S in one pass at the end of each iteration.  That
+keeps all the linear algebra of an iteration inside one hold of the
+libperf lock while the relocations, which dominate the cost, run
+unlocked.  */
+typedef struct Pmel_work {
+	int nevents;
+	int *m;  /* number of arrivals for each event */
+	int *ncol;  /* free coordinates for each event this pass */
+	int *used;  /* true when event data are to be used this pass */
+	double **A;  /* equations of condition (FORTRAN, leading dim m) */
+	double **r;  /* residuals */
+	double **w;  /* total weights (w*reswt of form_equations) */
+	int **cindex;  /* S column of each row */
+	int maxm;  /* largest m */
+	int *active, *columns;  /* see pmel_columns */
+	int nactive;
+	double *C;  /* project_event work space */
+	double *U;  /* svd placeholder, never referenced */
+	double *Vt, *svalue;  /* svd of compacted S */
+	double *scrhs;  /* annulled data */
+	double *bwork;
+	double *sc_solved;  /* perturbation in full column space */
+	double *xa, *xp;  /* vectors in the active column space */
+	/* form_equations output */
+	float **Amatrix, *b, *res, *wt, *reswt;
+} Pmel_work;
+
+static void free_pmel_work(Pmel_work *pw)
+{
+	int i;
+	for(i=0;i<pw->nevents;++i)
+	{
+		free(pw->A[i]);
+		free(pw->r[i]);
+		free(pw->w[i]);
+		free(pw->cindex[i]);
+	}
+	free(pw->m);
+	free(pw->ncol);
+	free(pw->used);
+	free(pw->A);
+	free(pw->r);
+	free(pw->w);
+	free(pw->cindex);
+	free(pw->active);
+	free(pw->columns);
+	free(pw->C);
+	free(pw->U);
+	free(pw->Vt);
+	free(pw->svalue);
+	free(pw->scrhs);
+	free(pw->bwork);
+	free(pw->sc_solved);
+	free(pw->xa);
+	free(pw->xp);
+	free(pw->b);
+	free(pw->res);
+	free(pw->wt);
+	free(pw->reswt);
+	free_matrix((char **)pw->Amatrix,0,pw->maxm-1,0);
+	free(pw);
+}
+static Pmel_work *create_pmel_work(int nevents, Tbl **ta, SCMatrix *s)
+{
+	Pmel_work *pw;
+	int i,m,na;
+
+	allot(Pmel_work *,pw,1);
+	pw->nevents = nevents;
+	allot(int *,pw->m,nevents);
+	allot(int *,pw->ncol,nevents);
+	allot(int *,pw->used,nevents);
+	allot(double **,pw->A,nevents);
+	allot(double **,pw->r,nevents);
+	allot(double **,pw->w,nevents);
+	allot(int **,pw->cindex,nevents);
+	for(i=0,pw->maxm=1;i<nevents;++i)
+	{
+		m = maxtbl(ta[i]);
+		pw->m[i] = m;
+		pw->used[i] = 0;
+		if(m>pw->maxm) pw->maxm = m;
+		/* the +1 keeps these legal for an event with no data */
+		allot(double *,pw->A[i],4*m+1);
+		allot(double *,pw->r[i],m+1);
+		allot(double *,pw->w[i],m+1);
+		allot(int *,pw->cindex[i],m+1);
+		form_column_indices(s,ta[i],pw->cindex[i]);
+	}
+	allot(int *,pw->active,s->ncol);
+	allot(int *,pw->columns,s->ncol);
+	pw->nactive = pmel_columns(nevents,pw->m,pw->cindex,s->ncol,
+				pw->active,pw->columns);
+	na = pw->nactive > 0 ? pw->nactive : 1;
+	/* S is only needed for the active columns */
+	reallot(double *,s->S,(s->nrow)*na);
+	allot(double *,pw->C,(pw->maxm)*(pw->maxm+1));
+	allot(double *,pw->U,1);
+	allot(double *,pw->Vt,na*na);
+	allot(double *,pw->svalue,na);
+	allot(double *,pw->scrhs,s->nrow);
+	allot(double *,pw->bwork,s->nrow);
+	allot(double *,pw->sc_solved,s->ncol);
+	allot(double *,pw->xa,na);
+	allot(double *,pw->xp,na);
+	/* I hate this mixed double and float, but at this point I 
+	don't want to create the havoc it would cause to make everything
+	double */
+	allot(float *,pw->b,pw->maxm);
+	allot(float *,pw->res,pw->maxm);
+	allot(float *,pw->wt,pw->maxm);
+	allot(float *,pw->reswt,pw->maxm);
+	pw->Amatrix = matrix(0,pw->maxm-1,0,3);
+	return(pw);
+}
+/* Computes S_N for every event used in this pass, solves for the
+station correction adjustments with an svd of S compacted to its
+active columns, and applies the bias/data projectors to s->sc.  Must
+be called with the libperf lock held.
+
+Returns the number of singular values used or -1 on failure.  The
+number of rows of S is returned in nrows_S, the perturbation is left
+in pw->sc_solved, the relative size of the adjustment in ds_over_s,
+and the norm of the residual after the adjustment in rhsnrm.
+*/
+static int pmel_solve_sc(Pmel_work *pw, SCMatrix *s, double rsvc,
+	int *nrows_S, double *ds_over_s, double *rhsnrm)
+{
+	int i,k,nnull,nused,svdinfo;
+	int nr=s->nrow, nc=s->ncol, na=pw->nactive;
+
+	for(k=0;k<nr*na;++k) s->S[k]=0.0;
+	*nrows_S = 0;
+	for(i=0;i<pw->nevents;++i)
+	{
+		if(!pw->used[i]) continue;
+		nnull = pw->m[i] - pw->ncol[i];
+		if(nnull<=0) continue;
+		svdinfo = project_event(pw->m[i],pw->ncol[i],pw->A[i],
+			pw->r[i],pw->w[i],pw->cindex[i],pw->active,pw->C,
+			(s->S)+(*nrows_S),nr,(pw->scrhs)+(*nrows_S));
+		if(svdinfo)
+		{
+			elog_notify(0,"pmel:  QR factorization error processing event number %d (info=%d)\nEvent not used for station corrections\n",
+				i,svdinfo);
+			continue;
+		}
+		*nrows_S += nnull;
+	}
+	if(*nrows_S<=0)
+	{
+		elog_notify(0,"pmel:  Insufficient data to compute\
+station corrections\n");
+		return(-1);
+	}
+	/* Now we solve for station correction adjustments that 
+	are determinate from the available data. U is not actually
+	hit because we use the 'o' flag, but Vt is set*/
+	dgesvd('o','a',*nrows_S,na,s->S,nr,pw->svalue,pw->U,1,
+		pw->Vt,na,&svdinfo);
+	if(svdinfo) 
+	{
+	        elog_complain(0,"pmel:  svd error inverting station correction matrix\n");
+	        svd_error(svdinfo);
+	        return(-1);
+	}
+	/* This is a pseudoinverse solver. It returns the number of
+	singular values used for the solution which we used below to
+	do subspace projections */
+	nused = dpinv_solver(*nrows_S,na,s->S,nr,pw->svalue,pw->Vt,na,
+		pw->scrhs,pw->xa,rsvc);
+	for(k=0;k<nc;++k) pw->sc_solved[k]=0.0;
+	for(k=0;k<na;++k) pw->sc_solved[pw->columns[k]] = pw->xa[k];
+
+	/* Now we apply the projectors.  We first add the current solution
+	as a perturbation factor to the current total station correction
+	vector and then project it onto range defined by svd of the S
+	matrix.  This may not be necessary for teleseismic events, but
+	can be significant if large changes happen in initial steps
+	that distort the matrices used to construct S.  Columns
+	no datum touches lie in the null space, so there scdata is 0 
+	and scbias is scref.  */
+	daxpy(nc,1.0,pw->sc_solved,1,s->sc,1);
+	for(k=0;k<nc;++k)
+	{
+		s->scdata[k] = 0.0;
+		s->scbias[k] = s->scref[k];
+	}
+	for(k=0;k<na;++k) pw->xa[k] = s->sc[pw->columns[k]];
+	if(nused<na)
+	{
+		if(model_space_range_project(pw->Vt,na,nused,na,
+				pw->xa,pw->xp))
+			elog_complain(0,"sc matrix size error\n");
+	}
+	else
+		dcopy(na,pw->xa,1,pw->xp,1);
+	for(k=0;k<na;++k) s->scdata[pw->columns[k]] = pw->xp[k];
+	for(k=0;k<na;++k) pw->xa[k] = s->scref[pw->columns[k]];
+	if(nused<na)
+	{
+		if(model_space_null_project(pw->Vt,na,nused,na,
+				pw->xa,pw->xp))
+			elog_complain(0,"sc matrix size error\n");
+	}
+	else
+		for(k=0;k<na;++k) pw->xp[k] = 0.0;
+	for(k=0;k<na;++k) s->scbias[pw->columns[k]] = pw->xp[k];
+	dcopy(nc,s->scdata,1,s->sc,1);
+	for(k=0;k<nc;++k)s->sc[k] += s->scbias[k];
+
+	/* Test for small correction vector relative to norm s.
+	It is intentional to divide by scdata as adjustments
+	only happen in the subspace covered by scdata. If we used the
+	full vector s->sc it can be artificially large */
+	*ds_over_s = dnrm2(nc,pw->sc_solved,1)/dnrm2(nc,s->scdata,1);
+
+	/* a second measure of rms*/
+	if(data_space_null_project(s->S,nr,nused,*nrows_S,pw->scrhs,pw->bwork))
+		elog_complain(0,"Problems in data_space_null_project\n");
+	*rhsnrm = dnrm2(*nrows_S,pw->bwork,1);
+	return(nused);
+}
+	
+
+
 /* 
 
 Arguments:
@@ -196,7 +516,10 @@ Arguments:
         and associated indexing and size parameters (see definition
         in location.h)  It also is the primary input and output
 	workspace.  The sc vector within s is the primary output
-	along with the rms parameters also stored there.
+	along with the rms parameters also stored there.  s->nrow
+	must be at least the total number of arrivals in ta.  S is 
+	resized here to s->nrow rows by the number of station:phase
+	pairs found in ta;  other columns of S are always zero.
     phase_arr - associative array of phase handles.   The station
 	correction field of these objects are altered by pmel.
     pf - parameter file pointer (used to parse options for 
@@ -231,25 +554,19 @@ int pmel(int nevents,
     Tbl *tu;
     char *fix;
     int locrcode;
-    double *A;  /* FORTRAN order matrix of equation of condition */
-    double *U,*svalue,*Vt;  /* Used to store full SVD */
-    double *wts;  /* used here as product of w and reswt */
-    double *residuals;  /* working vector of residuals */
-    int *cindex;  /* working vector of column index positions.
-	That is, these hold column index for sta:phase for each row of A*/
-
-    int nr,nc;  /* Copies of s->nrow and s->ncol used for clarity*/
+    Pmel_work *pw;
+    FILE *out;
+
+    int nr;  /* Copy of s->nrow used for clarity*/
     /* These keep track of counts of data and events used in solution*/
     int nev_used, ndata_used, total_ndgf,total_ndgf2,sc_iterations=0;
     int sc_adjustments=0,sc_adjusted_last_pass;
     int hypo_iterations;
-    int nrows_S, nnull;  /* nrows_S is an index to the current high water
-			mark as S is filled */
+    int nrows_S;  /* number of rows of S formed on this pass */
 
     /* These are total residual figures */
     double total_rms_raw,total_ssq_raw, total_wssq,total_wssq2;
     double rhsnrm;
-    double *bwork;
     double sswrodgf,sswrodgf2;
     /* ggnloc output lists */
     Tbl *history=NULL, *reasons=NULL, *restbl=NULL;
@@ -267,11 +584,7 @@ int pmel(int nevents,
     /* Related to form_equations */
     Robust_statistics stats;
     float **Amatrix, *b, *r, *w, *reswt;
-    int nused,svdinfo;
-    /* hold residuals for station correction inversion */
-    double *scrhs;
-    /* holds station correction perturbation solved for in each interation */
-    double *sc_solved;
+    int nused;
     double ds_over_s,ds_over_s_converge;
     Hypocenter *hypocen_history;
     double centroid_lat, centroid_lon, centroid_z;
@@ -283,31 +596,21 @@ int pmel(int nevents,
     *sc_converge_reasons=newtbl(0);
 
     nr = s->nrow;
-    nc = s->ncol;
-    /* 
-    The +4 is a fudge factor to fix an apparent bug in sunperf's
-    C interface to dgesvd that generates rua errors in access checking
-    */
-    allot(double *,A,4*nc+4);
-    allot(double *,U,nc*nc);
-    /* Vt and svalue are used as work space in inversion of S matrix 
-    as well as accumulation phase for individual events */
-    allot(double *,Vt,nc*nc+2);
-    allot(double *,svalue,nc);
-    allot(double *,wts,nc);
-    allot(double *,residuals,nc);
-    allot(int *,cindex,nc);
-    allot(double *,scrhs,nr);
-    allot(double *,bwork,nr);
-    allot(double *,sc_solved,nc);
-    /* I hate this mixed double and float, but at this point I 
-    don't want to create the havoc it would cause to make everything
-    double */
-    allot(float *,b,nc);
-    allot(float *,r,nc);
-    allot(float *,w,nc);
-    allot(float *,reswt,nc);
-    Amatrix = matrix(0,nc-1,0,3);
+    out = pmel_output();
+    pw = create_pmel_work(nevents,ta,s);
+    if(pw->nactive<=0)
+    {
+	elog_notify(0,"pmel:  no data index any station correction\n");
+	pushtbl(*sc_converge_reasons,
+		strdup("ABORT on insufficient data"));
+	free_pmel_work(pw);
+	return(-1);
+    }
+    Amatrix = pw->Amatrix;
+    b = pw->b;
+    r = pw->res;
+    w = pw->wt;
+    reswt = pw->reswt;
 
     /* We now extract parameters from pf specific to pmel */
     esmin = pfget_double(pf,"pmel_minimum_error_scale");
@@ -337,7 +640,7 @@ int pmel(int nevents,
     for(i=0;i<nevents;++i) h0[i].used = 1;
 
     /* Top of processing loop for this group */
-    fprintf(stdout,"Iteration Raw_rms Escale  sswrodgf sswrodgf2 ndgf  ndgf2\
+    fprintf(out,"Iteration Raw_rms Escale  sswrodgf sswrodgf2 ndgf  ndgf2\
 Nevents Nevents_used\n");
     sc_iterations = 0;
     sc_adjusted_last_pass=0;
@@ -345,13 +648,13 @@ Nevents Nevents_used\n");
         Hypocenter *current_hypo;
         double current_wssq;
 	int nrow_amatrix,ncol_amatrix;
+	double *wts,*residuals,*A;
 	/* top of loop initializations */
 	adjust_sc_ok = 1;
         nev_used = 0;
         ndata_used = 0;
         total_ndgf = 0;
-	nrows_S = 0;
-	for(k=0;k<((s->nrow)*(s->ncol));++k) s->S[k]=0.0;
+	for(i=0;i<nevents;++i) pw->used[i]=0;
 
 	/* main loop over events */
         for(i=0,total_ssq_raw=0.0,total_wssq=0.0,centroid_lat=0.0,
@@ -387,8 +690,10 @@ Nevents Nevents_used\n");
 			--ncol_amatrix;
 		}
 	    }
+	    pmel_perf_lock();
             locrcode=ggnloc(h0[i],ta[i],tu,*o,
                 &history,&reasons,&restbl);
+	    pmel_perf_unlock();
 	    /* maintenance note in the segment below:  watch out for distinction
 	    between h0[i] (starting hypo) and current_hypo (one returned by ggnloc).
 	    Eventually h0 has to be replaced by current_hypo, but because of the 
@@ -481,9 +786,12 @@ Nevents Nevents_used\n");
                     total_wssq += current_wssq;
 		    ++nev_used;
 
-                    /* Now we turn to the station correction
-                    accumulation*/
-		    nrow_amatrix = maxtbl(ta[i]);
+                    /* Now we save the equations needed for the
+		    station correction accumulation*/
+		    nrow_amatrix = pw->m[i];
+		    wts = pw->w[i];
+		    residuals = pw->r[i];
+		    A = pw->A[i];
 		    stats = form_equations(ALL,*current_hypo,ta[i],tu,*o,
 				Amatrix,b,r,w,reswt,&nused);
 		    for(j=0;j<nrow_amatrix;++j)
@@ -491,9 +799,7 @@ Nevents Nevents_used\n");
 		        wts[j] = ((double)w[j])*((double)reswt[j]);
 		        residuals[j] = (double)b[j];
 		    }
-		    if(ncol_amatrix>0)
-		    {
-		    if(cluster_mode)
+		    if(ncol_amatrix>0 && cluster_mode)
 		    {
 		    /* The hypocentroid has no time field.  We set it
 			to the current_hypo value to keep from having
@@ -512,49 +818,13 @@ Nevents Nevents_used\n");
 				          *= ((float)wts[j])/(w[j]*reswt[j]);
 		    }
 		    /* C matrix form to FORTRAN matrix conversion required to
-		    interface with LAPACK svd routine.  Note we use nc as
-		    equivalent to the leading dimension of a FORTRAN array.
-		    Symbol is confusing because this is actually rows of
-		    a matrix in fortran form.*/
+		    interface with LAPACK.  The leading dimension is the 
+		    number of data for this event.*/
 		    for(j=0;j<nrow_amatrix;++j)
 		        for(k=0;k<ncol_amatrix;++k)
-			        A[j+nc*k] = (double)(Amatrix[j][k]);
-
-		    /* Compute the svd of this matrix.  All we need here 
-		    is the left singular vectors spanning the data space */
-		    dgesvd('a','n',nrow_amatrix,ncol_amatrix,A,
-			    nc, svalue, U, nc, Vt, nc, &svdinfo);
-  		    if(svdinfo) 
-		    {
-		        elog_notify(0,"pmel:  svd error processing event number %d\n",i);
-		        svd_error(svdinfo);
-		    }
-		    /* Compute S_N as U_N^T*S.  WARNING:  this assumes
-		    blindly that smatrix->S was allocated big enough
-		    to hold all of S as we accumulate it here. */
-		    nnull = nrow_amatrix-ncol_amatrix;
-    		    form_column_indices(s,ta[i],cindex);
-		    accumulate_sn_matrix(nrow_amatrix,U+nc*ncol_amatrix,
-			    nc,nnull,(s->S)+nrows_S,s->nrow,cindex,wts);
-		    /* This forms the annulled data */
-		    for(j=0,k=nrows_S;j<nnull;++j,++k)
-		    {
-			    scrhs[k] = ddot(nrow_amatrix,U+nc*(ncol_amatrix+j),1,
-						residuals,1);
-		    }
-		    nrows_S += nnull; 
-		    }
-		    else
-		    {
-			/* Special block for all fixed coordinates */
-			form_column_indices(s,ta[i],cindex);
-			for(j=0,k=nrows_S;j<nrow_amatrix;++j,++k)
-			{
-				scrhs[k]=residuals[j];
-				s->S[k+cindex[j]*(s->nrow)]=wts[j];
-			}
-			nrows_S+=nrow_amatrix;
-		    }
+			        A[j+nrow_amatrix*k] = (double)(Amatrix[j][k]);
+		    pw->ncol[i] = ncol_amatrix;
+		    pw->used[i] = 1;
 		}   
             }
             if(maxtbl(history))freetbl(history,free);
@@ -576,21 +846,7 @@ Nevents Nevents_used\n");
  positive\n");
 		pushtbl(*sc_converge_reasons,
 			strdup("ABORT on insufficient data"));
-	        free(A);
-	        free(U);
-	        free(Vt);
-	        free(svalue);
-	        free(wts);
-	        free(residuals);
-	        free(cindex);
-	        free(scrhs);
-	        free(bwork);
-	        free(sc_solved);
-	        free(b);
-	        free(r);
-	        free(w);
-	        free(reswt);
-	        free_matrix((char **)Amatrix,0,nc-1,0);
+		free_pmel_work(pw);
 	        freetbl(tu,free);
 		return(-1);
 	}
@@ -628,41 +884,16 @@ Nevents Nevents_used\n");
 	if(sc_adjusted_last_pass==0) adjust_sc_ok=1;  /* force this or we may not converge */
 	if(adjust_sc_ok)
 	{
-	    if(nrows_S<=0)
+	    /* All the linear algebra for this pass happens here */
+	    pmel_perf_lock();
+	    nused = pmel_solve_sc(pw,s,rsvc,&nrows_S,&ds_over_s,&rhsnrm);
+	    pmel_perf_unlock();
+	    if(nused<0)
 	    {
-		elog_notify(0,"pmel:  Insufficient data to compute\
-station corrections\n");
+		free_pmel_work(pw);
+		freetbl(tu,free);
 		return(-1);
 	    }
-	    /* Now we solve for station correction adjustments that 
-	    are determinate from the available data. U is not actually
-	    hit because we use the 'o' flag, but Vt is set*/
-	    dgesvd('o','a',nrows_S,nc,s->S,nr,svalue,U,nc,Vt,nc,&svdinfo);
-	    if(svdinfo) 
-	    {
-	        elog_complain(0,"pmel:  svd error inverting station correction matrix\n");
-	        svd_error(svdinfo);
-	        return(-1);
-	    }
-	    /* This is a pseudoinverse solver. It returns the number of
-	    singular values used for the solution which we used below to
-	    do subspace projections */
-	    nused = dpinv_solver(nrows_S,nc,s->S,nr,svalue,Vt,nc,
-		scrhs,sc_solved,rsvc);
-
-	    /* Now we apply the projectors.  We first add the current solution
-	    as a perturbation factor to the current total station correction
-	    vector and then project it onto range defined by svd of the S
-	    matrix.  This may not be necessary for teleseismic events, but
-	    can be significant if large changes happen in initial steps
-	    that distort the matrices used to construct S. */
-	    daxpy(nc,1.0,sc_solved,1,s->sc,1);
-	    if(model_space_range_project(Vt,nc,nused,nc,s->sc,s->scdata))
-		elog_complain(0,"sc matrix size error\n");
-	    if(model_space_null_project(Vt,nc,nused,nc,s->scref,s->scbias))
-		elog_complain(0,"sc matrix size error\n");
-	    dcopy(nc,s->scdata,1,s->sc,1);
-	    for(k=0;k<nc;++k)s->sc[k] += s->scbias[k];
 
 	    /* This routine updates the active list of station corrections
 	    in the phase handles.  */
@@ -672,23 +903,10 @@ station corrections\n");
 corrections during iteration %d\n",
 			sc_iterations);
 	    }
-	    /* Test for small correction vector relative to norm s.
-	    It is intentional to divide by scdata as adjustments
-	    only happen in the subspace covered by scdata. If we used the
-	    full vector s->sc it can be artificially large */
-	    ds_over_s = dnrm2(nc,sc_solved,1)/dnrm2(nc,s->scdata,1);
-/*
-ds_over_s=dnrm2_(&nc,sc_solved,&one)/dnrm2_(&nc,s->scdata,&one);
-*/
-
 	    if(ds_over_s<ds_over_s_converge)
 		pushtbl(*sc_converge_reasons,
 			strdup("Small adjustment to station corrections"));
 
-	    /* a second measure of rms*/
-	    if(data_space_null_project(s->S,nr,nused,nrows_S,scrhs,bwork))
-		elog_complain(0,"Problems in data_space_null_project\n");
-	    rhsnrm = dnrm2(nrows_S,bwork,1);
 	    total_wssq2 = rhsnrm*rhsnrm;
 	    total_ndgf2 = total_ndgf - nused;  /*use nused as svd truncation
 						will be the norm with
@@ -717,7 +935,7 @@ ds_over_s=dnrm2_(&nc,sc_solved,&one)/dnrm2_(&nc,s->scdata,&one);
 	    hypocen_history->degrees_of_freedom = total_ndgf;
 	    pushtbl(*pmelhistory,hypocen_history);
 	    copy_hypocenter(hypocen_history,hypocen);
-	    fprintf(stdout,"%d  %lf  %lf  %lf %lf %d %d %d %d\n",
+	    fprintf(out,"%d  %lf  %lf  %lf %lf %d %d %d %d\n",
 		sc_iterations,total_rms_raw,escale,
 			sswrodgf,sswrodgf2,
 			total_ndgf,total_ndgf2,nevents,nev_used);
@@ -727,7 +945,7 @@ ds_over_s=dnrm2_(&nc,sc_solved,&one)/dnrm2_(&nc,s->scdata,&one);
 	else
 	{
 	    sc_adjusted_last_pass = 0;
-	    fprintf(stdout,"%d  --No station correction change this pass--\n",
+	    fprintf(out,"%d  --No station correction change this pass--\n",
 		sc_iterations);
 	    /* This forces another iteration whenever irregularities 
 	    in hypocenter use changes */
@@ -743,24 +961,10 @@ ds_over_s=dnrm2_(&nc,sc_solved,&one)/dnrm2_(&nc,s->scdata,&one);
 			strdup("Hit station correction iteration limit"));
     }
     while (maxtbl(*sc_converge_reasons)<=0 );
-    fprintf(stdout,"Convergence in %d total iterations with %d adjustments\n",
+    fprintf(out,"Convergence in %d total iterations with %d adjustments\n",
 		sc_iterations,sc_adjustments);
 
-    free(A);
-    free(U);
-    free(Vt);
-    free(svalue);
-    free(wts);
-    free(residuals);
-    free(cindex);
-    free(scrhs);
-    free(bwork);
-    free(sc_solved);
-    free(b);
-    free(r);
-    free(w);
-    free(reswt);
-    free_matrix((char **)Amatrix,0,nc-1,0);
+    free_pmel_work(pw);
     freetbl(tu,free);
     return(0);
 }
@@ -31,6 +31,28 @@ typedef struct scmatrix {
         double *S;
 } SCMatrix;
 
+/* One cluster of events for pmel_cluster and the pmel_pool routines.
+The caller fills in the inputs (see pmel_cluster.c) */
+typedef struct pmel_cluster {
+	long gridid;
+	int nevents;
+	long *evid;
+	Tbl **ta;
+	Hypocenter *h0;
+	Hypocenter hypocentroid;
+	Arr *fixarr;
+	int ndata;  /* total number of arrivals in ta */
+	/* set by pmel_cluster */
+	Arr *phase_arr;  /* private phase handles ta points to */
+	SCMatrix *smatrix;
+	Location_options o;
+	Tbl *converge, *pmelhistory;
+	int status;  /* pmel return code, -1 for no solution */
+	FILE *output;  /* pmel output held for a pool */
+	int done;
+} Pmel_cluster;
+typedef struct Pmel_pool Pmel_pool;
+
 enum FREEZE_METHOD {DEPTH_MAXARRIVALS, ALLSPACE_MAXARRIVALS, ALL_MAXARRIVALS, 
 		DEPTH_MINRMS, ALLSPACE_MINRMS, ALL_MINRMS, NOTSET };
 #ifdef  __cplusplus
@@ -56,6 +78,19 @@ int initialize_station_corrections(Arr *, Arr *, Arr *, Hypocenter *);
 int compute_scref(SCMatrix *, Hypocenter *, Arr *, Arr *, Arr *);
 int update_scarr(SCMatrix *,Arr *);
 Arr *pmel_dbload_stations(Dbptr db,Pf *);
+Arr *dup_phase_handles(Arr *);
+void free_phase_handle_copy(void *);
+void pmel_perf_lock();
+void pmel_perf_unlock();
+void pmel_set_output(FILE *);
+Pmel_cluster *create_Pmel_cluster();
+void free_Pmel_cluster(Pmel_cluster *);
+int pmel_cluster(Pmel_cluster *, Arr *, Arr *, Arr *, Location_options *, Pf *);
+Pmel_pool *pmel_pool_create(int, Arr *, Arr *, Arr *, Location_options *, Pf *);
+void pmel_pool_submit(Pmel_pool *, Pmel_cluster *);
+int pmel_pool_pending(Pmel_pool *);
+Pmel_cluster *pmel_pool_next(Pmel_pool *);
+void pmel_pool_destroy(Pmel_pool *);
 #ifdef  __cplusplus
 }
 #endif
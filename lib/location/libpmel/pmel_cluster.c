@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "stock.h"
+#include "arrays.h"
+#include "pf.h"
+#include "elog.h"
+#include "location.h"
+#include "pmel.h"
+/* Routines to run pmel on independent clusters (grid points) and to
+run many clusters at once on a pool of threads.  A cluster carries
+its own copy of the phase handles, its own SCMatrix, and its own
+location options, so nothing pmel alters is shared between clusters.
+The travel time calculators are shared; the genloc calculators that
+are not reentrant serialize themselves, and pmel holds a lock for all
+calls into libperf (see pmel.c).  All database work stays with the
+caller, which loads a cluster, submits it, and saves the results when
+pmel_pool_next hands it back in submission order.  */
+
+/* Creates an empty cluster object.  The caller fills in gridid,
+nevents, evid, ta, h0, hypocentroid, fixarr, and ndata.  All of those
+become owned by the cluster and are released by free_Pmel_cluster. */
+Pmel_cluster *create_Pmel_cluster()
+{
+	Pmel_cluster *c;
+
+	allot(Pmel_cluster *,c,1);
+	memset(c,0,sizeof(Pmel_cluster));
+	initialize_hypocenter(&(c->hypocentroid));
+	c->status = -1;
+	return(c);
+}
+void free_Pmel_cluster(Pmel_cluster *c)
+{
+	int i;
+
+	/* The arrivals point at the private phase handles, so they
+	have to go first */
+	if(c->ta!=NULL)
+	{
+		for(i=0;i<c->nevents;++i)
+			if(c->ta[i]!=NULL) freetbl(c->ta[i],free);
+		free(c->ta);
+	}
+	if(c->phase_arr!=NULL) freearr(c->phase_arr,free_phase_handle_copy);
+	if(c->evid!=NULL) free(c->evid);
+	if(c->h0!=NULL) free(c->h0);
+	if(c->fixarr!=NULL) freearr(c->fixarr,free);
+	if(c->smatrix!=NULL) destroy_SCMatrix(c->smatrix);
+	if(c->converge!=NULL) freetbl(c->converge,free);
+	if(c->pmelhistory!=NULL) freetbl(c->pmelhistory,free);
+	if(c->output!=NULL) fclose(c->output);
+	free(c);
+}
+/* Runs pmel on one cluster.  This is what dbpmel used to do inline
+for each grid point:  the phase handles are copied and the station
+corrections in the copy are set for the hypocentroid, the reference
+corrections are computed, and pmel is called.  The results are left
+in c->smatrix, c->h0, c->ta, c->o, c->converge and c->pmelhistory.
+
+Arguments:
+	c - cluster to process
+	stations - associative array of Station objects
+	pha - phase handles for the reference model.  Not altered.
+	pha3D - phase handles of the bias (3D) model.  Not altered.
+	o - location options.  Copied to c->o, which pmel alters.
+	pf - parameters for pmel
+
+Returns the pmel return code (also stored in c->status).  -1 means
+there is no solution for this cluster.
+*/
+int pmel_cluster(Pmel_cluster *c, Arr *stations, Arr *pha, Arr *pha3D,
+	Location_options *o, Pf *pf)
+{
+	Arrival *a;
+	Phase_handle *p;
+	int i,j,ierr;
+
+	c->status = -1;
+	c->phase_arr = dup_phase_handles(pha);
+	for(i=0;i<c->nevents;++i)
+	{
+		for(j=0;j<maxtbl(c->ta[i]);++j)
+		{
+			a = (Arrival *)gettbl(c->ta[i],j);
+			p = (Phase_handle *)getarr(c->phase_arr,a->phase->name);
+			if(p!=NULL) a->phase = p;
+		}
+	}
+	/* This function alters the phase handles by setting the
+	station corrections to those computed from the difference
+	in travel time between the model defined in the pha3D
+	definition and that in pha.  */
+	ierr = initialize_station_corrections(c->phase_arr,pha3D,
+		stations,&(c->hypocentroid));
+	if(ierr>0)
+	{
+		elog_complain(0,"%d problems setting path anomaly corrections for gridid=%ld\n",
+			ierr,c->gridid);
+	}
+	else if(ierr<0)
+	{
+		elog_complain(0,"Cannot compute any path anomaly corrections for gridid=%ld\nSkipping to next grid point\n",
+			c->gridid);
+		return(-1);
+	}
+	/* S needs at most one row per datum.  pmel sizes the columns
+	to the station:phase pairs present in the data */
+	c->smatrix = create_SCMatrix(stations,c->phase_arr);
+	c->smatrix->nrow = c->ndata;
+
+	/* This computes the set of reference station corrections
+	for this group of events */
+	ierr = compute_scref(c->smatrix,&(c->hypocentroid),stations,
+		c->phase_arr,pha3D);
+	if(ierr)
+	{
+		elog_complain(0,"%d errors in compute_scref\n",ierr);
+	}
+	/* It is necessary to initialize the sc vector in smatrix
+	to the contents of the reference station corrections to make
+	the results internally consistent.  (memcpy rather than dcopy
+	because this runs outside the libperf lock) */
+	memcpy(c->smatrix->sc,c->smatrix->scref,
+		(c->smatrix->ncol)*sizeof(double));
+	c->o = *o;
+	c->status = pmel(c->nevents,c->evid,c->ta,c->h0,
+		c->fixarr,&(c->hypocentroid),c->smatrix,
+		c->phase_arr,&(c->o),pf,&(c->converge),&(c->pmelhistory));
+	/* S is only work space.  Release it now as the cluster may wait
+	some time before the caller saves it. */
+	free(c->smatrix->S);
+	c->smatrix->S = NULL;
+	return(c->status);
+}
+
+struct Pmel_pool {
+	int nthreads;
+	pthread_t *tid;
+	Pf **pf;  /* a private copy of the parameters for each thread */
+	Arr *stations, *pha, *pha3D;
+	Location_options o;
+	Pf *callerpf;
+	Tbl *queue;  /* clusters in order of submission */
+	int nstarted;  /* clusters taken by a thread */
+	int nreturned;  /* clusters handed back by pmel_pool_next */
+	int shutdown;
+	pthread_mutex_t lock;
+	pthread_cond_t work, finished;
+};
+typedef struct Pmel_worker_arg {
+	Pmel_pool *pool;
+	int id;
+} Pmel_worker_arg;
+
+static void *pmel_worker(void *arg)
+{
+	Pmel_worker_arg *w=(Pmel_worker_arg *)arg;
+	Pmel_pool *pool=w->pool;
+	Pf *pf=pool->pf[w->id];
+	Pmel_cluster *c;
+
+	free(w);
+	pthread_mutex_lock(&(pool->lock));
+	while(1)
+	{
+		while(!pool->shutdown && pool->nstarted>=maxtbl(pool->queue))
+			pthread_cond_wait(&(pool->work),&(pool->lock));
+		if(pool->nstarted>=maxtbl(pool->queue)) break;
+		c = (Pmel_cluster *)gettbl(pool->queue,pool->nstarted);
+		++(pool->nstarted);
+		pthread_mutex_unlock(&(pool->lock));
+
+		/* pmel's iteration table is kept with the cluster and
+		printed when the cluster is handed back */
+		c->output = tmpfile();
+		pmel_set_output(c->output);
+		pmel_cluster(c,pool->stations,pool->pha,pool->pha3D,
+			&(pool->o),pf);
+		pmel_set_output(NULL);
+
+		pthread_mutex_lock(&(pool->lock));
+		c->done = 1;
+		pthread_cond_broadcast(&(pool->finished));
+	}
+	pthread_mutex_unlock(&(pool->lock));
+	return(NULL);
+}
+/* Creates a pool of nthreads threads that run pmel_cluster on
+submitted clusters.  0 means one thread per processor.  With one
+thread no threads are created and pmel_pool_submit runs each cluster
+immediately.  The arguments are as for pmel_cluster and must stay
+valid until pmel_pool_destroy.  */
+Pmel_pool *pmel_pool_create(int nthreads, Arr *stations, Arr *pha,
+	Arr *pha3D, Location_options *o, Pf *pf)
+{
+	Pmel_pool *pool;
+	Pmel_worker_arg *w;
+	char *pfimage;
+	int i;
+
+	if(nthreads<=0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads<=0) nthreads = 1;
+	allot(Pmel_pool *,pool,1);
+	pool->stations = stations;
+	pool->pha = pha;
+	pool->pha3D = pha3D;
+	pool->o = *o;
+	pool->callerpf = pf;
+	pool->queue = newtbl(0);
+	pool->nstarted = 0;
+	pool->nreturned = 0;
+	pool->shutdown = 0;
+	pool->nthreads = 0;
+	pool->tid = NULL;
+	pool->pf = NULL;
+	pthread_mutex_init(&(pool->lock),NULL);
+	pthread_cond_init(&(pool->work),NULL);
+	pthread_cond_init(&(pool->finished),NULL);
+	if(nthreads==1) return(pool);
+
+	allot(pthread_t *,pool->tid,nthreads);
+	allot(Pf **,pool->pf,nthreads);
+	pfimage = pf2string(pf);
+	for(i=0;i<nthreads;++i)
+	{
+		pool->pf[i] = NULL;
+		if(pfcompile(pfimage,&(pool->pf[i])))
+			elog_die(0,"pmel_pool_create:  pfcompile failed copying parameters\n");
+		allot(Pmel_worker_arg *,w,1);
+		w->pool = pool;
+		w->id = i;
+		if(pthread_create(pool->tid+i,NULL,pmel_worker,w))
+		{
+			elog_complain(1,"pmel_pool_create:  pthread_create failed; using %d threads\n",i);
+			free(w);
+			pffree(pool->pf[i]);
+			break;
+		}
+	}
+	free(pfimage);
+	pool->nthreads = i;
+	return(pool);
+}
+/* Queues a cluster.  The pool owns it until pmel_pool_next returns it. */
+void pmel_pool_submit(Pmel_pool *pool, Pmel_cluster *c)
+{
+	c->done = 0;
+	if(pool->nthreads<=0)
+	{
+		pmel_cluster(c,pool->stations,pool->pha,pool->pha3D,
+			&(pool->o),pool->callerpf);
+		c->done = 1;
+	}
+	pthread_mutex_lock(&(pool->lock));
+	pushtbl(pool->queue,c);
+	pthread_cond_signal(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+}
+/* Number of clusters submitted but not yet returned */
+int pmel_pool_pending(Pmel_pool *pool)
+{
+	int n;
+	pthread_mutex_lock(&(pool->lock));
+	n = maxtbl(pool->queue) - pool->nreturned;
+	pthread_mutex_unlock(&(pool->lock));
+	return(n);
+}
+/* Waits for the oldest cluster not yet returned to finish and returns
+it, after copying its pmel iteration table to stdout.  Clusters come
+back in the order they were submitted, so output and database rows
+are in the same order as a sequential run.  Returns NULL if nothing
+is pending.  The caller frees the result with free_Pmel_cluster. */
+Pmel_cluster *pmel_pool_next(Pmel_pool *pool)
+{
+	Pmel_cluster *c;
+	char buf[BUFSIZ];
+	size_t n;
+
+	pthread_mutex_lock(&(pool->lock));
+	if(pool->nreturned>=maxtbl(pool->queue))
+	{
+		pthread_mutex_unlock(&(pool->lock));
+		return(NULL);
+	}
+	c = (Pmel_cluster *)gettbl(pool->queue,pool->nreturned);
+	while(!c->done)
+		pthread_cond_wait(&(pool->finished),&(pool->lock));
+	settbl(pool->queue,pool->nreturned,NULL);
+	++(pool->nreturned);
+	pthread_mutex_unlock(&(pool->lock));
+
+	if(c->output!=NULL)
+	{
+		rewind(c->output);
+		while((n=fread(buf,1,BUFSIZ,c->output))>0)
+			fwrite(buf,1,n,stdout);
+		fclose(c->output);
+		c->output = NULL;
+	}
+	return(c);
+}
+/* Waits for the threads to finish any clusters already submitted
+and releases the pool.  Clusters never returned are freed. */
+void pmel_pool_destroy(Pmel_pool *pool)
+{
+	Pmel_cluster *c;
+	int i;
+
+	pthread_mutex_lock(&(pool->lock));
+	pool->shutdown = 1;
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+	for(i=0;i<pool->nthreads;++i)
+	{
+		pthread_join(pool->tid[i],NULL);
+		pffree(pool->pf[i]);
+	}
+	while((c=pmel_pool_next(pool))!=NULL) free_Pmel_cluster(c);
+	freetbl(pool->queue,0);
+	pthread_mutex_destroy(&(pool->lock));
+	pthread_cond_destroy(&(pool->work));
+	pthread_cond_destroy(&(pool->finished));
+	if(pool->tid!=NULL) free(pool->tid);
+	if(pool->pf!=NULL) free(pool->pf);
+	free(pool);
+}
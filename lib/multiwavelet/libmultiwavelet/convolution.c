@@ -1,9 +1,25 @@
 #include <stdio.h>
-#include <perf.h>
 #include "elog.h"
 
-/* sconv is a general purpose convolution routine using sunperf BLAS function
-sdot for speed.  
+/* Inner product used by sconv.  This is the unit stride case of the
+BLAS sdot with the same order of summation, so results match sdot
+exactly.  The perf library version keeps its sum in a static and
+cannot be used by tr_mwtransform's threads. */
+static float sconv_dot(int n, float *x, float *y)
+{
+	int i,m;
+	float sum=0.0;
+
+	m = n%5;
+	for(i=0;i<m;++i) sum += x[i]*y[i];
+	for(i=m;i<n;i+=5)
+		sum = sum + x[i]*y[i] + x[i+1]*y[i+1] + x[i+2]*y[i+2]
+			+ x[i+3]*y[i+3] + x[i+4]*y[i+4];
+	return(sum);
+}
+
+/* sconv is a general purpose convolution routine using an unrolled
+inner product (see sconv_dot) for speed.  It is reentrant.
 
 arguments:
 
@@ -57,12 +73,11 @@ int sconv(float *in, int nin, float *filter, int nfilter,
 		ret_code = -ioff;
 		ioff = 0;
 	}
-	/* elegance of blas shows here */
 	for(i=ioff,j=0,iend=ioff+nfilter,*nout=0;
 		iend<nin;
 		i += decfac,++j,iend += decfac)
 	{
-		out[j] = (float)sdot(nfilter,in+i,1,filter,1);
+		out[j] = sconv_dot(nfilter,in+i,filter);
 	}
 	*nout = j;
 	return(ret_code);
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <perf.h>
 
 #include "stock.h"
@@ -275,8 +276,10 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 				nin);
 		return(-999);
 	}
-	/* Note this routine works if nstages = 0 (empty tbl) */
-	scopy(nin,in,1,buf,1);
+	/* Note this routine works if nstages = 0 (empty tbl).
+	Copies use memcpy because perf's scopy is not reentrant and
+	this is called from tr_mwtransform's threads. */
+	memcpy(buf,in,nin*sizeof(float));
 	decfac = 1;
 	si=dt0;
 	n=nin;
@@ -299,7 +302,7 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 		{
 			/* Fall in this block for no decimation with
 			zero length filter (the "none" case ) */
-			scopy(n,buf,1,buf2,1);
+			memcpy(buf2,buf,n*sizeof(float));
 			*nout = n;
 		}
 		else
@@ -312,7 +315,7 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 				*nout = 0;
 				return(-1);
 			}	
-			ret_code = sconv(buf,n,d->coefs,d->ncoefs,0,d->decfac,
+			ret_code = sconv_fft(buf,n,d->coefs,d->ncoefs,0,d->decfac,
 					buf2,nout);
 
 		/* This fragment should never really be executed, but better
@@ -326,7 +329,7 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 			}
 		}
 		/* this always works because nout <= nin */
-		scopy(*nout,buf2,1,buf,1);
+		memcpy(buf,buf2,(*nout)*sizeof(float));
 		n = *nout;
 	}
 
@@ -335,7 +338,7 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 	if(*out == NULL)
 		elog_die(0,"decimate_trace:  cannot malloc output vector of length %d\n",
 			*nout);
-	scopy(*nout,buf2,1,*out,1);
+	memcpy(*out,buf2,(*nout)*sizeof(float));
 	*t0out = t0 + deltat0;
 	*dt = si;
 	free(buf);
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stock.h"
+#include "elog.h"
+#include "multiwavelet.h"
+#include "fftplan.h"
+
+/* This file contains an overlap-save FFT implementation of the
+correlation computed by sconv.  The input trace is broken into
+overlapping blocks whose spectra are computed once and saved in an
+FFTconv_trace object.  Any number of filters up to the maximum length
+the object was built for can then be applied to the same trace at
+the cost of one filter FFT and one inverse FFT per block.  This is
+what makes it fast for the multiwavelet transform where every wavelet
+of a band is applied to the same decimated trace.
+
+All functions here match the output of sconv exactly (to rounding
+error) including the ioff and decfac conventions.  That is, output
+sample j is the dot product of filter with in[ioff+j*decfac ...] and
+output stops when a full filter length no longer fits in the input.
+
+Transforms use the shared plans of libfft (fftplan.h).
+*/
+
+/* Smallest fft length used for a block.  Shorter is never efficient */
+#define FFTCONV_MIN_NFFT 16
+
+/* Returns block fft length used for a trace of length nin and filters
+up to length maxfilter.  Blocks about 4 times the filter length are
+near optimal, but there is no reason to use a block longer than
+needed to hold the entire trace. */
+static int fftconv_nfft(int nin, int maxfilter)
+{
+	int nfft,nmax;
+
+	for(nmax=FFTCONV_MIN_NFFT;nmax<(nin+maxfilter);nmax<<=1);
+	for(nfft=FFTCONV_MIN_NFFT;nfft<4*maxfilter;nfft<<=1);
+	if(nfft>nmax) nfft=nmax;
+	return(nfft);
+}
+/* Returns number of sample points between 0 and nin-2 inclusive
+(the largest possible output position) covered by blocks of length
+step */
+static int fftconv_nblocks(int nin, int step)
+{
+	if(nin<2) return(0);
+	return((nin-2)/step + 1);
+}
+/* Builds an FFTconv_trace object from the float vector in of length nin.
+maxfilter is the length of the longest filter that will be applied
+using this object.  Returns NULL if maxfilter is larger than nin (the
+same condition sconv rejects).  Dies only on malloc failures. */
+FFTconv_trace *fftconv_trace_create(float *in, int nin, int maxfilter)
+{
+	FFTconv_trace *t;
+	float *x,*work;
+	int b,i,i0,ncopy;
+
+	if(maxfilter>nin || maxfilter<1)
+	{
+		elog_log(0,"fftconv_trace_create:  filter length (%d) longer than input time series (%d)\n",maxfilter,nin);
+		return(NULL);
+	}
+	allot(FFTconv_trace *,t,1);
+	t->nin = nin;
+	t->maxfilter = maxfilter;
+	t->nfft = fftconv_nfft(nin,maxfilter);
+	t->step = t->nfft - maxfilter + 1;
+	t->nblocks = fftconv_nblocks(nin,t->step);
+	/* The shared cache returns NULL when it is full */
+	t->plan = fftplan_get(t->nfft,0);
+	t->ownplan = 0;
+	if(t->plan == NULL)
+	{
+		t->plan = fftplan_new(t->nfft,0);
+		t->ownplan = 1;
+	}
+	t->spectra = (float *)calloc(2*(t->nfft)*(MAX(t->nblocks,1)),
+						sizeof(float));
+	if(t->spectra == NULL)
+		elog_die(0,"fftconv_trace_create:  cannot alloc %d blocks of length %d\n",
+			t->nblocks,t->nfft);
+	allot(float *,work,fftplan_worksize(t->plan));
+	for(b=0;b<t->nblocks;++b)
+	{
+		x = t->spectra + 2*b*(t->nfft);
+		i0 = b*(t->step);
+		ncopy = MIN(t->nfft,nin-i0);
+		for(i=0;i<ncopy;++i) x[2*i] = in[i0+i];
+		fftplan_complex(t->plan,x,-1,work);
+	}
+	free(work);
+	return(t);
+}
+void free_fftconv_trace(FFTconv_trace *t)
+{
+	if(t==NULL) return;
+	if(t->ownplan) fftplan_free(t->plan);
+	free(t->spectra);
+	free(t);
+}
+/* Applies a complex filter with real part fr and imaginary part fi
+(either may be NULL, in which case that part is taken as zero) of
+length nfilter to the trace held in t.   The real and imaginary parts
+of out are what sconv would produce using fr and fi as filters
+respectively, with the same ioff and decfac.   out must be large
+enough to hold the output (nin/decfac + 1 is always sufficient).
+Return codes are the same as sconv.  */
+int fftconv(FFTconv_trace *t, float *fr, float *fi, int nfilter,
+		int ioff, int decfac, complex *out, int *nout)
+{
+	int nfft=t->nfft;
+	int i,j,b,p,pfirst,plast,blockend;
+	int ret_code=0;
+	float *g,*w,*x,*work;
+	float scale,xr,xi,gr,gi;
+
+	*nout=0;
+	if(nfilter > t->nin)
+	{
+		elog_log(0,"fftconv:  filter length (%d) longer than input time series (%d)\n",nfilter,t->nin);
+		return(-1);
+	}
+	if(nfilter > t->maxfilter || nfilter < 1 || decfac < 1)
+	{
+		elog_log(0,"fftconv:  illegal filter length (%d) or decimation factor (%d) for object built for maximum filter length %d\n",
+			nfilter,decfac,t->maxfilter);
+		return(-1);
+	}
+	if(ioff < 0)
+	{
+		elog_log(0,"fftconv:  illegal offset value = %d set to 0\n",
+			ioff);
+		ret_code = -ioff;
+		ioff = 0;
+	}
+	/* Last output position is the same as sconv's */
+	plast = t->nin - nfilter - 1;
+	if(plast<ioff) return(ret_code);
+
+	g = (float *)calloc(4*nfft+fftplan_worksize(t->plan),sizeof(float));
+	if(g==NULL) elog_die(0,"fftconv:  cannot alloc work space of length %d\n",nfft);
+	w = g + 2*nfft;
+	work = w + 2*nfft;
+	/* Correlation is convolution with the time reversed filter.
+	The transform with positive exponent does that reversal. */
+	for(i=0;i<nfilter;++i)
+	{
+		if(fr!=NULL) g[2*i] = fr[i];
+		if(fi!=NULL) g[2*i+1] = fi[i];
+	}
+	fftplan_complex(t->plan,g,1,work);
+	scale = 1.0/((float)nfft);
+
+	for(b=0,j=0;b<t->nblocks && j*decfac+ioff<=plast;++b)
+	{
+		/* first output position in this block on the decimated grid */
+		pfirst = b*(t->step);
+		if(pfirst<ioff)
+			pfirst = ioff;
+		else if((pfirst-ioff)%decfac)
+			pfirst += decfac - (pfirst-ioff)%decfac;
+		blockend = MIN((b+1)*(t->step)-1,plast);
+		if(pfirst>blockend) continue;
+		x = t->spectra + 2*b*nfft;
+		for(i=0;i<nfft;++i)
+		{
+			xr=x[2*i]; xi=x[2*i+1];
+			gr=g[2*i]; gi=g[2*i+1];
+			w[2*i] = xr*gr - xi*gi;
+			w[2*i+1] = xr*gi + xi*gr;
+		}
+		fftplan_complex(t->plan,w,1,work);
+		for(p=pfirst;p<=blockend;p+=decfac)
+		{
+			i = p - b*(t->step);
+			j = (p-ioff)/decfac;
+			out[j].r = w[2*i]*scale;
+			out[j].i = w[2*i+1]*scale;
+		}
+		++j;
+	}
+	*nout = (plast-ioff)/decfac + 1;
+	free(g);
+	return(ret_code);
+}
+/* Rough operation count comparison of sconv and fftconv for applying
+nfilters filters of length nfilter to a trace of length nin with
+decimation factor decfac.   Returns 1 if fftconv should be faster. */
+int fftconv_preferred(int nin, int nfilter, int decfac, int nfilters)
+{
+	double direct,fft,nfftlogn;
+	int nfft,nblocks;
+
+	if(nfilter>nin || nfilter<1) return(0);
+	if(decfac<1) decfac=1;
+	direct = ((double)nfilters)*((double)(nin-nfilter)/((double)decfac))
+			*((double)nfilter);
+	nfft = fftconv_nfft(nin,nfilter);
+	nblocks = fftconv_nblocks(nin,nfft-nfilter+1);
+	nfftlogn = 5.0*((double)nfft)*log((double)nfft)/log(2.0);
+	fft = ((double)nblocks)*nfftlogn
+		+ ((double)nfilters)*(nfftlogn
+			+ ((double)nblocks)*(nfftlogn + 6.0*((double)nfft)));
+	if(fft<direct)
+		return(1);
+	else
+		return(0);
+}
+/* Drop in replacement for sconv.  Uses fftconv when it is estimated
+to be faster and sconv otherwise.  Arguments and return codes are
+the same as sconv. */
+int sconv_fft(float *in, int nin, float *filter, int nfilter,
+		int ioff, int decfac,
+		float *out, int *nout)
+{
+	FFTconv_trace *t;
+	complex *z;
+	int i,ret_code;
+
+	if(!fftconv_preferred(nin,nfilter,decfac,1))
+		return(sconv(in,nin,filter,nfilter,ioff,decfac,out,nout));
+	t = fftconv_trace_create(in,nin,nfilter);
+	if(t==NULL) return(-1);
+	allot(complex *,z,nin/MAX(decfac,1)+1);
+	ret_code = fftconv(t,filter,NULL,nfilter,ioff,decfac,z,nout);
+	for(i=0;i<(*nout);++i) out[i]=z[i].r;
+	free(z);
+	free_fftconv_trace(t);
+	return(ret_code);
+}
@@ -46,6 +46,21 @@ typedef struct FIR_decimation{
 	int ncoefs;
 	float *coefs;
 } FIR_decimation;
+/* Object holding the spectra of a trace broken into overlapping
+blocks for overlap-save convolution with fftconv.  Built once
+per trace and reused for any number of filters of length up to
+maxfilter. */
+typedef struct FFTconv_trace_ {
+	int nin;  /* length of the input trace */
+	int maxfilter;  /* longest filter this object can be used with */
+	int nfft;  /* fft length of each block */
+	int step;  /* output samples computed per block (nfft-maxfilter+1)*/
+	int nblocks;
+	float *spectra;  /* nblocks complex spectra of length nfft stored
+				as interleaved real,imag pairs */
+	struct FFTplan *plan;  /* libfft complex plan of length nfft */
+	int ownplan;  /* plan was built with fftplan_new and must be freed */
+} FFTconv_trace;
 /* Object returned by stacking function */
 typedef struct MWstack_
 {
@@ -248,6 +263,14 @@ int decimate_trace(Tbl *dectbl,float *in, int nin, double dt0, double t0,
 int sconv(float *in, int nin, float *filter, int nfilter,
                 int ioff, int decfac,
                 float *out, int *nout);
+FFTconv_trace *fftconv_trace_create(float *in, int nin, int maxfilter);
+void free_fftconv_trace(FFTconv_trace *t);
+int fftconv(FFTconv_trace *t, float *fr, float *fi, int nfilter,
+		int ioff, int decfac, complex *out, int *nout);
+int fftconv_preferred(int nin, int nfilter, int decfac, int nfilters);
+int sconv_fft(float *in, int nin, float *filter, int nfilter,
+		int ioff, int decfac,
+		float *out, int *nout);
 Tbl **build_decimation_objects(Tbl **filelists, int nbands, int *decfac);
 void free_decimation(FIR_decimation *d);
 MWbasis *load_multiwavelets_pf(Pf *pf,int *nwavelets);
@@ -289,6 +312,7 @@ void mwap_process(Dbptr ,char *,  Pf *);
 double unwrap_delta_phase(complex , complex );
 char *make_mw_key(char *, char *);
 Arr *tr_mwtransform(Dbptr , Arr *, Time_Window *, int *, Tbl **, int , MWbasis *, int );
+void set_mwtransform_threads(int);
 MWgather *MWgather_alloc(int );
 void free_MWgather(MWgather *);
 void free_MWtransform_arr(Arr *,int, int);
@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <strings.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #undef  __USE_SVID     /* for Linux !! to get MAXFLOAT */
 #define  __USE_XOPEN 1 /* for Linux !! */
@@ -69,6 +71,105 @@ char *make_mw_key(char *sta, char *chan)
 }
 	
 
+/* The stations in tr_mwtransform are transformed independently so
+the transforms are computed by a pool of threads.   The database is
+only touched by the calling thread.   One of these is created for
+each sta/chan to be processed. */
+typedef struct MWtransform_job_ {
+	char *key;  /* sta/chan key from make_mw_key */
+	Trsample *trace;  /* first sample to process */
+	double si, starttime;
+	int nsamples;
+	MWtrace **mwt;  /* result from MWtransform */
+} MWtransform_job;
+
+typedef struct MWtransform_pool_ {
+	MWtransform_job *jobs;
+	int njobs;
+	int next;  /* next job not yet taken by a thread */
+	pthread_mutex_t lock;
+	MWbasis *basis;
+	int nbasis;
+	Tbl **decimators;
+	int nbands;
+} MWtransform_pool;
+
+/* Number of threads used by tr_mwtransform.  0 means use one per
+processor. */
+static int mwtransform_threads=0;
+
+void set_mwtransform_threads(int n)
+{
+	if(n<0) n=0;
+	mwtransform_threads = n;
+}
+
+static void *mwtransform_worker(void *arg)
+{
+	MWtransform_pool *pool=(MWtransform_pool *)arg;
+	MWtransform_job *job;
+	int i;
+
+	while(1)
+	{
+		pthread_mutex_lock(&(pool->lock));
+		i = pool->next;
+		++(pool->next);
+		pthread_mutex_unlock(&(pool->lock));
+		if(i>=pool->njobs) break;
+		job = pool->jobs + i;
+		job->mwt = MWtransform(job->trace,
+				job->si,job->starttime,job->nsamples,
+				pool->basis, pool->nbasis, 
+				pool->decimators, pool->nbands);
+	}
+	return(NULL);
+}
+
+static void run_mwtransform_jobs(MWtransform_job *jobs, int njobs,
+	MWbasis *basis, int nbasis, Tbl **decimators, int nbands)
+{
+	MWtransform_pool pool;
+	pthread_t *tid;
+	int i,nthreads;
+
+	if(njobs<=0) return;
+	pool.jobs = jobs;
+	pool.njobs = njobs;
+	pool.next = 0;
+	pool.basis = basis;
+	pool.nbasis = nbasis;
+	pool.decimators = decimators;
+	pool.nbands = nbands;
+	pthread_mutex_init(&(pool.lock),NULL);
+
+	nthreads = mwtransform_threads;
+	if(nthreads<=0) nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if(nthreads>njobs) nthreads = njobs;
+	if(nthreads<=1)
+	{
+		mwtransform_worker(&pool);
+	}
+	else
+	{
+		allot(pthread_t *,tid,nthreads);
+		for(i=0;i<nthreads;++i)
+		{
+			if(pthread_create(tid+i,NULL,mwtransform_worker,&pool))
+			{
+				elog_complain(1,"tr_mwtransform:  pthread_create failed; using %d threads\n",i);
+				break;
+			}
+		}
+		/* If no threads could be started do the work here */
+		if(i==0) mwtransform_worker(&pool);
+		nthreads = i;
+		for(i=0;i<nthreads;++i) pthread_join(tid[i],NULL);
+		free(tid);
+	}
+	pthread_mutex_destroy(&(pool.lock));
+}
+
 /* This function is the main multiwavelet transform routine.  It computes
 multiwavelet transforms in a group of band dependent time windows relative
 to a set of arrival times.   The code is drastically complicated by
@@ -96,7 +197,10 @@ Arguments:
 
 
 Returns an associate array keyed by sta/chan of MWtrace ** pointers
-returned by MWtransform routine. 
+returned by MWtransform routine.   The transforms are computed in 
+parallel using the number of threads set with set_mwtransform_threads
+(default is one per processor).  Results do not depend on the number
+of threads.
 
 Numerous complaint messages can come from this routine.  It will always
 return something even if the arr is empty.  It dies only on malloc
@@ -136,8 +240,10 @@ Arr *tr_mwtransform(
 	int istart; 
 	int points_to_process;
 	MWtrace ***mwt; 
-	char *key;
 	Arr *result=newarr(0);  /* output associative array keyed by key */
+	MWtransform_job *jobs=NULL;
+	int njobs=0,maxjobs=0;
+	int i;
 
 	/* This function returns the largest time window required
 	in all bands.  */
@@ -270,17 +376,35 @@ fprintf(stderr,"DEBUG:  entered gap loop for %s:%s\n",sta,chan);
 					sta,chan,strtime(swtime),
 					points_to_process);
 		}
+		/* The transforms themselves are computed below after
+		all the database work is done */
+		if(njobs>=maxjobs)
+		{
+			maxjobs = 2*maxjobs + 16;
+			jobs = (MWtransform_job *)realloc(jobs,
+					maxjobs*sizeof(MWtransform_job));
+			if(jobs == NULL) elog_die(0,"tr_mwtransform:  cannot alloc job list of length %d\n",maxjobs);
+		}
+		jobs[njobs].key = make_mw_key(sta,chan);
+		jobs[njobs].trace = trdata+istart;
+		jobs[njobs].si = si;
+		jobs[njobs].starttime = swtime;
+		jobs[njobs].nsamples = points_to_process;
+		jobs[njobs].mwt = NULL;
+		++njobs;
+	}
+	run_mwtransform_jobs(jobs,njobs,basis,nbasis,decimators,nbands);
+	for(i=0;i<njobs;++i)
+	{
 		/* Need to allot this pointer so we can load it into the
 		arr below.  setarr requires pointers stored in static 
 		memory*/
 		allot(MWtrace ***,mwt,1);
-		*(mwt) = MWtransform(trdata+istart,
-				si,swtime,points_to_process,
-				basis, nbasis, decimators, nbands);
-		key = make_mw_key(sta,chan);
-		setarr(result,key,mwt);
-		free(key);
+		*(mwt) = jobs[i].mwt;
+		setarr(result,jobs[i].key,mwt);
+		free(jobs[i].key);
 	}
+	free(jobs);
 	return(result);
 }
 /*This pair of function create and destroy a MWgather structure
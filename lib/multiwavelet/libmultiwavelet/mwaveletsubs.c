@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <perf.h>
 
 #include "stock.h"
@@ -170,6 +171,8 @@ MWtrace **MWtransform(float *trace, double dt, double starttime, int nsamples,
 	int decfac=1, dec_this_stage=1;  /* total and current decimation
 					factor respectively */
 	int nout,n_this_band;
+	int maxn;  /* longest basis function */
+	FFTconv_trace *ftrace;  /* saved spectrum of newtrace */
 
 	/* Create the workspace matrix */
 	allmw = MWmatrix(0,nbands-1,0,nbasis-1);
@@ -181,8 +184,11 @@ MWtrace **MWtransform(float *trace, double dt, double starttime, int nsamples,
 
 
 	/* We copy trace to a work space where it will be successively
-	decimated */
-	scopy(nsamples,trace,1,work,1);
+	decimated.  memcpy rather than perf's scopy because this runs
+	in tr_mwtransform's threads */
+	memcpy(work,trace,nsamples*sizeof(float));
+	for(j=0,maxn=0;j<nbasis;++j)
+		if(basis[j].n > maxn) maxn = basis[j].n;
 
 	/* Now work through adjacent bands */
 	for(i=0,dtprevious=dt,stprevious=starttime,n_this_band=nsamples;i<nbands;++i)
@@ -220,7 +226,14 @@ MWtrace **MWtransform(float *trace, double dt, double starttime, int nsamples,
 			
 		/* Now we convolve each wavelet basis function
 		with the trace data held in the newtrace vector and
-		build the complete set of traces for this band */
+		build the complete set of traces for this band.
+		When the basis functions are long enough that it pays
+		we compute the spectrum of newtrace once here and 
+		apply every wavelet in the frequency domain.  */
+		if(fftconv_preferred(n,maxn,1,nbasis))
+			ftrace = fftconv_trace_create(newtrace,n,maxn);
+		else
+			ftrace = NULL;
 		for(j=0;j<nbasis;++j)
 		{
 			allmw[i][j].dt = dtnew;
@@ -241,6 +254,26 @@ MWtrace **MWtransform(float *trace, double dt, double starttime, int nsamples,
 			allmw[i][j].starttime = stime
 				+ ((double)((basis[j].n)-1)*dtnew/2.0);
 				
+			if(ftrace != NULL)
+			{
+				allot(complex *,z,n);
+				if(fftconv(ftrace,basis[j].r,basis[j].i,
+					basis[j].n,0,1,z,&nout) < 0)
+				{
+					elog_log(0,"Multiwavelet transform for wavelet %d in band %d has zero length\n",
+						j,i);
+					allmw[i][j].nz = 0;
+					free(z);
+				}
+				else
+				{
+					allmw[i][j].z = z;
+					allmw[i][j].endtime = allmw[i][j].starttime
+						+ dtnew*((double)nout);
+					allmw[i][j].nz = nout;
+				}
+				continue;
+			}
 			re_work = (float *)calloc(n,sizeof(float));
 			im_work = (float *)calloc(n,sizeof(float));
 			if( (re_work == NULL) || (im_work == NULL))
@@ -271,6 +304,7 @@ MWtrace **MWtransform(float *trace, double dt, double starttime, int nsamples,
 			free(re_work);
 			free(im_work);
 		}
+		free_fftconv_trace(ftrace);
 		dtprevious = dtnew;
 		stprevious = stime;
 		/* This is weird, but it basically clears the workspace, and the
@@ -0,0 +1,376 @@
+/* Streaming multistage FIR decimator.  See firdec.h for a description.
+
+This is the common decimation engine used by dbdec, dbheli and the
+seispp Decimator object.   It replaces three separate implementations
+that each filtered complete traces one stage at a time.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "firdec.h"
+
+/* Inner product of a filter with a window of data.   Four partial sums
+break the dependency chain so the loop pipelines and vectorizes. */
+static double
+fir_dot (const double *c, const double *x, int n)
+{
+	double s0=0.0, s1=0.0, s2=0.0, s3=0.0;
+	int i;
+
+	for (i=0; i+3<n; i+=4) {
+		s0 += c[i]*x[i];
+		s1 += c[i+1]*x[i+1];
+		s2 += c[i+2]*x[i+2];
+		s3 += c[i+3]*x[i+3];
+	}
+	for (; i<n; i++) s0 += c[i]*x[i];
+	return ((s0+s1)+(s2+s3));
+}
+
+/* Same for a symmetric filter of length 2*lag+1 centered on x[lag].
+Only the right half of the filter (c[lag] ... c[2*lag]) is used. */
+static double
+fir_dot_symmetric (const double *c, const double *x, int lag)
+{
+	const double *cr=c+lag;
+	const double *xc=x+lag;
+	double s0=0.0, s1=0.0;
+	int k;
+
+	for (k=1; k+1<=lag; k+=2) {
+		s0 += cr[k]*(xc[k]+xc[-k]);
+		s1 += cr[k+1]*(xc[k+1]+xc[-k-1]);
+	}
+	for (; k<=lag; k++) s0 += cr[k]*(xc[k]+xc[-k]);
+	return (cr[0]*xc[0] + (s0+s1));
+}
+
+static int
+stage_reserve (FIRdec_stage *st, long n)
+{
+	double *newbuf;
+
+	if (n <= st->bufsize) return (0);
+	newbuf = (double *) realloc (st->buf, n*sizeof(double));
+	if (newbuf == NULL) return (-1);
+	st->buf = newbuf;
+	st->bufsize = n;
+	return (0);
+}
+
+static void
+stage_reset (FIRdec_stage *st, int ioff)
+{
+	st->nbuf = 0;
+	st->buf0 = 0;
+	st->next = ioff;
+	st->nin = 0;
+	st->ioff = ioff;
+	st->started = 0;
+}
+
+/* Compute all outputs for which the full filter window is in the buffer,
+then discard samples no longer needed. */
+static long
+stage_run (FIRdec_stage *st, double *out, long limit)
+{
+	long nout=0;
+	long right=st->ncoefs-1-st->lag;
+	long last=st->buf0+st->nbuf-1;
+	long keep;
+
+	while (st->next+right <= last && st->next < limit) {
+		double *x=st->buf+(st->next-st->lag-st->buf0);
+		if (st->symmetric)
+			out[nout] = fir_dot_symmetric (st->coefs, x, st->lag);
+		else
+			out[nout] = fir_dot (st->coefs, x, st->ncoefs);
+		nout++;
+		st->next += st->decfac;
+	}
+	keep = st->next-st->lag-st->buf0;
+	if (keep > st->nbuf) keep = st->nbuf;
+	if (keep > 0) {
+		memmove (st->buf, st->buf+keep, (st->nbuf-keep)*sizeof(double));
+		st->nbuf -= keep;
+		st->buf0 += keep;
+	}
+	return (nout);
+}
+
+static long
+stage_push (FIRdec_stage *st, int edge, double *in, long n, double *out)
+{
+	long i;
+
+	if (n <= 0) return (0);
+	if (!st->started) {
+		double pad=(edge==FIRDEC_EDGE_CONSTANT) ? in[0] : 0.0;
+		if (stage_reserve (st, st->lag+n) < 0) return (-1);
+		for (i=0; i<st->lag; i++) st->buf[i] = pad;
+		st->nbuf = st->lag;
+		st->buf0 = -st->lag;
+		st->started = 1;
+	}
+	if (stage_reserve (st, st->nbuf+n) < 0) return (-1);
+	memcpy (st->buf+st->nbuf, in, n*sizeof(double));
+	st->nbuf += n;
+	st->nin += n;
+	return (stage_run (st, out, st->nin));
+}
+
+static long
+stage_flush (FIRdec_stage *st, int edge, double *out)
+{
+	long i, n, nout;
+	double pad;
+
+	if (!st->started) return (0);
+	n = st->ncoefs-1-st->lag;
+	pad = (edge==FIRDEC_EDGE_CONSTANT && st->nbuf > 0) ? st->buf[st->nbuf-1] : 0.0;
+	if (stage_reserve (st, st->nbuf+n) < 0) return (-1);
+	for (i=0; i<n; i++) st->buf[st->nbuf+i] = pad;
+	st->nbuf += n;
+	nout = stage_run (st, out, st->nin);
+	stage_reset (st, 0);
+	return (nout);
+}
+
+static int
+work_reserve (FIRdec *fd, long n)
+{
+	double *w0, *w1;
+
+	if (n <= fd->worksize) return (0);
+	w0 = (double *) realloc (fd->work[0], n*sizeof(double));
+	if (w0 == NULL) return (-1);
+	fd->work[0] = w0;
+	w1 = (double *) realloc (fd->work[1], n*sizeof(double));
+	if (w1 == NULL) return (-1);
+	fd->work[1] = w1;
+	fd->worksize = n;
+	return (0);
+}
+
+FIRdec *
+firdec_new (int edge)
+{
+	FIRdec *fd;
+
+	fd = (FIRdec *) calloc (1, sizeof(FIRdec));
+	if (fd == NULL) return (NULL);
+	fd->edge = edge;
+	return (fd);
+}
+
+void
+firdec_free (FIRdec *fd)
+{
+	int i;
+
+	if (fd == NULL) return;
+	for (i=0; i<fd->nstages; i++) {
+		free (fd->stages[i].coefs);
+		free (fd->stages[i].buf);
+	}
+	free (fd->stages);
+	free (fd->work[0]);
+	free (fd->work[1]);
+	free (fd);
+}
+
+/* Append a stage defined by the full set of ncoefs coefficients with the
+zero lag point at coefs[lag].  Returns 0 on success, -1 on error. */
+int
+firdec_add_stage (FIRdec *fd, int decfac, int ncoefs, double *coefs, int lag)
+{
+	FIRdec_stage *st, *newstages;
+	int i;
+
+	if (decfac < 1 || ncoefs < 1 || lag < 0 || lag >= ncoefs) return (-1);
+	newstages = (FIRdec_stage *) realloc (fd->stages,
+				(fd->nstages+1)*sizeof(FIRdec_stage));
+	if (newstages == NULL) return (-1);
+	fd->stages = newstages;
+	st = fd->stages + fd->nstages;
+	memset (st, 0, sizeof(FIRdec_stage));
+	st->coefs = (double *) malloc (ncoefs*sizeof(double));
+	if (st->coefs == NULL) return (-1);
+	memcpy (st->coefs, coefs, ncoefs*sizeof(double));
+	st->decfac = decfac;
+	st->ncoefs = ncoefs;
+	st->lag = lag;
+	st->symmetric = (ncoefs == 2*lag+1);
+	for (i=1; i<=lag && st->symmetric; i++)
+		if (coefs[lag-i] != coefs[lag+i]) st->symmetric = 0;
+	stage_reset (st, 0);
+	fd->nstages++;
+	return (0);
+}
+
+/* Append a symmetric stage stored as in the response file readers of
+dbdec and dbheli:  half[0] is the center coefficient and half[i] the
+coefficient at lag +-i. */
+int
+firdec_add_half_stage (FIRdec *fd, int decfac, int nhalf, float *half)
+{
+	double *full;
+	int i, n, ret;
+
+	n = 2*nhalf-1;
+	full = (double *) malloc (n*sizeof(double));
+	if (full == NULL) return (-1);
+	for (i=0; i<nhalf; i++) {
+		full[nhalf-1+i] = half[i];
+		full[nhalf-1-i] = half[i];
+	}
+	ret = firdec_add_stage (fd, decfac, n, full, nhalf-1);
+	free (full);
+	return (ret);
+}
+
+int
+firdec_decfac (FIRdec *fd)
+{
+	int i, d;
+
+	for (i=0,d=1; i<fd->nstages; i++) d *= fd->stages[i].decfac;
+	return (d);
+}
+
+/* Clear all state.  The first output of the first stage will be centered
+on input sample ioff.  Later stages start with their first input. */
+void
+firdec_reset (FIRdec *fd, int ioff)
+{
+	int i;
+
+	for (i=0; i<fd->nstages; i++) stage_reset (fd->stages+i, (i==0) ? ioff : 0);
+}
+
+/* Clear all state and set each stage so its output samples fall on a
+grid of the output sample interval referenced to time tref.  t0 and dt
+are the time of the first input sample and the input sample interval.
+Returns the time of the first output sample. */
+double
+firdec_align (FIRdec *fd, double t0, double dt, double tref)
+{
+	int i, ioff, decfac;
+	long k;
+
+	for (i=0; i<fd->nstages; i++) {
+		decfac = fd->stages[i].decfac;
+		/* k is the input sample number relative to tref, which can be
+		negative or larger than an int for epoch times.  ioff is the
+		number of samples to the next multiple of decfac. */
+		k = (long) floor ((t0-tref)/dt + 0.5);
+		ioff = (int) (k % decfac);
+		if (ioff < 0) ioff += decfac;
+		ioff = (decfac - ioff) % decfac;
+		stage_reset (fd->stages+i, ioff);
+		t0 += ioff*dt;
+		dt *= decfac;
+	}
+	return (t0);
+}
+
+/* Upper bound on the number of output samples produced by pushing nin
+samples (or by a flush when nin is 0).  Use this to size output buffers. */
+long
+firdec_maxout (FIRdec *fd, long nin)
+{
+	long n=nin;
+	int i;
+
+	for (i=0; i<fd->nstages; i++) {
+		FIRdec_stage *st=fd->stages+i;
+		n = (n+2*st->ncoefs+st->decfac)/st->decfac + 2;
+	}
+	return (n);
+}
+
+/* Largest number of samples passed between two stages */
+static long
+interstage_size (FIRdec *fd, long nin)
+{
+	long n=nin, nmax=1;
+	int i;
+
+	for (i=0; i<fd->nstages-1; i++) {
+		FIRdec_stage *st=fd->stages+i;
+		n = (n+2*st->ncoefs+st->decfac)/st->decfac + 2;
+		if (n > nmax) nmax = n;
+	}
+	return (nmax);
+}
+
+/* Push nin samples through the chain.   Output is written to out, which
+must hold at least firdec_maxout(fd,nin) values.   Returns the number
+of output samples or -1 on a memory allocation error. */
+long
+firdec_process (FIRdec *fd, double *in, long nin, double *out)
+{
+	double *src, *dst;
+	long n;
+	int i;
+
+	if (fd->nstages <= 0) {
+		memcpy (out, in, nin*sizeof(double));
+		return (nin);
+	}
+	if (work_reserve (fd, interstage_size (fd, nin)) < 0) return (-1);
+	src = in;
+	n = nin;
+	for (i=0; i<fd->nstages; i++) {
+		dst = (i==fd->nstages-1) ? out : fd->work[i%2];
+		n = stage_push (fd->stages+i, fd->edge, src, n, dst);
+		if (n < 0) return (-1);
+		src = dst;
+	}
+	return (n);
+}
+
+/* Same as firdec_process for single precision input. */
+long
+firdec_process_float (FIRdec *fd, float *in, long nin, double *out)
+{
+	double buf[4096];
+	long i, j, n, nout=0;
+
+	for (i=0; i<nin; i+=n) {
+		n = nin-i;
+		if (n > 4096) n = 4096;
+		for (j=0; j<n; j++) buf[j] = in[i+j];
+		j = firdec_process (fd, buf, n, out+nout);
+		if (j < 0) return (-1);
+		nout += j;
+	}
+	return (nout);
+}
+
+/* Drain the chain at the end of a segment.  out must hold at least
+firdec_maxout(fd,0) values.  The object is left reset with ioff 0. */
+long
+firdec_flush (FIRdec *fd, double *out)
+{
+	double *src, *dst;
+	long n, m;
+	int i;
+
+	if (fd->nstages <= 0) return (0);
+	if (work_reserve (fd, interstage_size (fd, 0)) < 0) return (-1);
+	src = NULL;
+	n = 0;
+	for (i=0; i<fd->nstages; i++) {
+		dst = (i==fd->nstages-1) ? out : fd->work[i%2];
+		if (n > 0) {
+			n = stage_push (fd->stages+i, fd->edge, src, n, dst);
+			if (n < 0) return (-1);
+		}
+		m = stage_flush (fd->stages+i, fd->edge, dst+n);
+		if (m < 0) return (-1);
+		n += m;
+		src = dst;
+	}
+	return (n);
+}
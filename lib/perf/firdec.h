@@ -0,0 +1,66 @@
+#ifndef _FIRDEC_H_
+#define _FIRDEC_H_
+/* Streaming multistage FIR decimator.
+
+A FIRdec object holds a chain of FIR decimation stages.  Data are pushed
+through the chain in blocks of any size with firdec_process and each
+stage carries the filter state (the last ncoefs samples) from one block
+to the next, so an arbitrarily long continuous record can be decimated
+with memory bounded by the block size.  Only the output samples that
+are retained are computed (the polyphase form of a decimating FIR) and
+the inner products run over contiguous memory with symmetric filters
+folded to halve the multiplies.
+
+Output sample k of a stage is centered on input sample ioff+k*decfac
+where ioff is set by firdec_reset or firdec_align.  Data beyond either
+end of a segment are taken as zero (FIRDEC_EDGE_ZERO) or as the value
+of the end sample (FIRDEC_EDGE_CONSTANT).  Call firdec_flush at the end
+of a segment (e.g. at a data gap) to drain the chain and then
+firdec_reset or firdec_align before pushing the next segment.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIRDEC_EDGE_ZERO 0
+#define FIRDEC_EDGE_CONSTANT 1
+
+typedef struct FIRdec_stage {
+	int decfac;
+	int ncoefs;
+	int lag;		/* index in coefs of zero lag point */
+	int symmetric;		/* nonzero if folded inner product is used */
+	double *coefs;
+	double *buf;		/* history plus pending input */
+	long nbuf, bufsize;
+	long buf0;		/* sample number of buf[0] */
+	long next;		/* sample number of next output center */
+	long nin;		/* number of input samples received */
+	int ioff;
+	int started;
+} FIRdec_stage;
+
+typedef struct FIRdec {
+	int edge;
+	int nstages;
+	FIRdec_stage *stages;
+	double *work[2];	/* interstage buffers */
+	long worksize;
+} FIRdec;
+
+FIRdec *firdec_new(int edge);
+void firdec_free(FIRdec *fd);
+int firdec_add_stage(FIRdec *fd, int decfac, int ncoefs, double *coefs, int lag);
+int firdec_add_half_stage(FIRdec *fd, int decfac, int nhalf, float *half);
+int firdec_decfac(FIRdec *fd);
+void firdec_reset(FIRdec *fd, int ioff);
+double firdec_align(FIRdec *fd, double t0, double dt, double tref);
+long firdec_maxout(FIRdec *fd, long nin);
+long firdec_process(FIRdec *fd, double *in, long nin, double *out);
+long firdec_process_float(FIRdec *fd, float *in, long nin, double *out);
+long firdec_flush(FIRdec *fd, double *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,779 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include "stock.h"
+#include "orb.h"
+#include "ingest.h"
+
+/* Multiplexed packet ingestion.  See ingest.h and ingest(3). */
+
+#define PORT_CLOSED	0
+#define PORT_CONNECTING	1
+#define PORT_OPEN	2
+#define PORT_DONE	3	/* closed for good (ingest_add_fd) */
+
+#define KIND_TCP	0
+#define KIND_DEVICE	1
+#define KIND_FD		2
+
+#define INGEST_BATCH		64	/* packets moved per lock */
+#define INGEST_MAXEVENTS	256
+#define INGEST_ORB_ERRORS	30	/* orbput failures before reopening */
+
+typedef struct IngestPort {
+	char	*name;
+	int	kind;
+	int	default_port;
+	int	fd;
+	int	state;
+	double	last_input;	/* time data was last read */
+	double	next_open;	/* earliest time of the next open attempt */
+	int	failures;	/* consecutive open failures */
+	unsigned char *stage;	/* bytes read but not yet framed */
+	int	nstage;
+	IngestFramer frame;
+	IngestConvert convert;
+	void	*arg;
+	/* Counters; npackets, nbytes and ndiscard belong to the reader,
+	nput and nrejected are updated under the pool lock */
+	long	npackets, nbytes, ndiscard, nput, nrejected;
+} IngestPort;
+
+struct Ingest {
+	char	*orbname;
+	int	orb;
+	int	orb_errors;
+	double	timeout, retry;
+	IngestPort *ports;
+	int	nports;
+	int	stagesize;
+	/* The packet pool and the queue to the writer */
+	int	npackets, packet_size;
+	unsigned char *slab;
+	IngestPacket *packets;
+	IngestPacket **freelist;
+	int	nfree;
+	IngestPacket **queue;	/* ring of npackets entries */
+	int	qhead, qcount;
+	pthread_mutex_t lock;
+	pthread_cond_t queued, released;
+	long	nstalls;	/* times the reader waited for a buffer */
+	/* Reader side, touched only by the thread in ingest_run */
+	IngestPacket **stash;	/* free buffers taken from the pool */
+	int	nstash;
+	IngestPacket **pending;	/* framed packets not yet queued */
+	int	npending;
+	int	epfd;
+	volatile sig_atomic_t stop;
+	int	reader_done;
+};
+
+static void
+deadline ( struct timespec *ts, double seconds )
+{
+	struct timeval tv;
+	double	t;
+
+	gettimeofday ( &tv, NULL );
+	t = tv.tv_sec + tv.tv_usec * 1.0e-6 + seconds;
+	ts->tv_sec = (time_t) t;
+	ts->tv_nsec = (long) ((t - (double) ts->tv_sec) * 1.0e9);
+}
+
+/* Create an Ingest that puts packets on orbname.  npackets buffers of
+packet_size bytes are allocated once; packet_size bounds the length of
+any packet a framer may return.  A port that delivers nothing for
+timeout seconds is reopened (0 disables the check); a port that cannot
+be opened is retried every retry seconds. */
+Ingest *
+ingest_new ( char *orbname, int npackets, int packet_size,
+	double timeout, double retry )
+{
+	Ingest	*in;
+	int	i;
+
+	if ( npackets < 2 || packet_size < 1 ) {
+		elog_die ( 0, "ingest_new: invalid pool of %d packets of %d bytes\n",
+			npackets, packet_size );
+	}
+	allot ( Ingest *, in, 1 );
+	in->orbname = strdup ( orbname );
+	in->orb = -1;
+	in->orb_errors = 0;
+	in->timeout = timeout;
+	in->retry = retry > 0.0 ? retry : 10.0;
+	in->ports = NULL;
+	in->nports = 0;
+	in->stagesize = 2 * packet_size < 8192 ? 8192 : 2 * packet_size;
+	in->npackets = npackets;
+	in->packet_size = packet_size;
+	allot ( unsigned char *, in->slab, (size_t) npackets * packet_size );
+	allot ( IngestPacket *, in->packets, npackets );
+	allot ( IngestPacket **, in->freelist, npackets );
+	allot ( IngestPacket **, in->queue, npackets );
+	allot ( IngestPacket **, in->stash, INGEST_BATCH );
+	allot ( IngestPacket **, in->pending, npackets );
+	for ( i = 0; i < npackets; i++ ) {
+		in->packets[i].data = in->slab + (size_t) i * packet_size;
+		in->freelist[i] = &(in->packets[i]);
+	}
+	in->nfree = npackets;
+	in->qhead = in->qcount = 0;
+	in->nstash = in->npending = 0;
+	in->nstalls = 0;
+	pthread_mutex_init ( &in->lock, NULL );
+	pthread_cond_init ( &in->queued, NULL );
+	pthread_cond_init ( &in->released, NULL );
+	in->epfd = -1;
+	in->stop = 0;
+	in->reader_done = 0;
+	/* Fail at startup, as the programs always have, if the orb
+	cannot be opened at all.  Only later reopens are retried. */
+	if ( (in->orb = orbopen ( in->orbname, "w&" )) < 0 ) {
+		elog_die ( 0, "ingest_new: cannot open orb %s\n", in->orbname );
+	}
+	return in;
+}
+
+static int
+add_port ( Ingest *in, char *name, int kind, int fd,
+	IngestFramer frame, IngestConvert convert, void *arg )
+{
+	IngestPort *p;
+
+	if ( in->nports == 0 ) {
+		allot ( IngestPort *, in->ports, 1 );
+	} else {
+		reallot ( IngestPort *, in->ports, in->nports + 1 );
+	}
+	p = &(in->ports[in->nports]);
+	memset ( p, 0, sizeof(IngestPort) );
+	p->name = strdup ( name );
+	p->kind = kind;
+	p->fd = fd;
+	p->state = fd >= 0 ? PORT_OPEN : PORT_CLOSED;
+	p->frame = frame;
+	p->convert = convert;
+	p->arg = arg;
+	allot ( unsigned char *, p->stage, in->stagesize );
+	return in->nports++;
+}
+
+/* Read from a TCP server given as host:port (or host, to use
+default_port).  The connection is made and remade by ingest_run. */
+int
+ingest_add_tcp ( Ingest *in, char *address, int default_port,
+	IngestFramer frame, IngestConvert convert, void *arg )
+{
+	int	id;
+
+	id = add_port ( in, address, KIND_TCP, -1, frame, convert, arg );
+	in->ports[id].default_port = default_port;
+	return id;
+}
+
+/* Read from a character device such as a serial line.  Line settings
+are whatever the device has when it is opened (see stty(1)). */
+int
+ingest_add_device ( Ingest *in, char *path,
+	IngestFramer frame, IngestConvert convert, void *arg )
+{
+	return add_port ( in, path, KIND_DEVICE, -1, frame, convert, arg );
+}
+
+/* Read from a descriptor opened by the caller.  It is not reopened;
+once it fails or reaches end of file the port is finished. */
+int
+ingest_add_fd ( Ingest *in, char *name, int fd,
+	IngestFramer frame, IngestConvert convert, void *arg )
+{
+	fcntl ( fd, F_SETFL, fcntl ( fd, F_GETFL ) | O_NONBLOCK );
+	return add_port ( in, name, KIND_FD, fd, frame, convert, arg );
+}
+
+char *
+ingest_port_name ( Ingest *in, int port )
+{
+	return in->ports[port].name;
+}
+
+static void
+watch_port ( Ingest *in, int id )
+{
+#ifdef __linux__
+	struct epoll_event ev;
+	IngestPort *p = &(in->ports[id]);
+
+	memset ( &ev, 0, sizeof(ev) );
+	ev.events = p->state == PORT_CONNECTING ? EPOLLOUT : EPOLLIN;
+	ev.data.u32 = id;
+	if ( epoll_ctl ( in->epfd, EPOLL_CTL_ADD, p->fd, &ev ) < 0
+	  && ( errno != EEXIST
+	    || epoll_ctl ( in->epfd, EPOLL_CTL_MOD, p->fd, &ev ) < 0 ) ) {
+		elog_complain ( 1, "ingest: cannot watch %s\n", p->name );
+	}
+#endif
+}
+
+static void
+close_port ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+
+	if ( p->fd >= 0 ) {
+#ifdef __linux__
+		epoll_ctl ( in->epfd, EPOLL_CTL_DEL, p->fd, NULL );
+#endif
+		close ( p->fd );
+		p->fd = -1;
+	}
+	p->nstage = 0;
+	p->state = p->kind == KIND_FD ? PORT_DONE : PORT_CLOSED;
+	p->next_open = now () + in->retry;
+}
+
+static void
+opened ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+
+	if ( p->failures > 0 ) {
+		elog_notify ( 0, "ingest: connected to %s after %d failures\n",
+			p->name, p->failures );
+	} else {
+		elog_notify ( 0, "ingest: reading %s\n", p->name );
+	}
+	p->failures = 0;
+	p->state = PORT_OPEN;
+	p->last_input = now ();
+	watch_port ( in, id );
+}
+
+static void
+open_failed ( Ingest *in, int id, char *why )
+{
+	IngestPort *p = &(in->ports[id]);
+
+	if ( p->failures++ == 0 ) {
+		elog_complain ( 1, "ingest: %s %s, retrying every %.0f s\n",
+			why, p->name, in->retry );
+	}
+	close_port ( in, id );
+}
+
+static void
+open_tcp ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+	struct addrinfo hints, *ai;
+	char	host[256], service[32], *colon;
+	int	fd;
+
+	strncpy ( host, p->name, sizeof(host) - 1 );
+	host[sizeof(host)-1] = '\0';
+	sprintf ( service, "%d", p->default_port );
+	if ( (colon = strrchr ( host, ':' )) != NULL ) {
+		*colon++ = '\0';
+		if ( *colon != '\0' ) {
+			strncpy ( service, colon, sizeof(service) - 1 );
+			service[sizeof(service)-1] = '\0';
+		}
+	}
+	if ( host[0] == '\0' ) {
+		strcpy ( host, "localhost" );
+	}
+	memset ( &hints, 0, sizeof(hints) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ( getaddrinfo ( host, service, &hints, &ai ) != 0 ) {
+		open_failed ( in, id, "cannot resolve" );
+		return;
+	}
+	if ( (fd = socket ( ai->ai_family, ai->ai_socktype, ai->ai_protocol )) < 0 ) {
+		freeaddrinfo ( ai );
+		open_failed ( in, id, "cannot create a socket for" );
+		return;
+	}
+	fcntl ( fd, F_SETFL, fcntl ( fd, F_GETFL ) | O_NONBLOCK );
+	fcntl ( fd, F_SETFD, FD_CLOEXEC );
+	p->fd = fd;
+	if ( connect ( fd, ai->ai_addr, ai->ai_addrlen ) == 0 ) {
+		opened ( in, id );
+	} else if ( errno == EINPROGRESS ) {
+		p->state = PORT_CONNECTING;
+		p->last_input = now ();
+		watch_port ( in, id );
+	} else {
+		open_failed ( in, id, "cannot connect to" );
+	}
+	freeaddrinfo ( ai );
+}
+
+/* A non-blocking connect finished, successfully or not */
+static void
+connected ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+	int	err = 0;
+	socklen_t len = sizeof(err);
+
+	if ( getsockopt ( p->fd, SOL_SOCKET, SO_ERROR, &err, &len ) < 0 ) {
+		err = errno;
+	}
+	if ( err != 0 ) {
+		errno = err;
+		open_failed ( in, id, "cannot connect to" );
+	} else {
+		opened ( in, id );
+	}
+}
+
+static void
+open_port ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+
+	if ( p->kind == KIND_TCP ) {
+		open_tcp ( in, id );
+	} else if ( (p->fd = open ( p->name, O_RDONLY | O_NONBLOCK | O_NOCTTY )) < 0 ) {
+		open_failed ( in, id, "cannot open" );
+	} else {
+		fcntl ( p->fd, F_SETFD, FD_CLOEXEC );
+		opened ( in, id );
+	}
+}
+
+/* Hand the framed packets to the writer.  Called with the lock held. */
+static void
+queue_pending ( Ingest *in )
+{
+	int	i;
+
+	for ( i = 0; i < in->npending; i++ ) {
+		in->queue[(in->qhead + in->qcount++) % in->npackets] = in->pending[i];
+	}
+	if ( in->npending > 0 ) {
+		pthread_cond_signal ( &in->queued );
+	}
+	in->npending = 0;
+}
+
+static void
+publish ( Ingest *in )
+{
+	if ( in->npending > 0 ) {
+		pthread_mutex_lock ( &in->lock );
+		queue_pending ( in );
+		pthread_mutex_unlock ( &in->lock );
+	}
+}
+
+/* Take a free buffer, refilling the reader's stash from the pool a
+batch at a time.  Waits while the pool is empty; returns NULL only if
+the Ingest is being stopped. */
+static IngestPacket *
+get_buffer ( Ingest *in )
+{
+	struct timespec ts;
+	int	stalled = 0;
+
+	if ( in->nstash == 0 ) {
+		pthread_mutex_lock ( &in->lock );
+		while ( in->nfree == 0 && ! in->stop ) {
+			queue_pending ( in );
+			if ( ! stalled ) {
+				stalled = 1;
+				in->nstalls++;
+			}
+			deadline ( &ts, 1.0 );
+			pthread_cond_timedwait ( &in->released, &in->lock, &ts );
+		}
+		while ( in->nfree > 0 && in->nstash < INGEST_BATCH ) {
+			in->stash[in->nstash++] = in->freelist[--in->nfree];
+		}
+		pthread_mutex_unlock ( &in->lock );
+		if ( in->nstash == 0 ) {
+			return NULL;
+		}
+	}
+	return in->stash[--in->nstash];
+}
+
+/* Split the staged bytes of a port into packets */
+static void
+frame_port ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+	IngestPacket *pkt;
+	int	off = 0, avail, r;
+
+	while ( off < p->nstage ) {
+		avail = p->nstage - off;
+		r = p->frame ( p->arg, p->stage + off, avail );
+		if ( r == 0 || r > avail ) {
+			if ( off == 0 && p->nstage == in->stagesize ) {
+				elog_complain ( 0, "ingest: no packet boundary in %d bytes "
+					"from %s, resynchronizing\n", p->nstage, p->name );
+				off = 1;
+				p->ndiscard++;
+			}
+			break;
+		} else if ( r == INGEST_RECONNECT ) {
+			close_port ( in, id );
+			p->next_open = now ();
+			return;
+		} else if ( r < 0 ) {
+			r = -r < avail ? -r : avail;
+			off += r;
+			p->ndiscard += r;
+		} else if ( r > in->packet_size ) {
+			elog_complain ( 0, "ingest: discarding %d byte packet from %s, "
+				"larger than %d bytes\n", r, p->name, in->packet_size );
+			off += r;
+			p->ndiscard += r;
+		} else {
+			if ( (pkt = get_buffer ( in )) == NULL ) {
+				break;
+			}
+			memcpy ( pkt->data, p->stage + off, r );
+			pkt->nbytes = r;
+			pkt->port = id;
+			pkt->received = p->last_input;
+			in->pending[in->npending++] = pkt;
+			p->npackets++;
+			off += r;
+		}
+	}
+	if ( off > 0 ) {
+		p->nstage -= off;
+		memmove ( p->stage, p->stage + off, p->nstage );
+	}
+}
+
+static void
+read_port ( Ingest *in, int id )
+{
+	IngestPort *p = &(in->ports[id]);
+	long	n;
+
+	n = read ( p->fd, p->stage + p->nstage, in->stagesize - p->nstage );
+	if ( n > 0 ) {
+		p->nstage += n;
+		p->nbytes += n;
+		p->last_input = now ();
+		frame_port ( in, id );
+	} else if ( n == 0 ) {
+		elog_complain ( 0, "ingest: end of file on %s\n", p->name );
+		close_port ( in, id );
+	} else if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) {
+		elog_complain ( 1, "ingest: read error on %s\n", p->name );
+		close_port ( in, id );
+	}
+}
+
+/* Open ports that are due and drop those that have gone quiet.
+Returns the number of ports that are not finished. */
+static int
+service_ports ( Ingest *in )
+{
+	IngestPort *p;
+	double	t = now ();
+	int	id, nlive = 0;
+
+	for ( id = 0; id < in->nports; id++ ) {
+		p = &(in->ports[id]);
+		if ( p->state == PORT_CLOSED && t >= p->next_open ) {
+			open_port ( in, id );
+		} else if ( p->state == PORT_CONNECTING
+		  && t - p->last_input > in->retry ) {
+			errno = ETIMEDOUT;
+			open_failed ( in, id, "timed out connecting to" );
+		} else if ( p->state == PORT_OPEN && in->timeout > 0.0
+		  && p->kind != KIND_FD && t - p->last_input > in->timeout ) {
+			elog_complain ( 0, "ingest: no data from %s for %.0f s, "
+				"reopening\n", p->name, t - p->last_input );
+			close_port ( in, id );
+			p->next_open = t;
+		}
+		if ( p->state != PORT_DONE ) {
+			nlive++;
+		}
+	}
+	return nlive;
+}
+
+/* Wait up to a second for input and service every port that has some */
+static void
+wait_ports ( Ingest *in )
+{
+	int	i, n, id;
+#ifdef __linux__
+	struct epoll_event events[INGEST_MAXEVENTS];
+
+	n = epoll_wait ( in->epfd, events, INGEST_MAXEVENTS, 1000 );
+	for ( i = 0; i < n; i++ ) {
+		id = events[i].data.u32;
+		if ( in->ports[id].state == PORT_CONNECTING ) {
+			connected ( in, id );
+		} else if ( in->ports[id].state == PORT_OPEN ) {
+			read_port ( in, id );
+		}
+	}
+#else
+	static struct pollfd *fds = NULL;
+	static int *ids = NULL, nfds = 0;
+
+	if ( nfds < in->nports ) {
+		nfds = in->nports;
+		reallot ( struct pollfd *, fds, nfds );
+		reallot ( int *, ids, nfds );
+	}
+	for ( id = 0, n = 0; id < in->nports; id++ ) {
+		if ( in->ports[id].state == PORT_OPEN
+		  || in->ports[id].state == PORT_CONNECTING ) {
+			fds[n].fd = in->ports[id].fd;
+			fds[n].events = in->ports[id].state == PORT_OPEN ? POLLIN : POLLOUT;
+			fds[n].revents = 0;
+			ids[n++] = id;
+		}
+	}
+	if ( poll ( fds, n, 1000 ) <= 0 ) {
+		return;
+	}
+	for ( i = 0; i < n; i++ ) {
+		if ( fds[i].revents == 0 ) {
+			continue;
+		}
+		id = ids[i];
+		if ( in->ports[id].state == PORT_CONNECTING ) {
+			connected ( in, id );
+		} else if ( in->ports[id].state == PORT_OPEN ) {
+			read_port ( in, id );
+		}
+	}
+#endif
+}
+
+static void
+orb_put ( Ingest *in, IngestPacket *pkt )
+{
+	while ( in->orb < 0 ) {
+		if ( (in->orb = orbopen ( in->orbname, "w&" )) >= 0 ) {
+			if ( in->orb_errors > 0 ) {
+				elog_notify ( 0, "ingest: reopened orb %s after %d attempts\n",
+					in->orbname, in->orb_errors + 1 );
+			}
+			in->orb_errors = 0;
+			break;
+		}
+		if ( in->orb_errors++ % 60 == 0 ) {
+			elog_complain ( 0, "ingest: cannot reopen orb %s, "
+				"retrying every second (%d attempts)\n",
+				in->orbname, in->orb_errors );
+		}
+		if ( in->stop && in->reader_done ) {
+			return;
+		}
+		sleep ( 1 );
+	}
+	if ( orbput ( in->orb, pkt->srcname, pkt->time, pkt->out, pkt->outsize ) < 0 ) {
+		elog_complain ( 0, "ingest: orbput of %s to %s failed\n",
+			pkt->srcname, in->orbname );
+		if ( ++in->orb_errors >= INGEST_ORB_ERRORS ) {
+			orbclose ( in->orb );
+			in->orb = -1;
+			in->orb_errors = 0;
+		}
+	} else {
+		in->orb_errors = 0;
+	}
+}
+
+/* The writer thread: take queued packets a batch at a time, convert
+them, put them on the orb and return the buffers to the pool */
+static void *
+orb_writer ( void *arg )
+{
+	Ingest	*in = (Ingest *) arg;
+	IngestPacket *batch[INGEST_BATCH], *pkt;
+	IngestPort *p;
+	int	status[INGEST_BATCH];
+	int	i, n;
+
+	for ( ;; ) {
+		pthread_mutex_lock ( &in->lock );
+		while ( in->qcount == 0 && ! in->reader_done ) {
+			pthread_cond_wait ( &in->queued, &in->lock );
+		}
+		if ( in->qcount == 0 ) {
+			pthread_mutex_unlock ( &in->lock );
+			break;
+		}
+		for ( n = 0; n < INGEST_BATCH && in->qcount > 0; n++ ) {
+			batch[n] = in->queue[in->qhead];
+			in->qhead = (in->qhead + 1) % in->npackets;
+			in->qcount--;
+		}
+		pthread_mutex_unlock ( &in->lock );
+
+		for ( i = 0; i < n; i++ ) {
+			pkt = batch[i];
+			p = &(in->ports[pkt->port]);
+			pkt->srcname[0] = '\0';
+			pkt->time = pkt->received;
+			pkt->out = (char *) pkt->data;
+			pkt->outsize = pkt->nbytes;
+			status[i] = p->convert != NULL ? p->convert ( p->arg, pkt ) : 0;
+			if ( status[i] == 0 && pkt->outsize <= 0 ) {
+				status[i] = -1;
+			}
+			if ( status[i] == 0 ) {
+				orb_put ( in, pkt );
+			}
+		}
+
+		pthread_mutex_lock ( &in->lock );
+		for ( i = 0; i < n; i++ ) {
+			p = &(in->ports[batch[i]->port]);
+			if ( status[i] == 0 ) {
+				p->nput++;
+			} else {
+				p->nrejected++;
+			}
+			in->freelist[in->nfree++] = batch[i];
+		}
+		pthread_cond_signal ( &in->released );
+		pthread_mutex_unlock ( &in->lock );
+	}
+	return NULL;
+}
+
+/* Read all ports until ingest_stop is called or every port added with
+ingest_add_fd is finished and there are no other ports.  Packets
+already read are written before the routine returns.  Returns 0, or -1
+if the writer thread cannot be started. */
+int
+ingest_run ( Ingest *in )
+{
+	pthread_t writer;
+	int	id;
+
+#ifdef __linux__
+	if ( in->epfd < 0 && (in->epfd = epoll_create ( in->nports + 1 )) < 0 ) {
+		elog_complain ( 1, "ingest: epoll_create failed\n" );
+		return -1;
+	}
+	for ( id = 0; id < in->nports; id++ ) {
+		if ( in->ports[id].state == PORT_OPEN ) {
+			watch_port ( in, id );
+		}
+	}
+#endif
+	in->reader_done = 0;
+	if ( pthread_create ( &writer, NULL, orb_writer, in ) != 0 ) {
+		elog_complain ( 1, "ingest: cannot start the orb writer thread\n" );
+		return -1;
+	}
+	while ( ! in->stop ) {
+		if ( service_ports ( in ) == 0 ) {
+			break;
+		}
+		wait_ports ( in );
+		publish ( in );
+	}
+	for ( id = 0; id < in->nports; id++ ) {
+		if ( in->ports[id].fd >= 0 ) {
+			close_port ( in, id );
+		}
+	}
+
+	pthread_mutex_lock ( &in->lock );
+	queue_pending ( in );
+	while ( in->nstash > 0 ) {
+		in->freelist[in->nfree++] = in->stash[--in->nstash];
+	}
+	in->reader_done = 1;
+	pthread_cond_signal ( &in->queued );
+	pthread_mutex_unlock ( &in->lock );
+	pthread_join ( writer, NULL );
+	return 0;
+}
+
+/* Make ingest_run return within about a second.  Safe to call from a
+signal handler or from a converter. */
+void
+ingest_stop ( Ingest *in )
+{
+	in->stop = 1;
+}
+
+/* Log packet counts for every port */
+void
+ingest_report ( Ingest *in )
+{
+	IngestPort *p;
+	int	id;
+	static char *states[] = { "closed", "connecting", "open", "finished" };
+
+	pthread_mutex_lock ( &in->lock );
+	for ( id = 0; id < in->nports; id++ ) {
+		p = &(in->ports[id]);
+		elog_notify ( 0, "%s: %s, %ld bytes, %ld packets, %ld sent, "
+			"%ld rejected, %ld bytes discarded\n",
+			p->name, states[p->state], p->nbytes, p->npackets,
+			p->nput, p->nrejected, p->ndiscard );
+	}
+	if ( in->nstalls > 0 ) {
+		elog_notify ( 0, "ingest: input paused %ld times waiting for "
+			"the orb (pool of %d packets)\n", in->nstalls, in->npackets );
+	}
+	pthread_mutex_unlock ( &in->lock );
+}
+
+void
+ingest_free ( Ingest *in )
+{
+	int	id;
+
+	for ( id = 0; id < in->nports; id++ ) {
+		if ( in->ports[id].fd >= 0 ) {
+			close ( in->ports[id].fd );
+		}
+		free ( in->ports[id].name );
+		free ( in->ports[id].stage );
+	}
+	free ( in->ports );
+	if ( in->orb >= 0 ) {
+		orbclose ( in->orb );
+	}
+#ifdef __linux__
+	if ( in->epfd >= 0 ) {
+		close ( in->epfd );
+	}
+#endif
+	pthread_mutex_destroy ( &in->lock );
+	pthread_cond_destroy ( &in->queued );
+	pthread_cond_destroy ( &in->released );
+	free ( in->orbname );
+	free ( in->slab );
+	free ( in->packets );
+	free ( in->freelist );
+	free ( in->queue );
+	free ( in->stash );
+	free ( in->pending );
+	free ( in );
+}
@@ -0,0 +1,79 @@
+#ifndef _INGEST_H_
+#define _INGEST_H_
+/*
+	Multiplexed packet ingestion from many input ports into one orb.
+
+	An Ingest reads any number of TCP connections and serial (or
+	other character) devices from a single event loop (epoll on
+	Linux, poll elsewhere).  Each port has a framer that finds the
+	packet boundaries in its byte stream.  Complete packets are
+	copied into a fixed pool of buffers allocated once, so nothing
+	is allocated per packet, and handed in batches to a writer
+	thread.  The writer converts each packet (adds headers, builds
+	the source name, rejects bad packets) and puts it on the orb.
+	A slow orb therefore never stalls the reads; when the pool is
+	exhausted the reads pause and the kernel socket buffers absorb
+	the backlog.
+
+	Ports that fail, reach end of file, or are silent for longer
+	than the timeout are closed and reopened after the retry
+	interval without affecting the other ports.
+
+	Framers run in the thread that calls ingest_run.  Converters
+	run in the writer thread, one packet at a time, so neither
+	needs to be thread safe as long as they do not share state
+	with each other.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "orb.h"
+
+/* Framer return value that closes and reopens the port, for streams
+without sync characters that cannot recover any other way. */
+#define INGEST_RECONNECT	(-0x7fffffff)
+
+typedef struct IngestPacket {
+	int	port;			/* port id the packet came from */
+	int	nbytes;			/* length of the raw packet in data */
+	unsigned char *data;		/* raw packet; room for packet_size bytes */
+	double	received;		/* time the packet was read */
+	/* Set by the converter */
+	char	srcname[ORBSRCNAME_SIZE];
+	double	time;
+	char	*out;			/* bytes to put on the orb, default data */
+	int	outsize;		/* their length, default nbytes */
+} IngestPacket;
+
+/* Given the unconsumed bytes of a port, return the length of the
+complete packet at the start of buf, 0 if more bytes are needed, -n to
+discard n bytes (resynchronize), or INGEST_RECONNECT. */
+typedef int (*IngestFramer) ( void *arg, unsigned char *buf, int nbuf );
+
+/* Fill in srcname, time, and optionally out and outsize.  out may
+point into data or to a buffer owned by the converter that stays valid
+until its next call.  Return 0 to put the packet on the orb, anything
+else to drop it. */
+typedef int (*IngestConvert) ( void *arg, IngestPacket *pkt );
+
+typedef struct Ingest Ingest;
+
+extern Ingest *ingest_new ( char *orbname, int npackets, int packet_size,
+	double timeout, double retry );
+extern int ingest_add_tcp ( Ingest *in, char *address, int default_port,
+	IngestFramer frame, IngestConvert convert, void *arg );
+extern int ingest_add_device ( Ingest *in, char *path,
+	IngestFramer frame, IngestConvert convert, void *arg );
+extern int ingest_add_fd ( Ingest *in, char *name, int fd,
+	IngestFramer frame, IngestConvert convert, void *arg );
+extern char *ingest_port_name ( Ingest *in, int port );
+extern int ingest_run ( Ingest *in );
+extern void ingest_stop ( Ingest *in );
+extern void ingest_report ( Ingest *in );
+extern void ingest_free ( Ingest *in );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "stock.h"
+#include "tablewatch.h"
+
+/* Change detection for Datascope table files.  See tablewatch.h
+and tablewatch(3).  */
+
+typedef struct Watched {
+	char	*filename;
+	char	*basename;
+	int	dir;		/* index in Tablewatch dirs */
+	long	reclen;		/* record length with newline, 0 if unknown */
+	long	committed;	/* records already handled by the caller */
+	off_t	seen_size;	/* file size at the last check */
+	time_t	seen_mtime;
+	ino_t	seen_ino;
+	int	dirty;		/* written since the last check */
+} Watched;
+
+struct Tablewatch {
+	int	fd;		/* inotify descriptor, -1 when polling */
+	double	poll_interval;
+	Watched	*tables;
+	int	ntables;
+	char	**dirs;
+	int	*wd;
+	int	ndirs;
+};
+
+#define TABLEWATCH_EVENTS_SIZE 16384
+
+Tablewatch *
+tablewatch_new ( int mode, double poll_interval )
+{
+	Tablewatch *tw;
+
+	allot ( Tablewatch *, tw, 1 );
+	tw->fd = -1;
+	tw->poll_interval = poll_interval > 0.0 ? poll_interval : 1.0;
+	tw->tables = NULL;
+	tw->ntables = 0;
+	tw->dirs = NULL;
+	tw->wd = NULL;
+	tw->ndirs = 0;
+#ifdef __linux__
+	if ( mode == TABLEWATCH_AUTO ) {
+		tw->fd = inotify_init ();
+		if ( tw->fd < 0 ) {
+			elog_complain ( 1, "tablewatch: inotify_init failed, "
+				"falling back to polling every %.3f s\n",
+				tw->poll_interval );
+		} else {
+			fcntl ( tw->fd, F_SETFL,
+				fcntl ( tw->fd, F_GETFL ) | O_NONBLOCK );
+			fcntl ( tw->fd, F_SETFD, FD_CLOEXEC );
+		}
+	}
+#endif
+	return tw;
+}
+
+static void
+stop_events ( Tablewatch *tw )
+{
+	if ( tw->fd >= 0 ) {
+		close ( tw->fd );
+		tw->fd = -1;
+	}
+}
+
+/* Length of one record, taken from the position of the first newline.
+Returns 0 if the file does not yet hold a complete record. */
+static long
+measure_reclen ( char *filename )
+{
+	char	buf[8192];
+	char	*nl;
+	long	offset = 0, nread;
+	int	fd;
+
+	if ( (fd = open ( filename, O_RDONLY )) < 0 ) {
+		return 0;
+	}
+	while ( (nread = read ( fd, buf, sizeof(buf) )) > 0 ) {
+		if ( (nl = memchr ( buf, '\n', nread )) != NULL ) {
+			close ( fd );
+			return offset + (nl - buf) + 1;
+		}
+		offset += nread;
+	}
+	close ( fd );
+	return 0;
+}
+
+static int
+find_dir ( Tablewatch *tw, char *dir )
+{
+	int	i;
+
+	for ( i = 0; i < tw->ndirs; i++ ) {
+		if ( strcmp ( tw->dirs[i], dir ) == 0 ) {
+			return i;
+		}
+	}
+	if ( tw->ndirs == 0 ) {
+		allot ( char **, tw->dirs, 1 );
+		allot ( int *, tw->wd, 1 );
+	} else {
+		reallot ( char **, tw->dirs, tw->ndirs + 1 );
+		reallot ( int *, tw->wd, tw->ndirs + 1 );
+	}
+	tw->dirs[tw->ndirs] = strdup ( dir );
+	tw->wd[tw->ndirs] = -1;
+#ifdef __linux__
+	if ( tw->fd >= 0 ) {
+		tw->wd[tw->ndirs] = inotify_add_watch ( tw->fd, dir,
+			IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE |
+			IN_MOVED_TO | IN_DELETE | IN_ATTRIB );
+		if ( tw->wd[tw->ndirs] < 0 ) {
+			elog_complain ( 1, "tablewatch: cannot watch directory %s, "
+				"falling back to polling every %.3f s\n",
+				dir, tw->poll_interval );
+			stop_events ( tw );
+		}
+	}
+#endif
+	return tw->ndirs++;
+}
+
+/* Add a table file to the watch list.  start_record is the number of
+records the caller has already handled; a negative value means all
+records now in the file.  Returns the id used by the other calls. */
+int
+tablewatch_add ( Tablewatch *tw, char *filename, long start_record )
+{
+	Watched	*t;
+	char	*slash, *dir;
+	struct stat sb;
+
+	if ( tw->ntables == 0 ) {
+		allot ( Watched *, tw->tables, 1 );
+	} else {
+		reallot ( Watched *, tw->tables, tw->ntables + 1 );
+	}
+	t = &(tw->tables[tw->ntables]);
+	t->filename = strdup ( filename );
+	dir = strdup ( filename );
+	if ( (slash = strrchr ( dir, '/' )) != NULL ) {
+		t->basename = t->filename + (slash - dir) + 1;
+		if ( slash == dir ) {
+			slash[1] = '\0';
+		} else {
+			*slash = '\0';
+		}
+	} else {
+		t->basename = t->filename;
+		strcpy ( dir, "." );
+	}
+	t->dir = find_dir ( tw, dir );
+	free ( dir );
+
+	t->reclen = measure_reclen ( t->filename );
+	t->dirty = 0;
+	if ( stat ( t->filename, &sb ) == 0 ) {
+		t->seen_size = sb.st_size;
+		t->seen_mtime = sb.st_mtime;
+		t->seen_ino = sb.st_ino;
+	} else {
+		t->seen_size = 0;
+		t->seen_mtime = 0;
+		t->seen_ino = 0;
+	}
+	if ( start_record >= 0 ) {
+		t->committed = start_record;
+	} else {
+		t->committed = t->reclen > 0 ? t->seen_size / t->reclen : 0;
+	}
+	return tw->ntables++;
+}
+
+static void
+drain_events ( Tablewatch *tw )
+{
+#ifdef __linux__
+	char	buf[TABLEWATCH_EVENTS_SIZE]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	char	*p;
+	long	n;
+	int	i, d;
+
+	while ( (n = read ( tw->fd, buf, sizeof(buf) )) > 0 ) {
+		for ( p = buf; p < buf + n;
+			p += sizeof(struct inotify_event) + ev->len ) {
+			ev = (struct inotify_event *) p;
+			if ( ev->mask & IN_Q_OVERFLOW ) {
+				for ( i = 0; i < tw->ntables; i++ ) {
+					tw->tables[i].dirty = 1;
+				}
+				continue;
+			}
+			if ( ev->len == 0 ) {
+				continue;
+			}
+			for ( d = 0; d < tw->ndirs; d++ ) {
+				if ( tw->wd[d] == ev->wd ) break;
+			}
+			for ( i = 0; i < tw->ntables; i++ ) {
+				if ( tw->tables[i].dir == d
+				  && strcmp ( tw->tables[i].basename, ev->name ) == 0 ) {
+					tw->tables[i].dirty = 1;
+				}
+			}
+		}
+	}
+	if ( n < 0 && errno != EAGAIN && errno != EINTR ) {
+		elog_complain ( 1, "tablewatch: read of inotify events failed, "
+			"falling back to polling every %.3f s\n",
+			tw->poll_interval );
+		stop_events ( tw );
+		for ( i = 0; i < tw->ntables; i++ ) {
+			tw->tables[i].dirty = 1;
+		}
+	}
+#endif
+}
+
+/* Poll mode test for a change since the last check */
+static int
+stat_changed ( Watched *t )
+{
+	struct stat sb;
+
+	if ( stat ( t->filename, &sb ) != 0 ) {
+		return t->seen_size != 0;
+	}
+	return sb.st_size != t->seen_size || sb.st_mtime != t->seen_mtime
+		|| sb.st_ino != t->seen_ino;
+}
+
+static int
+count_dirty ( Tablewatch *tw )
+{
+	int	i, ndirty = 0;
+
+	for ( i = 0; i < tw->ntables; i++ ) {
+		if ( tw->tables[i].dirty ) ndirty++;
+	}
+	return ndirty;
+}
+
+static void
+nap ( double seconds )
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t) seconds;
+	ts.tv_nsec = (long) ((seconds - (double) ts.tv_sec) * 1.0e9);
+	nanosleep ( &ts, NULL );
+}
+
+/* Block until at least one table file has been written or timeout
+seconds have passed (forever if timeout is negative).  With inotify,
+after the first event the call waits up to coalesce more seconds so
+a burst of writes is handled in one pass.  Returns the number of
+tables written, 0 on timeout. */
+int
+tablewatch_wait ( Tablewatch *tw, double timeout, double coalesce )
+{
+	double	waited = 0.0, step;
+	int	i, ndirty;
+
+	if ( (ndirty = count_dirty ( tw )) > 0 ) {
+		return ndirty;
+	}
+#ifdef __linux__
+	if ( tw->fd >= 0 ) {
+		struct pollfd pfd;
+
+		pfd.fd = tw->fd;
+		pfd.events = POLLIN;
+		if ( poll ( &pfd, 1, timeout < 0.0 ? -1 : (int) (timeout * 1000.0) ) > 0 ) {
+			drain_events ( tw );
+			if ( coalesce > 0.0 && tw->fd >= 0
+			  && poll ( &pfd, 1, (int) (coalesce * 1000.0) ) > 0 ) {
+				drain_events ( tw );
+			}
+		}
+		return count_dirty ( tw );
+	}
+#endif
+	for ( ;; ) {
+		for ( i = 0; i < tw->ntables; i++ ) {
+			if ( stat_changed ( &(tw->tables[i]) ) ) {
+				tw->tables[i].dirty = 1;
+			}
+		}
+		if ( (ndirty = count_dirty ( tw )) > 0 ) {
+			return ndirty;
+		}
+		if ( timeout >= 0.0 && waited >= timeout ) {
+			return 0;
+		}
+		step = tw->poll_interval;
+		if ( timeout >= 0.0 && waited + step > timeout ) {
+			step = timeout - waited;
+		}
+		nap ( step );
+		waited += step;
+	}
+}
+
+/* Report what happened to table id since records were last committed.
+For TABLEWATCH_APPENDED records first through last-1 are new.  For
+TABLEWATCH_SHRUNK the table now has last records (first is set to 0).
+Otherwise first=last=committed count. */
+int
+tablewatch_check ( Tablewatch *tw, int id, long *first, long *last )
+{
+	Watched	*t;
+	struct stat sb;
+	long	nrecords;
+	int	status, written;
+
+	t = &(tw->tables[id]);
+	if ( stat ( t->filename, &sb ) != 0 ) {
+		sb.st_size = 0;
+		sb.st_mtime = 0;
+		sb.st_ino = 0;
+	}
+	if ( t->reclen == 0 && sb.st_size > 0 ) {
+		t->reclen = measure_reclen ( t->filename );
+	}
+	nrecords = t->reclen > 0 ? sb.st_size / t->reclen : 0;
+	written = t->dirty || sb.st_mtime != t->seen_mtime
+		|| sb.st_ino != t->seen_ino;
+
+	*first = *last = t->committed;
+	if ( nrecords < t->committed ) {
+		status = TABLEWATCH_SHRUNK;
+		*first = 0;
+		*last = nrecords;
+	} else if ( nrecords > t->committed ) {
+		status = TABLEWATCH_APPENDED;
+		*last = nrecords;
+	} else if ( written ) {
+		status = TABLEWATCH_MODIFIED;
+	} else {
+		status = TABLEWATCH_UNCHANGED;
+	}
+	t->seen_size = sb.st_size;
+	t->seen_mtime = sb.st_mtime;
+	t->seen_ino = sb.st_ino;
+	t->dirty = 0;
+	return status;
+}
+
+/* Record that the caller has handled the first nrecords records */
+void
+tablewatch_commit ( Tablewatch *tw, int id, long nrecords )
+{
+	tw->tables[id].committed = nrecords;
+}
+
+int
+tablewatch_is_event_driven ( Tablewatch *tw )
+{
+	return tw->fd >= 0;
+}
+
+void
+tablewatch_free ( Tablewatch *tw )
+{
+	int	i;
+
+	stop_events ( tw );
+	for ( i = 0; i < tw->ntables; i++ ) {
+		free ( tw->tables[i].filename );
+	}
+	for ( i = 0; i < tw->ndirs; i++ ) {
+		free ( tw->dirs[i] );
+	}
+	free ( tw->tables );
+	free ( tw->dirs );
+	free ( tw->wd );
+	free ( tw );
+}
@@ -0,0 +1,49 @@
+#ifndef _TABLEWATCH_H_
+#define _TABLEWATCH_H_
+/*
+	Change detection for Datascope table files.
+
+	A Tablewatch follows a set of table files and tells the caller
+	which records were appended since the last time it looked.  Each
+	table's position is kept as a count of records already handled
+	(the committed count), so only new rows need to be read.
+
+	On Linux the directories holding the tables are watched with
+	inotify and tablewatch_wait returns as soon as a table file is
+	written.  Elsewhere, or when TABLEWATCH_POLL is requested, the
+	files are checked with stat at a fixed interval.  Either way the
+	cost of an idle check is a stat per table, not a database query.
+
+	Datascope records are fixed length lines.  The record length is
+	measured from the first line of the file, so a table may be empty
+	or even absent when it is added.  A partially written last record
+	is never reported.
+*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Modes for tablewatch_new */
+#define TABLEWATCH_AUTO		0
+#define TABLEWATCH_POLL		1
+
+/* Return codes of tablewatch_check */
+#define TABLEWATCH_UNCHANGED	0
+#define TABLEWATCH_APPENDED	1	/* new whole records at the end */
+#define TABLEWATCH_MODIFIED	2	/* written without growing */
+#define TABLEWATCH_SHRUNK	3	/* fewer records than committed */
+
+typedef struct Tablewatch Tablewatch;
+
+extern Tablewatch *tablewatch_new ( int mode, double poll_interval );
+extern int tablewatch_add ( Tablewatch *tw, char *filename, long start_record );
+extern int tablewatch_wait ( Tablewatch *tw, double timeout, double coalesce );
+extern int tablewatch_check ( Tablewatch *tw, int id, long *first, long *last );
+extern void tablewatch_commit ( Tablewatch *tw, int id, long nrecords );
+extern int tablewatch_is_event_driven ( Tablewatch *tw );
+extern void tablewatch_free ( Tablewatch *tw );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
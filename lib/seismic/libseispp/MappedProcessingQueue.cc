@@ -0,0 +1,420 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sstream>
+#include <chrono>
+#include "seispp.h"
+#include "dbpp.h"
+#include "ProcessingQueue.h"
+using namespace std;
+using namespace SEISPP;
+namespace SEISPP
+{
+/* The queue file is a header of 3 longs (record count, table number,
+and a high water mark) followed by a vector of ProcessingStatus values.
+This must stay identical to what DatascopeProcessingQueue writes.
+The heartbeat file has a header of 2 longs (magic and record count)
+followed by one long per record.  A heartbeat of 0 means the record
+is not claimed. */
+const long QueueHeaderSize(3);
+const long HeartbeatHeaderSize(2);
+const long HeartbeatMagic(0x5150484231L);
+/* When stale claim recovery is disabled a TODO record with a heartbeat
+older than this many seconds is assumed to be left over from a crash
+and subsequent rewind_queue.  Only the claim operation itself leaves
+a TODO record with a nonzero heartbeat so this can be short. */
+const long ClaimGrace(60);
+
+/* Small helpers for atomic access to the mapped words.  These are
+gcc builtins that compile to plain locked instructions on shared
+memory and are lock free between processes. */
+static inline int load_status(int *s)
+{
+	return(__atomic_load_n(s,__ATOMIC_ACQUIRE));
+}
+static inline bool cas_status(int *s, int oldval, int newval)
+{
+	return(__atomic_compare_exchange_n(s,&oldval,newval,false,
+		__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE));
+}
+static inline long load_long(long *p)
+{
+	return(__atomic_load_n(p,__ATOMIC_ACQUIRE));
+}
+static inline bool cas_long(long *p, long oldval, long newval)
+{
+	return(__atomic_compare_exchange_n(p,&oldval,newval,false,
+		__ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE));
+}
+/* Creates or validates a file of a given size.  Called only while
+the queue file lock is held.  Returns true if the file was created.*/
+static bool prepare_file(int fd, size_t length, const string& fname)
+{
+	struct stat sbuffer;
+	if(fstat(fd,&sbuffer))
+		throw SeisppError(string("MappedProcessingQueue:  fstat failed on file ")
+			+ fname);
+	if(sbuffer.st_size==0)
+	{
+		/* ftruncate zero fills which is TODO for the status
+		vector and unclaimed for the heartbeat vector */
+		if(ftruncate(fd,(off_t)length))
+			throw SeisppError(string("MappedProcessingQueue:  ")
+			 + "ftruncate failed creating file " + fname);
+		return(true);
+	}
+	if(sbuffer.st_size!=(off_t)length)
+	{
+		stringstream ss;
+		ss << "MappedProcessingQueue:  file "<<fname
+			<< " has size "<<sbuffer.st_size
+			<< " but the database view requires "<<length<<" bytes"<<endl
+			<< "File does not match the view passed through the database handle"<<endl;
+		throw SeisppError(ss.str());
+	}
+	return(false);
+}
+static void *map_file(int fd, size_t length, const string& fname)
+{
+	void *addr=mmap(NULL,length,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	if(addr==MAP_FAILED)
+		throw SeisppError(string("MappedProcessingQueue:  mmap failed on file ")
+			+ fname + " : " + strerror(errno));
+	return(addr);
+}
+
+MappedProcessingQueue::MappedProcessingQueue(DatascopeHandle& dbh, string fn,
+	int bsize, long stimeout) : fname(fn)
+{
+	const string base_error("MappedProcessingQueue constructor:  ");
+	if(sizeof(ProcessingStatus)!=sizeof(int))
+		throw SeisppError(base_error
+		 + "ProcessingStatus is not int sized on this platform");
+	batch_size=bsize;
+	if(batch_size<1) batch_size=1;
+	stale_timeout=stimeout;
+	if(stale_timeout<0) stale_timeout=0;
+	shutdown=false;
+	header=NULL;
+	hb=NULL;
+	hbfd=-1;
+	records_in_this_view=dbh.number_tuples();
+	if(records_in_this_view<=0)
+		throw SeisppError(base_error
+		 + "Database view is empty. Run dbverify and/or fix your code");
+	maplength=sizeof(long)*QueueHeaderSize
+		+ sizeof(int)*records_in_this_view;
+	hbmaplength=sizeof(long)*(HeartbeatHeaderSize+records_in_this_view);
+	fd=open(fname.c_str(),O_RDWR|O_CREAT,0664);
+	if(fd<0)
+		throw SeisppError(base_error
+		 + string("Cannot open queue file=") + fname);
+	/* The lock serializes creation of the two files between processes
+	started at the same time.  It is not used after this. */
+	if(lockf(fd,F_LOCK,(off_t) 0 ) )
+	{
+		close(fd);
+		throw SeisppError(base_error
+			+ "Could not lock queue file.  Cannot proceed");
+	}
+	try {
+		string hbname=fname+".hb";
+		bool created=prepare_file(fd,maplength,fname);
+		header=static_cast<long *>(map_file(fd,maplength,fname));
+		status=reinterpret_cast<int *>(header+QueueHeaderSize);
+		if(created)
+		{
+			if(SEISPP_verbose)
+				cerr << base_error<< "queue file = "<< fname
+				  << " is being created"<<endl
+				  << "Buildng queue with "<<records_in_this_view
+				  <<" entries"<<endl;
+			header[0]=records_in_this_view;
+			header[1]=dbh.db.table;
+			header[2]=0;
+		}
+		else if(header[0]!=records_in_this_view)
+		{
+			stringstream ss;
+			ss << base_error
+			  << "queue size does not match size of view passed through database handle"<<endl
+			  << "Queue size = "<<header[0]<<endl
+			  << "DatascopeHandle passed has "<<records_in_this_view<<" rows"<<endl;
+			throw SeisppError(ss.str());
+		}
+		view_table=header[1];
+		hbfd=open(hbname.c_str(),O_RDWR|O_CREAT,0664);
+		if(hbfd<0)
+			throw SeisppError(base_error
+			 + string("Cannot open heartbeat file=") + hbname);
+		if(prepare_file(hbfd,hbmaplength,hbname))
+		{
+			hb=static_cast<long *>(map_file(hbfd,hbmaplength,hbname));
+			hb[0]=HeartbeatMagic;
+			hb[1]=records_in_this_view;
+		}
+		else
+		{
+			hb=static_cast<long *>(map_file(hbfd,hbmaplength,hbname));
+			if((hb[0]!=HeartbeatMagic) || (hb[1]!=records_in_this_view))
+				throw SeisppError(base_error
+				 + "heartbeat file="+hbname
+				 + " is not consistent with queue file.  Delete it and rerun");
+		}
+		lseek(fd,(off_t)0,SEEK_SET);
+		lockf(fd,F_ULOCK,(off_t)0);
+	} catch (...) {
+		lseek(fd,(off_t)0,SEEK_SET);
+		lockf(fd,F_ULOCK,(off_t)0);
+		if(header!=NULL) munmap(header,maplength);
+		if(hb!=NULL) munmap(hb,hbmaplength);
+		if(hbfd>=0) close(hbfd);
+		close(fd);
+		throw;
+	}
+	/* Claim the first batch so the first has_data/set_to_current
+	pair works like DatascopeProcessingQueue, which marks the first
+	record PROCESSING in the constructor. */
+	claim_batch();
+	if(stale_timeout>0)
+		hbthread=std::thread(&MappedProcessingQueue::heartbeat_loop,this);
+}
+MappedProcessingQueue::~MappedProcessingQueue()
+{
+	{
+		std::lock_guard<std::mutex> lock(claimlock);
+		shutdown=true;
+	}
+	hbcv.notify_all();
+	if(hbthread.joinable()) hbthread.join();
+	/* Anything still held was never marked.  Return it to the queue.*/
+	int nreleased(0);
+	while(!claims.empty())
+	{
+		if(release(claims.front(),TODO)) ++nreleased;
+		claims.pop_front();
+	}
+	if(SEISPP_verbose)
+	{
+		cerr << "Closing MappedProcessingQueue.  Returned "<<nreleased
+			<< " unprocessed records to the queue.  Final contents on closure."
+			<<endl;
+		cerr << *this;
+	}
+	msync(header,maplength,MS_SYNC);
+	munmap(header,maplength);
+	munmap(hb,hbmaplength);
+	close(hbfd);
+	close(fd);
+}
+/* Scans forward from the high water mark for records that can be
+claimed.  A record is claimed by a compare and swap on its heartbeat
+word first and then on its status word.  The heartbeat swap is what
+serializes competing processes.  PROCESSING records with a stale
+heartbeat are taken over with the same heartbeat swap and the status
+is left as PROCESSING. */
+int MappedProcessingQueue::claim_batch()
+{
+	long now=static_cast<long>(time(NULL));
+	long todo_stale=now - (stale_timeout>0 ? stale_timeout : ClaimGrace);
+	long processing_stale=now-stale_timeout;
+	long start=load_long(header+2);
+	if(start<0 || start>=records_in_this_view) start=0;
+	long i,h;
+	int s;
+	int nclaimed(0);
+	bool advancing(true);
+	long hwm(start);
+	std::lock_guard<std::mutex> lock(claimlock);
+	for(i=start;(i<records_in_this_view) && (nclaimed<batch_size);++i)
+	{
+		s=load_status(status+i);
+		h=load_long(hb+HeartbeatHeaderSize+i);
+		if(s==TODO)
+		{
+			advancing=false;
+			if( (h!=0) && (h>=todo_stale) ) continue;
+			if(!cas_long(hb+HeartbeatHeaderSize+i,h,now)) continue;
+			if(!cas_status(status+i,TODO,PROCESSING))
+			{
+				/* Status changed under us.  Only possible
+				if someone ran rewind_queue or the file locking
+				implementation on a live queue.  Back off. */
+				cas_long(hb+HeartbeatHeaderSize+i,now,0);
+				continue;
+			}
+			claims.push_back(QueueClaim(i,now));
+			++nclaimed;
+		}
+		else if(s==PROCESSING)
+		{
+			/* The owner can still return this record as TODO
+			so the high water mark must not pass it */
+			advancing=false;
+			if(stale_timeout<=0 || h==0 || h>=processing_stale)
+				continue;
+			if(!cas_long(hb+HeartbeatHeaderSize+i,h,now)) continue;
+			if(SEISPP_verbose)
+				cerr << "MappedProcessingQueue:  taking over stale claim on record "
+					<< i << " last heartbeat "<<now-h<<" s ago"<<endl;
+			claims.push_back(QueueClaim(i,now));
+			++nclaimed;
+		}
+		/* The high water mark only moves past FINISHED and SKIPPED
+		records.  Those can never be claimed again, so a concurrent
+		release to TODO can never be behind the new mark.  */
+		if(advancing) hwm=i+1;
+	}
+	long oldhwm=load_long(header+2);
+	while(hwm>oldhwm)
+	{
+		if(cas_long(header+2,oldhwm,hwm)) break;
+		oldhwm=load_long(header+2);
+	}
+	return(nclaimed);
+}
+bool MappedProcessingQueue::release(QueueClaim& c, ProcessingStatus ps)
+{
+	if(c.lost || !cas_long(hb+HeartbeatHeaderSize+c.record,c.stamp,0))
+	{
+		if(SEISPP_verbose)
+			cerr << "MappedProcessingQueue:  claim on record "<<c.record
+				<< " was taken over by another process."<<endl;
+		return(false);
+	}
+	__atomic_store_n(status+c.record,static_cast<int>(ps),__ATOMIC_RELEASE);
+	/* claim_batch never moves the high water mark past a PROCESSING
+	record so this should not find the record behind the mark.  Pull
+	the mark back anyway in case the file was edited while in use. */
+	if(ps==TODO)
+	{
+		long oldhwm=load_long(header+2);
+		while(c.record<oldhwm)
+		{
+			if(cas_long(header+2,oldhwm,c.record)) break;
+			oldhwm=load_long(header+2);
+		}
+	}
+	return(true);
+}
+void MappedProcessingQueue::mark(ProcessingStatus pstat)
+{
+	{
+		std::lock_guard<std::mutex> lock(claimlock);
+		if(claims.empty()) return;
+		release(claims.front(),pstat);
+		claims.pop_front();
+		/* Nothing is current now so claims lost to another
+		process can be dropped before one becomes current */
+		while(!claims.empty() && claims.front().lost)
+			claims.pop_front();
+		if(!claims.empty()) return;
+	}
+	claim_batch();
+}
+bool MappedProcessingQueue::has_data()
+{
+	std::lock_guard<std::mutex> lock(claimlock);
+	return(!claims.empty());
+}
+int MappedProcessingQueue::records_claimed()
+{
+	std::lock_guard<std::mutex> lock(claimlock);
+	return(claims.size());
+}
+void MappedProcessingQueue::set_to_current(DatascopeHandle& dbh)
+{
+	if(dbh.db.table!=view_table)
+	{
+		stringstream serr;
+		serr << "MappedProcessingQueue::set_to_current:  "
+		  << "db table mismatch.  "<<endl;
+		serr << "Queue is defined for table number " << view_table
+			<< " but handle passed points to table "
+			<< dbh.db.table<<endl;
+		throw SeisppError(serr.str());
+	}
+	std::lock_guard<std::mutex> lock(claimlock);
+	if(claims.empty())
+		throw SeisppError(string("MappedProcessingQueue::set_to_current:  ")
+			+ "queue is empty.  Call has_data before this method");
+	dbh.db.record=claims.front().record;
+}
+int MappedProcessingQueue::heartbeat()
+{
+	long now=static_cast<long>(time(NULL));
+	std::lock_guard<std::mutex> lock(claimlock);
+	deque<QueueClaim>::iterator cptr;
+	int nheld(0);
+	/* Lost claims are flagged, not erased.  The front claim may be 
+	the record set_to_current handed out and mark must release that 
+	record and no other. */
+	for(cptr=claims.begin();cptr!=claims.end();++cptr)
+	{
+		if(cptr->lost) continue;
+		if( (cptr->stamp!=now) 
+		  && !cas_long(hb+HeartbeatHeaderSize+cptr->record,
+					cptr->stamp,now))
+		{
+			if(SEISPP_verbose)
+				cerr << "MappedProcessingQueue::heartbeat:  claim on record "
+					<< cptr->record
+					<< " was taken over by another process"<<endl;
+			cptr->lost=true;
+			continue;
+		}
+		cptr->stamp=now;
+		++nheld;
+	}
+	return(nheld);
+}
+void MappedProcessingQueue::heartbeat_loop()
+{
+	long interval=stale_timeout/4;
+	if(interval<1) interval=1;
+	std::unique_lock<std::mutex> lock(claimlock);
+	while(!shutdown)
+	{
+		hbcv.wait_for(lock,std::chrono::seconds(interval));
+		if(shutdown) break;
+		lock.unlock();
+		heartbeat();
+		lock.lock();
+	}
+}
+ostream& operator<<(ostream& os, MappedProcessingQueue& q)
+{
+	os << "Mapped processing queue for table number "<<q.view_table<<endl
+		<< " High water mark is "<< load_long(q.header+2)
+		<< " of " << q.records_in_this_view << " total."<<endl
+		<< " This process holds "<<q.records_claimed()<<" records"<<endl
+		<<"Processing status of each member of queue:"<<endl;
+	long i;
+	for(i=0;i<q.records_in_this_view;++i)
+	{
+		os << i <<" ";
+		switch (load_status(q.status+i))
+		{
+		case TODO:
+			os << "Incomplete"<<endl;
+			break;
+		case FINISHED:
+			os << "Finished"<<endl;
+			break;
+		case SKIPPED:
+			os << "Skipped"<<endl;
+			break;
+		case PROCESSING:
+			os << "Processing"<<endl;
+			break;
+		default:
+			os << "Unrecognized status value."<<endl;
+		}
+	}
+	return(os);
+}
+
+}  // end SEISPP Namespace encapsulation
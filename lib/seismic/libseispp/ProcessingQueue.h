@@ -2,8 +2,13 @@
 #define _PROCESSINGQUEUE_H_
 
 #include <stdio.h>
+#include <time.h>
 #include <string>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 #include "dbpp.h"
 namespace SEISPP
 {
@@ -16,6 +21,29 @@ the records was skipped for some reason, and PROCESSING is used to
 mark records locked and being processed by this or another process.
 */
 enum ProcessingStatus {TODO, FINISHED, SKIPPED, PROCESSING};
+/*! \brief Abstract base for database driven processing queues.
+
+Programs like dbxcor only need to mark the record they just handled,
+ask if anything is left, and position a database handle to the next
+record.  This base class defines that minimal interface so the
+implementation used to negotiate records between processes can
+be selected at run time.  Two backends exist:  DatascopeProcessingQueue
+uses unix file locking and is the one to use on a cluster sharing
+a common disk pool.  MappedProcessingQueue uses a memory mapped 
+image of the same file with atomic updates and is much faster
+when many processes on one machine hit the same queue.
+*/
+class ProcessingQueue
+{
+public:
+	virtual ~ProcessingQueue(){};
+	/*! Mark the state of the current record and advance to the next one. */
+	virtual void mark(ProcessingStatus ps)=0;
+	/*! Set the database handle to the current record. */
+	virtual void set_to_current(DatascopeHandle& dbh)=0;
+	/*! Return true while there is a current record to process. */
+	virtual bool has_data()=0;
+};
 /*! \brief Processing queue for database driven procesing using Datascope.
 
 Many numerical algorithms are data driven and can be abstracted as driven by 
@@ -58,7 +86,7 @@ but the authors expectation is this is likely to be a minor concern because
 the database behind the view would likely eat up all memory long before this
 became a concern.  At least that is my theoretical view at this point in time.
 */
-class DatascopeProcessingQueue
+class DatascopeProcessingQueue : public ProcessingQueue
 {
 public:
 	/*! Primary constructor for this object.
@@ -149,5 +177,128 @@ private:
 	*/
 	long position_to_next(long startrec);
 };
+/*! \brief Lock free processing queue for many processes on one host.
+
+This is an alternative backend to DatascopeProcessingQueue.  It uses 
+exactly the same queue file (a three long header of record count, 
+table number, and high water mark followed by one ProcessingStatus
+value per row of the view) so a queue can be started with one 
+implementation and finished with the other and rewind_queue works 
+with either.  The difference is how records are claimed.  Instead of
+locking and rewriting the entire file every time a record is marked 
+this implementation maps the file into memory and claims records with
+atomic compare and swap operations on the individual status words.
+The file lock is only used when the queue is created.  
+
+Records are claimed in batches of a size set by the constructor.  
+A process takes its own batch one record at a time through the usual
+mark, has_data, set_to_current loop and only returns to the shared 
+queue when the batch is exhausted.  Records not processed when the 
+object is destroyed are returned to the queue as TODO.
+
+A process that dies leaves its claims marked PROCESSING.  With 
+the older implementation the only recovery was to run rewind_queue.
+Here each claim carries a heartbeat time stored in a companion file 
+with the name of the queue file plus ".hb".  A background thread 
+refreshes the heartbeat of all claims held by this process.  When 
+stale_timeout is positive any claim whose heartbeat is older than 
+that many seconds is assumed to be orphaned and is taken over by the
+next process that scans the queue.   If the original owner was only
+slow and not dead it discovers the loss on its next heartbeat or mark
+and leaves the record to the new owner.
+
+Be warned that atomic operations on a shared mapping are only coherent
+between processes on the same machine.  Do NOT use this object on a 
+queue file accessed from several hosts through a network file system.  
+Use DatascopeProcessingQueue for that situation.  Never mix the two 
+implementations on the same queue file at the same time either.  
+*/
+class MappedProcessingQueue : public ProcessingQueue
+{
+public:
+	/*! Primary constructor.
+
+	\param dbh is the handle to the database view used to define the
+	queue.  As with DatascopeProcessingQueue this is one row per 
+	data set to be processed.
+	\param fname is the queue file name.  It is created if it does not
+	exist.  The heartbeat file fname.hb is created as needed.
+	\param batch_size is the number of records claimed from the shared
+	queue at a time.  Values less than 1 are treated as 1.
+	\param stale_timeout is the time in seconds after which a claim 
+	that has not been refreshed is considered orphaned.  A value of 0
+	(default) disables stale claim recovery and the heartbeat thread.
+
+	\exception SeisppError is thrown if the file cannot be created,
+	mapped, or does not match the database view.  
+	*/
+	MappedProcessingQueue(DatascopeHandle& dbh, string fname,
+		int batch_size=1, long stale_timeout=0);
+	/*! Destructor.  Returns unprocessed claims to the queue and 
+	unmaps the files. */
+	~MappedProcessingQueue();
+	/*! Mark the state of the current record.
+
+	The status of the current record is set to ps.  If this process
+	holds more claimed records the next one becomes current.  
+	Otherwise a new batch is claimed from the shared queue.  
+	*/
+	void mark(ProcessingStatus ps);
+	/*! Set the database handle to the current record.
+	\exception throws a SeisppError object if the handle properties are not
+		consistent with this queue.  */
+	void set_to_current(DatascopeHandle& dbh);
+	/*! Returns true while this process holds a record to process. */
+	bool has_data();
+	/*! Refresh the heartbeat of all records held by this process.
+	
+	This is called automatically by a background thread when
+	stale_timeout is positive, but can be called directly by
+	programs that prefer to do it from their main loop.
+	Returns the number of claims still held. */
+	int heartbeat();
+	/*! Return the number of records currently held by this process.*/
+	int records_claimed();
+	/*! Prints current queue contents. */
+	friend ostream& operator<<(ostream&, MappedProcessingQueue& q);
+private:
+	/* Each claim keeps the heartbeat value this process last wrote.
+	The heartbeat word for the record is only changed with a compare
+	and swap against this value so a lost claim is always detected. 
+	A lost claim stays in place, flagged, until mark reaches it so 
+	the front of claims is always the current record. */
+	class QueueClaim
+	{
+	public:
+		long record;
+		long stamp;
+		bool lost;
+		QueueClaim(long r, long s){record=r;stamp=s;lost=false;};
+	};
+	string fname;
+	long records_in_this_view;
+	long view_table;
+	int batch_size;
+	long stale_timeout;
+	int fd,hbfd;
+	size_t maplength,hbmaplength;
+	/* mapped header and status vector of queue file */
+	long *header;
+	int *status;
+	/* mapped heartbeat vector */
+	long *hb;
+	deque<QueueClaim> claims;
+	std::mutex claimlock;
+	std::condition_variable hbcv;
+	std::thread hbthread;
+	bool shutdown;
+	/* Claim up to batch_size records from the shared queue. 
+	Returns number claimed. */
+	int claim_batch();
+	/* Give up a claim and set its status. Returns false if 
+	the claim had been taken over by another process. */
+	bool release(QueueClaim& c, ProcessingStatus ps);
+	void heartbeat_loop();
+};
 }
 #endif
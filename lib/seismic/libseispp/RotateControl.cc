@@ -0,0 +1,204 @@
+/* General purpose engine to rotate an ensemble.   This was originally
+   part of the rotate program and is now shared with the fused
+   pipeline processor so both produce identical results. */
+#include <math.h>
+#include "coords.h"
+#include "seispp.h"
+#include "Hypocenter.h"
+#include "RotateControl.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+RotateControl::RotateControl(string pffile)
+{
+  const string base_error("RotateControl constructor:  ");
+  Pf *pf;
+  if(pfread(const_cast<char *>(pffile.c_str()),&pf))
+    throw SeisppError(base_error+"pfread failed for "+pffile);
+  try{
+    Metadata md(pf);
+    string modedef=md.get_string("rotation_type");
+    constant_transformation=false;
+    if(modedef=="constant")
+    {
+      constant_transformation=true;
+      phi=md.get_double("phi");
+      theta=md.get_double("theta");
+      /* convert both to radians */
+      phi=rad(phi);
+      theta=rad(theta);
+    }
+    else if(modedef=="ZRT")
+      mode=ZRT;
+    else if(modedef=="LQT")
+      mode=LQT;
+    else if(modedef=="FST")
+      mode=FST;
+    else
+      throw SeisppError(base_error 
+          + "Illegal entry in parameter file for rotation_type="+modedef);
+    saamode=md.get_bool("small_aperture_array_mode");
+    if(saamode && constant_transformation)
+    {
+      cerr << "rotate (WARNING):  pf file specifies constant transformation "
+        << "and small aperture array mode"<<endl
+        << "Turning off small aperture array mode"<<endl;
+      saamode=false;
+    }
+    string nullstring("");
+    if(constant_transformation)
+    {
+      phi=md.get_double("phi");
+      theta=md.get_double("theta");
+      /* convert both to radians */
+      phi=rad(phi);
+      theta=rad(theta);
+      stalatkey=nullstring;
+      stalonkey=nullstring;
+      evlatkey=nullstring;
+      evlatkey=nullstring;
+      evdepthkey=nullstring;
+      ttmethod=nullstring;
+      ttmodel=nullstring;
+    }
+    else
+    {
+      phi=0.0;
+      theta=0.0;
+      stalatkey=md.get_string("station_latitude_key");
+      stalonkey=md.get_string("station_longitude_key");
+      evlatkey=md.get_string("event_latitude_key");
+      evlonkey=md.get_string("event_longitude_key");
+      evdepthkey=md.get_string("event_depth_key");
+      ttmethod=md.get_string("ttmethod");
+      ttmodel=md.get_string("ttmodel");
+      vp0=md.get_double("vp0");
+      vs0=md.get_double("vs0");
+    }
+    use_S_slowness=md.get_bool("use_S_slowness");
+    ctsc.radius=1.0;
+    ctsc.phi=phi;
+    ctsc.theta=theta;
+  }catch(...){throw;};
+}
+SlownessVector RotateControl::slowness(double stalat,double stalon,
+    double evlat,double evlon,double evdepth)
+{
+  /* Use this for origin time - times are not important to us 
+     so it can be bogus */
+  double otime(0.0);
+  /* Assume in this procedure lat and lons are in degrees */
+  Hypocenter h(rad(evlat),rad(evlon),evdepth,otime,ttmethod,ttmodel);
+  SlownessVector u;
+  if(use_S_slowness)
+    u=h.phaseslow(rad(stalat),rad(stalon),0.0,string("S"));
+  else
+    u=h.pslow(rad(stalat),rad(stalon),0.0);
+  return u;
+}
+void RotateControl::apply(ThreeComponentEnsemble& d, bool accum_mode,
+    int ensemble_number)
+{
+  try{
+  vector<ThreeComponentSeismogram>::iterator dptr;
+  double slat,slon,evlat,evlon,evdep;
+  int k;
+  if(saamode)
+  {
+     evlat=d.get_double(evlatkey);
+     evlon=d.get_double(evlonkey);
+     evdep=d.get_double(evdepthkey);
+  }
+  for(dptr=d.member.begin(),k=0;dptr!=d.member.end();++dptr,++k)
+  {
+    if(!accum_mode)
+    {
+      if(!dptr->components_are_cardinal)
+        dptr->rotate_to_standard();
+    }
+    double az,delta;
+    if(constant_transformation)
+    {
+      dptr->rotate(ctsc);
+    }
+    else
+    {
+      slat=dptr->get_double(stalatkey);
+      slon=dptr->get_double(stalonkey);
+      if(!saamode)
+      {
+        evlat=dptr->get_double(evlatkey);
+        evlon=dptr->get_double(evlonkey);
+        evdep=dptr->get_double(evdepthkey);
+      }
+      dist(rad(slat),rad(slon),rad(evlat),rad(evlon),&delta,&az);
+      /* Azimuth, az, is backazimuth but all the rotation methods
+         in libseispp use propagation azimuth so convert to that
+         form */
+      az += M_PI;
+      if(az>(2.0*M_PI)) az -= (2.0*M_PI);
+      SlownessVector u;
+      double umag,ema,vtimesu;
+      SphericalCoordinate sc;
+      switch(mode)
+      {
+        case ZRT:
+          dptr->rotate(az);
+          break;
+        case LQT:
+          u=slowness(slat,slon,evlat,evlon,evdep);
+          umag=u.mag();
+          if(use_S_slowness)
+          {
+            vtimesu=vs0*umag;
+            if(vtimesu>1.0)
+            {
+              cerr << "Warning:  LQT vs0*slowness > 1 - assuming horizontal propagation"<<endl;
+              ema=M_PI_2;
+            }
+            else
+            {
+              ema=asin(vtimesu);
+            }
+          }
+          else
+          {
+            vtimesu=vp0*umag;
+            if(vtimesu>1.0)
+            {
+              cerr << "Warning:  LQT vp0*slowness > 1 - assuming vertical incidence"<<endl;
+              ema=0.0;
+            }
+            ema=asin(vp0*umag);
+          }
+          sc.radius=1.0;
+          /* Spherical coordinates are angles from x1 axis but 
+             the slowness vector returns azimuth from north -convert*/
+          sc.phi=M_PI_2-u.azimuth();
+          sc.theta=ema;
+          dptr->rotate(sc);
+          break;
+        case FST:
+          u=slowness(slat,slon,evlat,evlon,evdep);
+          dptr->free_surface_transformation(u,vp0,vs0);
+          break;
+        default:
+          throw SeisppError(string("RotateControl::apply:  ")
+              + "coding error - illegal rotation mode");
+      };
+      /* az is backazimuth but rotate needs amount y should rotate
+       * to be R = azimuth so add pi */
+      dptr->rotate(az+M_PI);
+      if(SEISPP_verbose)
+      {
+          cerr << "Ensemble index="<<ensemble_number<<" Member index="<<k<<endl
+              <<"Station coordinates(degrees):  "<<slat<<" "<<slon<<endl
+              <<"Event coordinates (degrees):  "<<evlat<<" "<<evlon<<endl
+              <<"Rotation angle (degrees)="<<deg(az+M_PI)<<endl;
+      }
+    }
+  }
+  }catch(...){throw;};
+}
+} // End SEISPP namespace declaration
@@ -0,0 +1,63 @@
+#ifndef _ROTATECONTROL_H_
+#define _ROTATECONTROL_H_
+#include <string>
+#include "ensemble.h"
+#include "SphericalCoordinate.h"
+#include "slowness.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Three component rotation processor.
+
+This object encapsulates the rotation algorithms of the seispp rotate
+program.   The constructor reads a parameter file that defines the
+transformation and the apply method applies it to each member of
+an ensemble.   Station and event coordinates, when needed, are
+extracted from the Metadata of each seismogram (or from the ensemble
+in small aperture array mode).
+*/
+class RotateControl
+{
+  public:
+    /*! Rotation methods supported */
+    enum RotateMode {Fixed,ZRT,LQT,FST};
+    /*! Construct from a parameter file.
+
+      \param pffile is the name of the parameter file to read.
+      \exception SeisppError is thrown if there are problems with
+        the parameter file. */
+    RotateControl(string pffile);
+    /*! Apply the transformation to all members of an ensemble.
+
+      \param d is the ensemble to be transformed (altered in place).
+      \param accum_mode when false (normal use) data are restored to
+        cardinal directions before the transformation is applied.
+      \param ensemble_number is used only in verbose messages.
+      \exception SeisppError is thrown if required Metadata are
+        missing. */
+    void apply(ThreeComponentEnsemble& d, bool accum_mode,
+        int ensemble_number=0);
+    /* When true use the same angle for all data */
+    bool constant_transformation;
+    /* When true get event metadata from ensemble metadata not
+     * trace data. This is a valid approximation only form small
+     * arrays */
+    bool saamode;
+    double phi,theta;
+    string stalatkey,stalonkey;
+    string evlatkey,evlonkey,evdepthkey;
+    string ttmethod,ttmodel;
+    RotateMode mode;
+    /* Surface P and S needed for or LQT */
+    double vp0,vs0;
+    /* When true LQT and FST modes will use S slowness.  Default is P*/
+    bool use_S_slowness;
+  private:
+    /* Transformation used when constant_transformation is true */
+    SphericalCoordinate ctsc;
+    SlownessVector slowness(double stalat,double stalon,
+        double evlat,double evlon,double evdepth);
+};
+} // End SEISPP namespace declaration
+#endif
@@ -0,0 +1,345 @@
+#include <math.h>
+#include <sstream>
+#include <algorithm>
+#include "seispp.h"
+#include "StaLtaDetector.h"
+#include "parallel_for.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/* Butterworth design.   The normalized analog Butterworth polynomial of
+order n factors into s^2 + 2 sin(theta_k) s + 1 with
+theta_k=pi*(2k-1)/(2n), k=1..n/2, and an additional s+1 for odd n.
+Each factor is mapped to a digital section with the bilinear transform
+with the corner prewarped (K=tan(pi*fc*dt)).  */
+StreamingButterworth::StreamingButterworth(double flow, int npl,
+	double fhigh, int nph, double dt)
+{
+	const string base_error("StreamingButterworth constructor:  ");
+	double fnyq=0.5/dt;
+	int pass,k,n;
+	for(pass=0;pass<2;++pass)
+	{
+		double fc;
+		bool highpass;
+		if(pass==0)
+		{
+			fc=flow;
+			n=npl;
+			highpass=true;
+		}
+		else
+		{
+			fc=fhigh;
+			n=nph;
+			highpass=false;
+		}
+		if((fc<=0.0) || (n<=0)) continue;
+		if(fc>=fnyq)
+		{
+			stringstream ss;
+			ss << base_error << "corner frequency "<<fc
+				<< " is not below the Nyquist frequency "<<fnyq;
+			throw SeisppError(ss.str());
+		}
+		double K=tan(M_PI*fc*dt);
+		double K2=K*K;
+		Section sec;
+		sec.z1=0.0;
+		sec.z2=0.0;
+		for(k=1;k<=n/2;++k)
+		{
+			double d=2.0*sin(M_PI*((double)(2*k-1))/((double)(2*n)));
+			double norm=1.0/(1.0+d*K+K2);
+			if(highpass)
+			{
+				sec.b0=norm;
+				sec.b1=-2.0*norm;
+			}
+			else
+			{
+				sec.b0=K2*norm;
+				sec.b1=2.0*sec.b0;
+			}
+			sec.b2=sec.b0;
+			sec.a1=2.0*(K2-1.0)*norm;
+			sec.a2=(1.0-d*K+K2)*norm;
+			sections.push_back(sec);
+		}
+		if(n%2)
+		{
+			double norm=1.0/(1.0+K);
+			if(highpass)
+			{
+				sec.b0=norm;
+				sec.b1=-norm;
+			}
+			else
+			{
+				sec.b0=K*norm;
+				sec.b1=sec.b0;
+			}
+			sec.b2=0.0;
+			sec.a1=(K-1.0)*norm;
+			sec.a2=0.0;
+			sections.push_back(sec);
+		}
+	}
+}
+void StreamingButterworth::apply(double *x, int n)
+{
+	vector<Section>::iterator sptr;
+	int i;
+	for(sptr=sections.begin();sptr!=sections.end();++sptr)
+	{
+		/* Local copies so the state stays in registers */
+		double b0=sptr->b0,b1=sptr->b1,b2=sptr->b2;
+		double a1=sptr->a1,a2=sptr->a2;
+		double z1=sptr->z1,z2=sptr->z2;
+		double xi,yi;
+		for(i=0;i<n;++i)
+		{
+			xi=x[i];
+			yi=b0*xi+z1;
+			z1=b1*xi-a1*yi+z2;
+			z2=b2*xi-a2*yi;
+			x[i]=yi;
+		}
+		sptr->z1=z1;
+		sptr->z2=z2;
+	}
+}
+void StreamingButterworth::reset()
+{
+	vector<Section>::iterator sptr;
+	for(sptr=sections.begin();sptr!=sections.end();++sptr)
+	{
+		sptr->z1=0.0;
+		sptr->z2=0.0;
+	}
+}
+
+StaLtaDetector::StaLtaDetector(const Metadata& mdin, double dtin) : dt(dtin)
+{
+	const string base_error("StaLtaDetector constructor:  ");
+	if(dt<=0.0) throw SeisppError(base_error
+			+ "sample interval must be positive");
+	try {
+		Metadata md(mdin);
+		double stawin=md.get_double("sta_window");
+		double ltawin=md.get_double("lta_window");
+		on_threshold=md.get_double("trigger_on");
+		off_threshold=md.get_double("trigger_off");
+		string smethod=md.get_string("stalta_method");
+		if(smethod=="recursive")
+			method=RecursiveStaLta;
+		else if(smethod=="classic")
+			method=ClassicStaLta;
+		else
+			throw SeisppError(base_error
+				+ "illegal stalta_method="+smethod
+				+ "\nMust be recursive or classic");
+		if(md.is_attribute_set("freeze_lta_when_triggered"))
+			freeze_lta=md.get_bool("freeze_lta_when_triggered");
+		else
+			freeze_lta=true;
+		nsta=nint(stawin/dt);
+		nlta=nint(ltawin/dt);
+		if( (nsta<1) || (nlta<=nsta) )
+			throw SeisppError(base_error
+				+ "sta_window must be at least one sample and shorter than lta_window");
+		if(off_threshold>on_threshold)
+			throw SeisppError(base_error
+				+ "trigger_off cannot be larger than trigger_on");
+		double flow=md.get_double("filter_low");
+		int npl=md.get_int("filter_low_poles");
+		double fhigh=md.get_double("filter_high");
+		int nph=md.get_int("filter_high_poles");
+		filter=StreamingButterworth(flow,npl,fhigh,nph,dt);
+		stringstream ss;
+		if(filter.is_null())
+			ss << "none";
+		else
+			ss << "BW "<<flow<<" "<<npl<<" "<<fhigh<<" "<<nph;
+		filter_description=ss.str();
+	}catch(MetadataGetError& mderr)
+	{
+		throw SeisppError(base_error + "missing required parameter\n"
+			+ mderr.message);
+	}
+	if(method==ClassicStaLta) ring.resize(nlta);
+	this->reset();
+}
+void StaLtaDetector::reset()
+{
+	filter.reset();
+	sta=0.0;
+	lta=0.0;
+	if(!ring.empty()) fill(ring.begin(),ring.end(),0.0);
+	ringpos=0;
+	nprocessed=0;
+	is_on=false;
+	lta_at_trigger=0.0;
+	current_ratio=0.0;
+	next_time=0.0;
+}
+/* Adds a detection at time t on the channel of d to detections */
+static void post_detection(TimeSeries& d, double t, double ratio,
+	string& filter_description, vector<Metadata>& detections)
+{
+	const string keys[4]={"net","sta","chan","loc"};
+	Metadata det;
+	for(int k=0;k<4;++k)
+		if(d.is_attribute_set(keys[k]))
+			det.put(keys[k],d.get_string(keys[k]));
+	det.put("time",t);
+	det.put("snr",ratio);
+	det.put("filter",filter_description);
+	detections.push_back(det);
+}
+int StaLtaDetector::process(TimeSeries& d, vector<Metadata>& detections)
+{
+	if( !d.live || (d.ns<=0) ) return 0;
+	if(fabs(d.dt-dt)>(0.001*dt))
+		throw SeisppError(string("StaLtaDetector::process:  ")
+			+ "sample interval of data does not match detector");
+	/* A gap or overlap starts a new stream */
+	if( (nprocessed>0) && (fabs(d.t0-next_time)>(0.5*dt)) )
+		this->reset();
+	int ns=d.ns;
+	int ndet(0);
+	work.assign(d.s.begin(),d.s.begin()+ns);
+	filter.apply(&(work[0]),ns);
+	double csta=1.0/((double)nsta);
+	double clta=1.0/((double)nlta);
+	double x2,ltause;
+	int i;
+	for(i=0;i<ns;++i)
+	{
+		x2=work[i]*work[i];
+		if(method==RecursiveStaLta)
+		{
+			sta+=csta*(x2-sta);
+			lta+=clta*(x2-lta);
+		}
+		else
+		{
+			/* ring holds the last nlta squared samples.  sta and
+			lta are running sums over the last nsta and nlta. */
+			int ista=ringpos-nsta;
+			if(ista<0) ista+=nlta;
+			sta+=x2-ring[ista];
+			lta+=x2-ring[ringpos];
+			ring[ringpos]=x2;
+			++ringpos;
+			if(ringpos>=nlta)
+			{
+				/* Recompute the sums once per pass through the
+				ring so roundoff cannot accumulate */
+				ringpos=0;
+				int j;
+				for(j=0,lta=0.0;j<nlta;++j) lta+=ring[j];
+				for(j=nlta-nsta,sta=0.0;j<nlta;++j) sta+=ring[j];
+			}
+		}
+		++nprocessed;
+		if(nprocessed<nlta) continue;
+		if(is_on && freeze_lta)
+			ltause=lta_at_trigger;
+		else
+			ltause=lta;
+		if(method==ClassicStaLta)
+			ltause*=((double)nsta)/((double)nlta);
+		if(ltause>0.0)
+			current_ratio=sta/ltause;
+		else
+			current_ratio=0.0;
+		if(is_on)
+		{
+			if(current_ratio<off_threshold) is_on=false;
+		}
+		else if(current_ratio>=on_threshold)
+		{
+			is_on=true;
+			lta_at_trigger=lta;
+			post_detection(d,d.t0+dt*((double)i),current_ratio,
+				filter_description,detections);
+			++ndet;
+		}
+	}
+	next_time=d.t0+dt*((double)ns);
+	return ndet;
+}
+
+MultichannelStaLta::MultichannelStaLta(const Metadata& md, int nt)
+	: control(md),nthreads(nt)
+{
+	/* Build a test detector so parameter errors are found now
+	rather than when the first data arrive.  The sample interval is
+	small so any sensible filter corner is below Nyquist. */
+	StaLtaDetector test(control,0.001);
+}
+/* Used to sort detections */
+static bool detection_time_less(const Metadata& a, const Metadata& b)
+{
+	return a.get_double("time")<b.get_double("time");
+}
+vector<Metadata> MultichannelStaLta::process(vector<TimeSeries>& d)
+{
+	const string base_error("MultichannelStaLta::process:  ");
+	vector<Metadata> result;
+	int i;
+	/* Group blocks by channel.   Work is done a channel at a time so
+	blocks of one channel are always processed in order. */
+	map<string,vector<int> > groups;
+	for(i=0;i<d.size();++i)
+	{
+		if(!d[i].live) continue;
+		if(!(d[i].is_attribute_set("sta")
+				&& d[i].is_attribute_set("chan")))
+			throw SeisppError(base_error
+				+ "data block is missing required sta or chan");
+		string key;
+		if(d[i].is_attribute_set("net"))
+			key=d[i].get_string("net");
+		key += string("_")+d[i].get_string("sta")
+			+ string("_")+d[i].get_string("chan");
+		if(d[i].is_attribute_set("loc"))
+			key+=string("_")+d[i].get_string("loc");
+		groups[key].push_back(i);
+	}
+	if(groups.empty()) return result;
+	/* New channels and sample rate changes are handled here so the
+	detector map is not altered by the worker threads */
+	vector<StaLtaDetector *> work_detector;
+	vector<vector<int> *> work_blocks;
+	map<string,vector<int> >::iterator gptr;
+	for(gptr=groups.begin();gptr!=groups.end();++gptr)
+	{
+		TimeSeries& first(d[gptr->second[0]]);
+		map<string,shared_ptr<StaLtaDetector> >::iterator dptr;
+		dptr=detectors.find(gptr->first);
+		if( (dptr==detectors.end()) || (fabs(dptr->second->sample_interval()
+				- first.dt)>0.001*first.dt) )
+		{
+			detectors[gptr->first]=shared_ptr<StaLtaDetector>
+				(new StaLtaDetector(control,first.dt));
+		}
+		work_detector.push_back(detectors[gptr->first].get());
+		work_blocks.push_back(&(gptr->second));
+	}
+	int nwork=work_detector.size();
+	vector<vector<Metadata> > found(nwork);
+	parallel_for(nwork,nthreads,[&](long w)
+	{
+		vector<int>& blocks(*(work_blocks[w]));
+		for(int k=0;k<blocks.size();++k)
+			work_detector[w]->process(d[blocks[k]],found[w]);
+	});
+	for(i=0;i<nwork;++i)
+		result.insert(result.end(),found[i].begin(),found[i].end());
+	stable_sort(result.begin(),result.end(),detection_time_less);
+	return result;
+}
+}  // End SEISPP namespace declaration
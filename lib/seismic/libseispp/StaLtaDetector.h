@@ -0,0 +1,195 @@
+#ifndef _STALTADETECTOR_H_
+#define _STALTADETECTOR_H_
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "Metadata.h"
+#include "TimeSeries.h"
+#include "SeisppError.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Butterworth filter that can be applied to a data stream in pieces.
+
+TimeInvariantFilter filters a complete time series and starts from
+rest on every call.   A detector running on continuous data receives
+the data in blocks (e.g. orb packets) and needs the filter state
+carried from one block to the next.   This object implements a
+Butterworth highpass, lowpass, or bandpass filter as a cascade of
+second order sections designed with the bilinear transform.  The
+state of each section is retained between calls to apply so filtering
+a stream in any number of pieces gives the same answer as filtering
+it all at once.
+
+The filter is causal (minimum phase) like the Antelope BW filters.
+*/
+class StreamingButterworth
+{
+public:
+	/*! Default constructor.  Creates a filter that does nothing. */
+	StreamingButterworth(){};
+	/*! Construct a Butterworth filter.
+
+	\param flow low frequency corner (Hz).  Set 0 for no highpass.
+	\param npl number of poles for low corner.
+	\param fhigh high frequency corner (Hz).  Set 0 for no lowpass.
+	\param nph number of poles for high corner.
+	\param dt sample interval (s) of data to be filtered.
+	\exception SeisppError is thrown for a corner above Nyquist.
+	*/
+	StreamingButterworth(double flow, int npl, double fhigh, int nph,
+		double dt);
+	/*! Filter n samples of x in place continuing from the last call. */
+	void apply(double *x, int n);
+	/*! Clear the filter memory.  Use at a data gap. */
+	void reset();
+	/*! Return true if this filter does nothing. */
+	bool is_null(){return sections.empty();};
+private:
+	/* Transposed direct form II second order section.  A first order
+	section has b2=a2=0. */
+	class Section
+	{
+	public:
+		double b0,b1,b2,a1,a2;
+		double z1,z2;
+	};
+	vector<Section> sections;
+};
+/*! Algorithms supported by StaLtaDetector */
+enum StaLtaMethod {RecursiveStaLta, /*!< exponentially weighted averages */
+	ClassicStaLta	/*!< boxcar averages over fixed windows */
+};
+/*! \brief Streaming STA/LTA detector for one channel of continuous data.
+
+This object runs a short term average over long term average
+detector on a stream of data delivered in blocks.   All state (the
+prefilter memory, the averages, and the trigger state) is carried
+from one block to the next so a detector fed one second blocks
+gives the same detections as one fed the whole day.   The averages
+are of the squared (optionally filtered) signal.
+
+Two algorithms are supported.  The recursive version uses
+exponentially weighted averages with time constants equal to the
+sta and lta windows.  The classic version uses boxcar averages
+over the last sta and lta seconds of data.  Both cost a fixed small
+number of operations per sample.
+
+A detection is declared when the ratio reaches the on threshold
+and the detector has seen at least one lta window of data.   No
+new detection is declared until the ratio falls below the off
+threshold.  By default the lta used to form the ratio is held at its
+value at the trigger time while the detector is triggered so a
+long signal does not shorten its own detection.
+
+A gap between blocks (next block start time not within half a
+sample of the expected time) resets the detector.   It then
+needs another lta window of data before it can trigger.
+*/
+class StaLtaDetector
+{
+public:
+	/*! Construct from parameters in a Metadata object.
+
+	Required parameters are sta_window and lta_window (s), trigger_on
+	and trigger_off (ratio thresholds), stalta_method (recursive or
+	classic), and filter_low, filter_low_poles, filter_high, and
+	filter_high_poles defining the optional Butterworth prefilter
+	(a corner of 0 disables that side of the filter).
+	freeze_lta_when_triggered is optional (default true).
+
+	\param md contains the parameters.
+	\param dt sample interval of the data this detector will see.
+	\exception SeisppError is thrown for missing or illegal parameters.
+	*/
+	StaLtaDetector(const Metadata& md, double dt);
+	/*! Process the next block of data for this channel.
+
+	Detections found in this block are appended to detections.  Each
+	is a Metadata object with the time of the trigger (key time), the
+	sta/lta ratio at that time (snr), the filter used (filter),
+	and the net, sta, chan, and loc attributes of the block (when
+	defined).
+
+	\param d next block of data.  d is not altered.
+	\param detections vector to which new detections are appended.
+	\return number of detections appended.
+	\exception SeisppError is thrown if the sample interval of d
+		does not match that used to create the detector.
+	*/
+	int process(TimeSeries& d, vector<Metadata>& detections);
+	/*! Clear all state.   The next block starts a new stream. */
+	void reset();
+	/*! Current sta/lta ratio (0 during warm up). */
+	double ratio(){return current_ratio;};
+	/*! True if the detector is currently triggered. */
+	bool triggered(){return is_on;};
+	/*! Sample interval the detector was designed for. */
+	double sample_interval(){return dt;};
+private:
+	StaLtaMethod method;
+	double dt;
+	double on_threshold,off_threshold;
+	bool freeze_lta;
+	string filter_description;
+	StreamingButterworth filter;
+	int nsta,nlta;
+	/* Recursive averages or boxcar sums */
+	double sta,lta;
+	/* Squared samples of the last lta window (classic only) */
+	vector<double> ring;
+	int ringpos;
+	/* Number of samples processed since the last reset */
+	long nprocessed;
+	bool is_on;
+	double lta_at_trigger;
+	double current_ratio;
+	/* Time expected for the first sample of the next block */
+	double next_time;
+	/* Scratch for filtered data */
+	vector<double> work;
+};
+/*! \brief STA/LTA detection for many channels of continuous data.
+
+This object manages one StaLtaDetector for each channel it sees.
+Each call to process takes a batch of data blocks from any mix
+of channels (e.g. all the packets read from an orb in the last
+second), runs the detectors, and returns all detections.   Channels
+are processed in parallel, but the blocks of any one channel are
+always processed in order by a single thread so results do not
+depend on the number of threads.
+
+A channel is defined by the net, sta, chan, and loc attributes of
+each block (sta and chan are required).  A detector for a new
+channel, or for a channel whose sample rate changes, is created
+from the parameters passed to the constructor.
+*/
+class MultichannelStaLta
+{
+public:
+	/*! Constructor.
+
+	\param md parameters for all detectors (see StaLtaDetector).
+	\param nthreads number of threads to use.  0 (default) means
+		use the number of cores.
+	\exception SeisppError is thrown for illegal parameters. */
+	MultichannelStaLta(const Metadata& md, int nthreads=0);
+	/*! Process a batch of data blocks.
+
+	\param d blocks to process.   Blocks of the same channel must be
+		in time order.
+	\return detections sorted by time.
+	\exception SeisppError is thrown if any block cannot be
+		processed (e.g. missing sta or chan).  */
+	vector<Metadata> process(vector<TimeSeries>& d);
+	/*! Number of channels with an active detector. */
+	int number_channels(){return detectors.size();};
+private:
+	Metadata control;
+	int nthreads;
+	map<string,shared_ptr<StaLtaDetector> > detectors;
+};
+}  // End SEISPP namespace declaration
+#endif
@@ -763,99 +763,90 @@ ThreeComponentSeismogram::ThreeComponentSeismogram(vector<TimeSeries>& ts,
 	else
 		components_are_orthogonal=false;
 }
-// Note on usage in this group of functions.  The rotation algorithms used here
-// all key on the BLAS for speed.  That is, a transformation matrix could be done
-// by using the * operator between matrix objects.  
+// Note on usage in this group of functions.  All transformations of the
+// data are done with ApplyTransformation3C, which multiplies each sample
+// vector by a 3x3 matrix in place in one pass through the data.  
+// Methods that define a new coordinate system (rotate and 
+// free_surface_transformation) do not first restore the data to cardinal
+// directions.  Instead they compose the new transformation with the 
+// inverse of the current one (set_transformation_matrix) so the data 
+// are touched only once.
 
-void ThreeComponentSeismogram::rotate_to_standard()
-	throw(SeisppError)
+void ApplyTransformation3C(double a[3][3], double *u, int ns)
 {
-	if( (ns<=0) || !live) return; // do nothing in these situations
-	double *work[3];
-	int i,j;
-	if(components_are_cardinal) return;
-	for(j=0;j<3;++j) work[j]=new double[ns];
-	if(components_are_orthogonal)
+	/* Copy the matrix to scalars so the compiler can hold them in
+	registers and vectorize the loop over samples */
+	const double a00=a[0][0],a01=a[0][1],a02=a[0][2];
+	const double a10=a[1][0],a11=a[1][1],a12=a[1][2];
+	const double a20=a[2][0],a21=a[2][1],a22=a[2][2];
+	double x0,x1,x2;
+	double *ptr;
+	int i;
+	for(i=0,ptr=u;i<ns;++i,ptr+=3)
 	{
-		//
-		//Use a daxpy algorithm.  tmatrix stores the
-		//forward transformation used to get current
-		//Use the transpose to get back
-		//
-		for(i=0;i<3;++i)
-		{
-			// x has a stride of 3 because we store in fortran order in x
-			dcopy(ns,u.get_address(0,0),3,work[i],1);
-			dscal(ns,tmatrix[0][i],work[i],1);
-			daxpy(ns,tmatrix[1][i],u.get_address(1,0),3,work[i],1);
-			daxpy(ns,tmatrix[2][i],u.get_address(2,0),3,work[i],1);
-		}
-		for(i=0;i<3;++i) dcopy(ns,work[i],1,u.get_address(i,0),3);
+		x0=ptr[0];
+		x1=ptr[1];
+		x2=ptr[2];
+		ptr[0]=a00*x0+a01*x1+a02*x2;
+		ptr[1]=a10*x0+a11*x1+a12*x2;
+		ptr[2]=a20*x0+a21*x1+a22*x2;
 	}
-	else
+}
+/* Computes the inverse of a transformation matrix.  When orthogonal is
+true the inverse is the transpose.  Otherwise the inverse is computed
+from the adjugate.  This is done in closed form rather than with the
+LAPACK routines in perf because those keep static state and this is
+called from threads (see ensemble_transforms.cc).
+Throws a SeisppError if the matrix is singular. */
+static void invert_tmatrix(double tm[3][3], bool orthogonal, 
+		double tinv[3][3])
+{
+	int i,j;
+	if(orthogonal)
 	{
-		//
-		//Enter here only when the transformation matrix is
-		//not orthogonal.  We have to construct a fortran 
-		//order matrix a to use LINPACK routine in sunperf/perf
-		//This could be done with the matrix template library 
-		//but the overhead ain't worth it
-		//
-		double a[9];
-		int ipivot[3];
-		int info;
-		double det;
-		int asize=3;
-		double awork[10];
-		int ldwork=10;
-		a[0] = tmatrix[0][0];
-		a[1] = tmatrix[1][0];
-		a[2] = tmatrix[2][0];
-		a[3] = tmatrix[0][1];
-		a[4] = tmatrix[1][1];
-		a[5] = tmatrix[2][1];
-		a[6] = tmatrix[0][2];
-		a[7] = tmatrix[1][2];
-		a[8] = tmatrix[2][2];
-		//Perf lib matrix inversion routine using LU factorizatoin
-		// Note this is changed from parent code.  Untested.
-		dgetrf_(&asize,&asize,a,&asize,ipivot,&info);
-		if(info!=0) 
-                {
-                    for(i=0;i<3;++i) delete [] work[i];
-                    throw(SeisppError(
-			string("rotate_to_standard:  LU factorization of transformation matrix failed")));
-                }
-		dgetri_(&asize,a,&asize,ipivot,awork,&ldwork,&info);
-		if(info!=0) 
-                {
-                    for(i=0;i<3;++i) delete [] work[i];
-                    throw(SeisppError(
-			string("rotate_to_standard:  LU factorization inversion of transformation matrix failed")));
-                }
-		
-		tmatrix[0][0] = a[0];
-		tmatrix[1][0] = a[1];
-		tmatrix[2][0] = a[2];
-		tmatrix[0][1] = a[3];
-		tmatrix[1][1] = a[4];
-		tmatrix[2][1] = a[5];
-		tmatrix[0][2] = a[6];
-		tmatrix[1][2] = a[7];
-		tmatrix[2][2] = a[8];
-                /* The inverse is now in tmatrix so we reverse the 
-                   rows and columms from above loop */
- 
 		for(i=0;i<3;++i)
+			for(j=0;j<3;++j) tinv[i][j]=tm[j][i];
+		return;
+	}
+	double cof[3][3];  // cofactors of tm
+	double det;
+	cof[0][0]=tm[1][1]*tm[2][2]-tm[1][2]*tm[2][1];
+	cof[0][1]=tm[1][2]*tm[2][0]-tm[1][0]*tm[2][2];
+	cof[0][2]=tm[1][0]*tm[2][1]-tm[1][1]*tm[2][0];
+	cof[1][0]=tm[0][2]*tm[2][1]-tm[0][1]*tm[2][2];
+	cof[1][1]=tm[0][0]*tm[2][2]-tm[0][2]*tm[2][0];
+	cof[1][2]=tm[0][1]*tm[2][0]-tm[0][0]*tm[2][1];
+	cof[2][0]=tm[0][1]*tm[1][2]-tm[0][2]*tm[1][1];
+	cof[2][1]=tm[0][2]*tm[1][0]-tm[0][0]*tm[1][2];
+	cof[2][2]=tm[0][0]*tm[1][1]-tm[0][1]*tm[1][0];
+	det=tm[0][0]*cof[0][0]+tm[0][1]*cof[0][1]+tm[0][2]*cof[0][2];
+	if(det==0.0) 
+		throw(SeisppError(
+		string("rotate_to_standard:  transformation matrix is singular")));
+	for(i=0;i<3;++i)
+		for(j=0;j<3;++j) tinv[i][j]=cof[j][i]/det;
+}
+/* c=a*b for 3x3 matrices.  c must not be a or b */
+static void mult3x3(double a[3][3], double b[3][3], double c[3][3])
+{
+	int i,j,k;
+	for(i=0;i<3;++i)
+		for(j=0;j<3;++j)
 		{
-			dcopy(ns,u.get_address(0,0),3,work[i],1);
-			dscal(ns,tmatrix[i][0],work[i],1);
-			daxpy(ns,tmatrix[i][1],u.get_address(1,0),3,work[i],1);
-			daxpy(ns,tmatrix[i][2],u.get_address(2,0),3,work[i],1);
+			c[i][j]=0.0;
+			for(k=0;k<3;++k) c[i][j]+=a[i][k]*b[k][j];
 		}
-		for(i=0;i<3;++i) dcopy(ns,work[i],1,u.get_address(i,0),3);
-		components_are_orthogonal = true;
-	}
+}
+
+void ThreeComponentSeismogram::rotate_to_standard()
+	throw(SeisppError)
+{
+	if( (ns<=0) || !live) return; // do nothing in these situations
+	int i,j;
+	if(components_are_cardinal) return;
+	double tinv[3][3];
+	invert_tmatrix(tmatrix,components_are_orthogonal,tinv);
+	ApplyTransformation3C(tinv,u.get_address(0,0),ns);
 	//
 	//Have to set the transformation matrix to an identity now
 	//
@@ -867,7 +858,34 @@ void ThreeComponentSeismogram::rotate_to_standard()
 				tmatrix[i][j]=0.0;
 
 	components_are_cardinal=true;
-	for(i=0;i<3;++i) delete [] work[i];
+	components_are_orthogonal=true;
+}
+void ThreeComponentSeismogram::set_transformation_matrix(double a[3][3])
+{
+	if( (ns<=0) || !live) return; // do nothing in these situations
+	int i,j;
+	double op[3][3];
+	if(components_are_cardinal)
+	{
+		for(i=0;i<3;++i)
+			for(j=0;j<3;++j) op[i][j]=a[i][j];
+	}
+	else
+	{
+		/* Data operator is a times the inverse of the current
+		transformation - undo and apply the new transformation
+		in one pass */
+		double tinv[3][3];
+		invert_tmatrix(tmatrix,components_are_orthogonal,tinv);
+		mult3x3(a,tinv,op);
+	}
+	ApplyTransformation3C(op,u.get_address(0,0),ns);
+	for(i=0;i<3;++i)
+		for(j=0;j<3;++j) tmatrix[i][j]=a[i][j];
+	components_are_cardinal = tmatrix_is_cardinal(*this);
+	/* As in apply_transformation_matrix we do not test a for 
+	orthogonality. Callers that know better set this true. */
+	components_are_orthogonal = components_are_cardinal;
 }
 
 
@@ -901,28 +919,28 @@ Arguments:
 	xsc - spherical coordinate structure defining unit vector used
 		to define the transform (radius is ignored).  Angles
 		are assumed in radians.
+	tm - transformation matrix returned.
 
 Author:  Gary L. Pavlis
 Written:  Sept. 1999
 Modified:  Feb 2003
 Original was plain C.  Adapted to C++ for seismic processing
 */
-void ThreeComponentSeismogram::rotate(SphericalCoordinate xsc)
+static void ray_transformation_matrix(SphericalCoordinate xsc, 
+		double tm[3][3])
 {
-	if( (ns<=0) || !live) return; // do nothing in these situations
-	int i;
+	int i,j;
 	double theta, phi;  /* corrected angles after dealing with signs */
 	double a,b,c,d;
 
-	//
-	//Undo any previous transformations
-	//
-	this->rotate_to_standard();
        	if(xsc.theta == M_PI) 
 	{
 		//This will be left handed
-		tmatrix[2][2] = -1.0;
-                dscal(ns,-1.0,u.get_address(2,0),3);
+		for(i=0;i<3;++i)
+			for(j=0;j<3;++j) tm[i][j]=0.0;
+		tm[0][0]=1.0;
+		tm[1][1]=1.0;
+		tm[2][2] = -1.0;
 		return;
 	}
 
@@ -950,29 +968,27 @@ void ThreeComponentSeismogram::rotate(SphericalCoordinate xsc)
         c = cos(theta);
         d = sin(theta);
 
-	tmatrix[0][0] = a;
-	tmatrix[1][0] = b*c;
-	tmatrix[2][0] = b*d;
-	tmatrix[0][1] = -b;
-	tmatrix[1][1] = a*c;
-	tmatrix[2][1] = a*d;
-	tmatrix[0][2] = 0.0;
-	tmatrix[1][2] = -d;
-	tmatrix[2][2] = c;
-
-        /* Now multiply the data by this transformation matrix.  */
-	double *work[3];
-	for(i=0;i<3;++i)work[i] = new double[ns];
-	for(i=0;i<3;++i)
-	{
-		dcopy(ns,u.get_address(0,0),3,work[i],1);
-		dscal(ns,tmatrix[i][0],work[i],1);
-		daxpy(ns,tmatrix[i][1],u.get_address(1,0),3,work[i],1);
-		daxpy(ns,tmatrix[i][2],u.get_address(2,0),3,work[i],1);
-	}
-	for(i=0;i<3;++i) dcopy(ns,work[i],1,u.get_address(i,0),3);
+	tm[0][0] = a;
+	tm[1][0] = b*c;
+	tm[2][0] = b*d;
+	tm[0][1] = -b;
+	tm[1][1] = a*c;
+	tm[2][1] = a*d;
+	tm[0][2] = 0.0;
+	tm[1][2] = -d;
+	tm[2][2] = c;
+}
+void ThreeComponentSeismogram::rotate(SphericalCoordinate xsc)
+{
+	if( (ns<=0) || !live) return; // do nothing in these situations
+	double tm[3][3];
+	ray_transformation_matrix(xsc,tm);
+	//
+	//Replaces any previous transformation in one pass
+	//
+	this->set_transformation_matrix(tm);
 	components_are_cardinal=false;
-	for(i=0;i<3;++i) delete [] work[i];
+	components_are_orthogonal=true;
 }
 void ThreeComponentSeismogram::rotate(double nu[3])
 {
@@ -982,71 +998,38 @@ void ThreeComponentSeismogram::rotate(double nu[3])
 }
 /* simplified procedure to rotate only zonal angle by phi radians. 
  Similar to above but using only azimuth angle AND doing a simple
- rotation in the horizontal plane.  Efficient algorithm only 
- alters 0 and 1 components. */
+ rotation in the horizontal plane. */
 void ThreeComponentSeismogram::rotate(double phi)
 {
 	if( (ns<=0) || !live) return; // do nothing in these situations
-	int i;
 	double a,b;
-        /* Restore to cardinate coordinates */
-        this->rotate_to_standard();
+	double tm[3][3];
         a=cos(phi);
         b=sin(phi);
-	tmatrix[0][0] = a;
-	tmatrix[1][0] = b;
-	tmatrix[2][0] = 0.0;
-	tmatrix[0][1] = -b;
-	tmatrix[1][1] = a;
-	tmatrix[2][1] = 0.0;
-	tmatrix[0][2] = 0.0;
-	tmatrix[1][2] = 0.0;
-	tmatrix[2][2] = 1.0;
-
-        /* Now multiply the data by this transformation matrix.  
-         Not trick in this i only goes to 2 because 3 component
-         is an identity.*/
-	double *work[2];
-	for(i=0;i<2;++i)work[i] = new double[ns];
-	for(i=0;i<2;++i)
-	{
-		dcopy(ns,u.get_address(0,0),3,work[i],1);
-		dscal(ns,tmatrix[i][0],work[i],1);
-		daxpy(ns,tmatrix[i][1],u.get_address(1,0),3,work[i],1);
-	}
-	for(i=0;i<2;++i) dcopy(ns,work[i],1,u.get_address(i,0),3);
+	tm[0][0] = a;
+	tm[1][0] = b;
+	tm[2][0] = 0.0;
+	tm[0][1] = -b;
+	tm[1][1] = a;
+	tm[2][1] = 0.0;
+	tm[0][2] = 0.0;
+	tm[1][2] = 0.0;
+	tm[2][2] = 1.0;
+	this->set_transformation_matrix(tm);
 	components_are_cardinal=false;
-	for(i=0;i<2;++i) delete [] work[i];
+	components_are_orthogonal=true;
 }
 void ThreeComponentSeismogram::apply_transformation_matrix(double a[3][3])
 {
 	if( (ns<=0) || !live) return; // do nothing in these situations
-	int i,j,k;
-	double *work[3];
-	for(i=0;i<3;++i) work[i] = new double[ns];
-	double twork[3];
-	for(i=0;i<3;++i)
-	{
-		dcopy(ns,u.get_address(0,0),3,work[i],1);
-		dscal(ns,a[i][0],work[i],1);
-		daxpy(ns,a[i][1],u.get_address(1,0),3,work[i],1);
-		daxpy(ns,a[i][2],u.get_address(2,0),3,work[i],1);
-	}
-	for(i=0;i<3;++i) dcopy(ns,work[i],1,u.get_address(i,0),3);
-	 for(i=0;i<3;++i) delete [] work[i];
+	ApplyTransformation3C(a,u.get_address(0,0),ns);
          /* Hand code this rather than use dmatrix or other library.
             Probably dumb, but this is just a 3x3 system.  This 
             is simply a multiply of a*tmatrix with result replacing
             the internal tmatrix */
          double tmnew[3][3];
-         double prod;
-         for(i=0;i<3;++i)
-             for(j=0;j<3;++j)
-             {
-                 for(prod=0.0,k=0;k<3;++k)
-                     prod+=a[i][k]*tmatrix[k][j];
-                 tmnew[i][j]=prod;
-             }
+         int i,j;
+         mult3x3(a,tmatrix,tmnew);
          for(i=0;i<3;++i)
              for(j=0;j<3;++j)tmatrix[i][j]=tmnew[i][j];
 	components_are_cardinal = false;
@@ -1098,7 +1081,8 @@ void ThreeComponentSeismogram::free_surface_transformation(SlownessVector uvec,
 	scor.radius=1.0;
 	// after this transformation x1=transverse horizontal
 	// x2=radial horizonal, and x3 is still vertical
-	this->rotate(scor);
+	double hrot[3][3];
+	ray_transformation_matrix(scor,hrot);
 
 	a02=a0*a0;
 	b02=b0*b0;
@@ -1120,7 +1104,10 @@ void ThreeComponentSeismogram::free_surface_transformation(SlownessVector uvec,
 	fstran[0][0]=0.5;  fstran[0][1]=0.0;  fstran[0][2]=0.0;
 	fstran[1][0]=0.0;  fstran[1][1]=vsr;  fstran[1][2]=vpr;
 	fstran[2][0]=0.0;  fstran[2][1]=-vsz;  fstran[2][2]=-vpz;
-	this->apply_transformation_matrix(fstran);
+	/* Compose the two and apply in one pass */
+	double tm[3][3];
+	mult3x3(fstran,hrot,tm);
+	this->set_transformation_matrix(tm);
 
 	components_are_cardinal=false;
 	components_are_orthogonal=false;
@@ -348,6 +348,24 @@ method defined below.
 \param a is a C style 3x3 matrix.
 **/
 	void apply_transformation_matrix(double a[3][3]);
+/*!
+ Transform the data so the transformation matrix becomes a.
+
+ This is equivalent to calling rotate_to_standard followed by
+ apply_transformation_matrix(a), but the inverse of the current
+ transformation and a are composed first so the data are
+ transformed in a single pass.   This is the method to use when a
+ new coordinate system replaces the current one.   The rotate methods
+ and free_surface_transformation use it.  After the call
+ components_are_orthogonal is set false unless a is an identity.  
+ Set it true if a is known to be orthogonal.
+
+\param a is a C style 3x3 matrix defining the new transformation
+  from cardinal coordinates.
+\exception SeisppError thrown if the current transformation matrix
+  is singular.
+**/
+	void set_transformation_matrix(double a[3][3]);
 /*!
  Computes and applies the Kennett [1991] free surface transformation matrix.
 
@@ -394,6 +412,19 @@ a geographical azimuth.
 
 */
 void HorizontalRotation(ThreeComponentSeismogram& d, double phi);
+/*! \brief Low level 3x3 transformation of three component samples.
+
+Multiplies each 3 component sample vector by the matrix a in place.
+The data are assumed stored in the form used by the u matrix of
+a ThreeComponentSeismogram (3 values per sample, component index
+varying fastest).  No work space is used.   Normal use is through
+ThreeComponentSeismogram methods, which also maintain tmatrix.
+
+\param a is a C style 3x3 matrix
+\param u is a pointer to the first sample (e.g. d.u.get_address(0,0))
+\param ns is the number of samples
+*/
+void ApplyTransformation3C(double a[3][3], double *u, int ns);
 /*!
  Extract one component from a ThreeComponentSeismogram and 
  create a TimeSeries object from it.  
@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "stock.h"
+#include "TravelTimeTable.h"
+using namespace std;
+using namespace SEISPP;
+namespace SEISPP
+{
+/* The Antelope tt interface and the calculators it loads are not
+thread safe.  Every call made through any table, either to build
+a row or as a fallback, is serialized with this lock.  Lookups in
+rows that are already built never touch it. */
+static mutex calculator_lock;
+
+/* Used to convert ray parameter (s/km) to dt/ddelta (s/radian).
+The differences between earth radii used by the calculators are
+irrelevant here since this only sets the Hermite slopes. */
+const double TTTABLE_EARTH_RADIUS(6371.0);
+
+/* Layout of a table file.  The header is followed by padding to
+TTTABLE_HEADER_SIZE bytes, then the nz by nd time array and the
+nz by nd slowness array as native doubles.  The byteorder word
+is used to reject files written on a machine of different endian.*/
+const char TTTABLE_MAGIC[8]={'S','P','P','T','T','T','1','\0'};
+const int TTTABLE_BYTEORDER(0x01020304);
+const size_t TTTABLE_HEADER_SIZE(512);
+typedef struct TTTableHeader {
+	char magic[8];
+	int byteorder;
+	int nd,nz;
+	int spare;
+	double ddelta,z0,dz,vsurface;
+	char method[64],model[64],phase[32];
+} TTTableHeader;
+
+TravelTimeTable::TravelTimeTable(string meth, string mod, string phase_name,
+	double delta_max, double dd, double zmin, double zmax, double dz0,
+		double vs)
+	: method(meth),model(mod),phase(phase_name),mapbase(NULL),maplength(0)
+{
+	const string base_error("TravelTimeTable constructor:  ");
+	if( (dd<=0.0) || (delta_max<dd) || (delta_max>180.0) )
+		throw SeisppError(base_error
+			+ string("invalid distance grid definition"));
+	if( (dz0<=0.0) || (zmax<=zmin) )
+		throw SeisppError(base_error
+			+ string("invalid depth grid definition"));
+	if(vs<0.0)
+		throw SeisppError(base_error
+			+ string("surface velocity cannot be negative"));
+	if( (method.size()>=64) || (model.size()>=64) || (phase.size()>=32) )
+		throw SeisppError(base_error
+			+ string("method, model, or phase name is too long"));
+	/* The distance grid never extends past delta_max while the
+	depth grid always reaches at least zmax */
+	nd=static_cast<int>(floor(delta_max/dd+0.0001))+1;
+	nz=static_cast<int>(ceil((zmax-zmin)/dz0-0.0001))+1;
+	ddelta=rad(dd);
+	z0=zmin;
+	dz=dz0;
+	vsurface=vs;
+	ttbuffer.resize(nd*nz,-1.0);
+	slowbuffer.resize(nd*nz,-1.0);
+	ttime=&(ttbuffer[0]);
+	slow=&(slowbuffer[0]);
+	ready=new atomic<char>[nz];
+	for(int i=0;i<nz;++i) ready[i].store(0);
+}
+TravelTimeTable::TravelTimeTable(string fname)
+{
+	const string base_error("TravelTimeTable file constructor:  ");
+	int fd;
+	struct stat sb;
+	TTTableHeader hdr;
+
+	fd=open(fname.c_str(),O_RDONLY);
+	if(fd<0)
+		throw SeisppError(base_error+string("cannot open ")+fname);
+	if( (fstat(fd,&sb)!=0)
+		|| (sb.st_size<static_cast<off_t>(TTTABLE_HEADER_SIZE)) )
+	{
+		close(fd);
+		throw SeisppError(base_error+fname
+			+string(" is not a travel time table file"));
+	}
+	maplength=static_cast<size_t>(sb.st_size);
+	mapbase=mmap(NULL,maplength,PROT_READ,MAP_SHARED,fd,0);
+	close(fd);
+	if(mapbase==MAP_FAILED)
+		throw SeisppError(base_error+string("mmap failed for ")+fname);
+	memcpy(&hdr,mapbase,sizeof(TTTableHeader));
+	size_t nbytes=TTTABLE_HEADER_SIZE
+		+2*sizeof(double)*static_cast<size_t>(hdr.nd)*hdr.nz;
+	if( memcmp(hdr.magic,TTTABLE_MAGIC,8)
+		|| (hdr.byteorder!=TTTABLE_BYTEORDER)
+		|| (hdr.nd<2) || (hdr.nz<2) || (nbytes!=maplength) )
+	{
+		munmap(mapbase,maplength);
+		throw SeisppError(base_error+fname
+			+string(" is not a valid travel time table for this machine"));
+	}
+	hdr.method[63]='\0';
+	hdr.model[63]='\0';
+	hdr.phase[31]='\0';
+	method=string(hdr.method);
+	model=string(hdr.model);
+	phase=string(hdr.phase);
+	nd=hdr.nd;
+	nz=hdr.nz;
+	ddelta=hdr.ddelta;
+	z0=hdr.z0;
+	dz=hdr.dz;
+	vsurface=hdr.vsurface;
+	ttime=reinterpret_cast<double *>(static_cast<char *>(mapbase)
+			+TTTABLE_HEADER_SIZE);
+	slow=ttime+nd*nz;
+	ready=new atomic<char>[nz];
+	for(int i=0;i<nz;++i) ready[i].store(1);
+}
+TravelTimeTable::~TravelTimeTable()
+{
+	delete [] ready;
+	if(mapbase!=NULL) munmap(mapbase,maplength);
+}
+/* Compute one depth row of the grid.  Failures of the calculator
+are not errors here.  They just mark nodes where the phase does not
+exist. */
+void TravelTimeTable::build_row(int iz)
+{
+	lock_guard<mutex> lock(build_lock);
+	/* Another thread may have built this row while we waited */
+	if(ready[iz].load(memory_order_relaxed)) return;
+	double depth=z0+dz*static_cast<double>(iz);
+	Hypocenter h(0.0,0.0,depth,0.0,method,model);
+	double *t=ttime+iz*nd;
+	double *u=slow+iz*nd;
+	for(int i=0;i<nd;++i)
+	{
+		/* Receivers are placed along the equator at sea level */
+		double lon0=ddelta*static_cast<double>(i);
+		lock_guard<mutex> calc(calculator_lock);
+		try {
+			t[i]=h.phasetime(0.0,lon0,0.0,phase);
+		} catch (SeisppError& serr)
+		{
+			t[i]=-1.0;
+		}
+		u[i]=-1.0;
+		if(t[i]<0.0) continue;
+		try {
+			SlownessVector sv=h.phaseslow(0.0,lon0,0.0,phase);
+			u[i]=hypot(sv.ux,sv.uy);
+		} catch (SeisppError& serr)
+		{
+			u[i]=-1.0;
+		}
+	}
+	ready[iz].store(1,memory_order_release);
+}
+void TravelTimeTable::build()
+{
+	for(int iz=0;iz<nz;++iz) require_row(iz);
+}
+/* Cubic Hermite interpolation along one row of the grid between
+nodes id and id+1 at fractional position s.  The slopes come from
+the ray parameter.  If either ray parameter is missing this reverts
+to linear interpolation.  Returns a negative number if the phase is
+not defined at both nodes.*/
+static double hermite_row(const double *t, const double *u, int id,
+	double s, double h)
+{
+	double t0=t[id];
+	double t1=t[id+1];
+	if( (t0<0.0) || (t1<0.0) ) return(-1.0);
+	if( (u[id]<0.0) || (u[id+1]<0.0) ) return(t0+s*(t1-t0));
+	double m0=u[id]*TTTABLE_EARTH_RADIUS*h;
+	double m1=u[id+1]*TTTABLE_EARTH_RADIUS*h;
+	double s2=s*s;
+	double s3=s2*s;
+	return( (2.0*s3-3.0*s2+1.0)*t0 + (s3-2.0*s2+s)*m0
+		+ (3.0*s2-2.0*s3)*t1 + (s3-s2)*m1 );
+}
+/* Core interpolator.  Returns false if (delta,depth) is outside the
+grid or the phase is not defined in the grid cell.  p is set negative
+if time is defined but the ray parameter is not. */
+bool TravelTimeTable::interpolate(double delta, double depth,
+	double& t, double& p)
+{
+	double x=delta/ddelta;
+	double y=(depth-z0)/dz;
+	if( (x<0.0) || (x>static_cast<double>(nd-1))
+		|| (y<0.0) || (y>static_cast<double>(nz-1)) ) return false;
+	int id=static_cast<int>(x);
+	if(id>=nd-1) id=nd-2;
+	int iz=static_cast<int>(y);
+	if(iz>=nz-1) iz=nz-2;
+	double s=x-static_cast<double>(id);
+	double r=y-static_cast<double>(iz);
+	require_row(iz);
+	require_row(iz+1);
+	const double *ta=ttime+iz*nd;
+	const double *tb=ta+nd;
+	const double *ua=slow+iz*nd;
+	const double *ub=ua+nd;
+	double t1=hermite_row(ta,ua,id,s,ddelta);
+	double t2=hermite_row(tb,ub,id,s,ddelta);
+	if( (t1<0.0) || (t2<0.0) ) return false;
+	t=t1+r*(t2-t1);
+	if( (ua[id]<0.0) || (ua[id+1]<0.0) || (ub[id]<0.0) || (ub[id+1]<0.0) )
+		p=-1.0;
+	else
+		p=(1.0-r)*((1.0-s)*ua[id]+s*ua[id+1])
+			+ r*((1.0-s)*ub[id]+s*ub[id+1]);
+	return true;
+}
+double TravelTimeTable::time(double delta, double depth)
+{
+	double t,p;
+	if(!interpolate(delta,depth,t,p))
+		throw SeisppError(string("TravelTimeTable::time:  ")
+			+ phase + string(" is not tabulated at requested distance and depth"));
+	return(t);
+}
+double TravelTimeTable::slowness(double delta, double depth)
+{
+	double t,p;
+	if( !interpolate(delta,depth,t,p) || (p<0.0) )
+		throw SeisppError(string("TravelTimeTable::slowness:  ")
+			+ phase + string(" slowness is not tabulated at requested distance and depth"));
+	return(p);
+}
+Hypocenter TravelTimeTable::fallback(Hypocenter& h)
+{
+	return(Hypocenter(h.lat,h.lon,h.z,h.time,method,model));
+}
+/* Vertical ray correction for a receiver at elevation elev (km) for
+a ray with ray parameter p (s/km).  Zero if vsurface is 0 or p is
+not defined. */
+double TravelTimeTable::elevation_correction(double p, double elev)
+{
+	if( (vsurface<=0.0) || (p<0.0) ) return(0.0);
+	double eta2=1.0/(vsurface*vsurface)-p*p;
+	if(eta2<=0.0) return(0.0);
+	return(elev*sqrt(eta2));
+}
+double TravelTimeTable::phasetime(Hypocenter& h, double lat0, double lon0,
+	double elev)
+{
+	double t,p;
+	if(interpolate(h.distance(lat0,lon0),h.z,t,p))
+		return(t+elevation_correction(p,elev));
+	/* Compute at sea level like the grid so elevation is handled
+	the same way by both paths */
+	Hypocenter hexact=fallback(h);
+	lock_guard<mutex> calc(calculator_lock);
+	try {
+		t=hexact.phasetime(lat0,lon0,0.0,phase);
+		if(vsurface>0.0)
+		{
+			try {
+				SlownessVector sv=hexact.phaseslow(lat0,lon0,0.0,phase);
+				t+=elevation_correction(hypot(sv.ux,sv.uy),elev);
+			} catch (SeisppError& serr) {};
+		}
+		return(t);
+	} catch (...) {throw;};
+}
+SlownessVector TravelTimeTable::phaseslow(Hypocenter& h, double lat0,
+	double lon0, double elev)
+{
+	double t,p;
+	if(interpolate(h.distance(lat0,lon0),h.z,t,p) && (p>=0.0) )
+	{
+		/* Propagation direction at the receiver is opposite the
+		station to event azimuth */
+		double az=h.seaz(lat0,lon0)+M_PI;
+		return(SlownessVector(p*sin(az),p*cos(az)));
+	}
+	Hypocenter hexact=fallback(h);
+	lock_guard<mutex> calc(calculator_lock);
+	try {
+		return(hexact.phaseslow(lat0,lon0,0.0,phase));
+	} catch (...) {throw;};
+}
+void TravelTimeTable::save(string fname)
+{
+	const string base_error("TravelTimeTable::save:  ");
+	TTTableHeader hdr;
+	char pad[TTTABLE_HEADER_SIZE];
+	FILE *fp;
+
+	build();
+	memset(&hdr,0,sizeof(TTTableHeader));
+	memcpy(hdr.magic,TTTABLE_MAGIC,8);
+	hdr.byteorder=TTTABLE_BYTEORDER;
+	hdr.nd=nd;
+	hdr.nz=nz;
+	hdr.ddelta=ddelta;
+	hdr.z0=z0;
+	hdr.dz=dz;
+	hdr.vsurface=vsurface;
+	strncpy(hdr.method,method.c_str(),63);
+	strncpy(hdr.model,model.c_str(),63);
+	strncpy(hdr.phase,phase.c_str(),31);
+	memset(pad,0,TTTABLE_HEADER_SIZE);
+	memcpy(pad,&hdr,sizeof(TTTableHeader));
+
+	string tmpname=fname+string(".tmp");
+	fp=fopen(tmpname.c_str(),"w");
+	if(fp==NULL)
+		throw SeisppError(base_error+string("cannot open ")+tmpname);
+	size_t npts=static_cast<size_t>(nd)*nz;
+	if( (fwrite(pad,1,TTTABLE_HEADER_SIZE,fp)!=TTTABLE_HEADER_SIZE)
+		|| (fwrite(ttime,sizeof(double),npts,fp)!=npts)
+		|| (fwrite(slow,sizeof(double),npts,fp)!=npts) )
+	{
+		fclose(fp);
+		unlink(tmpname.c_str());
+		throw SeisppError(base_error+string("write error on ")+tmpname);
+	}
+	if(fclose(fp))
+	{
+		unlink(tmpname.c_str());
+		throw SeisppError(base_error+string("write error on ")+tmpname);
+	}
+	if(rename(tmpname.c_str(),fname.c_str()))
+	{
+		unlink(tmpname.c_str());
+		throw SeisppError(base_error+string("cannot rename ")+tmpname
+			+string(" to ")+fname);
+	}
+}
+} // End SEISPP namespace declaration
@@ -0,0 +1,146 @@
+#ifndef _TRAVELTIMETABLE_H_
+#define _TRAVELTIMETABLE_H_
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "SeisppError.h"
+#include "Hypocenter.h"
+#include "slowness.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Tabulated travel times for one phase and one earth model.
+
+Hypocenter::phasetime and Hypocenter::phaseslow call the Antelope
+tt interface for every station.  That is fine for a few stations
+but predicting arrivals for a large array and a large catalog
+repeats the same ray calculations millions of times.  This object
+samples the travel time and ray parameter of a single phase on a
+regular (epicentral distance, source depth) grid and interpolates
+that grid.  Time is interpolated with cubic Hermite polynomials in
+distance, using the ray parameter as the slope, and linearly in
+depth.  The ray parameter is interpolated bilinearly.  With the
+default 0.1 degree by 5 km grid the interpolation error is of the
+order of milliseconds.  It is largest at distances comparable to
+the depth of shallow sources where travel time curves bend sharply.
+Use a finer grid for local event work.
+
+The grid is built lazily.  A depth row is computed the first time
+any lookup needs it, so a catalog of events at a few depths never
+pays for the rest of the table.  Lookups are safe to call from
+any number of threads.  Row construction and all calls to the
+tt interface are serialized internally because the travel time
+calculators themselves are not thread safe.
+
+A complete table can be written to a file with save and later
+loaded with the file constructor.  A loaded table is memory
+mapped read only, so many processes using the same table share
+one copy of it.
+
+The grid is computed with the receiver at sea level.  Station
+elevation is handled with a vertical ray correction through a
+layer of velocity vsurface.  That is exactly what tt1dcvl does
+with its first layer.  If vsurface is 0 elevation is ignored, as
+it is by tttaup.
+
+When a point falls outside the grid, or in a grid cell where the
+phase does not exist at all four corners (e.g. the P shadow zone),
+phasetime and phaseslow fall back to calling the calculator
+directly.  Results are always defined when the calculator itself
+would succeed.  The calculator is called with the receiver at sea
+level and the same vsurface correction applied, so elevation is
+handled the same way whichever path is taken.
+*/
+class TravelTimeTable
+{
+public:
+	/*! Define a table that will be built on demand.
+
+	\param meth travel time method passed to the tt interface (e.g. tttaup).
+	\param mod earth model name passed to the tt interface (e.g. iasp91).
+	\param phase_name phase to tabulate.  As with phasetime this
+		is normally the first arrival of that phase name.
+	\param delta_max maximum epicentral distance (degrees)
+	\param ddelta distance grid interval (degrees)
+	\param zmin minimum source depth (km)
+	\param zmax maximum source depth (km)
+	\param dz depth grid interval (km)
+	\param vsurface velocity (km/s) used for station elevation
+		corrections.  0 means no elevation correction.
+	\exception SeisppError is thrown for an invalid grid.
+	*/
+	TravelTimeTable(string meth, string mod, string phase_name,
+		double delta_max=180.0, double ddelta=0.1,
+		double zmin=0.0, double zmax=700.0, double dz=5.0,
+		double vsurface=0.0);
+	/*! Load a table written earlier by save.  The file is
+	memory mapped read only.
+
+	\exception SeisppError is thrown if the file cannot be opened
+		or is not a valid table for this machine.
+	*/
+	TravelTimeTable(string fname);
+	~TravelTimeTable();
+	/*! Interpolated travel time (s).
+
+	\param delta epicentral distance in radians.
+	\param depth source depth in km.
+	\exception SeisppError if the point is outside the grid or the
+		phase is not defined in the grid cell containing it.
+	*/
+	double time(double delta, double depth);
+	/*! Interpolated ray parameter (s/km) with the same conventions
+	as time. */
+	double slowness(double delta, double depth);
+	/*! Drop in replacement for Hypocenter::phasetime using this table.
+	The method, model, and phase of the Hypocenter are ignored;
+	those of the table are used.  Station coordinates are in radians
+	and elevation in km, as for Hypocenter.
+	\exception SeisppError if the fallback calculation fails. */
+	double phasetime(Hypocenter& h, double lat0, double lon0, double elev);
+	/*! Drop in replacement for Hypocenter::phaseslow using this table.
+	\exception SeisppError if the fallback calculation fails. */
+	SlownessVector phaseslow(Hypocenter& h, double lat0, double lon0,
+		double elev);
+	/*! Compute every row of the grid that has not yet been built. */
+	void build();
+	/*! Build the complete table and write it to a file.  The file
+	is written to a temporary name and renamed, so a process loading
+	the table never sees a partial file.
+	\exception SeisppError on any i/o error. */
+	void save(string fname);
+	/*! Return the phase this table was built for. */
+	string phase_name(){return phase;};
+	/*! Return a string that uniquely describes the table in the
+	same form as Hypocenter::tt_definition. */
+	string tt_definition(){return(method+":"+model);};
+private:
+	string method,model,phase;
+	int nd,nz;
+	double ddelta,z0,dz,vsurface;  // ddelta in radians
+	/* Row major nz by nd arrays.  These point either into the
+	vectors below or into a memory mapped file.  Invalid nodes
+	hold a negative value. */
+	double *ttime,*slow;
+	vector<double> ttbuffer,slowbuffer;
+	atomic<char> *ready;
+	mutex build_lock;
+	void *mapbase;
+	size_t maplength;
+	void build_row(int iz);
+	void require_row(int iz)
+	{
+		if(!ready[iz].load(memory_order_acquire)) build_row(iz);
+	};
+	bool interpolate(double delta, double depth, double& t, double& p);
+	Hypocenter fallback(Hypocenter& h);
+	double elevation_correction(double p, double elev);
+	/* Not copyable.  Declared but not defined.*/
+	TravelTimeTable(const TravelTimeTable&);
+	TravelTimeTable& operator=(const TravelTimeTable&);
+};
+
+} // End SEISPP namespace declaration
+#endif
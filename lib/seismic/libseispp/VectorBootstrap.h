@@ -0,0 +1,245 @@
+#ifndef _VECTORBOOTSTRAP_H_
+#define _VECTORBOOTSTRAP_H_
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "dmatrix.h"
+#include "SeisppError.h"
+#include "parallel_for.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/* This file contains a generic, multithreaded bootstrap engine for
+estimating the uncertainty of an average direction computed from a
+set of 3D vectors.   It replaces several serial implementations
+that stored every trial and drew random numbers from a single
+global generator.
+
+Random draws here are computed from a counter-based generator:
+draw j of trial i is a pure function of (seed,i,j).   Trials are
+also accumulated in fixed size blocks that are summed in block
+order.   Together this means the results are bit for bit the same
+for any number of threads.  */
+
+/*! Default seed for the bootstrap random number streams. */
+const uint64_t BootstrapDefaultSeed(0x9E3779B97F4A7C15ULL);
+/*! Number of trials accumulated in one block of work. */
+const int BootstrapBlockSize(256);
+
+/*! \brief Counter based random array index.
+
+Returns a random index in the range 0 to range-1 for a given
+position (counter) in the random stream defined by seed.   The value
+depends only on the arguments, which is what makes the bootstrap
+reproducible when trials are computed in parallel.  The bootstrap
+uses counter=trial*range+draw.  The mixing function is the
+splitmix64 finalizer. */
+inline int bootstrap_random_index(uint64_t seed, uint64_t counter, int range)
+{
+  uint64_t z=seed + 0x9E3779B97F4A7C15ULL*(counter+1);
+  z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+  z=(z^(z>>27))*0x94D049BB133111EBULL;
+  z=z^(z>>31);
+  /* Use the upper 53 bits as a uniform number in [0,1) */
+  double u=((double)(z>>11))*(1.0/9007199254740992.0);
+  int i=(int)(u*((double)range));
+  if(i>=range) i=range-1;
+  return i;
+}
+/*! \brief Bootstrap estimate of a mean direction and its angular error.
+
+This object implements the delete and replace bootstrap for
+estimators that produce a direction (3 vector) from a set of data.
+Each trial draws nx row indices with replacement and passes them
+to a user supplied function object that computes an estimate from
+those rows.   The bootstrap mean direction is the normalized sum of
+the trial estimates and the angle error is the confidence level
+quantile of the angles between each trial estimate and that mean.
+
+The angle quantile is measured from the final mean so the engine
+keeps one 3 vector per trial.   Everything else is accumulated on
+the fly in blocks. */
+class UnitVectorBootstrap
+{
+public:
+  /*! Default constructor.  Mean is zero and error is 180 degrees */
+  UnitVectorBootstrap();
+  /*! Primary constructor.
+
+  Construction is initialization.  The bootstrap is computed by
+  the constructor.
+
+  \param nx is the number of data (rows available to resample)
+  \param f is a function object called as f(rows,result) where
+     rows is a const vector<int>& of length nx containing resampled
+     row indices and result is a double[3] to receive the estimate.
+     Each block of trials is run with its own copy of f, so f can
+     hold scratch space but must not modify anything it shares with
+     other copies.
+  \param confidence is the confidence level for the angle error
+     (0<confidence<1).
+  \param number_trials is number of resampling trials.
+  \param nthreads is the number of threads to use.  0 means use
+     one per processor.
+  \param seed sets the random number streams.
+
+  \exception SeisppError is thrown for illegal parameters.  Any
+     exception thrown by f is rethrown by the constructor.
+  */
+  template <class TrialFunction> UnitVectorBootstrap(int nx,
+      const TrialFunction& f, double confidence, int number_trials,
+      int nthreads=0, uint64_t seed=BootstrapDefaultSeed);
+  /*! Return the bootstrap mean unit vector. */
+  vector<double> mean_vector()
+  {
+    return vector<double>(mean,mean+3);
+  };
+  /*! Return the angle error (radians) at confidence_level */
+  double angle_error()
+  {
+    return aci;
+  };
+  double confidence_level()
+  {
+    return cl;
+  };
+  /*! Return number of trials used to compute this estimate. */
+  int number_of_trials()
+  {
+    return ntrials;
+  };
+protected:
+  double mean[3];
+  double aci;
+  double cl;
+  int ntrials;
+};
+
+inline UnitVectorBootstrap::UnitVectorBootstrap()
+{
+  for(int k=0;k<3;++k) mean[k]=0.0;
+  aci=M_PI;
+  cl=0.0;
+  ntrials=0;
+}
+
+template <class TrialFunction> UnitVectorBootstrap::UnitVectorBootstrap(
+    int nx, const TrialFunction& f, double confidence, int number_trials,
+    int nthreads, uint64_t seed)
+{
+  const string base_error("UnitVectorBootstrap constructor:  ");
+  if((confidence>1.0) || (confidence<=0.0))
+    throw SeisppError(base_error
+        + "Illegal confidence interval requested - must be probability level (i.e greater than 0 and less than 1.0)");
+  if(nx<=0)
+    throw SeisppError(base_error + "No data to resample");
+  if(number_trials<=0)
+    throw SeisppError(base_error + "Number of trials must be positive");
+  cl=confidence;
+  ntrials=number_trials;
+  int nblocks=(number_trials+BootstrapBlockSize-1)/BootstrapBlockSize;
+  /* One 3 vector per trial and one partial sum per block */
+  vector<double> trials(3*number_trials);
+  vector<double> blocksums(3*nblocks,0.0);
+  parallel_for(nblocks,nthreads,[&](long b)
+  {
+    TrialFunction fthread(f);
+    vector<int> rows(nx);
+    int i0=b*BootstrapBlockSize;
+    int i1=min(i0+BootstrapBlockSize,number_trials);
+    double *bsum=&(blocksums[3*b]);
+    for(int i=i0;i<i1;++i)
+    {
+      uint64_t counter=((uint64_t)i)*((uint64_t)nx);
+      for(int j=0;j<nx;++j)
+        rows[j]=bootstrap_random_index(seed,counter+j,nx);
+      double *x=&(trials[3*i]);
+      fthread(rows,x);
+      for(int k=0;k<3;++k) bsum[k]+=x[k];
+    }
+  });
+  /* Sum the blocks in order so the result does not depend on
+  which thread computed which block. */
+  double xbar[3]={0.0,0.0,0.0};
+  int b,i,k;
+  for(b=0;b<nblocks;++b)
+    for(k=0;k<3;++k) xbar[k]+=blocksums[3*b+k];
+  double nrm=sqrt(xbar[0]*xbar[0]+xbar[1]*xbar[1]+xbar[2]*xbar[2]);
+  if(nrm<=0.0)
+    throw SeisppError(base_error + "Bootstrap mean vector has zero length");
+  for(k=0;k<3;++k) mean[k]=xbar[k]/nrm;
+  /* Angles between each trial and the mean */
+  vector<double> theta(number_trials);
+  for(i=0;i<number_trials;++i)
+  {
+    double *x=&(trials[3*i]);
+    double xnrm=sqrt(x[0]*x[0]+x[1]*x[1]+x[2]*x[2]);
+    double dp;
+    if(xnrm<=0.0)
+      dp=-1.0;
+    else
+      dp=(x[0]*mean[0]+x[1]*mean[1]+x[2]*mean[2])/xnrm;
+    if(dp>1.0) dp=1.0;
+    if(dp<-1.0) dp=-1.0;
+    theta[i]=acos(dp);
+  }
+  /* This angle error is one sided - we estimate the probability
+     the uncertainty in theta angles is less than the
+     confidence value */
+  int nconf=rint(((double)number_trials)*confidence);
+  if(nconf>=number_trials) nconf=number_trials-1;
+  nth_element(theta.begin(),theta.begin()+nconf,theta.end());
+  aci=theta[nconf];
+}
+/*! \brief Bootstrap error of the average of a set of 3D vectors.
+
+The estimator for each trial is the normalized arithmetic mean of the
+resampled vectors.   This is a drop in for the libmwtpp
+Vector3DBootstrapError object but runs in parallel.  */
+class Vector3DBootstrap : public UnitVectorBootstrap
+{
+public:
+  /*! Construct from a 3 by n matrix of vectors (one per column).
+  Other arguments are as for UnitVectorBootstrap. */
+  Vector3DBootstrap(const dmatrix& x, double confidence, int number_trials,
+      int nthreads=0, uint64_t seed=BootstrapDefaultSeed);
+private:
+  /* Trial function used by the constructor */
+  class MeanTrial
+  {
+  public:
+    MeanTrial(const dmatrix& xin)
+    {
+      if(xin.rows()!=3)
+        throw SeisppError(string("Vector3DBootstrap constructor:  ")
+          + "input matrix must have 3 rows");
+      int ncol=xin.columns();
+      x.reserve(3*ncol);
+      for(int j=0;j<ncol;++j)
+        for(int k=0;k<3;++k)
+          x.push_back(const_cast<dmatrix&>(xin)(k,j));
+    };
+    void operator()(const vector<int>& rows,double *result)
+    {
+      int j,k;
+      for(k=0;k<3;++k) result[k]=0.0;
+      for(j=0;j<rows.size();++j)
+        for(k=0;k<3;++k) result[k]+=x[3*rows[j]+k];
+      double nrm=sqrt(result[0]*result[0]+result[1]*result[1]
+            +result[2]*result[2]);
+      if(nrm>0.0) for(k=0;k<3;++k) result[k]/=nrm;
+    };
+  private:
+    vector<double> x;
+  };
+};
+inline Vector3DBootstrap::Vector3DBootstrap(const dmatrix& x,
+    double confidence, int number_trials, int nthreads, uint64_t seed)
+  : UnitVectorBootstrap(x.columns(),
+      MeanTrial(x),confidence,number_trials,nthreads,seed)
+{
+}
+} // End SEISPP namespace
+#endif
@@ -105,7 +105,34 @@ XcorProcessingEngine::XcorProcessingEngine(Pf * global_pf,
 		case GenericGathers:
 			waveform_db_handle=DatascopeHandle(waveform_db_handle,
 				global_pf,string("dbprocess_commands"));
-			dpq=new DatascopeProcessingQueue(waveform_db_handle,queuefile);
+			/* Queue backend is optional.  Default is the original
+			file locking implementation that works across a cluster.
+			mapped selects the lock free version for many processes
+			on one host. */
+			{
+			string queue_backend("file");
+			int queue_batch_size(1);
+			int queue_stale_timeout(0);
+			try {
+				queue_backend=global_md.get_string("queue_backend");
+			} catch (MetadataGetError& mde) {};
+			try {
+				queue_batch_size=global_md.get_int("queue_batch_size");
+			} catch (MetadataGetError& mde) {};
+			try {
+				queue_stale_timeout=global_md.get_int("queue_stale_timeout");
+			} catch (MetadataGetError& mde) {};
+			if(queue_backend=="mapped")
+				dpq=new MappedProcessingQueue(waveform_db_handle,
+					queuefile,queue_batch_size,queue_stale_timeout);
+			else if(queue_backend=="file")
+				dpq=new DatascopeProcessingQueue(waveform_db_handle,queuefile);
+			else
+				throw SeisppError(base_error
+				 + "Illegal value for queue_backend parameter="
+				 + queue_backend
+				 + "\nMust be either file or mapped");
+			}
 			break;
 		case ContinuousDB:
 			dpq=NULL;
@@ -247,6 +274,16 @@ XcorProcessingEngine::XcorProcessingEngine(Pf * global_pf,
 		mcc = NULL;   // Need this unless we can convert to a shared_ptr;
 		autoscale_initial=global_md.get_bool("AutoscaleInitialPlot");
 		load_arrivals=global_md.get_bool("LoadArrivals");
+		/* Background prefetch parameters are optional.  Prefetching is
+		off unless prefetch_depth is set to a positive value. */
+		max_prefetch=0;
+		number_prefetch_threads=1;
+		try {
+			max_prefetch=global_md.get_int("prefetch_depth");
+			number_prefetch_threads=global_md.get_int("prefetch_threads");
+		} catch (MetadataGetError& mde) {};
+		if(number_prefetch_threads<1) number_prefetch_threads=1;
+		prefetch_shutdown=false;
 		if( (processing_mode==GenericGathers)
 			&& load_arrivals)
 		{
@@ -268,6 +305,17 @@ XcorProcessingEngine::XcorProcessingEngine(Pf * global_pf,
 }
 XcorProcessingEngine::~XcorProcessingEngine()
 {
+	/* Prefetch threads must be stopped before anything they use is released */
+	{
+		std::lock_guard<std::mutex> lock(prefetch_lock);
+		prefetch_shutdown=true;
+		list<shared_ptr<XcorPrefetchedGather> >::iterator pptr;
+		for(pptr=prefetch_cache.begin();pptr!=prefetch_cache.end();++pptr)
+			(*pptr)->cancelled=true;
+		prefetch_cache.clear();
+	}
+	prefetch_cv.notify_all();
+	for(int i=0;i<prefetch_workers.size();++i) prefetch_workers[i].join();
 	dbcrunch(dbassoc);
 	dbcrunch(dbarrival);
 	if(mcc!=NULL) delete mcc;
@@ -987,17 +1035,40 @@ shared_ptr<TimeSeriesEnsemble> Convert3CEnsemble(ThreeComponentEnsemble *tcse,
 }
 /* Common code to load_data methods.  Note both call this private method.*/
 void XcorProcessingEngine::prep_gather()
+{
+	this->prep_regular_gather(*regular_gather,analysis_setting);
+	// Load filtered data into waveform_ensemble copy
+	// of this data.
+	current_subarray=this->select_working_ensemble(*regular_gather,stations,
+		use_subarrays,waveform_ensemble,current_subarray_name);
+        if(SEISPP_verbose) cerr << "XcorProcessingEngine:  filtering ensemble"
+            <<endl;
+	this->filter_working_ensemble(waveform_ensemble,analysis_setting.filter_param);
+
+	// We need to always reset these
+	xcorpeak_cutoff=xcorpeak_cutoff_default;
+	coherence_cutoff=coherence_cutoff_default;
+	stack_weight_cutoff=stack_weight_cutoff_default;
+
+}
+/* Initializes the metadata of a newly loaded regular gather.  This is 
+the first half of what was once all in prep_gather.  It is kept separate
+and works only through its arguments so it can be run by the prefetch
+threads. */
+void XcorProcessingEngine::prep_regular_gather(TimeSeriesEnsemble& g,
+	XcorAnalysisSetting& a)
 {
 	/* Load arrival times if requested */
 	if(load_arrivals)
 	{
                 if(SEISPP_verbose) cerr << "XcorProcessingEngine:  "
                     << "Calling LoadEventArrivals for phase "
-                        <<analysis_setting.phase_for_analysis<<endl
+                        <<a.phase_for_analysis<<endl
                         << "Using predicted time metadata key="
                         << predicted_time_key 
                         <<" and arrival time metadata key ="
                         << dbarrival_time_key<<endl;
+		std::lock_guard<std::mutex> lock(dblock);
 		/* This is a bit of a misuse of this constructor, but it will
 		work in this context in the current implemenation.  Beware a
 		possible maintenance issue */
@@ -1007,9 +1078,9 @@ void XcorProcessingEngine::prep_gather()
 		arrivals.  -1.0 is used to set a null value for data with
 		no arrivals.  Works here as below we can then test for a
 		negative value to indicate a null. */
-		LoadEventArrivals<TimeSeriesEnsemble>(*regular_gather,
+		LoadEventArrivals<TimeSeriesEnsemble>(g,
 			dynamic_cast<DatabaseHandle&>(dbh),
-			 analysis_setting.phase_for_analysis,
+			 a.phase_for_analysis,
 			  predicted_time_key,
 			   dbarrival_time_key,
 			      20.0,
@@ -1021,16 +1092,16 @@ void XcorProcessingEngine::prep_gather()
 	// ensemble.  Without this there can be state issues about
 	// whether these are loaded that cause metadata related
 	// exceptions to be thrown.
-	for(int i=0;i<regular_gather->member.size();++i)
+	for(int i=0;i<g.member.size();++i)
 	{
 		double atime;
 		double lat,lon;
-		regular_gather->member[i].put(trace_number_keyword,i);
-		regular_gather->member[i].put(coherence_keyword,0.0);
-		regular_gather->member[i].put(stack_weight_keyword,0.0);
-		regular_gather->member[i].put(peakxcor_keyword,0.0);
-		regular_gather->member[i].put(amplitude_static_keyword,0.0);
-		regular_gather->member[i].put(moveout_keyword,MoveoutBad);
+		g.member[i].put(trace_number_keyword,i);
+		g.member[i].put(coherence_keyword,0.0);
+		g.member[i].put(stack_weight_keyword,0.0);
+		g.member[i].put(peakxcor_keyword,0.0);
+		g.member[i].put(amplitude_static_keyword,0.0);
+		g.member[i].put(moveout_keyword,MoveoutBad);
 		/* Initialize arrival_time_key to time_align_key value which
 		is the time 0 mark for the data at this stage.  Note this
 		time is dithered throughout this processing, but we maintain
@@ -1042,26 +1113,26 @@ void XcorProcessingEngine::prep_gather()
 		/* This mode is inteded to used if input gathers
 		have a relative time base*/
 		    atime=0.0;
-		    regular_gather->member[i].put(arrival_time_key,atime);
+		    g.member[i].put(arrival_time_key,atime);
 		}
 		else
 		{
-		    atime=regular_gather->member[i].get_double(time_align_key);
-		    regular_gather->member[i].put(arrival_time_key,atime);
+		    atime=g.member[i].get_double(time_align_key);
+		    g.member[i].put(arrival_time_key,atime);
 		}
 	}
 	/* Shift traces by measured arrival times if requested.  */
-	if(load_arrivals) dbarrival_shift(*regular_gather);
+	if(load_arrivals) dbarrival_shift(g);
 	Hypocenter h;
 	if( (processing_mode==EventGathers)
 		|| (processing_mode==ContinuousDB) )
 	{
 		double slat,slon,sz,stime;
 		try{
-		    slat=regular_gather->get_double("source_lat");
-		    slon=regular_gather->get_double("source_lon");
-		    sz=regular_gather->get_double("source_depth");
-		    stime=regular_gather->get_double("source_time");
+		    slat=g.get_double("source_lat");
+		    slon=g.get_double("source_lon");
+		    sz=g.get_double("source_depth");
+		    stime=g.get_double("source_time");
 		    h=Hypocenter(rad(slat),rad(slon),sz,stime,ttmethod,ttmodel);
 		} catch (...)
 		{
@@ -1072,14 +1143,14 @@ void XcorProcessingEngine::prep_gather()
 				<<endl;
 		}
 	}
-	for(int i=0;i<regular_gather->member.size();++i)
+	for(int i=0;i<g.member.size();++i)
 	{
 		double lat,lon;
 		double slat,slon,sz,stime;
 		double seaz,esaz,distance;
 		try {
-			lat=regular_gather->member[i].get_double("sta_lat");
-			lon=regular_gather->member[i].get_double("sta_lon");
+			lat=g.member[i].get_double("sta_lat");
+			lon=g.member[i].get_double("sta_lon");
 			/* these are loaded in degrees.  We must convert
 			them to radians */
 			lat=rad(lat);
@@ -1089,10 +1160,10 @@ void XcorProcessingEngine::prep_gather()
 			source position for the whole ensemble */
 			if(processing_mode==GenericGathers)
 			{
-				slat=regular_gather->member[i].get_double("source_lat");
-				slon=regular_gather->member[i].get_double("source_lon");
-				sz=regular_gather->member[i].get_double("source_depth");
-				stime=regular_gather->member[i].get_double("source_time");
+				slat=g.member[i].get_double("source_lat");
+				slon=g.member[i].get_double("source_lon");
+				sz=g.member[i].get_double("source_depth");
+				stime=g.member[i].get_double("source_time");
 				h=Hypocenter(rad(slat),rad(slon),sz,stime,ttmethod,ttmodel);
 			}
 
@@ -1106,72 +1177,77 @@ void XcorProcessingEngine::prep_gather()
 		seaz=h.seaz(lat,lon);
 		esaz=h.esaz(lat,lon);
 		distance=h.distance(lat,lon);
-		regular_gather->member[i].put("seaz",deg(seaz));
-		regular_gather->member[i].put("esaz",deg(esaz));
-		regular_gather->member[i].put("distance",distance);
-		regular_gather->member[i].put("distance_deg",deg(distance));
+		g.member[i].put("seaz",deg(seaz));
+		g.member[i].put("esaz",deg(esaz));
+		g.member[i].put("distance",distance);
+		g.member[i].put("distance_deg",deg(distance));
 	}
 	// post netname here.  Overridden below for subarrays
 	// but this sets it for full array mode
-	regular_gather->put("netname",netname);
-
-
-	// Load filtered data into waveform_ensemble copy
-	// of this data.
-	if(use_subarrays)
+	g.put("netname",netname);
+}
+/* Extracts the data to be displayed from a regular gather.  When subarrays
+are turned on this is the first subarray with data.  Returns the index of 
+that subarray and sets subname to its name.  */
+int XcorProcessingEngine::select_working_ensemble(TimeSeriesEnsemble& g,
+	SeismicArray& geometry, bool subarrays_on,
+		TimeSeriesEnsemble& result, string& subname)
+{
+	int isub(0);
+	if(subarrays_on)
 	{
-		int nsubs=stations.number_subarrays();
+		int nsubs=geometry.number_subarrays();
 		shared_ptr<TimeSeriesEnsemble> csub;
-		for(current_subarray=0;current_subarray<nsubs;
-				++current_subarray)
+		for(isub=0;isub<nsubs;++isub)
 		{
-			SeismicArray subnet=stations.subset(current_subarray);
-			csub=ArraySubset(*regular_gather,subnet);
+			SeismicArray subnet=geometry.subset(isub);
+			csub=ArraySubset(g,subnet);
 			// post subarray name as netname in ensemble
 			// Convenient if mysterious way to get this
 			// to save procedure
 			csub->put("netname",subnet.name);
 			// Need to set the name too
-			current_subarray_name=subnet.name;
+			subname=subnet.name;
 			if((*csub).member.size()>0) break;
 		}
-		if(current_subarray>=nsubs)
+		if(isub>=nsubs)
 			throw SeisppError(
 				string("XcorProcessingEngine::load_data: ")
 				+ string("  error in subarray definitions.  ")
 				+ string("All subarrays have no data for this event"));
-		waveform_ensemble=*csub;
+		result=*csub;
 	}
 	else
 	{
-		waveform_ensemble=*regular_gather;
+		result=g;
 	}
-        if(SEISPP_verbose) cerr << "XcorProcessingEngine:  filtering ensemble"
-            <<endl;
-	FilterEnsemble(waveform_ensemble,analysis_setting.filter_param);
+	return(isub);
+}
+/* Applies the initial filter and amplitude scaling to a working ensemble.
+This was once duplicated in several methods.  Note the database lock is 
+held because the Antelope filter routines are not known to be reentrant.*/
+void XcorProcessingEngine::filter_working_ensemble(TimeSeriesEnsemble& d,
+	TimeInvariantFilter& f)
+{
+	std::lock_guard<std::mutex> lock(dblock);
+	FilterEnsemble(d,f);
 	if(autoscale_initial)
 	{
                 if(SEISPP_verbose) cerr << "XcorProcessingEngine:  "
                     <<"Autoscaling data to have constant peak amplitude"<<endl;
 		MeasureEnsemblePeakAmplitudes<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword);
+			(d,gain_keyword);
 		ScaleEnsemble<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword,true);
+			(d,gain_keyword,true);
 		ScaleCalib<TimeSeriesEnsemble>
-			(waveform_ensemble,gain_keyword,amplitude_static_keyword);
+			(d,gain_keyword,amplitude_static_keyword);
 	}
 	else
 	{
 		double initial_gain=1.0;
 		InitializeEnsembleAttribute<TimeSeriesEnsemble,double>
-			(waveform_ensemble,gain_keyword,initial_gain);
+			(d,gain_keyword,initial_gain);
 	}
-
-	// We need to always reset these
-	xcorpeak_cutoff=xcorpeak_cutoff_default;
-	coherence_cutoff=coherence_cutoff_default;
-	stack_weight_cutoff=stack_weight_cutoff_default;
-
 }
 /* New method added to support segmented data in any type of
 generic gather. */
@@ -1183,7 +1259,7 @@ int  XcorProcessingEngine::load_data(DatabaseHandle& dbh,ProcessingStatus stat)
 	  + string("Coding error.  This method not allowed for time window (ContinuousDB) processing"));
     if(dpq==NULL)
 	throw SeisppError(base_error
-		+ string("Coding error.  Handle to the DatascopeProcessingQueue object is not defined"));
+		+ string("Coding error.  Handle to the ProcessingQueue object is not defined"));
     if(mcc!=NULL)
     {
 	delete mcc;
@@ -1299,8 +1375,6 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
 	throw SeisppError(base_message
 		+ string("Coding error.  Wrong method called."));
     try {
-        if(SEISPP_verbose) cerr << base_message
-            <<"Starting to read data"<<endl;
 	// It is necessary to clear the contents of mcc in
 	// some situations.  In particular, in the gui dbxcor
 	// we desire sorting the data after it is read.  The
@@ -1317,19 +1391,74 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
            range because it does not allow for travel times.  */
 	current_data_window=TimeWindow(h.time+raw_data_twin.start,
 		h.time+raw_data_twin.end);
+	/* Use data loaded by the prefetch threads when it exists and was
+	built with the current analysis setting */
+	shared_ptr<XcorPrefetchedGather> pg=this->claim_prefetched(h);
+	if((pg!=NULL) && pg->usable(analysis_setting))
+	{
+            if(SEISPP_verbose) cerr << base_message
+                <<"Using gather loaded by prefetch thread"<<endl;
+	    {
+		/* prefetch workers read stations under this lock */
+		std::lock_guard<std::mutex> lock(dblock);
+		stations=pg->stations;
+	    }
+	    regular_gather=pg->regular_gather;
+	    if( (pg->use_subarrays==use_subarrays)
+		&& (pg->asetting.filter_param.type_description()
+			== analysis_setting.filter_param.type_description()) )
+	    {
+		waveform_ensemble=pg->waveform_ensemble;
+		current_subarray=pg->subarray;
+		current_subarray_name=pg->subarray_name;
+	    }
+	    else
+	    {
+		current_subarray=this->select_working_ensemble(*regular_gather,
+			stations,use_subarrays,waveform_ensemble,
+			current_subarray_name);
+		this->filter_working_ensemble(waveform_ensemble,
+			analysis_setting.filter_param);
+	    }
+	    xcorpeak_cutoff=xcorpeak_cutoff_default;
+	    coherence_cutoff=coherence_cutoff_default;
+	    stack_weight_cutoff=stack_weight_cutoff_default;
+	    return;
+	}
+        if(SEISPP_verbose) cerr << base_message
+            <<"Starting to read data"<<endl;
 	UpdateGeometry(current_data_window);
-	// Read raw data.  Using an shared_ptr as good practice
-	// 3c mode can work for either cardinal directions or
-	// applying transformations.  In either case we use
-	// the temporary shared_ptr to hold the data read in
-	shared_ptr<TimeSeriesEnsemble> tse;
+	regular_gather=this->read_event_gather(h,analysis_setting,stations);
+        if(SEISPP_verbose) cerr << base_message
+            <<"Doing Housecleaning work"<<endl;
+	this->prep_gather();
+    }
+    catch (...) {throw;}
+}
+/* Reads data for one event and builds the regular gather (aligned by
+predicted arrival time and resampled to target_dt).  All database and
+travel time calculator access is done while holding the database lock.  
+The resampling is not so it can run concurrently with work in other 
+threads. */
+shared_ptr<TimeSeriesEnsemble> XcorProcessingEngine::read_event_gather(Hypocenter& h,
+	XcorAnalysisSetting& a, SeismicArray& geometry)
+{
+    const string base_message("XcorProcessingEngine::load_data:  ");
+    // Read raw data.  Using an shared_ptr as good practice
+    // 3c mode can work for either cardinal directions or
+    // applying transformations.  In either case we use
+    // the temporary shared_ptr to hold the data read in
+    shared_ptr<TimeSeriesEnsemble> tse;
+    StationTime predarr;
+    {
+	std::lock_guard<std::mutex> lock(dblock);
 	if(RequireThreeComponents)
 	{
                 if(SEISPP_verbose) cerr << base_message
                     <<"Using RequireThreeComponents read method"
                         <<endl;
 		string chan_allowed("ZNELRT");
-		if(analysis_setting.component_name
+		if(a.component_name
 			.find_first_of(chan_allowed,0)==std::string::npos)
 		{
 			throw SeisppError(base_message
@@ -1347,11 +1476,11 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
 		else
 		{
 		    tcse = array_get_data(
-  			   stations,
+  			   geometry,
                            h,
-			   analysis_setting.phase_for_analysis,
+			   a.phase_for_analysis,
                            raw_data_twin,
-                           analysis_setting.tpad,
+                           a.tpad,
                            dynamic_cast<DatabaseHandle&>(waveform_db_handle),
 			   stachanmap,
                            ensemble_mdl,
@@ -1363,8 +1492,8 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
 		// done in one pass here for efficiency.  Local function
 		// to this file found above
 		tse=shared_ptr<TimeSeriesEnsemble>(Convert3CEnsemble(tcse,
-			analysis_setting.component_name,h,
-			analysis_setting.phase_for_analysis,
+			a.component_name,h,
+			a.phase_for_analysis,
 			ttmethod,ttmodel));
 		delete tcse;
 	}
@@ -1374,12 +1503,12 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
                     <<"Using scalar data read method"
                         <<endl;
 		tse=shared_ptr<TimeSeriesEnsemble>(array_get_data(
-  			   stations,
+  			   geometry,
                            h,
-			   analysis_setting.phase_for_analysis,
-			   analysis_setting.chan_expression,
+			   a.phase_for_analysis,
+			   a.chan_expression,
                            raw_data_twin,
-                           analysis_setting.tpad,
+                           a.tpad,
                            dynamic_cast<DatabaseHandle&>(waveform_db_handle),
                            ensemble_mdl,
                            trace_mdl,
@@ -1387,33 +1516,24 @@ void XcorProcessingEngine::load_data(Hypocenter & h)
 	}
         if(SEISPP_verbose) cerr << base_message
             <<"Data loaded.  Forming working gather"<<endl;
-	StationTime predarr=ArrayPredictedArrivals(stations,h,
-		analysis_setting.phase_for_analysis);
-
-	// Following not needed because regular_gather is now
-	// stored as an shared_ptr.
-	//if (regular_gather != NULL) { delete regular_gather; regular_gather=NULL;}
-	regular_gather=shared_ptr<TimeSeriesEnsemble>
-			(AssembleRegularGather(*tse,predarr,
-			analysis_setting.phase_for_analysis,
-            		analysis_setting.gather_twin,target_dt,rdef,true));
-	/* To use the common prep_gather method we need to post these
-	to the ensemble metadata area.  Note the conversion to degrees*/
-	regular_gather->put("source_lat",deg(h.lat));
-	regular_gather->put("source_lon",deg(h.lon));
-	regular_gather->put("source_depth",deg(h.z));
-	regular_gather->put("source_time",deg(h.time));
-        if(SEISPP_verbose) cerr << base_message
-            <<"Doing Housecleaning work"<<endl;
-	this->prep_gather();
+	predarr=ArrayPredictedArrivals(geometry,h,a.phase_for_analysis);
     }
-    catch (...) {throw;}
+    shared_ptr<TimeSeriesEnsemble> result(AssembleRegularGather(*tse,predarr,
+		a.phase_for_analysis,a.gather_twin,target_dt,rdef,true));
+    /* To use the common prep_gather method we need to post these
+    to the ensemble metadata area.  Note the conversion to degrees*/
+    result->put("source_lat",deg(h.lat));
+    result->put("source_lon",deg(h.lon));
+    result->put("source_depth",deg(h.z));
+    result->put("source_time",deg(h.time));
+    return result;
 }
 // This applies a second filter to the data beyond the base filter.
 // This is often necessary. e.g. demean followed by integration.
 //
 void XcorProcessingEngine::filter_data(TimeInvariantFilter f)
 {
+	std::lock_guard<std::mutex> lock(dblock);
 	FilterEnsemble(waveform_ensemble,f);
 }
 /* helper for save_results.  Counts and sets nass in origin.
@@ -1487,6 +1607,7 @@ string set_chan_this_phase(string chan, XcorAnalysisSetting& a)
 }
 void XcorProcessingEngine::save_results(long evid, long orid ,Hypocenter& h)
 {
+	std::lock_guard<std::mutex> lock(dblock);
 	// First save the beam
 	long pwfid;
 	string pchan(analysis_setting.component_name);
@@ -1798,6 +1919,7 @@ void XcorProcessingEngine::save_results(long evid, long orid ,Hypocenter& h)
 // These are private functions hidden by the interface
 void XcorProcessingEngine::UpdateGeometry(TimeWindow twin)
 {
+	std::lock_guard<std::mutex> lock(dblock);
 	if(stations.GeometryIsValid(twin))
 	{
 		return;
@@ -1859,19 +1981,7 @@ void XcorProcessingEngine::restore_original_ensemble()
 	{
 		waveform_ensemble=*regular_gather;
 	}
-	FilterEnsemble(waveform_ensemble,analysis_setting.filter_param);
-	if(autoscale_initial)
-	{
-		MeasureEnsemblePeakAmplitudes<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword);
-		ScaleEnsemble<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword,true);
-		ScaleCalib<TimeSeriesEnsemble>
-			(waveform_ensemble,gain_keyword,amplitude_static_keyword);
-	}
-	else
-		InitializeEnsembleAttribute<TimeSeriesEnsemble,double>
-			(waveform_ensemble,gain_keyword,(double)1.0);
+	this->filter_working_ensemble(waveform_ensemble,analysis_setting.filter_param);
 }
 void XcorProcessingEngine::next_subarray()
 {
@@ -1884,19 +1994,8 @@ void XcorProcessingEngine::next_subarray()
 		current_subarray_name=ss.name;
 		shared_ptr<TimeSeriesEnsemble> csub(ArraySubset(*regular_gather,ss));
 		waveform_ensemble=*csub;
-		FilterEnsemble(waveform_ensemble,analysis_setting.filter_param);
-		if(autoscale_initial)
-		{
-		    MeasureEnsemblePeakAmplitudes<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword);
-		    ScaleEnsemble<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword,true);
-		    ScaleCalib<TimeSeriesEnsemble>
-			(waveform_ensemble,gain_keyword,amplitude_static_keyword);
-		}
-		else
-			InitializeEnsembleAttribute<TimeSeriesEnsemble,double>
-				(waveform_ensemble,gain_keyword,(double)1.0);
+		this->filter_working_ensemble(waveform_ensemble,
+			analysis_setting.filter_param);
 
 	    } catch (...) {throw;}
 	}
@@ -1957,26 +2056,192 @@ int XcorProcessingEngine::clear_already_processed()
 	/* overwrite regular_ensemble with waveform_ensemble.  It will be the new master */
 	regular_gather=shared_ptr<TimeSeriesEnsemble>(new TimeSeriesEnsemble(waveform_ensemble));
 	/* The working copy (waveform_ensemble) now must be preprocessed
-	with initial filter and initialize the amplitude factors.  Note
-	this is a complete duplicate of code in prep_gather.  Watch out
-	as a possible maintenance issue.  Did this to avoid a private
-	method or a procedure with a long list of arguments*/
-	FilterEnsemble(waveform_ensemble,analysis_setting.filter_param);
-	if(autoscale_initial)
+	with initial filter and initialize the amplitude factors. */
+	this->filter_working_ensemble(waveform_ensemble,analysis_setting.filter_param);
+	return(regular_gather->member.size());
+}
+/* Prefetch stage.   Requests are kept in a list in the order they were 
+queued.  Worker threads take the first request in the queued state, load it, 
+and mark it ready.  load_data claims a request by hypocenter.   */
+XcorPrefetchedGather::XcorPrefetchedGather(Hypocenter& hypo,
+	XcorAnalysisSetting& a, bool subarrays_on)
+		: h(hypo), asetting(a)
+{
+	use_subarrays=subarrays_on;
+	state=PrefetchQueued;
+	cancelled=false;
+	subarray=0;
+}
+bool XcorPrefetchedGather::is_event(Hypocenter& hypo)
+{
+	/* Hypocenters come from the same database rows so these
+	tests are really for equality.  The tolerance avoids trouble
+	with any roundoff in radian conversions. */
+	const double angle_tolerance(1.0e-9),time_tolerance(1.0e-4);
+	if(fabs(hypo.time-h.time)>time_tolerance) return false;
+	if(fabs(hypo.lat-h.lat)>angle_tolerance) return false;
+	if(fabs(hypo.lon-h.lon)>angle_tolerance) return false;
+	if(fabs(hypo.z-h.z)>time_tolerance) return false;
+	return true;
+}
+bool XcorPrefetchedGather::usable(XcorAnalysisSetting& a)
+{
+	if(state!=PrefetchReady) return false;
+	if(a.phase_for_analysis!=asetting.phase_for_analysis) return false;
+	if(a.component_name!=asetting.component_name) return false;
+	if(a.chan_expression!=asetting.chan_expression) return false;
+	if(a.tpad!=asetting.tpad) return false;
+	if( (a.gather_twin.start!=asetting.gather_twin.start)
+		|| (a.gather_twin.end!=asetting.gather_twin.end) ) return false;
+	return true;
+}
+bool XcorProcessingEngine::prefetch(Hypocenter& h)
+{
+	if( (max_prefetch<=0) || (processing_mode!=ContinuousDB) ) return false;
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	if(prefetch_cache.size()>=max_prefetch) return false;
+	/* Ignore duplicate requests */
+	list<shared_ptr<XcorPrefetchedGather> >::iterator pptr;
+	for(pptr=prefetch_cache.begin();pptr!=prefetch_cache.end();++pptr)
+		if((*pptr)->is_event(h)) return true;
+	/* Threads are launched on first use so programs that never prefetch
+	never create them */
+	if(prefetch_workers.size()==0)
 	{
-		MeasureEnsemblePeakAmplitudes<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword);
-		ScaleEnsemble<TimeSeriesEnsemble,TimeSeries>
-			(waveform_ensemble,gain_keyword,true);
-		ScaleCalib<TimeSeriesEnsemble>
-			(waveform_ensemble,gain_keyword,amplitude_static_keyword);
+		for(int i=0;i<number_prefetch_threads;++i)
+			prefetch_workers.push_back(std::thread(
+				&XcorProcessingEngine::prefetch_worker,this));
 	}
-	else
+	shared_ptr<XcorPrefetchedGather> pg(new XcorPrefetchedGather(h,
+		analysis_setting,use_subarrays));
+	prefetch_cache.push_back(pg);
+	prefetch_cv.notify_all();
+	return true;
+}
+void XcorProcessingEngine::cancel_prefetch()
+{
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	list<shared_ptr<XcorPrefetchedGather> >::iterator pptr;
+	for(pptr=prefetch_cache.begin();pptr!=prefetch_cache.end();++pptr)
+		(*pptr)->cancelled=true;
+	prefetch_cache.clear();
+}
+int XcorProcessingEngine::number_prefetched()
+{
+	std::lock_guard<std::mutex> lock(prefetch_lock);
+	return(prefetch_cache.size());
+}
+/* Removes the request for hypocenter h from the cache and returns it
+when it is ready.  Requests queued ahead of h are assumed to have been
+skipped by the analyst and are discarded.   If h was never requested 
+the analyst has jumped and everything is discarded.  Returns an empty
+pointer if there is nothing usable. */
+shared_ptr<XcorPrefetchedGather> XcorProcessingEngine::claim_prefetched(Hypocenter& h)
+{
+	shared_ptr<XcorPrefetchedGather> result;
+	std::unique_lock<std::mutex> lock(prefetch_lock);
+	list<shared_ptr<XcorPrefetchedGather> >::iterator pptr;
+	for(pptr=prefetch_cache.begin();pptr!=prefetch_cache.end();++pptr)
+		if((*pptr)->is_event(h)) break;
+	list<shared_ptr<XcorPrefetchedGather> >::iterator pend(pptr);
+	if(pend!=prefetch_cache.end()) ++pend;
+	list<shared_ptr<XcorPrefetchedGather> >::iterator pdel;
+	for(pdel=prefetch_cache.begin();pdel!=pend;++pdel)
+		(*pdel)->cancelled=true;
+	if(pptr!=prefetch_cache.end())
 	{
-		double initial_gain=1.0;
-		InitializeEnsembleAttribute<TimeSeriesEnsemble,double>
-			(waveform_ensemble,gain_keyword,initial_gain);
+		result=(*pptr);
+		/* Still waiting to be started.  Faster to just load it in 
+		this thread. */
+		if(result->state==PrefetchQueued) result.reset();
 	}
-	return(regular_gather->member.size());
+	prefetch_cache.erase(prefetch_cache.begin(),pend);
+	if(result==NULL) return result;
+	prefetch_cv.wait(lock,[&result]{
+		return((result->state==PrefetchReady) 
+			|| (result->state==PrefetchFailed));});
+	if(result->state==PrefetchFailed)
+	{
+		cerr << "XcorProcessingEngine::load_data (Warning):  "
+			<< "prefetch of this event failed with this message:"<<endl
+			<< result->error_message<<endl
+			<< "Trying again"<<endl;
+		result.reset();
+	}
+	return result;
+}
+void XcorProcessingEngine::prefetch_worker()
+{
+	std::unique_lock<std::mutex> lock(prefetch_lock);
+	while(true)
+	{
+		list<shared_ptr<XcorPrefetchedGather> >::iterator pptr;
+		shared_ptr<XcorPrefetchedGather> pg;
+		for(pptr=prefetch_cache.begin();pptr!=prefetch_cache.end();++pptr)
+		{
+			if((*pptr)->state==PrefetchQueued)
+			{
+				pg=(*pptr);
+				break;
+			}
+		}
+		if(prefetch_shutdown) return;
+		if(pg==NULL)
+		{
+			prefetch_cv.wait(lock);
+			continue;
+		}
+		pg->state=PrefetchLoading;
+		lock.unlock();
+		PrefetchState final_state(PrefetchReady);
+		try {
+			this->load_prefetched_gather(*pg);
+		} catch (SeisppError& serr) {
+			pg->error_message=serr.message;
+			final_state=PrefetchFailed;
+		} catch (std::exception& stexc) {
+			pg->error_message=stexc.what();
+			final_state=PrefetchFailed;
+		} catch (...) {
+			pg->error_message="Unknown exception";
+			final_state=PrefetchFailed;
+		}
+		lock.lock();
+		pg->state=final_state;
+		prefetch_cv.notify_all();
+	}
+}
+/* Does the same work as load_data, but on data held in a
+XcorPrefetchedGather object instead of the engine.  The cancelled
+flag is tested between each step to avoid wasted work when the
+analyst jumps to an event that was not requested. */
+void XcorProcessingEngine::load_prefetched_gather(XcorPrefetchedGather& pg)
+{
+	TimeWindow twin(pg.h.time+raw_data_twin.start,
+		pg.h.time+raw_data_twin.end);
+	{
+		std::lock_guard<std::mutex> lock(dblock);
+		if(stations.GeometryIsValid(twin))
+			pg.stations=stations;
+		else
+		{
+			pg.stations=SeismicArray(
+			  dynamic_cast<DatabaseHandle&>(waveform_db_handle),
+				twin.start,netname);
+			load_subarrays_from_pf(pg.stations,pf_used_by_engine);
+		}
+	}
+	if(pg.stations.array.size()<=0)
+		throw SeisppError(string("XcorProcessingEngine prefetch -- network name=")
+			+ netname
+			+ string(" has no active stations at event time.") );
+	if(pg.cancelled) return;
+	pg.regular_gather=this->read_event_gather(pg.h,pg.asetting,pg.stations);
+	if(pg.cancelled) return;
+	this->prep_regular_gather(*(pg.regular_gather),pg.asetting);
+	if(pg.cancelled) return;
+	pg.subarray=this->select_working_ensemble(*(pg.regular_gather),
+		pg.stations,pg.use_subarrays,pg.waveform_ensemble,pg.subarray_name);
+	this->filter_working_ensemble(pg.waveform_ensemble,pg.asetting.filter_param);
 }
 #endif
@@ -9,6 +9,11 @@
 
 #include <sstream>
 #include <vector>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 #include "stock.h"
 #include "pf.h"
@@ -36,6 +41,45 @@ See documentation for the XcorProcessingEngine for a desciption of what thee mod
 */
 enum XcorEngineMode {ContinuousDB, EventGathers, GenericGathers};
 
+/*! Defines the state of a gather loaded by the prefetch threads of an XcorProcessingEngine. */
+enum PrefetchState {PrefetchQueued, PrefetchLoading, PrefetchReady, PrefetchFailed};
+
+/*! \brief Event gather loaded in the background by an XcorProcessingEngine.
+
+The prefetch stage of XcorProcessingEngine reads, aligns, resamples, and filters 
+gathers for events the caller expects to process next while an analyst is 
+working on the current event.   This object holds the result along with 
+a copy of the settings used to build it.   The settings are needed because the
+analyst can change the phase, component, or filter between the time a 
+gather was requested and when it is used.  The engine treats the result as
+stale in that situation and reloads the data.   This object is an implementation
+detail of the engine and is not intended to be used directly.
+*/
+class XcorPrefetchedGather
+{
+public:
+	Hypocenter h;
+	/* Copies of engine settings when the request was queued */
+	XcorAnalysisSetting asetting;
+	bool use_subarrays;
+	PrefetchState state;
+	/* Set by the engine when the request is no longer wanted.  The loader 
+	tests this between processing steps and abandons the work if set. */
+	std::atomic<bool> cancelled;
+	string error_message;
+	/* Products.  Only valid when state is PrefetchReady */
+	shared_ptr<TimeSeriesEnsemble> regular_gather;
+	SeismicArray stations;
+	TimeSeriesEnsemble waveform_ensemble;
+	int subarray;
+	string subarray_name;
+	XcorPrefetchedGather(Hypocenter& hypo, XcorAnalysisSetting& a, bool subarrays_on);
+	/*! Returns true if this gather is for hypocenter hypo. */
+	bool is_event(Hypocenter& hypo);
+	/*! Returns true if the regular gather was built with settings compatible with a. */
+	bool usable(XcorAnalysisSetting& a);
+};
+
 /* \brief Processing object for multichannel correlator.
 
 This is a processing object that can be used to process a series of gathers
@@ -170,6 +214,39 @@ public:
 		generic anticipating alternatives may exist in the future.
 	*/
 	DatabaseHandle *get_db(string dbmember);
+	/*! \brief Queue an event for background loading.
+
+	In ContinuousDB mode the time an analyst waits for data to be read,
+	aligned, resampled, and filtered can be hidden by loading the next few
+	events on background threads while the analyst works on the current one.
+	This method queues a request to do that for hypocenter h using the current
+	analysis setting.  A later call to load_data with the same hypocenter
+	will use the result if the analysis setting has not changed in the interim.
+	A call to load_data for an event that was not queued is treated as a jump
+	and discards all pending results.  The number of outstanding requests is
+	limited by the prefetch_depth parameter.  Prefetching is disabled when 
+	that parameter is 0 or absent.
+
+	\param h hypocenter of event to load
+	\return true if the request was queued.  false if prefetching is disabled,
+		the processing mode does not support it, or the cache is full.
+	*/
+	bool prefetch(Hypocenter& h);
+	/*! Discard all queued and completed prefetch requests. */
+	void cancel_prefetch();
+	/*! Return the number of prefetch requests queued, loading, or ready. */
+	int number_prefetched();
+	/*! Return the maximum number of events that can be prefetched. */
+	int prefetch_depth(){return max_prefetch;};
+	/*! \brief Return the lock used to serialize database access.
+
+	Datascope and the travel time libraries are not safe for concurrent use.
+	When prefetching is active all access to the databases used by this engine
+	must hold this lock.  The engine does this itself.  A caller that 
+	accesses the same databases directly while prefetch requests are 
+	outstanding must do the same.
+	*/
+	std::mutex& database_lock(){return dblock;};
 private:
 	DatascopeHandle waveform_db_handle;
 	DatascopeHandle result_db_handle;
@@ -256,11 +333,35 @@ private:
 	// it a variable.  These are method and model for a travel time calculator
 	string ttmethod,ttmodel;
 	/* Added to support new queue driven processng Feb 2008 */
-	DatascopeProcessingQueue *dpq;
+	ProcessingQueue *dpq;
 	/* Code used to be in load_data, but since load_data is overloaded this
 	method contains common code shared by load_data methods.  It needs to be
 	a member to allow access to all the class data. */
 	void prep_gather();
+	/* prep_gather is split into these pieces so the prefetch threads can 
+	run them on data not yet loaded into the engine.  read_event_gather
+	reads and builds the regular gather for an event, prep_regular_gather 
+	initializes its metadata, select_working_ensemble extracts the data 
+	to be displayed, and filter_working_ensemble applies the initial filter
+	and amplitude scaling. */
+	shared_ptr<TimeSeriesEnsemble> read_event_gather(Hypocenter& h,
+		XcorAnalysisSetting& a,SeismicArray& geometry);
+	void prep_regular_gather(TimeSeriesEnsemble& g, XcorAnalysisSetting& a);
+	int select_working_ensemble(TimeSeriesEnsemble& g, SeismicArray& geometry,
+		bool subarrays_on, TimeSeriesEnsemble& result, string& subname);
+	void filter_working_ensemble(TimeSeriesEnsemble& d, TimeInvariantFilter& f);
+	/* Background prefetch stage */
+	int max_prefetch;
+	int number_prefetch_threads;
+	bool prefetch_shutdown;
+	std::mutex dblock;
+	std::mutex prefetch_lock;
+	std::condition_variable prefetch_cv;
+	list<shared_ptr<XcorPrefetchedGather> > prefetch_cache;
+	vector<std::thread> prefetch_workers;
+	void prefetch_worker();
+	void load_prefetched_gather(XcorPrefetchedGather& pg);
+	shared_ptr<XcorPrefetchedGather> claim_prefetched(Hypocenter& h);
 };
 /*! /brief Function object to sort a set of objects defined by a Metadata double in
 increasing order.
@@ -48,6 +48,33 @@ StationTime ArrayPredictedArrivals(SeismicArray& stations,
 	}
 	return(result);
 }
+// Same as above using an interpolated travel time table.  The
+// map insertions here cost about as much as the table lookups.
+StationTime ArrayPredictedArrivals(SeismicArray& stations,
+		Hypocenter& hypo, TravelTimeTable& table)
+{
+	StationTime result;
+	map<string, SeismicStationLocation>::iterator sta;
+	for(sta=stations.array.begin();sta!=stations.array.end();++sta)
+	{
+		double atime;
+		SeismicStationLocation& loc=(*sta).second;
+		try {
+			atime=table.phasetime(hypo,loc.lat,loc.lon,loc.elev);
+			atime+=hypo.time;
+			result.insert(result.end(),
+				StationTime::value_type((*sta).first,atime));
+		}
+		catch (SeisppError& serr)
+		{
+			cerr << "ArrayPredictedError(Warning):  travel time "
+				<< "table failed computing travel time for "
+				<< table.phase_name() << " for station "
+				<<(*sta).first<<endl;
+		}
+	}
+	return(result);
+}
 /* Scan the map of arrival times returning a TimeWindow defining
 range (max and min) of times contained in the map.  It might
 be possible to replace the algorithm here with calls to 
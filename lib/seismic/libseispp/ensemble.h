@@ -14,6 +14,8 @@
 
 #include <memory>
 #include <vector>
+#include <map>
+#include <sstream>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/archive/text_oarchive.hpp>
@@ -31,7 +33,9 @@
 #include "StationChannelMap.h"
 #endif
 #include "Hypocenter.h"
+#include "TravelTimeTable.h"
 #include "SeisppKeywords.h"
+#include "parallel_for.h"
 #ifdef NO_ANTELOPE
 using namespace PWMIG;
 #endif
@@ -664,6 +668,125 @@ template <class Tensemble> void LoadEventArrivals(Tensemble& d,
 	we don't do this.  If changed this next line must be removed */
 	//dbfree(dbhss.db);
 }
+/*! \brief Load arrival times for several phases in one pass.
+
+This is the same algorithm as the single phase version above applied 
+to a list of phases.  Station names and predicted times are read from 
+each member once and the station to member index is built once for 
+all phases instead of once per phase.  Each entry of the three vectors
+defines one phase as in the single phase version.  
+
+\param d data ensemble to which this procedure is to be applied.
+\param dbi generic database handle (cast to a DatascopeHandle).
+\param phases list of phases to load.
+\param predarrkeywords predicted arrival time keyword for each phase.
+\param atkeywords keyword used to store the arrival time for each phase.
+\param tpad time padding around around time window computed from 
+	predicted arrival times.
+\param nullvalue value loaded as the arrival time when there is no entry 
+	in the database for a data member.
+
+\exception SeisppError is thrown if the vector sizes do not match,
+	if no predicted times are defined for a phase, or if the database
+	reads fail.
+*/
+template <class Tensemble> void LoadEventArrivals(Tensemble& d, 
+		DatabaseHandle& dbi,
+			vector<string>& phases,
+				vector<string>& predarrkeywords,
+					vector<string>& atkeywords,
+						double tpad,
+							double nullvalue)
+{
+	const string base_error("LoadEventArrivals (multiple phase version):  ");
+	int nphases=phases.size();
+	if( (predarrkeywords.size()!=nphases) || (atkeywords.size()!=nphases) )
+		throw SeisppError(base_error
+			+ string("phase and keyword lists have different sizes"));
+	DatascopeHandle dbh=dynamic_cast<DatascopeHandle&> (dbi);
+	int nmembers=d.member.size();
+	int i,j;
+	/* Cache the station name of each member and the list of members
+	for each station.  Used for every phase */
+	vector<string> stations;
+	map<string,vector<int> > staindex;
+	map<string,vector<int> >::iterator sptr;
+	stations.reserve(nmembers);
+	for(i=0;i<nmembers;++i)
+	{
+		try {
+			stations.push_back(d.member[i].get_string("sta"));
+		} catch (MetadataGetError& mderr)
+		{
+			stations.push_back(string(""));
+			continue;
+		}
+		staindex[stations[i]].push_back(i);
+	}
+	for(j=0;j<nphases;++j)
+	{
+		TimeWindow atrange(-2.0,-1.0);
+		double testval;
+		bool firstpass(true);
+		for(i=0;i<nmembers;++i)
+		{
+			d.member[i].put(atkeywords[j],nullvalue);
+			if(d.member[i].is_attribute_set(predarrkeywords[j]))
+			{
+				testval=d.member[i].get_double(predarrkeywords[j]);
+				if(firstpass)
+				{
+					atrange.start=testval;
+					atrange.end=testval;
+					firstpass=false;
+				}
+				else
+				{
+					if(atrange.start>testval)
+						atrange.start=testval;
+					if(atrange.end<testval)
+						atrange.end=testval;
+				}
+			}
+		}
+		if(atrange.start<0.0)
+			throw SeisppError(base_error
+				+ string("no predicted arrivals are defined for phase ")
+				+ phases[j]
+				+ string(" in ensemble passed to this procedure\n")
+				+ string("Coding error or problem in the way metadata were loaded.") );
+		atrange.start -= tpad;
+		atrange.end += tpad;
+		char ssexpression[256];
+		sprintf(ssexpression,"(time >= %lf && time<=%lf && iphase=~/%s/)",
+			atrange.start,atrange.end,phases[j].c_str());
+		DatascopeHandle dbhss(dbh);
+		dbhss.subset(string(ssexpression));
+		try {
+			string sta;
+			double t;
+			dbhss.rewind();
+			for(i=0;i<dbhss.number_tuples();++i,++dbhss)
+			{
+				sta=dbhss.get_string("sta");
+				sptr=staindex.find(sta);
+				if(sptr==staindex.end()) continue;
+				t=dbhss.get_double("arrival.time");
+				/* As in the single phase version the last row
+				for a station wins */
+				vector<int>::iterator mptr;
+				for(mptr=sptr->second.begin();
+					mptr!=sptr->second.end();++mptr)
+					d.member[*mptr].put(atkeywords[j],t);
+			}
+		}
+		catch (...) 
+		{
+			throw SeisppError(base_error
+			+ string("Problems arrivals.  Not all arrivals were loaded") );
+		}
+	}
+}
 #endif
 /*! \brief Load predicted times for a general ensemble.
 
@@ -774,6 +897,287 @@ template <class Tensemble> int LoadPredictedArrivalTimes(Tensemble& d,
 	return(nfailures);
 }
 
+/*! \brief Post predicted arrival times to an ensemble using a travel time table.
+
+This is the same algorithm as the version above but travel times are
+interpolated from a TravelTimeTable instead of being computed by the
+ttcalc interface for every member.  Use this form for large data sets.
+The phase, method, and model are those of the table.  The same seven
+attributes are required and failures are handled the same way.
+
+\param d ensemble object to be processed
+\param table travel time table for the phase of interest
+\param predarr_keyword is the key used to store the predicted time in
+	the Metadata area for each ensemble member.
+\param verbose if true every error will cause an error messae
+	to be be written to stderr.
+
+\return Normal return is 0.  Nonzero values indicate number of
+	failures in computing times.
+*/
+template <class Tensemble> int LoadPredictedArrivalTimes(Tensemble& d,
+	TravelTimeTable& table,
+		string predarr_keyword=predicted_time_key,
+			bool verbose=false)
+{
+	int i,nmembers;
+	double slat,slon,sz,stime;
+	double rlat,rlon,relev;
+	double phasetime;
+	int nfailures(0);
+
+	nmembers=d.member.size();
+	for(i=0;i<nmembers;++i)
+	{
+		if(d.member[i].live)
+		{
+			try{
+				slat=d.member[i].get_double("source_lat");
+				slon=d.member[i].get_double("source_lon");
+				sz=d.member[i].get_double("source_depth");
+				stime=d.member[i].get_double("source_time");
+				rlat=d.member[i].get_double("sta_lat");
+				rlon=d.member[i].get_double("sta_lon");
+				relev=d.member[i].get_double("sta_elev");
+				Hypocenter h(rad(slat),rad(slon),sz,stime,
+					string("tttaup"),string("iasp91"));
+				phasetime=table.phasetime(h,rad(rlat),
+					rad(rlon),relev);
+				phasetime+=stime;
+			}
+			catch (MetadataGetError mderr)
+			{
+				phasetime=0.0;
+				++nfailures;
+				if(verbose)
+				{
+					cerr << "LoadPredictedArrivalTimes:  "
+					 << "get failed on attribute name="
+					<< mderr.name
+					<<" for ensemble member number "
+					<< i <<endl
+					<< "Arrival time set to 0.0"<<endl;
+				}
+			}
+			catch (SeisppError serr)
+			{
+				phasetime=0.0;
+				++nfailures;
+				if(verbose)
+				{
+					cerr << "LoadPredictedArrivalTimes:  "
+					 << "travel time table error "
+					 << "for member="<<i <<endl
+					 << "SeisppError message:"<<endl;
+					serr.log_error();
+					cerr << "Arrival time set to zero"<<endl;
+				}
+			}
+
+		}
+		else
+		{
+			phasetime=0.0;
+		}
+		d.member[i].put(predarr_keyword,phasetime);
+	}
+	return(nfailures);
+}
+
+/*! \brief Post predicted arrival times for several phases to a vector 
+of seismic data objects.
+
+This is the batch form of the algorithm above intended for large data
+sets.  The same seven attributes are required, but members that
+share the same source and station are computed only once.  The unique
+source-station pairs are found first.  Times for every phase are then 
+computed for each pair, and finally posted to the members.  The last 
+two steps are done in parallel.  Travel times always come from the 
+tables because the ttcalc interface is not reentrant.  
+
+The template works on any seismic data object that inherits 
+Metadata and BasicTimeSeries (TimeSeries and ThreeComponentSeismogram).
+Failures are handled as in the single phase versions.  When verbose 
+is true errors are written to stderr after all the work is done.
+
+\param members vector of data objects to be processed.
+\param tables travel time table for each phase.
+\param predarr_keywords key used to store the predicted time for each
+	phase.  Must be the same size as tables.
+\param nthreads number of threads to use.  0 (default) means use 
+	the number of cores.
+\param verbose if true log every error to stderr.
+\param geometry_keys keys to use for source_lat, source_lon, 
+	source_depth, source_time, sta_lat, sta_lon, and sta_elev 
+	(in that order).  Default is those names.  
+
+\return Number of predicted times (members times phases) that could 
+	not be computed.  Those times are set to 0.0.
+\exception SeisppError is thrown if the vector sizes are inconsistent.
+	Any exception other than a travel time SeisppError is rethrown 
+	after all threads finish.
+*/
+template <class T> int LoadPredictedArrivalTimes(vector<T>& members,
+	vector<TravelTimeTable *>& tables,
+		vector<string>& predarr_keywords,
+			int nthreads=0,
+				bool verbose=false,
+				vector<string> geometry_keys=vector<string>())
+{
+	const string base_error("LoadPredictedArrivalTimes (batch version):  ");
+	const int ngeom(7);
+	int nphases=tables.size();
+	if(predarr_keywords.size()!=nphases)
+		throw SeisppError(base_error
+			+ string("tables and keyword lists have different sizes"));
+	if(geometry_keys.size()==0)
+	{
+		geometry_keys.push_back("source_lat");
+		geometry_keys.push_back("source_lon");
+		geometry_keys.push_back("source_depth");
+		geometry_keys.push_back("source_time");
+		geometry_keys.push_back("sta_lat");
+		geometry_keys.push_back("sta_lon");
+		geometry_keys.push_back("sta_elev");
+	}
+	else if(geometry_keys.size()!=ngeom)
+		throw SeisppError(base_error
+			+ string("geometry_keys must contain seven keys"));
+	int nmembers=members.size();
+	int i,j;
+	/* Serial pass.  Metadata gets are not cheap and the lookup of 
+	unique geometries needs a map, so both are done once here.  
+	geomindex is -1 for dead members and -2 for members missing 
+	a required attribute */
+	vector<int> geomindex(nmembers,-1);
+	vector<vector<double> > geometry;
+	map<vector<double>,int> geomap;
+	map<vector<double>,int>::iterator gptr;
+	vector<string> errors;
+	vector<double> g(ngeom);
+	for(i=0;i<nmembers;++i)
+	{
+		BasicTimeSeries *bts=dynamic_cast<BasicTimeSeries *>(&members[i]);
+		if((bts!=NULL) && !(bts->live)) continue;
+		Metadata *md=dynamic_cast<Metadata *>(&members[i]);
+		try {
+			for(j=0;j<ngeom;++j) 
+				g[j]=md->get_double(geometry_keys[j]);
+		} catch (MetadataGetError& mderr)
+		{
+			geomindex[i]=-2;
+			if(verbose)
+			{
+				stringstream ss;
+				ss << "LoadPredictedArrivalTimes:  "
+					<< "get failed on attribute name="
+					<< mderr.name
+					<<" for ensemble member number "
+					<< i;
+				errors.push_back(ss.str());
+			}
+			continue;
+		}
+		gptr=geomap.find(g);
+		if(gptr==geomap.end())
+		{
+			geomindex[i]=geometry.size();
+			geomap[g]=geometry.size();
+			geometry.push_back(g);
+		}
+		else
+			geomindex[i]=gptr->second;
+	}
+	int ngeometries=geometry.size();
+	/* Row major ngeometries by nphases.  Failed times are left 0 */
+	vector<double> times(ngeometries*nphases,0.0);
+	vector<char> ok(ngeometries*nphases,0);
+	vector<string> tterrors(ngeometries*nphases);
+	/* Travel time failures are recorded per phase.  Any other 
+	exception stops the calculation and is rethrown by parallel_for
+	after all threads finish. */
+	parallel_for(ngeometries,nthreads,[&](long k)
+	{
+		vector<double>& gk=geometry[k];
+		Hypocenter h(rad(gk[0]),rad(gk[1]),gk[2],gk[3],
+			string("tttaup"),string("iasp91"));
+		for(int l=0;l<nphases;++l)
+		{
+			try {
+				times[k*nphases+l]=tables[l]->phasetime(h,
+					rad(gk[4]),rad(gk[5]),gk[6])
+					+ gk[3];
+				ok[k*nphases+l]=1;
+			} catch (SeisppError& serr)
+			{
+				tterrors[k*nphases+l]=serr.message;
+			}
+		}
+	});
+	parallel_for(nmembers,nthreads,[&](long m)
+	{
+		Metadata *md=dynamic_cast<Metadata *>(&members[m]);
+		int k=geomindex[m];
+		for(int l=0;l<nphases;++l)
+		{
+			if(k>=0)
+				md->put(predarr_keywords[l],times[k*nphases+l]);
+			else
+				md->put(predarr_keywords[l],0.0);
+		}
+	});
+	/* Count failures per member, not per unique geometry */
+	int nfailures(0);
+	for(i=0;i<nmembers;++i)
+	{
+		int k=geomindex[i];
+		if(k==-2)
+			nfailures+=nphases;
+		else if(k>=0)
+		{
+			for(j=0;j<nphases;++j)
+			{
+				if(ok[k*nphases+j]) continue;
+				++nfailures;
+				if(verbose)
+				{
+					stringstream ss;
+					ss << "LoadPredictedArrivalTimes:  "
+					 << "travel time table error for phase "
+					 << tables[j]->phase_name()
+					 << " for member="<<i <<endl
+					 << "SeisppError message:"<<endl
+					 << tterrors[k*nphases+j];
+					errors.push_back(ss.str());
+				}
+			}
+		}
+	}
+	if(verbose)
+	{
+		for(i=0;i<errors.size();++i)
+			cerr << errors[i] << endl 
+				<< "Arrival time set to zero"<<endl;
+	}
+	return(nfailures);
+}
+/*! \brief Post predicted arrival times for several phases to an ensemble.
+
+Convenience form of the batch algorithm applied to the members of an 
+ensemble.  All arguments are as in the vector form.  
+*/
+template <class Tensemble> int LoadPredictedArrivalTimes(Tensemble& d,
+	vector<TravelTimeTable *>& tables,
+		vector<string>& predarr_keywords,
+			int nthreads=0,
+				bool verbose=false)
+{
+	try {
+		return(LoadPredictedArrivalTimes(d.member,tables,
+				predarr_keywords,nthreads,verbose));
+	} catch(...){throw;};
+}
+
 /*! Extract a component from a ThreeComponentEnsemble to yield a TimeSeriesEnsemble.
 
 An ensemble of three component data can be conceptualized as a three-dimensional
@@ -790,6 +1194,53 @@ to yield a scalar (TimeSeriesEnsemble) result.  This procedure does this.
 \exception SeisppError is throw if result is empty of component number is illegal.
 */
 shared_ptr<TimeSeriesEnsemble> ExtractComponent(ThreeComponentEnsemble& tcs,int component);
+/*! \brief Restore all members of an ensemble to cardinal directions.
+
+Calls rotate_to_standard for each member.  Members are processed 
+in parallel.
+
+\param d ensemble to be transformed (altered in place)
+\param nthreads number of threads to use.  0 (default) means use 
+  the number of cores.
+\exception SeisppError is thrown if any member's transformation
+  matrix is singular.
+*/
+void RotateMembersToStandard(ThreeComponentEnsemble& d, int nthreads=0);
+/*! \brief Rotate each member of an ensemble to its own ray coordinates.
+
+Member i is transformed as if rotate(sc[i]) had been called.  Any
+previous transformation is replaced with a single pass through the 
+data.  Members are processed in parallel.
+
+\param d ensemble to be transformed (altered in place)
+\param sc direction for each member (see ThreeComponentSeismogram::rotate).
+   Must be the same size as d.member.
+\param nthreads number of threads to use.  0 (default) means use 
+  the number of cores.
+\exception SeisppError is thrown if sizes do not match or a 
+  transformation matrix is singular.
+*/
+void RotateMembers(ThreeComponentEnsemble& d, vector<SphericalCoordinate>& sc,
+		int nthreads=0);
+/*! \brief Apply a 3x3 transformation to each member of an ensemble.
+
+Member i is transformed by the matrix a[i].   Members are processed
+in parallel.  
+
+\param d ensemble to be transformed (altered in place)
+\param a transformation matrix for each member.  Each must be 3x3
+  and the vector must be the same size as d.member.
+\param accumulate when true call apply_transformation_matrix, so a[i]
+  is applied on top of any previous transformation.  When false 
+  (default) call set_transformation_matrix so a[i] replaces any 
+  previous transformation.
+\param nthreads number of threads to use.  0 (default) means use 
+  the number of cores.
+\exception SeisppError is thrown if sizes do not match or a 
+  transformation matrix is singular.
+*/
+void TransformMembers(ThreeComponentEnsemble& d, vector<dmatrix>& a,
+		bool accumulate=false, int nthreads=0);
 #ifndef NO_ANTELOPE
 /*! \brief Bundle scalar data to produce an ensemble of three-component data.
 
@@ -0,0 +1,65 @@
+#include <vector>
+#include "seispp.h"
+#include "ensemble.h"
+#include "parallel_for.h"
+namespace SEISPP
+{
+using namespace std;
+using namespace SEISPP;
+/* Calls f(member,i) for each member of d on a pool of threads (see
+parallel_for).  Each member is touched by only one thread so f needs 
+no locking. */
+template <class MemberFunction> void for_each_member(
+		ThreeComponentEnsemble& d, MemberFunction f, int nthreads)
+{
+	parallel_for(d.member.size(),nthreads,[&](long i)
+		{
+			f(d.member[i],i);
+		});
+}
+/* Copies a dmatrix holding a 3x3 matrix to a C array */
+static void copy_3x3(dmatrix& a, double c[3][3], const string caller)
+{
+	if( (a.rows()!=3) || (a.columns()!=3) )
+		throw SeisppError(caller
+			+ "  transformation matrices must be 3x3");
+	for(int i=0;i<3;++i)
+		for(int j=0;j<3;++j) c[i][j]=a(i,j);
+}
+void RotateMembersToStandard(ThreeComponentEnsemble& d, int nthreads)
+{
+	for_each_member(d,[](ThreeComponentSeismogram& s, int i)
+		{
+			s.rotate_to_standard();
+		},nthreads);
+}
+void RotateMembers(ThreeComponentEnsemble& d, vector<SphericalCoordinate>& sc,
+		int nthreads)
+{
+	if(sc.size()!=d.member.size())
+		throw SeisppError(string("RotateMembers:  ")
+			+ "size mismatch between ensemble and vector of directions");
+	for_each_member(d,[&sc](ThreeComponentSeismogram& s, int i)
+		{
+			s.rotate(sc[i]);
+		},nthreads);
+}
+void TransformMembers(ThreeComponentEnsemble& d, vector<dmatrix>& a,
+		bool accumulate, int nthreads)
+{
+	const string base_error("TransformMembers:  ");
+	if(a.size()!=d.member.size())
+		throw SeisppError(base_error
+			+ "size mismatch between ensemble and vector of matrices");
+	for_each_member(d,[&a,&base_error,accumulate]
+		(ThreeComponentSeismogram& s, int i)
+		{
+			double c[3][3];
+			copy_3x3(a[i],c,base_error);
+			if(accumulate)
+				s.apply_transformation_matrix(c);
+			else
+				s.set_transformation_matrix(c);
+		},nthreads);
+}
+} // End SEISPP namespace declaration
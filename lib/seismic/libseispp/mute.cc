@@ -1,3 +1,4 @@
+#include <sstream>
 #include "seispp.h"
 #include "mute.h"
 #include "PfStyleMetadata.h"
@@ -122,5 +123,60 @@ TopMute::TopMute(PfStyleMetadata& md,string tag)
     catch (...) {throw;};
 }
 
+TailMute::TailMute(PfStyleMetadata& pf)
+{
+  try{
+    t0=pf.get<double>("t0");
+    t1=pf.get<double>("t1");
+    if(t1>=t0)
+    {
+      stringstream serr;
+      serr<<"TailMute constructor:  illegal parameters for mute definition"
+        <<endl<<"Time of start (t1) ="<<t1<<endl
+        <<"Time of mute end (t0) where data after that time are zeroed="<<t0
+        <<endl
+        << "t0 must be greater than t1"<<endl;
+      throw SeisppError(serr.str());
+    }
+    dwdt = 1.0/(t0-t1);
+  }catch(...){throw;};
+}
+int TailMute::apply(ThreeComponentSeismogram& d)
+{
+  int i,k;
+  int n(0);
+  double t;
+  double te=d.endtime();
+  //DEBUG
+  /*
+  cerr << "first sample number="<<d.sample_number(t1+d.dt)+1<<endl
+      << "last sample number="<<d.sample_number(te)<<endl
+      << "This trace length="<<d.ns<<endl;
+      */
+  for(t=t1+d.dt,i=d.sample_number(t1+d.dt)+1;t<te&&i<d.ns;t+=d.dt,++i)
+  {
+    double w;
+    if(i<0) continue;
+    if(t>=t0)
+        w=0.0;
+    else
+        w=1.0-(t-t1)*dwdt;
+    for(k=0;k<3;++k) d.u(k,i)*=w;
+    ++n;
+  }
+  for(;i<d.ns;++i)
+  {
+    for(k=0;k<3;++k) d.u(k,i)=0.0;
+    ++n;
+  }
+  if(n>=d.ns)
+  {
+      d.live=false;
+      cerr << "TailMute::apply:   zeroed all data.  Marking output dead"
+          <<endl;
+  }
+  return n;
+}
+
 	
 } // Termination of namespace SEISPP definitions
@@ -84,6 +84,29 @@ functions will be return immediately doing nothing.*/
    */
         TopMute(PfStyleMetadata& md,string tag);
 };
+/*! \brief Defines a tail mute (end of data segment).
+
+A tail mute zeros data at the end of a segment.  This implementation
+only supports a linear ramp from 1 at time t1 to 0 at t0.   Data after
+t0 are zeroed.  Times are relative to the data time reference.
+\author Gary L. Pavlis
+**/
+class TailMute
+{
+  public:
+    /*! Start of mute (where value is 1) */
+    double t1; 
+    /*! Time when mute is zero */
+    double t0;
+    /*! Construct from a pf.   Requires keys t0 and t1.
+    \exception SeisppError if t1>=t0 or either is missing.  */
+    TailMute(PfStyleMetadata& pf);
+    /*! Apply the mute to a seismogram.   Returns number of samples changed.
+    If all samples are zeroed the output is marked dead.  */
+    int apply(ThreeComponentSeismogram& d);
+  private:
+    double dwdt;  //change in weight with time used to compute ramp mute
+};
 /*!
 // Applies a top mute to a TimeSeries object.
 **/
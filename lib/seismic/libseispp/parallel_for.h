@@ -0,0 +1,91 @@
+#ifndef _PARALLEL_FOR_H_
+#define _PARALLEL_FOR_H_
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <system_error>
+#include <exception>
+namespace SEISPP
+{
+/*! \brief Number of threads parallel_for uses for n items of work.
+
+0 or less means one per hardware thread.  The result is never more
+than n and never less than 1.
+
+\param nthreads - requested number of threads
+\param n - number of items of work
+*/
+inline int parallel_thread_count(int nthreads, long n)
+{
+	if(nthreads<=0) nthreads=std::thread::hardware_concurrency();
+	if(nthreads>n) nthreads=n;
+	if(nthreads<1) nthreads=1;
+	return nthreads;
+}
+/*! \brief Calls f(i) for i=0,...,n-1 on a pool of threads.
+
+Indices are handed out one at a time so items of very different cost
+are balanced.  Each index is passed to exactly one call of f.  When
+only one thread is used all calls are made in order on the calling
+thread.  If threads cannot be started the calling thread does the
+work that is left.
+
+Once any call throws no more indices are handed out.  The exception
+is rethrown after all threads finish.  If more than one call throws,
+the exception from the lowest index is rethrown.
+
+\param n - number of items of work
+\param nthreads - number of threads.  0 means one per hardware thread
+  (see parallel_thread_count).
+\param f - callable with one long argument, the index of the item.
+  f is shared by all threads, so anything it alters other than the
+  item it was passed must be locked.
+*/
+template <class Function> void parallel_for(long n, int nthreads,
+		Function f)
+{
+	if(n<=0) return;
+	nthreads=parallel_thread_count(nthreads,n);
+	if(nthreads==1)
+	{
+		for(long i=0;i<n;++i) f(i);
+		return;
+	}
+	std::atomic<long> next(0);
+	std::atomic<bool> failed(false);
+	std::mutex lock;
+	std::exception_ptr error;
+	long error_index(n);
+	auto worker=[&]()
+	{
+		long i;
+		while(!failed && ((i=next++)<n))
+		{
+			try{
+				f(i);
+			}catch(...)
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if(i<error_index)
+				{
+					error=std::current_exception();
+					error_index=i;
+				}
+				failed=true;
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	try{
+		for(int t=0;t<nthreads;++t)
+			threads.push_back(std::thread(worker));
+	}catch(std::system_error&)
+	{
+		worker();
+	}
+	for(size_t t=0;t<threads.size();++t) threads[t].join();
+	if(error) std::rethrow_exception(error);
+}
+} // End SEISPP namespace declaration
+#endif
@@ -8,6 +8,7 @@
 #endif
 #include "seispp.h"
 #include "dmatrix.h"
+#include "wfswap.h"
 namespace SEISPP
 {
 using namespace SEISPP;
@@ -441,8 +442,7 @@ long dbsave(TimeSeries& ts,
 			// note this uses sdtype set in indefs above
 			dbputv(db,0,"datatype",sdtype.c_str(),NULL);
 			float *outbuf = new float[ts.ns];
-			for(int i=0;i<ts.ns;++i) 
-				outbuf[i]=static_cast<float>(ts.s[i]);
+			wf_double_to_f4(outbuf,&(ts.s[0]),ts.ns,0);
 			foff = vector_fwrite(outbuf,ts.ns,
 				string(dir), string(dfile));
 			delete [] outbuf;
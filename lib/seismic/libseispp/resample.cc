@@ -13,6 +13,7 @@ Written:  Winter spring 2004
 #include <vector>
 #include <sstream>
 #include "perf.h"
+#include "firdec.h"
 using namespace std;
 #include "seispp.h"
 #include "interpolator1d.h"
@@ -307,43 +308,43 @@ DecimatedVector *Decimator::apply(int nsamp_in, double *s,bool trim)
 		else
 			nsamp_out = nsamp_in/idecfac;
 		dout = new DecimatedVector(nsamp_out);
+		// The filtering is done by the streaming decimator in libperf
+		// shared with dbdec.  Outputs are centered lag samples after 
+		// the start of the filter window.  Without trim the window of
+		// the first output starts at sample 1-lag and data off the ends
+		// are zero.  With trim only full windows are used.
+		FIRdec *fd=firdec_new(FIRDEC_EDGE_ZERO);
+		if(fd==NULL) throw SeisppError("Decimator::apply:  firdec_new failed");
+		if(firdec_add_stage(fd,idecfac,ncoefs,&coefs[0],lag))
+		{
+			firdec_free(fd);
+			throw SeisppError("Decimator::apply:  invalid FIR decimation stage");
+		}
 		if(trim)
 		{
 			dout->lag = lag;
-			for(i=0,ii=lag;i<nsamp_out;++i,ii+=idecfac)
-			{
-				double dotprd;
-				dotprd = ddot(ncoefs,&coefs[0],1,s+ii-lag,1);
-				dout->d.push_back(dotprd);
-			}
+			firdec_reset(fd,lag);
 		}
 		else
 		{
 			dout->lag = 0;
-			for(i=0,ii=1-lag;i<nsamp_out;++i,ii+=idecfac)
-			{
-				int ndot,id0;
-				double dotprd;
-				if(ii<0)
-				{
-					ndot=ncoefs+ii; // right because ii is negative
-					// pointer lag in coefs sets pointer to leading edge of coefs
-					dotprd=ddot(ndot,&coefs[-ii],1,s,1);
-					dout->d.push_back(dotprd);
-				}
-				else if(ii+ncoefs>nsamp_in)
-				{
-					ndot = nsamp_in - ii;
-					dotprd=ddot(ndot,&coefs[0],1,s+ii,1);
-					dout->d.push_back(dotprd);
-				}
-				else
-				{
-					dotprd=ddot(ncoefs,&coefs[0],1,s+ii,1);
-					dout->d.push_back(dotprd);
-				}
-			}
+			firdec_reset(fd,1);
+		}
+		// Trailing zeros play the role of a flush here.  Without trim
+		// the last output can be centered one sample past the end.
+		vector<double> zeros(ncoefs+idecfac,0.0);
+		vector<double> work(firdec_maxout(fd,nsamp_in)
+				+firdec_maxout(fd,zeros.size()));
+		long nw=firdec_process(fd,s,nsamp_in,&work[0]);
+		if(nw>=0 && nw<nsamp_out) 
+		{
+			long nf=firdec_process(fd,&zeros[0],zeros.size(),&work[nw]);
+			nw = (nf<0) ? nf : nw+nf;
 		}
+		firdec_free(fd);
+		if(nw<0) throw SeisppError("Decimator::apply:  memory allocation failure in firdec");
+		if(nw<nsamp_out) nsamp_out=nw;
+		dout->d.assign(work.begin(),work.begin()+nsamp_out);
 	}
 	return(dout);
 }
@@ -10,6 +10,7 @@
 #include "databasehandle.h"
 #endif
 #include "Hypocenter.h"
+#include "TravelTimeTable.h"
 #include "ensemble.h"
 #include "resample.h"
 #include "PfStyleMetadata.h"
@@ -321,6 +322,22 @@ void load_subarrays(SeismicArray& master,PfStyleMetadata& pfmd);
 **/
 StationTime ArrayPredictedArrivals(SeismicArray& stations,
                 Hypocenter& hypo, string phase);
+/*! Computes predicted arrival times at all stations of an array
+ by interpolating a travel time table.
+
+ Same as the version using Hypocenter::phasetime but much faster
+ for large arrays and catalogs.  The phase, method, and model are
+ those of the table.  The table can be shared by any number of
+ threads calling this function.
+
+\param stations object defining station geometry.
+\param hypo object defining source coordinates.
+\param table travel time table for the phase of interest.
+
+\return map keyed by station named containing predicted arrival times.
+**/
+StationTime ArrayPredictedArrivals(SeismicArray& stations,
+                Hypocenter& hypo, TravelTimeTable& table);
 
 #ifndef NO_ANTELOPE
 /*! \brief Read a block of data in a fixed absolute time window.
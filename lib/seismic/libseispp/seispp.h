@@ -541,6 +541,25 @@ TimeSeries WindowData(const TimeSeries& parent, const TimeWindow& tw);
 **/
 ThreeComponentSeismogram WindowData(const ThreeComponentSeismogram& parent, const TimeWindow& tw);
 
+/*!
+// Applies a three-component automatic gain control operator.
+//
+// Uses the same algorithm as seismic unix but with a vector sum of 
+// squares of all three components instead of the scalar form.
+// The gain is averaged over a window of length twin ramping on and 
+// off at the ends using the same cumulative approach used in the 
+// seismic unix algorithm.  d is altered in place.
+//
+//\return TimeSeries containing the gain function applied to each 
+//      3c sample.
+//
+//\exception SeisppError if twin resolves to less than one sample.
+//
+//\param d is the data to be gained.
+//\param twin is the agc window length in seconds.
+**/
+TimeSeries ApplyAGC(ThreeComponentSeismogram& d, double twin);
+
 /*! Extract a specified time window from an ensemble.
 // The seispp library defines a fairly generic ensemble object that
 // uses an STL vector container to hold an array of objects 
@@ -0,0 +1,182 @@
+#ifndef _BLOCK_OBJECT_FILE_H_
+#define _BLOCK_OBJECT_FILE_H_
+#include <string>
+#include <vector>
+#include <streambuf>
+#include <zlib.h>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+#include "seispp_io.h"
+#include "Metadata.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/* This file contains definitions shared by BlockObjectWriter and
+BlockObjectReader.   A block file is an alternative container to the
+simple concatenated archive written by StreamObjectWriter.  Objects are
+serialized one at a time and accumulated in a buffer.  When the buffer
+grows past a target size it is compressed (zlib) and written as a
+block.  At close the writer appends a footer that holds the position of
+every block, the location of every object within its block, and a set
+of Metadata attributes extracted from each object.  The footer is
+itself compressed and is located by a fixed size trailer at the end of
+the file.   A reader can then seek to any object by reading the footer
+and decompressing one block - no index pass through the data is needed.
+
+File layout:
+   magic (BINARY_TAG_SIZE bytes)
+   block 0 ... block n-1   (compressed)
+   footer                  (compressed binary archive of BlockFileFooter)
+   trailer                 (BlockFileTrailer, fixed size)
+*/
+/*! Magic string written at the start of a block compressed file */
+const string block_file_magic("SPBZ");
+/*! Tag written at the end of the trailer of a block compressed file */
+const string block_file_eof_tag("ENDZ");
+/*! Default uncompressed size target for one block (bytes) */
+const long DefaultObjectBlockSize(1048576);
+/*! \brief Fixed size trailer at the end of a block compressed file.
+
+Readers seek back sizeof(BlockFileTrailer) bytes from the end of file to
+load this and from it locate the footer. */
+struct BlockFileTrailer
+{
+  long footer_foff;
+  long footer_nbytes;
+  long footer_rawbytes;
+  long nobjects;
+  char tag[BINARY_TAG_SIZE];
+};
+/*! Description of one compressed block in the file */
+class BlockRecord
+{
+public:
+  /*! file offset of the start of the compressed block */
+  long foff;
+  /*! size of the compressed block in bytes */
+  long nbytes;
+  /*! size of the block after decompression */
+  long rawbytes;
+  BlockRecord(){foff=0;nbytes=0;rawbytes=0;};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>
+     void serialize(Archive& ar,const unsigned int version)
+  {
+    ar & foff;
+    ar & nbytes;
+    ar & rawbytes;
+  };
+};
+/*! Location of one serialized object in an uncompressed block */
+class BlockObjectEntry
+{
+public:
+  int block;
+  long offset;
+  long nbytes;
+  BlockObjectEntry(){block=0;offset=0;nbytes=0;};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>
+     void serialize(Archive& ar,const unsigned int version)
+  {
+    ar & block;
+    ar & offset;
+    ar & nbytes;
+  };
+};
+/*! Embedded index saved at the end of a block compressed file */
+class BlockFileFooter
+{
+public:
+  /*! typeid name of the objects stored in the file */
+  string type_name;
+  /*! true if blocks were XOR preconditioned before compression */
+  bool preconditioned;
+  vector<BlockRecord> blocks;
+  vector<BlockObjectEntry> objects;
+  /*! Metadata attributes extracted from each object by the writer */
+  vector<Metadata> index;
+  BlockFileFooter(){preconditioned=false;};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>
+     void serialize(Archive& ar,const unsigned int version)
+  {
+    ar & type_name;
+    ar & preconditioned;
+    ar & blocks;
+    ar & objects;
+    ar & index;
+  };
+};
+/* Stride in bytes of the XOR preconditioner.  Each byte is replaced by
+its XOR with the byte this many positions earlier.   For arrays of
+double values that vary slowly sign, exponent, and high mantissa bytes
+repeat so the result is mostly zeros and compresses much better.   The
+transformation is byte wise so it does not care about alignment of
+the sample vectors inside the archive. */
+const int BlockXORStride(8);
+inline void block_xor_precondition(vector<char>& buf)
+{
+  long i;
+  for(i=buf.size()-1;i>=BlockXORStride;--i)
+    buf[i] ^= buf[i-BlockXORStride];
+}
+inline void block_xor_restore(vector<char>& buf)
+{
+  long i;
+  for(i=BlockXORStride;i<buf.size();++i)
+    buf[i] ^= buf[i-BlockXORStride];
+}
+/*! \brief Compress a buffer with zlib.
+
+\param raw - data to be compressed
+\param out - holds compressed data on return (resized)
+\param level - zlib compression level.  Default favors speed.
+
+\exception SeisppError is thrown if zlib fails
+*/
+inline void block_compress(const vector<char>& raw,vector<char>& out,
+        int level=Z_BEST_SPEED)
+{
+  uLongf nout=compressBound(raw.size());
+  out.resize(nout);
+  int iret=compress2(reinterpret_cast<Bytef *>(&(out[0])),&nout,
+          reinterpret_cast<const Bytef *>(raw.data()),raw.size(),level);
+  if(iret!=Z_OK)
+    throw SeisppError(string("block_compress:  zlib compress2 failed"));
+  out.resize(nout);
+}
+/*! \brief Inverse of block_compress.
+
+\param cbuf - pointer to compressed data
+\param nc - number of bytes in cbuf
+\param raw - output buffer.  Must be sized to the expected raw size
+   on entry.
+
+\exception SeisppError is thrown if zlib fails or the decompressed size
+   does not match the size of raw.
+*/
+inline void block_expand(const char *cbuf,long nc,vector<char>& raw)
+{
+  uLongf nout=raw.size();
+  int iret=uncompress(reinterpret_cast<Bytef *>(&(raw[0])),&nout,
+          reinterpret_cast<const Bytef *>(cbuf),nc);
+  if( (iret!=Z_OK) || (nout!=raw.size()) )
+    throw SeisppError(string("block_expand:  zlib uncompress failed.  ")
+            + "Block compressed file is probably corrupted");
+}
+/* Minimal read only streambuf on a memory buffer.   Used to deserialize
+objects directly from an uncompressed block without a copy. */
+class BlockMemoryBuffer : public std::streambuf
+{
+public:
+  BlockMemoryBuffer(char *b,long n)
+  {
+    setg(b,b,b+n);
+  };
+};
+} // End SEISPP namespace
+#endif
@@ -0,0 +1,156 @@
+#ifndef _BLOCK_OBJECT_READER_H_
+#define _BLOCK_OBJECT_READER_H_
+#include "BasicObjectReader.h"
+#include "BlockObjectFile.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Reader for block compressed files written by BlockObjectWriter.
+
+The constructor loads the index embedded at the end of the file so this
+reader supports both sequential reads and random access by object
+number.   Only the block containing the requested object is
+decompressed.  The last block used is cached so reading objects in
+file order decompresses each block only once.
+*/
+template <typename T>
+    class BlockObjectReader : public BasicObjectReader<T>
+{
+  public:
+    /*! \brief Create handle to read from file.
+
+      \param fname - block compressed file to be read
+
+      \exception - throws a SeisppError object if the file cannot be
+        opened, is not a block compressed file, or holds objects of a
+        different type.
+        */
+    BlockObjectReader(const string fname);
+    /*! Read the next object in file. */
+    T read();
+    /*! Read object number i (0 is the first). */
+    T read(long i);
+    /*! Returns number of objects in the file being read. */
+    long number_available(){return footer.objects.size();};
+    long number_already_read(){return n_previously_read;};
+    bool good(){return n_previously_read<footer.objects.size();};
+    bool eof(){return n_previously_read>=footer.objects.size();};
+    /*! Return to the first object in the file */
+    void rewind(){n_previously_read=0;};
+    /*! \brief Return the embedded index.
+
+    The index is a vector of Metadata objects in file order holding
+    the attributes the writer was asked to save. */
+    const vector<Metadata>& index(){return footer.index;};
+    string filename(){return parent_filename;};
+  private:
+    string parent_filename;
+    ifstream ifs;
+    BlockFileFooter footer;
+    long n_previously_read;
+    /* Cache of the uncompressed block most recently used */
+    int current_block;
+    vector<char> rawblock;
+    void load_block(int iblock);
+};
+template <typename T>
+   BlockObjectReader<T>::BlockObjectReader(const string fname)
+       : parent_filename(fname)
+{
+  const string base_error("BlockObjectReader file constructor:  ");
+  ifs.open(fname.c_str(),ios::in | ios::binary);
+  if(ifs.fail())
+  {
+    throw SeisppError(base_error+"cannot open file "+fname+" for input");
+  }
+  char tagbuf[BINARY_TAG_SIZE+1];
+  ifs.read(tagbuf,BINARY_TAG_SIZE);
+  tagbuf[BINARY_TAG_SIZE]='\0';
+  BlockFileTrailer trailer;
+  ifs.seekg(-((long)sizeof(BlockFileTrailer)),ios_base::end);
+  ifs.read((char *)(&trailer),sizeof(BlockFileTrailer));
+  if(ifs.fail() || (string(tagbuf)!=block_file_magic)
+      || (string(trailer.tag,BINARY_TAG_SIZE)!=block_file_eof_tag))
+  {
+    throw SeisppError(base_error + "File "
+        + fname + " does not appear to be a valid seispp block compressed file");
+  }
+  vector<char> cbuf(trailer.footer_nbytes);
+  vector<char> raw(trailer.footer_rawbytes);
+  ifs.seekg(trailer.footer_foff,ios_base::beg);
+  ifs.read(&(cbuf[0]),cbuf.size());
+  if(ifs.fail())
+    throw SeisppError(base_error + "read error loading index from file "+fname);
+  block_expand(&(cbuf[0]),cbuf.size(),raw);
+  try{
+    BlockMemoryBuffer mbuf(&(raw[0]),raw.size());
+    istream is(&mbuf);
+    boost::archive::binary_iarchive ia(is,boost::archive::no_header);
+    ia>>footer;
+  }catch(...)
+  {
+    throw SeisppError(base_error + "Failed to deserialize index for file "
+            + fname);
+  }
+  if(footer.type_name != typeid(T).name())
+  {
+    throw SeisppError(base_error+"type mismatch in data file\n"
+       + "Expected object type="+typeid(T).name()
+       + " but file "+fname+" contains objects of type="+footer.type_name);
+  }
+  if(footer.objects.size()!=trailer.nobjects)
+    throw SeisppError(base_error + "object count in index does not match "
+            + "count in trailer of file "+fname);
+  n_previously_read=0;
+  current_block=-1;
+}
+template <typename T> void BlockObjectReader<T>::load_block(int iblock)
+{
+  if(iblock==current_block) return;
+  const BlockRecord& brec=footer.blocks[iblock];
+  vector<char> cbuf(brec.nbytes);
+  ifs.clear();
+  ifs.seekg(brec.foff,ios_base::beg);
+  ifs.read(&(cbuf[0]),brec.nbytes);
+  if(ifs.fail())
+    throw SeisppError(string("BlockObjectReader:  read error on file ")
+            + parent_filename);
+  /* Invalidate the cache first in case expand throws */
+  current_block=-1;
+  rawblock.resize(brec.rawbytes);
+  block_expand(&(cbuf[0]),cbuf.size(),rawblock);
+  if(footer.preconditioned) block_xor_restore(rawblock);
+  current_block=iblock;
+}
+template <typename T> T BlockObjectReader<T>::read(long i)
+{
+  const string base_error("BlockObjectReader read method:  ");
+  if( (i<0) || (i>=footer.objects.size()) )
+    throw SeisppError(base_error + "requested object number is outside range of file "
+            + parent_filename);
+  try{
+    const BlockObjectEntry& ent=footer.objects[i];
+    load_block(ent.block);
+    T d;
+    BlockMemoryBuffer mbuf(&(rawblock[ent.offset]),ent.nbytes);
+    istream is(&mbuf);
+    boost::archive::binary_iarchive ia(is,boost::archive::no_header);
+    ia>>d;
+    n_previously_read=i+1;
+    return d;
+  }catch(SeisppError& serr){throw;}
+  catch(...)
+  {
+    throw SeisppError(base_error
+      + "boost serialization read failed for file "+parent_filename);
+  }
+}
+template <typename T> T BlockObjectReader<T>::read()
+{
+  if(n_previously_read>=footer.objects.size())
+    throw SeisppError(string("BlockObjectReader read method:  ")
+        + "Trying to read past end of file - code should test for this condition with eof method");
+  return this->read(n_previously_read);
+}
+}
+#endif
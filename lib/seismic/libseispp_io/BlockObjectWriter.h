@@ -0,0 +1,177 @@
+#ifndef _BLOCK_OBJECT_WRITER_H_
+#define _BLOCK_OBJECT_WRITER_H_
+#include <sstream>
+#include <cstring>
+#include "BasicObjectWriter.h"
+#include "BlockObjectFile.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Object writer saving data in a block compressed file.
+
+This is an alternative to StreamObjectWriter.  Objects are serialized
+with boost binary serialization as in StreamObjectWriter, but they
+are grouped into blocks that are compressed independently.  An index
+of the position of each object and a set of Metadata attributes
+extracted from each object are saved in a footer at the end of the file.
+The output of this writer is read by BlockObjectReader or by
+IndexedObjectReader with format 'z'.   Because the file has to be
+closed with a footer output can only be directed to a file, not stdout.
+
+T must be a child of Metadata for the index to be built.
+*/
+template <class T> class BlockObjectWriter : public BasicObjectWriter<T>
+{
+  public:
+    /*! \brief Create handle to write to file.
+
+      \param fname - file to open for output
+      \param mdl - list of Metadata attributes copied from each
+         object to the embedded index.  May be empty.
+      \param blocksize - target uncompressed block size in bytes
+      \param precondition - when true (default) apply an XOR
+         preconditioner to each block before compression.
+
+      \exception - throws a SeisppError object if open fails.
+        */
+    BlockObjectWriter(string fname,MetadataList mdl=MetadataList(),
+            long blocksize=DefaultObjectBlockSize,bool precondition=true);
+    /*! Destructor - calls close if that was not done explicitly. */
+     ~BlockObjectWriter();
+    /*! \brief write one object.
+
+    Serializes d and appends it to the current block.  The block is
+    compressed and written when it exceeds the block size.
+
+    \param d - object to be written
+    */
+    void write(T& d);
+    /*! \brief Flush buffered data and write the footer.
+
+    This is done automatically by the destructor, but the destructor
+    cannot report errors.   Call this explicitly when it matters.  */
+    void close();
+    long number_already_written(){return footer.objects.size();};
+  private:
+    string parent_filename;
+    ofstream ofs;
+    MetadataList mdl;
+    long blocksize;
+    /* Uncompressed objects waiting to be written as a block */
+    vector<char> pending;
+    /* current output file position (bytes written so far) */
+    long foffnow;
+    BlockFileFooter footer;
+    bool closed;
+    void flush_block();
+};
+
+template <class T> BlockObjectWriter<T>::BlockObjectWriter(string fname,
+        MetadataList mdlin,long bsize,bool precondition)
+            : parent_filename(fname),mdl(mdlin)
+{
+  const string base_error("BlockObjectWriter file constructor:  ");
+  if(bsize<=0) throw SeisppError(base_error + "illegal block size");
+  blocksize=bsize;
+  ofs.open(fname.c_str(),ios::out | ios::binary | ios::trunc);
+  if(ofs.fail())
+  {
+    throw SeisppError(base_error+"open failed on file "+fname+" for output");
+  }
+  footer.type_name=typeid(T).name();
+  footer.preconditioned=precondition;
+  pending.reserve(blocksize+blocksize/4);
+  ofs.write(block_file_magic.c_str(),BINARY_TAG_SIZE);
+  foffnow=BINARY_TAG_SIZE;
+  closed=false;
+}
+template <class T> void BlockObjectWriter<T>::write(T& d)
+{
+  const string base_error("BlockObjectWriter write method:  ");
+  if(closed) throw SeisppError(base_error + "output file was already closed");
+  try {
+    /* Each object gets its own archive without header so any one of
+    them can be deserialized without reading what preceded it */
+    ostringstream oss(ios::out | ios::binary);
+    {
+      boost::archive::binary_oarchive oa(oss,boost::archive::no_header);
+      oa<<d;
+    }
+    string sbuf=oss.str();
+    BlockObjectEntry ent;
+    ent.block=footer.blocks.size();
+    ent.offset=pending.size();
+    ent.nbytes=sbuf.size();
+    pending.insert(pending.end(),sbuf.begin(),sbuf.end());
+    footer.objects.push_back(ent);
+    Metadata mdtmp;
+    copy_selected_metadata(dynamic_cast<Metadata&>(d),mdtmp,mdl);
+    footer.index.push_back(mdtmp);
+  }catch(...)
+  {
+    throw SeisppError(base_error + "serialization failed\n"
+                +"Is serialization defined for this object type?");
+  }
+  if(pending.size()>=blocksize) flush_block();
+}
+template <class T> void BlockObjectWriter<T>::flush_block()
+{
+  if(pending.size()<=0) return;
+  BlockRecord brec;
+  brec.foff=foffnow;
+  brec.rawbytes=pending.size();
+  if(footer.preconditioned) block_xor_precondition(pending);
+  vector<char> cbuf;
+  block_compress(pending,cbuf);
+  brec.nbytes=cbuf.size();
+  ofs.write(&(cbuf[0]),cbuf.size());
+  if(ofs.fail())
+    throw SeisppError(string("BlockObjectWriter:  write error on file ")
+            + parent_filename);
+  foffnow+=cbuf.size();
+  footer.blocks.push_back(brec);
+  pending.clear();
+}
+template <class T> void BlockObjectWriter<T>::close()
+{
+  if(closed) return;
+  /* Set this first so a failure here is not repeated by the destructor */
+  closed=true;
+  try{
+    flush_block();
+    ostringstream oss(ios::out | ios::binary);
+    {
+      boost::archive::binary_oarchive oa(oss,boost::archive::no_header);
+      oa<<footer;
+    }
+    string sbuf=oss.str();
+    vector<char> raw(sbuf.begin(),sbuf.end());
+    vector<char> cbuf;
+    block_compress(raw,cbuf,Z_DEFAULT_COMPRESSION);
+    BlockFileTrailer trailer;
+    /* zero padding bytes so output files are reproducible */
+    memset(&trailer,0,sizeof(BlockFileTrailer));
+    trailer.footer_foff=foffnow;
+    trailer.footer_nbytes=cbuf.size();
+    trailer.footer_rawbytes=raw.size();
+    trailer.nobjects=footer.objects.size();
+    memcpy(trailer.tag,block_file_eof_tag.c_str(),BINARY_TAG_SIZE);
+    ofs.write(&(cbuf[0]),cbuf.size());
+    ofs.write((char *)(&trailer),sizeof(BlockFileTrailer));
+    ofs.close();
+    if(ofs.fail())
+      throw SeisppError(string("BlockObjectWriter close method:  ")
+            + "write error closing file "+parent_filename);
+  }catch(...){throw;};
+}
+template <class T> BlockObjectWriter<T>::~BlockObjectWriter()
+{
+  try{
+    close();
+  }catch(SeisppError& serr)
+  {
+    serr.log_error();
+  }
+}
+}
+#endif
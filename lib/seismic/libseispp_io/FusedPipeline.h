@@ -0,0 +1,306 @@
+#ifndef _FUSEDPIPELINE_H_
+#define _FUSEDPIPELINE_H_
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include "SeisppError.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Bounded, thread safe queue connecting stages of a FusedPipeline.
+
+Objects are moved in and out of the queue so no data are copied when
+they are handed from one stage to the next.  push blocks when the
+queue is full and pop blocks when it is empty.  That provides the
+same back pressure a unix pipe gives a chain of seispp filters.
+A few statistics on the queue are accumulated for tuning.
+*/
+template <class T> class FusedPipelineQueue
+{
+  public:
+    /*! Construct a queue that will hold at most capacity objects.*/
+    FusedPipelineQueue(int capacity) : maxsize(capacity)
+    {
+      if(maxsize<1) maxsize=1;
+      closed=false;
+      aborted=false;
+      npush=0;
+      occupancy_sum=0;
+      max_occupancy=0;
+      push_wait=0.0;
+    };
+    /*! Move d to the end of the queue.
+
+      Blocks while the queue is full.  Returns false (d is not used)
+      if the pipeline has been aborted. */
+    bool push(T& d)
+    {
+      unique_lock<mutex> lock(m);
+      if(q.size()>=maxsize)
+      {
+        chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+        not_full.wait(lock,[this]{return (q.size()<maxsize)||aborted;});
+        push_wait += chrono::duration<double>
+            (chrono::steady_clock::now()-t0).count();
+      }
+      if(aborted) return false;
+      q.push_back(std::move(d));
+      ++npush;
+      occupancy_sum += q.size();
+      if(q.size()>max_occupancy) max_occupancy=q.size();
+      lock.unlock();
+      not_empty.notify_one();
+      return true;
+    };
+    /*! Move the object at the head of the queue to d.
+
+      Blocks while the queue is empty.   Returns false when there is
+      nothing more to read - the upstream stage has called close and
+      the queue is empty or the pipeline was aborted. */
+    bool pop(T& d)
+    {
+      unique_lock<mutex> lock(m);
+      not_empty.wait(lock,[this]{return (!q.empty())||closed||aborted;});
+      if(aborted || q.empty()) return false;
+      d=std::move(q.front());
+      q.pop_front();
+      lock.unlock();
+      not_full.notify_one();
+      return true;
+    };
+    /*! Called by the upstream stage when it has no more output. */
+    void close()
+    {
+      {
+        lock_guard<mutex> lock(m);
+        closed=true;
+      }
+      not_empty.notify_all();
+    };
+    /*! Release all threads blocked on this queue after an error. */
+    void abort()
+    {
+      {
+        lock_guard<mutex> lock(m);
+        aborted=true;
+        q.clear();
+      }
+      not_empty.notify_all();
+      not_full.notify_all();
+    };
+    /*! Number of objects that have passed through the queue. */
+    long number_pushed(){return npush;};
+    /*! Average number of objects in the queue seen by push. */
+    double mean_occupancy()
+    {
+      if(npush<=0) return 0.0;
+      return ((double)occupancy_sum)/((double)npush);
+    };
+    size_t maximum_occupancy(){return max_occupancy;};
+    /*! Total time (s) upstream stage spent blocked on a full queue. */
+    double push_wait_time(){return push_wait;};
+  private:
+    deque<T> q;
+    size_t maxsize;
+    bool closed,aborted;
+    mutex m;
+    condition_variable not_empty,not_full;
+    long npush;
+    long occupancy_sum;
+    size_t max_occupancy;
+    double push_wait;
+};
+/*! \brief Abstract base class for one stage of a FusedPipeline.
+
+A stage is the in process equivalent of one of the seispp unix
+filter programs.   process is called once for each object in
+the input stream.   It may alter d in place and push it to out, push
+nothing, or push several objects.   finish is called once after
+the last object has been processed.   Stages that must see the entire
+stream (e.g. a sort) hold data in process and release it in finish.
+
+Each stage runs in its own thread, but only one thread ever calls
+the methods of a given stage so implementations need no locking.
+*/
+template <class T> class PipelineStage
+{
+  public:
+    virtual ~PipelineStage(){};
+    /*! Name used in diagnostics and the run summary */
+    virtual string name()=0;
+    virtual void process(T& d, FusedPipelineQueue<T>& out)=0;
+    virtual void finish(FusedPipelineQueue<T>& out){};
+};
+/*! \brief In process replacement for a unix pipeline of seispp filters.
+
+A chain of seispp programs connected by unix pipes serializes and
+deserializes every object between each pair of programs.   For
+simple processing steps that conversion is often the dominant
+cost.   This object runs the same processing steps as a chain of
+PipelineStage objects in one process.  The input stream is read
+once, objects are moved from stage to stage through bounded queues,
+and the final result is written once.  The reader, each stage, and the
+writer run in separate threads so, like a unix pipeline, all steps
+run concurrently.
+
+Usage is to construct, call add for each stage in the order they
+are to be applied, then call run.
+*/
+template <class T> class FusedPipeline
+{
+  public:
+    /*! Construct an empty pipeline.
+
+      \param queue_size is the capacity of each queue linking two
+        stages.  It sets the maximum number of objects in flight
+        between a pair of stages. */
+    FusedPipeline(int queue_size=4) : qsize(queue_size){};
+    /*! Append a stage to the pipeline.  The pipeline takes
+      ownership of the stage. */
+    void add(PipelineStage<T> *stage)
+    {
+      stages.push_back(shared_ptr<PipelineStage<T> >(stage));
+    };
+    int number_stages(){return stages.size();};
+    /*! Run the pipeline.
+
+      Objects are read from in until eof and the results written
+      to out.   Reader and Writer are normally StreamObjectReader
+      and StreamObjectWriter.
+
+      \return number of objects written.
+      \exception SeisppError or any other exception thrown by a
+        stage, the reader, or the writer is rethrown here after
+        all threads have been stopped. */
+    template <class Reader, class Writer> long run(Reader& in, Writer& out);
+    /*! Print a summary of the last run to ostream. */
+    void report(ostream& ofs);
+  private:
+    int qsize;
+    vector<shared_ptr<PipelineStage<T> > > stages;
+    vector<shared_ptr<FusedPipelineQueue<T> > > queues;
+    /* Per stage (index 0 is the reader) counts and busy time */
+    vector<long> nprocessed;
+    vector<double> busy;
+    long nwritten;
+    double elapsed;
+};
+template <class T> template <class Reader, class Writer>
+  long FusedPipeline<T>::run(Reader& in, Writer& out)
+{
+  int i;
+  int nst=stages.size();
+  queues.clear();
+  for(i=0;i<=nst;++i)
+    queues.push_back(shared_ptr<FusedPipelineQueue<T> >
+        (new FusedPipelineQueue<T>(qsize)));
+  nprocessed.assign(nst+1,0);
+  busy.assign(nst+1,0.0);
+  nwritten=0;
+  vector<exception_ptr> errors(nst+2);
+  chrono::steady_clock::time_point tstart=chrono::steady_clock::now();
+  /* Any failure stops every thread */
+  auto abort_all=[this]()
+  {
+    for(int k=0;k<queues.size();++k) queues[k]->abort();
+  };
+  vector<thread> threads;
+  threads.push_back(thread([&]()
+  {
+    try{
+      FusedPipelineQueue<T>& q(*(queues[0]));
+      while(!in.eof())
+      {
+        chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+        T d(in.read());
+        ++nprocessed[0];
+        bool ok=q.push(d);
+        busy[0] += chrono::duration<double>
+            (chrono::steady_clock::now()-t0).count();
+        if(!ok) break;
+      }
+      q.close();
+    }catch(...)
+    {
+      errors[0]=current_exception();
+      abort_all();
+    }
+  }));
+  for(i=0;i<nst;++i)
+  {
+    threads.push_back(thread([&,i]()
+    {
+      try{
+        FusedPipelineQueue<T>& qin(*(queues[i]));
+        FusedPipelineQueue<T>& qout(*(queues[i+1]));
+        T d;
+        while(qin.pop(d))
+        {
+          chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+          stages[i]->process(d,qout);
+          busy[i+1] += chrono::duration<double>
+              (chrono::steady_clock::now()-t0).count();
+          ++nprocessed[i+1];
+        }
+        chrono::steady_clock::time_point t0=chrono::steady_clock::now();
+        stages[i]->finish(qout);
+        busy[i+1] += chrono::duration<double>
+            (chrono::steady_clock::now()-t0).count();
+        qout.close();
+      }catch(...)
+      {
+        errors[i+1]=current_exception();
+        abort_all();
+      }
+    }));
+  }
+  /* The writer runs in this thread */
+  try{
+    FusedPipelineQueue<T>& q(*(queues[nst]));
+    T d;
+    while(q.pop(d))
+    {
+      out.write(d);
+      ++nwritten;
+    }
+  }catch(...)
+  {
+    errors[nst+1]=current_exception();
+    abort_all();
+  }
+  for(i=0;i<threads.size();++i) threads[i].join();
+  elapsed=chrono::duration<double>(chrono::steady_clock::now()-tstart).count();
+  for(i=0;i<errors.size();++i)
+    if(errors[i]) rethrow_exception(errors[i]);
+  return nwritten;
+}
+template <class T> void FusedPipeline<T>::report(ostream& ofs)
+{
+  int i;
+  ofs << "FusedPipeline summary:  elapsed time="<<elapsed
+    << " s, objects written="<<nwritten<<endl
+    << "stage name objects_in busy_time(s) blocked_on_output(s) "
+    << "output_queue_mean output_queue_max"<<endl;
+  for(i=0;i<queues.size();++i)
+  {
+    ofs << i << " ";
+    if(i==0)
+      ofs << "reader";
+    else
+      ofs << stages[i-1]->name();
+    ofs << " " << nprocessed[i]
+      << " " << busy[i]-queues[i]->push_wait_time()
+      << " " << queues[i]->push_wait_time()
+      << " " << queues[i]->mean_occupancy()
+      << " " << queues[i]->maximum_occupancy()<<endl;
+  }
+}
+} // End SEISPP namespace declaration
+#endif
@@ -0,0 +1,905 @@
+#ifndef _HEADER_COLUMN_TABLE_H_
+#define _HEADER_COLUMN_TABLE_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include "seispp_io.h"
+#include "parallel_for.h"
+#include "ObjectHeaders.h"
+#include "StreamObjectReader.h"
+#include "StreamObjectFileIndex.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/* This file implements bulk extraction of Metadata from files of
+serialized seispp objects into a table stored by columns.   It is
+designed for QC of header attributes on very large data sets where
+reading each object in full and printing Metadata one key at a time
+through iostreams (listhdr) is far too slow.   The main pieces are:
+
+HeaderColumn - defines one column (key, type, and value for undefined)
+HeaderColumnTable - a block of rows held in one typed buffer per column
+HeaderTableWriter - writes blocks as csv or as a binary column table
+HeaderExporter - scans files with the header only object types (see
+   ObjectHeaders.h) and feeds a writer.  Multiple files (e.g. the
+   members of a DataSetReader) are scanned in parallel.
+*/
+
+/*! Where the values of a HeaderColumn come from. */
+enum HeaderColumnSource {HCmetadata, /*!< Metadata attribute */
+  HCfile, /*!< Name of the file the object was read from */
+  HCobject  /*!< Object number in the file (from 0) */
+};
+/*! \brief Definition of one column of a header table. */
+class HeaderColumn
+{
+public:
+  /*! Metadata key to extract */
+  string key;
+  /*! Type of the attribute */
+  MDtype mdt;
+  /*! Value written when key is not defined for an object */
+  string undefined_value;
+  HeaderColumnSource source;
+  HeaderColumn() : mdt(MDstring),source(HCmetadata){};
+  HeaderColumn(const string k, const MDtype t, const string undef,
+      const HeaderColumnSource src=HCmetadata)
+    : key(k),mdt(t),undefined_value(undef),source(src){};
+};
+/*! \brief Parse a table of column definitions.
+
+The format is the same as the csv format file of listhdr:  one line
+per column with a key, a type name (real, double, float, int, long,
+boolean, or string), and the value to write when the key is not
+defined.  Blank lines and lines starting with # are ignored.
+
+\exception SeisppError is thrown if the file cannot be read or a
+  type name is not recognized. */
+inline vector<HeaderColumn> read_header_columns(const string fname)
+{
+  const string base_error("read_header_columns:  ");
+  ifstream ifs;
+  ifs.open(fname.c_str(),ios::in);
+  if(ifs.fail())
+    throw SeisppError(base_error+"open failed on file "+fname);
+  vector<HeaderColumn> result;
+  string line;
+  while(getline(ifs,line))
+  {
+    stringstream ss(line);
+    HeaderColumn c;
+    string tname;
+    ss>>c.key;
+    if(c.key.empty() || (c.key[0]=='#')) continue;
+    ss>>tname;
+    if( (tname=="double") || (tname=="MDreal") || (tname=="real")
+        || (tname=="float") )
+      c.mdt=MDreal;
+    else if( (tname=="int") || (tname=="MDint") || (tname=="long") )
+      c.mdt=MDint;
+    else if(tname=="boolean")
+      c.mdt=MDboolean;
+    else if( (tname=="string") || (tname=="String") || (tname=="MDstring") )
+      c.mdt=MDstring;
+    else
+      throw SeisppError(base_error+"Unrecognized type="+tname
+          +" for entry with key="+c.key+" in file "+fname);
+    ss>>c.undefined_value;
+    result.push_back(c);
+  }
+  if(result.empty())
+    throw SeisppError(base_error+"no column definitions found in "+fname);
+  return result;
+}
+/*! \brief A block of header rows stored by column.
+
+Each column has a buffer of the type of the attribute so no value
+is converted to text until (and unless) the block is written as csv.
+Strings are stored as a length per row and one concatenated block of
+characters.  Every column also has a flag per row that is 0 if the
+key was not defined for that row.   The value stored for an undefined
+entry is the column's undefined_value converted to the column type.
+*/
+class HeaderColumnTable
+{
+public:
+  /*! Typed storage for one column.  Only the buffer matching the
+    column type is used. */
+  class Column
+  {
+  public:
+    vector<double> rval;
+    vector<long> ival;
+    vector<char> bval;
+    vector<int32_t> slen;
+    string sval;
+    vector<char> defined;
+    void clear()
+    {
+      rval.clear(); ival.clear(); bval.clear();
+      slen.clear(); sval.clear(); defined.clear();
+    };
+  };
+  vector<HeaderColumn> definitions;
+  vector<Column> columns;
+  HeaderColumnTable(){nrows=0;};
+  HeaderColumnTable(const vector<HeaderColumn>& cols)
+    : definitions(cols),columns(cols.size())
+  {
+    nrows=0;
+    undef_r.resize(cols.size());
+    undef_i.resize(cols.size());
+    undef_b.resize(cols.size());
+    for(size_t i=0;i<cols.size();++i)
+    {
+      undef_r[i]=atof(cols[i].undefined_value.c_str());
+      undef_i[i]=atol(cols[i].undefined_value.c_str());
+      undef_b[i]=(cols[i].undefined_value=="true")
+        || (atol(cols[i].undefined_value.c_str())!=0);
+    }
+  };
+  /*! \brief Add one row.
+
+    \param md - Metadata from which attributes are extracted
+    \param fallback - if not NULL keys not defined in md are taken
+      from here.  Used to fill rows for ensemble members with
+      attributes of the ensemble.
+    \param fname - file name (used only by HCfile columns)
+    \param objnum - object number (used only by HCobject columns) */
+  void append(Metadata& md, Metadata *fallback, const string& fname,
+      long objnum)
+  {
+    for(size_t i=0;i<columns.size();++i)
+    {
+      Column& c(columns[i]);
+      const HeaderColumn& def(definitions[i]);
+      if(def.source==HCfile)
+      {
+        push_string(c,fname,true);
+        continue;
+      }
+      if(def.source==HCobject)
+      {
+        c.ival.push_back(objnum);
+        c.defined.push_back(1);
+        continue;
+      }
+      Metadata *src(NULL);
+      if(md.is_attribute_set(def.key))
+        src=&md;
+      else if((fallback!=NULL) && fallback->is_attribute_set(def.key))
+        src=fallback;
+      if(src==NULL)
+      {
+        push_undefined(i);
+        continue;
+      }
+      try{
+        switch(def.mdt)
+        {
+          case MDreal:
+            c.rval.push_back(src->get<double>(def.key));
+            c.defined.push_back(1);
+            break;
+          case MDint:
+            c.ival.push_back(src->get<long>(def.key));
+            c.defined.push_back(1);
+            break;
+          case MDboolean:
+            c.bval.push_back(src->get<bool>(def.key) ? 1 : 0);
+            c.defined.push_back(1);
+            break;
+          case MDstring:
+          default:
+            push_string(c,src->get<string>(def.key),true);
+        }
+      }catch(MetadataGetError& mderr)
+      {
+        /* Defined with a different type that cannot be converted */
+        push_undefined(i);
+      }
+    }
+    ++nrows;
+  };
+  long rows(){return nrows;};
+  /*! Set the row count after filling the column buffers directly */
+  void set_rows(long n){nrows=n;};
+  int number_columns(){return columns.size();};
+  /*! Remove all rows.  Buffer capacity is retained. */
+  void clear()
+  {
+    for(size_t i=0;i<columns.size();++i) columns[i].clear();
+    nrows=0;
+  };
+  /*! Reserve space for n rows */
+  void reserve(long n)
+  {
+    for(size_t i=0;i<columns.size();++i)
+    {
+      Column& c(columns[i]);
+      c.defined.reserve(n);
+      switch(definitions[i].mdt)
+      {
+        case MDreal:
+          c.rval.reserve(n);
+          break;
+        case MDint:
+          c.ival.reserve(n);
+          break;
+        case MDboolean:
+          c.bval.reserve(n);
+          break;
+        default:
+          c.slen.reserve(n);
+      }
+    }
+  };
+private:
+  long nrows;
+  vector<double> undef_r;
+  vector<long> undef_i;
+  vector<char> undef_b;
+  void push_string(Column& c, const string& s, bool isdef)
+  {
+    c.slen.push_back(s.size());
+    c.sval.append(s);
+    c.defined.push_back(isdef ? 1 : 0);
+  };
+  void push_undefined(size_t i)
+  {
+    Column& c(columns[i]);
+    switch(definitions[i].mdt)
+    {
+      case MDreal:
+        c.rval.push_back(undef_r[i]);
+        break;
+      case MDint:
+        c.ival.push_back(undef_i[i]);
+        break;
+      case MDboolean:
+        c.bval.push_back(undef_b[i]);
+        break;
+      case MDstring:
+      default:
+        push_string(c,definitions[i].undefined_value,false);
+        return;
+    }
+    c.defined.push_back(0);
+  };
+};
+/*! \brief Abstract base for writers of HeaderColumnTable blocks. */
+class HeaderTableWriter
+{
+public:
+  virtual ~HeaderTableWriter(){};
+  /*! Write all rows of t.  t is not altered. */
+  virtual void write(HeaderColumnTable& t)=0;
+  /*! Flush and finish the output.   Called once after the last write. */
+  virtual void close()=0;
+};
+/*! \brief Writes header tables as csv.
+
+Output follows listhdr -csv:  no header line by default, reals with
+13 significant figures, booleans as 0 or 1, and the undefined_value
+string for undefined entries.  Unlike listhdr, strings containing a
+comma, a double quote, or a newline are enclosed in double quotes
+with embedded quotes doubled so every row has the same number of
+fields.  Other strings are written unchanged, so output is identical
+to listhdr unless such strings occur.  Each block is formatted into
+memory and written with one call. */
+class CSVHeaderTableWriter : public HeaderTableWriter
+{
+public:
+  /*! \param os - output stream (must remain valid until close)
+    \param header_line - when true the first line is the column keys */
+  CSVHeaderTableWriter(ostream& os, bool header_line=false)
+    : out(&os),need_header(header_line){};
+  void write(HeaderColumnTable& t)
+  {
+    long nrows=t.rows();
+    int ncol=t.number_columns();
+    if(ncol<=0) return;
+    buf.clear();
+    if(need_header)
+    {
+      for(int j=0;j<ncol;++j)
+      {
+        if(j>0) buf.push_back(',');
+        buf.append(t.definitions[j].key);
+      }
+      buf.push_back('\n');
+      need_header=false;
+    }
+    vector<size_t> soff(ncol,0);
+    char field[64];
+    long i;
+    int j;
+    for(i=0;i<nrows;++i)
+    {
+      for(j=0;j<ncol;++j)
+      {
+        HeaderColumnTable::Column& c(t.columns[j]);
+        const HeaderColumn& def(t.definitions[j]);
+        if(j>0) buf.push_back(',');
+        if((def.source==HCmetadata) && !c.defined[i]
+            && (def.mdt!=MDstring))
+        {
+          buf.append(def.undefined_value);
+          continue;
+        }
+        switch(def.source==HCobject ? MDint : def.mdt)
+        {
+          case MDreal:
+            buf.append(field,snprintf(field,64,"%.13g",c.rval[i]));
+            break;
+          case MDint:
+            buf.append(field,snprintf(field,64,"%ld",c.ival[i]));
+            break;
+          case MDboolean:
+            buf.push_back(c.bval[i] ? '1' : '0');
+            break;
+          case MDstring:
+          default:
+            append_string(c.sval.data()+soff[j],c.slen[i]);
+            soff[j]+=c.slen[i];
+        }
+      }
+      buf.push_back('\n');
+    }
+    out->write(buf.data(),buf.size());
+    if(out->fail())
+      throw SeisppError("CSVHeaderTableWriter:  write error");
+  };
+  void close(){out->flush();};
+private:
+  ostream *out;
+  bool need_header;
+  string buf;
+  void append_string(const char *s, int n)
+  {
+    if(memchr(s,',',n)==NULL && memchr(s,'"',n)==NULL
+        && memchr(s,'\n',n)==NULL)
+    {
+      buf.append(s,n);
+      return;
+    }
+    buf.push_back('"');
+    for(int k=0;k<n;++k)
+    {
+      if(s[k]=='"') buf.push_back('"');
+      buf.push_back(s[k]);
+    }
+    buf.push_back('"');
+  };
+};
+/*! Magic string at the start of a binary header table file */
+const string HeaderTableMagic("SPHT");
+/*! \brief Writes header tables in a binary column format.
+
+The file begins with the magic string SPHT followed by the column
+definitions:  int32 number of columns, then for each column int32
+type (MDtype value), int32 source (HeaderColumnSource value), and the
+key and undefined_value each as an int32 length followed by the
+characters.   Then come any number of row groups, one per call to
+write.   A row group is an int64 row count n followed, for each
+column in order, by n bytes of defined flags and the values:  n
+doubles for reals, n int64 for ints (and object numbers), n bytes
+for booleans, and n int32 lengths followed by the concatenated
+characters for strings.   The file ends with an int64 0 and an int64
+total row count.
+
+Like the binary seispp object files these are written in native byte
+order and are not intended to be moved between machines with different
+architectures.   Each buffer is written with a single call so the cost
+is dominated by the bulk I/O.  */
+class BinaryHeaderTableWriter : public HeaderTableWriter
+{
+public:
+  /*! \param fname - output file name
+    \param cols - column definitions (must match all tables written)
+    \exception SeisppError is thrown if the file cannot be opened. */
+  BinaryHeaderTableWriter(const string fname, const vector<HeaderColumn>& cols)
+    : filename(fname),ncol(cols.size()),total_rows(0),closed(false)
+  {
+    ofs.open(fname.c_str(),ios::out | ios::binary | ios::trunc);
+    if(ofs.fail())
+      throw SeisppError(string("BinaryHeaderTableWriter:  open failed for ")
+          + fname);
+    ofs.write(HeaderTableMagic.c_str(),BINARY_TAG_SIZE);
+    put_int32(ncol);
+    for(int j=0;j<ncol;++j)
+    {
+      put_int32((int32_t)cols[j].mdt);
+      put_int32((int32_t)cols[j].source);
+      put_string(cols[j].key);
+      put_string(cols[j].undefined_value);
+    }
+  };
+  ~BinaryHeaderTableWriter()
+  {
+    if(!closed)
+    {
+      try{ this->close(); }catch(...){};
+    }
+  };
+  void write(HeaderColumnTable& t)
+  {
+    int64_t n=t.rows();
+    if(n<=0) return;
+    if(t.number_columns()!=ncol)
+      throw SeisppError(string("BinaryHeaderTableWriter:  ")
+          + "table does not match the column definitions of "+filename);
+    ofs.write((char*)(&n),sizeof(int64_t));
+    for(int j=0;j<ncol;++j)
+    {
+      HeaderColumnTable::Column& c(t.columns[j]);
+      ofs.write(&(c.defined[0]),n);
+      switch(t.definitions[j].source==HCobject ? MDint
+          : t.definitions[j].mdt)
+      {
+        case MDreal:
+          ofs.write((char*)(&(c.rval[0])),n*sizeof(double));
+          break;
+        case MDint:
+          write_int64(c.ival);
+          break;
+        case MDboolean:
+          ofs.write(&(c.bval[0]),n);
+          break;
+        case MDstring:
+        default:
+          ofs.write((char*)(&(c.slen[0])),n*sizeof(int32_t));
+          ofs.write(c.sval.data(),c.sval.size());
+      }
+    }
+    if(ofs.fail())
+      throw SeisppError(string("BinaryHeaderTableWriter:  write error on ")
+          + filename);
+    total_rows+=n;
+  };
+  void close()
+  {
+    if(closed) return;
+    int64_t zero(0);
+    ofs.write((char*)(&zero),sizeof(int64_t));
+    ofs.write((char*)(&total_rows),sizeof(int64_t));
+    ofs.close();
+    closed=true;
+    if(ofs.fail())
+      throw SeisppError(string("BinaryHeaderTableWriter:  close failed for ")
+          + filename);
+  };
+private:
+  ofstream ofs;
+  string filename;
+  int ncol;
+  int64_t total_rows;
+  bool closed;
+  void put_int32(int32_t i)
+  {
+    ofs.write((char*)(&i),sizeof(int32_t));
+  };
+  void put_string(const string& s)
+  {
+    put_int32(s.size());
+    ofs.write(s.data(),s.size());
+  };
+  void write_int64(vector<long>& x)
+  {
+    if(sizeof(long)==sizeof(int64_t))
+      ofs.write((char*)(&(x[0])),x.size()*sizeof(int64_t));
+    else
+    {
+      vector<int64_t> tmp(x.begin(),x.end());
+      ofs.write((char*)(&(tmp[0])),tmp.size()*sizeof(int64_t));
+    }
+  };
+};
+/*! \brief Reads a file written by BinaryHeaderTableWriter.
+
+Each call to read returns one row group. */
+class BinaryHeaderTableReader
+{
+public:
+  /*! \exception SeisppError is thrown if fname is not a header table. */
+  BinaryHeaderTableReader(const string fname) : filename(fname)
+  {
+    const string base_error("BinaryHeaderTableReader:  ");
+    ifs.open(fname.c_str(),ios::in | ios::binary);
+    if(ifs.fail())
+      throw SeisppError(base_error+"open failed for "+fname);
+    char tagbuf[BINARY_TAG_SIZE+1];
+    ifs.read(tagbuf,BINARY_TAG_SIZE);
+    tagbuf[BINARY_TAG_SIZE]='\0';
+    if(ifs.fail() || (string(tagbuf)!=HeaderTableMagic))
+      throw SeisppError(base_error+fname+" is not a binary header table");
+    int32_t ncol=get_int32();
+    for(int j=0;j<ncol;++j)
+    {
+      HeaderColumn c;
+      c.mdt=(MDtype)get_int32();
+      c.source=(HeaderColumnSource)get_int32();
+      c.key=get_string();
+      c.undefined_value=get_string();
+      cols.push_back(c);
+    }
+    if(ifs.fail())
+      throw SeisppError(base_error+"error reading column definitions from "
+          +fname);
+  };
+  /*! Return the column definitions saved in the file */
+  vector<HeaderColumn> column_definitions(){return cols;};
+  /*! \brief Read the next row group.
+
+    \param t - is replaced by the rows read.
+    \return number of rows read.   0 at end of file. */
+  long read(HeaderColumnTable& t)
+  {
+    const string base_error("BinaryHeaderTableReader::read:  ");
+    t=HeaderColumnTable(cols);
+    int64_t n;
+    ifs.read((char*)(&n),sizeof(int64_t));
+    if(ifs.fail())
+      throw SeisppError(base_error+"read error in "+filename);
+    if(n<=0) return 0;
+    for(size_t j=0;j<cols.size();++j)
+    {
+      HeaderColumnTable::Column& c(t.columns[j]);
+      c.defined.resize(n);
+      ifs.read(&(c.defined[0]),n);
+      switch(cols[j].source==HCobject ? MDint : cols[j].mdt)
+      {
+        case MDreal:
+          c.rval.resize(n);
+          ifs.read((char*)(&(c.rval[0])),n*sizeof(double));
+          break;
+        case MDint:
+          {
+            vector<int64_t> tmp(n);
+            ifs.read((char*)(&(tmp[0])),n*sizeof(int64_t));
+            c.ival.assign(tmp.begin(),tmp.end());
+          }
+          break;
+        case MDboolean:
+          c.bval.resize(n);
+          ifs.read(&(c.bval[0]),n);
+          break;
+        case MDstring:
+        default:
+          {
+            c.slen.resize(n);
+            ifs.read((char*)(&(c.slen[0])),n*sizeof(int32_t));
+            size_t nchar(0);
+            for(long i=0;i<n;++i) nchar+=c.slen[i];
+            c.sval.resize(nchar);
+            if(nchar>0) ifs.read(&(c.sval[0]),nchar);
+          }
+      }
+    }
+    if(ifs.fail())
+      throw SeisppError(base_error+"truncated row group in "+filename);
+    t.set_rows(n);
+    return n;
+  };
+private:
+  ifstream ifs;
+  string filename;
+  vector<HeaderColumn> cols;
+  int32_t get_int32()
+  {
+    int32_t i(0);
+    ifs.read((char*)(&i),sizeof(int32_t));
+    return i;
+  };
+  string get_string()
+  {
+    int32_t n=get_int32();
+    if(n<=0 || ifs.fail()) return string("");
+    string s(n,' ');
+    ifs.read(&(s[0]),n);
+    return s;
+  };
+};
+/* Add the rows for one object to t.   The generic version adds one row
+from the object's Metadata.   Ensembles add one row for the ensemble or,
+if expand is true, one row per member with undefined keys taken from
+the ensemble Metadata. */
+template <typename H> void append_header_rows(HeaderColumnTable& t, H& h,
+    bool expand, const string& fname, long objnum)
+{
+  t.append(dynamic_cast<Metadata&>(h),NULL,fname,objnum);
+}
+template <typename H> void append_ensemble_header_rows(HeaderColumnTable& t,
+    H& h, bool expand, const string& fname, long objnum)
+{
+  Metadata& ensmd(dynamic_cast<Metadata&>(h));
+  if(!expand)
+  {
+    t.append(ensmd,NULL,fname,objnum);
+    return;
+  }
+  for(size_t i=0;i<h.member.size();++i)
+    t.append(dynamic_cast<Metadata&>(h.member[i]),&ensmd,fname,objnum);
+}
+inline void append_header_rows(HeaderColumnTable& t,
+    TimeSeriesEnsembleHeader& h, bool expand, const string& fname,
+    long objnum)
+{
+  append_ensemble_header_rows(t,h,expand,fname,objnum);
+}
+inline void append_header_rows(HeaderColumnTable& t,
+    ThreeComponentEnsembleHeader& h, bool expand, const string& fname,
+    long objnum)
+{
+  append_ensemble_header_rows(t,h,expand,fname,objnum);
+}
+inline void append_header_rows(HeaderColumnTable& t, TimeSeriesEnsemble& h,
+    bool expand, const string& fname, long objnum)
+{
+  append_ensemble_header_rows(t,h,expand,fname,objnum);
+}
+inline void append_header_rows(HeaderColumnTable& t,
+    ThreeComponentEnsemble& h, bool expand, const string& fname, long objnum)
+{
+  append_ensemble_header_rows(t,h,expand,fname,objnum);
+}
+/*! \brief Bulk extraction of Metadata from files of seispp objects.
+
+Objects are read with the header only version of Tdata (see
+ObjectHeaders.h) so sample data are skipped with a seek instead of
+being deserialized.   Selected attributes of each object are appended
+to a HeaderColumnTable that is passed to a HeaderTableWriter each time
+it reaches the block size.
+
+Input files can be binary data files written by StreamObjectWriter or
+index files (extension idx) as used to build a DataSetReader.   For an
+index file, or a data file with an index under the default name, the
+rows are taken directly from the index when it contains every key the
+columns need and ensemble members are not being expanded.  Then the
+data file is not read at all.
+
+When more than one file is given the files are scanned in parallel.
+Output is always in the order of the file list.   Completed tables of
+files ahead of the one being written are held in memory, but no more
+than two per thread, so memory use is bounded.
+*/
+template <typename Tdata> class HeaderExporter
+{
+public:
+  /*! \param cols - columns to extract
+    \param expand - when true ensembles produce one row per member
+      (ignored for other types)
+    \param use_index - when true use an index if it has all the keys
+    \param block_size - number of rows buffered before a write */
+  HeaderExporter(const vector<HeaderColumn>& cols, bool expand=false,
+      bool use_index=true, long block_size=100000)
+    : columns(cols),expand_members(expand),allow_index(use_index),
+      blocksize(block_size){};
+  /*! \brief Export headers of objects read from a stream.
+
+    Used for stdin.  Binary input is scanned with the header only
+    objects, but samples must be read and discarded as a pipe cannot
+    seek.   Text input is read in full.
+    \return number of objects scanned */
+  long export_stream(istream& in, char format, HeaderTableWriter& out)
+  {
+    const string base_error("HeaderExporter::export_stream:  ");
+    const string sname("STDIN");
+    HeaderColumnTable t(columns);
+    t.reserve(blocksize);
+    long nobj(0);
+    try{
+      if(format=='t')
+      {
+        StreamObjectReader<Tdata> rd('t');
+        while(rd.good())
+        {
+          Tdata d=rd.read();
+          append_header_rows(t,d,expand_members,sname,nobj);
+          ++nobj;
+          flush_if_full(t,out);
+        }
+      }
+      else
+      {
+        boost::archive::binary_iarchive ar(in);
+        HeaderOnlyScope scope(in.rdbuf());
+        char tagbuf[BINARY_TAG_SIZE+1];
+        while(1)
+        {
+          Theader h;
+          ar>>h;
+          append_header_rows(t,h,expand_members,sname,nobj);
+          ++nobj;
+          flush_if_full(t,out);
+          in.read(tagbuf,BINARY_TAG_SIZE);
+          tagbuf[BINARY_TAG_SIZE]='\0';
+          if(in.fail() || (string(tagbuf)!=more_data_tag)) break;
+        }
+      }
+      out.write(t);
+    }catch(SeisppError& serr){throw;}
+    catch(...)
+    {
+      throw SeisppError(base_error + "boost serialization read failed on stdin\n"
+          + "Check that input is a valid boost binary serialization file");
+    }
+    return nobj;
+  };
+  /*! \brief Export headers from a list of files.
+
+    \param fnames - data or index files.
+    \param out - writer receiving the rows in file order
+    \param nthreads - number of files scanned concurrently.  0 means
+      the number of hardware threads.
+    \return number of objects scanned
+    \exception SeisppError is thrown (after all threads finish) if any
+      file cannot be read. */
+  long export_files(const list<string>& fnames, HeaderTableWriter& out,
+      int nthreads=0)
+  {
+    vector<string> files(fnames.begin(),fnames.end());
+    long nfiles=files.size();
+    long nobj(0);
+    if(nfiles<=0) return 0;
+    nthreads=parallel_thread_count(nthreads,nfiles);
+    if(nthreads==1)
+    {
+      HeaderColumnTable t(columns);
+      t.reserve(blocksize);
+      for(long i=0;i<nfiles;++i)
+        nobj+=scan_file(files[i],t,&out);
+      out.write(t);
+      return nobj;
+    }
+    /* Files are scanned by parallel_for.  The thread that completes
+    the next file due to be written writes it and any later files 
+    already done, so output is in file order.  No file is started
+    more than lookahead files past the last one written, which bounds
+    the number of tables held in memory. */
+    const long lookahead=2*nthreads;
+    vector<shared_ptr<HeaderColumnTable> > results(nfiles);
+    vector<long> counts(nfiles,0);
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool failed(false);
+    long nwritten(0);
+    parallel_for(nfiles,nthreads,[&](long i)
+    {
+      {
+        std::unique_lock<std::mutex> lck(mtx);
+        cv.wait(lck,[&]{return (i<nwritten+lookahead) || failed;});
+        if(failed) return;
+      }
+      try{
+        shared_ptr<HeaderColumnTable> t(new HeaderColumnTable(columns));
+        long n=scan_file(files[i],*t,NULL);
+        std::lock_guard<std::mutex> lck(mtx);
+        if(failed) return;
+        results[i]=t;
+        counts[i]=n;
+        while((nwritten<nfiles) && results[nwritten])
+        {
+          out.write(*(results[nwritten]));
+          nobj+=counts[nwritten];
+          results[nwritten].reset();
+          ++nwritten;
+        }
+      }catch(...)
+      {
+        {
+          std::lock_guard<std::mutex> lck(mtx);
+          failed=true;
+        }
+        cv.notify_all();
+        throw;
+      }
+      cv.notify_all();
+    });
+    return nobj;
+  };
+private:
+  typedef typename HeaderOnlyType<Tdata>::type Theader;
+  vector<HeaderColumn> columns;
+  bool expand_members;
+  bool allow_index;
+  long blocksize;
+  void flush_if_full(HeaderColumnTable& t, HeaderTableWriter& out)
+  {
+    if(t.rows()>=blocksize)
+    {
+      out.write(t);
+      t.clear();
+    }
+  };
+  /* True if every Metadata column key is in the first index entry */
+  bool index_has_keys(StreamObjectFileIndex<Tdata>& idx)
+  {
+    if(idx.index_size()<=0) return false;
+    for(size_t j=0;j<columns.size();++j)
+      if((columns[j].source==HCmetadata)
+          && !idx.index[0].is_attribute_set(columns[j].key)) return false;
+    return true;
+  };
+  /* Appends the rows of one file to t.   If out is not NULL full
+  blocks are written as they fill. */
+  long scan_file(const string fname, HeaderColumnTable& t,
+      HeaderTableWriter *out)
+  {
+    const string base_error("HeaderExporter:  ");
+    string dfile(fname);
+    string idxfile;
+    size_t pos=fname.rfind('.');
+    bool is_index=(pos!=string::npos)
+      && (fname.substr(pos+1)==IndexFileExtension);
+    if(is_index)
+      idxfile=fname;
+    else if(allow_index)
+    {
+      idxfile=index_file_name(fname);
+      if(access(idxfile.c_str(),R_OK)!=0) idxfile.clear();
+    }
+    if(!idxfile.empty())
+    {
+      StreamObjectFileIndex<Tdata> idx;
+      idx.readindex(idxfile);
+      if(is_index) dfile=idx.data_file_name();
+      if(allow_index && !expand_members && index_has_keys(idx))
+      {
+        long n=idx.index_size();
+        for(long i=0;i<n;++i)
+        {
+          t.append(idx.index[i],NULL,dfile,i);
+          if(out!=NULL) flush_if_full(t,*out);
+        }
+        return n;
+      }
+    }
+    ifstream ifs;
+    ifs.open(dfile.c_str(),ios::in | ios::binary);
+    if(ifs.fail())
+      throw SeisppError(base_error+"cannot open file "+dfile+" for input");
+    char tagbuf[BINARY_TAG_SIZE+1];
+    long nobjects;
+    ifs.seekg(-(BinaryIOStreamEOFOffset),ios_base::end);
+    ifs.read(tagbuf,BINARY_TAG_SIZE);
+    tagbuf[BINARY_TAG_SIZE]='\0';
+    ifs.read((char*)(&nobjects),sizeof(long));
+    if(ifs.fail() || (string(tagbuf)!=eof_tag))
+      throw SeisppError(base_error + "File "
+          + dfile + " does not appear to be a valid seispp boost serialization file");
+    ifs.seekg(0,ios::beg);
+    try{
+      boost::archive::binary_iarchive ar(ifs);
+      HeaderOnlyScope scope(ifs.rdbuf());
+      for(long i=0;i<nobjects;++i)
+      {
+        Theader h;
+        ar>>h;
+        append_header_rows(t,h,expand_members,dfile,i);
+        if(out!=NULL) flush_if_full(t,*out);
+        ifs.read(tagbuf,BINARY_TAG_SIZE);
+        if(ifs.fail())
+          throw SeisppError(base_error + "read error in file "+dfile);
+      }
+    }catch(SeisppError& serr){throw;}
+    catch(...)
+    {
+      throw SeisppError(base_error + "boost serialization read failed scanning file "
+          + dfile + "\nFile may be truncated or contain objects of a different type");
+    }
+    return nobjects;
+  };
+};
+} // End SEISPP namespace
+#endif
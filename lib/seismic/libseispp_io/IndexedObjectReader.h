@@ -6,6 +6,7 @@
 #include "BasicObjectReader.h"
 #include "seispp_io.h"
 #include "StreamObjectFileIndex.h"
+#include "BlockObjectReader.h"
 namespace SEISPP{
 using namespace std;
 using namespace SEISPP;
@@ -33,7 +34,14 @@ constructors for the serialization handle creates a seg fault when the
 destructor in this object is called AFTER the rewind method is called.  
 It will exit find if the file is read sequentially and it is not necessary
 to call rewind.  
-constructor to define the index */
+constructor to define the index 
+
+Files written by BlockObjectWriter carry their own index.   For them
+the constructor is called with the data file name and format 'z'.  
+The index is then loaded from the footer of the data file and no
+separate index file or index pass is needed.  The rewind problem noted
+above does not apply to block files as every object has its own
+archive.*/
 template <typename Tdata>
     class IndexedObjectReader : BasicObjectReader<Tdata>
 {
@@ -47,7 +55,10 @@ public:
   that file can be gleaned from the code and will likely evolve as this
   object is extended.
 
-  \param indexfile is the file containing the index database
+  \param indexfile is the file containing the index database.  When
+     form is 'z' this is the block compressed data file itself.
+  \param form is 'b' for a binary stream file with separate index
+     or 'z' for a block compressed file with embedded index.
   */
   IndexedObjectReader(const string indexfile,const char form='b');
   /*! \brief Standard copy constructor.
@@ -104,6 +115,7 @@ public:
      (string key1, string key2=string(), string key3=string());*/
   bool good()
   {
+    if(format=='z') return !(this->eof());
     return dfs->good();
   };
   long number_available()
@@ -129,6 +141,9 @@ private:
   allow copying */
   std::shared_ptr<std::ifstream> dfs;
   std::shared_ptr<boost::archive::binary_iarchive> data_arptr;
+  /* Used instead of dfs and data_arptr when format is 'z'.  In that
+  case idx.foff holds object numbers in the block file, not offsets. */
+  std::shared_ptr<BlockObjectReader<Tdata> > blockreader;
   StreamObjectFileIndex<Tdata> idx;
   long last_object_read;
   /* this state variable is set on first read.   We need to make it illegal
@@ -150,45 +165,20 @@ template <typename Tdata>
     /* Initialize these */
     last_object_read=-1;
     sorting_allowed=true;
-    ifstream ifs;
-    ifs.open(indexfile.c_str(),ios::in);
-    if(ifs.fail())
-    {
-      throw SeisppError(base_error+"cannot open file "+indexfile+" for input");
-    }
-    /* These entries are in index data file, but we don't actually need to
-    store them.*/
-
-    ifs>>number_objects;
-    ifs>>fname;
-    string tname;
-    ifs>>tname;
-    if(typeid(Tdata).name() != tname)
-    {
-      throw SeisppError(base_error+"type mismatch in data file\n"
-         + "Expected object type="+typeid(Tdata).name()
-         + " but index given is to a file of objects of type="+tname);
-    }
-    /* Now we read in the index saved as a vector of Metadata objects */
-    boost::archive::text_iarchive ia(ifs);
-    int i;
-    idx.index.reserve(number_objects);
-    idx.foff.reserve(number_objects);
-    for(i=0;i<number_objects;++i)
+    if(format=='z')
     {
-      Metadata mdin;
-      long thisoffset;
-      ia>>mdin;
-      idx.index.push_back(mdin);
-      try{
-        thisoffset=mdin.get<long>("foff");
-        idx.foff.push_back(thisoffset);
-      }catch(MetadataGetError& mde)
-      {
-        throw SeisppError(base_error+"Error in index data\nRequired attribute foff missing");
-      }
+      blockreader=shared_ptr<BlockObjectReader<Tdata> >
+                (new BlockObjectReader<Tdata>(indexfile));
+      fname=indexfile;
+      number_objects=blockreader->number_available();
+      idx.index=blockreader->index();
+      idx.foff.reserve(number_objects);
+      long i;
+      for(i=0;i<number_objects;++i) idx.foff.push_back(i);
+      return;
     }
-    ifs.close();
+    number_objects=idx.readindex(indexfile);
+    fname=idx.data_file_name();
     dfs=shared_ptr<std::ifstream>(new std::ifstream);
     /* Note the format determines whether or not the data file is text or
     binary serialized data.   Note an internet source
@@ -219,6 +209,7 @@ template <typename Tdata>
 {
   format=parent.format;
   dfs=parent.dfs;
+  blockreader=parent.blockreader;
   data_arptr=parent.data_arptr;
   idx=parent.idx;
   last_object_read=parent.last_object_read;
@@ -232,7 +223,7 @@ template <typename Tdata>
 template <typename Tdata>
   IndexedObjectReader<Tdata>::~IndexedObjectReader()
 {
-    if(dfs.use_count()<=1) dfs->close();
+    if(dfs && (dfs.use_count()<=1)) dfs->close();
 }
 template <typename Tdata>
   IndexedObjectReader<Tdata>& IndexedObjectReader<Tdata>::operator=(const IndexedObjectReader& parent)
@@ -241,6 +232,7 @@ template <typename Tdata>
   {
     format=parent.format;
     dfs=parent.dfs;
+    blockreader=parent.blockreader;
     data_arptr=parent.data_arptr;
     idx=parent.idx;
     last_object_read=parent.last_object_read;
@@ -268,6 +260,8 @@ template <typename Tdata>
     {
       throw SeisppError(base_error + "Attempt to read past end of data set");
     }
+    if(format=='z')
+      return blockreader->read(this->idx.foff[last_object_read]);
     long offset=this->idx.foff[last_object_read];
     dfs->seekg(offset,ios::beg);
     if(dfs->bad())
@@ -295,6 +289,12 @@ template <typename Tdata>
     {
       throw SeisppError(base_error + "Requested object number past end of data set");
     }
+    if(format=='z')
+    {
+      d=blockreader->read(this->idx.foff[onum]);
+      last_object_read=onum;
+      return d;
+    }
     /* This conditional is necessary to handle a bug in how boost serialization
      * currently interacts with istream.   This conditionis a subset of 
      * the concept of rewind so it is handled with rewind that deals with
@@ -328,6 +328,11 @@ template <typename Tdata>
 template<typename Tdata> void IndexedObjectReader<Tdata>::rewind()
 {
   try{
+    if(format=='z')
+    {
+      last_object_read=-1;
+      return;
+    }
     dfs->close();
     dfs->open(fname.c_str(),ios::in | ios::binary);
     boost::archive::binary_iarchive *ptr;
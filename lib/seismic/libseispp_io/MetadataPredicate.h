@@ -0,0 +1,160 @@
+#ifndef _METADATA_PREDICATE_H_
+#define _METADATA_PREDICATE_H_
+#include <stdlib.h>
+#include <string>
+#include <list>
+#include <memory>
+#include "Metadata.h"
+#include "SeisppError.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Abstract base class for a test on Metadata.
+
+Predicates are used by readers to select objects by testing their
+headers (Metadata) before the sample data are loaded.  See
+SelectiveObjectReader.   Concrete predicates are a test on one key
+(MetadataKeyTest) and and/or/not combinations of other predicates.
+*/
+class MetadataPredicate
+{
+public:
+  virtual ~MetadataPredicate(){};
+  /*! Return true if md passes the test.
+
+    \exception MetadataGetError may be thrown if a key required by
+      the test is not defined in md. */
+  virtual bool operator()(const Metadata& md) const=0;
+  /*! Return the list of keys the test uses.  Readers use this to
+    decide if an index contains everything needed to evaluate
+    the test. */
+  virtual list<string> keys() const=0;
+};
+/*! Comparison operators supported by MetadataKeyTest. */
+enum MetadataTestOperator {MDTeq, MDTne, MDTmin, MDTmax, MDTrange};
+/*! \brief Test of the value of one Metadata attribute.
+
+The test is defined by a key, the type of the attribute, an operator,
+and one or two values (two only for MDTrange).  Values are passed as
+strings and converted to the attribute type.   Range tests are
+inclusive.  MDTmin passes values greater than or equal to the value
+and MDTmax passes values less than or equal to the value.
+*/
+class MetadataKeyTest : public MetadataPredicate
+{
+public:
+  MetadataKeyTest(const string k, const MDtype t, const MetadataTestOperator o,
+      const string v1, const string v2=string(""))
+    : key(k),mdt(t),op(o),sval1(v1),sval2(v2)
+  {
+    switch(mdt)
+    {
+      case MDint:
+        ival1=atol(v1.c_str());
+        ival2=atol(v2.c_str());
+        break;
+      case MDreal:
+        rval1=atof(v1.c_str());
+        rval2=atof(v2.c_str());
+        break;
+      case MDstring:
+        break;
+      default:
+        throw SeisppError(string("MetadataKeyTest constructor:  ")
+            + "only int, real, or string attributes can be tested");
+    };
+  };
+  bool operator()(const Metadata& md) const
+  {
+    switch(mdt)
+    {
+      case MDint:
+        return compare<long>(md.get<long>(key),ival1,ival2);
+      case MDreal:
+        return compare<double>(md.get<double>(key),rval1,rval2);
+      case MDstring:
+      default:
+        return compare<string>(md.get<string>(key),sval1,sval2);
+    };
+  };
+  list<string> keys() const
+  {
+    list<string> result;
+    result.push_back(key);
+    return result;
+  };
+private:
+  string key;
+  MDtype mdt;
+  MetadataTestOperator op;
+  string sval1,sval2;
+  long ival1,ival2;
+  double rval1,rval2;
+  template <typename T> bool compare(const T val, const T& v1,
+      const T& v2) const
+  {
+    switch(op)
+    {
+      case MDTeq:
+        return val==v1;
+      case MDTne:
+        return !(val==v1);
+      case MDTmin:
+        return !(val<v1);
+      case MDTmax:
+        return !(v1<val);
+      case MDTrange:
+      default:
+        return (!(val<v1)) && (!(v2<val));
+    };
+  };
+};
+/*! \brief Logical and/or of two predicates. */
+class MetadataCompoundTest : public MetadataPredicate
+{
+public:
+  /*! \param a - left hand side of test (evaluated first)
+      \param b - right hand side of test
+      \param use_and - when true the test is a and b.  Otherwise
+        a or b.   As in C evaluation stops when the result is
+        known so b is not tested (and b's keys need not be
+        present) if a decides the result. */
+  MetadataCompoundTest(shared_ptr<MetadataPredicate> a,
+      shared_ptr<MetadataPredicate> b, bool use_and)
+    : lhs(a),rhs(b),is_and(use_and){};
+  bool operator()(const Metadata& md) const
+  {
+    if(is_and)
+      return (*lhs)(md) && (*rhs)(md);
+    else
+      return (*lhs)(md) || (*rhs)(md);
+  };
+  list<string> keys() const
+  {
+    list<string> result=lhs->keys();
+    list<string> k2=rhs->keys();
+    result.splice(result.end(),k2);
+    return result;
+  };
+private:
+  shared_ptr<MetadataPredicate> lhs,rhs;
+  bool is_and;
+};
+/*! \brief Logical negation of a predicate. */
+class MetadataNotTest : public MetadataPredicate
+{
+public:
+  MetadataNotTest(shared_ptr<MetadataPredicate> a) : p(a){};
+  bool operator()(const Metadata& md) const
+  {
+    return !((*p)(md));
+  };
+  list<string> keys() const
+  {
+    return p->keys();
+  };
+private:
+  shared_ptr<MetadataPredicate> p;
+};
+} // End SEISPP namespace
+#endif
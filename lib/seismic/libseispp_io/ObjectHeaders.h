@@ -0,0 +1,344 @@
+#ifndef _OBJECT_HEADERS_H_
+#define _OBJECT_HEADERS_H_
+#include <string.h>
+#include <streambuf>
+#include <vector>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/collection_size_type.hpp>
+#include "seispp.h"
+#include "ensemble.h"
+#include "MetadataPredicate.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/* This file defines "header only" versions of the standard seispp data
+objects.   Each has a serialize method that matches the boost archive
+layout of the parent object exactly, but skips the sample data instead
+of loading them.   Reading one of these from a binary archive written
+with the parent type leaves the stream positioned at the end of the
+object, so they can be used to scan a file of large objects for
+Metadata without the cost of allocating and copying the samples.
+
+They are only valid for input.   Their save side is intentionally
+not defined.
+
+The skip is done with a seek on the streambuf attached to the archive
+when the caller registers it with a HeaderOnlyScope object.  Otherwise
+(or if the stream cannot seek, as for a pipe) the sample bytes are read
+into a scratch buffer and discarded.
+
+The same types can also load the samples of selected objects.  When a
+SampleLoadScope is active each top level object decides, after its
+Metadata are loaded and before any samples are read, whether to load
+or skip its samples.   Members of an ensemble follow the decision made
+for the ensemble.   header_to_object converts a header object with
+samples loaded to the parent type.  This is what allows a reader
+to test a predicate on the header and pay for the samples only when
+the test passes (see SelectiveObjectReader.h).  */
+
+/*! \brief Registers the streambuf a header only read should seek on.
+
+Construct one of these on the stack before reading header objects
+from an archive built on sb.   The setting is thread local so multiple
+files can be scanned concurrently in different threads.  */
+class HeaderOnlyScope
+{
+public:
+  HeaderOnlyScope(std::streambuf *sb)
+  {
+    previous=current_streambuf();
+    current_streambuf()=sb;
+  };
+  ~HeaderOnlyScope()
+  {
+    current_streambuf()=previous;
+  };
+  static std::streambuf*& current_streambuf()
+  {
+    static thread_local std::streambuf *sbptr(NULL);
+    return sbptr;
+  };
+private:
+  std::streambuf *previous;
+};
+/*! \brief Enables loading of samples by the header only types.
+
+While one of these is in scope (in the same thread) the header types
+below load the samples of any object for which pred returns true.
+A NULL pred means load the samples of every object.  The decision
+for the last top level object read is returned by samples_loaded. */
+class SampleLoadScope
+{
+public:
+  SampleLoadScope(const MetadataPredicate *pred)
+  {
+    previous=state();
+    state().active=true;
+    state().pred=pred;
+    state().depth=0;
+    state().decision=false;
+  };
+  ~SampleLoadScope()
+  {
+    state()=previous;
+  };
+  /*! Clear the decision state.  Readers call this before each object
+    so an exception thrown inside a read cannot leave stale state. */
+  static void reset()
+  {
+    state().depth=0;
+    state().decision=false;
+  };
+  static bool samples_loaded(){return state().decision;};
+  /* Called by each header type after its Metadata are loaded.   The
+  outermost object evaluates the predicate.   Objects nested inside it
+  inherit that result. */
+  static bool begin(const Metadata& md)
+  {
+    State& st(state());
+    if(!st.active) return false;
+    if(st.depth==0)
+    {
+      if(st.pred==NULL)
+        st.decision=true;
+      else
+        st.decision=(*(st.pred))(md);
+    }
+    ++st.depth;
+    return st.decision;
+  };
+  /* Decision for data nested inside an object that has called begin */
+  static bool nested()
+  {
+    State& st(state());
+    return st.active && (st.depth>0) && st.decision;
+  };
+  static void end()
+  {
+    State& st(state());
+    if(st.active && (st.depth>0)) --st.depth;
+  };
+private:
+  struct State
+  {
+    bool active;
+    const MetadataPredicate *pred;
+    int depth;
+    bool decision;
+  };
+  static State& state()
+  {
+    static thread_local State st={false,NULL,0,false};
+    return st;
+  };
+  State previous;
+};
+/* Mirror of the optimized boost load of a vector of an arithmetic
+type.  Must be kept consistent with boost/serialization/vector.hpp */
+template <class Archive,typename T> void skip_sample_vector(Archive& ar)
+{
+  boost::serialization::collection_size_type count;
+  ar >> count;
+  if(BOOST_SERIALIZATION_VECTOR_VERSIONED(ar.get_library_version()))
+  {
+    unsigned int item_version;
+    ar >> item_version;
+  }
+  size_t nbytes=sizeof(T)*count;
+  if(nbytes<=0) return;
+  std::streambuf *sb=HeaderOnlyScope::current_streambuf();
+  if(sb!=NULL)
+  {
+    if(sb->pubseekoff(nbytes,ios_base::cur,ios_base::in)>=0) return;
+  }
+  /* Not seekable - read and discard in pieces */
+  const size_t chunk(1048576);
+  vector<char> scratch(min(nbytes,chunk));
+  while(nbytes>0)
+  {
+    size_t n=min(nbytes,chunk);
+    ar.load_binary(&(scratch[0]),n);
+    nbytes-=n;
+  }
+}
+/* Loads a vector of samples if load is true and skips it otherwise */
+template <class Archive,typename T> void load_or_skip_samples(Archive& ar,
+    vector<T>& x, bool load)
+{
+  if(load)
+    ar & x;
+  else
+  {
+    x.clear();
+    skip_sample_vector<Archive,T>(ar);
+  }
+}
+/*! Header only version of a dmatrix.   Retains only the size unless
+samples are loaded (see SampleLoadScope).  */
+class dmatrixHeader
+{
+public:
+  int nrr,ncc,length;
+  /* Matrix values in dmatrix order.  Empty unless loaded. */
+  vector<double> ary;
+  dmatrixHeader(){nrr=0;ncc=0;length=0;};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>void serialize(Archive & ar,
+      const unsigned int version)
+  {
+    ar & nrr & ncc & length;
+    load_or_skip_samples<Archive,double>(ar,ary,SampleLoadScope::nested());
+  };
+};
+/*! Header only version of a TimeSeries */
+class TimeSeriesHeader : public Metadata, public BasicTimeSeries
+{
+public:
+  /* Samples - empty unless loaded */
+  vector<double> s;
+  void zero_gaps(){};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>void serialize(Archive & ar,
+      const unsigned int version)
+  {
+    ar & boost::serialization::base_object<Metadata>(*this);
+    ar & boost::serialization::base_object<BasicTimeSeries>(*this);
+    load_or_skip_samples<Archive,double>(ar,s,SampleLoadScope::begin(*this));
+    SampleLoadScope::end();
+  };
+};
+/*! Header only version of a ThreeComponentSeismogram */
+class ThreeComponentSeismogramHeader : public Metadata, public BasicTimeSeries
+{
+public:
+  bool components_are_orthogonal;
+  bool components_are_cardinal;
+  double tmatrix[3][3];
+  dmatrixHeader u;
+  void zero_gaps(){};
+private:
+  friend class boost::serialization::access;
+  template<class Archive>void serialize(Archive & ar,
+      const unsigned int version)
+  {
+    ar & boost::serialization::base_object<Metadata>(*this);
+    SampleLoadScope::begin(*this);
+    ar & boost::serialization::base_object<BasicTimeSeries>(*this);
+    ar & components_are_orthogonal & components_are_cardinal;
+    ar & tmatrix;
+    ar & u;
+    SampleLoadScope::end();
+  };
+};
+/*! Header only version of a TimeSeriesEnsemble.  Member Metadata
+are retained. */
+class TimeSeriesEnsembleHeader : public Metadata
+{
+public:
+  vector<TimeSeriesHeader> member;
+private:
+  friend class boost::serialization::access;
+  template<class Archive>void serialize(Archive & ar,
+      const unsigned int version)
+  {
+    ar & boost::serialization::base_object<Metadata>(*this);
+    SampleLoadScope::begin(*this);
+    ar & member;
+    SampleLoadScope::end();
+  };
+};
+/*! Header only version of a ThreeComponentEnsemble.  Member Metadata
+are retained. */
+class ThreeComponentEnsembleHeader : public Metadata
+{
+public:
+  vector<ThreeComponentSeismogramHeader> member;
+private:
+  friend class boost::serialization::access;
+  template<class Archive>void serialize(Archive & ar,
+      const unsigned int version)
+  {
+    ar & boost::serialization::base_object<Metadata>(*this);
+    SampleLoadScope::begin(*this);
+    ar & member;
+    SampleLoadScope::end();
+  };
+};
+/*! \brief Convert a header object to its parent type.
+
+Used after reading an object whose samples were loaded (see
+SampleLoadScope).   Sample vectors are moved from h when the layouts
+match, so h should be treated as invalid after the call.   The
+template version is for types that are their own header type. */
+template <typename T> void header_to_object(T& h, T& d)
+{
+  d=h;
+}
+inline void header_to_object(TimeSeriesHeader& h, TimeSeries& d)
+{
+  dynamic_cast<Metadata&>(d)=dynamic_cast<Metadata&>(h);
+  dynamic_cast<BasicTimeSeries&>(d)=dynamic_cast<BasicTimeSeries&>(h);
+  d.s.swap(h.s);
+}
+inline void header_to_object(ThreeComponentSeismogramHeader& h,
+    ThreeComponentSeismogram& d)
+{
+  dynamic_cast<Metadata&>(d)=dynamic_cast<Metadata&>(h);
+  dynamic_cast<BasicTimeSeries&>(d)=dynamic_cast<BasicTimeSeries&>(h);
+  d.components_are_orthogonal=h.components_are_orthogonal;
+  d.components_are_cardinal=h.components_are_cardinal;
+  int i,j;
+  for(i=0;i<3;++i)
+    for(j=0;j<3;++j) d.tmatrix[i][j]=h.tmatrix[i][j];
+  d.u=dmatrix(h.u.nrr,h.u.ncc);
+  size_t n=min(h.u.ary.size(),(size_t)(h.u.nrr*h.u.ncc));
+  if(n>0) memcpy(d.u.get_address(0,0),&(h.u.ary[0]),n*sizeof(double));
+  h.u.ary.clear();
+}
+inline void header_to_object(TimeSeriesEnsembleHeader& h,
+    TimeSeriesEnsemble& d)
+{
+  dynamic_cast<Metadata&>(d)=dynamic_cast<Metadata&>(h);
+  d.member.clear();
+  d.member.resize(h.member.size());
+  for(size_t i=0;i<h.member.size();++i)
+    header_to_object(h.member[i],d.member[i]);
+}
+inline void header_to_object(ThreeComponentEnsembleHeader& h,
+    ThreeComponentEnsemble& d)
+{
+  dynamic_cast<Metadata&>(d)=dynamic_cast<Metadata&>(h);
+  d.member.clear();
+  d.member.resize(h.member.size());
+  for(size_t i=0;i<h.member.size();++i)
+    header_to_object(h.member[i],d.member[i]);
+}
+/*! \brief Maps a data object type to its header only version.
+
+The default maps a type to itself, which means the full object is
+deserialized.   Specializations exist for the core seispp objects.
+Add a specialization for any other object type with a large payload. */
+template <typename T> struct HeaderOnlyType
+{
+  typedef T type;
+};
+template <> struct HeaderOnlyType<TimeSeries>
+{
+  typedef TimeSeriesHeader type;
+};
+template <> struct HeaderOnlyType<ThreeComponentSeismogram>
+{
+  typedef ThreeComponentSeismogramHeader type;
+};
+template <> struct HeaderOnlyType<TimeSeriesEnsemble>
+{
+  typedef TimeSeriesEnsembleHeader type;
+};
+template <> struct HeaderOnlyType<ThreeComponentEnsemble>
+{
+  typedef ThreeComponentEnsembleHeader type;
+};
+} // End SEISPP namespace
+#endif
@@ -0,0 +1,460 @@
+#ifndef _SELECTIVE_OBJECT_READER_H_
+#define _SELECTIVE_OBJECT_READER_H_
+#include <unistd.h>
+#include <iostream>
+#include <fstream>
+#include <memory>
+#include <type_traits>
+#include "seispp_io.h"
+#include "MetadataPredicate.h"
+#include "ObjectHeaders.h"
+#include "StreamObjectReader.h"
+#include "StreamObjectFileIndex.h"
+namespace SEISPP{
+using namespace std;
+using namespace SEISPP;
+/*! \brief Sequential reader that returns only objects passing a header test.
+
+Most seispp filters that select a subset of a data set only need the
+Metadata of each object to make the decision.   This reader pushes the
+test down into deserialization.   Each object is read with the header
+only version of its type (see ObjectHeaders.h).  The predicate is
+evaluated as soon as the Metadata are loaded.   Samples of objects
+that pass are loaded; samples of objects that fail are skipped with a
+seek (or read and discarded if the input is a pipe).
+
+When reading a named binary file that has an index (built by
+StreamObjectFileIndex with the default index file name) that
+contains every key the predicate uses, the predicate is evaluated on
+the index and only matching objects are read.  Then the cost of
+selecting a small fraction of a large file is close to that fraction
+of the I/O.   The exception is the start of the file:  boost
+serialization requires objects to be read in order until every class
+they can contain has appeared, so the headers of objects before that
+point are read even if they are not selected.
+
+Text format input and types without a header only version are read
+in full and tested afterward.
+*/
+template <typename T> class SelectiveObjectReader
+{
+public:
+  /*! \brief Read from stdin.
+
+    \param pred - predicate an object's Metadata must pass to be
+       returned.  For ensembles the test is applied to the ensemble
+       Metadata.
+    \param format - 'b' for binary (default) or 't' for text. */
+  SelectiveObjectReader(shared_ptr<MetadataPredicate> pred,
+      const char format='b');
+  /*! \brief Read from a file.
+
+    \param fname - data file name
+    \param pred - selection predicate
+    \param format - 'b' for binary (default) or 't' for text.
+    \param use_index - when true (default) use an index file if one
+      exists and contains all the keys pred needs. */
+  SelectiveObjectReader(const string fname,
+      shared_ptr<MetadataPredicate> pred, const char format='b',
+      bool use_index=true);
+  ~SelectiveObjectReader();
+  /*! \brief Get the next object that passes the test.
+
+    \param d - is set to the object read when the return is true.
+    \return true if an object was found, false at end of data.
+    \exception SeisppError is thrown for read errors or if the
+      predicate cannot be evaluated (e.g. missing key). */
+  bool next(T& d);
+  /*! Number of objects tested so far. */
+  long number_scanned(){return nscanned;};
+  /*! Number of objects returned so far. */
+  long number_selected(){return nselected;};
+  /*! True if selections are being made from an index. */
+  bool using_index(){return indexed;};
+private:
+  typedef typename HeaderOnlyType<T>::type Theader;
+  shared_ptr<MetadataPredicate> test;
+  char format;
+  bool input_is_stdio;
+  string fname;
+  ifstream ifs;
+  istream *in;
+  boost::archive::binary_iarchive *bin_ar;
+  /* Text input is read in full with a StreamObjectReader */
+  shared_ptr<StreamObjectReader<T> > txtreader;
+  long nobjects;
+  long nscanned;
+  long nselected;
+  bool more_data_available;
+  /* Index related.   Objects are located by seeks when indexed. */
+  bool indexed;
+  StreamObjectFileIndex<T> idx;
+  long next_index;
+  /* Boost writes class information only with the first instance of
+  each class in an archive.   Until the archive has read every class
+  an object can contain (see archive_classes below) objects are read
+  sequentially from the start of the file rather than seeked to.
+  nsequential is the number of objects read that way and classes_seen
+  holds the classes they exposed. */
+  long nsequential;
+  unsigned int classes_seen;
+  bool primed;
+  void open_archive();
+  bool read_header(Theader& h, const MetadataPredicate *pred);
+  void skip_header(Theader& h);
+  void advance(long last);
+  bool read_sequential(T& d);
+  bool read_indexed(T& d);
+};
+/* Boost writes the class information for a type inside the first
+object in the archive that contains an instance of it.   Most of the
+classes in a seispp object appear in every object, but the elements
+of containers do not:  the pairs of each Metadata map, the TimeWindow
+of a gap list, and the members of an ensemble first appear in whichever
+object first has that container not empty.   An archive can only be
+positioned at an arbitrary object after it has read all of these.
+The functions below return the bits for the element classes an object
+exposes.   Types without a header only version are never considered
+complete so they are always read sequentially. */
+const unsigned int ArchiveRealClass(1);
+const unsigned int ArchiveIntClass(2);
+const unsigned int ArchiveBoolClass(4);
+const unsigned int ArchiveStringClass(8);
+const unsigned int ArchiveGapClass(16);
+const unsigned int ArchiveMemberClass(32);
+const unsigned int ArchiveSeriesClasses(31);
+const unsigned int ArchiveEnsembleClasses(63);
+inline unsigned int metadata_classes(Metadata& md)
+{
+  unsigned int result(0);
+  MetadataList mdl=md.keys();
+  MetadataList::iterator mptr;
+  for(mptr=mdl.begin();mptr!=mdl.end();++mptr)
+  {
+    switch(mptr->mdt)
+    {
+      case MDreal:
+        result |= ArchiveRealClass;
+        break;
+      case MDint:
+        result |= ArchiveIntClass;
+        break;
+      case MDboolean:
+        result |= ArchiveBoolClass;
+        break;
+      case MDstring:
+        result |= ArchiveStringClass;
+        break;
+      default:
+        break;
+    }
+  }
+  return result;
+}
+template <typename H> unsigned int archive_classes(H& h)
+{
+  return 0;
+}
+template <typename H> bool archive_classes_complete(H& h,
+    unsigned int seen)
+{
+  return false;
+}
+inline unsigned int archive_classes(TimeSeriesHeader& h)
+{
+  unsigned int result=metadata_classes(h);
+  if(h.has_gap()) result |= ArchiveGapClass;
+  return result;
+}
+inline unsigned int archive_classes(ThreeComponentSeismogramHeader& h)
+{
+  unsigned int result=metadata_classes(h);
+  if(h.has_gap()) result |= ArchiveGapClass;
+  return result;
+}
+template <typename E> unsigned int ensemble_classes(E& h)
+{
+  unsigned int result=metadata_classes(h);
+  if(!h.member.empty()) result |= ArchiveMemberClass;
+  for(int i=0;i<h.member.size();++i)
+    result |= archive_classes(h.member[i]);
+  return result;
+}
+inline unsigned int archive_classes(TimeSeriesEnsembleHeader& h)
+{
+  return ensemble_classes(h);
+}
+inline unsigned int archive_classes(ThreeComponentEnsembleHeader& h)
+{
+  return ensemble_classes(h);
+}
+inline bool archive_classes_complete(TimeSeriesHeader& h, unsigned int seen)
+{
+  return (seen & ArchiveSeriesClasses)==ArchiveSeriesClasses;
+}
+inline bool archive_classes_complete(ThreeComponentSeismogramHeader& h,
+    unsigned int seen)
+{
+  return (seen & ArchiveSeriesClasses)==ArchiveSeriesClasses;
+}
+inline bool archive_classes_complete(TimeSeriesEnsembleHeader& h,
+    unsigned int seen)
+{
+  return (seen & ArchiveEnsembleClasses)==ArchiveEnsembleClasses;
+}
+inline bool archive_classes_complete(ThreeComponentEnsembleHeader& h,
+    unsigned int seen)
+{
+  return (seen & ArchiveEnsembleClasses)==ArchiveEnsembleClasses;
+}
+
+template <typename T>
+  SelectiveObjectReader<T>::SelectiveObjectReader(
+      shared_ptr<MetadataPredicate> pred, const char form)
+    : test(pred),format(form)
+{
+  input_is_stdio=true;
+  fname="STDIN";
+  in=&cin;
+  bin_ar=NULL;
+  nobjects=0;
+  nscanned=0;
+  nselected=0;
+  more_data_available=true;
+  indexed=false;
+  next_index=0;
+  nsequential=0;
+  classes_seen=0;
+  primed=false;
+  if(format=='t')
+    txtreader=shared_ptr<StreamObjectReader<T> >
+      (new StreamObjectReader<T>('t'));
+  else
+    bin_ar=new boost::archive::binary_iarchive(std::cin);
+}
+template <typename T>
+  SelectiveObjectReader<T>::SelectiveObjectReader(const string file,
+      shared_ptr<MetadataPredicate> pred, const char form, bool use_index)
+    : test(pred),format(form),fname(file)
+{
+  const string base_error("SelectiveObjectReader file constructor:  ");
+  input_is_stdio=false;
+  in=&ifs;
+  bin_ar=NULL;
+  nscanned=0;
+  nselected=0;
+  more_data_available=true;
+  indexed=false;
+  next_index=0;
+  nsequential=0;
+  classes_seen=0;
+  primed=false;
+  try{
+    if(format=='t')
+    {
+      txtreader=shared_ptr<StreamObjectReader<T> >
+        (new StreamObjectReader<T>(fname,'t'));
+      nobjects=txtreader->number_available();
+      return;
+    }
+    ifs.open(fname.c_str(),ios::in | ios::binary);
+    if(ifs.fail())
+      throw SeisppError(base_error+"cannot open file "+fname+" for input");
+    char tagbuf[BINARY_TAG_SIZE+1];
+    ifs.seekg(-(BinaryIOStreamEOFOffset),ios_base::end);
+    ifs.read(tagbuf,BINARY_TAG_SIZE);
+    tagbuf[BINARY_TAG_SIZE]='\0';
+    ifs.read((char*)(&nobjects),sizeof(long));
+    if(ifs.fail() || (string(tagbuf)!=eof_tag))
+      throw SeisppError(base_error + "File "
+        + fname + " does not appear to be a valid seispp boost serialization file");
+    if(use_index)
+    {
+      string idxfile=index_file_name(fname);
+      if(access(idxfile.c_str(),R_OK)==0)
+      {
+        idx.readindex(idxfile);
+        indexed=(idx.index_size()==nobjects);
+        if(indexed && (nobjects>0))
+        {
+          list<string> keys=test->keys();
+          list<string>::iterator kptr;
+          for(kptr=keys.begin();kptr!=keys.end();++kptr)
+            if(!idx.index[0].is_attribute_set(*kptr)) indexed=false;
+        }
+        if(!indexed)
+        {
+          idx.index.clear();
+          idx.foff.clear();
+        }
+      }
+    }
+    open_archive();
+  }catch(...){throw;};
+}
+template <typename T> SelectiveObjectReader<T>::~SelectiveObjectReader()
+{
+  if(bin_ar!=NULL) delete bin_ar;
+  if(!input_is_stdio && (format!='t')) ifs.close();
+}
+/* (Re)create the archive at the start of the file */
+template <typename T> void SelectiveObjectReader<T>::open_archive()
+{
+  if(bin_ar!=NULL) delete bin_ar;
+  bin_ar=NULL;
+  ifs.clear();
+  ifs.seekg(0,ios::beg);
+  bin_ar=new boost::archive::binary_iarchive(ifs);
+  nsequential=0;
+  classes_seen=0;
+  primed=false;
+}
+/* Read one object in header form at the current position.  Samples
+are loaded only if pred passes (all are loaded if pred is NULL).
+Returns true if the samples were loaded. */
+template <typename T>
+  bool SelectiveObjectReader<T>::read_header(Theader& h,
+      const MetadataPredicate *pred)
+{
+  try{
+    HeaderOnlyScope scope(in->rdbuf());
+    SampleLoadScope loadscope(pred);
+    SampleLoadScope::reset();
+    (*bin_ar)>>h;
+    return SampleLoadScope::samples_loaded();
+  }catch(SeisppError& serr){throw;}
+  catch(...)
+  {
+    throw SeisppError(string("SelectiveObjectReader:  ")
+      + "boost serialization read failed on "+fname
+      + "\nCheck that input is a valid boost binary serialization file");
+  }
+}
+/* Read one object at the current position without loading samples */
+template <typename T>
+  void SelectiveObjectReader<T>::skip_header(Theader& h)
+{
+  try{
+    HeaderOnlyScope scope(in->rdbuf());
+    (*bin_ar)>>h;
+  }catch(SeisppError& serr){throw;}
+  catch(...)
+  {
+    throw SeisppError(string("SelectiveObjectReader:  ")
+      + "boost serialization read failed on "+fname
+      + "\nCheck that input is a valid boost binary serialization file");
+  }
+}
+/* Read forward in file order, without loading samples, through
+object number last or until the archive has seen every class an
+object can contain.  Only used with an index. */
+template <typename T> void SelectiveObjectReader<T>::advance(long last)
+{
+  while(!primed && (nsequential<=last))
+  {
+    Theader h;
+    ifs.seekg(idx.foff[nsequential],ios::beg);
+    skip_header(h);
+    ++nsequential;
+    classes_seen |= archive_classes(h);
+    primed=archive_classes_complete(h,classes_seen);
+  }
+}
+template <typename T> bool SelectiveObjectReader<T>::read_sequential(T& d)
+{
+  const string base_error("SelectiveObjectReader read:  ");
+  char tagbuf[BINARY_TAG_SIZE+1];
+  const bool has_header_type=!(std::is_same<Theader,T>::value);
+  while(more_data_available)
+  {
+    if(!input_is_stdio && (nscanned>=nobjects))
+    {
+      more_data_available=false;
+      break;
+    }
+    Theader h;
+    bool loaded=read_header(h,test.get());
+    in->read(tagbuf,BINARY_TAG_SIZE);
+    tagbuf[BINARY_TAG_SIZE]='\0';
+    string tag(tagbuf);
+    if(tag==eof_tag)
+      more_data_available=false;
+    else if(tag!=more_data_tag)
+    {
+      more_data_available=false;
+      cerr << base_error<<"(WARNING): invalid end of data tag="
+        << tag<<endl
+        << "Read may be truncated"<<endl
+        << "Number of objects read so far="<<nscanned+1<<endl;
+    }
+    ++nscanned;
+    bool selected;
+    if(has_header_type)
+      selected=loaded;
+    else
+      selected=(*test)(dynamic_cast<Metadata&>(h));
+    if(selected)
+    {
+      header_to_object(h,d);
+      ++nselected;
+      return true;
+    }
+  }
+  return false;
+}
+template <typename T> bool SelectiveObjectReader<T>::read_indexed(T& d)
+{
+  long n=idx.index_size();
+  while(next_index<n)
+  {
+    long i=next_index;
+    ++next_index;
+    ++nscanned;
+    if(!(*test)(idx.index[i])) continue;
+    Theader h;
+    /* Objects are selected in file order so i is never less than
+    nsequential.   Until primed every object before i is read. */
+    advance(i-1);
+    ifs.seekg(idx.foff[i],ios::beg);
+    if(!ifs.good())
+      throw SeisppError(string("SelectiveObjectReader:  seekg failure in ")
+          + fname);
+    read_header(h,NULL);
+    if(!primed)
+    {
+      ++nsequential;
+      classes_seen |= archive_classes(h);
+      primed=archive_classes_complete(h,classes_seen);
+    }
+    header_to_object(h,d);
+    ++nselected;
+    return true;
+  }
+  return false;
+}
+template <typename T> bool SelectiveObjectReader<T>::next(T& d)
+{
+  try{
+    if(format=='t')
+    {
+      /* No pushdown possible for text - read everything */
+      while(!txtreader->eof())
+      {
+        d=txtreader->read();
+        ++nscanned;
+        if((*test)(dynamic_cast<Metadata&>(d)))
+        {
+          ++nselected;
+          return true;
+        }
+      }
+      return false;
+    }
+    if(indexed)
+      return read_indexed(d);
+    else
+      return read_sequential(d);
+  }catch(...){throw;};
+}
+} // End SEISPP namespace
+#endif
@@ -2,14 +2,32 @@
 #define _STREAM_OBJECT_INDEX_H_
 #include <fstream>
 #include <vector>
+#include <list>
+#include <exception>
 #include "seispp_io.h"
 #include "Metadata.h"
+#include "parallel_for.h"
 #include "StreamObjectReader.h"
+#include "ObjectHeaders.h"
 namespace SEISPP{
 using namespace std;
 using namespace SEISPP;
 const string IndexFileExtension("idx");
 const string FileOffsetKey("foff");
+/*! Magic string at the start of an index saved with writeindex_binary */
+const string BinaryIndexMagic("SPIX");
+/*! Return the default index file name for data file dfile */
+inline string index_file_name(const string dfile)
+{
+  std::size_t pos=dfile.rfind('.');
+  /* if period is not found just set the result to dfile.
+     Otherwise we use substr to extract what we need */
+  if(pos == std::string::npos)
+    return dfile+IndexFileExtension;
+  else
+    // +1 because of start at 0 in C
+    return dfile.substr(0,pos+1) + IndexFileExtension;
+}
 
 template <typename Tdata> class StreamObjectFileIndex
 {
@@ -17,6 +35,15 @@ public:
   vector<Metadata> index;
   vector<long> foff;
   StreamObjectFileIndex();
+  /*! \brief Build an index for a binary stream file.
+
+    The file is scanned with the header only version of Tdata (see
+    ObjectHeaders.h) so sample data are skipped with a seek rather than
+    deserialized.   Types without a header only version are read in full.
+
+    \param dfile - binary file written by StreamObjectWriter
+    \param mdl - list of Metadata attributes to copy to the index
+    */
   StreamObjectFileIndex(string dfile,MetadataList mdl);
   StreamObjectFileIndex(const StreamObjectFileIndex& parent);
   /*! Save the index as the root file name with a fixed extension.
@@ -29,10 +56,33 @@ public:
   int writeindex();
   int writeindex(const string fname);
   int writeindex(ofstream& ofs);
+  /*! \brief Save the index in binary form.
+
+    The text format produced by writeindex is portable but slow to parse
+    for large files.   This writes the same content as a binary archive
+    preceded by a magic string.   IndexedObjectReader recognizes either
+    format.  Like binary data files these should not be moved between
+    machines.  The no argument version uses the default file name.  */
+  int writeindex_binary();
+  int writeindex_binary(const string fname);
+  /*! \brief Load an index saved by writeindex or writeindex_binary.
+
+    Either format is recognized.   Any previous contents are replaced.
+
+    \param fname - index file name
+    \return number of objects in the index
+    \exception SeisppError is thrown if the file cannot be read or
+      was written for a different object type. */
+  int readindex(const string fname);
   int index_size()
   {
     return ndata;
   };
+  /*! Return the name of the data file this index references. */
+  string data_file_name()
+  {
+    return dfilename;
+  };
   StreamObjectFileIndex& operator=(const StreamObjectFileIndex& parent);
 private:
   int ndata;
@@ -50,24 +100,48 @@ template <typename Tdata>
    StreamObjectFileIndex<Tdata>::StreamObjectFileIndex(string dfile,
      MetadataList mdl) : dfilename(dfile)
 {
+  const string base_error("StreamObjectFileIndex constructor:  ");
+  typedef typename HeaderOnlyType<Tdata>::type Theader;
+  ifstream ifs;
+  ifs.open(dfile.c_str(),ios::in | ios::binary);
+  if(ifs.fail())
+    throw SeisppError(base_error+"cannot open file "+dfile+" for input");
+  /* The object count is at the end of the file.  Same as StreamObjectReader */
+  char tagbuf[BINARY_TAG_SIZE+1];
+  long nobjects;
+  ifs.seekg(-(BinaryIOStreamEOFOffset),ios_base::end);
+  ifs.read(tagbuf,BINARY_TAG_SIZE);
+  tagbuf[BINARY_TAG_SIZE]='\0';
+  ifs.read((char*)(&nobjects),sizeof(long));
+  if(ifs.fail() || (string(tagbuf)!=eof_tag))
+    throw SeisppError(base_error + "File "
+        + dfile + " does not appear to be a valid seispp boost serialization file");
+  ifs.seekg(0,ios::beg);
   try{
-    StreamObjectReader<Tdata> dfh(dfile,'b');
-    Tdata d;
-    Metadata mdtmp;
-    long foffnow;
-    foffnow=dfh.foff();
-    foff.push_back(foffnow);
-    while(dfh.good())
+    boost::archive::binary_iarchive ar(ifs);
+    HeaderOnlyScope scope(ifs.rdbuf());
+    foff.reserve(nobjects);
+    index.reserve(nobjects);
+    long i;
+    for(i=0;i<nobjects;++i)
     {
-      d=dfh.read();
-      foffnow=dfh.foff();
-      foff.push_back(foffnow);
+      foff.push_back(ifs.tellg());
+      Theader d;
+      ar>>d;
+      Metadata mdtmp;
       copy_selected_metadata(dynamic_cast<Metadata&>(d),mdtmp,mdl);
       index.push_back(mdtmp);
+      ifs.read(tagbuf,BINARY_TAG_SIZE);
+      if(ifs.fail())
+        throw SeisppError(base_error + "read error in file "+dfile);
     }
-    foff.pop_back();   //needed because last entry is eof
-    ndata=foff.size();
-  }catch(...){throw;};
+  }catch(SeisppError& serr){throw;}
+  catch(...)
+  {
+    throw SeisppError(base_error + "boost serialization read failed scanning file "
+        + dfile + "\nFile may be truncated or contain objects of a different type");
+  }
+  ndata=foff.size();
 }
 template <typename Tdata>StreamObjectFileIndex<Tdata>::StreamObjectFileIndex
    (const StreamObjectFileIndex& parent) : index(parent.index),foff(parent.foff),
@@ -79,15 +153,7 @@ template <typename Tdata>
    int StreamObjectFileIndex<Tdata>::writeindex()
 {
   try{
-    string indxfname;
-    std::size_t pos=dfilename.rfind('.');
-    /* if period is not found just set the result to dfilename.
-       Otherwise we use substr to extract what we need */
-    if(pos == std::string::npos)
-      indxfname=dfilename+IndexFileExtension;
-    else
-      // +1 because of start at 0 in C
-      indxfname=dfilename.substr(0,pos+1) + IndexFileExtension;
+    string indxfname=index_file_name(dfilename);
     int count;
     count=this->writeindex(indxfname);
     return count;
@@ -136,5 +202,158 @@ template <typename Tdata>
     return ndata;
   }catch(...){throw;};
 }
+template <typename Tdata>
+   int StreamObjectFileIndex<Tdata>::writeindex_binary()
+{
+  try{
+    return this->writeindex_binary(index_file_name(dfilename));
+  }catch(...){throw;};
+}
+template <typename Tdata>
+   int StreamObjectFileIndex<Tdata>::writeindex_binary(const string fname)
+{
+  try{
+    ofstream ofs;
+    ofs.open(fname.c_str(),ios::out | ios::binary | ios::trunc);
+    if(ofs.fail())
+    {
+      throw SeisppError(string("StreamObjectFileIndex writeindex_binary method:  ")
+          +"open filed on output index file="+fname);
+    }
+    if(foff.size()!=ndata)
+    {
+      throw SeisppError(string("StreamObjectFileIndex::writeindex_binary method:")
+           + "Coding error.\nInternally stored number of objects does not match actual vector size");
+    }
+    string tname(typeid(Tdata).name());
+    ofs.write(BinaryIndexMagic.c_str(),BINARY_TAG_SIZE);
+    boost::archive::binary_oarchive ar(ofs);
+    ar<<ndata;
+    ar<<dfilename;
+    ar<<tname;
+    ar<<index;
+    ar<<foff;
+    ofs.close();
+    return ndata;
+  }catch(...){throw;};
+}
+template <typename Tdata>
+   int StreamObjectFileIndex<Tdata>::readindex(const string indexfile)
+{
+  const string base_error("StreamObjectFileIndex readindex method:  ");
+  try{
+    ifstream ifs;
+    ifs.open(indexfile.c_str(),ios::in | ios::binary);
+    if(ifs.fail())
+    {
+      throw SeisppError(base_error+"cannot open file "+indexfile+" for input");
+    }
+    index.clear();
+    foff.clear();
+    /* An index saved with writeindex_binary starts with a magic string.
+    Anything else is assumed to be the original text format */
+    char tagbuf[BINARY_TAG_SIZE+1];
+    ifs.read(tagbuf,BINARY_TAG_SIZE);
+    tagbuf[BINARY_TAG_SIZE]='\0';
+    string tname;
+    int number_objects;
+    if(ifs.good() && (string(tagbuf)==BinaryIndexMagic))
+    {
+      boost::archive::binary_iarchive ia(ifs);
+      ia>>number_objects;
+      ia>>dfilename;
+      ia>>tname;
+      if(typeid(Tdata).name() != tname)
+      {
+        throw SeisppError(base_error+"type mismatch in data file\n"
+           + "Expected object type="+typeid(Tdata).name()
+           + " but index given is to a file of objects of type="+tname);
+      }
+      ia>>index;
+      ia>>foff;
+      if(foff.size()!=number_objects)
+        throw SeisppError(base_error+"Error in binary index file "+indexfile
+            + "\nNumber of offsets does not match object count");
+    }
+    else
+    {
+      ifs.clear();
+      ifs.seekg(0,ios::beg);
+      ifs>>number_objects;
+      ifs>>dfilename;
+      ifs>>tname;
+      if(typeid(Tdata).name() != tname)
+      {
+        throw SeisppError(base_error+"type mismatch in data file\n"
+           + "Expected object type="+typeid(Tdata).name()
+           + " but index given is to a file of objects of type="+tname);
+      }
+      /* Now we read in the index saved as a vector of Metadata objects */
+      boost::archive::text_iarchive ia(ifs);
+      int i;
+      index.reserve(number_objects);
+      foff.reserve(number_objects);
+      for(i=0;i<number_objects;++i)
+      {
+        Metadata mdin;
+        ia>>mdin;
+        index.push_back(mdin);
+        try{
+          foff.push_back(mdin.get<long>(FileOffsetKey));
+        }catch(MetadataGetError& mde)
+        {
+          throw SeisppError(base_error+"Error in index data\nRequired attribute foff missing");
+        }
+      }
+    }
+    ifs.close();
+    ndata=foff.size();
+    return ndata;
+  }catch(...){throw;};
+}
+/*! \brief Build indexes for a list of data files concurrently.
+
+Large data sets are commonly stored as many files read through
+DataSetReader.   This builds the index for each file in dfiles using
+nthreads threads and saves each with the default index file name.
+
+\param dfiles - list of binary stream files to index
+\param mdl - list of Metadata attributes to copy to each index
+\param nthreads - number of threads to use.  0 means use the number
+  of hardware threads.
+\param binary - when true (default) save indexes with writeindex_binary.
+
+\return list of index file names in the same order as dfiles.  This
+  list can be passed directly to the DataSetReader constructor.
+\exception SeisppError is thrown after all threads finish if any file
+  failed.
+*/
+template <typename Tdata> list<string> build_indexes(list<string> dfiles,
+        MetadataList mdl,int nthreads=0,bool binary=true)
+{
+  vector<string> files(dfiles.begin(),dfiles.end());
+  /* Every file is tried even if one fails, so failures are kept here
+  rather than left to stop parallel_for */
+  vector<std::exception_ptr> errors(files.size());
+  parallel_for(files.size(),nthreads,[&](long i)
+  {
+    try{
+      StreamObjectFileIndex<Tdata> idx(files[i],mdl);
+      if(binary)
+        idx.writeindex_binary();
+      else
+        idx.writeindex();
+    }catch(...)
+    {
+      errors[i]=std::current_exception();
+    }
+  });
+  int i;
+  for(i=0;i<errors.size();++i)
+    if(errors[i]) std::rethrow_exception(errors[i]);
+  list<string> result;
+  for(i=0;i<files.size();++i) result.push_back(index_file_name(files[i]));
+  return result;
+}
 } // End SEISPP namespace
 #endif
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "stock.h"
 #include "arrays.h"
 #include "coords.h"
@@ -31,13 +33,22 @@ typedef struct Vmodel{
 	int nlayers;
 } Vmodel;
 
-/* The hook for this function is just an Arr indexed by model:name 
-that is used to lookup a particular model that has already been loaded */
+/* The hook for this function now only remembers the model used by the
+last call.  Models themselves live in the process wide cache below
+(vmodel_cache) indexed by model:property.  Callers like the
+Hypocenter object in libseispp release their hook after every call,
+and when the models were owned by the hook that meant every travel
+time reread the model from the database. Models in the cache are
+never modified after they are loaded, so they can be shared freely
+among threads.  vmodel_mutex serializes cache updates and the
+Datascope calls used to load a model.*/
 typedef struct tt1dcvl_hook {
 	Vmodel *current_model;
-	Arr *ttlvz_models;
 } tt1dcvl_hook;
 
+static Arr *vmodel_cache=NULL;
+static pthread_mutex_t vmodel_mutex=PTHREAD_MUTEX_INITIALIZER;
+
 /* Shared libraries in Solaris will call an initialization routine 
 by this name when the library is first accessed.  This is the
 initialization routine for this calculator.  It reads a database
@@ -92,9 +103,7 @@ static void free_Vmodel(void *modp)
 }
 static void tt1dcvl_free_hook(void *oldp)
 {
-	tt1dcvl_hook *old = (tt1dcvl_hook *) oldp;
-
-	freearr(old->ttlvz_models,free_Vmodel);
+	free(oldp);
 }
 char *make_vmodel_key(char *model,char *property)
 {
@@ -185,9 +194,9 @@ Vmodel  *read_model_from_db(char *mod, char *property)
 /* As name implies this function manages the hook used by this
 calculator.  This does "lazy initialization" meaning a model is
 not loaded into memory until it is requested.  Function uses 
-an arr to index loaded models using a key created by the 
-make_vmodel_key function above.  The algorithm is basically
-when a model is not found in the arr, we attempt to read it.
+the process wide vmodel_cache to index loaded models using a key 
+created by the make_vmodel_key function above.  The algorithm is 
+basically when a model is not found in the arr, we attempt to read it.
 Normal return is 0 on sucesss, -5 if the read failed.  This 
 can be passed directly back through ttcalc interface as a 
 "no model" error.
@@ -200,29 +209,37 @@ int manage_hook_1dcvl (
 	Hook **hookp)
 {
 	tt1dcvl_hook *old;
-	static char *key;
+	char *key;
 	Vmodel *test;
 
 	if(*hookp == NULL) {
 		*hookp = new_hook ( tt1dcvl_free_hook );
 		allot(tt1dcvl_hook *, old, 1);
 		(*hookp)->p = old;
-		old->ttlvz_models = newarr(0);
 		old->current_model = NULL;
 	}
 	else
 	{
 		old = (*hookp)->p;
 	}
+	/* Avoid the key building and cache lookup when the same model
+	is requested repeatedly through the same hook */
+	test = old->current_model;
+	if( (test != NULL) && !strcmp(test->name,model)
+		&& !strcmp(test->property,property) ) return(0);
+
 	key = make_vmodel_key(model,property);
-	test = (Vmodel *)getarr(old->ttlvz_models,key);
+	pthread_mutex_lock(&vmodel_mutex);
+	if(vmodel_cache == NULL) vmodel_cache = newarr(0);
+	test = (Vmodel *)getarr(vmodel_cache,key);
 	if(test == NULL)
 	{
 		test = read_model_from_db(model,property);
-		if(test == NULL) return(-5);
-		setarr(old->ttlvz_models,key,test);
+		if(test != NULL) setarr(vmodel_cache,key,test);
 	}
+	pthread_mutex_unlock(&vmodel_mutex);
 	free(key);
+	if(test == NULL) return(-5);
 	old->current_model = test;
 	return(0);
 }
@@ -286,7 +303,6 @@ TTTime *tt1dcvl_compute_atime(TTGeometry *x,double d_km,double azimuth,
 		char *phase, char *model, char *property, 
 		int mode, Hook **hookp)
 {
-	double z0;  /* hold first layer depth (see below)  */
 	TTTime *t;
 	Vmodel *mod;
 
@@ -316,22 +332,20 @@ TTTime *tt1dcvl_compute_atime(TTGeometry *x,double d_km,double azimuth,
 	mod = (Vmodel *)(h->current_model);
  
 	/* We cheat and distort the model to handle elevation corrections.
-	We do this by storing the original velocity and depth of the 
-	first layer in (v0,z0), and then set the first point to the 
-	receiver depth.  */
-	z0 = mod->ztop[0];
+	We do this by working with a copy of the layer depths and setting 
+	the first point to the receiver depth.  The cached model is
+	shared and must never be altered.  */
+	nz = mod->nlayers;
+	allot(double *,z,nz);
+	memcpy(z,mod->ztop,nz*sizeof(double));
 	if(x->receiver.z < mod->ztop[1])
-		mod->ztop[0] = x->receiver.z;
+		z[0] = x->receiver.z;
 	else
 	{
 		elog_log(0,"Warning (ttlvz_time_exec):  elevation correction error\nStation elevation %lf lies below first layer depth %lf\nElevation ignored\n",
 			x->receiver.z, mod->ztop[1]);
 	}
-	/* This could be avoided, but it is a relic of the earlier code,
-	It also reduces the symbolic complexity a lot. */
 	v = mod->velocity;
-	z = mod->ztop;
-	nz = mod->nlayers;
 
 	allot(double *,work1,2*nz);
 	allot(double *,work2,2*nz);
@@ -344,7 +358,7 @@ TTTime *tt1dcvl_compute_atime(TTGeometry *x,double d_km,double azimuth,
 		free(t);
 		free(work1);
 		free(work2);
-		mod->ztop[0] = z0;
+		free(z);
 		return(NULL);
         }
 	if (mode & TT_DERIVATIVES) 
@@ -391,7 +405,7 @@ TTTime *tt1dcvl_compute_atime(TTGeometry *x,double d_km,double azimuth,
 	    t->deriv[2] = 0.0 ;
 	}
 
-	mod->ztop[0] = z0;
+	free(z);
 	free(work1);
 	free(work2);
 	return(t);
@@ -437,7 +451,6 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
 		char *phase, char *model, char *property, 
 		int mode, Hook **hookp)
 {
-	double z0;  /* hold first layer depth (see below)  */
 	Vmodel *mod;
 
 	double *v, *z;
@@ -469,25 +482,21 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
 	mod = (Vmodel *)(h->current_model);
  
 	/* We cheat and distort the model to handle elevation corrections.
-	We do this by storing the original velocity and depth of the 
-	first layer in (v0,z0), and then set the first point to the 
-	receiver depth.  I also do something devious here that could
-	be confusing.  I set the pointers v and z to the P or S 
-	model vectors depending on which phase I want to compute.  This
-	avoids repetitious code, but adds a slight overhead at the end
-	where we need to reset the first layer values again.*/
-	z0 = mod->ztop[0];
+	We do this by working with a copy of the layer depths and setting 
+	the first point to the receiver depth.  The cached model is
+	shared and must never be altered, so the copy has to be freed
+	on every exit below.*/
+	nz = mod->nlayers;
+	allot(double *,z,nz);
+	memcpy(z,mod->ztop,nz*sizeof(double));
 	if(x->receiver.z < mod->ztop[1])
-		mod->ztop[0] = x->receiver.z;
+		z[0] = x->receiver.z;
 	else
 	{
 		elog_log(0,"Warning (ttlvz_slowness_exec):  elevation correction error\nStation elevation %lf lies below first layer depth %lf\nElevation ignored\n",
 			x->receiver.z, mod->ztop[1]);
 	}
-	/* This could be avoided, but it is a relic of the earlier code */
 	v = mod->velocity;
-	z = mod->ztop;
-	nz = mod->nlayers;
 
 	work1 = (double *) calloc(2*nz,sizeof(double));
 	work2 = (double *) calloc(2*nz,sizeof(double));
@@ -502,7 +511,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
 		free(slow);
 		free(work1);
 		free(work2);
-		mod->ztop[0] = z0;
+		free(z);
 		return(NULL);
         }
 
@@ -547,7 +556,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
         			}
 				dudr = (p1-p)/dx;
@@ -571,7 +580,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
    				free(slow);
 				free(work1);
 				free(work2);
-				mod->ztop[0] = z0;
+				free(z);
 				return(NULL);
         		}
 			while(!up && (dx>=MINIMUM_DX) )
@@ -586,7 +595,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 			}
@@ -607,7 +616,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 
@@ -628,7 +637,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 				dis = d_km-dx;
@@ -640,7 +649,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 
@@ -653,7 +662,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 
@@ -666,7 +675,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 
@@ -710,7 +719,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 				dudz = (p0 - p)/DZ_STEP_SIZE;
@@ -726,7 +735,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
        				  free(slow);
 				  free(work1);
 			 	  free(work2);
-				  mod->ztop[0] = z0;
+				  free(z);
 				  return(NULL);
 				}
 				dudz = (p - p0)/DZ_STEP_SIZE;
@@ -754,7 +763,7 @@ TTSlow *tt1dcvl_compute_slowness(TTGeometry *x,double d_km,
 	    slow->uyderiv[1] = 0.0 ;
 	    slow->uyderiv[2] = 0.0 ;
 	}
-	mod->ztop[0] = z0;
+	free(z);
 	free(work1);
 	free(work2);
 	return(slow);
@@ -726,6 +726,19 @@ public:
 	// \param x3p - Cartesian x3 coordinate of point to find within the grid
 	*/
 	int lookup(double, double, double);
+	/*! 
+	// Find the index position of a point using an external index.
+	//
+	// Same algorithm and return codes as the three argument method, but
+	// the search starts from and returns its result in index instead 
+	// of the internal index of the object.  The object is not altered, so
+	// several threads can search the same grid at once as long as each
+	// has its own index.  
+	//
+	// \param index three element array holding the index of the cell
+	//   to start the search from.  On return it holds the result.
+	*/
+	int lookup(double x1p, double x2p, double x3p, int *index);
 	void reset_index() {ix1=i0; ix2=j0; ix3=k0;};
 	void get_index(int *ind) {ind[0]=ix1; ind[1]=ix2; ind[2]=ix3;};
 	/*! 
@@ -802,6 +815,11 @@ public:
         {
             fast_lookup=true;
         };
+        /*! Returns true if the fast lookup method is in use.*/
+        bool using_fast_lookup()
+        {
+            return fast_lookup;
+        };
 /*! 
 // Destructor.  Nontrivial destructor has to destroy the coordinate arrays correctly
 // and handle case when they are never defined.  Handles this by checking for 
@@ -1612,6 +1630,22 @@ int comp, bool reverse) throw(GCLgrid_error);
 vector<double> pathintegral(GCLscalarfield3d& field,dmatrix& path)
                                 throw(GCLgrid_error);
 /*! 
+//  Integrate a 3D field variable along a path into a caller supplied buffer.
+//
+//  Does not alter field, so it can be called from several threads.
+//  see man(3) pathintegral.
+*/
+int pathintegral(GCLscalarfield3d& field,dmatrix& path,double *result)
+                                throw(GCLgrid_error);
+/*! 
+//  Integrate a 3D field variable along many paths using several threads.
+//
+//  see man(3) pathintegral.
+*/
+void pathintegral(GCLscalarfield3d& field,vector<dmatrix *>& paths,
+	vector<double *>& results, int *npts, int nthreads=0)
+                                throw(GCLgrid_error);
+/*! 
 // Transformation from standard spherical to local coordinates.
 //
 //  see man(3) ustrans.
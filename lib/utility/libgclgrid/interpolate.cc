@@ -66,46 +66,24 @@ olf fortran code.
 
 
 
-void compute_element_weights(GCLgrid3d *g, 
-	int i, int j, int k,
-		double *xp, double *weights)
+/* Shape functions of the distorted box element.  dxunit is the position
+of the point in the unit cube of the cell (0 to 1 on each axis).  
+These are derived from old fortran FMLIN3 subroutine. */
+void element_shape_weights(double *dxunit, double *weights)
 {
-	dmatrix J(3,3),Jinv(3,3);
-	dvector dxunit(3),dxraw(3),xi(3);
-	J(0,0)=g->x1[i+1][j][k] - g->x1[i][j][k];
-	J(1,0)=g->x2[i+1][j][k] - g->x2[i][j][k];
-	J(2,0)=g->x3[i+1][j][k] - g->x3[i][j][k];
-
-	J(0,1)=g->x1[i][j+1][k] - g->x1[i][j][k];
-	J(1,1)=g->x2[i][j+1][k] - g->x2[i][j][k];
-	J(2,1)=g->x3[i][j+1][k] - g->x3[i][j][k];
-
-	J(0,2)=g->x1[i][j][k+1] - g->x1[i][j][k];
-	J(1,2)=g->x2[i][j][k+1] - g->x2[i][j][k];
-	J(2,2)=g->x3[i][j][k+1] - g->x3[i][j][k];
-
-	dxraw(0) = xp[0] - g->x1[i][j][k];
-	dxraw(1) = xp[1] - g->x2[i][j][k];
-	dxraw(2) = xp[2] - g->x3[i][j][k];
-
-	int three(3);
-	double det;
-	treex3_(J.get_address(0,0),&three,
-		Jinv.get_address(0,0),&three,&det);
-	dxunit=Jinv*dxraw;
+	double xi[3];
+	int ii;
 	/* This transformation is needed to go from 0->1 cube edges to -1 to +1 
 	needed for shape functions */
-	int ii;
-	for(ii=0;ii<3;++ii) xi(ii)=2*dxunit(ii)-1.0;
-	/* These are derived from old fortran FMLIN3 subroutine */
+	for(ii=0;ii<3;++ii) xi[ii]=2*dxunit[ii]-1.0;
 	double xip,xim,etap,etam,zetap,zetam;  
-	xim = 1.0 - xi(0);
-	etam = 1.0 - xi(1);
-	zetam = 1.0 - xi(2);
+	xim = 1.0 - xi[0];
+	etam = 1.0 - xi[1];
+	zetam = 1.0 - xi[2];
 	
-	xip = 1.0 + xi(0);
-	etap = 1.0 + xi(1);
-	zetap = 1.0 + xi(2);
+	xip = 1.0 + xi[0];
+	etap = 1.0 + xi[1];
+	zetap = 1.0 + xi[2];
 	weights[0]=0.125*xim*etam*zetam;
 	weights[1]=0.125*xim*etam*zetap;
 	weights[2]=0.125*xip*etam*zetap;
@@ -115,6 +93,41 @@ void compute_element_weights(GCLgrid3d *g,
 	weights[6]=0.125*xip*etap*zetap;
 	weights[7]=0.125*xip*etap*zetam;
 }
+/* The 3x3 algebra is written out rather than using dmatrix, whose 
+operators call the BLAS, so this can be called from several threads. */
+void compute_element_weights(GCLgrid3d *g, 
+	int i, int j, int k,
+		double *xp, double *weights)
+{
+	double J[9],Jinv[9];  // FORTRAN order
+	double dxunit[3],dxraw[3];
+	J[0]=g->x1[i+1][j][k] - g->x1[i][j][k];
+	J[1]=g->x2[i+1][j][k] - g->x2[i][j][k];
+	J[2]=g->x3[i+1][j][k] - g->x3[i][j][k];
+
+	J[3]=g->x1[i][j+1][k] - g->x1[i][j][k];
+	J[4]=g->x2[i][j+1][k] - g->x2[i][j][k];
+	J[5]=g->x3[i][j+1][k] - g->x3[i][j][k];
+
+	J[6]=g->x1[i][j][k+1] - g->x1[i][j][k];
+	J[7]=g->x2[i][j][k+1] - g->x2[i][j][k];
+	J[8]=g->x3[i][j][k+1] - g->x3[i][j][k];
+
+	dxraw[0] = xp[0] - g->x1[i][j][k];
+	dxraw[1] = xp[1] - g->x2[i][j][k];
+	dxraw[2] = xp[2] - g->x3[i][j][k];
+
+	int three(3);
+	double det;
+	treex3_(J,&three,Jinv,&three,&det);
+	int ii,jj;
+	for(ii=0;ii<3;++ii)
+	{
+		dxunit[ii]=0.0;
+		for(jj=0;jj<3;++jj) dxunit[ii]+=Jinv[ii+3*jj]*dxraw[jj];
+	}
+	element_shape_weights(dxunit,weights);
+}
 
 
 //vector interpolators switch from loop to a blas call when nv larger than this
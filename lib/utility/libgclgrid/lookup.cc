@@ -446,10 +446,26 @@ const double minimum_search_distance(1.0);
 // This saves time in curved grids inside the bounding box
 const double border_cutoff(2.0);
 int GCLgrid3d::lookup(double x, double y, double z) 
+{
+	int index[3];
+	int iret;
+	get_index(index);
+	iret=this->lookup(x,y,z,index);
+	ix1=index[0];
+	ix2=index[1];
+	ix3=index[2];
+	return(iret);
+}
+/* This is the algorithm described above.  index is used as the 
+starting point of the search and returns the result.  The grid 
+itself is not altered so different threads can search the same grid 
+with their own index.  For that reason the 3x3 algebra is written out
+here instead of using dmatrix operators, which call the BLAS. */
+int GCLgrid3d::lookup(double x, double y, double z, int *index) 
 {
 	int i,j,k;
 	int ilast, jlast, klast;
-	int ii;
+	int ii,jj;
 	double dxi[3],dxj[3],dxk[3];
 	double nrmdxi,nrmdxj,nrmdxk;
 	double dxiunit,dxjunit,dxkunit;
@@ -461,8 +477,8 @@ int GCLgrid3d::lookup(double x, double y, double z)
 	necessary to stop excessive iterations on edge points */
 	const double InnerRCut(4.0);
 	double drunit,drunit_last;
-	dmatrix J(3,3),Jinv(3,3);  // Jacobian and it's inverse
-	dvector dxraw(3),dxunit(3);
+	double J[9],Jinv[9];  // Jacobian and it's inverse (FORTRAN order)
+	double dxraw[3],dxunit[3];
 	int three(3);
 	double det;
 
@@ -472,9 +488,9 @@ int GCLgrid3d::lookup(double x, double y, double z)
 	  ||  (y > (x2high)) || (y < (x2low)) 
 	  ||  (z > (x3high)) || (z < (x3low)) ) return(1);
 
-	i = ix1;
-	j = ix2;
-	k = ix3;
+	i = index[0];
+	j = index[1];
+	k = index[2];
 	if(i<0) i=0;
 	if(j<0) j=0;
 	if(k<0) k=0;
@@ -506,26 +522,29 @@ int GCLgrid3d::lookup(double x, double y, double z)
 		nrmdxj = dr3mag(dxj);
 		nrmdxk = dr3mag(dxk);
 
-		dxraw(0) = x - (x1[i][j][k]);
-		dxraw(1) = y - (x2[i][j][k]);
-		dxraw(2) = z - (x3[i][j][k]);
+		dxraw[0] = x - (x1[i][j][k]);
+		dxraw[1] = y - (x2[i][j][k]);
+		dxraw[2] = z - (x3[i][j][k]);
 
 		// Now compute and use the local Jacobian
 		// to compute the number of grid cells to jump.
 		for(ii=0;ii<3;++ii)
 		{
-			J(ii,0)=dxi[ii];
-			J(ii,1)=dxj[ii];
-			J(ii,2)=dxk[ii];
+			J[ii]=dxi[ii];
+			J[ii+3]=dxj[ii];
+			J[ii+6]=dxk[ii];
 		}
 		// This is a FORTRAN function to invert a 3x3 matrix
 		// with an analytic form. It is the same routine
 		// called in the interpolate method in this library.
 		// All the address references are because this is
 		// FORTRAN which requires passing pointers.
-		treex3_(J.get_address(0,0),&three,
-			Jinv.get_address(0,0),&three,&det);
-		dxunit=Jinv*dxraw;
+		treex3_(J,&three,Jinv,&three,&det);
+		for(ii=0;ii<3;++ii)
+		{
+			dxunit[ii]=0.0;
+			for(jj=0;jj<3;++jj) dxunit[ii]+=Jinv[ii+3*jj]*dxraw[jj];
+		}
 		
 		// This is necessary as int truncation for
 		// negative numbers removes the fractional
@@ -533,17 +552,17 @@ int GCLgrid3d::lookup(double x, double y, double z)
 		//direction as it does for positive numbers
 		// Necessary as we are search for the lower right corner
 		// of each cell.
-		if(dxunit(0)<0) dxunit(0)-=1.0;
-		if(dxunit(1)<0) dxunit(1)-=1.0;
-		if(dxunit(2)<0) dxunit(2)-=1.0;
-		di=static_cast<int>(dxunit(0));
-		dj=static_cast<int>(dxunit(1));
-		dk=static_cast<int>(dxunit(2));
+		if(dxunit[0]<0) dxunit[0]-=1.0;
+		if(dxunit[1]<0) dxunit[1]-=1.0;
+		if(dxunit[2]<0) dxunit[2]-=1.0;
+		di=static_cast<int>(dxunit[0]);
+		dj=static_cast<int>(dxunit[1]);
+		dk=static_cast<int>(dxunit[2]);
 
 		i += di;
 		j += dj;
 		k += dk;
-		drunit=dr3mag(dxunit.get_address(0,0));
+		drunit=dr3mag(dxunit);
 		if( (drunit<InnerRCut) && (drunit_last<drunit) )
 		{
 			// crude, but assures recovery loop will
@@ -581,9 +600,9 @@ int GCLgrid3d::lookup(double x, double y, double z)
 		}
 	}
 	while( (ctest>0) && (count<MAXIT) );
-	ix1 = i;
-	ix2 = j;
-	ix3 = k;
+	index[0] = i;
+	index[1] = j;
+	index[2] = k;
  
 	if(ctest==0)
 	{
@@ -591,7 +610,7 @@ int GCLgrid3d::lookup(double x, double y, double z)
                 return(0);
             else
             {
-		GridCell cell(*this, ix1,ix2,ix3);
+		GridCell cell(*this, i,j,k);
 		if(cell.InsideTest(x,y,z,UnambiguousTest))
 		{
 			return(0);
@@ -601,11 +620,11 @@ int GCLgrid3d::lookup(double x, double y, double z)
 
 	// Use dxunit values to define search distance in each direction
 	double nrmdel,search_distance[3]; 
-	for(ii=0;ii<3;++ii)search_distance[ii]=fabs(dxunit(ii));
+	for(ii=0;ii<3;++ii)search_distance[ii]=fabs(dxunit[ii]);
 	// This is aimed to reduce search time for points outside the actual
 	// boundary.
-	if((ix1==0) || (ix2==0) || (ix3==0)
-		||(ix1==n1-2) || (ix2==n2-2) || (ix3==n3-2) )
+	if((i==0) || (j==0) || (k==0)
+		||(i==n1-2) || (j==n2-2) || (k==n3-2) )
 	{
 		for(ii=0;ii<3;++ii)
 		{
@@ -625,18 +644,20 @@ int GCLgrid3d::lookup(double x, double y, double z)
 	}
 
 	
-	int *irecov=recover(*this,x,y,z,ix1,ix2,ix3,search_distance);
+	int *irecov=recover(*this,x,y,z,i,j,k,search_distance);
 	int iret;
 	if(irecov[0]<0) 
 	{
-		this->reset_index();
+		index[0]=i0;
+		index[1]=j0;
+		index[2]=k0;
 		iret=-1;
 	}
 	else
 	{
-		ix1=irecov[0];
-		ix2=irecov[1];
-		ix3=irecov[2];
+		index[0]=irecov[0];
+		index[1]=irecov[1];
+		index[2]=irecov[2];
 		iret=0;
 	}
 	delete [] irecov;
@@ -1,6 +1,161 @@
 #include <vector>
 #include "gclgrid.h"
 #include "dmatrix.h"
+#include "parallel_for.h"
+/* function prototypes used only here */
+extern "C" {
+extern void treex3_(double *, int *, double *, int *, double *);
+}
+void element_shape_weights(double *dxunit, double *weights);
+
+/* Evaluates a scalar field at successive points along a path.  A ray 
+path is normally sampled much more finely than the grid, so most points
+fall in the same cell as the one before.  This object keeps the lookup
+index and the inverse Jacobian of the current cell so such points cost 
+one 3x3 matrix-vector product.  The lookup and the Jacobian are only
+computed again when the path leaves the cell.  The field is never 
+altered, so any number of these can work on one field at once.  */
+class PathCursor
+{
+public:
+	PathCursor(GCLscalarfield3d& f);
+	/* Returns 0 and the field value at x in val, or the nonzero
+	return code of lookup when x is not in the grid */
+	int value(double *x, double& val);
+private:
+	GCLscalarfield3d& field;
+	int index[3];
+	int cell[3];  // cell of Jinv and x0 (cell[0]<0 if none)
+	double x0[3];
+	double Jinv[9];
+	void set_cell();
+	void unit_coordinates(double *x, double *u);
+};
+PathCursor::PathCursor(GCLscalarfield3d& f) : field(f)
+{
+	// Same starting point as reset_index
+	index[0]=field.i0;
+	index[1]=field.j0;
+	index[2]=field.k0;
+	cell[0]=-1;
+	cell[1]=-1;
+	cell[2]=-1;
+}
+void PathCursor::set_cell()
+{
+	int i=index[0];
+	int j=index[1];
+	int k=index[2];
+	double J[9];
+	int three(3);
+	double det;
+	J[0]=field.x1[i+1][j][k] - field.x1[i][j][k];
+	J[1]=field.x2[i+1][j][k] - field.x2[i][j][k];
+	J[2]=field.x3[i+1][j][k] - field.x3[i][j][k];
+	J[3]=field.x1[i][j+1][k] - field.x1[i][j][k];
+	J[4]=field.x2[i][j+1][k] - field.x2[i][j][k];
+	J[5]=field.x3[i][j+1][k] - field.x3[i][j][k];
+	J[6]=field.x1[i][j][k+1] - field.x1[i][j][k];
+	J[7]=field.x2[i][j][k+1] - field.x2[i][j][k];
+	J[8]=field.x3[i][j][k+1] - field.x3[i][j][k];
+	treex3_(J,&three,Jinv,&three,&det);
+	x0[0]=field.x1[i][j][k];
+	x0[1]=field.x2[i][j][k];
+	x0[2]=field.x3[i][j][k];
+	cell[0]=i;
+	cell[1]=j;
+	cell[2]=k;
+}
+void PathCursor::unit_coordinates(double *x, double *u)
+{
+	double dx[3];
+	int ii;
+	for(ii=0;ii<3;++ii) dx[ii]=x[ii]-x0[ii];
+	for(ii=0;ii<3;++ii)
+		u[ii]=Jinv[ii]*dx[0]+Jinv[ii+3]*dx[1]+Jinv[ii+6]*dx[2];
+}
+int PathCursor::value(double *x, double& val)
+{
+	double u[3],w[8];
+	int i,j,k;
+	bool incell(false);
+
+	if( (x[0] > field.x1high) || (x[0] < field.x1low) 
+	  ||  (x[1] > field.x2high) || (x[1] < field.x2low) 
+	  ||  (x[2] > field.x3high) || (x[2] < field.x3low) ) return(1);
+	/* This is the test the first pass of lookup would make starting
+	from this cell.  The high accuracy method does more, so it always
+	has to go through lookup. */
+	if( (cell[0]>=0) && field.using_fast_lookup())
+	{
+		unit_coordinates(x,u);
+		if( (u[0]>=0.0) && (u[0]<1.0) && (u[1]>=0.0) && (u[1]<1.0)
+			&& (u[2]>=0.0) && (u[2]<1.0) ) incell=true;
+	}
+	if(!incell)
+	{
+		int iret=field.lookup(x[0],x[1],x[2],index);
+		if(iret) return(iret);
+		if( (index[0]!=cell[0]) || (index[1]!=cell[1])
+			|| (index[2]!=cell[2]) ) set_cell();
+		unit_coordinates(x,u);
+	}
+	element_shape_weights(u,w);
+	i=cell[0];
+	j=cell[1];
+	k=cell[2];
+	val=w[0]*field.val[i][j][k];
+	val+=w[1]*field.val[i][j][k+1]; 
+	val+=w[2]*field.val[i+1][j][k+1];
+	val+=w[3]*field.val[i+1][j][k];
+	val+=w[4]*field.val[i][j+1][k];
+	val+=w[5]*field.val[i][j+1][k+1];
+	val+=w[6]*field.val[i+1][j+1][k+1];
+	val+=w[7]*field.val[i+1][j+1][k];
+	return(0);
+}
+/* Integrates field along path, a 3xn matrix of points in the Cartesian 
+system of field, with the trapezoidal rule.  result must have room for 
+n values; result[i] is the integral from the first point to point i.  
+Each field value is computed once and used for both intervals that 
+share the point.  If a point is not inside the grid the integration
+stops there.  The function returns the number of values set in result,
+which is less than n when the path left the grid.  The internal lookup
+index of field is not used or altered.  
+
+Throws a GCLgrid_error if path does not have 3 rows.  
+*/
+int pathintegral(GCLscalarfield3d& field,dmatrix& path,double *result)
+				throw(GCLgrid_error)
+{
+	int npts;
+	int i;
+	double *x,*xlast;
+	double val,vallast;
+	double dx1,dx2,dx3,dx;
+
+	if(path.rows()!=3)
+	  throw(GCLgrid_error("pathintegral:  input matrix of path coordinates has incorrect dimensions"));
+	npts=path.columns();
+	if(npts<=0) return(0);
+	PathCursor cursor(field);
+	result[0]=0.0;
+	xlast=path.get_address(0,0);
+	if(cursor.value(xlast,vallast)) return(1);
+	for(i=1;i<npts;++i)
+	{
+		x=xlast+3;
+		if(cursor.value(x,val)) break;
+		dx1 = x[0]-xlast[0];
+		dx2 = x[1]-xlast[1];
+		dx3 = x[2]-xlast[2];
+		dx = sqrt(dx1*dx1+dx2*dx2+dx3*dx3);
+		result[i]=result[i-1]+(vallast+val)*dx/2.0;
+		vallast=val;
+		xlast=x;
+	}
+	return(i);
+}
 /* General purpose utility to integrate a scalar field variable
 along a path defined by the input matrix path.  The prototype
 example of this for us seismologists is integration of slowness
@@ -28,46 +183,64 @@ Written:  June 2003
 vector <double> pathintegral(GCLscalarfield3d& field,dmatrix& path)
 				throw(GCLgrid_error)
 {
-	int *sz;
 	int npts;
-	double outval,outval_last;
-	int index[3];
-	double val1,val2;  // averaged to get field value for interval
-	double dx;  // path increment
-	vector<double> outvec;
-	int i;
-
-	sz=path.size();
-	npts = sz[1];
-	if(sz[0]!=3) 
-	{
-	  delete [] sz;
+	if(path.rows()!=3) 
 	  throw(GCLgrid_error("pathintegral:  input matrix of path coordinates has incorrect dimensions"));
-	}
-	delete [] sz;  // no longer needed
-	outvec.reserve(npts);
-	// push 0 to the first point 
-	outvec.push_back(0.0);
-	// This was found to alway be prudent
-	field.reset_index();
-	for( i=1,outval=0.0,outval_last=0.0;i<npts;++i)
+	npts=path.columns();
+	// Always return at least the 0 for the first point 
+	vector<double> outvec(npts>0 ? npts : 1,0.0);
+	if(npts>0)
 	{
-		double dx1,dx2,dx3;
-		if(field.lookup(path(0,i-1),path(1,i-1),path(2,i-1))) break;
-		val1=field.interpolate(path(0,i),path(1,i),path(2,i));
-		if(field.lookup(path(0,i),path(1,i),path(2,i))) break;
-		val2=field.interpolate(path(0,i),path(1,i),path(2,i));
-		// This could be functionized, but I'll make it inline
-		dx1 = path(0,i)-path(0,i-1);
-		dx2 = path(1,i)-path(1,i-1);
-		dx3 = path(2,i)-path(2,i-1);
-		dx = sqrt(dx1*dx1+dx2*dx2+dx3*dx3);
-		outval=outval_last+(val1+val2)*dx/2.0;
-		outval_last = outval;
-		outvec.push_back(outval);
+		npts=pathintegral(field,path,&(outvec[0]));
+		outvec.resize(npts);
 	}
 	return(outvec);
 }
+/* Integrates field along each of a list of paths.  This is the 
+function to use when a large number of rays are traced through one
+model (e.g. the forward step of tomography).  The paths are divided
+among nthreads threads (0 means one per processor).  
+
+Arguments:
+	field - field to integrate (not altered)
+	paths - list of 3xn path matrices (see above)
+	results - parallel list to paths of buffers to hold the 
+		integrals.  results[i] must have room for 
+		paths[i]->columns() values.
+	npts - array of paths.size() values.  On return npts[i] is 
+		the number of values set in results[i].  It is less 
+		than the number of points in paths[i] if that path 
+		left the grid.  
+	nthreads - number of threads to use.
+
+Throws a GCLgrid_error before any work is done if results and paths
+are not the same size or any path does not have 3 rows.  
+*/
+void pathintegral(GCLscalarfield3d& field,vector<dmatrix *>& paths,
+	vector<double *>& results, int *npts, int nthreads)
+				throw(GCLgrid_error)
+{
+	int npaths=paths.size();
+	int i;
+	if(results.size()!=paths.size())
+	  throw(GCLgrid_error("pathintegral:  number of result buffers does not match the number of paths"));
+	for(i=0;i<npaths;++i)
+	{
+	  if(paths[i]->rows()!=3)
+	    throw(GCLgrid_error("pathintegral:  input matrix of path coordinates has incorrect dimensions"));
+	}
+	/* Paths are handed out in small blocks as ray lengths vary a lot */
+	const int blocksize(64);
+	int nblocks=(npaths+blocksize-1)/blocksize;
+	SEISPP::parallel_for(nblocks,nthreads,[&](long b)
+	{
+		int first=b*blocksize;
+		int last=first+blocksize;
+		if(last>npaths) last=npaths;
+		for(int j=first;j<last;++j)
+			npts[j]=pathintegral(field,*(paths[j]),results[j]);
+	});
+}
 /* A path defined by a 3xn dmatrix is defined by the Cartesian reference frame in the
 grid from which it is derived.  If one wants to use this path inside another grid, 
 which does not necessarily have the same Cartesian transformation, the path has
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include "seispp.h"
+#include "dbpp.h"
+#include "ProcessingQueue.h"
+using namespace std;
+using namespace SEISPP;
+/* Test of MappedProcessingQueue.   Two queue objects on the same file
+stand in for two processes sharing a queue.   The queue file is read
+directly to check the high water mark and status of each record.  The
+layout is 3 longs (record count, table, high water mark) followed by
+one int status per record (see MappedProcessingQueue.cc). */
+bool SEISPP::SEISPP_verbose(false);
+const string qfile("test_queue.q");
+void remove_queue()
+{
+  remove(qfile.c_str());
+  remove((qfile+".hb").c_str());
+}
+long queue_hwm()
+{
+  long header[3];
+  FILE *fp=fopen(qfile.c_str(),"r");
+  if(fp==NULL) return -1;
+  if(fread(header,sizeof(long),3,fp)!=3) header[2]=-1;
+  fclose(fp);
+  return header[2];
+}
+int queue_status(long record)
+{
+  int s(-1);
+  FILE *fp=fopen(qfile.c_str(),"r");
+  if(fp==NULL) return -1;
+  fseek(fp,3*sizeof(long)+record*sizeof(int),SEEK_SET);
+  if(fread(&s,sizeof(int),1,fp)!=1) s=-1;
+  fclose(fp);
+  return s;
+}
+long current_record(MappedProcessingQueue& q, DatascopeHandle& dbh)
+{
+  q.set_to_current(dbh);
+  return dbh.db.record;
+}
+int check(bool ok, const string message)
+{
+  if(ok) return 0;
+  cerr << "FAILED:  "<<message<<endl;
+  return 1;
+}
+/* Records are claimed batch_size at a time and a second queue skips
+records held by the first.  The high water mark must stop at a
+PROCESSING record even when FINISHED records follow it, so a record
+returned to the queue as TODO is found again. */
+int test_batches(DatascopeHandle& dbh)
+{
+  int nerr(0);
+  int i;
+  remove_queue();
+  MappedProcessingQueue *q1=new MappedProcessingQueue(dbh,qfile,1,0);
+  nerr+=check(q1->records_claimed()==1,"first queue did not claim 1 record");
+  nerr+=check(current_record(*q1,dbh)==0,"first queue does not start at record 0");
+  MappedProcessingQueue q2(dbh,qfile,3,0);
+  nerr+=check(q2.records_claimed()==3,"second queue did not claim 3 records");
+  nerr+=check(current_record(q2,dbh)==1,
+    "second queue did not skip the record held by the first");
+  for(i=0;i<3;++i) q2.mark(FINISHED);
+  for(i=1;i<4;++i)
+    nerr+=check(queue_status(i)==FINISHED,"record not marked FINISHED");
+  nerr+=check(current_record(q2,dbh)==4,
+    "second queue did not claim the next free batch");
+  nerr+=check(queue_hwm()==0,
+    "high water mark moved past a PROCESSING record");
+  /* q1 returns record 0 to the queue */
+  delete q1;
+  nerr+=check(queue_status(0)==TODO,"released record is not TODO");
+  for(i=0;i<3;++i) q2.mark(FINISHED);
+  nerr+=check(current_record(q2,dbh)==0,
+    "record returned to the queue was not claimed again");
+  cout << "Batch claims and high water mark tested"<<endl;
+  return nerr;
+}
+/* A queue with no heartbeat thread leaves its claims to go stale.  A
+queue with stale claim recovery takes them over, and the first queue
+then finds its claims lost and must not mark them. */
+int test_stale(DatascopeHandle& dbh)
+{
+  int nerr(0);
+  remove_queue();
+  MappedProcessingQueue qa(dbh,qfile,2,0);
+  nerr+=check(current_record(qa,dbh)==0,"first queue does not start at record 0");
+  sleep(3);
+  MappedProcessingQueue qb(dbh,qfile,2,1);
+  nerr+=check(qb.records_claimed()==2,"stale claims were not taken over");
+  nerr+=check(current_record(qb,dbh)==0,"stale claim on record 0 not taken over");
+  nerr+=check(qa.heartbeat()==0,"heartbeat did not find its claims lost");
+  qa.mark(FINISHED);
+  nerr+=check(queue_status(0)==PROCESSING,
+    "lost claim was marked by the process that lost it");
+  nerr+=check(current_record(qa,dbh)==2,
+    "lost claims were not dropped before claiming more records");
+  qb.mark(FINISHED);
+  nerr+=check(queue_status(0)==FINISHED,"record taken over was not marked");
+  cout << "Stale claim recovery tested"<<endl;
+  return nerr;
+}
+int main(int argc, char **argv)
+{
+  string dbname("../test_dbpp/testdata/testdb");
+  if(argc>1) dbname=string(argv[1]);
+  int nerr(0);
+  try{
+    DatascopeHandle dbh(dbname,true);
+    dbh.lookup("site");
+    nerr+=test_batches(dbh);
+    nerr+=test_stale(dbh);
+    remove_queue();
+  }catch(SeisppError& serr)
+  {
+    serr.log_error();
+    exit(-1);
+  }
+  if(nerr>0)
+  {
+    cerr << "test_queue:  "<<nerr<<" tests failed"<<endl;
+    exit(-1);
+  }
+  cout << "test_queue:  all tests passed"<<endl;
+}
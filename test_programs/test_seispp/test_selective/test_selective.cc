@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include "seispp.h"
+#include "ensemble.h"
+#include "StreamObjectWriter.h"
+#include "StreamObjectFileIndex.h"
+#include "SelectiveObjectReader.h"
+using namespace std;
+using namespace SEISPP;
+/* Test of SelectiveObjectReader selecting from an indexed file.   The 
+first ensembles written have members with empty Metadata and only one
+has data gaps.   Boost puts the class information for the Metadata map
+entries and gap windows in the first object that has them, so reads
+that seek past those objects fail unless the reader handles it. */
+bool SEISPP::SEISPP_verbose(false);
+const int nobjects(100);
+const int nmembers(3);
+const int nsamp(50);
+/* Ensembles before this one have members with empty Metadata */
+const int first_with_metadata(5);
+/* Only this ensemble has gaps */
+const int gap_ensemble(7);
+ThreeComponentEnsemble make_test_ensemble(int evid)
+{
+  ThreeComponentEnsemble d;
+  d.put("evid",evid);
+  int i,j,k;
+  for(i=0;i<nmembers;++i)
+  {
+    ThreeComponentSeismogram s(nsamp);
+    s.ns=nsamp;
+    s.dt=0.05;
+    s.t0=(double)evid;
+    s.live=true;
+    for(j=0;j<nsamp;++j)
+      for(k=0;k<3;++k) s.u(k,j)=evid*10000.0+i*1000.0+k*100.0+j;
+    if(evid>=first_with_metadata)
+    {
+      stringstream ss;
+      ss<<"S"<<i;
+      s.put("sta",ss.str());
+      s.put("lat",45.0+i);
+      s.put("verified",true);
+    }
+    if(evid==gap_ensemble) s.add_gap(TimeWindow(s.t0+0.5,s.t0+1.0));
+    d.member.push_back(s);
+  }
+  return d;
+}
+/* Returns an error message or an empty string if d matches what 
+make_test_ensemble wrote for evid */
+string check_ensemble(ThreeComponentEnsemble& d, int evid)
+{
+  stringstream ss;
+  if(d.get<int>("evid")!=evid)
+  {
+    ss<<"evid mismatch:  expected "<<evid<<" got "<<d.get<int>("evid");
+    return ss.str();
+  }
+  if(d.member.size()!=nmembers)
+  {
+    ss<<"evid "<<evid<<" has "<<d.member.size()<<" members";
+    return ss.str();
+  }
+  int i,j,k;
+  for(i=0;i<nmembers;++i)
+  {
+    ThreeComponentSeismogram& s=d.member[i];
+    if(s.ns!=nsamp)
+    {
+      ss<<"evid "<<evid<<" member "<<i<<" has "<<s.ns<<" samples";
+      return ss.str();
+    }
+    for(j=0;j<nsamp;++j)
+      for(k=0;k<3;++k)
+        if(s.u(k,j)!=(evid*10000.0+i*1000.0+k*100.0+j))
+        {
+          ss<<"evid "<<evid<<" member "<<i<<" sample data mismatch";
+          return ss.str();
+        }
+    if(evid>=first_with_metadata)
+    {
+      if(!s.is_attribute_set("sta") || (s.get<double>("lat")!=45.0+i)
+          || !s.get<bool>("verified"))
+      {
+        ss<<"evid "<<evid<<" member "<<i<<" Metadata mismatch";
+        return ss.str();
+      }
+    }
+    if(s.has_gap()!=(evid==gap_ensemble))
+    {
+      ss<<"evid "<<evid<<" member "<<i<<" gap mismatch";
+      return ss.str();
+    }
+  }
+  return string("");
+}
+/* Select with the evid test and verify the objects returned were 
+the ones expected from the expected range */
+int run_test(const string fname, MetadataTestOperator op, 
+    const string v1, const string v2, int first, int last)
+{
+  shared_ptr<MetadataPredicate> test(new MetadataKeyTest("evid",
+        MDint,op,v1,v2));
+  SelectiveObjectReader<ThreeComponentEnsemble> reader(fname,test);
+  if(!reader.using_index())
+  {
+    cerr << "Index was not used for selection"<<endl;
+    return 1;
+  }
+  ThreeComponentEnsemble d;
+  int evid=first;
+  while(reader.next(d))
+  {
+    if(evid>last)
+    {
+      cerr << "Too many objects selected"<<endl;
+      return 1;
+    }
+    string err=check_ensemble(d,evid);
+    if(err.length()>0)
+    {
+      cerr << err<<endl;
+      return 1;
+    }
+    ++evid;
+  }
+  if(evid!=(last+1))
+  {
+    cerr << "Expected "<<last-first+1<<" objects but got "
+      << evid-first<<endl;
+    return 1;
+  }
+  cout << "Selected evid "<<first<<" to "<<last<<" correctly"<<endl;
+  return 0;
+}
+int main(int argc, char **argv)
+{
+  const string fname("test_selective.bin");
+  int nerr(0);
+  try{
+    int i;
+    {
+      StreamObjectWriter<ThreeComponentEnsemble> writer(fname);
+      for(i=0;i<nobjects;++i)
+      {
+        ThreeComponentEnsemble d=make_test_ensemble(i);
+        writer.write(d);
+      }
+    }
+    MetadataList mdl;
+    Metadata_typedef mdt;
+    mdt.tag="evid";
+    mdt.mdt=MDint;
+    mdl.push_back(mdt);
+    StreamObjectFileIndex<ThreeComponentEnsemble> idx(fname,mdl);
+    idx.writeindex();
+    cout << "Testing selection past the objects holding class information"
+      <<endl;
+    nerr+=run_test(fname,MDTmin,"50","",50,nobjects-1);
+    cout << "Testing selection just past the objects with gaps"<<endl;
+    nerr+=run_test(fname,MDTrange,"8","9",8,9);
+    cout << "Testing selection from the start of the file"<<endl;
+    nerr+=run_test(fname,MDTmax,"2","",0,2);
+    remove(fname.c_str());
+    remove(index_file_name(fname).c_str());
+  }catch(SeisppError& serr)
+  {
+    serr.log_error();
+    exit(-1);
+  }
+  if(nerr>0)
+  {
+    cerr << "test_selective:  "<<nerr<<" tests failed"<<endl;
+    exit(-1);
+  }
+  cout << "test_selective:  all tests passed"<<endl;
+}